@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+
+"""
+Encode a single file with several mpv processes running in parallel.
+
+The input timeline is split into N segments of equal length. Each segment is
+encoded by its own mpv instance (using --start/--end with precise seeking, so
+the cuts are frame-exact and don't need to be on keyframes), and the encoded
+segments are joined with ffmpeg's concat demuxer without re-encoding.
+
+Usage:
+
+    encode-segments.py [-j JOBS] [-n SEGMENTS] input output [mpv options...]
+
+All extra options are passed to each mpv instance, e.g. --ovc=libx264
+--ovcopts=crf=20. Since every segment starts a new encoder, rate control and
+GOP structure restart at each cut; use enough material per segment (the
+default is one segment per job).
+
+Requires mpv and ffmpeg in PATH. Set MPV or FFMPEG to use other binaries.
+"""
+
+import argparse
+import concurrent.futures
+import os
+import subprocess
+import sys
+import tempfile
+
+mpv = os.environ.get("MPV", "mpv")
+ffmpeg = os.environ.get("FFMPEG", "ffmpeg")
+
+def get_duration(path):
+    out = subprocess.check_output([mpv, "--no-config", "--vo=null", "--ao=null",
+                                   "--frames=1", "--quiet",
+                                   "--term-playing-msg=DURATION=${=duration}",
+                                   "--", path],
+                                  universal_newlines=True)
+    for line in out.splitlines():
+        if line.startswith("DURATION="):
+            return float(line[len("DURATION="):])
+    sys.exit("could not determine the duration of '%s'" % path)
+
+def encode(path, start, end, output, opts):
+    cmd = [mpv, "--no-config", "--hr-seek=yes", "--start=%f" % start,
+           "--end=%f" % end, "--o=" + output] + opts + ["--", path]
+    return subprocess.call(cmd, stdin=subprocess.DEVNULL,
+                           stdout=subprocess.DEVNULL)
+
+def main():
+    parser = argparse.ArgumentParser(description="Parallel mpv encoding.")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1)
+    parser.add_argument("-n", "--segments", type=int, default=0)
+    parser.add_argument("input")
+    parser.add_argument("output")
+    args, opts = parser.parse_known_args()
+
+    segments = args.segments if args.segments > 0 else args.jobs
+    duration = get_duration(args.input)
+    ext = os.path.splitext(args.output)[1] or ".mkv"
+
+    with tempfile.TemporaryDirectory() as tmp:
+        parts = [os.path.join(tmp, "%05d%s" % (n, ext))
+                 for n in range(segments)]
+        step = duration / segments
+        with concurrent.futures.ThreadPoolExecutor(args.jobs) as pool:
+            jobs = [pool.submit(encode, args.input, n * step,
+                                (n + 1) * step if n + 1 < segments else duration,
+                                parts[n], opts)
+                    for n in range(segments)]
+            if any(job.result() != 0 for job in jobs):
+                sys.exit("encoding a segment failed")
+
+        listfile = os.path.join(tmp, "list.txt")
+        with open(listfile, "w") as f:
+            for part in parts:
+                f.write("file '%s'\n" % part.replace("'", "'\\''"))
+        r = subprocess.call([ffmpeg, "-loglevel", "error", "-y", "-f", "concat",
+                             "-safe", "0", "-i", listfile, "-c", "copy",
+                             args.output])
+        if r != 0:
+            sys.exit("joining the segments failed")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+from pyqtgraph.Qt import QtGui, QtCore
+import pyqtgraph as pg
+import math
+import sys
+
+"""
+This script displays the frame timing log written by mpv's dump-frame-timings
+command or --frame-timing-dump=filename (see --frame-timing-log). Each line
+in that file is a frame rendered (or dropped) by the VO:
+
+    <frame-id> <video-pts> <audio-pts> <decoded> <queued> <target>
+    <render-start> <render-end> <swap-start> <swap-end> <vsync>
+    <dropped> <delayed>
+
+Times are in microseconds, 0 if unknown. PTS values are in seconds, nan if
+unknown. All graphs use the time the frame was queued to the VO as x axis.
+"""
+
+filename = sys.argv[1]
+
+SCALE = 1e6 # microseconds to seconds
+
+frames = []
+for line in open(filename, "r"):
+    line = line.split("#")[0].strip()
+    if not line:
+        continue
+    f = line.split()
+    frames.append({
+        "video_pts": float(f[1]),
+        "audio_pts": float(f[2]),
+        "decoded": int(f[3]),
+        "queued": int(f[4]),
+        "render_start": int(f[6]),
+        "render_end": int(f[7]),
+        "swap_start": int(f[8]),
+        "swap_end": int(f[9]),
+        "vsync": int(f[10]),
+        "dropped": int(f[11]),
+        "delayed": int(f[12]),
+    })
+
+if not frames:
+    sys.exit("no frames in " + filename)
+
+start = frames[0]["queued"]
+def ts(f):
+    return (f["queued"] - start) / SCALE
+
+def span(f, a, b):
+    if not f[a] or not f[b]:
+        return None
+    return (f[b] - f[a]) / 1000.0 # ms
+
+def vsync_interval(f, prev):
+    if not prev or not f["vsync"] or not prev["vsync"]:
+        return None
+    return (f["vsync"] - prev["vsync"]) / 1000.0
+
+def av_difference(f, prev):
+    if math.isnan(f["video_pts"]) or math.isnan(f["audio_pts"]):
+        return None
+    return (f["video_pts"] - f["audio_pts"]) * 1000.0
+
+# Each curve is computed from the frame and the previous non-dropped frame.
+curves = {
+    "decode to queue (ms)":     lambda f, p: span(f, "decoded", "queued"),
+    "queue to swap (ms)":       lambda f, p: span(f, "queued", "swap_end"),
+    "render (ms)":              lambda f, p: span(f, "render_start", "render_end"),
+    "swap (ms)":                lambda f, p: span(f, "swap_start", "swap_end"),
+    "vsync interval (ms)":      vsync_interval,
+    "A-V (ms)":                 av_difference,
+}
+
+colors = [(0.0, 0.5, 0.0), (0.0, 0.0, 1.0), (0.0, 0.0, 0.0), (1.0, 0.0, 0.0), (0.75, 0.75, 0), (0.0, 0.75, 0.75), (0.75, 0, 0.75)]
+def mkColor(t):
+    return pg.mkColor(int(t[0] * 255), int(t[1] * 255), int(t[2] * 255))
+
+pg.setConfigOption('background', 'w')
+pg.setConfigOption('foreground', 'k')
+app = QtGui.QApplication([])
+win = pg.GraphicsWindow()
+
+ax = win.addPlot()
+ax.addLegend(offset = (-1, 1))
+win.nextRow()
+ev = win.addPlot()
+ev.addLegend(offset = (-1, 1))
+ev.setXLink(ax)
+
+for (name, fn), n in zip(sorted(curves.items()), range(len(curves))):
+    xs, ys = [], []
+    prev = None
+    for f in frames:
+        v = fn(f, prev)
+        if not f["dropped"]:
+            prev = f
+        if v is None:
+            continue
+        xs.append(ts(f))
+        ys.append(v)
+    color = mkColor(colors[n % len(colors)])
+    ax.plot(xs, ys, name=name, antialias=True, pen=pg.mkPen(color, width=0))
+
+for name, key, y, marker, n in [("dropped", "dropped", 2, "o", 3),
+                                ("delayed", "delayed", 1, "s", 1)]:
+    xs = [ts(f) for f in frames if f[key]]
+    color = mkColor(colors[n])
+    ev.plot(xs, [y] * len(xs), name=name, pen=None, symbol=marker,
+            symbolBrush=pg.mkBrush(color, width=0))
+
+QtGui.QApplication.instance().exec_()
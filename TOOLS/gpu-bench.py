@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+
+"""
+Benchmark the GPU renderer on synthetic input.
+
+Renders a libavfilter test pattern with --vo=gpu through a matrix of scaler
+and colorspace configurations, and reports the render pass times written by
+--gpu-perf-dump. Rendering runs --untimed, so each configuration is measured
+at full speed. Compare the output of two builds to catch shader performance
+regressions.
+
+Usage:
+
+    gpu-bench.py [-f FRAMES] [-s WxH] [-g WxH] [-p] [mpv options...]
+
+Extra options are passed to every mpv instance (e.g. --gpu-api=vulkan or
+--gpu-context=...). Set MPV to use a different binary. With -p, the time of
+every pass is listed in addition to the frame total.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+mpv = os.environ.get("MPV", "mpv")
+
+SCALERS = [
+    ("bilinear", ["--scale=bilinear", "--cscale=bilinear",
+                  "--dscale=bilinear"]),
+    ("spline36", ["--scale=spline36", "--cscale=spline36",
+                  "--dscale=mitchell"]),
+    ("ewa_lanczossharp", ["--scale=ewa_lanczossharp",
+                          "--cscale=ewa_lanczossharp", "--dscale=mitchell"]),
+]
+
+COLORS = [
+    ("sdr-8bit", "format=fmt=yuv420p"),
+    ("sdr-10bit", "format=fmt=yuv420p10"),
+    ("hdr-pq", "format=fmt=yuv420p10:colormatrix=bt.2020-ncl:"
+               "primaries=bt.2020:gamma=pq"),
+    ("hdr-pq-peak", "format=fmt=yuv420p10:colormatrix=bt.2020-ncl:"
+                    "primaries=bt.2020:gamma=pq"),
+]
+
+EXTRA = {
+    "hdr-pq-peak": ["--hdr-compute-peak=yes"],
+}
+
+def run(size, geometry, frames, scaler_opts, vf, extra, opts):
+    with tempfile.TemporaryDirectory() as tmp:
+        dump = os.path.join(tmp, "perf.txt")
+        cmd = [mpv, "--no-config", "--vo=gpu", "--untimed", "--no-audio",
+               "--osd-level=0", "--frames=%d" % frames,
+               "--geometry=" + geometry, "--gpu-perf-dump=" + dump,
+               "--vf=" + vf] + scaler_opts + extra + opts
+        cmd += ["--", "av://lavfi:testsrc2=size=%s:rate=60" % size]
+        r = subprocess.call(cmd, stdin=subprocess.DEVNULL,
+                            stdout=subprocess.DEVNULL)
+        if r != 0 or not os.path.exists(dump):
+            return None
+        res = []
+        with open(dump) as f:
+            for line in f:
+                if line.startswith("#") or line.startswith("\t"):
+                    continue
+                fields = line.rstrip("\n").split("\t")
+                if len(fields) < 7 or fields[0] != "fresh":
+                    continue
+                res.append((fields[1], [int(x) for x in fields[2:7]]))
+        return res
+
+def main():
+    parser = argparse.ArgumentParser(description="GPU renderer benchmark.")
+    parser.add_argument("-f", "--frames", type=int, default=600)
+    parser.add_argument("-s", "--size", default="1920x1080",
+                        help="source video size")
+    parser.add_argument("-g", "--geometry", default="3840x2160",
+                        help="window size (upscaling if larger than -s)")
+    parser.add_argument("-p", "--passes", action="store_true")
+    args, opts = parser.parse_known_args()
+
+    print("%-20s %-12s %8s %8s %8s  (us)" % ("scaler", "color", "p50",
+                                             "p90", "p99"))
+    failed = False
+    for sname, sopts in SCALERS:
+        for cname, vf in COLORS:
+            res = run(args.size, args.geometry, args.frames, sopts, vf,
+                      EXTRA.get(cname, []), opts)
+            if not res:
+                print("%-20s %-12s failed" % (sname, cname))
+                failed = True
+                continue
+            for desc, (count, p50, p90, p99, p999) in res:
+                if desc == "(total)":
+                    print("%-20s %-12s %8.1f %8.1f %8.1f" %
+                          (sname, cname, p50 / 1e3, p90 / 1e3, p99 / 1e3))
+            if args.passes:
+                for desc, (count, p50, p90, p99, p999) in res:
+                    if desc != "(total)":
+                        print("    %-45s %8.1f %8.1f %8.1f" %
+                              (desc[:45], p50 / 1e3, p90 / 1e3, p99 / 1e3))
+    if failed:
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
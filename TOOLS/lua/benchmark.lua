@@ -0,0 +1,111 @@
+-- Run a file through the pipeline as fast as possible and print a report of
+-- throughput numbers when playback ends, for comparing builds. Example:
+--
+--   mpv --script=benchmark.lua --untimed --no-audio-display --ao=null \
+--       --vo=null file.mkv
+--
+-- Use --vo=gpu (possibly with a hidden window, --force-window=no --no-border
+-- and a small --geometry) to include rendering on a real GPU.
+--
+-- Measuring starts with the first playback-restart event, so player startup
+-- and file opening are not included. The report is a single JSON object,
+-- written to the terminal, or to the file set with benchmark-output. Keys:
+--
+--   wall_time          seconds between start of playback and end of file
+--   demux_mb_per_s     demuxed packet data per wall second (MiB)
+--   decode_fps         video frames decoded per wall second
+--   decode_avg_ms      average time per video decoder call
+--   render_avg_ms      average VO render time per frame
+--   present_avg_ms     average VO present (flip) time per frame
+--   vo_dropped         frames dropped by the VO
+--   decoder_dropped    frames dropped by the decoder
+--   vf, af             per-filter statistics (as in vf-perf/af-perf)
+--   gpu_passes         render pass timings (as in vo-passes), if available
+--   peak_rss_mb        peak resident memory (Linux only)
+
+local utils = require 'mp.utils'
+local options = require 'mp.options'
+
+local o = {
+    output = "",
+}
+options.read_options(o)
+
+local start_time = nil
+local start_perf = nil
+
+mp.register_event("playback-restart", function()
+    if not start_time then
+        start_time = mp.get_time()
+        start_perf = mp.get_property_native("perf-counters")
+    end
+end)
+
+local function peak_rss_mb()
+    local f = io.open("/proc/self/status", "r")
+    if not f then
+        return nil
+    end
+    local res = nil
+    for line in f:lines() do
+        local kb = line:match("^VmHWM:%s*(%d+)")
+        if kb then
+            res = tonumber(kb) / 1024
+        end
+    end
+    f:close()
+    return res
+end
+
+local function timer_delta(now, before, name)
+    local a, b = now[name], before[name]
+    local count = a.count - b.count
+    local total = a.total - b.total
+    return count, count > 0 and total / count * 1000 or 0
+end
+
+local function report()
+    if not start_time then
+        return
+    end
+    local wall = mp.get_time() - start_time
+    local perf = mp.get_property_native("perf-counters")
+    start_time = nil
+    if not perf or wall <= 0 then
+        return
+    end
+
+    local res = {}
+    res.wall_time = wall
+    res.demux_mb_per_s =
+        (perf["demux-bytes"] - start_perf["demux-bytes"]) / 1048576 / wall
+    local frames, decode_avg = timer_delta(perf, start_perf, "video-decode")
+    res.decode_fps = frames / wall
+    res.decode_avg_ms = decode_avg
+    local _, render_avg = timer_delta(perf, start_perf, "vo-render")
+    res.render_avg_ms = render_avg
+    local _, present_avg = timer_delta(perf, start_perf, "vo-present")
+    res.present_avg_ms = present_avg
+    res.vo_dropped = perf["vo-dropped-frames"] - start_perf["vo-dropped-frames"]
+    res.decoder_dropped = mp.get_property_number("decoder-frame-drop-count", 0)
+    res.vf = mp.get_property_native("vf-perf")
+    res.af = mp.get_property_native("af-perf")
+    res.gpu_passes = mp.get_property_native("vo-passes")
+    res.peak_rss_mb = peak_rss_mb()
+
+    local json = utils.format_json(res)
+    if o.output ~= "" then
+        local f = io.open(o.output, "w")
+        if f then
+            f:write(json .. "\n")
+            f:close()
+        else
+            mp.msg.error("Can't write to " .. o.output)
+        end
+    else
+        print(json)
+    end
+end
+
+-- The properties above are still available before the file is unloaded.
+mp.add_hook("on_unload", 50, report)
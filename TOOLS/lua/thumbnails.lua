@@ -0,0 +1,125 @@
+-- Extract downscaled thumbnails at a list of timestamps. The file is opened
+-- only once: the demuxer, decoder and scaler are reused, and each thumbnail
+-- costs one keyframe seek plus one decoded frame (instead of starting mpv
+-- with --frames=1 --start=... for every thumbnail).
+--
+-- Command line usage:
+--
+--   mpv --script=thumbnails.lua --ao=null --vo=null \
+--       --script-opts=thumbnails-times=10,60,120,thumbnails-width=320 file.mkv
+--
+-- The player quits after the last thumbnail (see thumbnails-quit). Files are
+-- named by the thumbnails-template option, which is passed to string.format()
+-- with the thumbnail index (starting with 1). The file extension selects the
+-- image format, as with the screenshot-to-file command.
+--
+-- Clients (e.g. libmpv) can request a batch for the currently loaded file:
+--
+--   script-message thumbnails <template> <width> <time1> [<time2> ...]
+--
+-- A "thumbnails-done" script message is broadcast when the batch is finished.
+
+local options = require 'mp.options'
+
+local o = {
+    times = "",
+    width = 320,
+    template = "thumb-%04d.png",
+    quit = true,
+}
+options.read_options(o)
+
+local batch = nil
+
+local function finish()
+    local b = batch
+    batch = nil
+    mp.commandv("vf", "del", "@thumbnails")
+    mp.set_property_native("pause", b.was_paused)
+    mp.commandv("script-message", "thumbnails-done")
+    if b.quit then
+        mp.command("quit")
+    end
+end
+
+local function next_thumbnail()
+    local t = batch.times[batch.index]
+    if not t then
+        finish()
+        return
+    end
+    batch.seeking = true
+    batch.restarted = false
+    mp.commandv("seek", t, "absolute+keyframes")
+end
+
+local function start(template, width, times, quit)
+    if batch then
+        mp.msg.error("A thumbnail batch is already running.")
+        return
+    end
+    batch = {
+        template = template,
+        times = times,
+        index = 1,
+        quit = quit,
+        was_paused = mp.get_property_native("pause"),
+    }
+    mp.set_property_native("pause", true)
+    if width > 0 then
+        mp.commandv("vf", "add", "@thumbnails:scale=w=" .. width .. ":h=-2")
+    end
+    next_thumbnail()
+end
+
+-- The "seek" event confirms that our seek was executed; the playback-restart
+-- event after it means the target frame was decoded and is being displayed.
+mp.register_event("seek", function()
+    if batch and batch.seeking then
+        batch.restarted = true
+    end
+end)
+
+mp.register_event("playback-restart", function()
+    if not (batch and batch.seeking and batch.restarted) then
+        return
+    end
+    batch.seeking = false
+    local file = string.format(batch.template, batch.index)
+    mp.commandv("screenshot-to-file", file, "video")
+    batch.index = batch.index + 1
+    next_thumbnail()
+end)
+
+local function parse_times(list)
+    local times = {}
+    for _, s in ipairs(list) do
+        local t = tonumber(s)
+        if not t then
+            mp.msg.error("Invalid timestamp: " .. s)
+            return nil
+        end
+        times[#times + 1] = t
+    end
+    return times
+end
+
+mp.register_script_message("thumbnails", function(template, width, ...)
+    local times = parse_times({...})
+    if times and #times > 0 then
+        start(template, tonumber(width) or 0, times, false)
+    end
+end)
+
+if o.times ~= "" then
+    local list = {}
+    for s in string.gmatch(o.times, "[^,]+") do
+        list[#list + 1] = s
+    end
+    local times = parse_times(list)
+    if times then
+        mp.register_event("file-loaded", function()
+            start(o.template, o.width, times, o.quit)
+        end)
+    end
+end
@@ -59,6 +59,7 @@ struct mp_aconverter {
     struct mpv_global *global;
     double playback_speed;
     bool is_resampling;
+    double comp_ratio; // last ratio passed to avresample_set_compensation()
     bool passthrough_mode;
     struct AVAudioResampleContext *avrctx;
     struct mp_aframe *avrctx_fmt; // output format of avrctx
@@ -180,7 +181,10 @@ static bool configure_lavrr(struct mp_aconverter *p, bool verbose)
 
     p->in_rate = rate_from_speed(p->in_rate_user, p->playback_speed);
 
+    // With speed correction active, stay out of passthrough even if the rate
+    // rounds to the output rate, so the ratio can be adjusted continuously.
     p->passthrough_mode = p->opts->allow_passthrough &&
+                          p->playback_speed == 1.0 &&
                           p->in_rate == p->out_rate &&
                           p->in_format == p->out_format &&
                           mp_chmap_equals(&p->in_channels, &p->out_channels);
@@ -223,6 +227,17 @@ static bool configure_lavrr(struct mp_aconverter *p, bool verbose)
     av_opt_set_int(p->avrctx, "normalize_mix_level", !!normalize, 0);
 #endif
 
+    // Speed changes (e.g. --video-sync=display-resample) are applied with
+    // avresample_set_compensation(). Enable the resampler right away, instead
+    // of letting the library reinit itself on the first such call.
+    if (p->playback_speed != 1.0) {
+#if HAVE_LIBSWRESAMPLE
+        av_opt_set_int(p->avrctx, "flags", SWR_FLAG_RESAMPLE, 0);
+#else
+        av_opt_set_int(p->avrctx, "force_resampling", 1, 0);
+#endif
+    }
+
     if (mp_set_avopts(p->log, p->avrctx, p->opts->avopts) < 0)
         goto error;
 
@@ -323,6 +338,7 @@ static bool configure_lavrr(struct mp_aconverter *p, bool verbose)
     avresample_set_channel_mapping(p->avrctx, p->reorder_in);
 
     p->is_resampling = false;
+    p->comp_ratio = 0;
 
     if (avresample_open(p->avrctx) < 0 || avresample_open(p->avrctx_out) < 0) {
         MP_ERR(p, "Cannot open Libavresample Context. \n");
@@ -516,7 +532,7 @@ static void filter(struct mp_aconverter *p)
 
     int new_rate = rate_from_speed(p->in_rate_user, p->playback_speed);
 
-    if (p->passthrough_mode && new_rate != p->in_rate)
+    if (p->passthrough_mode && p->playback_speed != 1.0)
         configure_lavrr(p, false);
 
     if (p->passthrough_mode) {
@@ -527,9 +543,14 @@ static void filter(struct mp_aconverter *p)
         return;
     }
 
-    if (p->avrctx && !(!p->is_resampling && new_rate == p->in_rate)) {
-        AVRational r = av_d2q(p->playback_speed * p->in_rate_user / p->in_rate,
-                              INT_MAX / 2);
+    double ratio = p->playback_speed * p->in_rate_user / p->in_rate;
+    if (p->is_resampling && ratio == p->comp_ratio) {
+        // Unchanged since the last frame; the compensation is still active.
+        new_rate = p->in_rate;
+    } else if (p->avrctx && !(!p->is_resampling && new_rate == p->in_rate &&
+                              p->playback_speed == 1.0))
+    {
+        AVRational r = av_d2q(ratio, INT_MAX / 2);
         // Essentially, swr/avresample_set_compensation() does 2 things:
         // - adjust output sample rate by sample_delta/compensation_distance
         // - reset the adjustment after compensation_distance output samples
@@ -541,6 +562,7 @@ static void filter(struct mp_aconverter *p)
         if (avresample_set_compensation(p->avrctx, r.den - r.num, r.den) >= 0) {
             new_rate = p->in_rate;
             p->is_resampling = true;
+            p->comp_ratio = ratio;
         }
     }
 
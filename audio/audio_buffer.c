@@ -33,7 +33,9 @@ struct mp_audio_buffer {
     int num_planes;
     uint8_t *data[MP_NUM_CHANNELS];
     int allocated;
-    int num_samples;
+    int offset;         // start of the readable data
+    int num_samples;    // readable samples, starting at offset
+    uint8_t *read_ptr[MP_NUM_CHANNELS]; // returned by mp_audio_buffer_peek()
 };
 
 struct mp_audio_buffer *mp_audio_buffer_create(void *talloc_ctx)
@@ -52,6 +54,7 @@ void mp_audio_buffer_reinit_fmt(struct mp_audio_buffer *ab, int format,
     ab->channels = *channels;
     ab->srate = srate;
     ab->allocated = 0;
+    ab->offset = 0;
     ab->num_samples = 0;
     ab->sstride = af_fmt_to_bytes(ab->format);
     ab->num_planes = 1;
@@ -62,10 +65,33 @@ void mp_audio_buffer_reinit_fmt(struct mp_audio_buffer *ab, int format,
     }
 }
 
+// All integer parameters are in samples.
+// dst and src can overlap.
+static void copy_planes(struct mp_audio_buffer *ab,
+                        uint8_t **dst, int dst_offset,
+                        uint8_t **src, int src_offset, int length)
+{
+    for (int n = 0; n < ab->num_planes; n++) {
+        memmove((char *)dst[n] + dst_offset * ab->sstride,
+                (char *)src[n] + src_offset * ab->sstride,
+                length * ab->sstride);
+    }
+}
+
+// Move the readable data to the start of the internal buffer.
+static void compact(struct mp_audio_buffer *ab)
+{
+    if (ab->offset) {
+        copy_planes(ab, ab->data, 0, ab->data, ab->offset, ab->num_samples);
+        ab->offset = 0;
+    }
+}
+
 // Make the total size of the internal buffer at least this number of samples.
 void mp_audio_buffer_preallocate_min(struct mp_audio_buffer *ab, int samples)
 {
     if (samples > ab->allocated) {
+        compact(ab);
         for (int n = 0; n < ab->num_planes; n++) {
             ab->data[n] = talloc_realloc(ab, ab->data[n], char,
                                          ab->sstride * samples);
@@ -81,25 +107,21 @@ int mp_audio_buffer_get_write_available(struct mp_audio_buffer *ab)
     return ab->allocated - ab->num_samples;
 }
 
-// All integer parameters are in samples.
-// dst and src can overlap.
-static void copy_planes(struct mp_audio_buffer *ab,
-                        uint8_t **dst, int dst_offset,
-                        uint8_t **src, int src_offset, int length)
+// Make room for appending the given number of samples at the end.
+static void ensure_tail_space(struct mp_audio_buffer *ab, int samples)
 {
-    for (int n = 0; n < ab->num_planes; n++) {
-        memmove((char *)dst[n] + dst_offset * ab->sstride,
-                (char *)src[n] + src_offset * ab->sstride,
-                length * ab->sstride);
-    }
+    if (ab->offset + ab->num_samples + samples > ab->allocated)
+        compact(ab);
+    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
 }
 
 // Append data to the end of the buffer.
 // If the buffer is not large enough, it is transparently resized.
 void mp_audio_buffer_append(struct mp_audio_buffer *ab, void **ptr, int samples)
 {
-    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
-    copy_planes(ab, ab->data, ab->num_samples, (uint8_t **)ptr, 0, samples);
+    ensure_tail_space(ab, samples);
+    copy_planes(ab, ab->data, ab->offset + ab->num_samples,
+                (uint8_t **)ptr, 0, samples);
     ab->num_samples += samples;
 }
 
@@ -107,40 +129,54 @@ void mp_audio_buffer_append(struct mp_audio_buffer *ab, void **ptr, int samples)
 void mp_audio_buffer_prepend_silence(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0);
-    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
-    copy_planes(ab, ab->data, samples, ab->data, 0, ab->num_samples);
+    if (samples > ab->offset) {
+        ensure_tail_space(ab, samples);
+        copy_planes(ab, ab->data, ab->offset + samples,
+                    ab->data, ab->offset, ab->num_samples);
+    } else {
+        ab->offset -= samples;
+    }
     ab->num_samples += samples;
-    for (int n = 0; n < ab->num_planes; n++)
-        af_fill_silence(ab->data[n], samples * ab->sstride, ab->format);
+    for (int n = 0; n < ab->num_planes; n++) {
+        af_fill_silence(ab->data[n] + ab->offset * ab->sstride,
+                        samples * ab->sstride, ab->format);
+    }
 }
 
 void mp_audio_buffer_duplicate(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0 && samples <= ab->num_samples);
-    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
-    copy_planes(ab, ab->data, ab->num_samples,
-                ab->data, ab->num_samples - samples, samples);
+    ensure_tail_space(ab, samples);
+    copy_planes(ab, ab->data, ab->offset + ab->num_samples,
+                ab->data, ab->offset + ab->num_samples - samples, samples);
     ab->num_samples += samples;
 }
 
-// Get the start of the current readable buffer.
+// Get the start of the current readable buffer. The returned pointers are
+// valid until the next call that modifies the buffer.
 void mp_audio_buffer_peek(struct mp_audio_buffer *ab, uint8_t ***ptr,
                           int *samples)
 {
-    *ptr = ab->data;
+    for (int n = 0; n < ab->num_planes; n++)
+        ab->read_ptr[n] = ab->data[n] + ab->offset * ab->sstride;
+    *ptr = ab->read_ptr;
     *samples = ab->num_samples;
 }
 
 // Skip leading samples. (Used with mp_audio_buffer_peek() to read data.)
+// This doesn't move the remaining data; that happens lazily when appending.
 void mp_audio_buffer_skip(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0 && samples <= ab->num_samples);
-    copy_planes(ab, ab->data, 0, ab->data, samples, ab->num_samples - samples);
+    ab->offset += samples;
     ab->num_samples -= samples;
+    if (!ab->num_samples)
+        ab->offset = 0;
 }
 
 void mp_audio_buffer_clear(struct mp_audio_buffer *ab)
 {
+    ab->offset = 0;
     ab->num_samples = 0;
 }
 
@@ -25,38 +25,53 @@
 #include <libavutil/opt.h>
 
 #include "config.h"
+#include "common/common.h"
 #include "common/msg.h"
 #include "common/av_common.h"
 #include "options/options.h"
 #include "ad.h"
 
 #define OUTBUF_SIZE 65536
+// Upper bound for the bursts collected into a single output frame.
+#define MAX_OUTBUF_SIZE (1024 * 1024)
+// Collect bursts until the output frame has at least this duration (seconds).
+// This reduces the number of frames (and AO wakeups) for codecs with short
+// bursts, such as DTS.
+#define MIN_FRAME_DURATION 0.02
 
 struct spdifContext {
     struct mp_log   *log;
     enum AVCodecID   codec_id;
     AVFormatContext *lavf_ctx;
     int              out_buffer_len;
-    uint8_t          out_buffer[OUTBUF_SIZE];
+    uint8_t         *out_buffer;    // muxed bursts not returned yet (reused)
+    double           out_pts;       // pts of the first packet in out_buffer
+    int              min_frame_len; // in bytes, see MIN_FRAME_DURATION
     bool             need_close;
     bool             use_dts_hd;
     struct mp_aframe *fmt;
     int              sstride;
     struct mp_aframe_pool *pool;
     bool             got_eof;
-    struct demux_packet *queued_packet;
 };
 
 static int write_packet(void *p, uint8_t *buf, int buf_size)
 {
     struct spdifContext *ctx = p;
 
-    int buffer_left = OUTBUF_SIZE - ctx->out_buffer_len;
+    int buffer_left = MAX_OUTBUF_SIZE - ctx->out_buffer_len;
     if (buf_size > buffer_left) {
         MP_ERR(ctx, "spdif packet too large.\n");
         buf_size = buffer_left;
     }
 
+    size_t size = talloc_get_size(ctx->out_buffer);
+    if (ctx->out_buffer_len + buf_size > size) {
+        size = MPMIN(MPMAX(size * 2, ctx->out_buffer_len + buf_size),
+                     MAX_OUTBUF_SIZE);
+        ctx->out_buffer = talloc_realloc_size(ctx, ctx->out_buffer, size);
+    }
+
     memcpy(&ctx->out_buffer[ctx->out_buffer_len], buf, buf_size);
     ctx->out_buffer_len += buf_size;
     return buf_size;
@@ -74,7 +89,6 @@ static void uninit(struct dec_audio *da)
             av_freep(&lavf_ctx->pb->buffer);
         av_freep(&lavf_ctx->pb);
         avformat_free_context(lavf_ctx);
-        talloc_free(spdif_ctx->queued_packet);
         spdif_ctx->lavf_ctx = NULL;
     }
 }
@@ -86,6 +100,8 @@ static int init(struct dec_audio *da, const char *decoder)
     spdif_ctx->log = da->log;
     spdif_ctx->use_dts_hd = da->opts->dtshd;
     spdif_ctx->pool = mp_aframe_pool_create(spdif_ctx);
+    spdif_ctx->out_buffer = talloc_size(spdif_ctx, OUTBUF_SIZE);
+    spdif_ctx->out_pts = MP_NOPTS_VALUE;
 
     if (strcmp(decoder, "spdif_dts_hd") == 0)
         spdif_ctx->use_dts_hd = true;
@@ -258,6 +274,8 @@ static int init_filter(struct dec_audio *da, AVPacket *pkt)
     mp_aframe_set_rate(spdif_ctx->fmt, samplerate);
 
     spdif_ctx->sstride = mp_aframe_get_sstride(spdif_ctx->fmt);
+    spdif_ctx->min_frame_len =
+        (int)(samplerate * MIN_FRAME_DURATION) * spdif_ctx->sstride;
 
     if (avformat_write_header(lavf_ctx, &format_opts) < 0) {
         MP_FATAL(da, "libavformat spdif initialization failed.\n");
@@ -276,49 +294,64 @@ fail:
 }
 
 
+// The packet is muxed right away, so it doesn't need to be copied. The output
+// is collected in out_buffer until receive_frame() returns it.
 static bool send_packet(struct dec_audio *da, struct demux_packet *mpkt)
 {
     struct spdifContext *spdif_ctx = da->priv;
 
-    if (spdif_ctx->queued_packet || spdif_ctx->got_eof)
-        return false;
-
-    spdif_ctx->queued_packet = mpkt ? demux_copy_packet(mpkt) : NULL;
-    spdif_ctx->got_eof = !mpkt;
-    return true;
-}
-
-static bool receive_frame(struct dec_audio *da, struct mp_aframe **out)
-{
-    struct spdifContext *spdif_ctx = da->priv;
-
-    if (spdif_ctx->got_eof) {
-        spdif_ctx->got_eof = false;
+    if (spdif_ctx->got_eof)
         return false;
-    }
 
-    if (!spdif_ctx->queued_packet)
+    if (!mpkt) {
+        spdif_ctx->got_eof = true;
         return true;
+    }
 
-    double pts = spdif_ctx->queued_packet->pts;
+    // Don't accept more data until the collected bursts were returned.
+    if (spdif_ctx->out_buffer_len &&
+        spdif_ctx->out_buffer_len >= spdif_ctx->min_frame_len)
+        return false;
 
     AVPacket pkt;
-    mp_set_av_packet(&pkt, spdif_ctx->queued_packet, NULL);
+    mp_set_av_packet(&pkt, mpkt, NULL);
     pkt.pts = pkt.dts = 0;
     if (!spdif_ctx->lavf_ctx) {
         if (init_filter(da, &pkt) < 0)
-            goto done;
+            return true;
     }
-    spdif_ctx->out_buffer_len  = 0;
+    // Some codecs (TrueHD) output a burst only every few packets; the burst
+    // starts at the first of them.
+    if (spdif_ctx->out_pts == MP_NOPTS_VALUE)
+        spdif_ctx->out_pts = mpkt->pts;
     int ret = av_write_frame(spdif_ctx->lavf_ctx, &pkt);
     avio_flush(spdif_ctx->lavf_ctx->pb);
-    if (ret < 0) {
+    if (ret < 0)
         MP_ERR(da, "spdif mux error: '%s'\n", mp_strerror(AVUNERROR(ret)));
-        goto done;
+    return true;
+}
+
+static void reset_output(struct spdifContext *spdif_ctx)
+{
+    spdif_ctx->out_buffer_len = 0;
+    spdif_ctx->out_pts = MP_NOPTS_VALUE;
+}
+
+static bool receive_frame(struct dec_audio *da, struct mp_aframe **out)
+{
+    struct spdifContext *spdif_ctx = da->priv;
+
+    int len = spdif_ctx->out_buffer_len;
+    if (spdif_ctx->got_eof && !len) {
+        spdif_ctx->got_eof = false;
+        return false;
     }
 
+    if (!len || (len < spdif_ctx->min_frame_len && !spdif_ctx->got_eof))
+        return true;
+
     *out = mp_aframe_new_ref(spdif_ctx->fmt);
-    int samples = spdif_ctx->out_buffer_len / spdif_ctx->sstride;
+    int samples = len / spdif_ctx->sstride;
     if (mp_aframe_pool_allocate(spdif_ctx->pool, *out, samples) < 0) {
         TA_FREEP(out);
         goto done;
@@ -330,12 +363,11 @@ static bool receive_frame(struct dec_audio *da, struct mp_aframe **out)
         goto done;
     }
 
-    memcpy(data[0], spdif_ctx->out_buffer, spdif_ctx->out_buffer_len);
-    mp_aframe_set_pts(*out, pts);
+    memcpy(data[0], spdif_ctx->out_buffer, samples * spdif_ctx->sstride);
+    mp_aframe_set_pts(*out, spdif_ctx->out_pts);
 
 done:
-    talloc_free(spdif_ctx->queued_packet);
-    spdif_ctx->queued_packet = NULL;
+    reset_output(spdif_ctx);
     return true;
 }
 
@@ -344,8 +376,7 @@ static int control(struct dec_audio *da, int cmd, void *arg)
     struct spdifContext *spdif_ctx = da->priv;
     switch (cmd) {
     case ADCTRL_RESET:
-        talloc_free(spdif_ctx->queued_packet);
-        spdif_ctx->queued_packet = NULL;
+        reset_output(spdif_ctx);
         spdif_ctx->got_eof = false;
         return CONTROL_TRUE;
     }
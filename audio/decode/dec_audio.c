@@ -29,6 +29,7 @@
 #include "common/msg.h"
 #include "common/recorder.h"
 #include "misc/bstr.h"
+#include "misc/dec_thread.h"
 #include "options/options.h"
 
 #include "stream/stream.h"
@@ -50,9 +51,23 @@ static const struct ad_functions * const ad_drivers[] = {
     NULL
 };
 
+static void reset_decoder(struct dec_audio *d_audio)
+{
+    if (d_audio->ad_driver)
+        d_audio->ad_driver->control(d_audio, ADCTRL_RESET, NULL);
+    d_audio->pts = MP_NOPTS_VALUE;
+    talloc_free(d_audio->current_frame);
+    d_audio->current_frame = NULL;
+    talloc_free(d_audio->packet);
+    d_audio->packet = NULL;
+    talloc_free(d_audio->new_segment);
+    d_audio->new_segment = NULL;
+    d_audio->start = d_audio->end = MP_NOPTS_VALUE;
+}
+
 static void uninit_decoder(struct dec_audio *d_audio)
 {
-    audio_reset_decoding(d_audio);
+    reset_decoder(d_audio);
     if (d_audio->ad_driver) {
         MP_VERBOSE(d_audio, "Uninit audio decoder.\n");
         d_audio->ad_driver->uninit(d_audio);
@@ -112,7 +127,7 @@ static const struct ad_functions *find_driver(const char *name)
     return NULL;
 }
 
-int audio_init_best_codec(struct dec_audio *d_audio)
+static int init_best_codec(struct dec_audio *d_audio)
 {
     uninit_decoder(d_audio);
     assert(!d_audio->ad_driver);
@@ -149,26 +164,37 @@ int audio_init_best_codec(struct dec_audio *d_audio)
     return !!d_audio->ad_driver;
 }
 
+int audio_init_best_codec(struct dec_audio *d_audio)
+{
+    if (d_audio->thread)
+        mp_dec_thread_stop(d_audio->thread);
+    return init_best_codec(d_audio);
+}
+
 void audio_uninit(struct dec_audio *d_audio)
 {
     if (!d_audio)
         return;
+    talloc_free(d_audio->thread);
     uninit_decoder(d_audio);
     talloc_free(d_audio);
 }
 
 void audio_reset_decoding(struct dec_audio *d_audio)
 {
-    if (d_audio->ad_driver)
-        d_audio->ad_driver->control(d_audio, ADCTRL_RESET, NULL);
-    d_audio->pts = MP_NOPTS_VALUE;
-    talloc_free(d_audio->current_frame);
-    d_audio->current_frame = NULL;
-    talloc_free(d_audio->packet);
-    d_audio->packet = NULL;
-    talloc_free(d_audio->new_segment);
-    d_audio->new_segment = NULL;
-    d_audio->start = d_audio->end = MP_NOPTS_VALUE;
+    if (d_audio->thread)
+        mp_dec_thread_stop(d_audio->thread);
+    reset_decoder(d_audio);
+}
+
+void audio_set_recorder_sink(struct dec_audio *d_audio,
+                             struct mp_recorder_sink *sink)
+{
+    if (d_audio->thread)
+        mp_dec_thread_lock(d_audio->thread);
+    d_audio->recorder_sink = sink;
+    if (d_audio->thread)
+        mp_dec_thread_unlock(d_audio->thread);
 }
 
 static void fix_audio_pts(struct dec_audio *da)
@@ -202,7 +228,7 @@ static bool is_new_segment(struct dec_audio *da, struct demux_packet *p)
         (p->start != da->start || p->end != da->end || p->codec != da->codec);
 }
 
-void audio_work(struct dec_audio *da)
+static void decode_step(struct dec_audio *da)
 {
     if (da->current_frame || !da->ad_driver)
         return;
@@ -255,12 +281,12 @@ void audio_work(struct dec_audio *da)
         da->new_segment = NULL;
 
         if (da->codec == new_segment->codec) {
-            audio_reset_decoding(da);
+            reset_decoder(da);
         } else {
             da->codec = new_segment->codec;
             da->ad_driver->uninit(da);
             da->ad_driver = NULL;
-            audio_init_best_codec(da);
+            init_best_codec(da);
         }
 
         da->start = new_segment->start;
@@ -271,12 +297,7 @@ void audio_work(struct dec_audio *da)
     }
 }
 
-// Fetch an audio frame decoded with audio_work(). Returns one of:
-//  DATA_OK:    *out_frame is set to a new image
-//  DATA_WAIT:  waiting for demuxer; will receive a wakeup signal
-//  DATA_EOF:   end of file, no more frames to be expected
-//  DATA_AGAIN: dropped frame or something similar
-int audio_get_frame(struct dec_audio *da, struct mp_aframe **out_frame)
+static int get_frame(struct dec_audio *da, struct mp_aframe **out_frame)
 {
     *out_frame = NULL;
     if (da->current_frame) {
@@ -288,3 +309,70 @@ int audio_get_frame(struct dec_audio *da, struct mp_aframe **out_frame)
         return DATA_AGAIN;
     return da->current_state;
 }
+
+void audio_work(struct dec_audio *da)
+{
+    if (da->thread) {
+        mp_dec_thread_kick(da->thread);
+    } else {
+        decode_step(da);
+    }
+}
+
+// Fetch an audio frame decoded with audio_work(). Returns one of:
+//  DATA_OK:    *out_frame is set to a new image
+//  DATA_WAIT:  waiting for demuxer or decoder thread; will receive a wakeup
+//  DATA_EOF:   end of file, no more frames to be expected
+//  DATA_AGAIN: dropped frame or something similar
+int audio_get_frame(struct dec_audio *da, struct mp_aframe **out_frame)
+{
+    if (!da->thread)
+        return get_frame(da, out_frame);
+
+    void *frame;
+    int res = mp_dec_thread_get(da->thread, &frame);
+    *out_frame = frame;
+    return res;
+}
+
+static int thread_step(void *ctx, void **frame)
+{
+    struct dec_audio *da = ctx;
+
+    if (!da->ad_driver)
+        return DATA_EOF;
+
+    decode_step(da);
+
+    struct mp_aframe *fr;
+    int res = get_frame(da, &fr);
+    *frame = fr;
+    return res;
+}
+
+static void free_frame(void *frame)
+{
+    talloc_free(frame);
+}
+
+static const struct mp_dec_thread_fns thread_fns = {
+    .step = thread_step,
+    .free_frame = free_frame,
+};
+
+// Decode on a separate thread from now on, keeping up to queue_frames decoded
+// frames. wakeup(wakeup_ctx) is called when a new frame can be retrieved with
+// audio_get_frame().
+bool audio_init_thread(struct dec_audio *d_audio, int queue_frames,
+                       void (*wakeup)(void *ctx), void *wakeup_ctx)
+{
+    assert(!d_audio->thread);
+
+    d_audio->thread = mp_dec_thread_create(d_audio, "ad", &thread_fns, d_audio,
+                                           queue_frames, wakeup, wakeup_ctx);
+    if (!d_audio->thread) {
+        MP_ERR(d_audio, "Could not create decoder thread.\n");
+        return false;
+    }
+    return true;
+}
@@ -24,6 +24,7 @@
 #include "demux/stheader.h"
 
 struct mp_decoder_list;
+struct mp_dec_thread;
 
 struct dec_audio {
     struct mp_log *log;
@@ -49,16 +50,23 @@ struct dec_audio {
     struct demux_packet *new_segment;
     struct mp_aframe *current_frame;
     int current_state;
+
+    // Set if decoding runs on a separate thread (audio_init_thread()).
+    struct mp_dec_thread *thread;
 };
 
 struct mp_decoder_list *audio_decoder_list(void);
 int audio_init_best_codec(struct dec_audio *d_audio);
 void audio_uninit(struct dec_audio *d_audio);
+bool audio_init_thread(struct dec_audio *d_audio, int queue_frames,
+                       void (*wakeup)(void *ctx), void *wakeup_ctx);
 
 void audio_work(struct dec_audio *d_audio);
 int audio_get_frame(struct dec_audio *d_audio, struct mp_aframe **out_frame);
 
 void audio_reset_decoding(struct dec_audio *d_audio);
+void audio_set_recorder_sink(struct dec_audio *d_audio,
+                             struct mp_recorder_sink *sink);
 
 // ad_spdif.c
 struct mp_decoder_list *select_spdif_codec(const char *codec, const char *pref);
@@ -23,9 +23,12 @@
 
 #include "common/common.h"
 #include "common/global.h"
+#include "common/perf.h"
+#include "misc/node.h"
 
 #include "options/m_option.h"
 #include "options/m_config.h"
+#include "osdep/timer.h"
 
 #include "audio/audio_buffer.h"
 #include "af.h"
@@ -179,6 +182,7 @@ static struct af_instance *af_create(struct af_stream *s, char *name,
         .replaygain_data = s->replaygain_data,
         .out_pool = mp_audio_pool_create(af),
     };
+    af->perf = mp_perf_stat_create(af);
     struct m_config *config =
         m_config_from_obj_desc_and_args(af, s->log, NULL, &desc,
                                         name, s->opts->af_defs, args);
@@ -268,6 +272,23 @@ repeat:
     }
 }
 
+// Return per-filter statistics as node array (free with talloc_free(dst->u.list)).
+void af_get_perf_node(struct af_stream *s, struct mpv_node *dst)
+{
+    node_init(dst, MPV_FORMAT_NODE_ARRAY, NULL);
+    for (struct af_instance *af = s->first; af; af = af->next) {
+        if (af == s->first || af == s->last)
+            continue;
+        struct mpv_node *e = node_array_add(dst, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "name", af->info->name);
+        if (af->label)
+            node_map_add_string(e, "label", af->label);
+        node_map_add_flag(e, "autoinserted", af->auto_inserted);
+        node_map_add_int64(e, "queued", af->num_out_queued);
+        mp_perf_stat_get_node(af->perf, e);
+    }
+}
+
 static void af_print_filter_chain(struct af_stream *s, struct af_instance *at,
                                   int msg_level)
 {
@@ -715,14 +736,17 @@ void af_add_output_frame(struct af_instance *af, struct mp_audio *frame)
     if (frame) {
         assert(mp_audio_config_equals(&af->fmt_out, frame));
         MP_TARRAY_APPEND(af, af->out_queued, af->num_out_queued, frame);
+        mp_perf_stat_add(af->perf, MP_PERF_STAT_FRAMES, 1);
     }
 }
 
 static bool af_has_output_frame(struct af_instance *af)
 {
     if (!af->num_out_queued && af->filter_out) {
+        int64_t start = mp_time_us();
         if (af->filter_out(af) < 0)
             MP_ERR(af, "Error filtering frame.\n");
+        mp_perf_stat_time(af->perf, mp_time_us() - start);
     }
     return af->num_out_queued > 0;
 }
@@ -751,9 +775,11 @@ static int af_do_filter(struct af_instance *af, struct mp_audio *frame)
 {
     if (frame)
         assert(mp_audio_config_equals(&af->fmt_in, frame));
+    int64_t start = mp_time_us();
     int r = af->filter_frame(af, frame);
     if (r < 0)
         MP_ERR(af, "Error filtering frame.\n");
+    mp_perf_stat_time(af->perf, mp_time_us() - start);
     return r;
 }
 
@@ -821,6 +847,8 @@ void af_unread_output_frame(struct af_stream *s, struct mp_audio *frame)
 // Return negative error code on failure (i.e. you can't write).
 int af_make_writeable(struct af_instance *af, struct mp_audio *frame)
 {
+    if (!mp_audio_is_writeable(frame))
+        mp_perf_stat_add(af->perf, MP_PERF_STAT_ALLOCS, 1);
     return mp_audio_pool_make_writeable(af->out_pool, frame);
 }
 
@@ -87,6 +87,8 @@ struct af_instance {
     int num_out_queued;
 
     struct mp_audio_pool *out_pool;
+
+    struct mp_perf_stat *perf;
 };
 
 // Current audio stream
@@ -150,6 +152,8 @@ void af_control_all(struct af_stream *s, int cmd, void *arg);
 int af_control_by_label(struct af_stream *s, int cmd, void *arg, bstr label);
 void af_seek_reset(struct af_stream *s);
 int af_send_command(struct af_stream *s, char *label, char *cmd, char *arg);
+struct mpv_node;
+void af_get_perf_node(struct af_stream *s, struct mpv_node *dst);
 
 void af_add_output_frame(struct af_instance *af, struct mp_audio *frame);
 int af_filter_frame(struct af_stream *s, struct mp_audio *frame);
@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <inttypes.h>
 #include <math.h>
@@ -58,13 +59,17 @@
 #define G_MIN   -12.0
 
 // Data for specific instances of this filter
+// The per-channel data is stored with the channel as innermost index, so that
+// the compiler can vectorize the filter loop across channels.
 typedef struct af_equalizer_s
 {
   float   a[KM][L];             // A weights
   float   b[KM][L];             // B weights
-  float   wq[AF_NCH][KM][L];    // Circular buffer for W data
-  float   g[AF_NCH][KM];        // Gain factor for each channel and band
+  float   wq[KM][L][AF_NCH];    // Circular buffer for W data
+  float   g[KM][AF_NCH];        // Gain factor for each band and channel
   int     K;                    // Number of used eq bands
+  int     bands[KM];            // Used bands with a non-zero gain
+  int     num_bands;
   int     channels;             // Number of channels
   float   gain_factor;     // applied at output to avoid clipping
   double  p[KM];
@@ -113,13 +118,25 @@ static int control(struct af_instance* af, int cmd, void* arg)
     for(k=0;k<s->K;k++)
       bp2(s->a[k],s->b[k],F[k]/((float)af->data->rate),Q);
 
+    // A band with gain 0 doesn't change the output, so skip it entirely.
+    s->num_bands=0;
+    for(k=0;k<s->K;k++){
+      for(i=0;i<AF_NCH;i++){
+        if(s->g[k][i] != 0.0f){
+          s->bands[s->num_bands++]=k;
+          break;
+        }
+      }
+    }
+    memset(s->wq,0,sizeof(s->wq));
+
     // Calculate how much this plugin adds to the overall time delay
     af->delay = 2.0 / (double)af->data->rate;
 
     // Calculate gain factor to prevent clipping at output
-    for(k=0;k<AF_NCH;k++)
+    for(k=0;k<KM;k++)
     {
-        for(i=0;i<KM;i++)
+        for(i=0;i<AF_NCH;i++)
         {
             if(s->gain_factor < s->g[k][i]) s->gain_factor=s->g[k][i];
         }
@@ -140,47 +157,52 @@ static int control(struct af_instance* af, int cmd, void* arg)
   return AF_UNKNOWN;
 }
 
+// Run band k on all channels of one sample frame. The channels are
+// independent, so this loop is vectorized.
+static inline void filter_band(af_equalizer_t* s, int k, float* restrict y,
+                               int nch)
+{
+  float* restrict w0 = s->wq[k][0];
+  float* restrict w1 = s->wq[k][1];
+  const float* restrict g = s->g[k];
+  float a0 = s->a[k][0], a1 = s->a[k][1];
+  float b0 = s->b[k][0], b1 = s->b[k][1];
+
+  for(int ci=0;ci<nch;ci++){
+    // Calculate output from AR part of current filter
+    float w = y[ci]*b0 + w0[ci]*a0 + w1[ci]*a1;
+    // Calculate output form MA part of current filter
+    y[ci] += (w + w1[ci]*b1)*g[ci];
+    // Update circular buffer
+    w1[ci] = w0[ci];
+    w0[ci] = w;
+  }
+}
+
 static int filter(struct af_instance* af, struct mp_audio* data)
 {
   struct mp_audio*       c      = data;                         // Current working data
   if (!c)
     return 0;
   af_equalizer_t*  s    = (af_equalizer_t*)af->priv;    // Setup
-  uint32_t         ci   = af->data->nch;                // Index for channels
-  uint32_t         nch  = af->data->nch;                // Number of channels
+  int              nch  = af->data->nch;                // Number of channels
 
   if (af_make_writeable(af, data) < 0) {
     talloc_free(data);
     return -1;
   }
 
-  while(ci--){
-    float*      g   = s->g[ci];      // Gain factor
-    float*      in  = ((float*)c->planes[0])+ci;
-    float*      out = ((float*)c->planes[0])+ci;
-    float*      end = in + c->samples*c->nch; // Block loop end
-
-    while(in < end){
-      register int      k  = 0;         // Frequency band index
-      register float    yt = *in;       // Current input sample
-      in+=nch;
-
-      // Run the filters
-      for(;k<s->K;k++){
-        // Pointer to circular buffer wq
-        register float* wq = s->wq[ci][k];
-        // Calculate output from AR part of current filter
-        register float w=yt*s->b[k][0] + wq[0]*s->a[k][0] + wq[1]*s->a[k][1];
-        // Calculate output form MA part of current filter
-        yt+=(w + wq[1]*s->b[k][1])*g[k];
-        // Update circular buffer
-        wq[1] = wq[0];
-        wq[0] = w;
-      }
-      // Calculate output
-      *out=yt*s->gain_factor;
-      out+=nch;
-    }
+  float*      y   = c->planes[0];
+  float*      end = y + c->samples*nch; // Block loop end
+
+  // The bands of a channel depend on each other, so process all channels of a
+  // sample frame per band instead of all bands of a channel per sample.
+  for(;y<end;y+=nch){
+    for(int n=0;n<s->num_bands;n++)
+      filter_band(s,s->bands[n],y,nch);
+    // Calculate output
+    for(int ci=0;ci<nch;ci++)
+      y[ci]*=s->gain_factor;
   }
   af_add_output_frame(af, data);
   return 0;
@@ -194,7 +216,7 @@ static int af_open(struct af_instance* af){
   af_equalizer_t *priv = af->priv;
   for(int i=0;i<AF_NCH;i++){
       for(int j=0;j<KM;j++){
-        priv->g[i][j] = pow(10.0,MPCLAMP(priv->p[j],G_MIN,G_MAX)/20.0)-1.0;
+        priv->g[j][i] = pow(10.0,MPCLAMP(priv->p[j],G_MIN,G_MAX)/20.0)-1.0;
       }
     }
   return AF_OK;
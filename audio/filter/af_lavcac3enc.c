@@ -35,6 +35,8 @@
 
 #include "common/av_common.h"
 #include "common/common.h"
+#include "common/perf.h"
+#include "osdep/timer.h"
 #include "af.h"
 #include "audio/audio_buffer.h"
 #include "audio/chmap_sel.h"
@@ -277,6 +279,8 @@ static int filter_out(struct af_instance *af)
     AVPacket pkt = {0};
     av_init_packet(&pkt);
 
+    int64_t t0 = mp_time_us();
+
     // Send input as long as it wants.
     while (1) {
         err = read_input_frame(af, frame);
@@ -297,6 +301,7 @@ static int filter_out(struct af_instance *af)
         s->input->samples = 0;
     }
     int lavc_ret = avcodec_receive_packet(s->lavc_actx, &pkt);
+    mp_perf_time(af->global, MP_PERF_AUDIO_ENCODE, mp_time_us() - t0);
     if (lavc_ret == AVERROR(EAGAIN)) {
         // Need to buffer more input.
         err = 0;
@@ -32,6 +32,12 @@ typedef struct af_pan_s {
     int nch; // Number of output channels; zero means same as input
     float level[AF_NCH][AF_NCH];  // Gain level for each channel
     char *matrixstr;
+    // Non-zero entries of level[][] for each output channel, rebuilt when the
+    // levels change.
+    bool levels_changed;
+    int num_in[AF_NCH];
+    int in_ch[AF_NCH][AF_NCH];
+    float in_level[AF_NCH][AF_NCH];
 } af_pan_t;
 
 static void set_channels(struct mp_audio *mpa, int num)
@@ -61,7 +67,22 @@ static void parse_matrix(struct af_instance *af, const char *cp)
             break;
         cp++;
     }
+    s->levels_changed = true;
+}
 
+static void update_levels(af_pan_t *s, int nchi, int ncho)
+{
+    for (int j = 0; j < ncho; j++) {
+        s->num_in[j] = 0;
+        for (int k = 0; k < nchi; k++) {
+            if (s->level[j][k] != 0.0f) {
+                s->in_ch[j][s->num_in[j]] = k;
+                s->in_level[j][s->num_in[j]] = s->level[j][k];
+                s->num_in[j]++;
+            }
+        }
+    }
+    s->levels_changed = false;
 }
 
 // Initialization and runtime control
@@ -78,6 +99,7 @@ static int control(struct af_instance *af, int cmd, void *arg)
         af->data->rate = ((struct mp_audio*)arg)->rate;
         mp_audio_set_format(af->data, AF_FORMAT_FLOAT);
         set_channels(af->data, s->nch ? s->nch : ((struct mp_audio*)arg)->nch);
+        s->levels_changed = true;
 
         if ((af->data->format != ((struct mp_audio*)arg)->format) ||
             (af->data->bps != ((struct mp_audio*)arg)->bps)) {
@@ -93,6 +115,7 @@ static int control(struct af_instance *af, int cmd, void *arg)
             return AF_FALSE;
         for (i = 0; i < AF_NCH; i++)
             s->level[ch][i] = level[i];
+        s->levels_changed = true;
         return AF_OK;
     }
     case AF_CONTROL_SET_PAN_NOUT:
@@ -116,6 +139,7 @@ static int control(struct af_instance *af, int cmd, void *arg)
             s->level[1][0] = MPMAX(0.f, -val);
             s->level[1][1] = MPMIN(1.f, 1.f + val);
         }
+        s->levels_changed = true;
         return AF_OK;
     }
     case AF_CONTROL_GET_PAN_BALANCE:
@@ -147,27 +171,36 @@ static int filter_frame(struct af_instance *af, struct mp_audio *c)
     }
     mp_audio_copy_attributes(l, c);
 
-    af_pan_t*     s    = af->priv;        // Setup for this instance
+    af_pan_t      *s   = af->priv;        // Setup for this instance
     float         *in  = c->planes[0];    // Input audio data
-    float         *out = NULL;            // Output audio data
-    float         *end = in+c->samples * c->nch;    // End of loop
+    float         *out = l->planes[0];    // Output audio data
     int           nchi = c->nch;          // Number of input channels
     int           ncho = l->nch;          // Number of output channels
-    register int  j, k;
-
-    out = l->planes[0];
-    // Execute panning
-    // FIXME: Too slow
-    while (in < end) {
-        for (j = 0; j < ncho; j++) {
-            register float  x    = 0.0;
-            register float  *tin = in;
-            for (k = 0; k < nchi; k++)
-                x += tin[k] * s->level[j][k];
-            out[j] = x;
+
+    if (s->levels_changed)
+        update_levels(s, nchi, ncho);
+
+    // Execute panning. Only input channels with a non-zero level contribute
+    // to an output channel; typical matrices are mostly zeros. Each output
+    // channel is computed over the whole block at once.
+    for (int j = 0; j < ncho; j++) {
+        float *restrict dst = out + j;
+        int num_in = s->num_in[j];
+        if (!num_in) {
+            for (int i = 0; i < c->samples; i++)
+                dst[i * ncho] = 0;
+            continue;
+        }
+        const float *restrict src = in + s->in_ch[j][0];
+        float g = s->in_level[j][0];
+        for (int i = 0; i < c->samples; i++)
+            dst[i * ncho] = src[i * nchi] * g;
+        for (int n = 1; n < num_in; n++) {
+            src = in + s->in_ch[j][n];
+            g = s->in_level[j][n];
+            for (int i = 0; i < c->samples; i++)
+                dst[i * ncho] += src[i * nchi] * g;
         }
-        out += ncho;
-        in += nchi;
     }
 
     talloc_free(c);
@@ -129,13 +129,23 @@ static int best_overlap_offset_float(af_scaletempo_t *s)
     for (int i = s->num_channels; i < s->samples_overlap; i++)
         *ppc++ = *pw++ **po++;
 
+    // Use independent partial sums, so the compiler can vectorize the inner
+    // loop without relaxed float semantics. buf_pre_corr is zero-padded, and
+    // buf_queue has UNROLL_PADDING bytes at the end, so rounding the length
+    // up to a multiple of 4 is safe.
+    int num = s->samples_overlap - s->num_channels;
     float *search_start = (float *)s->buf_queue + s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        float corr = 0;
+        float sum[4] = {0};
         float *ps = search_start;
         ppc = s->buf_pre_corr;
-        for (int i = s->num_channels; i < s->samples_overlap; i++)
-            corr += *ppc++ **ps++;
+        for (int i = 0; i < num; i += 4) {
+            sum[0] += ppc[i + 0] * ps[i + 0];
+            sum[1] += ppc[i + 1] * ps[i + 1];
+            sum[2] += ppc[i + 2] * ps[i + 2];
+            sum[3] += ppc[i + 3] * ps[i + 3];
+        }
+        float corr = (sum[0] + sum[1]) + (sum[2] + sum[3]);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
@@ -379,13 +389,16 @@ static int control(struct af_instance *af, int cmd, void *arg)
                 }
                 s->best_overlap_offset = best_overlap_offset_s16;
             } else {
-                s->buf_pre_corr = realloc(s->buf_pre_corr, s->bytes_overlap);
+                s->buf_pre_corr = realloc(s->buf_pre_corr,
+                                          s->bytes_overlap + UNROLL_PADDING);
                 s->table_window = realloc(s->table_window,
                                           s->bytes_overlap - nch * bps);
                 if (!s->buf_pre_corr || !s->table_window) {
                     MP_FATAL(af, "Out of memory\n");
                     return AF_ERROR;
                 }
+                memset((char *)s->buf_pre_corr + s->bytes_overlap - nch * bps,
+                       0, nch * bps + UNROLL_PADDING);
                 float *pw = s->table_window;
                 for (int i = 1; i < frames_overlap; i++) {
                     float v = i * (frames_overlap - i);
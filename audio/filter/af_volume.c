@@ -135,9 +135,16 @@ static void filter_plane(struct af_instance *af, struct mp_audio *data, int p)
             if (af_make_writeable(af, data) < 0)
                 return; // oom
             float *a = data->planes[p];
-            for (int i = 0; i < num_samples; i++) {
-                float x = a[i] * vol;
-                a[i] = s->soft ? af_softclip(x) : MPCLAMP(x, -1.0, 1.0);
+            // Keep the branch out of the loops, so the common hard clipping
+            // case compiles to straight vector code.
+            if (s->soft) {
+                for (int i = 0; i < num_samples; i++)
+                    a[i] = af_softclip(a[i] * vol);
+            } else {
+                for (int i = 0; i < num_samples; i++) {
+                    float x = a[i] * vol;
+                    a[i] = MPCLAMP(x, -1.0f, 1.0f);
+                }
             }
         }
     }
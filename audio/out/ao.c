@@ -154,6 +154,7 @@ static struct ao *ao_alloc(bool probing, struct mpv_global *global,
         .wakeup_ctx = wakeup_ctx,
         .log = mp_log_new(ao, log, name),
         .def_buffer = opts->audio_buffer,
+        .max_buffer = opts->audio_buffer_max,
         .client_name = talloc_strdup(ao, opts->audio_client_name),
     };
     ao->priv = m_config_group_from_desc(ao, ao->log, global, &desc, name);
@@ -273,6 +274,8 @@ struct ao *ao_init_best(struct mpv_global *global,
     struct m_obj_settings *ao_list = NULL;
     int ao_num = 0;
 
+    mp_msg(log, MSGL_STATS, "start ao init");
+
     for (int n = 0; opts->audio_driver_list && opts->audio_driver_list[n].name; n++)
         MP_TARRAY_APPEND(tmp, ao_list, ao_num, opts->audio_driver_list[n]);
 
@@ -330,6 +333,7 @@ struct ao *ao_init_best(struct mpv_global *global,
         }
     }
 
+    mp_msg(log, MSGL_STATS, "end ao init");
     talloc_free(tmp);
     return ao;
 }
@@ -369,6 +373,17 @@ double ao_get_delay(struct ao *ao)
     return ao->api->get_delay(ao);
 }
 
+// Return the current buffer configuration. The soft buffer target only changes
+// at runtime with --audio-buffer-max (and only with push based AOs).
+void ao_get_buffer_state(struct ao *ao, struct ao_buffer_state *st)
+{
+    *st = (struct ao_buffer_state){
+        .target = ao->buffer / (double)ao->samplerate,
+        .device = ao->device_buffer / (double)ao->samplerate,
+    };
+    ao_control(ao, AOCONTROL_GET_BUFFER_STATE, st);
+}
+
 // Return free size of the internal audio buffer. This controls how much audio
 // the core should decode and try to queue with ao_play().
 int ao_get_space(struct ao *ao)
@@ -665,8 +680,10 @@ bool ao_need_conversion(struct ao_convert_fmt *fmt)
 // The LSB is always ignored.
 #if BYTE_ORDER == BIG_ENDIAN
 #define SHIFT24(x) ((3-(x))*8)
+#define PAD24(x) ((x) & 0xFFFFFF00u)
 #else
 #define SHIFT24(x) (((x)+1)*8)
+#define PAD24(x) ((x) >> 8)
 #endif
 
 static void convert_plane(int type, void *data, int num_samples)
@@ -674,20 +691,23 @@ static void convert_plane(int type, void *data, int num_samples)
     switch (type) {
     case 0:
         break;
-    case 1: /* fall through */
-    case 2: {
-        int bytes = type == 1 ? 3 : 4;
+    case 1: {
         for (int s = 0; s < num_samples; s++) {
             uint32_t val = *((uint32_t *)data + s);
-            uint8_t *ptr = (uint8_t *)data + s * bytes;
+            uint8_t *ptr = (uint8_t *)data + s * 3;
             ptr[0] = val >> SHIFT24(0);
             ptr[1] = val >> SHIFT24(1);
             ptr[2] = val >> SHIFT24(2);
-            if (type == 2)
-                ptr[3] = 0;
         }
         break;
     }
+    case 2: {
+        // Same sample size, so this is a plain word operation (and vectorizes).
+        uint32_t *ptr = data;
+        for (int s = 0; s < num_samples; s++)
+            ptr[s] = PAD24(ptr[s]);
+        break;
+    }
     default:
         abort();
     }
@@ -39,6 +39,15 @@ enum aocontrol {
     AOCONTROL_HAS_SOFT_VOLUME,
     // like above, but volume persists (per app), mpv won't restore volume
     AOCONTROL_HAS_PER_APP_VOLUME,
+    // struct ao_buffer_state*, for ao_get_buffer_state() (handled by push.c)
+    AOCONTROL_GET_BUFFER_STATE,
+};
+
+struct ao_buffer_state {
+    double target;      // soft buffer size the AO tries to maintain (seconds)
+    double device;      // device buffer size (seconds)
+    int underruns;      // times the AO ran out of data while playing
+    int late;           // times the device was fed too late (only some AOs)
 };
 
 // If set, then the queued audio data is the last. Note that after a while, new
@@ -96,6 +105,7 @@ bool ao_untimed(struct ao *ao);
 int ao_play(struct ao *ao, void **data, int samples, int flags);
 int ao_control(struct ao *ao, enum aocontrol cmd, void *arg);
 double ao_get_delay(struct ao *ao);
+void ao_get_buffer_state(struct ao *ao, struct ao_buffer_state *st);
 int ao_get_space(struct ao *ao);
 void ao_reset(struct ao *ao);
 void ao_pause(struct ao *ao);
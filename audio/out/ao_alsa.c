@@ -27,6 +27,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <sys/time.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -60,6 +61,9 @@ struct ao_alsa_opts {
     int resample;
     int ni;
     int ignore_chmap;
+    int mmap;
+    int buffer_time;
+    int frags;
 };
 
 #define OPT_BASE_STRUCT struct ao_alsa_opts
@@ -71,6 +75,9 @@ static const struct m_sub_options ao_alsa_conf = {
         OPT_INTRANGE("alsa-mixer-index", mixer_index, 0, 0, 99),
         OPT_FLAG("alsa-non-interleaved", ni, 0),
         OPT_FLAG("alsa-ignore-chmap", ignore_chmap, 0),
+        OPT_FLAG("alsa-mmap", mmap, 0),
+        OPT_INTRANGE("alsa-buffer-time", buffer_time, 0, 0, INT_MAX),
+        OPT_INTRANGE("alsa-periods", frags, 0, 0, INT_MAX),
         {0}
     },
     .defaults = &(const struct ao_alsa_opts) {
@@ -78,6 +85,8 @@ static const struct m_sub_options ao_alsa_conf = {
         .mixer_name = "Master",
         .mixer_index = 0,
         .ni = 0,
+        .buffer_time = 250000, // 250ms
+        .frags = 16,
     },
     .size = sizeof(struct ao_alsa_opts),
 };
@@ -92,6 +101,7 @@ struct priv {
     double delay_before_pause;
     snd_pcm_uframes_t buffersize;
     snd_pcm_uframes_t outburst;
+    bool mmap;                  // using SND_PCM_ACCESS_MMAP_*
 
     snd_output_t *output;
 
@@ -100,9 +110,6 @@ struct priv {
     struct ao_alsa_opts *opts;
 };
 
-#define BUFFER_TIME 250000  // 250ms
-#define FRAGCOUNT 16
-
 #define CHECK_ALSA_ERROR(message) \
     do { \
         if (err < 0) { \
@@ -703,7 +710,25 @@ static int init_device(struct ao *ao, int mode)
     snd_pcm_access_t access = af_fmt_is_planar(ao->format)
                                     ? SND_PCM_ACCESS_RW_NONINTERLEAVED
                                     : SND_PCM_ACCESS_RW_INTERLEAVED;
-    err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+    p->mmap = false;
+    if (p->opts->mmap) {
+        snd_pcm_access_t mmap_access = af_fmt_is_planar(ao->format)
+                                    ? SND_PCM_ACCESS_MMAP_NONINTERLEAVED
+                                    : SND_PCM_ACCESS_MMAP_INTERLEAVED;
+        err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, mmap_access);
+        if (err < 0 && af_fmt_is_planar(ao->format)) {
+            mmap_access = SND_PCM_ACCESS_MMAP_INTERLEAVED;
+            err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams,
+                                               mmap_access);
+            if (err >= 0)
+                ao->format = af_fmt_from_planar(ao->format);
+        }
+        p->mmap = err >= 0;
+        if (!p->mmap)
+            MP_VERBOSE(ao, "mmap access not supported, using read/write.\n");
+    }
+    if (!p->mmap)
+        err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
     if (err < 0 && af_fmt_is_planar(ao->format)) {
         ao->format = af_fmt_from_planar(ao->format);
         access = SND_PCM_ACCESS_RW_INTERLEAVED;
@@ -799,12 +824,15 @@ static int init_device(struct ao *ao, int mode)
     snd_pcm_hw_params_copy(hwparams_backup, alsa_hwparams);
 
     // Cargo-culted buffer settings; might still be useful for PulseAudio.
-    err = snd_pcm_hw_params_set_buffer_time_near
-            (p->alsa, alsa_hwparams, &(unsigned int){BUFFER_TIME}, NULL);
-    CHECK_ALSA_WARN("Unable to set buffer time near");
-    if (err >= 0) {
+    err = 0;
+    if (p->opts->buffer_time) {
+        err = snd_pcm_hw_params_set_buffer_time_near
+            (p->alsa, alsa_hwparams, &(unsigned int){p->opts->buffer_time}, NULL);
+        CHECK_ALSA_WARN("Unable to set buffer time near");
+    }
+    if (err >= 0 && p->opts->frags) {
         err = snd_pcm_hw_params_set_periods_near
-                    (p->alsa, alsa_hwparams, &(unsigned int){FRAGCOUNT}, NULL);
+            (p->alsa, alsa_hwparams, &(unsigned int){p->opts->frags}, NULL);
         CHECK_ALSA_WARN("Unable to set periods");
     }
     if (err < 0)
@@ -857,6 +885,14 @@ static int init_device(struct ao *ao, int mode)
             (p->alsa, alsa_swparams, p->outburst);
     CHECK_ALSA_ERROR("Unable to set start threshold");
 
+    /* Don't wake up the playthread for every period. Wait until a quarter of
+     * the buffer is free, which matches what push.c does for AOs without
+     * poll support. */
+    snd_pcm_uframes_t avail_min = p->buffersize / 4 / p->outburst * p->outburst;
+    err = snd_pcm_sw_params_set_avail_min
+            (p->alsa, alsa_swparams, MPMAX(avail_min, p->outburst));
+    CHECK_ALSA_WARN("Unable to set avail min");
+
     /* disable underrun reporting */
     err = snd_pcm_sw_params_set_stop_threshold
             (p->alsa, alsa_swparams, boundary);
@@ -871,6 +907,7 @@ static int init_device(struct ao *ao, int mode)
     CHECK_ALSA_ERROR("Unable to set sw-parameters");
 
     MP_VERBOSE(ao, "hw pausing supported: %s\n", p->can_pause ? "yes" : "no");
+    MP_VERBOSE(ao, "mmap access: %s\n", p->mmap ? "yes" : "no");
     MP_VERBOSE(ao, "buffersize: %d samples\n", (int)p->buffersize);
     MP_VERBOSE(ao, "period size: %d samples\n", (int)p->outburst);
 
@@ -1093,6 +1130,84 @@ static void reset(struct ao *ao)
 alsa_error: ;
 }
 
+// Copy already converted samples into the mmap'ed area (at frame offset dst).
+static void copy_to_area(struct ao *ao, const snd_pcm_channel_area_t *areas,
+                         snd_pcm_uframes_t dst, void **data, int src, int frames)
+{
+    struct priv *p = ao->priv;
+    int bps = p->convert.dst_bits / 8;
+    int nch = ao->channels.num;
+    bool planar = af_fmt_is_planar(ao->format);
+
+    // The usual case: interleaved, or one packed area per plane.
+    int planes = planar ? nch : 1;
+    int frame_bytes = planar ? bps : bps * nch;
+    bool packed = true;
+    for (int n = 0; n < planes; n++) {
+        packed &= areas[n].first % 8 == 0 && areas[n].step == frame_bytes * 8;
+        if (!planar && areas[n].first != 0)
+            packed = false;
+    }
+    if (packed) {
+        for (int n = 0; n < planes; n++) {
+            uint8_t *d = (uint8_t *)areas[n].addr + areas[n].first / 8 +
+                         dst * frame_bytes;
+            memcpy(d, (uint8_t *)data[n] + src * frame_bytes,
+                   frames * frame_bytes);
+        }
+        return;
+    }
+
+    for (int c = 0; c < nch; c++) {
+        const snd_pcm_channel_area_t *a = &areas[c];
+        for (int i = 0; i < frames; i++) {
+            uint8_t *d = (uint8_t *)a->addr + (a->first + (dst + i) * a->step) / 8;
+            uint8_t *s = planar ? (uint8_t *)data[c] + (src + i) * bps
+                                : (uint8_t *)data[0] + ((src + i) * nch + c) * bps;
+            memcpy(d, s, bps);
+        }
+    }
+}
+
+// Write directly into the device ring buffer. Like blocking writei/writen,
+// this waits if there is no space at all, but may write less than requested.
+static snd_pcm_sframes_t write_mmap(struct ao *ao, void **data, int samples)
+{
+    struct priv *p = ao->priv;
+    int written = 0;
+
+    while (written < samples) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(p->alsa);
+        if (avail < 0)
+            return avail;
+        if (avail == 0) {
+            if (written)
+                break;
+            int err = snd_pcm_wait(p->alsa, 1000);
+            if (err < 0)
+                return err;
+            continue;
+        }
+
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset, frames = MPMIN(avail, samples - written);
+        int err = snd_pcm_mmap_begin(p->alsa, &areas, &offset, &frames);
+        if (err < 0)
+            return err;
+
+        copy_to_area(ao, areas, offset, data, written, frames);
+
+        snd_pcm_sframes_t res = snd_pcm_mmap_commit(p->alsa, offset, frames);
+        if (res < 0)
+            return res;
+        written += res;
+        if (res != frames)
+            break;
+    }
+
+    return written;
+}
+
 static int play(struct ao *ao, void **data, int samples, int flags)
 {
     struct priv *p = ao->priv;
@@ -1106,7 +1221,9 @@ static int play(struct ao *ao, void **data, int samples, int flags)
     do {
         ao_convert_inplace(&p->convert, data, samples);
 
-        if (af_fmt_is_planar(ao->format)) {
+        if (p->mmap) {
+            res = write_mmap(ao, data, samples);
+        } else if (af_fmt_is_planar(ao->format)) {
             res = snd_pcm_writen(p->alsa, data, samples);
         } else {
             res = snd_pcm_writei(p->alsa, data[0], samples);
@@ -395,6 +395,16 @@ static int reopen_device(struct ao *ao, bool allow_format_changes)
     p->outburst -= p->outburst % sstride; // round down
     ao->period_size = p->outburst / sstride;
 
+#ifdef SNDCTL_DSP_LOW_WATER
+    // Make poll() report the device writable only if a quarter of the buffer
+    // is free, instead of after each fragment.
+    if (p->buffersize > 0 && p->outburst > 0) {
+        int low_water = MPMAX(p->buffersize / 4 / p->outburst, 1) * p->outburst;
+        if (ioctl(p->audio_fd, SNDCTL_DSP_LOW_WATER, &low_water) == -1)
+            MP_VERBOSE(ao, "could not set low water mark\n");
+    }
+#endif
+
     return 0;
 
 fail:
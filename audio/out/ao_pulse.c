@@ -30,8 +30,10 @@
 
 #include "config.h"
 #include "audio/format.h"
+#include "common/common.h"
 #include "common/msg.h"
 #include "options/m_option.h"
+#include "osdep/timer.h"
 #include "ao.h"
 #include "internal.h"
 
@@ -58,8 +60,23 @@ struct priv {
     pthread_cond_t wakeup;
     int wakeup_status;
 
+    // Timing info cached by the latency update callback, so that get_delay()
+    // does not need to lock the mainloop. Protected by timing_lock.
+    pthread_mutex_t timing_lock;
+    bool timing_valid;
+    bool timing_playing;    // whether the stream was playing at timing_time
+    int64_t timing_latency; // stream latency at timing_time (us)
+    int64_t timing_time;    // mp_time_us() of the last update
+    int64_t timing_written; // audio written since the last update (us)
+
+    // Adaptive buffer size (only touched with the mainloop lock held)
+    uint32_t tlength;       // current target length in bytes (0 if native)
+    uint32_t max_tlength;
+    bool final_chunk;       // last play() call had AOPLAY_FINAL_CHUNK
+
     char *cfg_host;
     int cfg_buffer;
+    int cfg_adaptive_buffer;
     int cfg_latency_hacks;
 };
 
@@ -150,13 +167,71 @@ static int wait_audio(struct ao *ao, pthread_mutex_t *lock)
     return 0;
 }
 
+// timing_lock must be held
+static int64_t get_cached_delay(struct priv *priv, int64_t now)
+{
+    int64_t latency = priv->timing_latency + priv->timing_written;
+    if (priv->timing_playing)
+        latency -= now - priv->timing_time;
+    return MPMAX(latency, 0);
+}
+
+static void invalidate_timing(struct priv *priv)
+{
+    pthread_mutex_lock(&priv->timing_lock);
+    priv->timing_valid = false;
+    pthread_mutex_unlock(&priv->timing_lock);
+}
+
 static void stream_latency_update_cb(pa_stream *s, void *userdata)
 {
     struct ao *ao = userdata;
     struct priv *priv = ao->priv;
+    pa_usec_t latency;
+    int negative = 0;
+    const pa_timing_info *ti = pa_stream_get_timing_info(s);
+    if (!priv->cfg_latency_hacks && ti &&
+        pa_stream_get_latency(s, &latency, &negative) >= 0)
+    {
+        pthread_mutex_lock(&priv->timing_lock);
+        priv->timing_valid = true;
+        priv->timing_playing = ti->playing;
+        priv->timing_latency = negative ? 0 : latency;
+        priv->timing_time = mp_time_us();
+        priv->timing_written = 0;
+        pthread_mutex_unlock(&priv->timing_lock);
+    }
     pa_threaded_mainloop_signal(priv->mainloop, 0);
 }
 
+static void stream_underflow_cb(pa_stream *s, void *userdata)
+{
+    struct ao *ao = userdata;
+    struct priv *priv = ao->priv;
+
+    // Playback stops until prebuf is reached again.
+    invalidate_timing(priv);
+
+    // Running out of data at the end of the stream is expected.
+    if (!priv->cfg_adaptive_buffer || !priv->tlength || priv->final_chunk ||
+        priv->tlength >= priv->max_tlength)
+        return;
+
+    const pa_buffer_attr *cur = pa_stream_get_buffer_attr(s);
+    if (!cur)
+        return;
+    priv->tlength = MPMIN(priv->tlength * 2, priv->max_tlength);
+    pa_buffer_attr attr = *cur;
+    attr.tlength = priv->tlength;
+    attr.minreq = priv->tlength / 4;
+    pa_operation *op = pa_stream_set_buffer_attr(s, &attr, NULL, NULL);
+    if (op)
+        pa_operation_unref(op);
+    MP_VERBOSE(ao, "Underrun, increasing buffer to %d ms.\n",
+               (int)(pa_bytes_to_usec(priv->tlength,
+                                      pa_stream_get_sample_spec(s)) / 1000));
+}
+
 static void success_cb(pa_stream *s, int success, void *userdata)
 {
     struct ao *ao = userdata;
@@ -307,6 +382,7 @@ static void uninit(struct ao *ao)
 
     pthread_cond_destroy(&priv->wakeup);
     pthread_mutex_destroy(&priv->wakeup_lock);
+    pthread_mutex_destroy(&priv->timing_lock);
 }
 
 static int pa_init_boilerplate(struct ao *ao)
@@ -317,6 +393,7 @@ static int pa_init_boilerplate(struct ao *ao)
 
     pthread_mutex_init(&priv->wakeup_lock, NULL);
     pthread_cond_init(&priv->wakeup, NULL);
+    pthread_mutex_init(&priv->timing_lock, NULL);
 
     if (!(priv->mainloop = pa_threaded_mainloop_new())) {
         MP_ERR(ao, "Failed to allocate main loop\n");
@@ -454,13 +531,21 @@ static int init(struct ao *ao)
     pa_stream_set_write_callback(priv->stream, stream_request_cb, ao);
     pa_stream_set_latency_update_callback(priv->stream,
                                           stream_latency_update_cb, ao);
+    pa_stream_set_underflow_callback(priv->stream, stream_underflow_cb, ao);
     int buf_size = af_fmt_seconds_to_bytes(ao->format, priv->cfg_buffer / 1000.0,
                                            ao->channels.num, ao->samplerate);
+    // With the adaptive buffer, allow growing up to 1 second (but never
+    // shrink below what the user requested).
+    int max_size = af_fmt_seconds_to_bytes(ao->format, 1.0, ao->channels.num,
+                                           ao->samplerate);
+    priv->tlength = MPMAX(buf_size, 0);
+    priv->max_tlength = MPMAX(buf_size, max_size);
     pa_buffer_attr bufattr = {
         .maxlength = -1,
         .tlength = buf_size > 0 ? buf_size : (uint32_t)-1,
         .prebuf = -1,
-        .minreq = -1,
+        // Request data in larger chunks, to reduce the number of wakeups.
+        .minreq = buf_size > 0 ? buf_size / 4 : (uint32_t)-1,
         .fragsize = -1,
     };
 
@@ -506,6 +591,19 @@ unlock_and_fail:
 static void cork(struct ao *ao, bool pause)
 {
     struct priv *priv = ao->priv;
+    if (pause) {
+        // Stop interpolating; the next timing update resumes it.
+        pthread_mutex_lock(&priv->timing_lock);
+        int64_t now = mp_time_us();
+        priv->timing_latency = get_cached_delay(priv, now);
+        priv->timing_written = 0;
+        priv->timing_time = now;
+        priv->timing_playing = false;
+        pthread_mutex_unlock(&priv->timing_lock);
+    } else {
+        // Corking triggers a timing update, which validates it again.
+        invalidate_timing(priv);
+    }
     pa_threaded_mainloop_lock(priv->mainloop);
     priv->retval = 0;
     if (!waitop(priv, pa_stream_cork(priv->stream, pause, success_cb, ao)) ||
@@ -522,7 +620,12 @@ static int play(struct ao *ao, void **data, int samples, int flags)
                         PA_SEEK_RELATIVE) < 0) {
         GENERIC_ERR_MSG("pa_stream_write() failed");
         samples = -1;
+    } else {
+        pthread_mutex_lock(&priv->timing_lock);
+        priv->timing_written += samples * 1000000LL / ao->samplerate;
+        pthread_mutex_unlock(&priv->timing_lock);
     }
+    priv->final_chunk = flags & AOPLAY_FINAL_CHUNK;
     if (flags & AOPLAY_FINAL_CHUNK) {
         // Force start in case the stream was too short for prebuf
         pa_operation *op = pa_stream_trigger(priv->stream, NULL, NULL);
@@ -539,6 +642,7 @@ static void reset(struct ao *ao)
     cork(ao, true);
     struct priv *priv = ao->priv;
     pa_threaded_mainloop_lock(priv->mainloop);
+    priv->final_chunk = false;
     priv->retval = 0;
     if (!waitop(priv, pa_stream_flush(priv->stream, success_cb, ao)) ||
         !priv->retval)
@@ -644,11 +748,17 @@ static double get_delay_pulse(struct ao *ao)
 static double get_delay(struct ao *ao)
 {
     struct priv *priv = ao->priv;
-    if (priv->cfg_latency_hacks) {
+    if (priv->cfg_latency_hacks)
         return get_delay_hackfixed(ao);
-    } else {
-        return get_delay_pulse(ao);
-    }
+
+    // Interpolate from the last timing update, which avoids a mainloop
+    // round-trip on every call. Only query pulse directly if there was no
+    // update since the last reset or underrun.
+    pthread_mutex_lock(&priv->timing_lock);
+    bool valid = priv->timing_valid;
+    int64_t latency = valid ? get_cached_delay(priv, mp_time_us()) : 0;
+    pthread_mutex_unlock(&priv->timing_lock);
+    return valid ? latency / 1e6 : get_delay_pulse(ao);
 }
 
 /* A callback function that is called when the
@@ -831,11 +941,13 @@ const struct ao_driver audio_out_pulse = {
     .list_devs = list_devs,
     .priv_size = sizeof(struct priv),
     .priv_defaults = &(const struct priv) {
-        .cfg_buffer = 250,
+        .cfg_buffer = 100,
+        .cfg_adaptive_buffer = 1,
     },
     .options = (const struct m_option[]) {
         OPT_STRING("host", cfg_host, 0),
         OPT_CHOICE_OR_INT("buffer", cfg_buffer, 0, 1, 2000, ({"native", 0})),
+        OPT_FLAG("adaptive-buffer", cfg_adaptive_buffer, 0),
         OPT_FLAG("latency-hacks", cfg_latency_hacks, 0),
         {0}
     },
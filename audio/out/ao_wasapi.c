@@ -113,6 +113,13 @@ static bool thread_feed(struct ao *ao)
         // enough to send more feed events when it gets behind.
         refill = true;
     }
+    if (atomic_load(&state->sample_count) > 0) {
+        if (!padding) {
+            atomic_fetch_add(&state->num_underruns, 1);
+        } else if (refill) {
+            atomic_fetch_add(&state->num_late, 1);
+        }
+    }
     MP_TRACE(ao, "Frame to fill: %"PRIu32". Padding: %"PRIu32"\n",
              frame_count, padding);
 
@@ -170,7 +177,11 @@ static void thread_resume(struct ao *ao)
     struct wasapi_state *state = ao->priv;
     MP_DBG(state, "Thread Resume\n");
     thread_reset(ao);
-    thread_feed(ao);
+    // Pre-fill the device buffer before starting, so that the first period
+    // doesn't start out as an under-run. In exclusive mode this queues two
+    // full periods (see thread_feed).
+    if (thread_feed(ao))
+        thread_feed(ao);
 
     HRESULT hr = IAudioClient_Start(state->pAudioClient);
     if (FAILED(hr)) {
@@ -449,6 +460,13 @@ static void run_control(void *p)
 static int control(struct ao *ao, enum aocontrol cmd, void *arg)
 {
     struct wasapi_state *state = ao->priv;
+    if (cmd == AOCONTROL_GET_BUFFER_STATE) {
+        struct ao_buffer_state *st = arg;
+        st->underruns = atomic_load(&state->num_underruns);
+        st->late = atomic_load(&state->num_late);
+        return CONTROL_OK;
+    }
+
     int ret;
     void *p[] = {ao, &cmd, arg, &ret};
     mp_dispatch_run(state->dispatch, run_control, p);
@@ -502,4 +520,9 @@ const struct ao_driver audio_out_wasapi = {
     .hotplug_init   = hotplug_init,
     .hotplug_uninit = hotplug_uninit,
     .priv_size      = sizeof(wasapi_state),
+    .options = (const struct m_option[]){
+        OPT_FLAG("min-period", opt_min_period, 0),
+        {0}
+    },
+    .options_prefix = "wasapi",
 };
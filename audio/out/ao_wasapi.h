@@ -87,6 +87,11 @@ typedef struct wasapi_state {
 
     // ao options
     int opt_exclusive;
+    int opt_min_period;
+
+    // glitch statistics, read by the core via AOCONTROL_GET_BUFFER_STATE
+    atomic_int num_underruns;    // device ran out of samples while playing
+    atomic_int num_late;         // feed events that found the buffer short
 
     // format info
     WAVEFORMATEXTENSIBLE format;
@@ -583,11 +583,20 @@ static HRESULT fix_format(struct ao *ao, bool align_hack)
     struct wasapi_state *state = ao->priv;
 
     MP_DBG(state, "IAudioClient::GetDevicePeriod\n");
-    REFERENCE_TIME devicePeriod;
+    REFERENCE_TIME devicePeriod, minPeriod;
     HRESULT hr = IAudioClient_GetDevicePeriod(state->pAudioClient,&devicePeriod,
-                                              NULL);
-    MP_VERBOSE(state, "Device period: %.2g ms\n",
-               (double) devicePeriod / 10000.0 );
+                                              &minPeriod);
+    MP_VERBOSE(state, "Device period: %.2g ms (minimum: %.2g ms)\n",
+               (double) devicePeriod / 10000.0, (double) minPeriod / 10000.0);
+
+    // In exclusive mode, the buffer is exchanged with the device one period
+    // at a time, so the period directly determines the output latency.
+    if (state->share_mode == AUDCLNT_SHAREMODE_EXCLUSIVE &&
+        state->opt_min_period && SUCCEEDED(hr) && minPeriod > 0)
+    {
+        MP_VERBOSE(state, "Using minimum device period.\n");
+        devicePeriod = minPeriod;
+    }
 
     REFERENCE_TIME bufferDuration = devicePeriod;
     if (state->share_mode == AUDCLNT_SHAREMODE_SHARED) {
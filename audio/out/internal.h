@@ -72,6 +72,7 @@ struct ao {
 
     int buffer;
     double def_buffer;
+    double max_buffer;          // --audio-buffer-max (push AOs only)
     void *api_priv;
 };
 
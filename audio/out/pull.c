@@ -25,6 +25,7 @@
 
 #include "common/msg.h"
 #include "common/common.h"
+#include "common/perf.h"
 
 #include "input/input.h"
 
@@ -65,7 +66,14 @@ struct ao_pull_state {
     // Device delay of the last written sample, in realtime.
     atomic_llong end_time_us;
 
+    // Set by the audio thread when it called ao->wakeup_cb, and cleared when
+    // the player asks for buffer space again. This keeps the audio callback
+    // from calling into the (locking) wakeup function on every invocation.
+    atomic_bool wakeup_pending;
+
+    // Preallocated in init(), so ao_read_data_converted() never allocates.
     char *convert_buffer;
+    int convert_samples;
 };
 
 static void set_state(struct ao *ao, int new_state)
@@ -86,6 +94,7 @@ static void set_state(struct ao *ao, int new_state)
 static int get_space(struct ao *ao)
 {
     struct ao_pull_state *p = ao->api_priv;
+    atomic_store(&p->wakeup_pending, false);
     // Since the reader will read the last plane last, its free space is the
     // minimum free space across all planes.
     return mp_ring_available(p->buffers[ao->num_planes - 1]) / ao->sstride;
@@ -155,6 +164,8 @@ int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
 
     if (buffered_bytes < bytes && !atomic_load(&p->draining))
         atomic_fetch_add(&p->underflow, (bytes - buffered_bytes) / ao->sstride);
+    if (buffered_bytes < full_bytes && !atomic_load(&p->draining))
+        mp_perf_add(ao->global, MP_PERF_AO_UNDERRUNS, 1);
 
     if (bytes > 0)
         atomic_store(&p->end_time_us, out_time_us);
@@ -165,7 +176,9 @@ int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
     }
 
     // Half of the buffer played -> request more.
-    need_wakeup = buffered_bytes - bytes <= mp_ring_size(p->buffers[0]) / 2;
+    need_wakeup = buffered_bytes - bytes <= mp_ring_size(p->buffers[0]) / 2 &&
+                  atomic_compare_exchange_strong(&p->wakeup_pending,
+                                                 &(bool){false}, true);
 
     // Should never fail.
     atomic_compare_exchange_strong(&p->state, &(int){AO_STATE_BUSY}, AO_STATE_PLAY);
@@ -200,24 +213,29 @@ int ao_read_data_converted(struct ao *ao, struct ao_convert_fmt *fmt,
 
     bool planar = af_fmt_is_planar(fmt->src_fmt);
     int planes = planar ? fmt->channels : 1;
-    int plane_samples = samples * (planar ? 1: fmt->channels);
-    int src_plane_size = plane_samples * af_fmt_to_bytes(fmt->src_fmt);
-    int dst_plane_size = plane_samples * fmt->dst_bits / 8;
-
-    int needed = src_plane_size * planes;
-    if (needed > talloc_get_size(p->convert_buffer) || !p->convert_buffer) {
-        talloc_free(p->convert_buffer);
-        p->convert_buffer = talloc_size(NULL, needed);
-    }
+    int spp = planar ? 1 : fmt->channels; // samples per plane and frame
+    int src_bytes = af_fmt_to_bytes(fmt->src_fmt);
+    int dst_bytes = fmt->dst_bits / 8;
+    int src_plane_size = p->convert_samples * spp * src_bytes;
 
     for (int n = 0; n < planes; n++)
         ndata[n] = p->convert_buffer + n * src_plane_size;
 
-    int res = ao_read_data(ao, ndata, samples, out_time_us);
+    // Convert in chunks that fit into the preallocated buffer.
+    int res = 0;
+    for (int pos = 0; pos < samples; pos += p->convert_samples) {
+        int chunk = MPMIN(samples - pos, p->convert_samples);
+        int left = samples - pos - chunk;
+        int64_t chunk_end = out_time_us - left * 1000000LL / ao->samplerate;
 
-    ao_convert_inplace(fmt, ndata, samples);
-    for (int n = 0; n < planes; n++)
-        memcpy(data[n], ndata[n], dst_plane_size);
+        res += ao_read_data(ao, ndata, chunk, chunk_end);
+
+        ao_convert_inplace(fmt, ndata, chunk);
+        for (int n = 0; n < planes; n++) {
+            memcpy((char *)data[n] + pos * spp * dst_bytes, ndata[n],
+                   chunk * spp * dst_bytes);
+        }
+    }
 
     return res;
 }
@@ -310,6 +328,9 @@ static int init(struct ao *ao)
     struct ao_pull_state *p = ao->api_priv;
     for (int n = 0; n < ao->num_planes; n++)
         p->buffers[n] = mp_ring_new(ao, ao->buffer * ao->sstride);
+    p->convert_samples = MPMAX(MPMAX(ao->device_buffer, ao->period_size), 4096);
+    p->convert_buffer = talloc_size(NULL, p->convert_samples * ao->sstride *
+                                          ao->num_planes);
     atomic_store(&p->state, AO_STATE_NONE);
     assert(ao->driver->resume);
 
@@ -30,6 +30,7 @@
 
 #include "common/msg.h"
 #include "common/common.h"
+#include "common/perf.h"
 
 #include "input/input.h"
 
@@ -56,6 +57,14 @@ struct ao_push_state {
     bool still_playing;
     bool need_wakeup;
     bool paused;
+    bool underrun;
+
+    // Soft buffer size to maintain (in samples). Starts at ao->buffer, and is
+    // adapted between that and max_target on underruns.
+    int target;
+    int max_target;             // 0 if not adaptive
+    int num_underruns;
+    double last_adjust;
 
     // Whether the current buffer contains the complete audio.
     bool final_chunk;
@@ -77,6 +86,15 @@ static void wakeup_playthread(struct ao *ao)
 static int control(struct ao *ao, enum aocontrol cmd, void *arg)
 {
     int r = CONTROL_UNKNOWN;
+    if (cmd == AOCONTROL_GET_BUFFER_STATE) {
+        struct ao_push_state *p = ao->api_priv;
+        struct ao_buffer_state *st = arg;
+        pthread_mutex_lock(&p->lock);
+        st->target = p->target / (double)ao->samplerate;
+        st->underruns = p->num_underruns;
+        pthread_mutex_unlock(&p->lock);
+        return CONTROL_OK;
+    }
     if (ao->driver->control) {
         struct ao_push_state *p = ao->api_priv;
         pthread_mutex_lock(&p->lock);
@@ -144,11 +162,10 @@ static void resume(struct ao *ao)
 static void drain(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
-    double maxbuffer = ao->buffer / (double)ao->samplerate + 1;
-
     MP_VERBOSE(ao, "draining...\n");
 
     pthread_mutex_lock(&p->lock);
+    double maxbuffer = p->target / (double)ao->samplerate + 1;
     if (p->paused)
         goto done;
 
@@ -186,13 +203,13 @@ static int unlocked_get_space(struct ao *ao)
     if (ao->driver->get_space) {
         int align = af_format_sample_alignment(ao->format);
         // The following code attempts to keep the total buffered audio to
-        // ao->buffer in order to improve latency.
+        // p->target in order to improve latency.
         int device_space = ao->driver->get_space(ao);
         int device_buffered = ao->device_buffer - device_space;
         int soft_buffered = mp_audio_buffer_samples(p->buffer);
         // The extra margin helps avoiding too many wakeups if the AO is fully
         // byte based and doesn't do proper chunked processing.
-        int min_buffer = ao->buffer + 64;
+        int min_buffer = p->target + 64;
         int missing = min_buffer - device_buffered - soft_buffered;
         missing = (missing + align - 1) / align * align;
         // But always keep the device's buffer filled as much as we can.
@@ -277,6 +294,35 @@ static bool realloc_silence(struct ao *ao, int samples)
     return true;
 }
 
+// With --audio-buffer-max: grow the soft buffer on underruns, and shrink it back
+// slowly while playback is stable.
+// called locked
+static void adapt_buffer(struct ao *ao, bool new_underrun)
+{
+    struct ao_push_state *p = ao->api_priv;
+    if (!p->max_target)
+        return;
+
+    double now = mp_time_sec();
+    int align = af_format_sample_alignment(ao->format);
+    int target = p->target;
+    if (new_underrun) {
+        target = MPMIN(target + target / 2, p->max_target);
+    } else if (now - p->last_adjust > 30 && p->still_playing && !p->underrun) {
+        target = MPMAX(target - target / 10, ao->buffer);
+    } else {
+        return;
+    }
+    target = (target + align - 1) / align * align;
+    p->last_adjust = now;
+    if (target == p->target)
+        return;
+
+    MP_VERBOSE(ao, "Changing soft-buffer to %d samples.\n", target);
+    p->target = target;
+    mp_audio_buffer_preallocate_min(p->buffer, target);
+}
+
 // called locked
 static void ao_play_data(struct ao *ao)
 {
@@ -295,6 +341,16 @@ static void ao_play_data(struct ao *ao)
         mp_audio_buffer_peek(p->buffer, &planes, &samples);
     }
     int max = samples;
+    // Count each time the device runs out of data while playing.
+    bool underrun = !play_silence && p->still_playing && !p->final_chunk &&
+                    space > 0 && max == 0;
+    bool new_underrun = underrun && !p->underrun;
+    if (new_underrun) {
+        mp_perf_add(ao->global, MP_PERF_AO_UNDERRUNS, 1);
+        p->num_underruns++;
+    }
+    p->underrun = underrun;
+    adapt_buffer(ao, new_underrun);
     if (samples > space)
         samples = space;
     int flags = 0;
@@ -465,6 +521,10 @@ static int init(struct ao *ao)
     mp_audio_buffer_reinit_fmt(p->buffer, ao->format,
                                &ao->channels, ao->samplerate);
     mp_audio_buffer_preallocate_min(p->buffer, ao->buffer);
+    p->target = ao->buffer;
+    if (ao->max_buffer * ao->samplerate > ao->buffer)
+        p->max_target = ao->max_buffer * ao->samplerate;
+    p->last_adjust = mp_time_sec();
     if (pthread_create(&p->thread, NULL, playthread, ao))
         goto err;
     return 0;
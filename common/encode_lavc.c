@@ -301,6 +301,9 @@ int encode_lavc_start(struct encode_lavc_context *ctx)
             return 0;
         }
     }
+    // vo_lavc opens hardware encoders only with the first frame.
+    if (ctx->vcc && !avcodec_is_open(ctx->vcc))
+        return 0;
     if (ctx->expect_audio && ctx->acc == NULL) {
         if (ctx->avc->oformat->audio_codec != AV_CODEC_ID_NONE ||
             ctx->options->acodec) {
@@ -692,6 +695,11 @@ int encode_lavc_open_codec(struct encode_lavc_context *ctx,
                    ctx->vc->name);
         }
 
+        // libavcodec defaults to a single thread; let the encoder pick the
+        // thread count (normally one per core) unless the user set it.
+        if (!av_dict_get(ctx->voptions, "threads", NULL, 0))
+            codec->thread_count = 0;
+
         ret = avcodec_open2(codec, ctx->vc, &ctx->voptions);
         if (ret >= 0)
             ret = avcodec_parameters_from_context(ctx->vst->codecpar, codec);
@@ -0,0 +1,169 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+
+#include "mpv_talloc.h"
+
+#include "common/common.h"
+#include "common/global.h"
+#include "osdep/atomic.h"
+
+#include "mem_budget.h"
+
+struct mp_mem_budget {
+    pthread_mutex_t lock;
+
+    // --- the following fields are protected by lock
+    int64_t limit;
+    struct mp_mem_client **clients;
+    int num_clients;
+};
+
+struct mp_mem_client {
+    struct mp_mem_budget *budget;
+    atomic_llong limit;
+
+    // --- the following fields are protected by budget->lock
+    int prio;
+    int64_t wanted;
+    bool done;          // temporary for recompute()
+};
+
+static void budget_dtor(void *ptr)
+{
+    struct mp_mem_budget *b = ptr;
+    assert(b->num_clients == 0);
+    pthread_mutex_destroy(&b->lock);
+}
+
+struct mp_mem_budget *mp_mem_budget_create(void *ta_parent)
+{
+    struct mp_mem_budget *b = talloc_zero(ta_parent, struct mp_mem_budget);
+    talloc_set_destructor(b, budget_dtor);
+    pthread_mutex_init(&b->lock, NULL);
+    return b;
+}
+
+// Must be called with b->lock held.
+static void recompute(struct mp_mem_budget *b)
+{
+    for (int n = 0; n < b->num_clients; n++) {
+        struct mp_mem_client *c = b->clients[n];
+        c->done = !b->limit;
+        if (c->done)
+            atomic_store(&c->limit, c->wanted);
+    }
+
+    // Give the clients wanting less than their weighted share what they want,
+    // and repeat with the remaining memory until all shares are too small.
+    int64_t remaining = b->limit;
+    while (1) {
+        int64_t weights = 0;
+        for (int n = 0; n < b->num_clients; n++) {
+            if (!b->clients[n]->done)
+                weights += b->clients[n]->prio;
+        }
+        if (!weights)
+            break;
+
+        bool changed = false;
+        for (int n = 0; n < b->num_clients; n++) {
+            struct mp_mem_client *c = b->clients[n];
+            if (!c->done && c->wanted <= remaining * c->prio / weights) {
+                atomic_store(&c->limit, c->wanted);
+                remaining -= c->wanted;
+                c->done = true;
+                changed = true;
+            }
+        }
+        if (changed)
+            continue;
+
+        for (int n = 0; n < b->num_clients; n++) {
+            struct mp_mem_client *c = b->clients[n];
+            if (!c->done) {
+                atomic_store(&c->limit, remaining * c->prio / weights);
+                c->done = true;
+            }
+        }
+    }
+}
+
+void mp_mem_budget_set_limit(struct mp_mem_budget *b, int64_t limit)
+{
+    pthread_mutex_lock(&b->lock);
+    b->limit = MPMAX(limit, 0);
+    recompute(b);
+    pthread_mutex_unlock(&b->lock);
+}
+
+struct mp_mem_client *mp_mem_client_new(struct mpv_global *global,
+                                        enum mp_mem_prio prio, int64_t wanted)
+{
+    struct mp_mem_budget *b = global ? global->mem_budget : NULL;
+    if (!b)
+        return NULL;
+
+    struct mp_mem_client *c = talloc_ptrtype(NULL, c);
+    *c = (struct mp_mem_client){
+        .budget = b,
+        .prio = prio,
+        .wanted = MPMAX(wanted, 0),
+    };
+    atomic_store(&c->limit, c->wanted);
+
+    pthread_mutex_lock(&b->lock);
+    MP_TARRAY_APPEND(b, b->clients, b->num_clients, c);
+    recompute(b);
+    pthread_mutex_unlock(&b->lock);
+    return c;
+}
+
+void mp_mem_client_free(struct mp_mem_client *c)
+{
+    if (!c)
+        return;
+    struct mp_mem_budget *b = c->budget;
+    pthread_mutex_lock(&b->lock);
+    for (int n = 0; n < b->num_clients; n++) {
+        if (b->clients[n] == c) {
+            MP_TARRAY_REMOVE_AT(b->clients, b->num_clients, n);
+            break;
+        }
+    }
+    recompute(b);
+    pthread_mutex_unlock(&b->lock);
+    talloc_free(c);
+}
+
+void mp_mem_client_set_wanted(struct mp_mem_client *c, int64_t wanted)
+{
+    if (!c)
+        return;
+    struct mp_mem_budget *b = c->budget;
+    pthread_mutex_lock(&b->lock);
+    c->wanted = MPMAX(wanted, 0);
+    recompute(b);
+    pthread_mutex_unlock(&b->lock);
+}
+
+// def is returned if c==NULL.
+int64_t mp_mem_client_get_limit(struct mp_mem_client *c, int64_t def)
+{
+    return c ? atomic_load(&c->limit) : def;
+}
@@ -0,0 +1,37 @@
+#ifndef MP_MEM_BUDGET_H
+#define MP_MEM_BUDGET_H
+
+#include <stdint.h>
+
+// Process-wide (per mpv_global) limit for the big buffers: demuxer packet
+// queues and stream caches. Each buffer registers as client with the amount of
+// memory it would use on its own (its configured limit), and a priority. If
+// the sum exceeds the budget, the budget is split between the clients by
+// priority weight; clients which want less than their share get what they
+// want, and the rest is redistributed among the others. Limits are recomputed
+// when clients come and go, or the budget changes.
+
+enum mp_mem_prio {
+    MP_MEM_PRIO_LOW = 1,        // e.g. stream cache below a demuxer
+    MP_MEM_PRIO_NORMAL = 2,     // external tracks, timeline segments
+    MP_MEM_PRIO_HIGH = 4,       // main file demuxer
+};
+
+struct mpv_global;
+struct mp_mem_budget;
+struct mp_mem_client;
+
+struct mp_mem_budget *mp_mem_budget_create(void *ta_parent);
+// limit==0 disables the budget (every client gets what it wants).
+void mp_mem_budget_set_limit(struct mp_mem_budget *b, int64_t limit);
+
+// Returns NULL if global has no budget. All functions below accept NULL.
+struct mp_mem_client *mp_mem_client_new(struct mpv_global *global,
+                                        enum mp_mem_prio prio, int64_t wanted);
+void mp_mem_client_free(struct mp_mem_client *c);
+void mp_mem_client_set_wanted(struct mp_mem_client *c, int64_t wanted);
+// Return the current limit for this client (<= wanted). Can be called from any
+// thread; the value can change at any time.
+int64_t mp_mem_client_get_limit(struct mp_mem_client *c, int64_t def);
+
+#endif
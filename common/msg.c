@@ -36,6 +36,7 @@
 #include "options/path.h"
 #include "osdep/terminal.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "libmpv/client.h"
@@ -61,8 +62,21 @@ struct mp_log_root {
     int num_buffers;
     FILE *log_file;
     FILE *stats_file;
+    FILE *trace_file;
     char *log_path;
     char *stats_path;
+    char *trace_path;
+    pthread_t *trace_threads;   // index+1 is used as trace event thread ID
+    int num_trace_threads;
+    // --log-file-async: if log_ring is set, log_file is written by
+    // log_file_thread, and log_file/log_path can't change while it runs.
+    struct mp_ring *log_ring;   // log_file_entry pointers; single writer
+    pthread_t log_thread;
+    pthread_mutex_t log_thread_lock;
+    pthread_cond_t log_thread_wakeup;
+    bool log_thread_signaled;   // protected by log_thread_lock
+    bool log_thread_exit;       // protected by log_thread_lock
+    atomic_int log_dropped;     // messages lost due to a full log_ring
     // --- must be accessed atomically
     /* This is incremented every time the msglevels must be reloaded.
      * (This is perhaps better than maintaining a globally accessible and
@@ -121,7 +135,7 @@ static void update_loglevel(struct mp_log *log)
         log->level = MPMAX(log->level, log->root->buffers[n]->level);
     if (log->root->log_file)
         log->level = MPMAX(log->level, MSGL_V);
-    if (log->root->stats_file)
+    if (log->root->stats_file || log->root->trace_file)
         log->level = MPMAX(log->level, MSGL_STATS);
     atomic_store(&log->reload_counter, atomic_load(&log->root->reload_counter));
     pthread_mutex_unlock(&mp_msg_lock);
@@ -281,6 +295,20 @@ static void print_terminal_line(struct mp_log *log, int lev,
     fflush(stream);
 }
 
+struct log_file_entry {
+    int64_t time;
+    int level;
+    char *prefix;
+    char *text;
+};
+
+static void print_log_file_line(FILE *f, int64_t time, int lev,
+                                const char *prefix, const char *text)
+{
+    fprintf(f, "[%8.3f][%c][%s] %s", (time - MP_START_TIME) / 1e6,
+            mp_log_levels[lev][0], prefix, text);
+}
+
 static void write_log_file(struct mp_log *log, int lev, char *text)
 {
     struct mp_log_root *root = log->root;
@@ -288,13 +316,113 @@ static void write_log_file(struct mp_log *log, int lev, char *text)
     if (!root->log_file || lev > MPMAX(MSGL_V, log->terminal_level))
         return;
 
-    fprintf(root->log_file, "[%8.3f][%c][%s] %s",
-            (mp_time_us() - MP_START_TIME) / 1e6,
-            mp_log_levels[lev][0],
-            log->verbose_prefix, text);
+    if (root->log_ring) {
+        // Assuming a single writer (serialized by msg lock)
+        if (mp_ring_available(root->log_ring) / sizeof(void *) < 1) {
+            atomic_fetch_add(&root->log_dropped, 1);
+            return;
+        }
+        struct log_file_entry *entry = talloc_ptrtype(NULL, entry);
+        *entry = (struct log_file_entry) {
+            .time = mp_time_us(),
+            .level = lev,
+            .prefix = talloc_strdup(entry, log->verbose_prefix),
+            .text = talloc_strdup(entry, text),
+        };
+        mp_ring_write(root->log_ring, (unsigned char *)&entry, sizeof(entry));
+        pthread_mutex_lock(&root->log_thread_lock);
+        root->log_thread_signaled = true;
+        pthread_cond_signal(&root->log_thread_wakeup);
+        pthread_mutex_unlock(&root->log_thread_lock);
+        return;
+    }
+
+    print_log_file_line(root->log_file, mp_time_us(), lev,
+                        log->verbose_prefix, text);
     fflush(root->log_file);
 }
 
+// Write out everything queued in log_ring. Called on log_thread only.
+static void drain_log_ring(struct mp_log_root *root)
+{
+    FILE *f = root->log_file;
+    bool wrote = false;
+    while (1) {
+        struct log_file_entry *entry = NULL;
+        int read = mp_ring_read(root->log_ring, (unsigned char *)&entry,
+                                sizeof(entry));
+        if (read == 0)
+            break;
+        if (read != sizeof(entry))
+            abort();
+        print_log_file_line(f, entry->time, entry->level, entry->prefix,
+                            entry->text);
+        talloc_free(entry);
+        wrote = true;
+    }
+    int dropped = atomic_fetch_and(&root->log_dropped, 0);
+    if (dropped) {
+        fprintf(f, "[%8.3f][e][log] %d log messages dropped\n",
+                (mp_time_us() - MP_START_TIME) / 1e6, dropped);
+        wrote = true;
+    }
+    if (wrote)
+        fflush(f);
+}
+
+static void *log_file_thread(void *p)
+{
+    struct mp_log_root *root = p;
+    mpthread_set_name("log-file");
+
+    while (1) {
+        pthread_mutex_lock(&root->log_thread_lock);
+        while (!root->log_thread_signaled && !root->log_thread_exit)
+            pthread_cond_wait(&root->log_thread_wakeup, &root->log_thread_lock);
+        root->log_thread_signaled = false;
+        bool exit = root->log_thread_exit;
+        pthread_mutex_unlock(&root->log_thread_lock);
+
+        drain_log_ring(root);
+        if (exit)
+            break;
+    }
+    return NULL;
+}
+
+// Must not be called with mp_msg_lock held.
+static void stop_log_file_thread(struct mp_log_root *root)
+{
+    pthread_mutex_lock(&mp_msg_lock);
+    bool running = !!root->log_ring;
+    pthread_mutex_unlock(&mp_msg_lock);
+    if (!running)
+        return;
+
+    pthread_mutex_lock(&root->log_thread_lock);
+    root->log_thread_exit = true;
+    pthread_cond_signal(&root->log_thread_wakeup);
+    pthread_mutex_unlock(&root->log_thread_lock);
+    pthread_join(root->log_thread, NULL);
+
+    pthread_mutex_lock(&mp_msg_lock);
+    TA_FREEP(&root->log_ring);
+    pthread_mutex_unlock(&mp_msg_lock);
+}
+
+static void start_log_file_thread(struct mp_log_root *root)
+{
+    pthread_mutex_lock(&mp_msg_lock);
+    if (root->log_file && !root->log_ring) {
+        root->log_thread_exit = false;
+        root->log_thread_signaled = false;
+        root->log_ring = mp_ring_new(root, 4096 * sizeof(void *));
+        if (pthread_create(&root->log_thread, NULL, log_file_thread, root))
+            TA_FREEP(&root->log_ring);
+    }
+    pthread_mutex_unlock(&mp_msg_lock);
+}
+
 static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
 {
     struct mp_log_root *root = log->root;
@@ -330,11 +458,64 @@ static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
     }
 }
 
+static int get_trace_tid(struct mp_log_root *root)
+{
+    pthread_t self = pthread_self();
+    for (int n = 0; n < root->num_trace_threads; n++) {
+        if (pthread_equal(root->trace_threads[n], self))
+            return n + 1;
+    }
+    MP_TARRAY_APPEND(root, root->trace_threads, root->num_trace_threads, self);
+    return root->num_trace_threads;
+}
+
+// Write a stats message as Chrome trace event: "start <name>" and
+// "end <name>" become duration events, "value <v> <name>" a counter, and
+// everything else an instant event.
+static void dump_trace(struct mp_log_root *root, int64_t ts, char *text)
+{
+    FILE *f = root->trace_file;
+    bstr name = bstr0(text);
+    char ph = 'i';
+    double value = 0;
+    if (bstr_eatstart0(&name, "start ")) {
+        ph = 'B';
+    } else if (bstr_eatstart0(&name, "end ")) {
+        ph = 'E';
+    } else if (bstr_eatstart0(&name, "value ")) {
+        ph = 'C';
+        value = bstrtod(name, &name);
+    }
+    name = bstr_strip(name);
+
+    fprintf(f, "%s{\"name\":\"", ftell(f) > 0 ? ",\n" : "[\n");
+    for (int n = 0; n < name.len; n++) {
+        unsigned char c = name.start[n];
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c >= 32) {
+            fputc(c, f);
+        }
+    }
+    fprintf(f, "\",\"ph\":\"%c\",\"ts\":%"PRId64",\"pid\":1,\"tid\":%d",
+            ph, ts, get_trace_tid(root));
+    if (ph == 'C')
+        fprintf(f, ",\"args\":{\"value\":%f}", value);
+    if (ph == 'i')
+        fprintf(f, ",\"s\":\"t\"");
+    fprintf(f, "}");
+}
+
 static void dump_stats(struct mp_log *log, int lev, char *text)
 {
     struct mp_log_root *root = log->root;
-    if (lev == MSGL_STATS && root->stats_file)
-        fprintf(root->stats_file, "%"PRId64" %s\n", mp_time_us(), text);
+    if (lev != MSGL_STATS)
+        return;
+    int64_t now = mp_time_us();
+    if (root->stats_file)
+        fprintf(root->stats_file, "%"PRId64" %s\n", now, text);
+    if (root->trace_file)
+        dump_trace(root, now, text);
 }
 
 void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
@@ -454,7 +635,10 @@ void mp_msg_init(struct mpv_global *global)
     *root = (struct mp_log_root){
         .global = global,
         .reload_counter = ATOMIC_VAR_INIT(1),
+        .log_dropped = ATOMIC_VAR_INIT(0),
     };
+    pthread_mutex_init(&root->log_thread_lock, NULL);
+    pthread_cond_init(&root->log_thread_wakeup, NULL);
 
     struct mp_log dummy = { .root = root };
     struct mp_log *log = mp_log_new(root, &dummy, "");
@@ -528,11 +712,20 @@ void mp_msg_update_msglevels(struct mpv_global *global)
     atomic_fetch_add(&root->reload_counter, 1);
     pthread_mutex_unlock(&mp_msg_lock);
 
+    // The log file can't be swapped while the writer thread uses it.
+    stop_log_file_thread(root);
+
     reopen_file(opts->log_file, &root->log_path, &root->log_file,
                 "log", global);
 
+    if (opts->log_file_async)
+        start_log_file_thread(root);
+
     reopen_file(opts->dump_stats, &root->stats_path, &root->stats_file,
                 "stats", global);
+
+    reopen_file(opts->dump_trace, &root->trace_path, &root->trace_file,
+                "trace", global);
 }
 
 void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr)
@@ -558,9 +751,17 @@ bool mp_msg_has_log_file(struct mpv_global *global)
 void mp_msg_uninit(struct mpv_global *global)
 {
     struct mp_log_root *root = global->log->root;
+    stop_log_file_thread(root);
+    pthread_cond_destroy(&root->log_thread_wakeup);
+    pthread_mutex_destroy(&root->log_thread_lock);
     if (root->stats_file)
         fclose(root->stats_file);
     talloc_free(root->stats_path);
+    if (root->trace_file) {
+        fprintf(root->trace_file, "\n]\n");
+        fclose(root->trace_file);
+    }
+    talloc_free(root->trace_path);
     if (root->log_file)
         fclose(root->log_file);
     talloc_free(root->log_path);
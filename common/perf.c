@@ -0,0 +1,188 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mpv_talloc.h"
+
+#include "common/common.h"
+#include "common/global.h"
+#include "misc/node.h"
+#include "osdep/atomic.h"
+
+#include "perf.h"
+
+// Timer histogram buckets: bucket n counts durations < 2^n microseconds (the
+// last one counts everything else).
+#define NUM_BUCKETS 24
+
+struct perf_timer {
+    atomic_ullong count;
+    atomic_ullong total_us;
+    atomic_ullong max_us;
+    atomic_ullong buckets[NUM_BUCKETS];
+};
+
+struct mp_perf {
+    atomic_ullong counters[MP_PERF_NUM_COUNTERS];
+    struct perf_timer timers[MP_PERF_NUM_TIMERS];
+};
+
+struct mp_perf_stat {
+    atomic_ullong counters[MP_PERF_STAT_NUM_COUNTERS];
+    struct perf_timer time;
+};
+
+static const char *const counter_names[MP_PERF_NUM_COUNTERS] = {
+    [MP_PERF_DEMUX_PACKETS] = "demux-packets",
+    [MP_PERF_DEMUX_BYTES]   = "demux-bytes",
+    [MP_PERF_AO_UNDERRUNS]  = "ao-underruns",
+    [MP_PERF_VO_DROPPED]    = "vo-dropped-frames",
+};
+
+static const char *const timer_names[MP_PERF_NUM_TIMERS] = {
+    [MP_PERF_VIDEO_DECODE]  = "video-decode",
+    [MP_PERF_VO_RENDER]     = "vo-render",
+    [MP_PERF_VO_PRESENT]    = "vo-present",
+    [MP_PERF_AUDIO_ENCODE]  = "audio-encode",
+};
+
+static void timer_add(struct perf_timer *t, int64_t duration_us)
+{
+    unsigned long long us = MPMAX(duration_us, 0);
+
+    int bucket = 0;
+    while (bucket < NUM_BUCKETS - 1 && us >= (1ULL << bucket))
+        bucket++;
+
+    atomic_fetch_add(&t->count, 1);
+    atomic_fetch_add(&t->total_us, us);
+    atomic_fetch_add(&t->buckets[bucket], 1);
+    unsigned long long max = atomic_load(&t->max_us);
+    while (us > max && !atomic_compare_exchange_strong(&t->max_us, &max, us)) {}
+}
+
+static void timer_get_node(struct perf_timer *t, struct mpv_node *sub)
+{
+    int64_t count = atomic_load(&t->count);
+    int64_t total = atomic_load(&t->total_us);
+    node_map_add_int64(sub, "count", count);
+    node_map_add_double(sub, "total", total / 1e6);
+    node_map_add_double(sub, "avg", count ? total / 1e6 / count : 0);
+    node_map_add_double(sub, "max", atomic_load(&t->max_us) / 1e6);
+}
+
+struct mp_perf *mp_perf_create(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct mp_perf);
+}
+
+void mp_perf_add(struct mpv_global *global, enum mp_perf_counter c, int64_t v)
+{
+    struct mp_perf *p = global ? global->perf : NULL;
+    if (p)
+        atomic_fetch_add(&p->counters[c], v);
+}
+
+void mp_perf_time(struct mpv_global *global, enum mp_perf_timer timer,
+                  int64_t duration_us)
+{
+    struct mp_perf *p = global ? global->perf : NULL;
+    if (!p)
+        return;
+    timer_add(&p->timers[timer], duration_us);
+}
+
+void mp_perf_get_node(struct mp_perf *p, struct mpv_node *dst)
+{
+    node_init(dst, MPV_FORMAT_NODE_MAP, NULL);
+
+    for (int n = 0; n < MP_PERF_NUM_COUNTERS; n++) {
+        node_map_add_int64(dst, counter_names[n],
+                           atomic_load(&p->counters[n]));
+    }
+
+    for (int n = 0; n < MP_PERF_NUM_TIMERS; n++) {
+        struct perf_timer *t = &p->timers[n];
+        struct mpv_node *sub = node_map_add(dst, timer_names[n],
+                                            MPV_FORMAT_NODE_MAP);
+        timer_get_node(t, sub);
+        // Histogram with the upper bound of each bucket in seconds.
+        struct mpv_node *hist = node_map_add(sub, "histogram",
+                                             MPV_FORMAT_NODE_ARRAY);
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            int64_t v = atomic_load(&t->buckets[i]);
+            if (!v)
+                continue;
+            struct mpv_node *e = node_array_add(hist, MPV_FORMAT_NODE_MAP);
+            if (i < NUM_BUCKETS - 1)
+                node_map_add_double(e, "below", (1ULL << i) / 1e6);
+            node_map_add_int64(e, "count", v);
+        }
+    }
+}
+
+const char *mp_perf_counter_name(enum mp_perf_counter c)
+{
+    return counter_names[c];
+}
+
+const char *mp_perf_timer_name(enum mp_perf_timer t)
+{
+    return timer_names[t];
+}
+
+int64_t mp_perf_get_counter(struct mp_perf *p, enum mp_perf_counter c)
+{
+    return atomic_load(&p->counters[c]);
+}
+
+void mp_perf_get_timer(struct mp_perf *p, enum mp_perf_timer t,
+                       struct mp_perf_timer_stats *st)
+{
+    *st = (struct mp_perf_timer_stats){
+        .count = atomic_load(&p->timers[t].count),
+        .total_us = atomic_load(&p->timers[t].total_us),
+        .max_us = atomic_load(&p->timers[t].max_us),
+    };
+}
+
+struct mp_perf_stat *mp_perf_stat_create(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct mp_perf_stat);
+}
+
+void mp_perf_stat_add(struct mp_perf_stat *s, enum mp_perf_stat_counter c,
+                      int64_t v)
+{
+    if (s)
+        atomic_fetch_add(&s->counters[c], v);
+}
+
+void mp_perf_stat_time(struct mp_perf_stat *s, int64_t duration_us)
+{
+    if (s)
+        timer_add(&s->time, duration_us);
+}
+
+void mp_perf_stat_get_node(struct mp_perf_stat *s, struct mpv_node *dst)
+{
+    struct mpv_node *sub = node_map_add(dst, "time", MPV_FORMAT_NODE_MAP);
+    timer_get_node(&s->time, sub);
+    node_map_add_int64(dst, "frames",
+                       atomic_load(&s->counters[MP_PERF_STAT_FRAMES]));
+    node_map_add_int64(dst, "allocations",
+                       atomic_load(&s->counters[MP_PERF_STAT_ALLOCS]));
+}
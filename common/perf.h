@@ -0,0 +1,86 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_PERF_H
+#define MP_PERF_H
+
+#include <stdint.h>
+
+// Always-on performance counters. Updating them is a single atomic add (or a
+// few for timers), so they can be used on hot paths.
+
+enum mp_perf_counter {
+    MP_PERF_DEMUX_PACKETS,      // packets added to demuxer queues
+    MP_PERF_DEMUX_BYTES,        // bytes of these packets
+    MP_PERF_AO_UNDERRUNS,       // AO wanted data, but none was buffered
+    MP_PERF_VO_DROPPED,         // frames dropped by the VO
+    MP_PERF_NUM_COUNTERS
+};
+
+enum mp_perf_timer {
+    MP_PERF_VIDEO_DECODE,       // time spent in the video decoder per call
+    MP_PERF_VO_RENDER,          // VO draw_frame/draw_image
+    MP_PERF_VO_PRESENT,         // VO flip_page
+    MP_PERF_AUDIO_ENCODE,       // af_lavcac3enc encoder calls
+    MP_PERF_NUM_TIMERS
+};
+
+struct mp_perf;
+struct mpv_global;
+struct mpv_node;
+
+struct mp_perf *mp_perf_create(void *ta_parent);
+
+void mp_perf_add(struct mpv_global *global, enum mp_perf_counter c, int64_t v);
+void mp_perf_time(struct mpv_global *global, enum mp_perf_timer t,
+                  int64_t duration_us);
+
+// Return the current state as node map (free it with talloc_free(dst->u.list)).
+void mp_perf_get_node(struct mp_perf *p, struct mpv_node *dst);
+
+struct mp_perf_timer_stats {
+    int64_t count;
+    int64_t total_us;
+    int64_t max_us;
+};
+
+// Direct access to single values, for consumers which poll them frequently.
+const char *mp_perf_counter_name(enum mp_perf_counter c);
+const char *mp_perf_timer_name(enum mp_perf_timer t);
+int64_t mp_perf_get_counter(struct mp_perf *p, enum mp_perf_counter c);
+void mp_perf_get_timer(struct mp_perf *p, enum mp_perf_timer t,
+                       struct mp_perf_timer_stats *st);
+
+// Statistics of a single object, such as a filter instance. Can be updated
+// from any thread.
+enum mp_perf_stat_counter {
+    MP_PERF_STAT_FRAMES,        // frames output
+    MP_PERF_STAT_ALLOCS,        // images/buffers allocated
+    MP_PERF_STAT_NUM_COUNTERS
+};
+
+struct mp_perf_stat;
+
+struct mp_perf_stat *mp_perf_stat_create(void *ta_parent);
+void mp_perf_stat_add(struct mp_perf_stat *s, enum mp_perf_stat_counter c,
+                      int64_t v);
+void mp_perf_stat_time(struct mp_perf_stat *s, int64_t duration_us);
+
+// Add the statistics to the node map dst.
+void mp_perf_stat_get_node(struct mp_perf_stat *s, struct mpv_node *dst);
+
+#endif
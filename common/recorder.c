@@ -16,6 +16,7 @@
  */
 
 #include <math.h>
+#include <pthread.h>
 
 #include <libavformat/avformat.h>
 
@@ -25,6 +26,8 @@
 #include "common/msg.h"
 #include "demux/packet.h"
 #include "demux/stheader.h"
+#include "options/options.h"
+#include "osdep/threads.h"
 
 #include "recorder.h"
 
@@ -59,6 +62,20 @@ struct mp_recorder {
     double rebase_ts;
 
     AVFormatContext *mux;
+
+    // Write-behind queue. If write_buffer is 0, packets are written directly
+    // by the caller. Otherwise, the writer thread owns the mux context while
+    // it is running, and everything else is protected by lock.
+    int write_buffer;           // max. bytes in queue
+    bool write_drop;            // drop instead of blocking on overflow
+    bool writer_running;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    AVPacket **queue;
+    int num_queue;
+    size_t queue_bytes;
+    bool writer_exit;
 };
 
 struct mp_recorder_sink {
@@ -68,10 +85,84 @@ struct mp_recorder_sink {
     double max_out_pts;
     bool discont;
     bool proper_eof;
+    bool overflow;          // dropping packets until next keyframe
     struct demux_packet **packets;
     int num_packets;
 };
 
+static void *writer_thread(void *p)
+{
+    struct mp_recorder *priv = p;
+
+    mpthread_set_name("recorder");
+
+    pthread_mutex_lock(&priv->lock);
+    while (1) {
+        if (priv->num_queue) {
+            AVPacket *pkt = priv->queue[0];
+            MP_TARRAY_REMOVE_AT(priv->queue, priv->num_queue, 0);
+            pthread_mutex_unlock(&priv->lock);
+
+            int size = pkt->size;
+            if (av_interleaved_write_frame(priv->mux, pkt) < 0)
+                MP_ERR(priv, "Failed writing packet.\n");
+            av_packet_free(&pkt);
+
+            pthread_mutex_lock(&priv->lock);
+            priv->queue_bytes -= size;
+            pthread_cond_broadcast(&priv->wakeup);
+            continue;
+        }
+        if (priv->writer_exit)
+            break;
+        pthread_cond_wait(&priv->wakeup, &priv->lock);
+    }
+    pthread_mutex_unlock(&priv->lock);
+    return NULL;
+}
+
+// Whether a packet of the given size can be queued without exceeding the
+// buffer limit. An empty queue always accepts a packet.
+static bool queue_has_space(struct mp_recorder *priv, int size)
+{
+    return !priv->num_queue ||
+           priv->queue_bytes + size <= (size_t)priv->write_buffer;
+}
+
+static void write_packet(struct mp_recorder *priv, AVPacket *pkt)
+{
+    if (!priv->writer_running) {
+        if (av_interleaved_write_frame(priv->mux, pkt) < 0)
+            MP_ERR(priv, "Failed writing packet.\n");
+        av_packet_free(&pkt);
+        return;
+    }
+
+    // In drop mode, overflow is handled in mp_recorder_feed_packet(). Packets
+    // that made it past that point are part of a decodable sequence, so they
+    // are always queued, even if this exceeds the limit a bit.
+    pthread_mutex_lock(&priv->lock);
+    while (!priv->write_drop && !queue_has_space(priv, pkt->size))
+        pthread_cond_wait(&priv->wakeup, &priv->lock);
+    MP_TARRAY_APPEND(priv, priv->queue, priv->num_queue, pkt);
+    priv->queue_bytes += pkt->size;
+    pthread_cond_broadcast(&priv->wakeup);
+    pthread_mutex_unlock(&priv->lock);
+}
+
+static void stop_writer(struct mp_recorder *priv)
+{
+    if (!priv->writer_running)
+        return;
+
+    pthread_mutex_lock(&priv->lock);
+    priv->writer_exit = true;
+    pthread_cond_broadcast(&priv->wakeup);
+    pthread_mutex_unlock(&priv->lock);
+    pthread_join(priv->writer, NULL);
+    priv->writer_running = false;
+}
+
 static int add_stream(struct mp_recorder *priv, struct sh_stream *sh)
 {
     enum AVMediaType av_type = mp_to_av_stream_type(sh->type);
@@ -123,6 +214,10 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
 
     priv->global = global;
     priv->log = mp_log_new(priv, global->log, "recorder");
+    priv->write_buffer = global->opts->record_file_buffer;
+    priv->write_drop = global->opts->record_file_overflow;
+    pthread_mutex_init(&priv->lock, NULL);
+    pthread_cond_init(&priv->wakeup, NULL);
 
     if (!num_streams) {
         MP_ERR(priv, "No streams.\n");
@@ -170,6 +265,13 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
     priv->base_ts = MP_NOPTS_VALUE;
     priv->rebase_ts = 0;
 
+    if (priv->write_buffer > 0) {
+        priv->writer_running =
+            !pthread_create(&priv->writer, NULL, writer_thread, priv);
+        if (!priv->writer_running)
+            MP_WARN(priv, "Could not start writer thread.\n");
+    }
+
     MP_WARN(priv, "This is an experimental feature. Output files might be "
                   "broken or not play correctly with various players "
                   "(including mpv itself).\n");
@@ -217,8 +319,7 @@ static void mux_packet(struct mp_recorder_sink *rst,
         return;
     }
 
-    if (av_interleaved_write_frame(priv->mux, new_packet) < 0)
-        MP_ERR(priv, "Failed writing packet.\n");
+    write_packet(priv, new_packet);
 }
 
 // Write all packets that currently can be written.
@@ -300,6 +401,8 @@ void mp_recorder_destroy(struct mp_recorder *priv)
             mux_packets(rst, true);
         }
 
+        stop_writer(priv);
+
         if (av_write_trailer(priv->mux) < 0)
             MP_ERR(priv, "Writing trailer failed.\n");
     }
@@ -312,6 +415,8 @@ void mp_recorder_destroy(struct mp_recorder *priv)
     }
 
     flush_packets(priv);
+    pthread_cond_destroy(&priv->wakeup);
+    pthread_mutex_destroy(&priv->lock);
     talloc_free(priv);
 }
 
@@ -323,6 +428,7 @@ void mp_recorder_mark_discontinuity(struct mp_recorder *priv)
     for (int n = 0; n < priv->num_streams; n++) {
         struct mp_recorder_sink *rst = priv->streams[n];
         rst->discont = true;
+        rst->overflow = false;
         rst->proper_eof = false;
     }
 
@@ -368,6 +474,24 @@ void mp_recorder_feed_packet(struct mp_recorder_sink *rst,
         return;
     rst->discont = false;
 
+    // If the writer can't keep up, skip until the next keyframe.
+    if (priv->writer_running && priv->write_drop) {
+        pthread_mutex_lock(&priv->lock);
+        bool space = queue_has_space(priv, pkt->len);
+        pthread_mutex_unlock(&priv->lock);
+        if (rst->overflow && !pkt->keyframe)
+            return;
+        if (!space) {
+            if (!rst->overflow) {
+                MP_WARN(priv, "Output too slow; dropping packets of stream "
+                        "%d until next keyframe.\n", rst->av_stream->index);
+            }
+            rst->overflow = true;
+            return;
+        }
+        rst->overflow = false;
+    }
+
     if (rst->num_packets >= QUEUE_MAX_PACKETS) {
         MP_ERR(priv, "Stream %d has too many queued packets; dropping.\n",
                rst->av_stream->index);
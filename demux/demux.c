@@ -28,13 +28,21 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <libavutil/md5.h>
+
 #include "config.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "options/path.h"
 #include "mpv_talloc.h"
+#include "common/mem_budget.h"
 #include "common/msg.h"
 #include "common/global.h"
+#include "common/perf.h"
+#include "misc/ctype.h"
+#include "osdep/io.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -92,6 +100,9 @@ struct demux_opts {
     int access_references;
     int seekable_cache;
     int create_ccs;
+    char *cache_dir;
+    int probe_cache;
+    int compress_cache;
 };
 
 #define OPT_BASE_STRUCT struct demux_opts
@@ -106,6 +117,11 @@ const struct m_sub_options demux_conf = {
         OPT_FLAG("access-references", access_references, 0),
         OPT_FLAG("demuxer-seekable-cache", seekable_cache, 0),
         OPT_FLAG("sub-create-cc-track", create_ccs, 0),
+        OPT_STRING("demuxer-cache-dir", cache_dir, M_OPT_FILE),
+        OPT_FLAG("demuxer-probe-cache", probe_cache, 0),
+#if HAVE_LZ4
+        OPT_FLAG("demuxer-cache-compress", compress_cache, 0),
+#endif
         {0}
     },
     .size = sizeof(struct demux_opts),
@@ -115,6 +131,7 @@ const struct m_sub_options demux_conf = {
         .min_secs = 1.0,
         .min_secs_cache = 10.0,
         .access_references = 1,
+        .probe_cache = 1,
     },
 };
 
@@ -156,6 +173,8 @@ struct demux_internal {
     int max_bytes;
     int max_bytes_bw;
     int seekable_cache;
+    int compress_cache;
+    char *cache_dir;            // for persistent cache (NULL if disabled)
 
     // Set if we know that we are at the start of the file. This is used to
     // avoid a redundant initial seek after enabling streams. We could just
@@ -164,6 +183,12 @@ struct demux_internal {
 
     bool tracks_switched;       // thread needs to inform demuxer of this
 
+    // For measuring the input rate (see update_read_speed()).
+    uint64_t read_bytes;        // total size of packets added by the demuxer
+    uint64_t speed_bytes;
+    int64_t speed_time;
+    double read_speed;
+
     bool seeking;               // there's a seek queued
     int seek_flags;             // flags for next seek (if seeking==true)
     double seek_pts;
@@ -179,6 +204,10 @@ struct demux_internal {
     struct demux_cached_range **ranges;
     int num_ranges;
 
+    // Packets removed from the queues are recycled into this.
+    struct demux_packet_pool *packet_pool;
+
+    struct mp_mem_client *mem;  // share of the global memory budget
     size_t total_bytes;         // total sum of packet data buffered
     size_t fw_bytes;            // sum of forward packet data in current_range
 
@@ -206,15 +235,44 @@ struct demux_cached_range {
     double seek_start, seek_end;
 };
 
+// Entry in demux_queue.kf_index.
+struct demux_kf_entry {
+    struct demux_packet *dp;    // keyframe packet with kf_seek_pts set
+    struct demux_packet *prev;  // packet before dp in the queue (or NULL)
+};
+
 // A continuous list of cached packets for a single stream/range. There is one
 // for each stream and range.
 struct demux_queue {
     struct demux_stream *ds;
+    struct demux_cached_range *range;
 
     struct demux_packet *head;
     struct demux_packet *tail;
 
+    // State for appending packets. Only the queues of the current range are
+    // appended to, but it must be kept for resuming or joining other ranges.
+    bool correct_dts;       // packet DTS is strictly monotonically increasing
+    bool correct_pos;       // packet pos is strictly monotonically increasing
+    int64_t last_pos;       // for determining correct_pos
+    double last_dts;        // for determining correct_dts
+    double last_ts;         // timestamp of the last packet added to queue
+    bool cache_from_start;  // queue has all packets since start of the file
+    struct demux_packet *next_prune_target; // cached value for faster pruning
+    struct demux_packet *compress_pos;  // last packet checked for compression
+    // for incrementally determining seek PTS range
+    double keyframe_pts, keyframe_end_pts;
+    struct demux_packet *keyframe_latest;
+    struct demux_packet *keyframe_latest_prev; // packet before keyframe_latest
+
     double seek_start, seek_end;
+
+    // All packets in the queue which are valid seek targets, in queue order.
+    // Entries before kf_index_start were pruned and are unused.
+    struct demux_kf_entry *kf_index;
+    int kf_index_start, num_kf_index;
+    // Set if kf_seek_pts is not monotonic in kf_index (no binary search).
+    bool kf_index_unsorted;
 };
 
 struct demux_stream {
@@ -232,20 +290,11 @@ struct demux_stream {
     bool eof;               // end of demuxed stream? (true if all buffers empty)
     bool need_refresh;      // enabled mid-stream
     bool refreshing;
-    bool correct_dts;       // packet DTS is strictly monotonically increasing
-    bool correct_pos;       // packet pos is strictly monotonically increasing
-    int64_t last_pos;       // for determining correct_pos
-    double last_dts;        // for determining correct_dts
     bool global_correct_dts;// all observed so far
     bool global_correct_pos;
-    double last_ts;         // timestamp of the last packet added to queue
-    struct demux_packet *next_prune_target; // cached value for faster pruning
-    // for incrementally determining seek PTS range
-    bool keyframe_seen;
-    double keyframe_pts, keyframe_end_pts;
-    struct demux_packet *keyframe_latest;
 
     // current queue - used both for reading and demuxing (this is never NULL)
+    // (always the queue of this stream in in->current_range)
     struct demux_queue *queue;
 
     // reader (decoder) state (bitrate calculations are part of it because we
@@ -278,6 +327,7 @@ static void *demux_thread(void *pctx);
 static void update_cache(struct demux_internal *in);
 static int cached_demux_control(struct demux_internal *in, int cmd, void *arg);
 static void clear_demux_state(struct demux_internal *in);
+static void recompute_buffers(struct demux_stream *ds);
 
 #if 0
 // very expensive check for redundant cached queue state
@@ -331,10 +381,8 @@ static void check_queue_consistency(struct demux_internal *in)
 }
 #endif
 
-static void update_seek_ranges(struct demux_stream *ds)
+static void update_seek_ranges(struct demux_cached_range *range)
 {
-    struct demux_cached_range *range = ds->in->current_range;
-
     range->seek_start = range->seek_end = MP_NOPTS_VALUE;
 
     for (int n = 0; n < range->num_streams; n++) {
@@ -356,6 +404,100 @@ static void update_seek_ranges(struct demux_stream *ds)
         range->seek_start = range->seek_end = MP_NOPTS_VALUE;
 }
 
+static void init_queue(struct demux_queue *queue)
+{
+    queue->head = queue->tail = NULL;
+    queue->kf_index_start = queue->num_kf_index = 0;
+    queue->kf_index_unsorted = false;
+    queue->next_prune_target = NULL;
+    queue->compress_pos = NULL;
+    queue->keyframe_latest = NULL;
+    queue->keyframe_latest_prev = NULL;
+    queue->keyframe_pts = queue->keyframe_end_pts = MP_NOPTS_VALUE;
+    queue->correct_dts = queue->correct_pos = true;
+    queue->last_pos = -1;
+    queue->last_ts = queue->last_dts = MP_NOPTS_VALUE;
+    queue->seek_start = queue->seek_end = MP_NOPTS_VALUE;
+    queue->cache_from_start = false;
+}
+
+// Remove the first packet of the queue. It must not be part of the forward
+// buffer (ds->reader_head).
+static void remove_head_packet(struct demux_queue *queue)
+{
+    struct demux_internal *in = queue->ds->in;
+    struct demux_packet *dp = queue->head;
+
+    assert(dp && dp != queue->ds->reader_head);
+
+    queue->head = dp->next;
+    if (!queue->head)
+        queue->tail = NULL;
+    if (queue->next_prune_target == dp)
+        queue->next_prune_target = NULL;
+    if (queue->compress_pos == dp)
+        queue->compress_pos = NULL;
+    if (queue->keyframe_latest == dp)
+        queue->keyframe_latest = NULL;
+    if (queue->keyframe_latest_prev == dp)
+        queue->keyframe_latest_prev = NULL;
+    queue->cache_from_start = false;
+    if (queue->kf_index_start < queue->num_kf_index &&
+        queue->kf_index[queue->kf_index_start].dp == dp)
+        queue->kf_index_start++;
+
+    in->total_bytes -= demux_packet_estimate_total_size(dp);
+    demux_packet_pool_push(in->packet_pool, dp);
+}
+
+static void clear_queue(struct demux_queue *queue)
+{
+    struct demux_internal *in = queue->ds->in;
+
+    struct demux_packet *dp = queue->head;
+    while (dp) {
+        struct demux_packet *dn = dp->next;
+        in->total_bytes -= demux_packet_estimate_total_size(dp);
+        demux_packet_pool_push(in->packet_pool, dp);
+        dp = dn;
+    }
+    init_queue(queue);
+}
+
+static void free_cached_range(struct demux_internal *in, int index)
+{
+    struct demux_cached_range *range = in->ranges[index];
+    assert(range != in->current_range);
+    for (int n = 0; n < range->num_streams; n++)
+        clear_queue(range->streams[n]);
+    MP_TARRAY_REMOVE_AT(in->ranges, in->num_ranges, index);
+    talloc_free(range);
+}
+
+// Free all ranges other than the current one which can't be seeked to. Also
+// enforce the MAX_SEEK_RANGES limit by freeing the smallest ranges.
+static void free_empty_cached_ranges(struct demux_internal *in)
+{
+    for (int n = in->num_ranges - 1; n >= 0; n--) {
+        struct demux_cached_range *range = in->ranges[n];
+        if (range != in->current_range &&
+            (range->seek_start == MP_NOPTS_VALUE || !in->seekable_cache))
+            free_cached_range(in, n);
+    }
+
+    while (in->num_ranges > MAX_SEEK_RANGES) {
+        int worst = -1;
+        for (int n = 0; n < in->num_ranges; n++) {
+            struct demux_cached_range *range = in->ranges[n];
+            if (range != in->current_range &&
+                (worst < 0 || range->seek_end - range->seek_start <
+                 in->ranges[worst]->seek_end - in->ranges[worst]->seek_start))
+                worst = n;
+        }
+        free_cached_range(in, worst);
+    }
+}
+
 static void ds_clear_reader_state(struct demux_stream *ds)
 {
     ds->in->fw_bytes -= ds->fw_bytes;
@@ -370,33 +512,34 @@ static void ds_clear_reader_state(struct demux_stream *ds)
     ds->fw_packs = 0;
 }
 
+// Clear the packets of this stream in all cached ranges. Ranges which contain
+// no data for it become unseekable (if the stream is active).
 static void ds_clear_demux_state(struct demux_stream *ds)
 {
+    struct demux_internal *in = ds->in;
+
     ds_clear_reader_state(ds);
 
-    demux_packet_t *dp = ds->queue->head;
-    while (dp) {
-        demux_packet_t *dn = dp->next;
-        ds->in->total_bytes -= demux_packet_estimate_total_size(dp);
-        free_demux_packet(dp);
-        dp = dn;
+    for (int n = in->num_ranges - 1; n >= 0; n--) {
+        struct demux_cached_range *range = in->ranges[n];
+        // Other ranges would lack packets for a stream that is going to be
+        // read, so they can't be used anymore.
+        if (ds->selected && range != in->current_range) {
+            free_cached_range(in, n);
+        } else {
+            clear_queue(range->streams[ds->index]);
+        }
     }
-    ds->queue->head = ds->queue->tail = NULL;
-    ds->next_prune_target = NULL;
-    ds->keyframe_latest = NULL;
 
     ds->eof = false;
     ds->active = false;
     ds->refreshing = false;
     ds->need_refresh = false;
-    ds->correct_dts = ds->correct_pos = true;
-    ds->last_pos = -1;
-    ds->last_ts = ds->last_dts = MP_NOPTS_VALUE;
-    ds->queue->seek_start = ds->queue->seek_end = MP_NOPTS_VALUE;
-    ds->keyframe_seen = false;
-    ds->keyframe_pts = ds->keyframe_end_pts = MP_NOPTS_VALUE;
+    ds->queue->cache_from_start = in->initial_state;
 
-    update_seek_ranges(ds);
+    for (int n = 0; n < in->num_ranges; n++)
+        update_seek_ranges(in->ranges[n]);
+    free_empty_cached_ranges(in);
 }
 
 void demux_set_ts_offset(struct demuxer *demuxer, double offset)
@@ -425,6 +568,17 @@ struct sh_stream *demux_alloc_sh_stream(enum stream_type type)
     return sh;
 }
 
+static void add_range_queue(struct demux_cached_range *range,
+                            struct demux_stream *ds)
+{
+    struct demux_queue *queue = talloc_zero(range, struct demux_queue);
+    queue->ds = ds;
+    queue->range = range;
+    init_queue(queue);
+    MP_TARRAY_APPEND(range, range->streams, range->num_streams, queue);
+    assert(range->streams[ds->index] == queue);
+}
+
 // Add a new sh_stream to the demuxer. Note that as soon as the stream has been
 // added, it must be immutable, and must not be released (this will happen when
 // the demuxer is destroyed).
@@ -462,19 +616,11 @@ static void demux_add_sh_stream_locked(struct demux_internal *in,
     MP_TARRAY_APPEND(in, in->streams, in->num_streams, sh);
     assert(in->streams[sh->index] == sh);
 
-    for (int n = 0; n < in->num_ranges; n++) {
-        struct demux_cached_range *range = in->ranges[n];
-        struct demux_queue *queue = talloc_ptrtype(range, queue);
-        *queue = (struct demux_queue){
-            .ds = sh->ds,
-            .seek_start = MP_NOPTS_VALUE,
-            .seek_end = MP_NOPTS_VALUE,
-        };
-        MP_TARRAY_APPEND(range, range->streams, range->num_streams, queue);
-        assert(range->streams[sh->ds->index] == queue);
-    }
+    for (int n = 0; n < in->num_ranges; n++)
+        add_range_queue(in->ranges[n], sh->ds);
 
     sh->ds->queue = in->current_range->streams[sh->ds->index];
+    sh->ds->queue->cache_from_start = true;
 
     in->events |= DEMUX_EVENT_STREAMS;
     if (in->wakeup_cb)
@@ -541,6 +687,231 @@ int demux_get_num_stream(struct demuxer *demuxer)
     return r;
 }
 
+#define PERSISTENT_CACHE_MAGIC "mpv-demux-cache-1\n"
+
+// Return the file name of the persistent cache for this demuxer, or NULL if it
+// is not used for it. The file also stores *out_key to detect collisions.
+// Must be called locked.
+static char *get_persistent_cache_path(struct demux_internal *in, void *ta_ctx,
+                                       char **out_dir, char **out_key)
+{
+    struct demuxer *d = in->d_user;
+    if (!in->cache_dir || !in->seekable_cache || !d->is_network || !d->filename)
+        return NULL;
+
+    char *key = talloc_asprintf(ta_ctx, "%s\n%s\n", d->filename, d->desc->name);
+    for (int n = 0; n < in->num_streams; n++) {
+        struct sh_stream *sh = in->streams[n];
+        key = talloc_asprintf_append(key, "%d %s %d %d\n", sh->type,
+                                     sh->codec->codec, sh->ff_index,
+                                     sh->demuxer_id);
+    }
+    uint8_t md5[16];
+    av_md5_sum(md5, key, strlen(key));
+    char *name = talloc_strdup(ta_ctx, "");
+    for (int i = 0; i < 16; i++)
+        name = talloc_asprintf_append(name, "%02X", md5[i]);
+
+    *out_dir = mp_get_user_path(ta_ctx, d->global, in->cache_dir);
+    *out_key = key;
+    return mp_path_join(ta_ctx, *out_dir, name);
+}
+
+// Write the packet queues of the selected streams to the persistent cache. This
+// happens only if they contain everything since the start of the file, because
+// restoring anything else would be much more complicated.
+// Called on destruction, with the demuxer thread stopped.
+static void save_persistent_cache(struct demux_internal *in)
+{
+    void *tmp = talloc_new(NULL);
+    FILE *f = NULL;
+    char *tmp_path = NULL;
+
+    pthread_mutex_lock(&in->lock);
+
+    char *dir, *key;
+    char *path = get_persistent_cache_path(in, tmp, &dir, &key);
+    if (!path)
+        goto done;
+
+    int *saved = NULL;
+    int32_t num_saved = 0;
+    uint64_t total_bytes = 0;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (!ds->selected)
+            continue;
+        if (!ds->queue->cache_from_start || !ds->queue->head)
+            goto done;
+        for (struct demux_packet *dp = ds->queue->head; dp; dp = dp->next) {
+            if (dp->segmented)
+                goto done;
+            total_bytes += demux_packet_estimate_total_size(dp);
+        }
+        MP_TARRAY_APPEND(tmp, saved, num_saved, n);
+    }
+    if (!num_saved)
+        goto done;
+
+    mp_mkdirp(dir);
+    tmp_path = talloc_asprintf(tmp, "%s.tmp", path);
+    f = fopen(tmp_path, "wb");
+    if (!f) {
+        MP_WARN(in, "Could not create demuxer cache file %s.\n", tmp_path);
+        goto done;
+    }
+
+    const char *magic = PERSISTENT_CACHE_MAGIC;
+    uint32_t key_len = strlen(key);
+    bool ok = fwrite(magic, strlen(magic), 1, f) == 1 &&
+              fwrite(&key_len, sizeof(key_len), 1, f) == 1 &&
+              fwrite(key, key_len, 1, f) == 1 &&
+              fwrite(&total_bytes, sizeof(total_bytes), 1, f) == 1 &&
+              fwrite(&num_saved, sizeof(num_saved), 1, f) == 1 &&
+              fwrite(saved, sizeof(saved[0]), num_saved, f) == (size_t)num_saved;
+    for (int n = 0; n < num_saved && ok; n++) {
+        struct demux_stream *ds = in->streams[saved[n]]->ds;
+        for (struct demux_packet *dp = ds->queue->head; dp && ok; dp = dp->next)
+            ok = demux_packet_write(dp, f);
+    }
+    ok &= fclose(f) == 0;
+    f = NULL;
+
+    if (ok && rename(tmp_path, path) == 0) {
+        MP_VERBOSE(in, "Wrote %"PRIu64" bytes of cached packets to %s.\n",
+                   total_bytes, path);
+    } else {
+        MP_WARN(in, "Could not write demuxer cache file %s.\n", path);
+        unlink(tmp_path);
+    }
+
+done:
+    if (f) {
+        fclose(f);
+        unlink(tmp_path);
+    }
+    pthread_mutex_unlock(&in->lock);
+    talloc_free(tmp);
+}
+
+// Add the packets from the persistent cache (if there is one for this stream),
+// and seek the demuxer to the end of the cached data. Packets the demuxer
+// returns before the end of the cached data are dropped (like with refresh
+// seeks). This is run before the first packet is read, and called unlocked.
+static void load_persistent_cache(struct demux_internal *in)
+{
+    void *tmp = talloc_new(NULL);
+    FILE *f = NULL;
+    bool added = false;
+
+    pthread_mutex_lock(&in->lock);
+    struct demuxer *demux = in->d_thread;
+    char *dir, *key;
+    char *path = get_persistent_cache_path(in, tmp, &dir, &key);
+    bool can_seek = demux->desc->seek && demux->seekable &&
+                    !demux->partially_seekable;
+    size_t max_bytes = (size_t)in->max_bytes + in->max_bytes_bw;
+    pthread_mutex_unlock(&in->lock);
+
+    if (!path || !can_seek)
+        goto done;
+
+    f = fopen(path, "rb");
+    if (!f)
+        goto done;
+
+    char magic[sizeof(PERSISTENT_CACHE_MAGIC) - 1];
+    uint32_t key_len;
+    uint64_t total_bytes;
+    int32_t num_saved;
+    if (fread(magic, sizeof(magic), 1, f) != 1 ||
+        memcmp(magic, PERSISTENT_CACHE_MAGIC, sizeof(magic)) != 0 ||
+        fread(&key_len, sizeof(key_len), 1, f) != 1 || key_len != strlen(key))
+        goto done;
+    char *file_key = talloc_size(tmp, key_len);
+    if (fread(file_key, key_len, 1, f) != 1 ||
+        memcmp(file_key, key, key_len) != 0 ||
+        fread(&total_bytes, sizeof(total_bytes), 1, f) != 1 ||
+        fread(&num_saved, sizeof(num_saved), 1, f) != 1 ||
+        num_saved < 1 || num_saved > 1000)
+        goto done;
+    if (total_bytes > max_bytes) {
+        MP_VERBOSE(in, "Not using demuxer cache file %s (too large).\n", path);
+        goto done;
+    }
+    int *saved = talloc_array(tmp, int, num_saved);
+    if (fread(saved, sizeof(saved[0]), num_saved, f) != (size_t)num_saved)
+        goto done;
+
+    // All selected streams must be covered, because everything is resumed at
+    // the end of the cached data.
+    pthread_mutex_lock(&in->lock);
+    bool ok = true;
+    for (int n = 0; n < in->num_streams; n++) {
+        bool found = false;
+        for (int i = 0; i < num_saved; i++)
+            found |= saved[i] == n;
+        ok &= found || !in->streams[n]->ds->selected;
+    }
+    int num_streams = in->num_streams;
+    pthread_mutex_unlock(&in->lock);
+    if (!ok)
+        goto done;
+
+    MP_VERBOSE(in, "Loading cached packets from %s.\n", path);
+
+    struct demux_packet *dp;
+    while ((dp = demux_packet_read(in->packet_pool, f))) {
+        if (dp->stream < 0 || dp->stream >= num_streams) {
+            demux_packet_pool_push(in->packet_pool, dp);
+            break;
+        }
+        // (Streams are never removed, so this is fine without lock.)
+        demux_add_packet(in->streams[dp->stream], dp);
+        added = true;
+    }
+
+done:
+    if (f)
+        fclose(f);
+
+    if (added) {
+        pthread_mutex_lock(&in->lock);
+        double seek_pts = MP_NOPTS_VALUE;
+        bool use_cache = !in->seeking;
+        for (int n = 0; n < in->num_streams; n++) {
+            struct demux_stream *ds = in->streams[n]->ds;
+            if (!ds->selected)
+                continue;
+            use_cache &= ds->queue->tail && (ds->queue->correct_dts || ds->queue->correct_pos);
+            seek_pts = MP_PTS_MIN(seek_pts, ds->queue->last_ts);
+        }
+        use_cache &= seek_pts != MP_NOPTS_VALUE;
+        if (use_cache) {
+            for (int n = 0; n < in->num_streams; n++) {
+                struct demux_stream *ds = in->streams[n]->ds;
+                ds->refreshing = ds->selected;
+            }
+            pthread_mutex_unlock(&in->lock);
+            MP_VERBOSE(in, "resuming after cached data at %f\n", seek_pts);
+            demux->desc->seek(demux, seek_pts - 1.0, SEEK_HR);
+        } else {
+            // The demuxer was not used yet, so just start from scratch.
+            if (!in->seeking) {
+                for (int n = 0; n < in->num_streams; n++) {
+                    struct demux_stream *ds = in->streams[n]->ds;
+                    ds_clear_demux_state(ds);
+                    ds->queue->cache_from_start = true;
+                }
+            }
+            pthread_mutex_unlock(&in->lock);
+            MP_WARN(in, "Could not use demuxer cache file.\n");
+        }
+    }
+
+    talloc_free(tmp);
+}
+
 void free_demuxer(demuxer_t *demuxer)
 {
     if (!demuxer)
@@ -550,6 +921,9 @@ void free_demuxer(demuxer_t *demuxer)
 
     demux_stop_thread(demuxer);
 
+    if (in->cache_dir)
+        save_persistent_cache(in);
+
     if (demuxer->desc->close)
         demuxer->desc->close(in->d_thread);
 
@@ -557,6 +931,7 @@ void free_demuxer(demuxer_t *demuxer)
 
     for (int n = in->num_streams - 1; n >= 0; n--)
         talloc_free(in->streams[n]);
+    mp_mem_client_free(in->mem);
     pthread_mutex_destroy(&in->lock);
     pthread_cond_destroy(&in->wakeup);
     talloc_free(demuxer);
@@ -683,7 +1058,7 @@ static double get_refresh_seek_pts(struct demux_internal *in)
         normal_seek &= ds->need_refresh;
         ds->need_refresh = false;
 
-        refresh_possible &= ds->correct_dts || ds->correct_pos;
+        refresh_possible &= ds->queue->correct_dts || ds->queue->correct_pos;
     }
 
     if (!needed || start_ts == MP_NOPTS_VALUE || !demux->desc->seek ||
@@ -702,7 +1077,7 @@ static double get_refresh_seek_pts(struct demux_internal *in)
         struct demux_stream *ds = in->streams[n]->ds;
         // Streams which didn't have any packets yet will return all packets,
         // other streams return packets only starting from the last position.
-        if (ds->last_pos != -1 || ds->last_dts != MP_NOPTS_VALUE)
+        if (ds->queue->last_pos != -1 || ds->queue->last_dts != MP_NOPTS_VALUE)
             ds->refreshing |= ds->selected;
     }
 
@@ -710,27 +1085,66 @@ static double get_refresh_seek_pts(struct demux_internal *in)
     return start_ts - 1.0;
 }
 
+// Add a keyframe packet whose kf_seek_pts was determined to the queue's index.
+static void add_kf_index_entry(struct demux_queue *queue,
+                               struct demux_packet *dp,
+                               struct demux_packet *prev)
+{
+    // Drop entries of pruned packets once they make up half of the array.
+    if (queue->kf_index_start > 0 &&
+        queue->kf_index_start >= queue->num_kf_index / 2)
+    {
+        queue->num_kf_index -= queue->kf_index_start;
+        memmove(queue->kf_index, queue->kf_index + queue->kf_index_start,
+                queue->num_kf_index * sizeof(queue->kf_index[0]));
+        queue->kf_index_start = 0;
+    }
+
+    if (queue->num_kf_index > queue->kf_index_start) {
+        struct demux_kf_entry *last = &queue->kf_index[queue->num_kf_index - 1];
+        if (dp->kf_seek_pts < last->dp->kf_seek_pts)
+            queue->kf_index_unsorted = true;
+    }
+
+    MP_TARRAY_APPEND(queue, queue->kf_index, queue->num_kf_index,
+                     (struct demux_kf_entry){ .dp = dp, .prev = prev });
+}
+
 // Determine seekable range when a packet is added. If dp==NULL, treat it as
 // EOF (i.e. closes the current block).
 // This has to deal with a number of corner cases, such as demuxers potentially
 // starting output at non-keyframes.
-static void adjust_seek_range_on_packet(struct demux_stream *ds,
+// Must be called before dp is appended to the queue. Returns true if the end
+// of the seekable range of the current range was extended.
+static bool adjust_seek_range_on_packet(struct demux_stream *ds,
                                         struct demux_packet *dp)
 {
+    struct demux_queue *queue = ds->queue;
+    bool extended = false;
+
     if (!ds->in->seekable_cache)
-        return;
+        return false;
 
     if (!dp || dp->keyframe) {
-        if (ds->keyframe_latest) {
-            ds->keyframe_latest->kf_seek_pts = ds->keyframe_pts;
-            if (ds->queue->seek_start == MP_NOPTS_VALUE)
-                ds->queue->seek_start = ds->keyframe_pts;
-            if (ds->keyframe_end_pts != MP_NOPTS_VALUE)
-                ds->queue->seek_end = ds->keyframe_end_pts;
-            update_seek_ranges(ds);
+        if (queue->keyframe_latest) {
+            queue->keyframe_latest->kf_seek_pts = queue->keyframe_pts;
+            if (queue->keyframe_pts != MP_NOPTS_VALUE) {
+                add_kf_index_entry(queue, queue->keyframe_latest,
+                                   queue->keyframe_latest_prev);
+            }
+            double old_end = queue->range->seek_end;
+            if (queue->seek_start == MP_NOPTS_VALUE)
+                queue->seek_start = queue->keyframe_pts;
+            if (queue->keyframe_end_pts != MP_NOPTS_VALUE)
+                queue->seek_end = queue->keyframe_end_pts;
+            update_seek_ranges(queue->range);
+            extended = queue->range->seek_end != MP_NOPTS_VALUE &&
+                       (old_end == MP_NOPTS_VALUE ||
+                        queue->range->seek_end > old_end);
         }
-        ds->keyframe_latest = dp;
-        ds->keyframe_pts = ds->keyframe_end_pts = MP_NOPTS_VALUE;
+        queue->keyframe_latest = dp;
+        queue->keyframe_latest_prev = dp ? queue->tail : NULL;
+        queue->keyframe_pts = queue->keyframe_end_pts = MP_NOPTS_VALUE;
     }
 
     if (dp) {
@@ -740,30 +1154,266 @@ static void adjust_seek_range_on_packet(struct demux_stream *ds,
         if (dp->segmented && (ts < dp->start || ts > dp->end))
             ts = MP_NOPTS_VALUE;
 
-        ds->keyframe_pts = MP_PTS_MIN(ds->keyframe_pts, ts);
-        ds->keyframe_end_pts = MP_PTS_MAX(ds->keyframe_end_pts, ts);
+        queue->keyframe_pts = MP_PTS_MIN(queue->keyframe_pts, ts);
+        queue->keyframe_end_pts = MP_PTS_MAX(queue->keyframe_end_pts, ts);
+    }
+
+    return extended;
+}
+
+// Make range the most recently used one (ranges[] is sorted by LRU).
+static void touch_range(struct demux_internal *in,
+                        struct demux_cached_range *range)
+{
+    for (int n = 0; n < in->num_ranges; n++) {
+        if (in->ranges[n] == range) {
+            MP_TARRAY_REMOVE_AT(in->ranges, in->num_ranges, n);
+            break;
+        }
+    }
+    MP_TARRAY_APPEND(in, in->ranges, in->num_ranges, range);
+}
+
+// Make range the range that is read from and appended to. The reader state
+// must have been reset before.
+static void switch_current_range(struct demux_internal *in,
+                                 struct demux_cached_range *range)
+{
+    struct demux_cached_range *old = in->current_range;
+    assert(old != range);
+
+    in->current_range = range;
+    touch_range(in, range);
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        assert(!ds->reader_head);
+        ds->queue = range->streams[n];
+        ds->refreshing = false;
+        ds->eof = false;
+    }
+
+    // Packets before the first keyframe can't be used when seeking back to the
+    // old range. Resuming it later requires a way to find the end of the
+    // already cached packets, so discard it if that's not possible.
+    bool usable = in->seekable_cache;
+    for (int n = 0; n < old->num_streams; n++) {
+        struct demux_queue *queue = old->streams[n];
+        while (queue->head && !queue->head->keyframe)
+            remove_head_packet(queue);
+        if (queue->ds->selected && !queue->correct_dts && !queue->correct_pos)
+            usable = false;
+    }
+    update_seek_ranges(old);
+    if (!usable)
+        old->seek_start = old->seek_end = MP_NOPTS_VALUE;
+
+    free_empty_cached_ranges(in);
+}
+
+// Start a new, empty range (seeking outside of the cached data). The old
+// current range is kept if the cache is seekable.
+static void switch_to_fresh_range(struct demux_internal *in)
+{
+    struct demux_cached_range *range = talloc_ptrtype(in, range);
+    *range = (struct demux_cached_range){
+        .seek_start = MP_NOPTS_VALUE,
+        .seek_end = MP_NOPTS_VALUE,
+    };
+    MP_TARRAY_APPEND(in, in->ranges, in->num_ranges, range);
+    for (int n = 0; n < in->num_streams; n++)
+        add_range_queue(range, in->streams[n]->ds);
+
+    switch_current_range(in, range);
+}
+
+// Remove all packets from q that come before end (a packet from another
+// range). Return true if q then starts with a packet equal to end.
+static bool find_join_point(struct demux_stream *ds, struct demux_queue *q,
+                            struct demux_packet *end)
+{
+    bool use_dts = ds->global_correct_dts;
+    while (q->head) {
+        struct demux_packet *dp = q->head;
+        if (use_dts ? dp->dts >= end->dts : dp->pos >= end->pos) {
+            // (Imperfect) sanity check that it's really the same packet.
+            return dp->dts == end->dts && dp->pos == end->pos &&
+                   dp->pts == end->pts && dp->len == end->len;
+        }
+        remove_head_packet(q);
     }
+    return false;
+}
+
+// If the end of the current range overlaps with the start of another range,
+// append that range to the current range, and continue demuxing after its end.
+// This is called after the seekable range of the current range was extended.
+static void attempt_range_joining(struct demux_internal *in)
+{
+    struct demux_cached_range *cur = in->current_range;
+    struct demux_cached_range *next = NULL;
+    double next_dist = INFINITY;
+
+    // Requires a low level seek after joining.
+    if (!in->threading || cur->seek_end == MP_NOPTS_VALUE)
+        return;
+
+    for (int n = 0; n < in->num_ranges; n++) {
+        struct demux_cached_range *range = in->ranges[n];
+        if (range == cur || range->seek_start == MP_NOPTS_VALUE)
+            continue;
+        if (cur->seek_start <= range->seek_start) {
+            // This uses ">" to get some non-0 overlap.
+            double dist = cur->seek_end - range->seek_start;
+            if (dist > 0 && dist < next_dist) {
+                next = range;
+                next_dist = dist;
+            }
+        }
+    }
+
+    if (!next)
+        return;
+
+    MP_VERBOSE(in, "joining ranges %f-%f + %f-%f\n", cur->seek_start,
+               cur->seek_end, next->seek_start, next->seek_end);
+
+    // Find the packet in the next range that equals the last packet of the
+    // current range, for each stream. The packets before it are dropped (if
+    // joining fails, the next range is discarded anyway). Sparse streams
+    // (subtitles) don't need to overlap.
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        struct demux_queue *q1 = cur->streams[n];
+        struct demux_queue *q2 = next->streams[n];
+        bool sparse = ds->type == STREAM_SUB || !ds->active;
+
+        if (!ds->global_correct_dts && !ds->global_correct_pos)
+            goto failed;
+        bool found = q1->tail && find_join_point(ds, q2, q1->tail);
+        if (!found && !sparse)
+            goto failed;
+        // The join point must be a completed packet run in q2.
+        if (found && q2->head == q2->keyframe_latest)
+            goto failed;
+        if (found) {
+            // q1's last packet is replaced by the equal packet in q2. If it
+            // was a keyframe, it starts a packet run whose seek pts is known.
+            struct demux_packet *end = q1->tail;
+            struct demux_packet *dp = q2->head;
+            if (end == q1->keyframe_latest) {
+                end->kf_seek_pts = dp->kf_seek_pts;
+                if (end->kf_seek_pts != MP_NOPTS_VALUE)
+                    add_kf_index_entry(q1, end, q1->keyframe_latest_prev);
+                q1->keyframe_latest = NULL;
+            }
+            remove_head_packet(q2);
+        }
+    }
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        struct demux_queue *q1 = cur->streams[n];
+        struct demux_queue *q2 = next->streams[n];
+        assert(ds->queue == q1);
+
+        if (!q2->head)
+            continue;
+
+        struct demux_packet *end = q1->tail;
+
+        int first_entry = q1->num_kf_index;
+        for (int i = q2->kf_index_start; i < q2->num_kf_index; i++) {
+            struct demux_kf_entry e = q2->kf_index[i];
+            if (e.dp == q2->head)
+                e.prev = end;
+            MP_TARRAY_APPEND(q1, q1->kf_index, q1->num_kf_index, e);
+        }
+        if (first_entry > q1->kf_index_start && first_entry < q1->num_kf_index &&
+            q1->kf_index[first_entry - 1].dp->kf_seek_pts >
+            q1->kf_index[first_entry].dp->kf_seek_pts)
+            q1->kf_index_unsorted = true;
+        q1->kf_index_unsorted |= q2->kf_index_unsorted;
+
+        if (end) {
+            end->next = q2->head;
+        } else {
+            q1->head = q2->head;
+        }
+        q1->tail = q2->tail;
+
+        q1->seek_start = MP_PTS_MIN(q1->seek_start, q2->seek_start);
+        q1->seek_end = MP_PTS_MAX(q1->seek_end, q2->seek_end);
+        q1->correct_dts &= q2->correct_dts;
+        q1->correct_pos &= q2->correct_pos;
+        q1->last_pos = q2->last_pos;
+        q1->last_dts = q2->last_dts;
+        q1->last_ts = q2->last_ts;
+        q1->keyframe_pts = q2->keyframe_pts;
+        q1->keyframe_end_pts = q2->keyframe_end_pts;
+        q1->keyframe_latest = q2->keyframe_latest;
+        q1->keyframe_latest_prev = q2->keyframe_latest_prev;
+        if (q1->keyframe_latest == q2->head)
+            q1->keyframe_latest_prev = end;
+        q1->next_prune_target = NULL;
+
+        // Ownership of the packets moved to q1.
+        init_queue(q2);
+
+        // The appended packets are part of the forward buffer.
+        if (ds->selected && !ds->reader_head) {
+            ds->reader_head = end ? end->next : q1->head;
+            ds->skip_to_keyframe = false;
+        }
+        in->fw_bytes -= ds->fw_bytes;
+        recompute_buffers(ds);
+        in->fw_bytes += ds->fw_bytes;
+    }
+
+    update_seek_ranges(cur);
+
+    // Continue demuxing after the end of the joined range. Packets which were
+    // already cached are dropped until the old end is reached.
+    in->seeking = true;
+    in->seek_flags = SEEK_HR;
+    in->seek_pts = next->seek_end - 1.0;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        ds->refreshing = ds->selected;
+    }
+
+    MP_VERBOSE(in, "ranges joined\n");
+    goto done;
+
+failed:
+    MP_VERBOSE(in, "ranges can't be joined\n");
+done:
+    // Either empty now, or unusable since packets were removed.
+    next->seek_start = next->seek_end = MP_NOPTS_VALUE;
+    free_empty_cached_ranges(in);
 }
 
 void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
 {
     struct demux_stream *ds = stream ? stream->ds : NULL;
     if (!dp || !dp->len || !ds) {
-        talloc_free(dp);
+        demux_packet_pool_push(ds ? ds->in->packet_pool : NULL, dp);
         return;
     }
     struct demux_internal *in = ds->in;
     pthread_mutex_lock(&in->lock);
 
+    in->read_bytes += dp->len;
+
     bool drop = ds->refreshing;
     if (ds->refreshing) {
         // Resume reading once the old position was reached (i.e. we start
         // returning packets where we left off before the refresh).
         // If it's the same position, drop, but continue normally next time.
-        if (ds->correct_dts) {
-            ds->refreshing = dp->dts < ds->last_dts;
-        } else if (ds->correct_pos) {
-            ds->refreshing = dp->pos < ds->last_pos;
+        if (ds->queue->correct_dts) {
+            ds->refreshing = dp->dts < ds->queue->last_dts;
+        } else if (ds->queue->correct_pos) {
+            ds->refreshing = dp->pos < ds->queue->last_pos;
         } else {
             ds->refreshing = false; // should not happen
         }
@@ -771,16 +1421,19 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
 
     if (!ds->selected || ds->need_refresh || in->seeking || drop) {
         pthread_mutex_unlock(&in->lock);
-        talloc_free(dp);
+        demux_packet_pool_push(in->packet_pool, dp);
         return;
     }
 
-    ds->correct_pos &= dp->pos >= 0 && dp->pos > ds->last_pos;
-    ds->correct_dts &= dp->dts != MP_NOPTS_VALUE && dp->dts > ds->last_dts;
-    ds->last_pos = dp->pos;
-    ds->last_dts = dp->dts;
-    ds->global_correct_pos &= ds->correct_pos;
-    ds->global_correct_dts &= ds->correct_dts;
+    mp_perf_add(in->d_thread->global, MP_PERF_DEMUX_PACKETS, 1);
+    mp_perf_add(in->d_thread->global, MP_PERF_DEMUX_BYTES, dp->len);
+
+    ds->queue->correct_pos &= dp->pos >= 0 && dp->pos > ds->queue->last_pos;
+    ds->queue->correct_dts &= dp->dts != MP_NOPTS_VALUE && dp->dts > ds->queue->last_dts;
+    ds->queue->last_pos = dp->pos;
+    ds->queue->last_dts = dp->dts;
+    ds->global_correct_pos &= ds->queue->correct_pos;
+    ds->global_correct_dts &= ds->queue->correct_dts;
 
     dp->stream = stream->index;
     dp->next = NULL;
@@ -800,6 +1453,8 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
         in->fw_bytes += bytes;
     }
 
+    bool join = adjust_seek_range_on_packet(ds, dp);
+
     if (ds->queue->tail) {
         // next packet in stream
         ds->queue->tail->next = dp;
@@ -809,8 +1464,6 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
         ds->queue->head = ds->queue->tail = dp;
     }
 
-    adjust_seek_range_on_packet(ds, dp);
-
     if (!ds->ignore_eof) {
         // obviously not true anymore
         ds->eof = false;
@@ -825,15 +1478,18 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
     double ts = dp->dts == MP_NOPTS_VALUE ? dp->pts : dp->dts;
     if (dp->segmented)
         ts = MP_PTS_MIN(ts, dp->end);
-    if (ts != MP_NOPTS_VALUE && (ts > ds->last_ts || ts + 10 < ds->last_ts))
-        ds->last_ts = ts;
+    if (ts != MP_NOPTS_VALUE && (ts > ds->queue->last_ts || ts + 10 < ds->queue->last_ts))
+        ds->queue->last_ts = ts;
     if (ds->base_ts == MP_NOPTS_VALUE)
-        ds->base_ts = ds->last_ts;
+        ds->base_ts = ds->queue->last_ts;
 
     MP_DBG(in, "append packet to %s: size=%d pts=%f dts=%f pos=%"PRIi64" "
            "[num=%zd size=%zd]\n", stream_type_name(stream->type),
            dp->len, dp->pts, dp->dts, dp->pos, ds->fw_packs, ds->fw_bytes);
 
+    if (join)
+        attempt_range_joining(in);
+
     // Wake up if this was the first packet after start/possible underrun.
     if (ds->in->wakeup_cb && ds->reader_head && !ds->reader_head->next)
         ds->in->wakeup_cb(ds->in->wakeup_cb_ctx);
@@ -841,7 +1497,43 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
     pthread_mutex_unlock(&in->lock);
 }
 
+// Track the rate at which the demuxer implementation delivers packet data
+// while it is reading. For network streams, this approximates the download
+// rate: time spent idle because the cache is full is not included.
+static void update_read_speed(struct demux_internal *in, uint64_t bytes,
+                              int64_t us)
+{
+    in->speed_bytes += bytes;
+    in->speed_time += us;
+    // Average over at least 1 second of reading, then smooth.
+    if (in->speed_time >= 1000000) {
+        double speed = in->speed_bytes * 1e6 / in->speed_time;
+        in->read_speed = in->read_speed > 0 ? in->read_speed * 0.7 + speed * 0.3
+                                            : speed;
+        in->speed_bytes = 0;
+        in->speed_time = 0;
+    }
+}
+
 // Returns true if there was "progress" (lock was released temporarily).
+// Return the forward and backward buffer limits, reduced proportionally if
+// the global memory budget grants less than the configured limits.
+static void get_byte_limits(struct demux_internal *in, size_t *fw, size_t *bw)
+{
+    int64_t max_fw = in->max_bytes;
+    int64_t max_bw = in->seekable_cache ? in->max_bytes_bw : 0;
+    int64_t wanted = max_fw + max_bw;
+    int64_t limit = mp_mem_client_get_limit(in->mem, wanted);
+    if (limit < wanted) {
+        max_fw = max_fw * limit / wanted;
+        max_bw = limit - max_fw;
+    }
+    if (fw)
+        *fw = max_fw;
+    if (bw)
+        *bw = max_bw;
+}
+
 static bool read_packet(struct demux_internal *in)
 {
     in->eof = false;
@@ -855,13 +1547,15 @@ static bool read_packet(struct demux_internal *in)
         struct demux_stream *ds = in->streams[n]->ds;
         active |= ds->active;
         read_more |= (ds->active && !ds->reader_head) || ds->refreshing;
-        if (ds->active && ds->last_ts != MP_NOPTS_VALUE && in->min_secs > 0 &&
-            ds->base_ts != MP_NOPTS_VALUE && ds->last_ts >= ds->base_ts)
-            prefetch_more |= ds->last_ts - ds->base_ts < in->min_secs;
+        if (ds->active && ds->queue->last_ts != MP_NOPTS_VALUE && in->min_secs > 0 &&
+            ds->base_ts != MP_NOPTS_VALUE && ds->queue->last_ts >= ds->base_ts)
+            prefetch_more |= ds->queue->last_ts - ds->base_ts < in->min_secs;
     }
     MP_DBG(in, "bytes=%zd, active=%d, read_more=%d prefetch_more=%d\n",
            in->fw_bytes, active, read_more, prefetch_more);
-    if (in->fw_bytes >= in->max_bytes) {
+    size_t max_fw_bytes;
+    get_byte_limits(in, &max_fw_bytes, NULL);
+    if (in->fw_bytes >= max_fw_bytes) {
         if (!read_more)
             return false;
         if (!in->warned_queue_overflow) {
@@ -897,24 +1591,33 @@ static bool read_packet(struct demux_internal *in)
 
     // Actually read a packet. Drop the lock while doing so, because waiting
     // for disk or network I/O can take time.
+    bool first_read = in->initial_state;
     in->idle = false;
     in->initial_state = false;
+    uint64_t read_bytes = in->read_bytes;
     pthread_mutex_unlock(&in->lock);
 
     struct demuxer *demux = in->d_thread;
 
+    if (first_read && in->cache_dir)
+        load_persistent_cache(in);
+
     if (refresh_seek) {
         MP_VERBOSE(in, "refresh seek to %f\n", seek_pts);
         demux->desc->seek(demux, seek_pts, SEEK_HR);
     }
 
     bool eof = true;
+    int64_t read_start = mp_time_us();
     if (demux->desc->fill_buffer && !demux_cancel_test(demux))
         eof = demux->desc->fill_buffer(demux) <= 0;
+    int64_t read_time = mp_time_us() - read_start;
     update_cache(in);
 
     pthread_mutex_lock(&in->lock);
 
+    update_read_speed(in, in->read_bytes - read_bytes, read_time);
+
     if (!in->seeking) {
         if (eof) {
             for (int n = 0; n < in->num_streams; n++) {
@@ -936,37 +1639,74 @@ static bool read_packet(struct demux_internal *in)
     return true;
 }
 
+// Return the range packets should be pruned from first: the one farthest away
+// from the playback position. The current range goes last, as it contains the
+// back buffer of the playback position.
+static struct demux_cached_range *find_prune_range(struct demux_internal *in)
+{
+    double pts = MP_NOPTS_VALUE;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (ds->selected)
+            pts = MP_PTS_MIN(pts, ds->base_ts);
+    }
+
+    struct demux_cached_range *res = in->current_range;
+    double max_dist = -1;
+    // (ranges[] is sorted by LRU, so the oldest range wins on equal distance.)
+    for (int n = 0; n < in->num_ranges; n++) {
+        struct demux_cached_range *range = in->ranges[n];
+        if (range == in->current_range)
+            continue;
+        bool any_packets = false;
+        for (int i = 0; i < range->num_streams; i++)
+            any_packets |= !!range->streams[i]->head;
+        if (!any_packets)
+            continue;
+        double dist = 0;
+        if (pts != MP_NOPTS_VALUE && range->seek_start != MP_NOPTS_VALUE)
+            dist = MPMAX(range->seek_start - pts, pts - range->seek_end);
+        if (dist > max_dist) {
+            res = range;
+            max_dist = dist;
+        }
+    }
+    return res;
+}
+
 static void prune_old_packets(struct demux_internal *in)
 {
     // It's not clear what the ideal way to prune old packets is. For now, we
-    // prune the oldest packet runs, as long as the total cache amount is too
-    // big.
-    size_t max_bytes = in->seekable_cache ? in->max_bytes_bw : 0;
+    // prune the oldest packet runs of the range farthest away from the
+    // playback position, as long as the total cache amount is too big.
+    size_t max_bytes;
+    get_byte_limits(in, NULL, &max_bytes);
     while (in->total_bytes - in->fw_bytes > max_bytes) {
+        struct demux_cached_range *range = find_prune_range(in);
         double earliest_ts = MP_NOPTS_VALUE;
-        struct demux_stream *earliest_stream = NULL;
+        struct demux_queue *earliest_queue = NULL;
 
-        for (int n = 0; n < in->num_streams; n++) {
-            struct demux_stream *ds = in->streams[n]->ds;
+        for (int n = 0; n < range->num_streams; n++) {
+            struct demux_queue *queue = range->streams[n];
 
-            if (ds->queue->head && ds->queue->head != ds->reader_head) {
-                struct demux_packet *dp = ds->queue->head;
+            if (queue->head && queue->head != queue->ds->reader_head) {
+                struct demux_packet *dp = queue->head;
                 double ts = dp->kf_seek_pts;
                 // Note: in obscure cases, packets might have no timestamps set,
                 // in which case we still need to prune _something_.
                 bool prune_always =
                     !in->seekable_cache || ts == MP_NOPTS_VALUE || !dp->keyframe;
-                if (prune_always || !earliest_stream || ts < earliest_ts) {
+                if (prune_always || !earliest_queue || ts < earliest_ts) {
                     earliest_ts = ts;
-                    earliest_stream = ds;
+                    earliest_queue = queue;
                     if (prune_always)
                         break;
                 }
             }
         }
 
-        assert(earliest_stream); // incorrect accounting of buffered sizes?
-        struct demux_stream *ds = earliest_stream;
+        assert(earliest_queue); // incorrect accounting of buffered sizes?
+        struct demux_queue *queue = earliest_queue;
 
         // Prune all packets until the next keyframe or reader_head. Keeping
         // those packets would not help with seeking at all, so we strictly
@@ -975,47 +1715,76 @@ static void prune_old_packets(struct demux_internal *in)
         // which in the worst case could be inside the forward buffer. The fact
         // that many keyframe ranges without keyframes exist (audio packets)
         // makes this much harder.
-        if (in->seekable_cache && !ds->next_prune_target) {
+        if (in->seekable_cache && !queue->next_prune_target) {
+            queue->seek_start = MP_NOPTS_VALUE;
+            queue->next_prune_target = queue->tail; // (prune all if none found)
             // (Has to be _after_ queue->head to drop at least 1 packet.)
-            struct demux_packet *prev = ds->queue->head;
-            ds->queue->seek_start = MP_NOPTS_VALUE;
-            ds->next_prune_target = ds->queue->tail; // (prune all if none found)
-            while (prev->next) {
-                struct demux_packet *dp = prev->next;
+            for (int i = queue->kf_index_start; i < queue->num_kf_index; i++) {
+                struct demux_kf_entry *e = &queue->kf_index[i];
                 // Note that the next back_pts might be above the lowest buffered
                 // packet, but it will still be only viable lowest seek target.
-                if (dp->keyframe && dp->kf_seek_pts != MP_NOPTS_VALUE) {
-                    ds->queue->seek_start = dp->kf_seek_pts;
-                    ds->next_prune_target = prev;
+                if (e->dp != queue->head) {
+                    queue->seek_start = e->dp->kf_seek_pts;
+                    queue->next_prune_target = e->prev;
                     break;
                 }
-                prev = prev->next;
             }
 
-            update_seek_ranges(ds);
+            update_seek_ranges(range);
         }
 
         bool done = false;
-        while (!done && ds->queue->head && ds->queue->head != ds->reader_head) {
-            struct demux_packet *dp = ds->queue->head;
+        while (!done && queue->head && queue->head != queue->ds->reader_head) {
+            struct demux_packet *dp = queue->head;
+            done = dp == queue->next_prune_target;
 
-            size_t bytes = demux_packet_estimate_total_size(dp);
             MP_TRACE(in, "dropping backbuffer packet size %zd from stream %d\n",
-                     bytes, ds->sh->index);
-
-            ds->queue->head = dp->next;
-            if (!ds->queue->head)
-                ds->queue->tail = NULL;
-            if (ds->next_prune_target == dp) {
-                ds->next_prune_target = NULL;
-                done = true;
+                     demux_packet_estimate_total_size(dp), queue->ds->index);
+
+            remove_head_packet(queue);
+        }
+
+        // Ranges other than the current one can be freed as a whole as soon
+        // as they became useless.
+        if (range != in->current_range && range->seek_start == MP_NOPTS_VALUE)
+            free_empty_cached_ranges(in);
+    }
+}
+
+#define COMPRESS_BATCH_BYTES (1024 * 1024)
+
+// Compress packets in the back buffer (before the reader position), at most
+// COMPRESS_BATCH_BYTES per call, to keep lock hold times short. Returns
+// whether there was anything to do.
+static bool compress_back_buffer(struct demux_internal *in)
+{
+    if (!in->compress_cache || !in->seekable_cache)
+        return false;
+
+    size_t done = 0;
+    for (int n = 0; n < in->num_ranges; n++) {
+        struct demux_cached_range *range = in->ranges[n];
+        for (int i = 0; i < range->num_streams; i++) {
+            struct demux_queue *queue = range->streams[i];
+            struct demux_stream *ds = queue->ds;
+            // Everything starting with reader_head is forward buffer.
+            struct demux_packet *stop = ds->queue == queue ? ds->reader_head : NULL;
+            while (1) {
+                struct demux_packet *dp =
+                    queue->compress_pos ? queue->compress_pos->next : queue->head;
+                if (!dp || dp == stop)
+                    break;
+                if (done >= COMPRESS_BATCH_BYTES)
+                    return true;
+                size_t bytes = demux_packet_estimate_total_size(dp);
+                if (demux_packet_compress(dp))
+                    in->total_bytes -= bytes - demux_packet_estimate_total_size(dp);
+                done += dp->len;
+                queue->compress_pos = dp;
             }
-            if (ds->keyframe_latest == dp)
-                ds->keyframe_latest = NULL;
-            talloc_free(dp);
-            in->total_bytes -= bytes;
         }
     }
+    return done > 0;
 }
 
 static void execute_trackswitch(struct demux_internal *in)
@@ -1087,6 +1856,8 @@ static void *demux_thread(void *pctx)
             in->force_cache_update = false;
             continue;
         }
+        if (compress_back_buffer(in))
+            continue;
         pthread_cond_signal(&in->wakeup);
         pthread_cond_wait(&in->wakeup, &in->lock);
     }
@@ -1620,11 +2391,17 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .max_bytes = opts->max_bytes,
         .max_bytes_bw = opts->max_bytes_bw,
         .seekable_cache = opts->seekable_cache,
+        .compress_cache = opts->compress_cache,
         .initial_state = true,
     };
+    if (opts->cache_dir && opts->cache_dir[0])
+        in->cache_dir = talloc_strdup(in, opts->cache_dir);
     pthread_mutex_init(&in->lock, NULL);
     pthread_cond_init(&in->wakeup, NULL);
 
+    in->packet_pool = demux_packet_pool_create(in);
+    demuxer->packet_pool = in->packet_pool;
+
     in->current_range = talloc_ptrtype(in, in->current_range),
     *in->current_range = (struct demux_cached_range){
         .seek_start = MP_NOPTS_VALUE,
@@ -1668,6 +2445,12 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         }
         demux_init_cuesheet(in->d_thread);
         demux_init_cache(demuxer);
+        int64_t wanted = in->max_bytes;
+        if (in->seekable_cache)
+            wanted += in->max_bytes_bw;
+        in->mem = mp_mem_client_new(global, params && params->mem_prio ?
+                                    params->mem_prio : MP_MEM_PRIO_NORMAL,
+                                    wanted);
         demux_init_ccs(demuxer, opts);
         demux_changed(in->d_thread, DEMUX_EVENT_ALL);
         demux_update(demuxer);
@@ -1678,6 +2461,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
             if (tl) {
                 struct demuxer_params params2 = {0};
                 params2.timeline = tl;
+                params2.mem_prio = params ? params->mem_prio : 0;
                 struct demuxer *sub =
                     open_given_type(global, log, &demuxer_desc_timeline, stream,
                                     &params2, DEMUX_CHECK_FORCE);
@@ -1701,6 +2485,118 @@ static const int d_normal[]  = {DEMUX_CHECK_NORMAL, DEMUX_CHECK_UNSAFE, -1};
 static const int d_request[] = {DEMUX_CHECK_REQUEST, -1};
 static const int d_force[]   = {DEMUX_CHECK_FORCE, -1};
 
+#define PROBE_CACHE_SIZE 32
+#define PROBE_MAGIC_SIZE 16
+
+// Remembers which demuxer (and check level) opened streams of a given kind,
+// so the next such stream can skip the demuxers with lower priority, which
+// would otherwise peek and parse the data before getting to the right one.
+struct probe_cache_entry {
+    const char *stream_type;    // stream_info_t.name (static string)
+    char ext[16];
+    char mime[64];
+    uint8_t magic[PROBE_MAGIC_SIZE];
+    int magic_len;
+    const struct demuxer_desc *desc;
+    enum demux_check level;
+    uint64_t last_use;
+};
+
+static pthread_mutex_t probe_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct probe_cache_entry probe_cache[PROBE_CACHE_SIZE];
+static uint64_t probe_cache_counter;
+
+// Signatures which can be attributed to a single demuxer without probing
+// the others. The first demuxer in demuxer_list that accepts files with such
+// a signature must be the one listed here.
+static const struct {
+    const char *magic;
+    int len;
+    const struct demuxer_desc *desc;
+} probe_signatures[] = {
+    {"\x1a\x45\xdf\xa3", 4, &demuxer_desc_matroska},
+    {"# mpv EDL v0\n", 13, &demuxer_desc_edl},
+};
+
+static void get_probe_key(struct stream *stream, struct probe_cache_entry *key)
+{
+    *key = (struct probe_cache_entry){
+        .stream_type = stream->info ? stream->info->name : "",
+    };
+    char *ext = mp_splitext(stream->url, NULL);
+    snprintf(key->ext, sizeof(key->ext), "%s", ext ? ext : "");
+    for (char *c = key->ext; *c; c++)
+        *c = mp_tolower(*c);
+    snprintf(key->mime, sizeof(key->mime), "%s",
+             stream->mime_type ? stream->mime_type : "");
+    bstr magic = stream_peek(stream, PROBE_MAGIC_SIZE);
+    key->magic_len = magic.len;
+    memcpy(key->magic, magic.start, magic.len);
+}
+
+static bool probe_key_equals(struct probe_cache_entry *a,
+                             struct probe_cache_entry *b)
+{
+    return strcmp(a->stream_type, b->stream_type) == 0 &&
+           strcmp(a->ext, b->ext) == 0 &&
+           strcmp(a->mime, b->mime) == 0 &&
+           a->magic_len == b->magic_len &&
+           memcmp(a->magic, b->magic, a->magic_len) == 0;
+}
+
+// Return the demuxer which is likely going to open the stream, or NULL.
+static const struct demuxer_desc *probe_predict(struct probe_cache_entry *key,
+                                                enum demux_check *level)
+{
+    const struct demuxer_desc *desc = NULL;
+    pthread_mutex_lock(&probe_cache_lock);
+    for (int n = 0; n < PROBE_CACHE_SIZE; n++) {
+        struct probe_cache_entry *e = &probe_cache[n];
+        if (e->desc && probe_key_equals(e, key)) {
+            e->last_use = ++probe_cache_counter;
+            desc = e->desc;
+            *level = e->level;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&probe_cache_lock);
+    if (desc)
+        return desc;
+
+    for (int n = 0; n < MP_ARRAY_SIZE(probe_signatures); n++) {
+        if (key->magic_len >= probe_signatures[n].len &&
+            memcmp(key->magic, probe_signatures[n].magic,
+                   probe_signatures[n].len) == 0)
+        {
+            *level = DEMUX_CHECK_NORMAL;
+            return probe_signatures[n].desc;
+        }
+    }
+    return NULL;
+}
+
+static void probe_remember(struct probe_cache_entry *key,
+                           const struct demuxer_desc *desc,
+                           enum demux_check level)
+{
+    pthread_mutex_lock(&probe_cache_lock);
+    struct probe_cache_entry *dst = &probe_cache[0];
+    for (int n = 0; n < PROBE_CACHE_SIZE; n++) {
+        struct probe_cache_entry *e = &probe_cache[n];
+        if (e->desc && probe_key_equals(e, key)) {
+            dst = e;
+            break;
+        }
+        if (e->last_use < dst->last_use)
+            dst = e;
+    }
+    *dst = *key;
+    dst->desc = desc;
+    dst->level = level;
+    dst->last_use = ++probe_cache_counter;
+    pthread_mutex_unlock(&probe_cache_lock);
+}
+
 // params can be NULL
 struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
                            struct mpv_global *global)
@@ -1709,11 +2605,14 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
     const struct demuxer_desc *check_desc = NULL;
     struct mp_log *log = mp_log_new(NULL, global->log, "!demux");
     struct demuxer *demuxer = NULL;
+    struct demux_opts *opts = NULL;
     char *force_format = params ? params->force_format : NULL;
 
     if (!force_format)
         force_format = stream->demuxer;
 
+    mp_msg(log, MSGL_STATS, "start demux open");
+
     if (force_format && force_format[0]) {
         check_levels = d_request;
         if (force_format[0] == '+') {
@@ -1730,6 +2629,25 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
         }
     }
 
+    opts = mp_get_config_group(NULL, global, &demux_conf);
+    bool use_probe_cache = opts->probe_cache && !check_desc &&
+                           !(params && params->timeline);
+    struct probe_cache_entry key;
+    if (use_probe_cache) {
+        get_probe_key(stream, &key);
+        enum demux_check level;
+        const struct demuxer_desc *desc = probe_predict(&key, &level);
+        if (desc) {
+            mp_verbose(log, "Trying predicted demuxer %s first.\n", desc->name);
+            demuxer = open_given_type(global, log, desc, stream, params, level);
+            if (demuxer) {
+                talloc_steal(demuxer, log);
+                log = NULL;
+                goto done;
+            }
+        }
+    }
+
     // Test demuxers from first to last, one pass for each check_levels[] entry
     for (int pass = 0; check_levels[pass] != -1; pass++) {
         enum demux_check level = check_levels[pass];
@@ -1739,6 +2657,8 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
             if (!check_desc || desc == check_desc) {
                 demuxer = open_given_type(global, log, desc, stream, params, level);
                 if (demuxer) {
+                    if (use_probe_cache)
+                        probe_remember(&key, desc, level);
                     talloc_steal(demuxer, log);
                     log = NULL;
                     goto done;
@@ -1748,6 +2668,8 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
     }
 
 done:
+    mp_msg(demuxer ? demuxer->glog : log, MSGL_STATS, "end demux open");
+    talloc_free(opts);
     talloc_free(log);
     return demuxer;
 }
@@ -1764,11 +2686,17 @@ struct demuxer *demux_open_url(const char *url,
     struct demuxer_params dummy = {0};
     if (!params)
         params = &dummy;
-    struct stream *s = stream_create(url, STREAM_READ | params->stream_flags,
-                                     cancel, global);
+    struct stream *s = NULL;
+    bool shared = false;
+    if (params->shared_cache && strcmp(params->shared_cache->url, url) == 0) {
+        s = stream_create_cache_reader(params->shared_cache, cancel, global);
+        shared = !!s;
+    }
+    if (!s)
+        s = stream_create(url, STREAM_READ | params->stream_flags, cancel, global);
     if (!s)
         return NULL;
-    if (!params->disable_cache)
+    if (!params->disable_cache && !shared)
         stream_enable_cache_defaults(&s);
     struct demuxer *d = demux_open(s, params, global);
     if (d) {
@@ -1820,15 +2748,15 @@ static void recompute_buffers(struct demux_stream *ds)
     }
 }
 
-static struct demux_packet *find_seek_target(struct demux_stream *ds,
-                                             double pts, int flags)
+// Linear search over the keyframe index; used if kf_seek_pts is not monotonic.
+static struct demux_packet *find_seek_target_linear(struct demux_queue *queue,
+                                                    double pts, int flags)
 {
     struct demux_packet *target = NULL;
     double target_diff = MP_NOPTS_VALUE;
-    for (struct demux_packet *dp = ds->queue->head; dp; dp = dp->next) {
+    for (int n = queue->kf_index_start; n < queue->num_kf_index; n++) {
+        struct demux_packet *dp = queue->kf_index[n].dp;
         double range_pts = dp->kf_seek_pts;
-        if (!dp->keyframe || range_pts == MP_NOPTS_VALUE)
-            continue;
 
         double diff = range_pts - pts;
         if (flags & SEEK_FORWARD) {
@@ -1850,6 +2778,54 @@ static struct demux_packet *find_seek_target(struct demux_stream *ds,
     return target;
 }
 
+// Return the index of the first entry with kf_seek_pts >= pts (or > pts if
+// after is set), or queue->num_kf_index if there is none.
+static int kf_index_bound(struct demux_queue *queue, double pts, bool after)
+{
+    int lo = queue->kf_index_start, hi = queue->num_kf_index;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        double mid_pts = queue->kf_index[mid].dp->kf_seek_pts;
+        if (after ? mid_pts <= pts : mid_pts < pts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Find the keyframe closest to pts. Without SEEK_FORWARD, this is the last
+// keyframe before or at pts (or the first one if there is none before pts),
+// otherwise the first keyframe at or after pts. On equal pts the earliest
+// packet is returned.
+static struct demux_packet *find_seek_target(struct demux_stream *ds,
+                                             double pts, int flags)
+{
+    struct demux_queue *queue = ds->queue;
+    if (queue->kf_index_start >= queue->num_kf_index)
+        return NULL;
+
+    if (queue->kf_index_unsorted)
+        return find_seek_target_linear(queue, pts, flags);
+
+    int idx;
+    if (flags & SEEK_FORWARD) {
+        idx = kf_index_bound(queue, pts, false);
+        if (idx >= queue->num_kf_index)
+            return NULL;
+    } else {
+        idx = kf_index_bound(queue, pts, true);
+        if (idx > queue->kf_index_start) {
+            // Last entry <= pts; go to the first entry with the same pts.
+            double target_pts = queue->kf_index[idx - 1].dp->kf_seek_pts;
+            idx = kf_index_bound(queue, target_pts, false);
+        }
+    }
+
+    return queue->kf_index[idx].dp;
+}
+
 // must be called locked
 static bool try_seek_cache(struct demux_internal *in, double pts, int flags)
 {
@@ -1860,24 +2836,32 @@ static bool try_seek_cache(struct demux_internal *in, double pts, int flags)
     if (in->seeking)
         return false;
 
-    struct demux_ctrl_reader_state rstate;
-    if (cached_demux_control(in, DEMUXER_CTRL_GET_READER_STATE, &rstate) < 0)
-        return false;
-
-    struct demux_seek_range r = {MP_NOPTS_VALUE, MP_NOPTS_VALUE};
-    if (rstate.num_seek_ranges > 0)
-        r = rstate.seek_ranges[0];
-
-    r.start = MP_ADD_PTS(r.start, -in->ts_offset);
-    r.end = MP_ADD_PTS(r.end, -in->ts_offset);
-
-    MP_VERBOSE(in, "in-cache seek range = %f <-> %f (%f)\n", r.start, r.end, pts);
+    struct demux_cached_range *range = NULL;
+    for (int n = 0; n < in->num_ranges; n++) {
+        struct demux_cached_range *r = in->ranges[n];
+        if (r->seek_start != MP_NOPTS_VALUE) {
+            MP_VERBOSE(in, "cached range %d: %f <-> %f\n",
+                       n, r->seek_start, r->seek_end);
+
+            if (pts >= r->seek_start && pts <= r->seek_end) {
+                MP_VERBOSE(in, "...using this range for in-cache seek.\n");
+                range = r;
+                break;
+            }
+        }
+    }
 
-    if (pts < r.start || pts > r.end)
+    if (!range)
         return false;
 
     clear_reader_state(in);
 
+    // The data of the current range is kept as a separate range, and the
+    // demuxer resumes appending to the end of the range seeked into.
+    bool resume = range != in->current_range;
+    if (resume)
+        switch_current_range(in, range);
+
     // Adjust the seek target to the found video key frames. Otherwise the
     // video will undershoot the seek target, while audio will be closer to it.
     // The player frontend will play the additional video without audio, so
@@ -1912,6 +2896,9 @@ static bool try_seek_cache(struct demux_internal *in, double pts, int flags)
         struct demux_packet *target = find_seek_target(ds, pts, flags);
         ds->reader_head = target;
         ds->skip_to_keyframe = !target;
+        // The forward buffer could contain compressed packets now, but it must
+        // not be compressed further.
+        ds->queue->compress_pos = NULL;
         if (ds->reader_head)
             ds->base_ts = PTS_OR_DEF(ds->reader_head->pts, ds->reader_head->dts);
 
@@ -1928,6 +2915,18 @@ static bool try_seek_cache(struct demux_internal *in, double pts, int flags)
         }
     }
 
+    if (resume) {
+        // Continue demuxing right after the end of the cached data. Packets
+        // that are already in the range are dropped by the refresh logic.
+        in->seeking = true;
+        in->seek_flags = SEEK_HR;
+        in->seek_pts = MP_PTS_MAX(range->seek_end - 1.0, range->seek_start);
+        for (int n = 0; n < in->num_streams; n++) {
+            struct demux_stream *ds = in->streams[n]->ds;
+            ds->refreshing = ds->selected;
+        }
+    }
+
     return true;
 }
 
@@ -1955,16 +2954,33 @@ int demux_seek(demuxer_t *demuxer, double seek_pts, int flags)
     if (try_seek_cache(in, seek_pts, flags)) {
         MP_VERBOSE(in, "in-cache seek worked!\n");
     } else {
-        clear_demux_state(in);
+        if (in->seekable_cache) {
+            // Keep the cached data as a separate range to seek back into.
+            clear_reader_state(in);
+            switch_to_fresh_range(in);
+            in->eof = false;
+            in->last_eof = false;
+            in->idle = true;
+            for (int n = 0; n < in->num_streams; n++) {
+                struct demux_stream *ds = in->streams[n]->ds;
+                ds->active = false;
+                ds->need_refresh = false;
+            }
+        } else {
+            clear_demux_state(in);
+            for (int n = 0; n < in->num_streams; n++)
+                in->streams[n]->ds->queue->cache_from_start = false;
+        }
 
         in->seeking = true;
         in->seek_flags = flags;
         in->seek_pts = seek_pts;
-
-        if (!in->threading)
-            execute_seek(in);
     }
 
+    // (Cache seeks into another range also need a low level seek to resume.)
+    if (in->seeking && !in->threading)
+        execute_seek(in);
+
     pthread_cond_signal(&in->wakeup);
     pthread_mutex_unlock(&in->lock);
 
@@ -2162,6 +3178,7 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
             .ts_reader = MP_NOPTS_VALUE,
             .ts_end = MP_NOPTS_VALUE,
             .ts_duration = -1,
+            .bytes_per_second = in->read_speed,
         };
         bool any_packets = false;
         for (int n = 0; n < in->num_streams; n++) {
@@ -2171,7 +3188,7 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
             {
                 r->underrun |= !ds->reader_head && !ds->eof;
                 r->ts_reader = MP_PTS_MAX(r->ts_reader, ds->base_ts);
-                r->ts_end = MP_PTS_MAX(r->ts_end, ds->last_ts);
+                r->ts_end = MP_PTS_MAX(r->ts_end, ds->queue->last_ts);
                 any_packets |= !!ds->queue->head;
             }
         }
@@ -2184,9 +3201,16 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
         if (in->seeking || !any_packets)
             r->ts_duration = 0;
         if (!in->seeking) {
-            for (int n = 0; n < in->num_ranges; n++) {
-                struct demux_cached_range *range = in->ranges[n];
-                if (range->seek_start != MP_NOPTS_VALUE && n < MAX_SEEK_RANGES) {
+            // The current range comes first, then the others from the most
+            // recently used one.
+            for (int n = in->num_ranges; n >= 0; n--) {
+                struct demux_cached_range *range =
+                    n == in->num_ranges ? in->current_range : in->ranges[n];
+                if (n < in->num_ranges && range == in->current_range)
+                    continue;
+                if (range->seek_start != MP_NOPTS_VALUE &&
+                    r->num_seek_ranges < MAX_SEEK_RANGES)
+                {
                     r->seek_ranges[r->num_seek_ranges++] =
                         (struct demux_seek_range){
                             .start = MP_ADD_PTS(range->seek_start, in->ts_offset),
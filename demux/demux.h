@@ -40,7 +40,7 @@ enum demux_ctrl {
     DEMUXER_CTRL_REPLACE_STREAM,
 };
 
-#define MAX_SEEK_RANGES 1
+#define MAX_SEEK_RANGES 10
 
 struct demux_seek_range {
     double start, end;
@@ -51,6 +51,7 @@ struct demux_ctrl_reader_state {
     double ts_duration;
     double ts_reader; // approx. timerstamp of decoder position
     double ts_end; // approx. timestamp of end of buffered range
+    double bytes_per_second; // rate at which packet data is read (0 if unknown)
     // Positions that can be seeked to without incurring the latency of a low
     // level seek.
     int num_seek_ranges;
@@ -165,14 +166,20 @@ struct demuxer_params {
     struct matroska_segment_uid *matroska_wanted_uids;
     int matroska_wanted_segment;
     bool *matroska_was_valid;
+    // If not NULL, set to the segment UID of the opened segment (if it has
+    // one), even if the file is rejected because it's not a wanted one.
+    struct matroska_segment_uid *matroska_probed_uid;
     struct timeline *timeline;
     bool disable_timeline;
     bool initial_readahead;
     bstr init_fragment;
     bool skip_lavf_probing;
+    int mem_prio; // enum mp_mem_prio (0 means normal)
     // -- demux_open_url() only
     int stream_flags;
     bool disable_cache;
+    // If the URL is the same as this stream's, share its cache (if any).
+    struct stream *shared_cache;
     // result
     bool demuxer_failed;
 };
@@ -217,6 +224,8 @@ typedef struct demuxer {
     struct mp_tags *metadata;
 
     void *priv;   // demuxer-specific internal data
+    // For new_demux_packet*() in demuxer implementations (never NULL).
+    struct demux_packet_pool *packet_pool;
     struct mpv_global *global;
     struct mp_log *log, *glog;
     struct demuxer_params *params;
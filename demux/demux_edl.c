@@ -22,6 +22,9 @@
 #include <string.h>
 #include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "mpv_talloc.h"
 
@@ -30,17 +33,35 @@
 #include "common/msg.h"
 #include "options/path.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "common/common.h"
+#include "osdep/io.h"
 #include "stream/stream.h"
 
 #define HEADER "# mpv EDL v0\n"
 
+// Maximum number of source files opened at the same time.
+#define MAX_OPEN_THREADS 8
+// Maximum number of files remembered in the probe cache.
+#define MAX_PROBE_CACHE 1024
+
+// What building the timeline needs to know about a source file. Read from the
+// opened source, or from the probe cache.
+struct source_info {
+    double start_time;
+    double duration;
+    bool is_network;
+    struct demux_chapter *chapters;
+    int num_chapters;
+};
+
 struct tl_part {
     char *filename;             // what is stream_open()ed
     double offset;              // offset into the source file
     bool offset_set;
     bool chapter_ts;
     double length;              // length of the part (-1 if rest of the file)
+    struct source_info *info;   // from the probe cache, or NULL
 };
 
 struct tl_parts {
@@ -55,6 +76,21 @@ struct priv {
     bool allow_any;
 };
 
+// Source files probed for earlier EDLs. Playlists which insert the same clips
+// over and over (such as ads) don't need to open them again just to get their
+// durations. Local files are checked against size and mtime; URLs are assumed
+// not to change during the session.
+struct probe_entry {
+    char *url;
+    int64_t size, mtime;
+    struct source_info info;
+};
+
+static pthread_mutex_t probe_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *probe_cache_ctx;
+static struct probe_entry *probe_cache;
+static int num_probe_cache;
+
 // Parse a time (absolute file time or duration). Currently equivalent to a
 // number. Return false on failure.
 static bool parse_time(bstr str, double *out_time)
@@ -155,17 +191,109 @@ error:
     return NULL;
 }
 
-static struct demuxer *open_source(struct timeline *tl, char *filename)
+static void get_file_id(const char *url, int64_t *size, int64_t *mtime)
+{
+    struct stat st;
+    *size = *mtime = -1;
+    if (!mp_is_url(bstr0(url)) && stat(url, &st) == 0) {
+        *size = st.st_size;
+        *mtime = st.st_mtime;
+    }
+}
+
+static void copy_info(void *ta_parent, struct source_info *dst,
+                      struct source_info *src)
+{
+    *dst = *src;
+    dst->chapters = demux_copy_chapter_data(src->chapters, src->num_chapters);
+    talloc_steal(ta_parent, dst->chapters);
+}
+
+static struct source_info *probe_cache_get(void *ta_parent, char *url)
+{
+    struct source_info *res = NULL;
+    int64_t size, mtime;
+    get_file_id(url, &size, &mtime);
+    pthread_mutex_lock(&probe_cache_lock);
+    for (int n = 0; n < num_probe_cache; n++) {
+        struct probe_entry *e = &probe_cache[n];
+        if (strcmp(e->url, url) == 0) {
+            if (e->size == size && e->mtime == mtime) {
+                res = talloc_zero(ta_parent, struct source_info);
+                copy_info(res, res, &e->info);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&probe_cache_lock);
+    return res;
+}
+
+static void probe_cache_add(char *url, struct source_info *info)
+{
+    int64_t size, mtime;
+    get_file_id(url, &size, &mtime);
+    pthread_mutex_lock(&probe_cache_lock);
+    // Simply start over if it gets too large.
+    if (num_probe_cache >= MAX_PROBE_CACHE) {
+        talloc_free(probe_cache_ctx);
+        probe_cache_ctx = NULL;
+        probe_cache = NULL;
+        num_probe_cache = 0;
+    }
+    if (!probe_cache_ctx)
+        probe_cache_ctx = talloc_new(NULL);
+    struct probe_entry *e = NULL;
+    for (int n = 0; n < num_probe_cache; n++) {
+        if (strcmp(probe_cache[n].url, url) == 0) {
+            e = &probe_cache[n];
+            break;
+        }
+    }
+    if (!e) {
+        MP_TARRAY_GROW(probe_cache_ctx, probe_cache, num_probe_cache);
+        e = &probe_cache[num_probe_cache++];
+        *e = (struct probe_entry){
+            .url = talloc_strdup(probe_cache_ctx, url),
+        };
+    }
+    talloc_free(e->info.chapters);
+    e->size = size;
+    e->mtime = mtime;
+    copy_info(probe_cache_ctx, &e->info, info);
+    pthread_mutex_unlock(&probe_cache_lock);
+}
+
+static void get_source_info(struct demuxer *d, struct source_info *info)
+{
+    *info = (struct source_info){
+        .start_time = d->start_time,
+        .duration = d->duration,
+        .is_network = d->is_network,
+        .chapters = d->chapters,
+        .num_chapters = d->num_chapters,
+    };
+}
+
+static struct demuxer *find_source(struct timeline *tl, char *filename)
 {
     for (int n = 0; n < tl->num_sources; n++) {
         struct demuxer *d = tl->sources[n];
         if (strcmp(d->stream->url, filename) == 0)
             return d;
     }
+    return NULL;
+}
+
+static struct demuxer *open_source(struct timeline *tl, char *filename)
+{
+    struct demuxer *d = find_source(tl, filename);
+    if (d)
+        return d;
     struct demuxer_params params = {
         .init_fragment = tl->init_fragment,
     };
-    struct demuxer *d = demux_open_url(filename, &params, tl->cancel, tl->global);
+    d = demux_open_url(filename, &params, tl->cancel, tl->global);
     if (d) {
         MP_TARRAY_APPEND(tl, tl->sources, tl->num_sources, d);
     } else {
@@ -174,21 +302,101 @@ static struct demuxer *open_source(struct timeline *tl, char *filename)
     return d;
 }
 
-static double demuxer_chapter_time(struct demuxer *demuxer, int n)
+struct open_job {
+    struct timeline *tl;
+    char *url;
+    struct demuxer *d;
+};
+
+// Runs on a worker thread.
+static void open_source_fn(void *ptr)
+{
+    struct open_job *job = ptr;
+    struct demuxer_params params = {
+        .init_fragment = job->tl->init_fragment,
+    };
+    job->d = demux_open_url(job->url, &params, job->tl->cancel,
+                            job->tl->global);
+}
+
+// Whether the EDL entry fully specifies which part of the source it uses, so
+// that the source doesn't need to be opened to build the timeline.
+static bool is_explicit(struct tl_part *part)
+{
+    return part->offset_set && part->length >= 0 && !part->chapter_ts;
+}
+
+// Open the sources needed to build the timeline, in parallel. Sources that are
+// not opened here are opened lazily when playback reaches them. Parts whose
+// sources were probed before get their info from the probe cache instead.
+static bool open_sources(struct timeline *tl, struct tl_parts *parts)
+{
+    void *tmp = talloc_new(NULL);
+    struct open_job *jobs = NULL;
+    int num_jobs = 0;
+
+    for (int n = 0; n < parts->num_parts; n++) {
+        struct tl_part *part = &parts->parts[n];
+        part->info = probe_cache_get(parts, part->filename);
+        // The first source defines the track layout.
+        if (n > 0 && (part->info || is_explicit(part)))
+            continue;
+        bool dup = false;
+        for (int i = 0; i < num_jobs; i++)
+            dup |= strcmp(jobs[i].url, part->filename) == 0;
+        if (!dup) {
+            struct open_job job = {.tl = tl, .url = part->filename};
+            MP_TARRAY_APPEND(tmp, jobs, num_jobs, job);
+        }
+    }
+
+    MP_VERBOSE(tl, "Opening %d of %d segments...\n", num_jobs, parts->num_parts);
+
+    struct mp_thread_pool *pool = NULL;
+    if (num_jobs > 1)
+        pool = mp_thread_pool_create(NULL, MPMIN(num_jobs, MAX_OPEN_THREADS));
+    for (int n = 0; n < num_jobs; n++) {
+        if (pool) {
+            mp_thread_pool_queue(pool, open_source_fn, &jobs[n]);
+        } else {
+            open_source_fn(&jobs[n]);
+        }
+    }
+    talloc_free(pool); // waits until all work is done
+
+    bool ok = true;
+    for (int n = 0; n < num_jobs; n++) {
+        struct open_job *job = &jobs[n];
+        if (job->d) {
+            MP_TARRAY_APPEND(tl, tl->sources, tl->num_sources, job->d);
+            struct source_info info;
+            get_source_info(job->d, &info);
+            probe_cache_add(job->url, &info);
+        } else {
+            MP_ERR(tl, "EDL: Could not open source file '%s'.\n", job->url);
+            ok = false;
+        }
+    }
+
+    talloc_free(tmp);
+    return ok;
+}
+
+static double source_chapter_time(struct source_info *info, int n)
 {
-    if (n < 0 || n >= demuxer->num_chapters)
+    if (n < 0 || n >= info->num_chapters)
         return -1;
-    return demuxer->chapters[n].pts;
+    return info->chapters[n].pts;
 }
 
 // Append all chapters from src to the chapters array.
 // Ignore chapters outside of the given time range.
 static void copy_chapters(struct demux_chapter **chapters, int *num_chapters,
-                          struct demuxer *src, double start, double len,
+                          struct source_info *src, double start, double len,
                           double dest_offset)
 {
     for (int n = 0; n < src->num_chapters; n++) {
-        double time = demuxer_chapter_time(src, n);
+        double time = source_chapter_time(src, n);
         if (time >= start && time <= start + len) {
             struct demux_chapter ch = {
                 .pts = dest_offset + time - start,
@@ -199,21 +407,21 @@ static void copy_chapters(struct demux_chapter **chapters, int *num_chapters,
     }
 }
 
-static void resolve_timestamps(struct tl_part *part, struct demuxer *demuxer)
+static void resolve_timestamps(struct tl_part *part, struct source_info *info)
 {
     if (part->chapter_ts) {
-        double start = demuxer_chapter_time(demuxer, part->offset);
+        double start = source_chapter_time(info, part->offset);
         double length = part->length;
         double end = length;
         if (end >= 0)
-            end = demuxer_chapter_time(demuxer, part->offset + part->length);
+            end = source_chapter_time(info, part->offset + part->length);
         if (end >= 0 && start >= 0)
             length = end - start;
         part->offset = start;
         part->length = length;
     }
     if (!part->offset_set)
-        part->offset = demuxer->start_time;
+        part->offset = info->start_time;
 }
 
 static void build_timeline(struct timeline *tl, struct tl_parts *parts)
@@ -241,6 +449,9 @@ static void build_timeline(struct timeline *tl, struct tl_parts *parts)
         }
     }
 
+    if (!tl->dash && !open_sources(tl, parts))
+        goto error;
+
     tl->parts = talloc_array_ptrtype(tl, tl->parts, parts->num_parts + 1);
     double starttime = 0;
     for (int n = 0; n < parts->num_parts; n++) {
@@ -261,17 +472,25 @@ static void build_timeline(struct timeline *tl, struct tl_parts *parts)
                     goto error;
             }
         } else {
-            MP_VERBOSE(tl, "Opening segment %d...\n", n);
-
-            source = open_source(tl, part->filename);
-            if (!source)
-                goto error;
-
-            resolve_timestamps(part, source);
+            // If the source wasn't opened, the segment is opened on demand.
+            struct source_info source_info;
+            struct source_info *info = part->info;
+            source = find_source(tl, part->filename);
+            if (source) {
+                get_source_info(source, &source_info);
+                info = &source_info;
+            }
 
-            double end_time = source->duration;
-            if (end_time >= 0)
-                end_time += source->start_time;
+            double end_time = -1;
+            if (info) {
+                resolve_timestamps(part, info);
+                end_time = info->duration;
+                if (end_time >= 0)
+                    end_time += info->start_time;
+                tl->demuxer->is_network |= info->is_network;
+            } else {
+                tl->demuxer->is_network |= mp_is_url(bstr0(part->filename));
+            }
 
             // Unknown length => use rest of the file. If duration is unknown, make
             // something up.
@@ -300,8 +519,10 @@ static void build_timeline(struct timeline *tl, struct tl_parts *parts)
             MP_TARRAY_APPEND(tl, tl->chapters, tl->num_chapters, ch);
 
             // Also copy the source file's chapters for the relevant parts
-            copy_chapters(&tl->chapters, &tl->num_chapters, source, part->offset,
-                          part->length, starttime);
+            if (info) {
+                copy_chapters(&tl->chapters, &tl->num_chapters, info,
+                              part->offset, part->length, starttime);
+            }
         }
 
         tl->parts[n] = (struct timeline_part) {
@@ -616,7 +616,7 @@ static void handle_new_stream(demuxer_t *demuxer, int i)
 
         if (st->disposition & AV_DISPOSITION_ATTACHED_PIC) {
             sh->attached_picture =
-                new_demux_packet_from_avpacket(&st->attached_pic);
+                new_demux_packet_from_avpacket(NULL, &st->attached_pic);
             if (sh->attached_picture) {
                 sh->attached_picture->pts = 0;
                 talloc_steal(sh, sh->attached_picture);
@@ -840,6 +840,13 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
         }
         priv->pb->read_seek = mp_read_seek;
         priv->pb->seekable = demuxer->seekable ? AVIO_SEEKABLE_NORMAL : 0;
+        // Let avio_read() call mp_read() directly with the caller's buffer,
+        // instead of copying through the AVIOContext buffer. Then packet data
+        // is copied straight from the cache (stream_read_partial() reads
+        // directly into the buffer for larger sizes, and serves small reads
+        // from the stream buffer). This makes all AVIO seeks go through
+        // mp_seek(), so only do it if seeking is cheap.
+        priv->pb->direct = priv->stream->caching;
         avfc->pb = priv->pb;
         if (stream_control(priv->stream, STREAM_CTRL_HAS_AVSEEK, NULL) > 0)
             demuxer->seekable = true;
@@ -970,7 +977,8 @@ static int demux_lavf_fill_buffer(demuxer_t *demux)
         return 1; // don't signal EOF if skipping a packet
     }
 
-    struct demux_packet *dp = new_demux_packet_from_avpacket(pkt);
+    struct demux_packet *dp =
+        new_demux_packet_from_avpacket(demux->packet_pool, pkt);
     if (!dp) {
         av_packet_unref(pkt);
         return 1;
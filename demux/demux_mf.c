@@ -15,6 +15,7 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <strings.h>
@@ -30,6 +31,7 @@
 #include "options/m_config.h"
 #include "options/path.h"
 #include "misc/ctype.h"
+#include "misc/thread_pool.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -38,14 +40,31 @@
 
 #define MF_MAX_FILE_SIZE (1024 * 1024 * 256)
 
+// A file read ahead of the current frame on a worker thread.
+struct mf_prefetch {
+    struct mpv_global *global;
+    int frame;              // -1 if unused
+    char *filename;
+    struct mp_task *task;
+    // written by the worker, and can be read once task is done
+    bstr data;
+};
+
 typedef struct mf {
     struct mp_log *log;
     struct sh_stream *sh;
     int curr_frame;
     int nr_of_files;
     char **names;
+    // printf-style pattern; if set, names[] are created on demand
+    char *pattern;
+    int pattern_start;
     // optional
     struct stream **streams;
+
+    struct mp_thread_pool *prefetch_pool;
+    struct mf_prefetch *prefetch;
+    int num_prefetch;
 } mf_t;
 
 
@@ -55,11 +74,61 @@ static void mf_add(mf_t *mf, const char *fname)
     MP_TARRAY_APPEND(mf, mf->names, mf->nr_of_files, entry);
 }
 
-static mf_t *open_mf_pattern(void *talloc_ctx, struct mp_log *log, char *filename)
+static char *mf_get_name(mf_t *mf, int frame)
+{
+    if (!mf->names[frame] && mf->pattern) {
+        mf->names[frame] =
+            talloc_asprintf(mf, mf->pattern, mf->pattern_start + frame);
+    }
+    return mf->names[frame];
+}
+
+static bool pattern_exists(const char *pattern, int n)
 {
-    int error_count = 0;
-    int count = 0;
+    char *fname = talloc_asprintf(NULL, pattern, n);
+    bool r = mp_path_exists(fname);
+    talloc_free(fname);
+    return r;
+}
 
+// Determine the number of files matched by a printf-style pattern without
+// listing them, assuming the sequence has no holes: find the first existing
+// index (0-4), then the end of the sequence by exponential and binary search.
+// This needs a logarithmic number of stat() calls, which matters for
+// sequences with hundreds of thousands of frames.
+static bool open_mf_printf(mf_t *mf, char *filename)
+{
+    int start = 0;
+    while (start < 5 && !pattern_exists(filename, start))
+        start++;
+    if (start == 5)
+        return false;
+
+    int lo = start; // exists
+    int step = 1;
+    while (step < INT_MAX / 4 && pattern_exists(filename, lo + step)) {
+        lo += step;
+        step *= 2;
+    }
+    int hi = lo + step; // does not exist
+    while (hi - lo > 1) {
+        int mid = lo + (hi - lo) / 2;
+        if (pattern_exists(filename, mid)) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    mf->pattern = talloc_strdup(mf, filename);
+    mf->pattern_start = start;
+    mf->nr_of_files = lo - start + 1;
+    mf->names = talloc_zero_array(mf, char *, mf->nr_of_files);
+    return true;
+}
+
+static mf_t *open_mf_pattern(void *talloc_ctx, struct mp_log *log, char *filename)
+{
     mf_t *mf = talloc_zero(talloc_ctx, mf_t);
     mf->log = log;
 
@@ -107,24 +176,25 @@ static mf_t *open_mf_pattern(void *talloc_ctx, struct mp_log *log, char *filenam
         goto exit_mf;
     }
 
-    char *fname = talloc_size(mf, strlen(filename) + 32);
-
 #if HAVE_GLOB
     if (!strchr(filename, '%')) {
+        char *fname = talloc_size(mf, strlen(filename) + 32);
         strcpy(fname, filename);
         if (!strchr(filename, '*'))
             strcat(fname, "*");
 
         mp_info(log, "search expr: %s\n", fname);
 
+        // GLOB_MARK appends '/' to directories, which avoids an extra stat()
+        // call per match.
         glob_t gg;
-        if (glob(fname, 0, NULL, &gg)) {
+        if (glob(fname, GLOB_MARK, NULL, &gg)) {
             talloc_free(mf);
             return NULL;
         }
 
         for (int i = 0; i < gg.gl_pathc; i++) {
-            if (mp_path_isdir(gg.gl_pathv[i]))
+            if (bstr_endswith0(bstr0(gg.gl_pathv[i]), "/"))
                 continue;
             mf_add(mf, gg.gl_pathv[i]);
         }
@@ -136,15 +206,8 @@ static mf_t *open_mf_pattern(void *talloc_ctx, struct mp_log *log, char *filenam
 
     mp_info(log, "search expr: %s\n", filename);
 
-    while (error_count < 5) {
-        sprintf(fname, filename, count++);
-        if (!mp_path_exists(fname)) {
-            error_count++;
-            mp_verbose(log, "file not found: '%s'\n", fname);
-        } else {
-            mf_add(mf, fname);
-        }
-    }
+    if (!open_mf_printf(mf, filename))
+        mp_verbose(log, "no files found\n");
 
     mp_info(log, "number of files: %d\n", mf->nr_of_files);
 
@@ -173,43 +236,131 @@ static void demux_seek_mf(demuxer_t *demuxer, double seek_pts, int flags)
     mf->curr_frame = newpos;
 }
 
-// return value:
-//     0 = EOF or no stream found
-//     1 = successfully read a packet
-static int demux_mf_fill_buffer(demuxer_t *demuxer)
+static void prefetch_fn(void *ctx)
+{
+    struct mf_prefetch *pf = ctx;
+    struct stream *stream = stream_open(pf->filename, pf->global);
+    if (stream) {
+        pf->data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
+        free_stream(stream);
+    }
+}
+
+static void prefetch_drop(struct mf_prefetch *pf)
+{
+    if (pf->task) {
+        mp_task_cancel(pf->task);
+        mp_task_wait(pf->task);
+        mp_task_release(pf->task);
+        pf->task = NULL;
+    }
+    talloc_free(pf->data.start);
+    pf->data = (bstr){0};
+    pf->frame = -1;
+}
+
+static struct mf_prefetch *prefetch_find(mf_t *mf, int frame)
+{
+    for (int n = 0; n < mf->num_prefetch; n++) {
+        if (mf->prefetch[n].frame == frame)
+            return &mf->prefetch[n];
+    }
+    return NULL;
+}
+
+// Make sure the files for the frames following the current one are being
+// read in the background, and drop results that are not needed anymore
+// (e.g. after a seek).
+static void prefetch_update(demuxer_t *demuxer)
 {
     mf_t *mf = demuxer->priv;
-    if (mf->curr_frame >= mf->nr_of_files)
-        return 0;
+    int end = MPMIN(mf->curr_frame + mf->num_prefetch, mf->nr_of_files);
+
+    for (int n = 0; n < mf->num_prefetch; n++) {
+        struct mf_prefetch *pf = &mf->prefetch[n];
+        if (pf->frame >= 0 && (pf->frame < mf->curr_frame || pf->frame >= end))
+            prefetch_drop(pf);
+    }
+
+    for (int frame = mf->curr_frame; frame < end; frame++) {
+        if (prefetch_find(mf, frame))
+            continue;
+        char *filename = mf_get_name(mf, frame);
+        struct mf_prefetch *pf = prefetch_find(mf, -1);
+        if (!filename || !pf)
+            continue;
+        pf->frame = frame;
+        pf->filename = filename;
+        // The frame needed next is more important than the ones after it.
+        enum mp_task_prio prio = frame == mf->curr_frame
+            ? MP_TASK_PRIO_PLAYBACK : MP_TASK_PRIO_BACKGROUND;
+        pf->task = mp_thread_pool_submit(mf->prefetch_pool, prio,
+                                         prefetch_fn, pf);
+    }
+}
+
+// Return the contents of the current frame's file. The caller owns the data.
+static bstr read_frame(demuxer_t *demuxer)
+{
+    mf_t *mf = demuxer->priv;
+    bstr data = {0};
+
+    if (mf->prefetch_pool) {
+        prefetch_update(demuxer);
+        struct mf_prefetch *pf = prefetch_find(mf, mf->curr_frame);
+        if (pf) {
+            mp_task_wait(pf->task);
+            mp_task_release(pf->task);
+            pf->task = NULL;
+            data = pf->data;
+            pf->data = (bstr){0};
+            pf->frame = -1;
+        }
+        return data;
+    }
 
     struct stream *entry_stream = NULL;
     if (mf->streams)
         entry_stream = mf->streams[mf->curr_frame];
     struct stream *stream = entry_stream;
     if (!stream) {
-        char *filename = mf->names[mf->curr_frame];
+        char *filename = mf_get_name(mf, mf->curr_frame);
         if (filename)
             stream = stream_open(filename, demuxer->global);
     }
 
     if (stream) {
         stream_seek(stream, 0);
-        bstr data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
-        if (data.len) {
-            demux_packet_t *dp = new_demux_packet(data.len);
-            if (dp) {
-                memcpy(dp->buffer, data.start, data.len);
-                dp->pts = mf->curr_frame / mf->sh->codec->fps;
-                dp->keyframe = true;
-                demux_add_packet(mf->sh, dp);
-            }
-        }
-        talloc_free(data.start);
+        data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
     }
 
     if (stream && stream != entry_stream)
         free_stream(stream);
 
+    return data;
+}
+
+// return value:
+//     0 = EOF or no stream found
+//     1 = successfully read a packet
+static int demux_mf_fill_buffer(demuxer_t *demuxer)
+{
+    mf_t *mf = demuxer->priv;
+    if (mf->curr_frame >= mf->nr_of_files)
+        return 0;
+
+    bstr data = read_frame(demuxer);
+    if (data.len) {
+        demux_packet_t *dp = new_demux_packet(demuxer->packet_pool, data.len);
+        if (dp) {
+            memcpy(dp->buffer, data.start, data.len);
+            dp->pts = mf->curr_frame / mf->sh->codec->fps;
+            dp->keyframe = true;
+            demux_add_packet(mf->sh, dp);
+        }
+    }
+    talloc_free(data.start);
+
     mf->curr_frame++;
     return 1;
 }
@@ -271,7 +422,7 @@ static const char *probe_format(mf_t *mf, char *type, enum demux_check check)
         return NULL;
     char *org_type = type;
     if (!type || !type[0]) {
-        char *p = strrchr(mf->names[0], '.');
+        char *p = strrchr(mf_get_name(mf, 0), '.');
         if (p)
             type = p + 1;
     }
@@ -308,8 +459,11 @@ static int demux_open_mf(demuxer_t *demuxer, enum demux_check check)
 
     double mf_fps;
     char *mf_type;
+    int mf_prefetch;
     mp_read_option_raw(demuxer->global, "mf-fps", &m_option_type_double, &mf_fps);
     mp_read_option_raw(demuxer->global, "mf-type", &m_option_type_string, &mf_type);
+    mp_read_option_raw(demuxer->global, "mf-prefetch", &m_option_type_int,
+                       &mf_prefetch);
 
     const char *codec = mp_map_mimetype_to_video_codec(demuxer->stream->mime_type);
     if (!codec || (mf_type && mf_type[0]))
@@ -333,6 +487,19 @@ static int demux_open_mf(demuxer_t *demuxer, enum demux_check check)
     demux_add_sh_stream(demuxer, sh);
 
     mf->sh = sh;
+
+    if (!mf->streams && mf->nr_of_files > 1 && mf_prefetch > 0) {
+        mf->prefetch_pool = mp_thread_pool_create(mf, mf_prefetch);
+        if (mf->prefetch_pool) {
+            mf->num_prefetch = mf_prefetch;
+            mf->prefetch = talloc_zero_array(mf, struct mf_prefetch, mf_prefetch);
+            for (int n = 0; n < mf->num_prefetch; n++) {
+                mf->prefetch[n].global = demuxer->global;
+                mf->prefetch[n].frame = -1;
+            }
+        }
+    }
+
     demuxer->priv = (void *)mf;
     demuxer->seekable = true;
     demuxer->duration = mf->nr_of_files / mf->sh->codec->fps;
@@ -345,6 +512,13 @@ error:
 
 static void demux_close_mf(demuxer_t *demuxer)
 {
+    mf_t *mf = demuxer->priv;
+    if (!mf)
+        return;
+    for (int n = 0; n < mf->num_prefetch; n++)
+        prefetch_drop(&mf->prefetch[n]);
+    talloc_free(mf->prefetch_pool);
+    mf->prefetch_pool = NULL;
 }
 
 const demuxer_desc_t demuxer_desc_mf = {
@@ -26,6 +26,9 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <libavutil/common.h>
 #include <libavutil/lzo.h>
@@ -45,6 +48,8 @@
 #include "common/av_common.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "options/path.h"
+#include "osdep/io.h"
 #include "misc/bstr.h"
 #include "stream/stream.h"
 #include "video/csputils.h"
@@ -187,6 +192,8 @@ typedef struct mkv_demuxer {
     size_t num_indexes;
     bool index_complete;
     int index_mode;
+    // Number of index entries loaded from or saved to the index cache.
+    size_t num_cached_indexes;
 
     int edition_id;
 
@@ -217,6 +224,7 @@ struct demux_mkv_opts {
     double subtitle_preroll_secs_index;
     int probe_duration;
     int probe_start_time;
+    int index_cache;
 };
 
 const struct m_sub_options demux_mkv_conf = {
@@ -230,6 +238,7 @@ const struct m_sub_options demux_mkv_conf = {
         OPT_CHOICE("probe-video-duration", probe_duration, 0,
                    ({"no", 0}, {"yes", 1}, {"full", 2})),
         OPT_FLAG("probe-start-time", probe_start_time, 0),
+        OPT_FLAG("index-cache", index_cache, 0),
         {0}
     },
     .size = sizeof(struct demux_mkv_opts),
@@ -422,6 +431,10 @@ static int demux_mkv_read_info(demuxer_t *demuxer)
         } else {
             memcpy(demuxer->matroska_data.uid.segment, info.segment_uid.start,
                    len);
+            if (demuxer->params && demuxer->params->matroska_probed_uid) {
+                memcpy(demuxer->params->matroska_probed_uid->segment,
+                       info.segment_uid.start, len);
+            }
             MP_VERBOSE(demuxer, "| + segment uid");
             for (size_t i = 0; i < len; i++)
                 MP_VERBOSE(demuxer, " %02x",
@@ -1314,7 +1327,8 @@ static void add_coverart(struct demuxer *demuxer)
         struct sh_stream *sh = demux_alloc_sh_stream(STREAM_VIDEO);
         sh->demuxer_id = -1 - sh->index; // don't clash with mkv IDs
         sh->codec->codec = codec;
-        sh->attached_picture = new_demux_packet_from(att->data, att->data_size);
+        sh->attached_picture =
+            new_demux_packet_from(NULL, att->data, att->data_size);
         if (sh->attached_picture) {
             sh->attached_picture->pts = 0;
             talloc_steal(sh, sh->attached_picture);
@@ -1958,6 +1972,187 @@ static int read_mkv_segment_header(demuxer_t *demuxer, int64_t *segment_end)
     return 0;
 }
 
+// --- index cache
+// For files without Cues, the index built while seeking is stored in the
+// config directory, so that later seeks in the same file don't need to read
+// all clusters again. The file format is native-endian, and only meant for
+// local use.
+
+#define INDEX_CACHE_DIR "mkv-index"
+#define INDEX_CACHE_MAGIC "mpvmkvix"
+#define INDEX_CACHE_VERSION 1
+
+struct index_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+    uint8_t segment_uid[16];
+    int64_t file_size;
+    int64_t mtime;
+    int64_t tc_scale;
+    uint64_t num_entries;
+};
+
+static bool has_cues(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    for (int n = 0; n < mkv_d->num_headers; n++) {
+        if (mkv_d->headers[n].id == MATROSKA_ID_CUES)
+            return true;
+    }
+    return mkv_d->index_complete;
+}
+
+// Fill in the header identifying the current file. Returns false if the file
+// can't use the index cache.
+static bool get_index_cache_header(struct demuxer *demuxer,
+                                   struct index_cache_header *hdr)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    struct stream *s = demuxer->stream;
+
+    if (!mkv_d->opts->index_cache || mkv_d->index_mode != 1 ||
+        !demuxer->seekable || has_cues(demuxer))
+        return false;
+
+    static const uint8_t zero_uid[16];
+    const uint8_t *uid = demuxer->matroska_data.uid.segment;
+    if (!memcmp(uid, zero_uid, 16))
+        return false;
+
+    int64_t size = stream_get_size(s);
+    if (size <= 0)
+        return false;
+
+    int64_t mtime = -1;
+    struct stat st;
+    if (s->is_local_file && s->path && stat(s->path, &st) == 0)
+        mtime = st.st_mtime;
+
+    *hdr = (struct index_cache_header){
+        .magic = INDEX_CACHE_MAGIC,
+        .version = INDEX_CACHE_VERSION,
+        .entry_size = sizeof(mkv_index_t),
+        .file_size = size,
+        .mtime = mtime,
+        .tc_scale = mkv_d->tc_scale,
+    };
+    memcpy(hdr->segment_uid, uid, 16);
+    return true;
+}
+
+static char *get_index_cache_path(void *ta_parent, struct demuxer *demuxer,
+                                  struct index_cache_header *hdr)
+{
+    char *name = talloc_strdup(NULL, "");
+    for (int n = 0; n < 16; n++)
+        name = talloc_asprintf_append(name, "%02X", hdr->segment_uid[n]);
+    name = talloc_asprintf_append(name, "-%"PRIx64, (uint64_t)hdr->file_size);
+
+    char *res = NULL;
+    char *dir = mp_find_user_config_file(NULL, demuxer->global, INDEX_CACHE_DIR);
+    if (dir)
+        res = mp_path_join(ta_parent, dir, name);
+    talloc_free(dir);
+    talloc_free(name);
+    return res;
+}
+
+static void load_index_cache(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    struct index_cache_header hdr;
+    if (!get_index_cache_header(demuxer, &hdr))
+        return;
+
+    char *path = get_index_cache_path(NULL, demuxer, &hdr);
+    FILE *f = path ? fopen(path, "rb") : NULL;
+    if (!f)
+        goto done;
+
+    struct index_cache_header fhdr;
+    if (fread(&fhdr, sizeof(fhdr), 1, f) != 1 ||
+        memcmp(&fhdr, &hdr, offsetof(struct index_cache_header, num_entries)))
+    {
+        MP_VERBOSE(demuxer, "Ignoring outdated index cache %s\n", path);
+        goto done;
+    }
+
+    // Cached index entries are a superset of whatever was indexed so far.
+    if (fhdr.num_entries <= mkv_d->num_indexes ||
+        fhdr.num_entries > SIZE_MAX / sizeof(mkv_index_t))
+        goto done;
+
+    size_t num = fhdr.num_entries;
+    mkv_index_t *indexes = talloc_array(mkv_d, mkv_index_t, num);
+    if (fread(indexes, sizeof(mkv_index_t), num, f) != num) {
+        talloc_free(indexes);
+        goto done;
+    }
+
+    talloc_free(mkv_d->indexes);
+    mkv_d->indexes = indexes;
+    mkv_d->num_indexes = num;
+    mkv_d->num_cached_indexes = num;
+    mkv_d->index_has_durations = true;
+    for (int n = 0; n < mkv_d->num_tracks; n++) {
+        mkv_track_t *track = mkv_d->tracks[n];
+        track->last_index_entry = (size_t)-1;
+        for (size_t i = 0; i < num; i++) {
+            if (indexes[i].tnum == track->tnum)
+                track->last_index_entry = i;
+        }
+    }
+
+    MP_VERBOSE(demuxer, "Loaded %zu index entries from %s\n", num, path);
+
+done:
+    if (f)
+        fclose(f);
+    talloc_free(path);
+}
+
+static void save_index_cache(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    // Nothing new was indexed (opening the file alone indexes 1-2 entries).
+    if (mkv_d->num_indexes <= MPMAX(mkv_d->num_cached_indexes, 2))
+        return;
+
+    struct index_cache_header hdr;
+    if (!get_index_cache_header(demuxer, &hdr))
+        return;
+    hdr.num_entries = mkv_d->num_indexes;
+
+    mp_mk_config_dir(demuxer->global, INDEX_CACHE_DIR);
+    char *path = get_index_cache_path(NULL, demuxer, &hdr);
+    if (!path)
+        return;
+    char *tmp = talloc_asprintf(path, "%s.tmp", path);
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f)
+        goto done;
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+              fwrite(mkv_d->indexes, sizeof(mkv_index_t), mkv_d->num_indexes,
+                     f) == mkv_d->num_indexes;
+    ok &= fclose(f) == 0;
+    // Replace the old file atomically, so concurrent readers are safe.
+    if (ok && rename(tmp, path) == 0) {
+        MP_VERBOSE(demuxer, "Saved %zu index entries to %s\n",
+                   mkv_d->num_indexes, path);
+        mkv_d->num_cached_indexes = mkv_d->num_indexes;
+    } else {
+        MP_WARN(demuxer, "Could not write index cache %s\n", path);
+        unlink(tmp);
+    }
+
+done:
+    talloc_free(path);
+}
+
 static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
 {
     stream_t *s = demuxer->stream;
@@ -2079,6 +2274,8 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     if (mkv_d->opts->probe_duration)
         probe_last_timestamp(demuxer, start_pos);
 
+    load_index_cache(demuxer);
+
     return 0;
 }
 
@@ -2258,8 +2455,9 @@ static bool handle_realaudio(demuxer_t *demuxer, mkv_track_t *track,
             goto error;
         // Release all the audio packets
         for (int x = 0; x < sph * w / apk_usize; x++) {
-            dp = new_demux_packet_from(track->audio_buf + x * apk_usize,
-                                        apk_usize);
+            dp = new_demux_packet_from(demuxer->packet_pool,
+                                       track->audio_buf + x * apk_usize,
+                                       apk_usize);
             if (!dp)
                 goto error;
             /* Put timestamp only on packets that correspond to original
@@ -2390,7 +2588,8 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
         int size = dp->len;
         uint8_t *parsed;
         if (libav_parse_wavpack(track, dp->buffer, &parsed, &size) >= 0) {
-            struct demux_packet *new = new_demux_packet_from(parsed, size);
+            struct demux_packet *new =
+                new_demux_packet_from(demuxer->packet_pool, parsed, size);
             if (new) {
                 demux_packet_copy_attribs(new, dp);
                 talloc_free(dp);
@@ -2402,7 +2601,8 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
 
     if (strcmp(stream->codec->codec, "prores") == 0) {
         size_t newlen = dp->len + 8;
-        struct demux_packet *new = new_demux_packet(newlen);
+        struct demux_packet *new =
+            new_demux_packet(demuxer->packet_pool, newlen);
         if (new) {
             AV_WB32(new->buffer + 0, newlen);
             AV_WB32(new->buffer + 4, MKBETAG('i', 'c', 'p', 'f'));
@@ -2444,7 +2644,8 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
         dp->len -= len;
         dp->pos += len;
         if (size) {
-            struct demux_packet *new = new_demux_packet_from(data, size);
+            struct demux_packet *new =
+                new_demux_packet_from(demuxer->packet_pool, data, size);
             if (!new)
                 break;
             if (copy_sidedata)
@@ -2618,9 +2819,10 @@ static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
 
             if (block.start != nblock.start || block.len != nblock.len) {
                 // (avoidable copy of the entire data)
-                dp = new_demux_packet_from(nblock.start, nblock.len);
+                dp = new_demux_packet_from(demuxer->packet_pool, nblock.start,
+                                           nblock.len);
             } else {
-                dp = new_demux_packet_from_buf(data);
+                dp = new_demux_packet_from_buf(demuxer->packet_pool, data);
             }
             if (!dp)
                 break;
@@ -3173,6 +3375,7 @@ static void mkv_free(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     if (!mkv_d)
         return;
+    save_index_cache(demuxer);
     mkv_seek_reset(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <assert.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <string.h>
 #include <strings.h>
 #include <sys/types.h>
@@ -39,6 +40,7 @@
 #include "options/options.h"
 #include "options/path.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "common/common.h"
 #include "common/playlist.h"
 #include "stream/stream.h"
@@ -62,8 +64,35 @@ struct tl_ctx {
     uint64_t missing_time; // Total missing time so far.
     uint64_t last_end_time; // When the last part ended on the complete timeline.
     int num_chapters; // Total number of expected chapters.
+
+    struct scan_entry *probed; // segment UIDs of candidate files
+    int num_probed;
+};
+
+// Maximum number of threads used to probe candidate files.
+#define MAX_PROBE_THREADS 8
+// Give up on files with more segments than this.
+#define MAX_PROBE_SEGMENTS 100
+// Maximum number of files remembered in the scan cache.
+#define MAX_SCAN_CACHE 4096
+
+// Segment UIDs of a candidate file. Files are identified by name, and the
+// result is considered valid as long as size and mtime don't change.
+struct scan_entry {
+    char *filename;
+    int64_t size, mtime;
+    int num_segments;
+    struct matroska_segment_uid *uids;
 };
 
+// Remembers the segment UIDs of files scanned for earlier playlist entries, so
+// that playing a series of files from the same directory doesn't reopen every
+// file in the directory for each entry.
+static pthread_mutex_t scan_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *scan_cache_ctx;
+static struct scan_entry *scan_cache;
+static int num_scan_cache;
+
 struct find_entry {
     char *name;
     int matchlen;
@@ -160,9 +189,41 @@ static bool has_source_request(struct tl_ctx *ctx,
     return false;
 }
 
+static struct scan_entry *find_probed(struct tl_ctx *ctx, char *filename)
+{
+    for (int n = 0; n < ctx->num_probed; n++) {
+        if (strcmp(ctx->probed[n].filename, filename) == 0)
+            return &ctx->probed[n];
+    }
+    return NULL;
+}
+
+// Return whether opening the given segment could match a missing source.
+// Files which could not be probed always need to be opened.
+static bool may_match(struct tl_ctx *ctx, char *filename, int segment,
+                      bool *was_valid)
+{
+    struct scan_entry *e = find_probed(ctx, filename);
+    if (!e)
+        return true;
+    *was_valid = segment < e->num_segments;
+    if (!*was_valid)
+        return false;
+    for (int i = 1; i < ctx->num_sources; i++) {
+        if (!ctx->sources[i] &&
+            !memcmp(ctx->uids[i].segment, e->uids[segment].segment, 16))
+            return true;
+    }
+    return false;
+}
+
 // segment = get Nth segment of a multi-segment file
 static bool check_file_seg(struct tl_ctx *ctx, char *filename, int segment)
 {
+    bool probed_valid = false;
+    if (!may_match(ctx, filename, segment, &probed_valid))
+        return probed_valid;
+
     bool was_valid = false;
     struct demuxer_params params = {
         .force_format = "mkv",
@@ -241,6 +302,149 @@ static void check_file(struct tl_ctx *ctx, char *filename, int first)
     }
 }
 
+static bool scan_cache_lookup(struct scan_entry *res, void *ta_parent)
+{
+    bool found = false;
+    pthread_mutex_lock(&scan_cache_lock);
+    for (int n = 0; n < num_scan_cache; n++) {
+        struct scan_entry *e = &scan_cache[n];
+        if (strcmp(e->filename, res->filename) == 0) {
+            if (e->size == res->size && e->mtime == res->mtime) {
+                res->num_segments = e->num_segments;
+                res->uids = talloc_memdup(ta_parent, e->uids,
+                                    e->num_segments * sizeof(e->uids[0]));
+                found = true;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&scan_cache_lock);
+    return found;
+}
+
+static void scan_cache_add(struct scan_entry *res)
+{
+    pthread_mutex_lock(&scan_cache_lock);
+    // Simply start over if it gets too large; the common case is playing
+    // files from a single directory.
+    if (num_scan_cache >= MAX_SCAN_CACHE) {
+        talloc_free(scan_cache_ctx);
+        scan_cache_ctx = NULL;
+        scan_cache = NULL;
+        num_scan_cache = 0;
+    }
+    if (!scan_cache_ctx)
+        scan_cache_ctx = talloc_new(NULL);
+    struct scan_entry *e = NULL;
+    for (int n = 0; n < num_scan_cache; n++) {
+        if (strcmp(scan_cache[n].filename, res->filename) == 0) {
+            e = &scan_cache[n];
+            break;
+        }
+    }
+    if (!e) {
+        MP_TARRAY_GROW(scan_cache_ctx, scan_cache, num_scan_cache);
+        e = &scan_cache[num_scan_cache++];
+        *e = (struct scan_entry){
+            .filename = talloc_strdup(scan_cache_ctx, res->filename),
+        };
+    }
+    talloc_free(e->uids);
+    e->size = res->size;
+    e->mtime = res->mtime;
+    e->num_segments = res->num_segments;
+    e->uids = talloc_memdup(scan_cache_ctx, res->uids,
+                            res->num_segments * sizeof(res->uids[0]));
+    pthread_mutex_unlock(&scan_cache_lock);
+}
+
+struct probe_job {
+    struct mpv_global *global;
+    struct mp_cancel *cancel;
+    struct scan_entry res;
+    bool ok;
+};
+
+// Read the segment UIDs of all segments in a file. This stops opening each
+// segment right after its header, so it's much cheaper than check_file_seg().
+// Runs on a worker thread.
+static void probe_file(void *ptr)
+{
+    struct probe_job *job = ptr;
+    struct scan_entry *res = &job->res;
+
+    struct stat st;
+    if (stat(res->filename, &st) != 0)
+        return;
+    res->size = st.st_size;
+    res->mtime = st.st_mtime;
+
+    if (scan_cache_lookup(res, job)) {
+        job->ok = true;
+        return;
+    }
+
+    for (int segment = 0; segment < MAX_PROBE_SEGMENTS; segment++) {
+        if (mp_cancel_test(job->cancel))
+            return;
+        struct matroska_segment_uid uid = {0}, none = {0};
+        bool was_valid = false;
+        struct demuxer_params params = {
+            .force_format = "mkv",
+            // Accept nothing, so opening stops after the segment info.
+            .matroska_num_wanted_uids = 0,
+            .matroska_wanted_uids = &none,
+            .matroska_wanted_segment = segment,
+            .matroska_was_valid = &was_valid,
+            .matroska_probed_uid = &uid,
+            .disable_timeline = true,
+            .disable_cache = true,
+        };
+        struct demuxer *d =
+            demux_open_url(res->filename, &params, job->cancel, job->global);
+        if (d)
+            free_demuxer_and_stream(d);
+        if (!was_valid) {
+            job->ok = segment > 0 || !mp_cancel_test(job->cancel);
+            break;
+        }
+        MP_TARRAY_APPEND(job, res->uids, res->num_segments, uid);
+    }
+
+    if (job->ok)
+        scan_cache_add(res);
+}
+
+// Determine the segment UIDs of all candidate files in parallel, so that the
+// sequential search below only needs to open files which actually match.
+static void probe_files(struct tl_ctx *ctx, void *ta_parent,
+                        char **filenames, int num_filenames)
+{
+    if (num_filenames < 1)
+        return;
+
+    struct probe_job *jobs = talloc_zero_array(ta_parent, struct probe_job,
+                                               num_filenames);
+    for (int n = 0; n < num_filenames; n++) {
+        jobs[n] = (struct probe_job){
+            .global = ctx->global,
+            .cancel = ctx->tl->cancel,
+            .res = { .filename = filenames[n] },
+        };
+    }
+
+    struct mp_thread_pool *pool =
+        mp_thread_pool_create(NULL, MPMIN(num_filenames, MAX_PROBE_THREADS));
+    for (int n = 0; pool && n < num_filenames; n++)
+        mp_thread_pool_queue(pool, probe_file, &jobs[n]);
+    talloc_free(pool); // waits until all work is done
+
+    for (int n = 0; n < num_filenames; n++) {
+        if (jobs[n].ok)
+            MP_TARRAY_APPEND(ta_parent, ctx->probed, ctx->num_probed, jobs[n].res);
+    }
+}
+
 static bool missing(struct tl_ctx *ctx)
 {
     for (int i = 0; i < ctx->num_sources; i++) {
@@ -277,6 +481,7 @@ static void find_ordered_chapter_sources(struct tl_ctx *ctx)
             num_filenames = MP_TALLOC_AVAIL(filenames);
             talloc_steal(tmp, filenames);
         }
+        probe_files(ctx, tmp, filenames, num_filenames);
         // Possibly get further segments appended to the first segment
         check_file(ctx, main_filename, 1);
     }
@@ -305,6 +510,8 @@ static void find_ordered_chapter_sources(struct tl_ctx *ctx)
         ctx->num_sources = j;
     }
 
+    ctx->probed = NULL;
+    ctx->num_probed = 0;
     talloc_free(tmp);
 }
 
@@ -276,7 +276,8 @@ static int raw_fill_buffer(demuxer_t *demuxer)
     if (demuxer->stream->eof)
         return 0;
 
-    struct demux_packet *dp = new_demux_packet(p->frame_size * p->read_frames);
+    struct demux_packet *dp = new_demux_packet(demuxer->packet_pool,
+                                               p->frame_size * p->read_frames);
     if (!dp) {
         MP_ERR(demuxer, "Can't read packet.\n");
         return 1;
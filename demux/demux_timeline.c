@@ -20,12 +20,17 @@
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
 
 #include "demux.h"
 #include "timeline.h"
 #include "stheader.h"
 #include "stream/stream.h"
 
+// Number of lazy segments after the current one that are opened in advance and
+// kept open.
+#define PREFETCH_SEGMENTS 1
+
 struct segment {
     int index;
     double start, end;
@@ -66,6 +71,13 @@ struct priv {
     // Total number of packets received past end of segment. Used
     // to be clever about determining when to switch segments.
     int eos_packets;
+
+    // Opening of an upcoming lazy segment on a worker thread. prefetch_d is
+    // written by the worker, and can be read once prefetch_task is done.
+    struct mp_thread_pool *prefetch_pool;
+    struct mp_task *prefetch_task;
+    struct segment *prefetch_seg;
+    struct demuxer *prefetch_d;
 };
 
 static bool target_stream_used(struct segment *seg, int target_index)
@@ -139,28 +151,125 @@ static void reselect_streams(struct demuxer *demuxer)
     }
 }
 
+// Whether a lazy segment should be kept open (or opened in advance).
+static bool segment_is_warm(struct priv *p, struct segment *seg)
+{
+    return p->current && seg->index >= p->current->index &&
+           seg->index <= p->current->index + PREFETCH_SEGMENTS;
+}
+
 static void close_lazy_segments(struct demuxer *demuxer)
 {
     struct priv *p = demuxer->priv;
 
-    // unload previous segment
+    // unload segments outside of the prefetch window
     for (int n = 0; n < p->num_segments; n++) {
         struct segment *seg = p->segments[n];
-        if (seg != p->current && seg->d && seg->lazy) {
+        if (seg->d && seg->lazy && !segment_is_warm(p, seg)) {
             free_demuxer_and_stream(seg->d);
             seg->d = NULL;
         }
     }
 }
 
+static void prefetch_fn(void *ctx)
+{
+    struct demuxer *demuxer = ctx;
+    struct priv *p = demuxer->priv;
+    struct segment *seg = p->prefetch_seg;
+
+    struct demuxer_params params = {
+        .init_fragment = p->tl->init_fragment,
+        .skip_lavf_probing = true,
+    };
+    struct demuxer *d = demux_open_url(seg->url, &params,
+                                       demuxer->stream->cancel, demuxer->global);
+    // Seek to the segment start, so that switch_segment() will seek within
+    // data that is already in the stream cache.
+    if (d && !p->dash) {
+        demux_set_ts_offset(d, seg->start - seg->d_start);
+        demux_seek(d, seg->start, SEEK_HR);
+    }
+    p->prefetch_d = d;
+}
+
+// Collect the result of the prefetch task, if it has finished (or wait until it
+// has finished if wait==true).
+static void poll_prefetch(struct demuxer *demuxer, bool wait)
+{
+    struct priv *p = demuxer->priv;
+
+    if (!p->prefetch_task || (!wait && !mp_task_is_done(p->prefetch_task)))
+        return;
+
+    mp_task_wait(p->prefetch_task);
+    mp_task_release(p->prefetch_task);
+    p->prefetch_task = NULL;
+
+    struct segment *seg = p->prefetch_seg;
+    struct demuxer *d = p->prefetch_d;
+    p->prefetch_seg = NULL;
+    p->prefetch_d = NULL;
+
+    if (d && !seg->d && segment_is_warm(p, seg)) {
+        MP_VERBOSE(demuxer, "prefetched segment %d\n", seg->index);
+        seg->d = d;
+        associate_streams(demuxer, seg);
+    } else if (d) {
+        free_demuxer_and_stream(d);
+    }
+}
+
+// Start opening the next lazy segment in the background. (Only one segment is
+// opened at a time; if a previous task is still running, this is retried the
+// next time.)
+static void start_prefetch(struct demuxer *demuxer)
+{
+    struct priv *p = demuxer->priv;
+
+    poll_prefetch(demuxer, false);
+    if (p->prefetch_task || !p->current)
+        return;
+
+    struct segment *seg = NULL;
+    for (int n = p->current->index + 1; n < p->num_segments; n++) {
+        struct segment *cur = p->segments[n];
+        if (!segment_is_warm(p, cur))
+            break;
+        if (cur->lazy && !cur->d) {
+            seg = cur;
+            break;
+        }
+    }
+    if (!seg)
+        return;
+
+    if (!p->prefetch_pool)
+        p->prefetch_pool = mp_thread_pool_create(p, 1);
+    if (!p->prefetch_pool)
+        return;
+
+    p->prefetch_seg = seg;
+    p->prefetch_task = mp_thread_pool_submit(p->prefetch_pool,
+                                             MP_TASK_PRIO_BACKGROUND,
+                                             prefetch_fn, demuxer);
+}
+
 static void reopen_lazy_segments(struct demuxer *demuxer)
 {
     struct priv *p = demuxer->priv;
 
+    close_lazy_segments(demuxer);
+
     if (p->current->d)
         return;
 
-    close_lazy_segments(demuxer);
+    // If it's being opened in the background already, wait for it.
+    if (p->prefetch_seg == p->current) {
+        poll_prefetch(demuxer, true);
+        if (p->current->d)
+            return;
+    }
 
     struct demuxer_params params = {
         .init_fragment = p->tl->init_fragment,
@@ -199,6 +308,8 @@ static void switch_segment(struct demuxer *demuxer, struct segment *new,
     }
 
     p->eos_packets = 0;
+
+    start_prefetch(demuxer);
 }
 
 static void d_seek(struct demuxer *demuxer, double seek_pts, int flags)
@@ -231,6 +342,8 @@ static int d_fill_buffer(struct demuxer *demuxer)
     if (!seg || !seg->d)
         return 0;
 
+    start_prefetch(demuxer);
+
     struct demux_packet *pkt = demux_read_any_packet(seg->d);
     if (!pkt || pkt->pts >= seg->end)
         p->eos_packets += 1;
@@ -421,6 +534,7 @@ static void d_close(struct demuxer *demuxer)
 {
     struct priv *p = demuxer->priv;
     struct demuxer *master = p->tl->demuxer;
+    poll_prefetch(demuxer, true);
     p->current = NULL;
     close_lazy_segments(demuxer);
     timeline_destroy(p->tl);
@@ -22,6 +22,8 @@
 
 #include <assert.h>
 
+#include <libavcodec/avcodec.h>
+
 #include "common/common.h"
 #include "common/msg.h"
 
@@ -219,7 +221,7 @@ static int demux_tv_fill_buffer(demuxer_t *demux)
     {
         len = tvh->functions->get_audio_framesize(tvh->priv);
 
-        dp=new_demux_packet(len);
+        dp=new_demux_packet(demux->packet_pool, len);
         if (dp) {
             dp->keyframe = true;
             dp->pts=tvh->functions->grab_audio_frame(tvh->priv, dp->buffer,len);
@@ -232,12 +234,30 @@ static int demux_tv_fill_buffer(demuxer_t *demux)
     if (want_video && tvh->functions->control(tvh->priv,
                             TVI_CONTROL_IS_VIDEO, 0) == TVI_CONTROL_TRUE)
     {
-        len = tvh->functions->get_video_framesize(tvh->priv);
-        dp=new_demux_packet(len);
-        if (dp) {
-            dp->keyframe = true;
-            dp->pts=tvh->functions->grab_video_frame(tvh->priv, dp->buffer, len);
-            demux_add_packet(want_video, dp);
+        if (tvh->functions->grab_video_buffer) {
+            // The packet references the capture buffer, without copying it.
+            AVBufferRef *buf = NULL;
+            int buf_len = 0;
+            double pts = tvh->functions->grab_video_buffer(tvh->priv, &buf,
+                                                           &buf_len);
+            if (buf) {
+                AVPacket pkt = { .data = buf->data, .size = buf_len, .buf = buf };
+                dp = new_demux_packet_from_avpacket(demux->packet_pool, &pkt);
+                av_buffer_unref(&buf);
+                if (dp) {
+                    dp->keyframe = true;
+                    dp->pts = pts;
+                    demux_add_packet(want_video, dp);
+                }
+            }
+        } else {
+            len = tvh->functions->get_video_framesize(tvh->priv);
+            dp=new_demux_packet(demux->packet_pool, len);
+            if (dp) {
+                dp->keyframe = true;
+                dp->pts=tvh->functions->grab_video_frame(tvh->priv, dp->buffer, len);
+                demux_add_packet(want_video, dp);
+            }
         }
     }
 
@@ -55,12 +55,86 @@ bool ebml_is_mkv_level1_id(uint32_t id)
     }
 }
 
+static uint32_t ebml_parse_id(uint8_t *data, size_t data_len, int *length)
+{
+    *length = -1;
+    uint8_t *end = data + data_len;
+    if (data == end)
+        return EBML_ID_INVALID;
+    int len = 1;
+    uint32_t id = *data++;
+    for (int len_mask = 0x80; !(id & len_mask); len_mask >>= 1) {
+        len++;
+        if (len > 4)
+            return EBML_ID_INVALID;
+    }
+    *length = len;
+    while (--len && data < end)
+        id = (id << 8) | *data++;
+    return id;
+}
+
+static uint64_t ebml_parse_length(uint8_t *data, size_t data_len, int *length)
+{
+    *length = -1;
+    uint8_t *end = data + data_len;
+    if (data == end)
+        return -1;
+    uint64_t r = *data++;
+    int len = 1;
+    int len_mask;
+    for (len_mask = 0x80; !(r & len_mask); len_mask >>= 1) {
+        len++;
+        if (len > 8)
+            return -1;
+    }
+    r &= len_mask - 1;
+
+    int num_allones = 0;
+    if (r == len_mask - 1)
+        num_allones++;
+    for (int i = 1; i < len; i++) {
+        if (data == end)
+            return -1;
+        if (*data == 255)
+            num_allones++;
+        r = (r << 8) | *data++;
+    }
+    // According to Matroska specs this means "unknown length"
+    // Could be supported if there are any actual files using it
+    if (num_allones == len)
+        return -1;
+    *length = len;
+    return r;
+}
+
+// Return a pointer to the next n bytes in the stream buffer, or NULL if it
+// doesn't contain that many. Since the stream reads in large blocks, this
+// allows parsing most elements directly from memory.
+static inline uint8_t *peek_buffer(stream_t *s, int n)
+{
+    if (s->buf_len - s->buf_pos < n)
+        return NULL;
+    return s->buffer + s->buf_pos;
+}
+
 /*
  * Read: the element content data ID.
  * Return: the ID.
  */
 uint32_t ebml_read_id(stream_t *s)
 {
+    uint8_t *data = peek_buffer(s, 4);
+    if (data) {
+        int length;
+        uint32_t id = ebml_parse_id(data, 4, &length);
+        if (length > 0) {
+            s->buf_pos += length;
+            return id;
+        }
+        // Let the code below deal with invalid data.
+    }
+
     int i, len_mask = 0x80;
     uint32_t id;
 
@@ -78,6 +152,16 @@ uint32_t ebml_read_id(stream_t *s)
  */
 uint64_t ebml_read_length(stream_t *s)
 {
+    uint8_t *data = peek_buffer(s, 8);
+    if (data) {
+        int length;
+        uint64_t len = ebml_parse_length(data, 8, &length);
+        if (length > 0) {
+            s->buf_pos += length;
+            return len;
+        }
+    }
+
     int i, j, num_ffs = 0, len_mask = 0x80;
     uint64_t len;
 
@@ -130,6 +214,14 @@ uint64_t ebml_read_uint(stream_t *s)
     if (len == EBML_UINT_INVALID || len > 8)
         return EBML_UINT_INVALID;
 
+    uint8_t *data = peek_buffer(s, len);
+    if (data) {
+        s->buf_pos += len;
+        while (len--)
+            value = (value << 8) | *data++;
+        return value;
+    }
+
     while (len--)
         value = (value << 8) | stream_read_char(s);
 
@@ -234,59 +326,6 @@ int ebml_resync_cluster(struct mp_log *log, stream_t *s)
 struct generic;
 #define generic_struct struct generic
 
-static uint32_t ebml_parse_id(uint8_t *data, size_t data_len, int *length)
-{
-    *length = -1;
-    uint8_t *end = data + data_len;
-    if (data == end)
-        return EBML_ID_INVALID;
-    int len = 1;
-    uint32_t id = *data++;
-    for (int len_mask = 0x80; !(id & len_mask); len_mask >>= 1) {
-        len++;
-        if (len > 4)
-            return EBML_ID_INVALID;
-    }
-    *length = len;
-    while (--len && data < end)
-        id = (id << 8) | *data++;
-    return id;
-}
-
-static uint64_t ebml_parse_length(uint8_t *data, size_t data_len, int *length)
-{
-    *length = -1;
-    uint8_t *end = data + data_len;
-    if (data == end)
-        return -1;
-    uint64_t r = *data++;
-    int len = 1;
-    int len_mask;
-    for (len_mask = 0x80; !(r & len_mask); len_mask >>= 1) {
-        len++;
-        if (len > 8)
-            return -1;
-    }
-    r &= len_mask - 1;
-
-    int num_allones = 0;
-    if (r == len_mask - 1)
-        num_allones++;
-    for (int i = 1; i < len; i++) {
-        if (data == end)
-            return -1;
-        if (*data == 255)
-            num_allones++;
-        r = (r << 8) | *data++;
-    }
-    // According to Matroska specs this means "unknown length"
-    // Could be supported if there are any actual files using it
-    if (num_allones == len)
-        return -1;
-    *length = len;
-    return r;
-}
-
 static uint64_t ebml_parse_uint(uint8_t *data, int length)
 {
     assert(length >= 0 && length <= 8);
@@ -19,32 +19,141 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
 #include <libavutil/intreadwrite.h>
 
 #include "config.h"
 
+#if HAVE_LZ4
+#include <lz4.h>
+#endif
+
 #include "common/av_common.h"
 #include "common/common.h"
 
 #include "packet.h"
 
+// Size classes for pooled payload buffers are powers of 2 between these (the
+// sizes include AV_INPUT_BUFFER_PADDING_SIZE). Larger packets are allocated
+// normally - they're rare enough that malloc overhead doesn't matter.
+#define POOL_MIN_BUF_SHIFT 8
+#define POOL_MAX_BUF_SHIFT 16
+#define POOL_NUM_BUF_CLASSES (POOL_MAX_BUF_SHIFT - POOL_MIN_BUF_SHIFT + 1)
+
+// Maximum number of unused packet structs kept around. Having more than this
+// is unlikely with steady demuxing, and would only happen after flushing.
+#define POOL_MAX_PACKETS 1024
+
+struct demux_packet_pool {
+    pthread_mutex_t lock;
+    // --- protected by lock
+    struct demux_packet *packets;   // free list, linked with dp->next
+    int num_packets;
+    // --- immutable (AVBufferPool is thread-safe)
+    AVBufferPool *buffers[POOL_NUM_BUF_CLASSES];
+};
+
 static void packet_destroy(void *ptr)
 {
     struct demux_packet *dp = ptr;
     av_packet_unref(dp->avpacket);
 }
 
-// This actually preserves only data and side data, not PTS/DTS/pos/etc.
-// It also allows avpkt->data==NULL with avpkt->size!=0 - the libavcodec API
-// does not allow it, but we do it to simplify new_demux_packet().
-struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
+static void pool_destroy(void *ptr)
 {
-    if (avpkt->size > 1000000000)
+    struct demux_packet_pool *pool = ptr;
+    struct demux_packet *dp = pool->packets;
+    while (dp) {
+        struct demux_packet *next = dp->next;
+        talloc_free(dp);
+        dp = next;
+    }
+    // Buffers still referenced by packets are freed when they are released.
+    for (int n = 0; n < POOL_NUM_BUF_CLASSES; n++)
+        av_buffer_pool_uninit(&pool->buffers[n]);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+// Create a pool of packet structs and payload buffers, which can be passed to
+// new_demux_packet*() functions. The pool is thread-safe. Packets allocated
+// from it can outlive it.
+struct demux_packet_pool *demux_packet_pool_create(void *ta_parent)
+{
+    struct demux_packet_pool *pool = talloc_zero(ta_parent, struct demux_packet_pool);
+    pthread_mutex_init(&pool->lock, NULL);
+    talloc_set_destructor(pool, pool_destroy);
+    for (int n = 0; n < POOL_NUM_BUF_CLASSES; n++) {
+        pool->buffers[n] = av_buffer_pool_init(1 << (n + POOL_MIN_BUF_SHIFT), NULL);
+        if (!pool->buffers[n])
+            abort();
+    }
+    return pool;
+}
+
+// Return the packet to the pool for reuse (or free it if there are too many
+// unused packets). If pool is NULL, this is like free_demux_packet(). The
+// packet must not be referenced anymore, and must not have a talloc parent.
+void demux_packet_pool_push(struct demux_packet_pool *pool,
+                            struct demux_packet *dp)
+{
+    if (!dp)
+        return;
+    if (!pool || !dp->avpacket) {
+        talloc_free(dp);
+        return;
+    }
+    av_packet_unref(dp->avpacket);
+    pthread_mutex_lock(&pool->lock);
+    if (pool->num_packets < POOL_MAX_PACKETS) {
+        dp->next = pool->packets;
+        pool->packets = dp;
+        pool->num_packets++;
+        dp = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    talloc_free(dp);
+}
+
+static struct demux_packet *pool_pop(struct demux_packet_pool *pool)
+{
+    struct demux_packet *dp = NULL;
+    if (pool) {
+        pthread_mutex_lock(&pool->lock);
+        dp = pool->packets;
+        if (dp) {
+            pool->packets = dp->next;
+            pool->num_packets--;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return dp;
+}
+
+// Return a pooled buffer with at least the given size, or NULL.
+static AVBufferRef *pool_get_buffer(struct demux_packet_pool *pool, size_t size)
+{
+    if (!pool)
         return NULL;
-    struct demux_packet *dp = talloc(NULL, struct demux_packet);
-    talloc_set_destructor(dp, packet_destroy);
+    for (int n = 0; n < POOL_NUM_BUF_CLASSES; n++) {
+        if (size <= (1 << (n + POOL_MIN_BUF_SHIFT)))
+            return av_buffer_pool_get(pool->buffers[n]);
+    }
+    return NULL;
+}
+
+// Allocate a packet struct with no data (unset fields are reset).
+static struct demux_packet *packet_alloc(struct demux_packet_pool *pool)
+{
+    struct demux_packet *dp = pool_pop(pool);
+    AVPacket *avpacket = dp ? dp->avpacket : NULL;
+    if (!dp) {
+        dp = talloc(NULL, struct demux_packet);
+        talloc_set_destructor(dp, packet_destroy);
+        avpacket = talloc_zero(dp, AVPacket);
+    }
     *dp = (struct demux_packet) {
         .pts = MP_NOPTS_VALUE,
         .dts = MP_NOPTS_VALUE,
@@ -53,17 +162,40 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
         .start = MP_NOPTS_VALUE,
         .end = MP_NOPTS_VALUE,
         .stream = -1,
-        .avpacket = talloc_zero(dp, AVPacket),
+        .avpacket = avpacket,
         .kf_seek_pts = MP_NOPTS_VALUE,
     };
     av_init_packet(dp->avpacket);
+    return dp;
+}
+
+// This actually preserves only data and side data, not PTS/DTS/pos/etc.
+// It also allows avpkt->data==NULL with avpkt->size!=0 - the libavcodec API
+// does not allow it, but we do it to simplify new_demux_packet().
+// pool can be NULL (applies to all new_demux_packet*() functions).
+struct demux_packet *new_demux_packet_from_avpacket(struct demux_packet_pool *pool,
+                                                    struct AVPacket *avpkt)
+{
+    if (avpkt->size > 1000000000)
+        return NULL;
+    struct demux_packet *dp = packet_alloc(pool);
     int r = -1;
     if (avpkt->data) {
         // We hope that this function won't need/access AVPacket input padding,
         // because otherwise new_demux_packet_from() wouldn't work.
         r = av_packet_ref(dp->avpacket, avpkt);
     } else {
-        r = av_new_packet(dp->avpacket, avpkt->size);
+        AVBufferRef *buf =
+            pool_get_buffer(pool, avpkt->size + (size_t)AV_INPUT_BUFFER_PADDING_SIZE);
+        if (buf) {
+            dp->avpacket->buf = buf;
+            dp->avpacket->data = buf->data;
+            dp->avpacket->size = avpkt->size;
+            memset(buf->data + avpkt->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+            r = 0;
+        } else {
+            r = av_new_packet(dp->avpacket, avpkt->size);
+        }
     }
     if (r < 0) {
         *dp->avpacket = (AVPacket){0};
@@ -76,31 +208,33 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
 }
 
 // (buf must include proper padding)
-struct demux_packet *new_demux_packet_from_buf(struct AVBufferRef *buf)
+struct demux_packet *new_demux_packet_from_buf(struct demux_packet_pool *pool,
+                                               struct AVBufferRef *buf)
 {
     AVPacket pkt = {
         .size = buf->size,
         .data = buf->data,
         .buf = buf,
     };
-    return new_demux_packet_from_avpacket(&pkt);
+    return new_demux_packet_from_avpacket(pool, &pkt);
 }
 
 // Input data doesn't need to be padded.
-struct demux_packet *new_demux_packet_from(void *data, size_t len)
+struct demux_packet *new_demux_packet_from(struct demux_packet_pool *pool,
+                                           void *data, size_t len)
 {
-    if (len > INT_MAX)
-        return NULL;
-    AVPacket pkt = { .data = data, .size = len };
-    return new_demux_packet_from_avpacket(&pkt);
+    struct demux_packet *dp = new_demux_packet(pool, len);
+    if (dp && len)
+        memcpy(dp->buffer, data, len);
+    return dp;
 }
 
-struct demux_packet *new_demux_packet(size_t len)
+struct demux_packet *new_demux_packet(struct demux_packet_pool *pool, size_t len)
 {
     if (len > INT_MAX)
         return NULL;
     AVPacket pkt = { .data = NULL, .size = len };
-    return new_demux_packet_from_avpacket(&pkt);
+    return new_demux_packet_from_avpacket(pool, &pkt);
 }
 
 void demux_packet_shorten(struct demux_packet *dp, size_t len)
@@ -129,14 +263,36 @@ void demux_packet_copy_attribs(struct demux_packet *dst, struct demux_packet *sr
     dst->stream = src->stream;
 }
 
+static struct demux_packet *copy_compressed_packet(struct demux_packet *dp)
+{
+#if HAVE_LZ4
+    struct demux_packet *new = new_demux_packet(NULL, dp->len);
+    if (!new)
+        return NULL;
+    if (av_packet_copy_props(new->avpacket, dp->avpacket) < 0 ||
+        LZ4_decompress_safe((const char *)dp->buffer, (char *)new->buffer,
+                            dp->avpacket->size, dp->len) != dp->len)
+    {
+        talloc_free(new);
+        return NULL;
+    }
+    return new;
+#else
+    return NULL;
+#endif
+}
+
+// The copy is never compressed.
 struct demux_packet *demux_copy_packet(struct demux_packet *dp)
 {
     struct demux_packet *new = NULL;
-    if (dp->avpacket) {
-        new = new_demux_packet_from_avpacket(dp->avpacket);
+    if (dp->compressed) {
+        new = copy_compressed_packet(dp);
+    } else if (dp->avpacket) {
+        new = new_demux_packet_from_avpacket(NULL, dp->avpacket);
     } else {
         // Some packets might be not created by new_demux_packet*().
-        new = new_demux_packet_from(dp->buffer, dp->len);
+        new = new_demux_packet_from(NULL, dp->buffer, dp->len);
     }
     if (!new)
         return NULL;
@@ -157,7 +313,7 @@ struct demux_packet *demux_copy_packet(struct demux_packet *dp)
 size_t demux_packet_estimate_total_size(struct demux_packet *dp)
 {
     size_t size = ROUND_ALLOC(sizeof(struct demux_packet));
-    size += ROUND_ALLOC(dp->len);
+    size += ROUND_ALLOC(dp->compressed ? dp->avpacket->size : dp->len);
     if (dp->avpacket) {
         size += ROUND_ALLOC(sizeof(AVPacket));
         size += ROUND_ALLOC(sizeof(AVBufferRef));
@@ -170,6 +326,40 @@ size_t demux_packet_estimate_total_size(struct demux_packet *dp)
     return size;
 }
 
+// Replace the packet data with a LZ4 compressed version, if that saves a
+// useful amount of memory. The packet data must not be referenced by anything
+// else that expects it to be unchanged (demux_copy_packet() is fine, as it
+// decompresses the data). Returns whether the packet was compressed.
+bool demux_packet_compress(struct demux_packet *dp)
+{
+#if HAVE_LZ4
+    if (dp->compressed || dp->incompressible || !dp->avpacket || !dp->len)
+        return false;
+    AVBufferRef *buf = NULL;
+    int bound = LZ4_compressBound(dp->len);
+    if (bound <= 0 || av_buffer_realloc(&buf, bound) < 0)
+        return false;
+    int size = LZ4_compress_default((const char *)dp->buffer, (char *)buf->data,
+                                    dp->len, bound);
+    // Not worth the decompression cost if less than 1/8 is saved.
+    if (size <= 0 || size > dp->len - dp->len / 8) {
+        av_buffer_unref(&buf);
+        dp->incompressible = true;
+        return false;
+    }
+    av_buffer_realloc(&buf, size); // shrink; keeps the old buffer on failure
+    av_buffer_unref(&dp->avpacket->buf);
+    dp->avpacket->buf = buf;
+    dp->avpacket->data = buf->data;
+    dp->avpacket->size = size;
+    dp->buffer = buf->data;
+    dp->compressed = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
 int demux_packet_set_padding(struct demux_packet *dp, int start, int end)
 {
 #if LIBAVCODEC_VERSION_MICRO >= 100
@@ -204,3 +394,89 @@ int demux_packet_add_blockadditional(struct demux_packet *dp, uint64_t id,
 #endif
     return 0;
 }
+
+// On-disk representation of a packet (followed by side data and the payload).
+// Uses the native byte order; only used for local cache files.
+struct packet_file_header {
+    int32_t stream;
+    int32_t len;
+    int32_t keyframe;
+    int32_t num_side_data;
+    double pts, dts, duration;
+    int64_t pos;
+};
+
+struct packet_file_side_data {
+    int32_t type;
+    int32_t size;
+};
+
+// Write the packet's data, side data and basic attributes to f. This does not
+// include segmentation information. Returns success.
+bool demux_packet_write(struct demux_packet *dp, FILE *f)
+{
+    if (dp->compressed) {
+        struct demux_packet *copy = demux_copy_packet(dp);
+        bool ok = copy && demux_packet_write(copy, f);
+        talloc_free(copy);
+        return ok;
+    }
+
+    AVPacket *avpkt = dp->avpacket;
+    struct packet_file_header hdr = {
+        .stream = dp->stream,
+        .len = dp->len,
+        .keyframe = dp->keyframe,
+        .num_side_data = avpkt ? avpkt->side_data_elems : 0,
+        .pts = dp->pts,
+        .dts = dp->dts,
+        .duration = dp->duration,
+        .pos = dp->pos,
+    };
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+        return false;
+    for (int n = 0; n < hdr.num_side_data; n++) {
+        AVPacketSideData *sd = &avpkt->side_data[n];
+        struct packet_file_side_data sdhdr = {sd->type, sd->size};
+        if (fwrite(&sdhdr, sizeof(sdhdr), 1, f) != 1 ||
+            (sd->size && fwrite(sd->data, sd->size, 1, f) != 1))
+            return false;
+    }
+    return !dp->len || fwrite(dp->buffer, dp->len, 1, f) == 1;
+}
+
+// Read a packet written by demux_packet_write(). Returns NULL on EOF or error.
+// The stream field is set to the written stream index.
+struct demux_packet *demux_packet_read(struct demux_packet_pool *pool, FILE *f)
+{
+    struct packet_file_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1)
+        return NULL;
+    if (hdr.len < 0 || hdr.num_side_data < 0 || hdr.num_side_data > 100)
+        return NULL;
+    struct demux_packet *dp = new_demux_packet(pool, hdr.len);
+    if (!dp)
+        return NULL;
+    for (int n = 0; n < hdr.num_side_data; n++) {
+        struct packet_file_side_data sdhdr;
+        if (fread(&sdhdr, sizeof(sdhdr), 1, f) != 1 || sdhdr.size < 0)
+            goto error;
+        uint8_t *sd = av_packet_new_side_data(dp->avpacket, sdhdr.type,
+                                              sdhdr.size);
+        if (!sd || (sdhdr.size && fread(sd, sdhdr.size, 1, f) != 1))
+            goto error;
+    }
+    if (hdr.len && fread(dp->buffer, hdr.len, 1, f) != 1)
+        goto error;
+    dp->stream = hdr.stream;
+    dp->keyframe = hdr.keyframe;
+    dp->pts = hdr.pts;
+    dp->dts = hdr.dts;
+    dp->duration = hdr.duration;
+    dp->pos = hdr.pos;
+    return dp;
+
+error:
+    talloc_free(dp);
+    return NULL;
+}
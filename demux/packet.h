@@ -20,6 +20,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <inttypes.h>
 
 // Holds one packet/frame/whatever
@@ -44,21 +45,35 @@ typedef struct demux_packet {
     struct demux_packet *next;
     struct AVPacket *avpacket;   // keep the buffer allocation and sidedata
     double kf_seek_pts; // demux.c internal: seek pts for keyframe range
+    bool compressed;    // buffer is LZ4 compressed (len is the original size)
+    bool incompressible; // demux_packet_compress() failed before
 } demux_packet_t;
 
 struct AVBufferRef;
+struct demux_packet_pool;
 
-struct demux_packet *new_demux_packet(size_t len);
-struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt);
-struct demux_packet *new_demux_packet_from(void *data, size_t len);
-struct demux_packet *new_demux_packet_from_buf(struct AVBufferRef *buf);
+struct demux_packet_pool *demux_packet_pool_create(void *ta_parent);
+void demux_packet_pool_push(struct demux_packet_pool *pool,
+                            struct demux_packet *dp);
+
+struct demux_packet *new_demux_packet(struct demux_packet_pool *pool, size_t len);
+struct demux_packet *new_demux_packet_from_avpacket(struct demux_packet_pool *pool,
+                                                    struct AVPacket *avpkt);
+struct demux_packet *new_demux_packet_from(struct demux_packet_pool *pool,
+                                           void *data, size_t len);
+struct demux_packet *new_demux_packet_from_buf(struct demux_packet_pool *pool,
+                                               struct AVBufferRef *buf);
 void demux_packet_shorten(struct demux_packet *dp, size_t len);
 void free_demux_packet(struct demux_packet *dp);
 struct demux_packet *demux_copy_packet(struct demux_packet *dp);
 size_t demux_packet_estimate_total_size(struct demux_packet *dp);
+bool demux_packet_compress(struct demux_packet *dp);
 
 void demux_packet_copy_attribs(struct demux_packet *dst, struct demux_packet *src);
 
+bool demux_packet_write(struct demux_packet *dp, FILE *f);
+struct demux_packet *demux_packet_read(struct demux_packet_pool *pool, FILE *f);
+
 int demux_packet_set_padding(struct demux_packet *dp, int start, int end);
 int demux_packet_add_blockadditional(struct demux_packet *dp, uint64_t id,
                                      void *data, size_t size);
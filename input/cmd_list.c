@@ -133,6 +133,8 @@ const struct mp_cmd_def mp_cmds[] = {
                       {"window", 1},
                       {"subtitles", 2})),
   }},
+  { MP_CMD_PREVIEW, "preview", { ARG_TIME, OARG_INT(0), OARG_INT(0) } },
+  { MP_CMD_PREVIEW_RAW, "preview-raw", },
   { MP_CMD_LOADFILE, "loadfile", {
       ARG_STRING,
       OARG_CHOICE(0, ({"replace", 0},
@@ -212,6 +214,8 @@ const struct mp_cmd_def mp_cmds[] = {
 
   { MP_CMD_WRITE_WATCH_LATER_CONFIG, "write-watch-later-config", },
 
+  { MP_CMD_DUMP_FRAME_TIMINGS, "dump-frame-timings", { ARG_STRING } },
+
   { MP_CMD_HOOK_ADD, "hook-add", { ARG_STRING, ARG_INT, ARG_INT } },
   { MP_CMD_HOOK_ACK, "hook-ack", { ARG_STRING } },
 
@@ -49,6 +49,8 @@ enum mp_command_type {
     MP_CMD_SCREENSHOT,
     MP_CMD_SCREENSHOT_TO_FILE,
     MP_CMD_SCREENSHOT_RAW,
+    MP_CMD_PREVIEW,
+    MP_CMD_PREVIEW_RAW,
     MP_CMD_LOADFILE,
     MP_CMD_LOADLIST,
     MP_CMD_PLAYLIST_CLEAR,
@@ -110,6 +112,8 @@ enum mp_command_type {
 
     MP_CMD_WRITE_WATCH_LATER_CONFIG,
 
+    MP_CMD_DUMP_FRAME_TIMINGS,
+
     MP_CMD_HOOK_ADD,
     MP_CMD_HOOK_ACK,
 
@@ -70,6 +70,8 @@ struct cmd_bind {
     char *location;     // filename/line number of definition
     bool is_builtin;
     struct cmd_bind_section *owner;
+    struct mp_cmd *parsed;  // cmd, parsed on first use (copied on dispatch)
+    bool parse_failed;
 };
 
 struct cmd_bind_section {
@@ -474,7 +476,12 @@ static mp_cmd_t *get_cmd_from_keys(struct input_ctx *ictx, char *force_section,
         talloc_free(key_buf);
         return NULL;
     }
-    mp_cmd_t *ret = mp_input_parse_cmd(ictx, bstr0(cmd->cmd), cmd->location);
+    if (!cmd->parsed && !cmd->parse_failed) {
+        cmd->parsed = mp_input_parse_cmd(ictx, bstr0(cmd->cmd), cmd->location);
+        cmd->parse_failed = !cmd->parsed;
+        talloc_steal(cmd->owner->binds, cmd->parsed);
+    }
+    mp_cmd_t *ret = mp_cmd_clone(cmd->parsed);
     if (ret) {
         ret->input_section = cmd->owner->section;
         ret->key_name = talloc_steal(ret, mp_input_get_key_combo_name(&code, 1));
@@ -1092,6 +1099,7 @@ static void bind_dealloc(struct cmd_bind *bind)
 {
     talloc_free(bind->cmd);
     talloc_free(bind->location);
+    talloc_free(bind->parsed);
 }
 
 // builtin: if true, remove all builtin binds, else remove all user binds
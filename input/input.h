@@ -277,4 +277,23 @@ char *mp_json_encode_event(struct mpv_event *event);
 struct mpv_handle;
 char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
 
+// Encoding of the IPC protocol. This is a per-connection setting, and can be
+// switched with the "set_encoding" command.
+enum mp_ipc_encoding {
+    MP_IPC_ENC_JSON,        // newline-separated JSON (or text commands)
+    MP_IPC_ENC_MSGPACK,     // MessagePack values, without separators
+};
+
+// Like mp_ipc_consume_next_command(), but for the given encoding. The reply
+// (if any) is returned in *out, allocated with ctx. *encoding is updated if
+// the command changes it.
+// Returns 1 if a message was consumed, 0 if buf doesn't contain a complete
+// message yet, <0 on invalid data (the connection can't be recovered).
+int mp_ipc_consume_next_message(struct mpv_handle *client, void *ctx, bstr *buf,
+                                int *encoding, bstr *out);
+
+// Serialize the given mpv_event for the given encoding.
+bstr mp_ipc_encode_event(void *ta_parent, struct mpv_event *event,
+                         int encoding);
+
 #endif /* MPLAYER_INPUT_H */
@@ -48,6 +48,7 @@ struct mp_ipc_ctx {
     struct mp_log *log;
     struct mp_client_api *client_api;
     const char *path;
+    char *input_file;
 
     pthread_t thread;
     int death_pipe[2];
@@ -60,13 +61,31 @@ struct client_arg {
     char *client_name;
     int client_fd;
     bool close_client_fd;
+    int wakeup_fd;
 
     bool writable;
+    int encoding;           // enum mp_ipc_encoding
+    bstr client_msg;        // buffered incoming data
 };
 
-static int ipc_write_str(struct client_arg *client, const char *buf)
+// All clients are served by a single thread, which polls the sockets and the
+// wakeup pipes of all clients.
+struct ipc_loop {
+    struct mp_log *log;
+    struct mp_client_api *client_api;
+
+    int listen_fd;          // -1 if not accepting new clients
+    int death_fd;           // -1 if not stoppable (see leftover_thread())
+    int client_num;
+
+    struct client_arg **clients;
+    int num_clients;
+};
+
+static int ipc_write(struct client_arg *client, bstr data)
 {
-    size_t count = strlen(buf);
+    const char *buf = data.start;
+    size_t count = data.len;
     while (count > 0) {
         ssize_t rc = send(client->client_fd, buf, count, MSG_NOSIGNAL);
         if (rc <= 0) {
@@ -78,7 +97,14 @@ static int ipc_write_str(struct client_arg *client, const char *buf)
                 return 0;
             }
 
-            if (errno == EINTR || errno == EAGAIN)
+            if (errno == EAGAIN) {
+                // The fd is non-blocking, but we have to finish the message.
+                struct pollfd fd = {.events = POLLOUT, .fd = client->client_fd};
+                poll(&fd, 1, -1);
+                continue;
+            }
+
+            if (errno == EINTR)
                 continue;
 
             return rc;
@@ -91,144 +117,130 @@ static int ipc_write_str(struct client_arg *client, const char *buf)
     return 0;
 }
 
-static void *client_thread(void *p)
+static void destroy_client(struct client_arg *arg)
 {
-    pthread_detach(pthread_self());
-
-    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
-    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
-    sigfillset(&sa.sa_mask);
-    sigaction(SIGPIPE, &sa, NULL);
-
-    int rc;
+    if (arg->client_msg.len > 0)
+        MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
+    talloc_free(arg->client_msg.start);
+    if (arg->close_client_fd)
+        close(arg->client_fd);
+    mpv_detach_destroy(arg->client);
+    talloc_free(arg);
+}
 
-    struct client_arg *arg = p;
-    bstr client_msg = { talloc_strdup(NULL, ""), 0 };
+// Send pending events to the client. Returns false if the client is done.
+static bool client_send_events(struct client_arg *arg)
+{
+    mp_flush_wakeup_pipe(arg->wakeup_fd);
 
-    mpthread_set_name(arg->client_name);
+    while (1) {
+        mpv_event *event = mpv_wait_event(arg->client, 0);
 
-    int pipe_fd = mpv_get_wakeup_pipe(arg->client);
-    if (pipe_fd < 0) {
-        MP_ERR(arg, "Could not get wakeup pipe\n");
-        goto done;
-    }
+        if (event->event_id == MPV_EVENT_NONE)
+            return true;
 
-    MP_VERBOSE(arg, "Client connected\n");
+        if (event->event_id == MPV_EVENT_SHUTDOWN)
+            return false;
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = pipe_fd},
-        {.events = POLLIN, .fd = arg->client_fd},
-    };
+        if (!arg->writable)
+            continue;
 
-    fcntl(arg->client_fd, F_SETFL, fcntl(arg->client_fd, F_GETFL, 0) | O_NONBLOCK);
+        bstr event_msg = mp_ipc_encode_event(NULL, event, arg->encoding);
+        if (!event_msg.len) {
+            MP_ERR(arg, "Encoding error\n");
+            return false;
+        }
 
-    while (1) {
-        rc = poll(fds, 2, 0);
-        if (rc == 0)
-            rc = poll(fds, 2, -1);
+        int rc = ipc_write(arg, event_msg);
+        talloc_free(event_msg.start);
         if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
-            continue;
+            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+            return false;
         }
+    }
+}
 
-        if (fds[0].revents & POLLIN) {
-            mp_flush_wakeup_pipe(pipe_fd);
+// Read and execute commands. Returns false if the client is done.
+static bool client_read_commands(struct client_arg *arg)
+{
+    while (1) {
+        char buf[4096];
+        bstr append = { buf, 0 };
+
+        ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
+        if (bytes < 0) {
+            if (errno == EAGAIN)
+                return true;
+            if (errno == EINTR)
+                continue;
 
-            while (1) {
-                mpv_event *event = mpv_wait_event(arg->client, 0);
+            MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
+            return false;
+        }
 
-                if (event->event_id == MPV_EVENT_NONE)
-                    break;
+        if (bytes == 0) {
+            MP_VERBOSE(arg, "Client disconnected\n");
+            return false;
+        }
 
-                if (event->event_id == MPV_EVENT_SHUTDOWN)
-                    goto done;
+        append.len = bytes;
 
-                if (!arg->writable)
-                    continue;
+        bstr_xappend(NULL, &arg->client_msg, append);
 
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
-                    MP_ERR(arg, "Encoding error\n");
-                    goto done;
-                }
+        while (1) {
+            bstr reply_msg;
+            int r = mp_ipc_consume_next_message(arg->client, NULL,
+                            &arg->client_msg, &arg->encoding, &reply_msg);
+            if (r < 0) {
+                MP_ERR(arg, "Invalid message received\n");
+                return false;
+            }
+            if (r == 0)
+                break;
 
-                rc = ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
+            if (reply_msg.len && arg->writable) {
+                int rc = ipc_write(arg, reply_msg);
                 if (rc < 0) {
                     MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                    goto done;
+                    talloc_free(reply_msg.start);
+                    return false;
                 }
             }
-        }
-
-        if (fds[1].revents & (POLLIN | POLLHUP)) {
-            while (1) {
-                char buf[128];
-                bstr append = { buf, 0 };
-
-                ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
-                if (bytes < 0) {
-                    if (errno == EAGAIN)
-                        break;
-
-                    MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
-
-                if (bytes == 0) {
-                    MP_VERBOSE(arg, "Client disconnected\n");
-                    goto done;
-                }
-
-                append.len = bytes;
-
-                bstr_xappend(NULL, &client_msg, append);
 
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
-
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
-                        if (rc < 0) {
-                            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
-                            goto done;
-                        }
-                    }
-
-                    talloc_free(reply_msg);
-                }
-            }
+            talloc_free(reply_msg.start);
         }
     }
-
-done:
-    if (client_msg.len > 0)
-        MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
-    talloc_free(client_msg.start);
-    if (arg->close_client_fd)
-        close(arg->client_fd);
-    mpv_detach_destroy(arg->client);
-    talloc_free(arg);
-    return NULL;
 }
 
-static void ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
+static void ipc_start_client(struct ipc_loop *loop, struct client_arg *client)
 {
-    client->client = mp_new_client(ctx->client_api, client->client_name),
-    client->log    = mp_client_get_log(client->client);
-
-    pthread_t client_thr;
-    if (pthread_create(&client_thr, NULL, client_thread, client)) {
+    client->client = mp_new_client(loop->client_api, client->client_name);
+    if (!client->client)
+        goto error;
+    client->log = mp_client_get_log(client->client);
+
+    client->wakeup_fd = mpv_get_wakeup_pipe(client->client);
+    if (client->wakeup_fd < 0) {
+        MP_ERR(client, "Could not get wakeup pipe\n");
         mpv_detach_destroy(client->client);
-        if (client->close_client_fd)
-            close(client->client_fd);
-        talloc_free(client);
+        goto error;
     }
+
+    fcntl(client->client_fd, F_SETFL,
+          fcntl(client->client_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    MP_VERBOSE(client, "Client connected\n");
+
+    MP_TARRAY_APPEND(loop, loop->clients, loop->num_clients, client);
+    return;
+
+error:
+    if (client->close_client_fd)
+        close(client->client_fd);
+    talloc_free(client);
 }
 
-static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd)
+static void ipc_start_client_json(struct ipc_loop *loop, int id, int fd)
 {
     struct client_arg *client = talloc_ptrtype(NULL, client);
     *client = (struct client_arg){
@@ -239,10 +251,10 @@ static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd)
         .writable = true,
     };
 
-    ipc_start_client(ctx, client);
+    ipc_start_client(loop, client);
 }
 
-static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
+static void ipc_start_client_text(struct ipc_loop *loop, const char *path)
 {
     int mode = O_RDONLY;
     int client_fd = -1;
@@ -256,7 +268,7 @@ static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
         char *end = NULL;
         client_fd = strtol(path + 5, &end, 0);
         if (!end || end == path + 5 || end[0]) {
-            MP_ERR(ctx, "Invalid FD: %s\n", path);
+            MP_ERR(loop, "Invalid FD: %s\n", path);
             return;
         }
         close_client_fd = false;
@@ -269,7 +281,7 @@ static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
         client_fd = open(path, mode);
     }
     if (client_fd < 0) {
-        MP_ERR(ctx, "Could not open '%s'\n", path);
+        MP_ERR(loop, "Could not open '%s'\n", path);
         return;
     }
 
@@ -281,26 +293,102 @@ static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
         .writable = writable,
     };
 
-    ipc_start_client(ctx, client);
+    ipc_start_client(loop, client);
 }
 
-static void *ipc_thread(void *p)
+// Run until the death pipe is signaled (returns true), or until there is
+// nothing left to serve (returns false).
+static bool run_loop(struct ipc_loop *loop)
 {
-    int rc;
+    struct pollfd *fds = NULL;
+    int num_fds = 0;
+
+    while (loop->num_clients || loop->listen_fd >= 0) {
+        num_fds = 0;
+        MP_TARRAY_GROW(loop, fds, 2 + loop->num_clients * 2);
+        fds[num_fds++] = (struct pollfd){.events = POLLIN, .fd = loop->death_fd};
+        fds[num_fds++] = (struct pollfd){.events = POLLIN, .fd = loop->listen_fd};
+        for (int n = 0; n < loop->num_clients; n++) {
+            struct client_arg *client = loop->clients[n];
+            fds[num_fds++] =
+                (struct pollfd){.events = POLLIN, .fd = client->wakeup_fd};
+            fds[num_fds++] =
+                (struct pollfd){.events = POLLIN, .fd = client->client_fd};
+        }
 
-    int ipc_fd;
-    struct sockaddr_un ipc_un = {0};
+        // (poll() ignores negative fds.)
+        int rc = poll(fds, num_fds, -1);
+        if (rc < 0) {
+            if (errno != EINTR)
+                MP_ERR(loop, "Poll error\n");
+            continue;
+        }
 
-    struct mp_ipc_ctx *arg = p;
+        if (fds[0].revents & POLLIN) {
+            talloc_free(fds);
+            return true;
+        }
 
-    mpthread_set_name("ipc socket listener");
+        // Iterate backwards, so that removing clients doesn't affect the
+        // indexes of clients not processed yet. New clients are appended
+        // after this.
+        for (int n = loop->num_clients - 1; n >= 0; n--) {
+            struct client_arg *client = loop->clients[n];
+            struct pollfd *cfds = &fds[2 + n * 2];
+            bool ok = true;
+            if (cfds[0].revents & POLLIN)
+                ok = client_send_events(client);
+            if (ok && (cfds[1].revents & (POLLIN | POLLHUP | POLLERR)))
+                ok = client_read_commands(client);
+            if (!ok) {
+                destroy_client(client);
+                MP_TARRAY_REMOVE_AT(loop->clients, loop->num_clients, n);
+            }
+        }
 
-    MP_VERBOSE(arg, "Starting IPC master\n");
+        if (fds[1].revents & POLLIN) {
+            int client_fd = accept(loop->listen_fd, NULL, NULL);
+            if (client_fd < 0) {
+                MP_ERR(loop, "Could not accept IPC client\n");
+                close(loop->listen_fd);
+                loop->listen_fd = -1;
+                continue;
+            }
+
+            ipc_start_client_json(loop, loop->client_num++, client_fd);
+        }
+    }
+
+    talloc_free(fds);
+    return false;
+}
+
+// Keep serving clients that were connected when the IPC server was stopped
+// (for example by changing --input-ipc-server at runtime). They exit with
+// MPV_EVENT_SHUTDOWN or on disconnect, like before.
+static void *leftover_thread(void *p)
+{
+    struct ipc_loop *loop = p;
+
+    pthread_detach(pthread_self());
+    mpthread_set_name("ipc clients");
+
+    run_loop(loop);
+    talloc_free(loop);
+    return NULL;
+}
+
+static int create_listen_socket(struct mp_ipc_ctx *arg)
+{
+    int rc;
+
+    int ipc_fd;
+    struct sockaddr_un ipc_un = {0};
 
     ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (ipc_fd < 0) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
 #if HAVE_FCHMOD
@@ -310,7 +398,7 @@ static void *ipc_thread(void *p)
     size_t path_len = strlen(arg->path);
     if (path_len >= sizeof(ipc_un.sun_path) - 1) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     ipc_un.sun_family = AF_UNIX,
@@ -327,49 +415,73 @@ static void *ipc_thread(void *p)
     rc = bind(ipc_fd, (struct sockaddr *) &ipc_un, addr_len);
     if (rc < 0) {
         MP_ERR(arg, "Could not bind IPC socket\n");
-        goto done;
+        goto error;
     }
 
     rc = listen(ipc_fd, 10);
     if (rc < 0) {
         MP_ERR(arg, "Could not listen on IPC socket\n");
-        goto done;
+        goto error;
     }
 
     MP_VERBOSE(arg, "Listening to IPC socket.\n");
 
-    int client_num = 0;
+    return ipc_fd;
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = arg->death_pipe[0]},
-        {.events = POLLIN, .fd = ipc_fd},
-    };
+error:
+    if (ipc_fd >= 0)
+        close(ipc_fd);
+    return -1;
+}
 
-    while (1) {
-        rc = poll(fds, 2, -1);
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
-            continue;
-        }
+static void *ipc_thread(void *p)
+{
+    struct mp_ipc_ctx *arg = p;
 
-        if (fds[0].revents & POLLIN)
-            goto done;
+    mpthread_set_name("ipc");
 
-        if (fds[1].revents & POLLIN) {
-            int client_fd = accept(ipc_fd, NULL, NULL);
-            if (client_fd < 0) {
-                MP_ERR(arg, "Could not accept IPC client\n");
-                goto done;
-            }
+    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
+    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
+    sigfillset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, NULL);
 
-            ipc_start_client_json(arg, client_num++, client_fd);
-        }
+    MP_VERBOSE(arg, "Starting IPC master\n");
+
+    struct ipc_loop *loop = talloc_ptrtype(NULL, loop);
+    *loop = (struct ipc_loop){
+        .log        = arg->log,
+        .client_api = arg->client_api,
+        .listen_fd  = -1,
+        .death_fd   = arg->death_pipe[0],
+    };
+
+    if (arg->input_file)
+        ipc_start_client_text(loop, arg->input_file);
+
+    if (arg->path)
+        loop->listen_fd = create_listen_socket(arg);
+
+    if (!run_loop(loop)) {
+        // Nothing to do anymore; wait until we're told to exit.
+        struct pollfd fd = {.events = POLLIN, .fd = arg->death_pipe[0]};
+        while (poll(&fd, 1, -1) < 0 && errno == EINTR) {}
     }
 
-done:
-    if (ipc_fd >= 0)
-        close(ipc_fd);
+    if (loop->listen_fd >= 0)
+        close(loop->listen_fd);
+    loop->listen_fd = -1;
+
+    if (loop->num_clients) {
+        loop->death_fd = -1;
+        loop->log = mp_log_new(loop, arg->log, NULL);
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, leftover_thread, loop) == 0)
+            return NULL;
+        for (int n = 0; n < loop->num_clients; n++)
+            destroy_client(loop->clients[n]);
+    }
 
+    talloc_free(loop);
     return NULL;
 }
 
@@ -382,15 +494,15 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
     *arg = (struct mp_ipc_ctx){
         .log        = mp_log_new(arg, global->log, "ipc"),
         .client_api = client_api,
-        .path       = mp_get_user_path(arg, global, opts->ipc_path),
         .death_pipe = {-1, -1},
     };
+    if (opts->ipc_path && *opts->ipc_path)
+        arg->path = mp_get_user_path(arg, global, opts->ipc_path);
     char *input_file = mp_get_user_path(arg, global, opts->input_file);
-
     if (input_file && *input_file)
-        ipc_start_client_text(arg, input_file);
+        arg->input_file = input_file;
 
-    if (!opts->ipc_path || !*opts->ipc_path)
+    if (!arg->path && !arg->input_file)
         goto out;
 
     if (mp_make_wakeup_pipe(arg->death_pipe) < 0)
@@ -20,6 +20,7 @@
 #include "common/msg.h"
 #include "input/input.h"
 #include "misc/json.h"
+#include "misc/msgpack.h"
 #include "options/m_option.h"
 #include "options/options.h"
 #include "options/path.h"
@@ -193,33 +194,61 @@ char *mp_json_encode_event(mpv_event *event)
     return output;
 }
 
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+bstr mp_ipc_encode_event(void *ta_parent, struct mpv_event *event,
+                         int encoding)
+{
+    if (encoding == MP_IPC_ENC_JSON) {
+        char *output = mp_json_encode_event(event);
+        talloc_steal(ta_parent, output);
+        return bstr0(output);
+    }
+
+    void *tmp = talloc_new(NULL);
+    mpv_node event_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+    mpv_event_to_node(tmp, event, &event_node);
+    bstr output = {0};
+    msgpack_write(ta_parent, &output, &event_node);
+    talloc_free(tmp);
+    return output;
+}
+
+// Read the optional numeric argument at index n (in seconds).
+static bool get_interval_arg(mpv_node *cmd_node, int n, double *out)
+{
+    if (cmd_node->u.list->num <= n)
+        return true;
+    mpv_node *arg = &cmd_node->u.list->values[n];
+    if (arg->format == MPV_FORMAT_INT64) {
+        *out = arg->u.int64;
+    } else if (arg->format == MPV_FORMAT_DOUBLE) {
+        *out = arg->u.double_;
+    } else {
+        return false;
+    }
+    return *out >= 0;
+}
+
+// Execute the command message msg_node (NULL if it couldn't be parsed), and
+// write the reply to reply_node. *encoding is the encoding of the connection,
+// and can be changed by the command (if encoding is NULL, this is not allowed).
+static void execute_command(struct mpv_handle *client, void *ta_parent,
+                            mpv_node *msg_node, mpv_node *reply_node,
+                            int *encoding)
 {
     int rc;
     const char *cmd = NULL;
-    struct mp_log *log = mp_client_get_log(client);
 
-    mpv_node msg_node;
-    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+    *reply_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
     mpv_node *reqid_node = NULL;
 
-    rc = json_parse(ta_parent, &msg_node, &src, 50);
-    if (rc < 0) {
-        mp_err(log, "malformed JSON received: '%s'\n", src);
-        rc = MPV_ERROR_INVALID_PARAMETER;
-        goto error;
-    }
-
-    if (msg_node.format != MPV_FORMAT_NODE_MAP) {
+    if (!msg_node || msg_node->format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    reqid_node = mpv_node_map_get(&msg_node, "request_id");
+    reqid_node = mpv_node_map_get(msg_node, "request_id");
 
-    mpv_node *cmd_node = mpv_node_map_get(&msg_node, "command");
+    mpv_node *cmd_node = mpv_node_map_get(msg_node, "command");
     if (!cmd_node ||
         (cmd_node->format != MPV_FORMAT_NODE_ARRAY) ||
         !cmd_node->u.list->num)
@@ -238,15 +267,15 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
     if (!strcmp("client_name", cmd)) {
         const char *client_name = mpv_client_name(client);
-        mpv_node_map_add_string(ta_parent, &reply_node, "data", client_name);
+        mpv_node_map_add_string(ta_parent, reply_node, "data", client_name);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_time_us", cmd)) {
         int64_t time_us = mpv_get_time_us(client);
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", time_us);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", time_us);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_version", cmd)) {
         int64_t ver = mpv_client_api_version();
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", ver);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", ver);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_property", cmd)) {
         mpv_node result_node;
@@ -264,7 +293,30 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         rc = mpv_get_property(client, cmd_node->u.list->values[1].u.string,
                               MPV_FORMAT_NODE, &result_node);
         if (rc >= 0) {
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
+            mpv_free_node_contents(&result_node);
+        }
+    } else if (!strcmp("get_properties", cmd)) {
+        mpv_node result_node;
+
+        int num = cmd_node->u.list->num;
+        if (num < 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        const char **names = talloc_zero_array(ta_parent, const char *, num);
+        for (int n = 1; n < num; n++) {
+            if (cmd_node->u.list->values[n].format != MPV_FORMAT_STRING) {
+                rc = MPV_ERROR_INVALID_PARAMETER;
+                goto error;
+            }
+            names[n - 1] = cmd_node->u.list->values[n].u.string;
+        }
+
+        rc = mpv_get_properties(client, names, &result_node);
+        if (rc >= 0) {
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
             mpv_free_node_contents(&result_node);
         }
     } else if (!strcmp("get_property_string", cmd)) {
@@ -281,9 +333,9 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         char *result = mpv_get_property_string(client,
                                         cmd_node->u.list->values[1].u.string);
         if (!result) {
-            mpv_node_map_add_null(ta_parent, &reply_node, "data");
+            mpv_node_map_add_null(ta_parent, reply_node, "data");
         } else {
-            mpv_node_map_add_string(ta_parent, &reply_node, "data", result);
+            mpv_node_map_add_string(ta_parent, reply_node, "data", result);
             mpv_free(result);
         }
     } else if (!strcmp("set_property", cmd)) {
@@ -299,6 +351,18 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
         rc = mpv_set_property(client, cmd_node->u.list->values[1].u.string,
                               MPV_FORMAT_NODE, &cmd_node->u.list->values[2]);
+    } else if (!strcmp("set_properties", cmd)) {
+        if (cmd_node->u.list->num != 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_NODE_MAP) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        rc = mpv_set_properties(client, &cmd_node->u.list->values[1]);
     } else if (!strcmp("set_property_string", cmd)) {
         if (cmd_node->u.list->num != 3) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -319,7 +383,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
                                      cmd_node->u.list->values[1].u.string,
                                      cmd_node->u.list->values[2].u.string);
     } else if (!strcmp("observe_property", cmd)) {
-        if (cmd_node->u.list->num != 3) {
+        if (cmd_node->u.list->num != 3 && cmd_node->u.list->num != 4) {
             rc = MPV_ERROR_INVALID_PARAMETER;
             goto error;
         }
@@ -334,12 +398,18 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             goto error;
         }
 
-        rc = mpv_observe_property(client,
-                                  cmd_node->u.list->values[1].u.int64,
-                                  cmd_node->u.list->values[2].u.string,
-                                  MPV_FORMAT_NODE);
+        double interval = 0;
+        if (!get_interval_arg(cmd_node, 3, &interval)) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        rc = mpv_observe_property_interval(client,
+                                           cmd_node->u.list->values[1].u.int64,
+                                           cmd_node->u.list->values[2].u.string,
+                                           MPV_FORMAT_NODE, interval);
     } else if (!strcmp("observe_property_string", cmd)) {
-        if (cmd_node->u.list->num != 3) {
+        if (cmd_node->u.list->num != 3 && cmd_node->u.list->num != 4) {
             rc = MPV_ERROR_INVALID_PARAMETER;
             goto error;
         }
@@ -354,10 +424,16 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             goto error;
         }
 
-        rc = mpv_observe_property(client,
-                                  cmd_node->u.list->values[1].u.int64,
-                                  cmd_node->u.list->values[2].u.string,
-                                  MPV_FORMAT_STRING);
+        double interval = 0;
+        if (!get_interval_arg(cmd_node, 3, &interval)) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        rc = mpv_observe_property_interval(client,
+                                           cmd_node->u.list->values[1].u.int64,
+                                           cmd_node->u.list->values[2].u.string,
+                                           MPV_FORMAT_STRING, interval);
     } else if (!strcmp("unobserve_property", cmd)) {
         if (cmd_node->u.list->num != 2) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -417,12 +493,37 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             }
             rc = mpv_request_event(client, event, enable);
         }
+    } else if (!strcmp("set_encoding", cmd)) {
+        if (cmd_node->u.list->num != 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        const char *name = cmd_node->u.list->values[1].u.string;
+        int new_encoding = -1;
+        if (!strcmp(name, "json")) {
+            new_encoding = MP_IPC_ENC_JSON;
+        } else if (!strcmp(name, "msgpack")) {
+            new_encoding = MP_IPC_ENC_MSGPACK;
+        }
+        if (!encoding || new_encoding < 0) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+        // Takes effect after the reply to this command.
+        *encoding = new_encoding;
+        rc = MPV_ERROR_SUCCESS;
     } else {
         mpv_node result_node;
 
         rc = mpv_command_node(client, cmd_node, &result_node);
         if (rc >= 0)
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
     }
 
 error:
@@ -431,10 +532,29 @@ error:
      * the original requests.
      */
     if (reqid_node) {
-        mpv_node_map_add(ta_parent, &reply_node, "request_id", reqid_node);
+        mpv_node_map_add(ta_parent, reply_node, "request_id", reqid_node);
     }
 
-    mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
+    mpv_node_map_add_string(ta_parent, reply_node, "error", mpv_error_string(rc));
+}
+
+// Function is allowed to modify src[n].
+static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
+                                  char *src, int *encoding)
+{
+    struct mp_log *log = mp_client_get_log(client);
+
+    mpv_node msg_node;
+    mpv_node reply_node;
+
+    // The parsed tree is only read while executing the command.
+    void *arena = talloc_new_arena(ta_parent);
+    int rc = json_parse(arena, &msg_node, &src, 50);
+    if (rc < 0)
+        mp_err(log, "malformed JSON received: '%s'\n", src);
+
+    execute_command(client, ta_parent, rc < 0 ? NULL : &msg_node, &reply_node,
+                    encoding);
 
     char *output = talloc_strdup(ta_parent, "");
     json_write(&output, &reply_node);
@@ -450,7 +570,8 @@ static char *text_execute_command(struct mpv_handle *client, void *tmp, char *sr
     return NULL;
 }
 
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
+static char *consume_next_line(struct mpv_handle *client, void *ctx, bstr *buf,
+                               int *encoding)
 {
     void *tmp = talloc_new(NULL);
 
@@ -466,7 +587,7 @@ char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *bu
     if (line0[0] == '\0' || line0[0] == '#') {
         // skip
     } else if (line0[0] == '{') {
-        reply_msg = json_execute_command(client, tmp, line0);
+        reply_msg = json_execute_command(client, tmp, line0, encoding);
     } else {
         reply_msg = text_execute_command(client, tmp, line0);
     }
@@ -475,3 +596,42 @@ char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *bu
     talloc_free(tmp);
     return reply_msg;
 }
+
+char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
+{
+    return consume_next_line(client, ctx, buf, NULL);
+}
+
+int mp_ipc_consume_next_message(struct mpv_handle *client, void *ctx, bstr *buf,
+                                int *encoding, bstr *out)
+{
+    *out = (bstr){0};
+
+    if (*encoding == MP_IPC_ENC_JSON) {
+        if (bstrchr(*buf, '\n') < 0)
+            return 0;
+        char *reply = consume_next_line(client, ctx, buf, encoding);
+        if (reply)
+            *out = bstr0(reply);
+        return 1;
+    }
+
+    void *tmp = talloc_new(NULL);
+    mpv_node msg_node;
+    bstr rest = *buf;
+    int r = msgpack_parse(talloc_new_arena(tmp), &msg_node, &rest, 50);
+    if (r <= 0) {
+        talloc_free(tmp);
+        return r;
+    }
+    mpv_node reply_node;
+    execute_command(client, tmp, &msg_node, &reply_node, encoding);
+    msgpack_write(ctx, out, &reply_node);
+    talloc_free(tmp);
+
+    // Same memory management as with JSON lines.
+    void *old = buf->start;
+    *buf = bstrdup(NULL, rest);
+    talloc_free(old);
+    return 1;
+}
@@ -205,7 +205,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 26)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 30)
 
 /**
  * The API user is allowed to "#define MPV_ENABLE_DEPRECATED 0" before
@@ -1028,6 +1028,31 @@ char *mpv_get_property_string(mpv_handle *ctx, const char *name);
  */
 char *mpv_get_property_osd_string(mpv_handle *ctx, const char *name);
 
+/**
+ * Read the values of multiple properties at once. This is like calling
+ * mpv_get_property() with MPV_FORMAT_NODE for each name, except that all
+ * properties are read while the core is locked only once. This is more
+ * efficient, and the values are consistent with each other.
+ *
+ * @param names NULL-terminated list of property names.
+ * @param[out] result Set to a MPV_FORMAT_NODE_MAP, which maps each property
+ *                    name to its value. Properties that could not be read are
+ *                    set to MPV_FORMAT_NONE. Free with mpv_free_node_contents().
+ * @return error code
+ */
+int mpv_get_properties(mpv_handle *ctx, const char **names, mpv_node *result);
+
+/**
+ * Set multiple properties at once. This is like calling mpv_set_property()
+ * with MPV_FORMAT_NODE for each entry of the map, except that the core is
+ * locked only once. The properties are set in the order of the map entries;
+ * all of them are attempted even if setting one fails.
+ *
+ * @param props MPV_FORMAT_NODE_MAP, mapping property names to the new values.
+ * @return error code of the first property that failed, or success
+ */
+int mpv_set_properties(mpv_handle *ctx, mpv_node *props);
+
 /**
  * Get a property asynchronously. You will receive the result of the operation
  * as well as the property data with the MPV_EVENT_GET_PROPERTY_REPLY event.
@@ -1091,6 +1116,22 @@ int mpv_get_property_async(mpv_handle *ctx, uint64_t reply_userdata,
 int mpv_observe_property(mpv_handle *mpv, uint64_t reply_userdata,
                          const char *name, mpv_format format);
 
+/**
+ * Like mpv_observe_property(), but limit the rate of change events for this
+ * property. After a MPV_EVENT_PROPERTY_CHANGE event, further changes are
+ * coalesced until min_interval seconds have passed, and then reported as a
+ * single change event with the current value. The property value is not read
+ * while changes are being coalesced, which saves some work on the core for
+ * properties that change often (like "time-pos").
+ *
+ * @param min_interval Minimum time between change events in seconds. 0 is the
+ *                     same as mpv_observe_property().
+ * @return error code
+ */
+int mpv_observe_property_interval(mpv_handle *mpv, uint64_t reply_userdata,
+                                  const char *name, mpv_format format,
+                                  double min_interval);
+
 /**
  * Undo mpv_observe_property(). This will remove all observed properties for
  * which the given number was passed as reply_userdata to mpv_observe_property.
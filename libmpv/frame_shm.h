@@ -0,0 +1,118 @@
+/* Copyright (C) 2017 the mpv developers
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MPV_CLIENT_API_FRAME_SHM_H_
+#define MPV_CLIENT_API_FRAME_SHM_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Warning: this API is not stable yet.
+ *
+ * Overview
+ * --------
+ *
+ * This header describes the memory layout used by the "shm" video output
+ * driver (--vo=shm). The VO publishes every decoded frame into a ring of
+ * slots in a POSIX shared memory object (see --vo-shm-name), so that an
+ * external process can read frames without going through screenshot-raw.
+ * Frames are copied into the ring as they are, without any conversion or
+ * scaling. There is no API to call; a consumer just maps the object.
+ *
+ * Usage
+ * -----
+ *
+ * Open the object with shm_open(name, O_RDONLY, 0) and mmap() it with
+ * PROT_READ. Check magic and version. The mapping starts with
+ * mpv_frame_shm_header, followed by num_slots mpv_frame_shm_slot entries.
+ * The image data of slot n starts at data_offset + n * slot_size.
+ *
+ * The object is recreated (and the old one unlinked) if the video size or
+ * format changes, in which case the generation field of the old mapping is
+ * set to UINT32_MAX. Consumers should then close and reopen the object.
+ *
+ * Reading a frame
+ * ---------------
+ *
+ * frame_count is the number of frames published so far. The most recent frame
+ * is in slot (frame_count - 1) % num_slots. Each slot is protected with a
+ * sequence counter: it is odd while the slot is being written. To read a
+ * frame consistently:
+ *
+ *  1. load seq (with acquire semantics); if it is odd, retry later
+ *  2. copy or process the image data and the other slot fields
+ *  3. issue an acquire fence, load seq again; if it changed, the data was
+ *     overwritten while reading it, and must be discarded
+ *
+ * A consumer that is slower than the video frame rate will miss frames; it
+ * can detect this by comparing frame_num values. Increasing --vo-shm-slots
+ * gives it more time.
+ *
+ * Image format
+ * ------------
+ *
+ * pixfmt is a FFmpeg AVPixelFormat value. Planes follow the FFmpeg conventions
+ * for this format. plane_offset[] is relative to the start of the slot's image
+ * data, and is only valid for the first num_planes entries.
+ */
+
+#define MPV_FRAME_SHM_MAGIC 0x6d707666 // "mpvf"
+#define MPV_FRAME_SHM_VERSION 1
+#define MPV_FRAME_SHM_MAX_PLANES 4
+
+typedef struct mpv_frame_shm_slot {
+    /** Sequence counter; odd while the slot is written. */
+    uint64_t seq;
+    /** Index of the frame since the VO was created (starts at 0). */
+    uint64_t frame_num;
+    /** Presentation timestamp in seconds (same as the time-pos property). */
+    double pts;
+    uint32_t num_planes;
+    uint32_t reserved;
+    uint64_t plane_offset[MPV_FRAME_SHM_MAX_PLANES];
+    int32_t plane_stride[MPV_FRAME_SHM_MAX_PLANES];
+} mpv_frame_shm_slot;
+
+typedef struct mpv_frame_shm_header {
+    /** MPV_FRAME_SHM_MAGIC */
+    uint32_t magic;
+    /** MPV_FRAME_SHM_VERSION */
+    uint32_t version;
+    /** UINT32_MAX if this object was abandoned (format change or exit). */
+    uint32_t generation;
+    uint32_t num_slots;
+    /** Offset of the first slot's image data from the start of the mapping. */
+    uint64_t data_offset;
+    /** Size of a slot's image data in bytes. */
+    uint64_t slot_size;
+    /** Total number of frames published. */
+    uint64_t frame_count;
+    /** Video parameters; the same for all slots. */
+    int32_t pixfmt;
+    int32_t width, height;
+    /** Display aspect ratio (display width/height), or 0 if unknown. */
+    int32_t d_w, d_h;
+    uint32_t reserved[7];
+} mpv_frame_shm_header;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -325,6 +325,91 @@ int mpv_opengl_cb_init_gl(mpv_opengl_cb_context *ctx, const char *exts,
  */
 int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int w, int h);
 
+/**
+ * Like mpv_opengl_cb_draw(), but for hosts which queue rendered frames and
+ * present them later (e.g. compositors). This does not wait until the player
+ * wants the frame to be displayed, but returns as soon as it was rendered.
+ * Each rendered frame must be followed by exactly one
+ * mpv_opengl_cb_report_flip() call once it is on screen.
+ *
+ * How many frames can be rendered before the first of them was reported as
+ * flipped is set with mpv_opengl_cb_set_render_ahead(). If there are more,
+ * the player waits with handing out new frames (and this function redraws
+ * the previous frame).
+ *
+ * @param fbo same as in mpv_opengl_cb_draw(); use a different FBO for each
+ *            frame rendered ahead
+ * @param w same as in mpv_opengl_cb_draw()
+ * @param h same as in mpv_opengl_cb_draw()
+ * @param target_time The mpv time (using mpv_get_time_us()) at which the host
+ *                    expects to present the frame, or 0 if unknown. If the
+ *                    matching mpv_opengl_cb_report_flip() call passes 0 as
+ *                    time, this is used as presentation time instead.
+ * @return same as mpv_opengl_cb_draw()
+ */
+int mpv_opengl_cb_draw_ahead(mpv_opengl_cb_context *ctx, int fbo, int w, int h,
+                             int64_t target_time);
+
+/**
+ * Set the number of frames which can be rendered with
+ * mpv_opengl_cb_draw_ahead() before the player waits for them to be reported
+ * with mpv_opengl_cb_report_flip(). The default is 0, which means each frame
+ * must be flipped before the next one is handed out (reporting flips is still
+ * optional in this case).
+ *
+ * Using render-ahead requires that the host reports all flips.
+ *
+ * @param frames number of frames, from 0 to 8
+ * @return error code (MPV_ERROR_INVALID_PARAMETER if out of range)
+ */
+int mpv_opengl_cb_set_render_ahead(mpv_opengl_cb_context *ctx, int frames);
+
+/**
+ * Create an additional render context ("view") for the same player. A view
+ * shows the same video as ctx, but has its own OpenGL context, size and update
+ * callback, so the host can show the video in several places (e.g. a main view
+ * and a picture-in-picture thumbnail) while decoding it only once.
+ *
+ * The view is used like the context returned by mpv_get_sub_api(): set an
+ * update callback, call mpv_opengl_cb_init_gl() with the view's OpenGL context
+ * current, and render with mpv_opengl_cb_draw(). Differences:
+ *  - Rendering a view never waits for the player, and the player never waits
+ *    for views. A view renders the most recent frame of the main context. Its
+ *    update callback is invoked when a new frame is available.
+ *  - mpv_opengl_cb_report_flip() and mpv_opengl_cb_set_render_ahead() have no
+ *    effect on views; video timing is determined by the main context only.
+ *  - Views do not render OSD and subtitles.
+ *  - Views can't map hardware decoded frames. Use a hwdec copy mode (such as
+ *    --hwdec=auto-copy), otherwise views render nothing.
+ *  - mpv_opengl_cb_uninit_gl() on a view does not affect playback.
+ *
+ * Views must be destroyed with mpv_opengl_cb_destroy_view() before the player
+ * is destroyed.
+ *
+ * @param ctx the context returned by mpv_get_sub_api()
+ * @return the new view, or NULL on error (e.g. if ctx is a view itself)
+ */
+mpv_opengl_cb_context *mpv_opengl_cb_create_view(mpv_opengl_cb_context *ctx);
+
+/**
+ * Destroy a view created with mpv_opengl_cb_create_view(). This implies
+ * mpv_opengl_cb_uninit_gl(), so the view's OpenGL context must be current if
+ * it was initialized. Calling this with NULL or with a context that is not a
+ * view does nothing.
+ */
+void mpv_opengl_cb_destroy_view(mpv_opengl_cb_context *view);
+
+/**
+ * Render with the cheapest settings (bilinear scaling, no debanding, no
+ * interpolation), regardless of the options. This is meant for small views,
+ * where the difference is barely visible. Can be used on the main context
+ * too. The default is 0 (render as configured by the options).
+ *
+ * @param fast 1 to enable, 0 to disable
+ * @return error code
+ */
+int mpv_opengl_cb_set_fast_rendering(mpv_opengl_cb_context *ctx, int fast);
+
 #if MPV_ENABLE_DEPRECATED
 /**
  * Deprecated. Use mpv_opengl_cb_draw(). This function is equivalent to:
@@ -349,9 +434,10 @@ int mpv_opengl_cb_render(mpv_opengl_cb_context *ctx, int fbo, int vp[4]);
  *
  * If this is called while no video or no OpenGL is initialized, it is ignored.
  *
- * @param time The mpv time (using mpv_get_time_us()) at which the flip call
- *             returned. If 0 is passed, mpv_get_time_us() is used instead.
- *             Currently, this parameter is ignored.
+ * @param time The mpv time (using mpv_get_time_us()) at which the frame was
+ *             presented. This is used for display-sync timing. If 0 is
+ *             passed, the target time passed to mpv_opengl_cb_draw_ahead()
+ *             is used, or if that was 0 too, the time is not used.
  * @return error code
  */
 int mpv_opengl_cb_report_flip(mpv_opengl_cb_context *ctx, int64_t time);
@@ -85,7 +85,29 @@ extern "C" {
  *   referenced resources - then return errors from the stream callbacks as
  *   long as the stream is still opened
  *
+ * Asynchronous reads
+ * ------------------
+ *
+ * Instead of read_fn, a stream can set read_async_fn. Then mpv passes a request
+ * handle and a buffer to the callback, which only starts the read and returns
+ * immediately. The user completes the request later, from any thread, with
+ * mpv_stream_cb_read_done(). This allows serving many streams from a single
+ * event loop, instead of blocking one thread per stream in read_fn.
+ *
+ * mpv still waits for the result on its own thread, so there is at most one
+ * pending read per stream. If mpv wants to abort a pending read (for example
+ * because playback is stopped), it calls cancel_fn. The request must still be
+ * completed (e.g. with a negative result) - cancel_fn only hints that the
+ * result is not needed anymore, and the close callback is never called while
+ * a read is pending.
+ *
+ */
+
+/**
+ * Handle for a pending asynchronous read. Opaque, and valid until it's passed
+ * to mpv_stream_cb_read_done().
  */
+typedef struct mpv_stream_cb_read_request mpv_stream_cb_read_request;
 
 /**
  * Read callback used to implement a custom stream. The semantics of the
@@ -105,6 +127,41 @@ extern "C" {
  */
 typedef int64_t (*mpv_stream_cb_read_fn)(void *cookie, char *buf, uint64_t nbytes);
 
+/**
+ * Asynchronous read callback, alternative to mpv_stream_cb_read_fn. This must
+ * not block. It starts reading up to nbytes into buf, and returns. The read is
+ * finished by calling mpv_stream_cb_read_done() with the request handle. This
+ * can be done within this callback as well.
+ *
+ * The buffer remains valid until the request is completed. Results are
+ * interpreted like the return value of mpv_stream_cb_read_fn.
+ *
+ * @param cookie opaque cookie identifying the stream,
+ *               returned from mpv_stream_cb_open_fn
+ * @param req handle that must be passed to mpv_stream_cb_read_done()
+ * @param buf buffer to read data into
+ * @param nbytes size of the buffer
+ */
+typedef void (*mpv_stream_cb_read_async_fn)(void *cookie,
+                                            mpv_stream_cb_read_request *req,
+                                            char *buf, uint64_t nbytes);
+
+/**
+ * Cancel callback for asynchronous reads. Called at most once per request, if
+ * mpv doesn't need the result of the pending read anymore. The user should
+ * complete the request as soon as possible (the result is ignored). This must
+ * not block. It's called from a mpv thread, possibly while a different thread
+ * is calling mpv_stream_cb_read_done() for the same request.
+ *
+ * This callback can be NULL, in which case mpv waits until the read completes.
+ *
+ * @param cookie opaque cookie identifying the stream,
+ *               returned from mpv_stream_cb_open_fn
+ * @param req the pending request
+ */
+typedef void (*mpv_stream_cb_cancel_fn)(void *cookie,
+                                        mpv_stream_cb_read_request *req);
+
 /**
  * Seek callback used to implement a custom stream.
  *
@@ -164,12 +221,20 @@ typedef struct mpv_stream_cb_info {
      * Callbacks set by the user in the mpv_stream_cb_open_ro_fn callback. Some
      * of them are optional, and can be left unset.
      *
-     * The following callbacks are mandatory: read_fn, close_fn
+     * The following callbacks are mandatory: read_fn (or read_async_fn),
+     * close_fn
      */
     mpv_stream_cb_read_fn read_fn;
     mpv_stream_cb_seek_fn seek_fn;
     mpv_stream_cb_size_fn size_fn;
     mpv_stream_cb_close_fn close_fn;
+
+    /**
+     * If set, this is used instead of read_fn. See "Asynchronous reads".
+     * Since API version 1.29.
+     */
+    mpv_stream_cb_read_async_fn read_async_fn;
+    mpv_stream_cb_cancel_fn cancel_fn;
 } mpv_stream_cb_info;
 
 /**
@@ -216,6 +281,19 @@ typedef int (*mpv_stream_cb_open_ro_fn)(void *user_data, char *uri,
 int mpv_stream_cb_add_ro(mpv_handle *ctx, const char *protocol, void *user_data,
                          mpv_stream_cb_open_ro_fn open_fn);
 
+/**
+ * Complete a read started with mpv_stream_cb_read_async_fn. This can be called
+ * from any thread, but exactly once per request. Afterwards, the request
+ * handle and the buffer must not be accessed anymore.
+ *
+ * Unlike other libmpv functions, this can (and must) be called from within
+ * stream callbacks, and doesn't take a mpv_handle.
+ *
+ * @param req the request passed to the read_async_fn callback
+ * @param result number of bytes read into the buffer, 0 on EOF, -1 on error
+ */
+void mpv_stream_cb_read_done(mpv_stream_cb_read_request *req, int64_t result);
+
 #ifdef __cplusplus
 }
 #endif
@@ -204,6 +204,15 @@ static inline bool bstr_equals0(struct bstr str1, const char *str2)
     return bstr_equals(str1, bstr0(str2));
 }
 
+// FNV-1a hash of the string contents (for name lookup tables).
+static inline uint32_t bstr_hash(struct bstr str)
+{
+    uint32_t h = 2166136261u;
+    for (size_t n = 0; n < str.len; n++)
+        h = (h ^ str.start[n]) * 16777619u;
+    return h;
+}
+
 static inline int bstrcasecmp0(struct bstr str1, const char *str2)
 {
     return bstrcasecmp(str1, bstr0(str2));
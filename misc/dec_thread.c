@@ -0,0 +1,232 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+
+#include "common/common.h"
+#include "osdep/threads.h"
+
+#include "dec_thread.h"
+
+// Runs a decoder's work function on a separate thread, and buffers up to a
+// fixed number of decoded frames. The thread is stopped initially, and after
+// each mp_dec_thread_stop() call, so the owner can reset the decoder without
+// racing with it. mp_dec_thread_kick() (re)starts it.
+struct mp_dec_thread {
+    const struct mp_dec_thread_fns *fns;
+    void *ctx;
+    char *name;
+    void (*wakeup)(void *ctx);
+    void *wakeup_ctx;
+    int max_frames;
+
+    pthread_t thread;
+
+    // Held during each step() call.
+    pthread_mutex_t dec_lock;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup_cond;
+
+    // --- the following fields are protected by lock
+    bool terminate;
+    bool running;       // false after mp_dec_thread_stop()
+    bool kicked;        // mp_dec_thread_kick() was called since the last step
+    bool in_step;
+    int state;          // DATA_* code of the last step
+    void **frames;
+    int num_frames;
+};
+
+static bool can_step(struct mp_dec_thread *t)
+{
+    if (!t->running || t->num_frames >= t->max_frames)
+        return false;
+    if (t->state == DATA_EOF)
+        return false;
+    return t->state != DATA_WAIT || t->kicked;
+}
+
+static void *dec_thread(void *arg)
+{
+    struct mp_dec_thread *t = arg;
+    mpthread_set_name(t->name);
+
+    pthread_mutex_lock(&t->lock);
+    while (!t->terminate) {
+        if (!can_step(t)) {
+            pthread_cond_wait(&t->wakeup_cond, &t->lock);
+            continue;
+        }
+
+        t->kicked = false;
+        t->in_step = true;
+        pthread_mutex_unlock(&t->lock);
+
+        void *frame = NULL;
+        pthread_mutex_lock(&t->dec_lock);
+        int state = t->fns->step(t->ctx, &frame);
+        pthread_mutex_unlock(&t->dec_lock);
+
+        pthread_mutex_lock(&t->lock);
+        t->in_step = false;
+        t->state = state;
+        if (frame)
+            MP_TARRAY_APPEND(t, t->frames, t->num_frames, frame);
+        pthread_cond_broadcast(&t->wakeup_cond);
+
+        if (frame || state == DATA_EOF) {
+            pthread_mutex_unlock(&t->lock);
+            if (t->wakeup)
+                t->wakeup(t->wakeup_ctx);
+            pthread_mutex_lock(&t->lock);
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    return NULL;
+}
+
+static void dec_thread_dtor(void *ptr)
+{
+    struct mp_dec_thread *t = ptr;
+
+    pthread_mutex_lock(&t->lock);
+    t->terminate = true;
+    pthread_cond_broadcast(&t->wakeup_cond);
+    pthread_mutex_unlock(&t->lock);
+
+    pthread_join(t->thread, NULL);
+
+    for (int n = 0; n < t->num_frames; n++)
+        t->fns->free_frame(t->frames[n]);
+
+    pthread_cond_destroy(&t->wakeup_cond);
+    pthread_mutex_destroy(&t->lock);
+    pthread_mutex_destroy(&t->dec_lock);
+}
+
+// Create a decoder thread, which calls fns->step(ctx, ...) while running, and
+// keeps up to max_frames frames. wakeup(wakeup_ctx) is called whenever a new
+// frame (or EOF) becomes available; it must not call back into this API.
+// Returns NULL if the thread could not be created. Destroy it with talloc_free()
+// (this joins the thread, and frees all queued frames).
+struct mp_dec_thread *mp_dec_thread_create(void *ta_parent, const char *name,
+                                           const struct mp_dec_thread_fns *fns,
+                                           void *ctx, int max_frames,
+                                           void (*wakeup)(void *ctx),
+                                           void *wakeup_ctx)
+{
+    assert(max_frames > 0);
+
+    struct mp_dec_thread *t = talloc_ptrtype(ta_parent, t);
+    *t = (struct mp_dec_thread){
+        .fns = fns,
+        .ctx = ctx,
+        .name = talloc_strdup(t, name),
+        .wakeup = wakeup,
+        .wakeup_ctx = wakeup_ctx,
+        .max_frames = max_frames,
+        .state = DATA_AGAIN,
+    };
+
+    pthread_mutex_init(&t->dec_lock, NULL);
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wakeup_cond, NULL);
+
+    if (pthread_create(&t->thread, NULL, dec_thread, t)) {
+        pthread_cond_destroy(&t->wakeup_cond);
+        pthread_mutex_destroy(&t->lock);
+        pthread_mutex_destroy(&t->dec_lock);
+        talloc_free(t);
+        return NULL;
+    }
+
+    talloc_set_destructor(t, dec_thread_dtor);
+    return t;
+}
+
+// Start decoding, or continue if the last step returned DATA_WAIT. This is
+// cheap, and is supposed to be called whenever the owner is woken up.
+void mp_dec_thread_kick(struct mp_dec_thread *t)
+{
+    pthread_mutex_lock(&t->lock);
+    t->running = true;
+    t->kicked = true;
+    pthread_cond_broadcast(&t->wakeup_cond);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Stop decoding, wait until the thread is idle, and drop all queued frames.
+// Until the next mp_dec_thread_kick(), step() is not called (so the decoder
+// state can be accessed freely).
+void mp_dec_thread_stop(struct mp_dec_thread *t)
+{
+    pthread_mutex_lock(&t->lock);
+    t->running = false;
+    while (t->in_step)
+        pthread_cond_wait(&t->wakeup_cond, &t->lock);
+    for (int n = 0; n < t->num_frames; n++)
+        t->fns->free_frame(t->frames[n]);
+    t->num_frames = 0;
+    t->state = DATA_AGAIN;
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Like mp_dec_thread_stop(), but keep the queued frames, and the state of the
+// last step.
+void mp_dec_thread_pause(struct mp_dec_thread *t)
+{
+    pthread_mutex_lock(&t->lock);
+    t->running = false;
+    while (t->in_step)
+        pthread_cond_wait(&t->wakeup_cond, &t->lock);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Return the oldest queued frame. Returns one of:
+//  DATA_OK:    *frame is set to a new frame
+//  DATA_WAIT:  no frame available yet; wakeup callback will be called
+//  DATA_EOF:   end of file, and all frames were returned
+int mp_dec_thread_get(struct mp_dec_thread *t, void **frame)
+{
+    *frame = NULL;
+    int res = DATA_WAIT;
+    pthread_mutex_lock(&t->lock);
+    if (t->num_frames) {
+        *frame = t->frames[0];
+        MP_TARRAY_REMOVE_AT(t->frames, t->num_frames, 0);
+        pthread_cond_broadcast(&t->wakeup_cond);
+        res = DATA_OK;
+    } else if (t->state == DATA_EOF) {
+        res = DATA_EOF;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return res;
+}
+
+// Exclude concurrent step() calls, e.g. for querying decoder state while the
+// thread is running. Must not be held while calling mp_dec_thread_stop().
+void mp_dec_thread_lock(struct mp_dec_thread *t)
+{
+    pthread_mutex_lock(&t->dec_lock);
+}
+
+void mp_dec_thread_unlock(struct mp_dec_thread *t)
+{
+    pthread_mutex_unlock(&t->dec_lock);
+}
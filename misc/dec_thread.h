@@ -0,0 +1,28 @@
+#ifndef MP_DEC_THREAD_H
+#define MP_DEC_THREAD_H
+
+struct mp_dec_thread;
+
+struct mp_dec_thread_fns {
+    // Run a single decoding step. Returns a DATA_* code, and sets *frame if
+    // DATA_OK is returned. DATA_WAIT makes the thread sleep until the next
+    // mp_dec_thread_kick() call, DATA_EOF until the next mp_dec_thread_stop().
+    // Called on the decoder thread, with the decoder lock held.
+    int (*step)(void *ctx, void **frame);
+    // Free a frame returned by step().
+    void (*free_frame)(void *frame);
+};
+
+struct mp_dec_thread *mp_dec_thread_create(void *ta_parent, const char *name,
+                                           const struct mp_dec_thread_fns *fns,
+                                           void *ctx, int max_frames,
+                                           void (*wakeup)(void *ctx),
+                                           void *wakeup_ctx);
+void mp_dec_thread_kick(struct mp_dec_thread *t);
+void mp_dec_thread_stop(struct mp_dec_thread *t);
+void mp_dec_thread_pause(struct mp_dec_thread *t);
+int mp_dec_thread_get(struct mp_dec_thread *t, void **frame);
+void mp_dec_thread_lock(struct mp_dec_thread *t);
+void mp_dec_thread_unlock(struct mp_dec_thread *t);
+
+#endif
@@ -75,35 +75,123 @@ void json_skip_whitespace(char **src)
     eat_ws(src);
 }
 
-static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
+static bool read_hex(const char *s, int digits, uint32_t *out)
+{
+    uint32_t v = 0;
+    for (int n = 0; n < digits; n++) {
+        char c = s[n];
+        int d;
+        if (c >= '0' && c <= '9') {
+            d = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            d = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            d = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        v = (v << 4) | d;
+    }
+    *out = v;
+    return true;
+}
+
+static int write_utf8(char *dst, uint32_t c)
+{
+    if (c < 0x80) {
+        dst[0] = c;
+        return 1;
+    } else if (c < 0x800) {
+        dst[0] = 0xC0 | (c >> 6);
+        dst[1] = 0x80 | (c & 0x3F);
+        return 2;
+    } else if (c < 0x10000) {
+        dst[0] = 0xE0 | (c >> 12);
+        dst[1] = 0x80 | ((c >> 6) & 0x3F);
+        dst[2] = 0x80 | (c & 0x3F);
+        return 3;
+    }
+    dst[0] = 0xF0 | (c >> 18);
+    dst[1] = 0x80 | ((c >> 12) & 0x3F);
+    dst[2] = 0x80 | ((c >> 6) & 0x3F);
+    dst[3] = 0x80 | (c & 0x3F);
+    return 4;
+}
+
+// Decode the escape sequence at *src (the character after the '\'), write the
+// result to *dst, and advance both. The decoded form is never longer than the
+// escape sequence, so dst can point into the same buffer (before src).
+// Accepts the same escapes as mp_append_escaped_string().
+static bool read_escape(char **dst, char **src)
+{
+    char *s = *src;
+    char replace = 0;
+    switch (s[0]) {
+    case '"':  replace = '"';  break;
+    case '\\': replace = '\\'; break;
+    case '/':  replace = '/'; break;
+    case 'b':  replace = '\b'; break;
+    case 'f':  replace = '\f'; break;
+    case 'n':  replace = '\n'; break;
+    case 'r':  replace = '\r'; break;
+    case 't':  replace = '\t'; break;
+    case 'e':  replace = '\x1b'; break;
+    case '\'': replace = '\''; break;
+    }
+    if (replace) {
+        *(*dst)++ = replace;
+        *src = s + 1;
+        return true;
+    }
+    uint32_t c;
+    if (s[0] == 'x' && read_hex(s + 1, 2, &c)) {
+        *(*dst)++ = c;
+        *src = s + 3;
+        return true;
+    }
+    if (s[0] == 'u' && read_hex(s + 1, 4, &c)) {
+        s += 5;
+        if (c >= 0xd800 && c <= 0xdbff) {
+            uint32_t c2;
+            if (s[0] != '\\' || s[1] != 'u' || !read_hex(s + 2, 4, &c2) ||
+                c2 < 0xdc00 || c2 > 0xdfff)
+                return false;
+            c = ((c - 0xd800) << 10) + 0x10000 + (c2 - 0xdc00);
+            s += 6;
+        }
+        *dst += write_utf8(*dst, c);
+        *src = s;
+        return true;
+    }
+    return false;
+}
+
+static int read_str(struct mpv_node *dst, char **src)
 {
     if (!eat_c(src, '"'))
         return -1; // not a string
     char *str = *src;
     char *cur = str;
-    bool has_escapes = false;
+    char *out = NULL; // write position, once the first escape was found
     while (cur[0] && cur[0] != '"') {
         if (cur[0] == '\\') {
-            has_escapes = true;
-            // skip >\"< and >\\< (latter to handle >\\"< correctly)
-            if (cur[1] == '"' || cur[1] == '\\')
-                cur++;
+            if (!out)
+                out = cur;
+            cur++;
+            if (!read_escape(&out, &cur))
+                return -1; // broken escapes
+        } else if (out) {
+            *out++ = *cur++;
+        } else {
+            cur++;
         }
-        cur++;
     }
     if (cur[0] != '"')
         return -1; // invalid termination
-    // Mutate input string so we have a null-terminated string to the literal.
-    // This is a stupid micro-optimization, so we can avoid allocation.
-    cur[0] = '\0';
     *src = cur + 1;
-    if (has_escapes) {
-        bstr unescaped = {0};
-        bstr r = bstr0(str);
-        if (!mp_append_escaped_string(ta_parent, &unescaped, &r))
-            return -1; // broken escapes
-        str = unescaped.start; // the function guarantees null-termination
-    }
+    // Mutate input string so we have a null-terminated string to the literal.
+    // Escapes were decoded in place as well, so strings never need allocations.
+    (out ? out : cur)[0] = '\0';
     dst->format = MPV_FORMAT_STRING;
     dst->u.string = str;
     return 0;
@@ -127,7 +215,7 @@ static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
         eat_ws(src);
         if (is_obj) {
             struct mpv_node keynode;
-            if (read_str(list, &keynode, src) < 0)
+            if (read_str(&keynode, src) < 0)
                 return -1; // key is not a string
             eat_ws(src);
             if (!eat_c(src, ':'))
@@ -154,8 +242,8 @@ static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
  *      whether *src really terminates)
  *  -1: failure, *dst is invalid, there may be dead allocs under ta_parent
  *      (ta_free_children(ta_parent) is the only way to free them)
- * The input string can be mutated in both cases. *dst might contain string
- * elements, which point into the (mutated) input string.
+ * The input string can be mutated in both cases. String elements in *dst
+ * always point into the (mutated) input string.
  */
 int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
 {
@@ -183,7 +271,7 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
         dst->u.flag = 0;
         return 0;
     } else if (c == '"') {
-        return read_str(ta_parent, dst, src);
+        return read_str(dst, src);
     } else if (c == '[' || c == '{') {
         return read_sub(ta_parent, dst, src, max_depth);
     } else if (c == '-' || (c >= '0' && c <= '9')) {
@@ -220,18 +308,19 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
 
 static void write_json_str(bstr *b, unsigned char *str)
 {
+    static const char hex[] = "0123456789abcdef";
     APPEND(b, "\"");
     while (1) {
         unsigned char *cur = str;
         while (cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
             cur++;
+        bstr_xappend(NULL, b, (bstr){str, cur - str});
         if (!cur[0])
             break;
-        bstr_xappend(NULL, b, (bstr){str, cur - str});
-        bstr_xappend_asprintf(NULL, b, "\\u%04x", (unsigned char)cur[0]);
+        char esc[6] = {'\\', 'u', '0', '0', hex[cur[0] >> 4], hex[cur[0] & 15]};
+        bstr_xappend(NULL, b, (bstr){esc, 6});
         str = cur + 1;
     }
-    APPEND(b, str);
     APPEND(b, "\"");
 }
 
@@ -0,0 +1,381 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libavutil/intreadwrite.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "osdep/io.h"
+#include "osdep/timer.h"
+
+#include "kv_store.h"
+
+// The store is a log of records, each a header followed by the data:
+//
+//  "MPKV"      magic
+//  key         KV_STORE_KEY_SIZE bytes
+//  length      LE32, REMOVED for a removed entry (no data follows)
+//  checksum    LE32, FNV-1a over key and data
+//
+// The newest record for a key wins. The file starts with a file header, which
+// contains a random ID that changes whenever the file is rewritten.
+//
+// The in-memory index is updated incrementally: only records appended since
+// the last access are read, which also picks up writes by other processes.
+// Once the file is much larger than the live data, it's rewritten with only
+// the live entries, and atomically replaced (compaction).
+
+#define FILE_MAGIC "mpv-kvstore\n"
+#define FILE_HEADER_SIZE 16
+#define RECORD_HEADER_SIZE (4 + KV_STORE_KEY_SIZE + 4 + 4)
+#define REMOVED 0xFFFFFFFFu
+#define MAX_DATA (16 * 1024 * 1024)
+
+// Don't bother compacting small files.
+#define MIN_COMPACT_SIZE (256 * 1024)
+
+struct entry {
+    uint8_t key[KV_STORE_KEY_SIZE];
+    int64_t offset;     // of the record; also orders entries by age
+    uint32_t len;       // REMOVED only in not yet merged entries
+};
+
+struct kv_store {
+    char *path;
+    int max_entries;
+
+    struct entry *entries;  // sorted by key
+    int num_entries;
+    int64_t live_size;      // size of the records in entries[]
+
+    uint32_t file_id;       // from the file header
+    int64_t scanned;        // file position up to which the index is valid
+    bool corrupted;         // invalid data found, rewrite on next write
+};
+
+struct kv_store *kv_store_open(void *ta_parent, const char *path,
+                               int max_entries)
+{
+    struct kv_store *s = talloc_zero(ta_parent, struct kv_store);
+    s->path = talloc_strdup(s, path);
+    s->max_entries = max_entries;
+    return s;
+}
+
+static uint32_t checksum(const uint8_t *key, bstr data)
+{
+    uint32_t h = 2166136261u;
+    for (int n = 0; n < KV_STORE_KEY_SIZE; n++)
+        h = (h ^ key[n]) * 16777619u;
+    for (size_t n = 0; n < data.len; n++)
+        h = (h ^ data.start[n]) * 16777619u;
+    return h;
+}
+
+static int cmp_entry(const void *pa, const void *pb)
+{
+    const struct entry *a = pa, *b = pb;
+    int r = memcmp(a->key, b->key, KV_STORE_KEY_SIZE);
+    if (r)
+        return r;
+    return a->offset < b->offset ? -1 : (a->offset > b->offset);
+}
+
+static int64_t record_size(struct entry *e)
+{
+    return RECORD_HEADER_SIZE + (e->len == REMOVED ? 0 : e->len);
+}
+
+static void reset_index(struct kv_store *s)
+{
+    TA_FREEP(&s->entries);
+    s->num_entries = 0;
+    s->live_size = 0;
+    s->file_id = 0;
+    s->scanned = 0;
+    s->corrupted = false;
+}
+
+// Sort new entries (appended to entries[] after the first num_old) into the
+// index. For each key, keep only the newest entry, unless it was removed.
+static void merge_entries(struct kv_store *s, int num_old)
+{
+    if (s->num_entries == num_old)
+        return;
+    qsort(s->entries, s->num_entries, sizeof(s->entries[0]), cmp_entry);
+    int num = 0;
+    s->live_size = 0;
+    for (int n = 0; n < s->num_entries; n++) {
+        struct entry *e = &s->entries[n];
+        if (n + 1 < s->num_entries &&
+            memcmp(e->key, s->entries[n + 1].key, KV_STORE_KEY_SIZE) == 0)
+            continue;
+        if (e->len == REMOVED)
+            continue;
+        s->entries[num++] = *e;
+        s->live_size += record_size(e);
+    }
+    s->num_entries = num;
+}
+
+static bool read_file_header(FILE *f, uint32_t *id)
+{
+    uint8_t hdr[FILE_HEADER_SIZE];
+    if (fseeko(f, 0, SEEK_SET) || fread(hdr, sizeof(hdr), 1, f) != 1)
+        return false;
+    if (memcmp(hdr, FILE_MAGIC, 12) != 0)
+        return false;
+    *id = AV_RL32(hdr + 12);
+    return true;
+}
+
+// Read the records not yet in the index. f == NULL means the file is missing.
+static void update_index(struct kv_store *s, FILE *f)
+{
+    uint32_t id;
+    if (!f || !read_file_header(f, &id)) {
+        reset_index(s);
+        return;
+    }
+    if (id != s->file_id || !s->scanned) {
+        // Rewritten by someone else (or first access).
+        reset_index(s);
+        s->file_id = id;
+        s->scanned = FILE_HEADER_SIZE;
+    }
+    if (fseeko(f, s->scanned, SEEK_SET))
+        return;
+
+    int num_old = s->num_entries;
+    void *tmp = talloc_new(NULL);
+    while (1) {
+        uint8_t hdr[RECORD_HEADER_SIZE];
+        size_t got = fread(hdr, 1, sizeof(hdr), f);
+        if (got == 0)
+            break;
+        if (got != sizeof(hdr) || memcmp(hdr, "MPKV", 4) != 0) {
+            s->corrupted = true;
+            break;
+        }
+        struct entry e = {.offset = s->scanned, .len = AV_RL32(hdr + 20)};
+        memcpy(e.key, hdr + 4, KV_STORE_KEY_SIZE);
+        bstr data = {0};
+        if (e.len != REMOVED) {
+            if (e.len > MAX_DATA) {
+                s->corrupted = true;
+                break;
+            }
+            data.start = talloc_realloc_size(tmp, NULL, MPMAX(e.len, 1));
+            data.len = e.len;
+            if (fread(data.start, data.len, 1, f) != 1 && data.len) {
+                // Possibly a write in progress; don't mark as corrupted.
+                break;
+            }
+        }
+        if (AV_RL32(hdr + 24) != checksum(e.key, data)) {
+            s->corrupted = true;
+            break;
+        }
+        talloc_free(data.start);
+        MP_TARRAY_APPEND(s, s->entries, s->num_entries, e);
+        s->scanned += record_size(&e);
+    }
+    talloc_free(tmp);
+
+    merge_entries(s, num_old);
+}
+
+static struct entry *find_entry(struct kv_store *s, const uint8_t *key)
+{
+    struct entry ref = {0};
+    memcpy(ref.key, key, KV_STORE_KEY_SIZE);
+    for (int lo = 0, hi = s->num_entries; lo < hi;) {
+        int mid = lo + (hi - lo) / 2;
+        int r = memcmp(ref.key, s->entries[mid].key, KV_STORE_KEY_SIZE);
+        if (r == 0)
+            return &s->entries[mid];
+        if (r < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+static bstr read_data(FILE *f, void *ta_parent, struct entry *e)
+{
+    char *data = talloc_size(ta_parent, e->len + 1);
+    if (fseeko(f, e->offset + RECORD_HEADER_SIZE, SEEK_SET) ||
+        (e->len && fread(data, e->len, 1, f) != 1))
+    {
+        talloc_free(data);
+        return (bstr){0};
+    }
+    data[e->len] = '\0';
+    return (bstr){(unsigned char *)data, e->len};
+}
+
+bstr kv_store_get(struct kv_store *s, void *ta_parent,
+                  const uint8_t key[KV_STORE_KEY_SIZE])
+{
+    bstr res = {0};
+    FILE *f = fopen(s->path, "rb");
+    update_index(s, f);
+    struct entry *e = find_entry(s, key);
+    if (f && e)
+        res = read_data(f, ta_parent, e);
+    if (f)
+        fclose(f);
+    return res;
+}
+
+
+static bool write_file_header(FILE *f)
+{
+    uint8_t hdr[FILE_HEADER_SIZE];
+    memcpy(hdr, FILE_MAGIC, 12);
+    AV_WL32(hdr + 12, (uint32_t)mp_raw_time_us() | 1);
+    return fwrite(hdr, sizeof(hdr), 1, f) == 1;
+}
+
+static bool write_record(FILE *f, const uint8_t *key, bstr data, bool removed)
+{
+    uint8_t hdr[RECORD_HEADER_SIZE];
+    memcpy(hdr, "MPKV", 4);
+    memcpy(hdr + 4, key, KV_STORE_KEY_SIZE);
+    AV_WL32(hdr + 20, removed ? REMOVED : data.len);
+    AV_WL32(hdr + 24, checksum(key, removed ? (bstr){0} : data));
+    // Write each record with a single call, so concurrent appends by other
+    // processes are less likely to interleave.
+    void *buf = talloc_size(NULL, sizeof(hdr) + data.len);
+    memcpy(buf, hdr, sizeof(hdr));
+    if (data.len)
+        memcpy((char *)buf + sizeof(hdr), data.start, data.len);
+    bool ok = fwrite(buf, sizeof(hdr) + data.len, 1, f) == 1;
+    talloc_free(buf);
+    return ok;
+}
+
+static int cmp_entry_age(const void *pa, const void *pb)
+{
+    const struct entry *a = pa, *b = pb;
+    return a->offset < b->offset ? -1 : (a->offset > b->offset);
+}
+
+// Rewrite the file with the live entries only, dropping the oldest entries
+// beyond max_entries.
+static void compact(struct kv_store *s)
+{
+    FILE *in = fopen(s->path, "rb");
+    if (!in)
+        return;
+    update_index(s, in);
+
+    void *tmp = talloc_new(NULL);
+    char *tmp_path = talloc_asprintf(tmp, "%s.tmp", s->path);
+    FILE *out = fopen(tmp_path, "wb");
+    bool ok = out && write_file_header(out);
+
+    struct entry *list = talloc_memdup(tmp, s->entries,
+                                       s->num_entries * sizeof(list[0]));
+    int num = s->num_entries;
+    qsort(list, num, sizeof(list[0]), cmp_entry_age);
+    int first = 0;
+    if (s->max_entries > 0 && num > s->max_entries)
+        first = num - s->max_entries;
+    for (int n = first; ok && n < num; n++) {
+        bstr data = read_data(in, tmp, &list[n]);
+        ok = data.start && write_record(out, list[n].key, data, false);
+        talloc_free(data.start);
+    }
+    fclose(in);
+    if (out)
+        ok = fclose(out) == 0 && ok;
+
+    if (ok && rename(tmp_path, s->path) != 0) {
+        // Windows doesn't replace existing files.
+        unlink(s->path);
+        ok = rename(tmp_path, s->path) == 0;
+    }
+    if (!ok)
+        unlink(tmp_path);
+
+    talloc_free(tmp);
+    reset_index(s);
+}
+
+static void update(struct kv_store *s)
+{
+    FILE *f = fopen(s->path, "rb");
+    update_index(s, f);
+    if (f)
+        fclose(f);
+}
+
+static bool put(struct kv_store *s, const uint8_t *key, bstr data,
+                bool removed)
+{
+    // Records appended after invalid data would never be read.
+    update(s);
+    if (s->corrupted)
+        compact(s);
+
+    FILE *f = fopen(s->path, "ab");
+    if (!f)
+        return false;
+    bool ok = true;
+    if (fseeko(f, 0, SEEK_END) == 0 && ftello(f) == 0)
+        ok = write_file_header(f);
+    ok = ok && write_record(f, key, data, removed);
+    ok = fclose(f) == 0 && ok;
+
+    update(s);
+
+    int max = s->max_entries;
+    if (s->corrupted || (max > 0 && s->num_entries > max + max / 4) ||
+        s->scanned > MPMAX(s->live_size * 2, MIN_COMPACT_SIZE))
+        compact(s);
+
+    return ok;
+}
+
+bool kv_store_put(struct kv_store *s, const uint8_t key[KV_STORE_KEY_SIZE],
+                  bstr data)
+{
+    if (data.len > MAX_DATA)
+        return false;
+    return put(s, key, data, false);
+}
+
+bool kv_store_has(struct kv_store *s, const uint8_t key[KV_STORE_KEY_SIZE])
+{
+    update(s);
+    return !!find_entry(s, key);
+}
+
+bool kv_store_remove(struct kv_store *s, const uint8_t key[KV_STORE_KEY_SIZE])
+{
+    if (!kv_store_has(s, key))
+        return true;
+    return put(s, key, (bstr){0}, true);
+}
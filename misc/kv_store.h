@@ -0,0 +1,30 @@
+#ifndef MP_KV_STORE_H
+#define MP_KV_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "misc/bstr.h"
+
+#define KV_STORE_KEY_SIZE 16
+
+struct kv_store;
+
+// Open the store at path. The file is created on the first write. Once there
+// are more than max_entries live entries, the oldest ones are dropped on the
+// next compaction (0 means unlimited).
+struct kv_store *kv_store_open(void *ta_parent, const char *path,
+                               int max_entries);
+
+// Return the data for the key, allocated under ta_parent, or a NULL bstr if
+// there is no such entry.
+bstr kv_store_get(struct kv_store *s, void *ta_parent,
+                  const uint8_t key[KV_STORE_KEY_SIZE]);
+bool kv_store_has(struct kv_store *s, const uint8_t key[KV_STORE_KEY_SIZE]);
+
+// Set or replace the entry. Returns false on write errors.
+bool kv_store_put(struct kv_store *s, const uint8_t key[KV_STORE_KEY_SIZE],
+                  bstr data);
+bool kv_store_remove(struct kv_store *s, const uint8_t key[KV_STORE_KEY_SIZE]);
+
+#endif
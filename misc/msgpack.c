@@ -0,0 +1,352 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* MessagePack parser and writer, mapping MessagePack values to mpv_node.
+ *
+ * nil, bool, integers, floats, strings, arrays and maps map directly to the
+ * corresponding mpv_node formats. "bin" is mapped to MPV_FORMAT_BYTE_ARRAY.
+ * Map keys must be strings. Integers outside of the int64_t range, and "ext"
+ * types are rejected.
+ *
+ * Strings are not checked for valid UTF-8. Strings with embedded 0 bytes are
+ * silently truncated, because mpv_node strings are 0-terminated.
+ *
+ * Also see: https://github.com/msgpack/msgpack/blob/master/spec.md
+ */
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "common/common.h"
+#include "mpv_talloc.h"
+
+#include "msgpack.h"
+
+struct reader {
+    void *ta_parent;
+    bstr s;
+    bool incomplete;
+};
+
+static bool read_bytes(struct reader *r, size_t len, unsigned char **out)
+{
+    if (r->s.len < len) {
+        r->incomplete = true;
+        return false;
+    }
+    *out = r->s.start;
+    r->s = bstr_cut(r->s, len);
+    return true;
+}
+
+static bool read_uint(struct reader *r, int bytes, uint64_t *out)
+{
+    unsigned char *p;
+    if (!read_bytes(r, bytes, &p))
+        return false;
+    uint64_t v = 0;
+    for (int n = 0; n < bytes; n++)
+        v = (v << 8) | p[n];
+    *out = v;
+    return true;
+}
+
+static bool read_int(struct reader *r, int bytes, int64_t *out)
+{
+    uint64_t v;
+    if (!read_uint(r, bytes, &v))
+        return false;
+    // Sign-extend.
+    int shift = 64 - bytes * 8;
+    *out = shift ? (int64_t)(v << shift) >> shift : (int64_t)v;
+    return true;
+}
+
+static bool read_str(struct reader *r, uint64_t len, char **out)
+{
+    unsigned char *p;
+    if (!read_bytes(r, len, &p))
+        return false;
+    *out = talloc_strndup(r->ta_parent, (char *)p, len);
+    return true;
+}
+
+static int read_value(struct reader *r, struct mpv_node *dst, int max_depth);
+
+static int read_list(struct reader *r, struct mpv_node *dst, uint64_t num,
+                     bool is_map, int max_depth)
+{
+    if (max_depth <= 0)
+        return -1;
+    // Each entry needs at least 1 byte - avoid absurd allocations.
+    if (num > r->s.len) {
+        r->incomplete = true;
+        return -1;
+    }
+    struct mpv_node_list *list = talloc_zero(r->ta_parent, struct mpv_node_list);
+    dst->format = is_map ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
+    dst->u.list = list;
+    list->values = talloc_array(list, struct mpv_node, num);
+    if (is_map)
+        list->keys = talloc_array(list, char *, num);
+    for (uint64_t n = 0; n < num; n++) {
+        if (is_map) {
+            struct mpv_node key;
+            if (read_value(r, &key, 1) < 0)
+                return -1;
+            if (key.format != MPV_FORMAT_STRING)
+                return -1;
+            list->keys[n] = key.u.string;
+        }
+        if (read_value(r, &list->values[n], max_depth - 1) < 0)
+            return -1;
+        list->num++;
+    }
+    return 0;
+}
+
+static int read_value(struct reader *r, struct mpv_node *dst, int max_depth)
+{
+    *dst = (struct mpv_node){0};
+
+    unsigned char *p;
+    if (!read_bytes(r, 1, &p))
+        return -1;
+    unsigned char c = p[0];
+
+    uint64_t len = 0;
+    if (c <= 0x7f) {
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = c;
+        return 0;
+    } else if (c >= 0xe0) {
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = (int8_t)c;
+        return 0;
+    } else if (c >= 0x80 && c <= 0x8f) {
+        return read_list(r, dst, c & 0xf, true, max_depth);
+    } else if (c >= 0x90 && c <= 0x9f) {
+        return read_list(r, dst, c & 0xf, false, max_depth);
+    } else if (c >= 0xa0 && c <= 0xbf) {
+        dst->format = MPV_FORMAT_STRING;
+        return read_str(r, c & 0x1f, &dst->u.string) ? 0 : -1;
+    }
+
+    switch (c) {
+    case 0xc0:
+        dst->format = MPV_FORMAT_NONE;
+        return 0;
+    case 0xc2:
+    case 0xc3:
+        dst->format = MPV_FORMAT_FLAG;
+        dst->u.flag = c == 0xc3;
+        return 0;
+    case 0xc4:
+    case 0xc5:
+    case 0xc6: {
+        if (!read_uint(r, 1 << (c - 0xc4), &len))
+            return -1;
+        unsigned char *data;
+        if (!read_bytes(r, len, &data))
+            return -1;
+        struct mpv_byte_array *ba = talloc_zero(r->ta_parent, struct mpv_byte_array);
+        ba->data = talloc_memdup(ba, data, len);
+        ba->size = len;
+        dst->format = MPV_FORMAT_BYTE_ARRAY;
+        dst->u.ba = ba;
+        return 0;
+    }
+    case 0xca:
+    case 0xcb: {
+        uint64_t v;
+        if (!read_uint(r, c == 0xca ? 4 : 8, &v))
+            return -1;
+        dst->format = MPV_FORMAT_DOUBLE;
+        if (c == 0xca) {
+            uint32_t v32 = v;
+            float f;
+            memcpy(&f, &v32, sizeof(f));
+            dst->u.double_ = f;
+        } else {
+            memcpy(&dst->u.double_, &v, sizeof(double));
+        }
+        return 0;
+    }
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    case 0xcf: {
+        uint64_t v;
+        if (!read_uint(r, 1 << (c - 0xcc), &v))
+            return -1;
+        if (v > INT64_MAX)
+            return -1;
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = v;
+        return 0;
+    }
+    case 0xd0:
+    case 0xd1:
+    case 0xd2:
+    case 0xd3:
+        dst->format = MPV_FORMAT_INT64;
+        return read_int(r, 1 << (c - 0xd0), &dst->u.int64) ? 0 : -1;
+    case 0xd9:
+    case 0xda:
+    case 0xdb:
+        if (!read_uint(r, 1 << (c - 0xd9), &len))
+            return -1;
+        dst->format = MPV_FORMAT_STRING;
+        return read_str(r, len, &dst->u.string) ? 0 : -1;
+    case 0xdc:
+    case 0xdd:
+        if (!read_uint(r, c == 0xdc ? 2 : 4, &len))
+            return -1;
+        return read_list(r, dst, len, false, max_depth);
+    case 0xde:
+    case 0xdf:
+        if (!read_uint(r, c == 0xde ? 2 : 4, &len))
+            return -1;
+        return read_list(r, dst, len, true, max_depth);
+    }
+
+    return -1; // ext types, or reserved (0xc1)
+}
+
+/* Parse the MessagePack value at the start of *src into *dst. On success,
+ * *src is advanced to the data following the value. Memory is allocated with
+ * ta_parent (on error, the partially parsed data is possibly left there).
+ * Returns: 1 on success, 0 if *src ends before the value is complete (*src is
+ * not changed), <0 on invalid data.
+ */
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                  int max_depth)
+{
+    struct reader r = { .ta_parent = ta_parent, .s = *src };
+    if (read_value(&r, dst, max_depth) < 0)
+        return r.incomplete ? 0 : -1;
+    *src = r.s;
+    return 1;
+}
+
+static void write_bytes(void *ta_parent, bstr *b, const void *data, size_t len)
+{
+    bstr_xappend(ta_parent, b, (bstr){(unsigned char *)data, len});
+}
+
+// Write the type byte c followed by v as big endian number of the given size.
+static void write_uint(void *ta_parent, bstr *b, unsigned char c, int bytes,
+                       uint64_t v)
+{
+    unsigned char buf[9] = {c};
+    for (int n = 0; n < bytes; n++)
+        buf[1 + n] = v >> ((bytes - 1 - n) * 8);
+    write_bytes(ta_parent, b, buf, 1 + bytes);
+}
+
+// Write a length-prefixed type. fix is the fixed-size type byte, or 0 if there
+// is none. base is the type byte for the 8 bit length, min_bytes the smallest
+// length size allowed for this type (types are in ascending size order).
+static void write_len(void *ta_parent, bstr *b, uint64_t len, int fix_max,
+                      unsigned char fix, unsigned char base, int min_bytes)
+{
+    if (fix && len <= fix_max) {
+        write_uint(ta_parent, b, fix | len, 0, 0);
+    } else if (min_bytes <= 1 && len <= UINT8_MAX) {
+        write_uint(ta_parent, b, base, 1, len);
+    } else if (min_bytes <= 2 && len <= UINT16_MAX) {
+        write_uint(ta_parent, b, base + (min_bytes <= 1), 2, len);
+    } else {
+        write_uint(ta_parent, b, base + (min_bytes <= 1) + 1, 4, len);
+    }
+}
+
+static void write_str(void *ta_parent, bstr *b, const char *s)
+{
+    size_t len = strlen(s);
+    write_len(ta_parent, b, len, 31, 0xa0, 0xd9, 1);
+    write_bytes(ta_parent, b, s, len);
+}
+
+static int write_value(void *ta_parent, bstr *b, const struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_NONE:
+        write_uint(ta_parent, b, 0xc0, 0, 0);
+        return 0;
+    case MPV_FORMAT_FLAG:
+        write_uint(ta_parent, b, src->u.flag ? 0xc3 : 0xc2, 0, 0);
+        return 0;
+    case MPV_FORMAT_INT64: {
+        int64_t v = src->u.int64;
+        if (v >= 0 && v <= 0x7f) {
+            write_uint(ta_parent, b, v, 0, 0);
+        } else if (v < 0 && v >= -32) {
+            write_uint(ta_parent, b, (uint8_t)v, 0, 0);
+        } else if (v >= INT32_MIN && v <= INT32_MAX) {
+            write_uint(ta_parent, b, 0xd2, 4, (uint32_t)v);
+        } else {
+            write_uint(ta_parent, b, 0xd3, 8, (uint64_t)v);
+        }
+        return 0;
+    }
+    case MPV_FORMAT_DOUBLE: {
+        uint64_t v;
+        memcpy(&v, &src->u.double_, sizeof(v));
+        write_uint(ta_parent, b, 0xcb, 8, v);
+        return 0;
+    }
+    case MPV_FORMAT_STRING:
+        write_str(ta_parent, b, src->u.string);
+        return 0;
+    case MPV_FORMAT_BYTE_ARRAY: {
+        struct mpv_byte_array *ba = src->u.ba;
+        write_len(ta_parent, b, ba->size, 0, 0, 0xc4, 1);
+        write_bytes(ta_parent, b, ba->data, ba->size);
+        return 0;
+    }
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        bool is_map = src->format == MPV_FORMAT_NODE_MAP;
+        int num = list ? list->num : 0;
+        if (is_map) {
+            write_len(ta_parent, b, num, 15, 0x80, 0xde, 2);
+        } else {
+            write_len(ta_parent, b, num, 15, 0x90, 0xdc, 2);
+        }
+        for (int n = 0; n < num; n++) {
+            if (is_map)
+                write_str(ta_parent, b, list->keys[n]);
+            if (write_value(ta_parent, b, &list->values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    }
+    return -1; // unknown format
+}
+
+/* Write the contents of *src as MessagePack, and append it to *dst. dst->start
+ * must be NULL or a talloc allocation, and is reallocated with ta_parent (see
+ * bstr_xappend()).
+ * Returns: 0 on success, <0 on failure.
+ */
+int msgpack_write(void *ta_parent, bstr *dst, struct mpv_node *src)
+{
+    return write_value(ta_parent, dst, src);
+}
@@ -18,49 +18,142 @@
 #include <pthread.h>
 
 #include "common/common.h"
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
 
 #include "thread_pool.h"
 
-struct work {
+enum {
+    TASK_QUEUED,
+    TASK_RUNNING,
+    TASK_DONE,
+    TASK_CANCELLED,
+};
+
+struct mp_task {
+    struct mp_thread_pool *pool;
     void (*fn)(void *ctx);
     void *fn_ctx;
+    atomic_int state;   // TASK_*
+
+    // --- the following fields are protected by pool->lock
+    bool dequeued;      // no longer referenced by a worker queue
+    bool released;      // no longer referenced by the submitter
+};
+
+struct worker {
+    struct mp_thread_pool *pool;
+    pthread_t thread;
+    bool thread_ok;
+
+    pthread_mutex_t lock;
+    // --- the following fields are protected by lock
+    // The owner takes from the start (oldest first), other threads steal from
+    // the end.
+    struct mp_task **queue[MP_TASK_PRIO_COUNT];
+    int num_queue[MP_TASK_PRIO_COUNT];
 };
 
 struct mp_thread_pool {
-    pthread_t *threads;
-    int num_threads;
+    struct worker **workers;
+    int num_workers;
+
+    // Number of entries in all worker queues (including cancelled tasks that
+    // were not removed yet).
+    atomic_int num_pending;
+    atomic_uint next_worker;
 
     pthread_mutex_t lock;
-    pthread_cond_t wakeup;
+    pthread_cond_t wakeup;  // new work or terminate
+    pthread_cond_t done;    // some task finished or was cancelled
 
     // --- the following fields are protected by lock
     bool terminate;
-    struct work *work;
-    int num_work;
 };
 
-static void *worker_thread(void *arg)
+// Must be called with pool->lock held.
+static void task_unref_locked(struct mp_task *task, bool dequeue)
+{
+    if (dequeue) {
+        task->dequeued = true;
+    } else {
+        task->released = true;
+    }
+    if (task->dequeued && task->released)
+        talloc_free(task);
+}
+
+static struct mp_task *pop_task(struct worker *w, int prio, bool steal)
+{
+    struct mp_task *task = NULL;
+    pthread_mutex_lock(&w->lock);
+    if (w->num_queue[prio]) {
+        int idx = steal ? w->num_queue[prio] - 1 : 0;
+        task = w->queue[prio][idx];
+        MP_TARRAY_REMOVE_AT(w->queue[prio], w->num_queue[prio], idx);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return task;
+}
+
+// Take the next task to run for the worker self, with higher priorities first.
+// Within a priority class, the worker's own queue is tried first, then the
+// queues of the other workers.
+static struct mp_task *take_task(struct mp_thread_pool *pool,
+                                 struct worker *self)
+{
+    for (int prio = 0; prio < MP_TASK_PRIO_COUNT; prio++) {
+        struct mp_task *task = pop_task(self, prio, false);
+        for (int n = 0; n < pool->num_workers && !task; n++) {
+            if (pool->workers[n] != self)
+                task = pop_task(pool->workers[n], prio, true);
+        }
+        if (task) {
+            atomic_fetch_add(&pool->num_pending, -1);
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static void run_task(struct mp_thread_pool *pool, struct mp_task *task)
 {
-    struct mp_thread_pool *pool = arg;
+    int state = TASK_QUEUED;
+    bool run = atomic_compare_exchange_strong(&task->state, &state,
+                                              TASK_RUNNING);
+    if (run)
+        task->fn(task->fn_ctx);
 
     pthread_mutex_lock(&pool->lock);
-    while (1) {
-        while (!pool->num_work && !pool->terminate)
-            pthread_cond_wait(&pool->wakeup, &pool->lock);
+    if (run) {
+        atomic_store(&task->state, TASK_DONE);
+        pthread_cond_broadcast(&pool->done);
+    }
+    task_unref_locked(task, true);
+    pthread_mutex_unlock(&pool->lock);
+}
 
-        if (!pool->num_work && pool->terminate)
-            break;
+static void *worker_thread(void *arg)
+{
+    struct worker *w = arg;
+    struct mp_thread_pool *pool = w->pool;
+    mpthread_set_name("worker");
 
-        assert(pool->num_work > 0);
-        struct work work = pool->work[pool->num_work - 1];
-        pool->num_work -= 1;
+    while (1) {
+        struct mp_task *task = take_task(pool, w);
+        if (task) {
+            run_task(pool, task);
+            continue;
+        }
 
-        pthread_mutex_unlock(&pool->lock);
-        work.fn(work.fn_ctx);
         pthread_mutex_lock(&pool->lock);
+        while (!atomic_load(&pool->num_pending) && !pool->terminate)
+            pthread_cond_wait(&pool->wakeup, &pool->lock);
+        bool exit = !atomic_load(&pool->num_pending) && pool->terminate;
+        pthread_mutex_unlock(&pool->lock);
+        if (exit)
+            break;
     }
-    assert(pool->num_work == 0);
-    pthread_mutex_unlock(&pool->lock);
 
     return NULL;
 }
@@ -74,10 +167,16 @@ static void thread_pool_dtor(void *ctx)
     pthread_cond_broadcast(&pool->wakeup);
     pthread_mutex_unlock(&pool->lock);
 
-    for (int n = 0; n < pool->num_threads; n++)
-        pthread_join(pool->threads[n], NULL);
+    for (int n = 0; n < pool->num_workers; n++) {
+        struct worker *w = pool->workers[n];
+        if (w->thread_ok)
+            pthread_join(w->thread, NULL);
+    }
 
-    assert(pool->num_work == 0);
+    assert(atomic_load(&pool->num_pending) == 0);
+    for (int n = 0; n < pool->num_workers; n++)
+        pthread_mutex_destroy(&pool->workers[n]->lock);
+    pthread_cond_destroy(&pool->done);
     pthread_cond_destroy(&pool->wakeup);
     pthread_mutex_destroy(&pool->lock);
 }
@@ -96,30 +195,126 @@ struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int threads)
 
     pthread_mutex_init(&pool->lock, NULL);
     pthread_cond_init(&pool->wakeup, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    atomic_store(&pool->num_pending, 0);
+    atomic_store(&pool->next_worker, 0);
+
+    // All workers must exist before the first thread starts stealing.
+    for (int n = 0; n < threads; n++) {
+        struct worker *w = talloc_zero(pool, struct worker);
+        w->pool = pool;
+        pthread_mutex_init(&w->lock, NULL);
+        MP_TARRAY_APPEND(pool, pool->workers, pool->num_workers, w);
+    }
 
     for (int n = 0; n < threads; n++) {
-        pthread_t thread;
-        if (pthread_create(&thread, NULL, worker_thread, pool)) {
+        struct worker *w = pool->workers[n];
+        if (pthread_create(&w->thread, NULL, worker_thread, w)) {
             talloc_free(pool);
             return NULL;
         }
-        MP_TARRAY_APPEND(pool, pool->threads, pool->num_threads, thread);
+        w->thread_ok = true;
     }
 
     return pool;
 }
 
+// Queue a task with the given priority, and return a handle to it. The handle
+// must be released with mp_task_release() (which does not wait for or cancel
+// the task) before the pool is destroyed. Tasks queued from a worker thread go to that worker's own queue;
+// other threads distribute tasks round-robin. Idle workers steal work from the
+// other workers' queues. This function always returns immediately.
+// Concurrent calls are allowed, as long as they do not overlap with pool
+// destruction.
+struct mp_task *mp_thread_pool_submit(struct mp_thread_pool *pool,
+                                      enum mp_task_prio prio,
+                                      void (*fn)(void *ctx), void *fn_ctx)
+{
+    assert(prio >= 0 && prio < MP_TASK_PRIO_COUNT);
+
+    // Not allocated under pool, because talloc is not thread-safe.
+    struct mp_task *task = talloc_ptrtype(NULL, task);
+    *task = (struct mp_task){
+        .pool = pool,
+        .fn = fn,
+        .fn_ctx = fn_ctx,
+    };
+    atomic_store(&task->state, TASK_QUEUED);
+
+    struct worker *w = NULL;
+    pthread_t self = pthread_self();
+    for (int n = 0; n < pool->num_workers; n++) {
+        if (pthread_equal(pool->workers[n]->thread, self))
+            w = pool->workers[n];
+    }
+    if (!w) {
+        unsigned idx = atomic_fetch_add(&pool->next_worker, 1);
+        w = pool->workers[idx % pool->num_workers];
+    }
+
+    // Count it first, so that no worker goes to sleep while it is queued.
+    atomic_fetch_add(&pool->num_pending, 1);
+
+    pthread_mutex_lock(&w->lock);
+    MP_TARRAY_APPEND(w, w->queue[prio], w->num_queue[prio], task);
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    return task;
+}
+
 // Queue a function to be run on a worker thread: fn(fn_ctx)
-// If no worker thread is currently available, it's appended to a list in memory
-// with unbounded size. This function always returns immediately.
-// Concurrent queue calls are allowed, as long as it does not overlap with
-// pool destruction.
+// Same as mp_thread_pool_submit() with MP_TASK_PRIO_PLAYBACK, except that no
+// handle is returned.
 void mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
                           void *fn_ctx)
 {
+    mp_task_release(mp_thread_pool_submit(pool, MP_TASK_PRIO_PLAYBACK,
+                                          fn, fn_ctx));
+}
+
+// Prevent the task from running if it has not started yet. Returns true if it
+// was cancelled; false if it is already running or done.
+bool mp_task_cancel(struct mp_task *task)
+{
+    struct mp_thread_pool *pool = task->pool;
+    int state = TASK_QUEUED;
+    if (!atomic_compare_exchange_strong(&task->state, &state, TASK_CANCELLED))
+        return false;
+    // The queue entry is skipped and freed when a worker encounters it.
     pthread_mutex_lock(&pool->lock);
-    struct work work = {fn, fn_ctx};
-    MP_TARRAY_INSERT_AT(pool, pool->work, pool->num_work, 0, work);
-    pthread_cond_signal(&pool->wakeup);
+    pthread_cond_broadcast(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+// Block until the task has finished running, or was cancelled.
+void mp_task_wait(struct mp_task *task)
+{
+    struct mp_thread_pool *pool = task->pool;
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&task->state) < TASK_DONE)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Return whether mp_task_wait() would return immediately.
+bool mp_task_is_done(struct mp_task *task)
+{
+    return atomic_load(&task->state) >= TASK_DONE;
+}
+
+// Release the handle returned by mp_thread_pool_submit(). The task itself is
+// not affected. NULL is ignored.
+void mp_task_release(struct mp_task *task)
+{
+    if (!task)
+        return;
+    struct mp_thread_pool *pool = task->pool;
+    pthread_mutex_lock(&pool->lock);
+    task_unref_locked(task, false);
     pthread_mutex_unlock(&pool->lock);
 }
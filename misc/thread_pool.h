@@ -1,10 +1,30 @@
 #ifndef MPV_MP_THREAD_POOL_H
 #define MPV_MP_THREAD_POOL_H
 
+#include <stdbool.h>
+
 struct mp_thread_pool;
+struct mp_task;
+
+// Tasks of a higher priority class (lower value) are always started before
+// queued tasks of a lower class.
+enum mp_task_prio {
+    MP_TASK_PRIO_REALTIME,      // needed for the next frame
+    MP_TASK_PRIO_PLAYBACK,      // needed soon (default)
+    MP_TASK_PRIO_BACKGROUND,    // prefetching and other optional work
+    MP_TASK_PRIO_COUNT
+};
 
 struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int threads);
 void mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
                           void *fn_ctx);
+struct mp_task *mp_thread_pool_submit(struct mp_thread_pool *pool,
+                                      enum mp_task_prio prio,
+                                      void (*fn)(void *ctx), void *fn_ctx);
+
+bool mp_task_cancel(struct mp_task *task);
+void mp_task_wait(struct mp_task *task);
+bool mp_task_is_done(struct mp_task *task);
+void mp_task_release(struct mp_task *task);
 
 #endif
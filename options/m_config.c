@@ -58,6 +58,9 @@ struct m_config_shadow {
     pthread_mutex_t lock;
     struct m_config *root;
     char *data;
+    // Per root option: value of change_ts when it was last written.
+    long long *opt_ts;
+    long long change_ts;
     struct m_config_cache **listeners;
     int num_listeners;
 };
@@ -334,6 +337,45 @@ static void m_config_add_option(struct m_config *config,
                                 const void *optstruct_def,
                                 const struct m_option *arg);
 
+static void insert_index(struct m_config *config, int index)
+{
+    const char *name = config->opts[index].name;
+    unsigned mask = config->opts_index_size - 1;
+    unsigned h = bstr_hash(bstr0(name)) & mask;
+    while (config->opts_index[h] >= 0) {
+        // If there are duplicate names, the first option wins.
+        if (strcmp(config->opts[config->opts_index[h]].name, name) == 0)
+            return;
+        h = (h + 1) & mask;
+    }
+    config->opts_index[h] = index;
+}
+
+// Recreate the name lookup table from scratch, growing it if needed to keep
+// the load factor below 1/2.
+static void rebuild_index(struct m_config *config)
+{
+    int size = MPMAX(config->opts_index_size, 16);
+    while (size < config->num_opts * 2)
+        size *= 2;
+    config->opts_index_size = size;
+    config->opts_index = talloc_realloc(config, config->opts_index, int, size);
+    for (int n = 0; n < size; n++)
+        config->opts_index[n] = -1;
+    for (int n = 0; n < config->num_opts; n++)
+        insert_index(config, n);
+}
+
+// Add config->opts[index] to the name lookup table.
+static void add_to_index(struct m_config *config, int index)
+{
+    if (config->num_opts * 2 <= config->opts_index_size) {
+        insert_index(config, index);
+    } else {
+        rebuild_index(config);
+    }
+}
+
 static void add_options(struct m_config *config,
                         struct m_config_option *parent,
                         void *optstruct,
@@ -527,6 +569,7 @@ static void m_config_add_option(struct m_config *config,
             init_opt_inplace(arg, co.data, co.default_data);
 
         MP_TARRAY_APPEND(config, config->opts, config->num_opts, co);
+        add_to_index(config, config->num_opts - 1);
 
         if (arg->type == &m_option_type_obj_settings_list)
             init_obj_settings_list(config, (const struct m_obj_list *)arg->priv);
@@ -536,14 +579,16 @@ static void m_config_add_option(struct m_config *config,
 struct m_config_option *m_config_get_co_raw(const struct m_config *config,
                                             struct bstr name)
 {
-    if (!name.len)
+    if (!name.len || !config->opts_index_size)
         return NULL;
 
-    for (int n = 0; n < config->num_opts; n++) {
-        struct m_config_option *co = &config->opts[n];
-        struct bstr coname = bstr0(co->name);
-        if (bstrcmp(coname, name) == 0)
+    unsigned mask = config->opts_index_size - 1;
+    unsigned h = bstr_hash(name) & mask;
+    while (config->opts_index[h] >= 0) {
+        struct m_config_option *co = &config->opts[config->opts_index[h]];
+        if (bstr_equals0(name, co->name))
             return co;
+        h = (h + 1) & mask;
     }
 
     return NULL;
@@ -831,17 +876,18 @@ static struct m_config_option *m_config_mogrify_cli_opt(struct m_config *config,
     if (co && co->opt->type == &m_option_type_cli_alias)
         *name = bstr0((char *)co->opt->priv);
 
-    // Might be a suffix "action", like "--vf-add". Expensively check for
-    // matches. (We don't allow you to combine them with "--no-".)
-    for (int n = 0; n < config->num_opts; n++) {
-        co = &config->opts[n];
-        struct bstr basename = bstr0(co->name);
-
-        if (!bstr_startswith(*name, basename))
+    // Might be a suffix "action", like "--vf-add". Try each "-" as the
+    // separator between option name and action. (We don't allow you to
+    // combine them with "--no-".)
+    for (int pos = 1; pos < name->len; pos++) {
+        if (name->start[pos] != '-')
             continue;
+        struct bstr basename = bstr_splice(*name, 0, pos);
+        struct bstr suffix = bstr_cut(*name, pos + 1);
 
+        co = m_config_get_co_raw(config, basename);
         // Aliased option + a suffix action, e.g. --opengl-shaders-append
-        if (co->opt->type == &m_option_type_alias)
+        if (co && co->opt->type == &m_option_type_alias)
             co = m_config_get_co_any(config, basename);
         if (!co)
             continue;
@@ -849,12 +895,7 @@ static struct m_config_option *m_config_mogrify_cli_opt(struct m_config *config,
         const struct m_option_type *type = co->opt->type;
         for (int i = 0; type->actions && type->actions[i].name; i++) {
             const struct m_option_action *action = &type->actions[i];
-            bstr suffix = bstr0(action->name);
-
-            if (bstr_endswith(*name, suffix) &&
-                (name->len == basename.len + 1 + suffix.len) &&
-                name->start[basename.len] == '-')
-            {
+            if (bstr_equals0(suffix, action->name)) {
                 *out_add_flags = action->flags;
                 return co;
             }
@@ -1184,6 +1225,8 @@ void m_config_create_shadow(struct m_config *config)
 
     config->shadow = talloc_zero(config, struct m_config_shadow);
     config->shadow->data = talloc_zero_size(config->shadow, config->shadow_size);
+    config->shadow->opt_ts = talloc_zero_array(config->shadow, long long,
+                                               config->num_opts);
 
     config->shadow->root = config;
     pthread_mutex_init(&config->shadow->lock, NULL);
@@ -1243,7 +1286,12 @@ struct m_config_cache *m_config_cache_alloc(void *ta_parent,
     }
 
     cache->ts = -1;
+    cache->opt_ts = -1;
     cache->group = -1;
+    cache->opt_index = talloc_array(cache, int, config->num_opts);
+    cache->opt_changed = talloc_zero_array(cache, bool, config->num_opts);
+    for (int n = 0; n < config->num_opts; n++)
+        cache->opt_index[n] = n;
 
     for (int n = 0; n < config->num_groups; n++) {
         if (config->groups[n].group == group) {
@@ -1265,6 +1313,7 @@ struct m_config_cache *m_config_cache_alloc(void *ta_parent,
         for (int n = 0; n < num_opts; n++) {
             struct m_config_option *co = &config->opts[n];
             if (is_group_included(config, co->group, cache->group)) {
+                cache->opt_index[config->num_opts] = n;
                 config->opts[config->num_opts++] = *co;
             } else {
                 m_option_free(co->opt, co->data);
@@ -1274,6 +1323,7 @@ struct m_config_cache *m_config_cache_alloc(void *ta_parent,
             if (!is_group_included(config, n, cache->group))
                 TA_FREEP(&config->groups[n].opts);
         }
+        rebuild_index(config);
     }
 
     m_config_cache_update(cache);
@@ -1292,15 +1342,44 @@ bool m_config_cache_update(struct m_config_cache *cache)
 
     pthread_mutex_lock(&shadow->lock);
     cache->ts = atomic_load(&shadow->root->groups[cache->group].ts);
+    // Copy only options written since the last update.
     for (int n = 0; n < cache->shadow_config->num_opts; n++) {
         struct m_config_option *co = &cache->shadow_config->opts[n];
-        if (co->shadow_offset >= 0)
+        bool changed = shadow->opt_ts[cache->opt_index[n]] > cache->opt_ts;
+        cache->opt_changed[n] = changed;
+        if (changed && co->shadow_offset >= 0)
             m_option_copy(co->opt, co->data, shadow->data + co->shadow_offset);
     }
+    cache->opt_ts = shadow->change_ts;
     pthread_mutex_unlock(&shadow->lock);
     return true;
 }
 
+bool m_config_cache_is_changed(struct m_config_cache *cache, void *ptr)
+{
+    struct m_config *config = cache->shadow_config;
+
+    int group = -1;
+    for (int n = 0; n < config->num_groups; n++) {
+        if (config->groups[n].opts && config->groups[n].opts == ptr &&
+            n != cache->group)
+        {
+            group = n;
+            break;
+        }
+    }
+
+    for (int n = 0; n < config->num_opts; n++) {
+        struct m_config_option *co = &config->opts[n];
+        if (!cache->opt_changed[n])
+            continue;
+        if (group >= 0 ? is_group_included(config, co->group, group)
+                       : co->data == ptr)
+            return true;
+    }
+    return false;
+}
+
 void m_config_notify_change_co(struct m_config *config,
                                struct m_config_option *co)
 {
@@ -1310,6 +1389,8 @@ void m_config_notify_change_co(struct m_config *config,
         pthread_mutex_lock(&shadow->lock);
         if (co->shadow_offset >= 0)
             m_option_copy(co->opt, shadow->data + co->shadow_offset, co->data);
+        assert(co >= config->opts && co < config->opts + config->num_opts);
+        shadow->opt_ts[co - config->opts] = ++shadow->change_ts;
         pthread_mutex_unlock(&shadow->lock);
     }
 
@@ -61,6 +61,11 @@ typedef struct m_config {
     struct m_config_option *opts; // all options, even suboptions
     int num_opts;
 
+    // Hash table for looking up opts by name; open addressing, each entry is
+    // an index into opts or -1. Maintained by m_config_add_option().
+    int *opts_index;
+    int opts_index_size;        // power of 2
+
     // Creation parameters
     size_t size;
     const void *defaults;
@@ -276,6 +281,9 @@ struct m_config_cache {
     long long ts;
     int group;
     bool in_list;
+    long long opt_ts;   // m_config_shadow.change_ts at last update
+    int *opt_index;     // shadow_config option index -> root option index
+    bool *opt_changed;  // per shadow_config option: copied by last update
     // --- Implicitly synchronized by setting/unsetting wakeup_cb.
     struct mp_dispatch_queue *wakeup_dispatch_queue;
     void (*wakeup_dispatch_cb)(void *ctx);
@@ -321,6 +329,13 @@ void m_config_cache_set_dispatch_change_cb(struct m_config_cache *cache,
 // data itself will (e.g. string options might be reallocated).
 bool m_config_cache_update(struct m_config_cache *cache);
 
+// Return whether the last m_config_cache_update() call changed the option
+// whose field ptr points to (ptr must point into cache->opts). If ptr is a
+// pointer to a sub-struct (as set by OPT_SUBSTRUCT), return whether any
+// option within it changed. Only options which were actually written are
+// copied by m_config_cache_update(), and only those are reported.
+bool m_config_cache_is_changed(struct m_config_cache *cache, void *ptr);
+
 // Like m_config_cache_alloc(), but return the struct (m_config_cache->opts)
 // directly, with no way to update the config. Basically this returns a copy
 // with a snapshot of the current option values.
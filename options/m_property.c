@@ -46,49 +46,97 @@ struct m_property *m_property_list_find(const struct m_property *list,
     return NULL;
 }
 
-static int do_action(const struct m_property *prop_list, const char *name,
+struct m_property_index {
+    const struct m_property *list;
+    int *table;         // open addressing; index into list, or -1 if empty
+    unsigned mask;
+};
+
+struct m_property_index *m_property_index_create(void *ta_parent,
+                                                 const struct m_property *list)
+{
+    struct m_property_index *idx = talloc_zero(ta_parent, struct m_property_index);
+    idx->list = list;
+    int num = 0;
+    while (list[num].name)
+        num++;
+    int size = 16;
+    while (size < num * 2)
+        size *= 2;
+    idx->mask = size - 1;
+    idx->table = talloc_array(idx, int, size);
+    for (int n = 0; n < size; n++)
+        idx->table[n] = -1;
+    for (int n = 0; n < num; n++) {
+        unsigned h = bstr_hash(bstr0(list[n].name)) & idx->mask;
+        while (idx->table[h] >= 0) {
+            // Like m_property_list_find(), the first entry wins.
+            if (strcmp(list[idx->table[h]].name, list[n].name) == 0)
+                break;
+            h = (h + 1) & idx->mask;
+        }
+        if (idx->table[h] < 0)
+            idx->table[h] = n;
+    }
+    return idx;
+}
+
+struct m_property *m_property_index_find(const struct m_property_index *idx,
+                                         bstr name)
+{
+    unsigned h = bstr_hash(name) & idx->mask;
+    while (idx->table[h] >= 0) {
+        const struct m_property *prop = &idx->list[idx->table[h]];
+        if (bstr_equals0(name, prop->name))
+            return (struct m_property *)prop;
+        h = (h + 1) & idx->mask;
+    }
+    return NULL;
+}
+
+static int do_action(const struct m_property_index *props, const char *name,
                      int action, void *arg, void *ctx)
 {
     struct m_property *prop;
     struct m_property_action_arg ka;
-    const char *sep = strchr(name, '/');
-    if (sep && sep[1]) {
-        char base[128];
-        snprintf(base, sizeof(base), "%.*s", (int)(sep - name), name);
-        prop = m_property_list_find(prop_list, base);
+    bstr base;
+    char *rem;
+    if (m_property_split_path(name, &base, &rem) && rem[0]) {
+        prop = m_property_index_find(props, base);
         ka = (struct m_property_action_arg) {
-            .key = sep + 1,
+            .key = rem,
             .action = action,
             .arg = arg,
         };
         action = M_PROPERTY_KEY_ACTION;
         arg = &ka;
-    } else
-        prop = m_property_list_find(prop_list, name);
+    } else {
+        prop = m_property_index_find(props, bstr0(name));
+    }
     if (!prop)
         return M_PROPERTY_UNKNOWN;
     return prop->call(ctx, prop, action, arg);
 }
 
 // (as a hack, log can be NULL on read-only paths)
-int m_property_do(struct mp_log *log, const struct m_property *prop_list,
+int m_property_do(struct mp_log *log, const struct m_property_index *props,
                   const char *name, int action, void *arg, void *ctx)
 {
     union m_option_value val = {0};
     int r;
 
     struct m_option opt = {0};
-    r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, &opt, ctx);
+    r = do_action(props, name, M_PROPERTY_GET_TYPE, &opt, ctx);
     if (r <= 0)
         return r;
     assert(opt.type);
 
     switch (action) {
     case M_PROPERTY_PRINT: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_PRINT, arg, ctx)) >= 0)
+        if ((r = do_action(props, name, M_PROPERTY_PRINT, arg, ctx)) >= 0)
             return r;
         // Fallback to m_option
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(props, name, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_pretty_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -96,7 +144,7 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
         return str != NULL;
     }
     case M_PROPERTY_GET_STRING: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(props, name, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -105,45 +153,45 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     }
     case M_PROPERTY_SET_STRING: {
         struct mpv_node node = { .format = MPV_FORMAT_STRING, .u.string = arg };
-        return m_property_do(log, prop_list, name, M_PROPERTY_SET_NODE, &node, ctx);
+        return m_property_do(log, props, name, M_PROPERTY_SET_NODE, &node, ctx);
     }
     case M_PROPERTY_SWITCH: {
         if (!log)
             return M_PROPERTY_ERROR;
         struct m_property_switch_arg *sarg = arg;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SWITCH, arg, ctx)) !=
+        if ((r = do_action(props, name, M_PROPERTY_SWITCH, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
         // Fallback to m_option
-        r = m_property_do(log, prop_list, name, M_PROPERTY_GET_CONSTRICTED_TYPE,
+        r = m_property_do(log, props, name, M_PROPERTY_GET_CONSTRICTED_TYPE,
                           &opt, ctx);
         if (r <= 0)
             return r;
         assert(opt.type);
         if (!opt.type->add)
             return M_PROPERTY_NOT_IMPLEMENTED;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(props, name, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         opt.type->add(&opt, &val, sarg->inc, sarg->wrap);
-        r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+        r = do_action(props, name, M_PROPERTY_SET, &val, ctx);
         m_option_free(&opt, &val);
         return r;
     }
     case M_PROPERTY_GET_CONSTRICTED_TYPE: {
-        if ((r = do_action(prop_list, name, action, arg, ctx)) >= 0)
+        if ((r = do_action(props, name, action, arg, ctx)) >= 0)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, arg, ctx)) >= 0)
+        if ((r = do_action(props, name, M_PROPERTY_GET_TYPE, arg, ctx)) >= 0)
             return r;
         return M_PROPERTY_NOT_IMPLEMENTED;
     }
     case M_PROPERTY_SET: {
-        return do_action(prop_list, name, M_PROPERTY_SET, arg, ctx);
+        return do_action(props, name, M_PROPERTY_SET, arg, ctx);
     }
     case M_PROPERTY_GET_NODE: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_NODE, arg, ctx)) !=
+        if ((r = do_action(props, name, M_PROPERTY_GET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(props, name, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         struct mpv_node *node = arg;
         int err = m_option_get_node(&opt, NULL, node, &val);
@@ -160,7 +208,7 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     case M_PROPERTY_SET_NODE: {
         if (!log)
             return M_PROPERTY_ERROR;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SET_NODE, arg, ctx)) !=
+        if ((r = do_action(props, name, M_PROPERTY_SET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
         int err = m_option_set_node_or_string(log, &opt, name, &val, arg);
@@ -169,13 +217,13 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
         } else if (err < 0) {
             r = M_PROPERTY_INVALID_FORMAT;
         } else {
-            r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+            r = do_action(props, name, M_PROPERTY_SET, &val, ctx);
         }
         m_option_free(&opt, &val);
         return r;
     }
     default:
-        return do_action(prop_list, name, action, arg, ctx);
+        return do_action(props, name, action, arg, ctx);
     }
 }
 
@@ -206,14 +254,14 @@ static void m_property_unkey(int *action, void **arg)
     }
 }
 
-static int m_property_do_bstr(const struct m_property *prop_list, bstr name,
+static int m_property_do_bstr(const struct m_property_index *props, bstr name,
                               int action, void *arg, void *ctx)
 {
     char name0[64];
     if (name.len >= sizeof(name0))
         return M_PROPERTY_UNKNOWN;
     snprintf(name0, sizeof(name0), "%.*s", BSTR_P(name));
-    return m_property_do(NULL, prop_list, name0, action, arg, ctx);
+    return m_property_do(NULL, props, name0, action, arg, ctx);
 }
 
 static void append_str(char **s, int *len, bstr append)
@@ -224,7 +272,7 @@ static void append_str(char **s, int *len, bstr append)
     *len = *len + append.len;
 }
 
-static int expand_property(const struct m_property *prop_list, char **ret,
+static int expand_property(const struct m_property_index *props, char **ret,
                            int *ret_len, bstr prop, bool silent_error, void *ctx)
 {
     bool cond_yes = bstr_eatstart0(&prop, "?");
@@ -238,7 +286,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     int method = raw ? M_PROPERTY_GET_STRING : M_PROPERTY_PRINT;
 
     char *s = NULL;
-    int r = m_property_do_bstr(prop_list, prop, method, &s, ctx);
+    int r = m_property_do_bstr(props, prop, method, &s, ctx);
     bool skip;
     if (comp) {
         skip = ((s && bstr_equals0(comp_with, s)) != cond_yes);
@@ -255,7 +303,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     return skip;
 }
 
-char *m_properties_expand_string(const struct m_property *prop_list,
+char *m_properties_expand_string(const struct m_property_index *props,
                                  const char *str0, void *ctx)
 {
     char *ret = NULL;
@@ -281,7 +329,7 @@ char *m_properties_expand_string(const struct m_property *prop_list,
             bool have_fallback = bstr_eatstart0(&str, ":");
 
             if (!skip) {
-                skip = expand_property(prop_list, &ret, &ret_len, name,
+                skip = expand_property(props, &ret, &ret_len, name,
                                        have_fallback, ctx);
                 if (skip)
                     skip_level = level;
@@ -421,12 +469,15 @@ int m_property_read_sub(const struct m_sub_property *props, int action, void *ar
         node.format = MPV_FORMAT_NODE_MAP;
         node.u.list = talloc_zero(NULL, mpv_node_list);
         mpv_node_list *list = node.u.list;
+        int count = 0;
+        for (int n = 0; props && props[n].name; n++)
+            count += !props[n].unavailable;
+        list->values = talloc_array(list, mpv_node, count);
+        list->keys = talloc_array(list, char *, count);
         for (int n = 0; props && props[n].name; n++) {
             const struct m_sub_property *prop = &props[n];
             if (prop->unavailable)
                 continue;
-            MP_TARRAY_GROW(list, list->values, list->num);
-            MP_TARRAY_GROW(list, list->keys, list->num);
             mpv_node *val = &list->values[list->num];
             if (m_option_get_node(&prop->type, list, val, (void*)&prop->value) < 0)
             {
@@ -494,6 +545,67 @@ int m_property_read_sub(const struct m_sub_property *props, int action, void *ar
 // count: number of items.
 // get_item: callback to access a single item.
 // ctx: userdata passed to get_item.
+// Return items [start, start + num) as node array.
+static struct mpv_node read_list_node(int start, int num,
+                                      m_get_item_cb get_item, void *ctx)
+{
+    struct mpv_node node;
+    node.format = MPV_FORMAT_NODE_ARRAY;
+    node.u.list = talloc_zero(NULL, mpv_node_list);
+    node.u.list->num = num;
+    node.u.list->values = talloc_array(node.u.list, mpv_node, num);
+    for (int i = 0; i < num; i++) {
+        int n = start + i;
+        struct mpv_node *sub = &node.u.list->values[i];
+        sub->format = MPV_FORMAT_NONE;
+        int r;
+        r = get_item(n, M_PROPERTY_GET_NODE, sub, ctx);
+        if (r == M_PROPERTY_NOT_IMPLEMENTED) {
+            struct m_option opt = {0};
+            r = get_item(n, M_PROPERTY_GET_TYPE, &opt, ctx);
+            if (r != M_PROPERTY_OK)
+                goto err;
+            union m_option_value val = {0};
+            r = get_item(n, M_PROPERTY_GET, &val, ctx);
+            if (r != M_PROPERTY_OK)
+                goto err;
+            m_option_get_node(&opt, node.u.list, sub, &val);
+            m_option_free(&opt, &val);
+        err: ;
+        }
+    }
+    return node;
+}
+
+// Handle "range/<start>/<num>" keys, which return only the given slice of the
+// list (clipped to the list size), so clients don't need to fetch all items
+// of huge lists.
+static int read_list_range(struct m_property_action_arg *ka, int count,
+                           m_get_item_cb get_item, void *ctx)
+{
+    char *end = NULL;
+    const char *s = ka->key + strlen("range/");
+    long int start = strtol(s, &end, 10);
+    if (end == s || *end != '/')
+        return M_PROPERTY_UNKNOWN;
+    s = end + 1;
+    long int num = strtol(s, &end, 10);
+    if (end == s || *end || start < 0 || num < 0)
+        return M_PROPERTY_UNKNOWN;
+    start = MPMIN(start, MPMAX(count, 0));
+    num = MPMIN(num, MPMAX(count, 0) - start);
+
+    switch (ka->action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)ka->arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        *(struct mpv_node *)ka->arg = read_list_node(start, num, get_item, ctx);
+        return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 int m_property_read_list(int action, void *arg, int count,
                          m_get_item_cb get_item, void *ctx)
 {
@@ -502,34 +614,9 @@ int m_property_read_list(int action, void *arg, int count,
     case M_PROPERTY_GET_TYPE:
         *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
         return M_PROPERTY_OK;
-    case M_PROPERTY_GET: {
-        struct mpv_node node;
-        node.format = MPV_FORMAT_NODE_ARRAY;
-        node.u.list = talloc_zero(NULL, mpv_node_list);
-        node.u.list->num = count;
-        node.u.list->values = talloc_array(node.u.list, mpv_node, count);
-        for (int n = 0; n < count; n++) {
-            struct mpv_node *sub = &node.u.list->values[n];
-            sub->format = MPV_FORMAT_NONE;
-            int r;
-            r = get_item(n, M_PROPERTY_GET_NODE, sub, ctx);
-            if (r == M_PROPERTY_NOT_IMPLEMENTED) {
-                struct m_option opt = {0};
-                r = get_item(n, M_PROPERTY_GET_TYPE, &opt, ctx);
-                if (r != M_PROPERTY_OK)
-                    goto err;
-                union m_option_value val = {0};
-                r = get_item(n, M_PROPERTY_GET, &val, ctx);
-                if (r != M_PROPERTY_OK)
-                    goto err;
-                m_option_get_node(&opt, node.u.list, sub, &val);
-                m_option_free(&opt, &val);
-            err: ;
-            }
-        }
-        *(struct mpv_node *)arg = node;
+    case M_PROPERTY_GET:
+        *(struct mpv_node *)arg = read_list_node(0, count, get_item, ctx);
         return M_PROPERTY_OK;
-    }
     case M_PROPERTY_PRINT: {
         // See m_property_read_sub() remarks.
         char *res = NULL;
@@ -561,6 +648,8 @@ int m_property_read_list(int action, void *arg, int count,
             }
             return M_PROPERTY_NOT_IMPLEMENTED;
         }
+        if (strncmp(ka->key, "range/", 6) == 0)
+            return read_list_range(ka, count, get_item, ctx);
         // This is expected of the form "123" or "123/rest"
         char *next = strchr(ka->key, '/');
         char *end = NULL;
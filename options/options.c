@@ -187,6 +187,8 @@ static const m_option_t mp_vo_opt_list[] = {
     OPT_STRING_VALIDATE("opengl-hwdec-interop", gl_hwdec_interop, 0,
                         ra_hwdec_validate_opt),
     OPT_REPLACED("hwdec-preload", "opengl-hwdec-interop"),
+    OPT_DOUBLE("frame-timing-log", frame_timing_log, M_OPT_RANGE,
+               .min = 0, .max = 3600),
     {0}
 };
 
@@ -276,8 +278,11 @@ const m_option_t mp_opts[] = {
     OPT_GENERAL(char**, "msg-level", msg_levels, CONF_PRE_PARSE | UPDATE_TERM,
                 .type = &m_option_type_msglevels),
     OPT_STRING("dump-stats", dump_stats, UPDATE_TERM | CONF_PRE_PARSE),
+    OPT_STRING("dump-trace", dump_trace, UPDATE_TERM | CONF_PRE_PARSE),
+    OPT_STRING("frame-timing-dump", frame_timing_dump, M_OPT_FILE),
     OPT_FLAG("msg-color", msg_color, CONF_PRE_PARSE | UPDATE_TERM),
     OPT_STRING("log-file", log_file, CONF_PRE_PARSE | M_OPT_FILE | UPDATE_TERM),
+    OPT_FLAG("log-file-async", log_file_async, CONF_PRE_PARSE | UPDATE_TERM),
     OPT_FLAG("msg-module", msg_module, UPDATE_TERM),
     OPT_FLAG("msg-time", msg_time, UPDATE_TERM),
 #if HAVE_WIN32_DESKTOP
@@ -290,10 +295,14 @@ const m_option_t mp_opts[] = {
                 {"belownormal", BELOW_NORMAL_PRIORITY_CLASS},
                 {"idle",        IDLE_PRIORITY_CLASS})),
 #endif
+    OPT_KEYVALUELIST("thread-affinity", thread_affinity, UPDATE_PRIORITY),
+    OPT_KEYVALUELIST("thread-priority", thread_priority, UPDATE_PRIORITY),
+    OPT_INTRANGE("memory-budget", memory_budget, UPDATE_MEM_BUDGET, 0, 1024 * 1024),
     OPT_FLAG("config", load_config, M_OPT_FIXED | CONF_PRE_PARSE),
     OPT_STRING("config-dir", force_configdir,
                M_OPT_FIXED | CONF_NOCFG | CONF_PRE_PARSE | M_OPT_FILE),
     OPT_STRINGLIST("reset-on-next-file", reset_options, 0),
+    OPT_FLAG("deferred-init", deferred_init, 0),
 
 #if HAVE_LUA || HAVE_JAVASCRIPT
     OPT_PATHLIST("scripts", script_files, M_OPT_FIXED),
@@ -307,6 +316,7 @@ const m_option_t mp_opts[] = {
     OPT_STRING("ytdl-format", lua_ytdl_format, 0),
     OPT_KEYVALUELIST("ytdl-raw-options", lua_ytdl_raw_options, 0),
     OPT_FLAG("load-stats-overlay", lua_load_stats, UPDATE_BUILTIN_SCRIPTS),
+    OPT_FLAG("lua-shared-thread", lua_shared_thread, 0),
 #endif
 
 // ------------------------- stream options --------------------
@@ -368,12 +378,14 @@ const m_option_t mp_opts[] = {
     OPT_FLAG("track-auto-selection", stream_auto_sel, 0),
 
     OPT_STRING("lavfi-complex", lavfi_complex, UPDATE_LAVFI_COMPLEX),
+    OPT_FLAG("lavfi-complex-keep-graph", lavfi_complex_keep_graph, 0),
 
     OPT_CHOICE("audio-display", audio_display, 0,
                ({"no", 0}, {"attachment", 1})),
 
     OPT_CHOICE_OR_INT("hls-bitrate", hls_bitrate, 0, 0, INT_MAX,
-                      ({"no", -1}, {"min", 0}, {"max", INT_MAX})),
+                      ({"no", -1}, {"min", 0}, {"max", INT_MAX},
+                       {"auto", -2})),
 
     OPT_STRINGLIST("display-tags", display_tags, 0),
 
@@ -390,10 +402,15 @@ const m_option_t mp_opts[] = {
     OPT_STRING("sub-demuxer", sub_demuxer_name, 0),
     OPT_FLAG("demuxer-thread", demuxer_thread, 0),
     OPT_FLAG("prefetch-playlist", prefetch_open, 0),
+    OPT_DOUBLE("prefetch-playlist-secs", prefetch_secs, M_OPT_MIN, .min = 0),
     OPT_FLAG("cache-pause", cache_pausing, 0),
+    OPT_DOUBLE("live-latency-target", live_latency_target, M_OPT_MIN, .min = 0),
+    OPT_DOUBLE("live-catchup-speed", live_catchup_speed, M_OPT_RANGE,
+               .min = 1, .max = 2),
 
     OPT_DOUBLE("mf-fps", mf_fps, 0),
     OPT_STRING("mf-type", mf_type, 0),
+    OPT_INTRANGE("mf-prefetch", mf_prefetch, 0, 0, 64),
 #if HAVE_TV
     OPT_SUBSTRUCT("tv", tv_params, tv_params_conf, 0),
 #endif /* HAVE_TV */
@@ -433,6 +450,10 @@ const m_option_t mp_opts[] = {
 
     OPT_STRING("ad", audio_decoders, 0),
     OPT_STRING("vd", video_decoders, 0),
+    OPT_INTRANGE("ad-queue-frames", audio_dec_queue, 0, 0, 1000),
+    OPT_INTRANGE("vd-queue-frames", video_dec_queue, 0, 0, 100),
+    OPT_INTRANGE("af-queue-frames", audio_filter_queue, 0, 0, 1000),
+    OPT_INTRANGE("vf-queue-frames", video_filter_queue, 0, 0, 100),
 
     OPT_STRING("audio-spdif", audio_spdif, 0),
 
@@ -446,6 +467,7 @@ const m_option_t mp_opts[] = {
                     .deprecation_message = "use --hwdec-image-format instead"),
 #endif
     OPT_IMAGEFORMAT("hwdec-image-format", hwdec_image_format, 0, .min = -1),
+    OPT_SIZE_BOX("hwdec-pool-size", hwdec_pool_size, 0),
 
     // -1 means auto aspect (prefer container size until aspect change)
     //  0 means square pixels
@@ -505,6 +527,9 @@ const m_option_t mp_opts[] = {
     OPT_CHOICE("sub-ass-shaper", ass_shaper, UPDATE_OSD,
                ({"simple", 0}, {"complex", 1})),
     OPT_FLAG("sub-ass-justify", ass_justify, 0),
+    OPT_FLAG("sub-ass-prefetch", ass_prefetch, 0),
+    OPT_INTRANGE("sub-ass-glyph-cache", ass_glyph_cache, 0, 0, 1000000),
+    OPT_INTRANGE("sub-ass-bitmap-cache", ass_bitmap_cache, 0, 0, 4096),
     OPT_CHOICE("sub-ass-override", ass_style_override, UPDATE_OSD,
                ({"no", 0}, {"yes", 1}, {"force", 3}, {"scale", 4}, {"strip", 5})),
     OPT_FLAG("sub-scale-by-window", sub_scale_by_window, UPDATE_OSD),
@@ -557,6 +582,8 @@ const m_option_t mp_opts[] = {
                 {"weak", -1})),
     OPT_DOUBLE("audio-buffer", audio_buffer, M_OPT_MIN | M_OPT_MAX,
                .min = 0, .max = 10),
+    OPT_DOUBLE("audio-buffer-max", audio_buffer_max, M_OPT_MIN | M_OPT_MAX,
+               .min = 0, .max = 10),
     OPT_FLOATRANGE("balance", balance, 0, -1, 1),
 
     OPT_STRING("title", wintitle, 0),
@@ -582,6 +609,9 @@ const m_option_t mp_opts[] = {
     OPT_FLAG("osd-fractions", osd_fractions, 0),
     OPT_FLOATRANGE("osd-scale", osd_scale, UPDATE_OSD, 0, 100),
     OPT_FLAG("osd-scale-by-window", osd_scale_by_window, 0),
+    OPT_FLAG("perf-overlay", perf_overlay, UPDATE_OSD),
+    OPT_DOUBLE("perf-overlay-interval", perf_overlay_interval, M_OPT_RANGE,
+               .min = 0.1, .max = 60),
 
     OPT_DOUBLE("sstep", step_sec, CONF_MIN, 0),
 
@@ -614,6 +644,9 @@ const m_option_t mp_opts[] = {
     OPT_FLAG("write-filename-in-watch-later-config", write_filename_in_watch_later_config, 0),
     OPT_FLAG("ignore-path-in-watch-later-config", ignore_path_in_watch_later_config, 0),
     OPT_STRING("watch-later-directory", watch_later_directory, M_OPT_FILE),
+    OPT_FLAG("watch-later-db", watch_later_db, 0),
+    OPT_INTRANGE("watch-later-db-entries", watch_later_db_entries, 0, 0,
+                 INT_MAX),
 
     OPT_FLAG("ordered-chapters", ordered_chapters, 0),
     OPT_STRING("ordered-chapters-files", ordered_chapters_files, M_OPT_FILE),
@@ -648,6 +681,8 @@ const m_option_t mp_opts[] = {
                ({"no", -1}, {"absolute", 0}, {"yes", 1}, {"always", 1})),
     OPT_FLOAT("hr-seek-demuxer-offset", hr_seek_demuxer_offset, 0),
     OPT_FLAG("hr-seek-framedrop", hr_seek_framedrop, 0),
+    OPT_FLAG("scrub-keyframes", scrub_keyframes, 0),
+    OPT_INTRANGE("backstep-cache-frames", backstep_cache_frames, 0, 0, 200),
     OPT_CHOICE_OR_INT("autosync", autosync, 0, 0, 10000,
                       ({"no", -1})),
 
@@ -684,6 +719,9 @@ const m_option_t mp_opts[] = {
     OPT_STRING("screenshot-directory", screenshot_directory, M_OPT_FILE),
 
     OPT_STRING("record-file", record_file, M_OPT_FILE),
+    OPT_INTRANGE("record-file-buffer", record_file_buffer, 0, 0, INT_MAX),
+    OPT_CHOICE("record-file-overflow", record_file_overflow, 0,
+               ({"block", 0}, {"drop", 1})),
 
     OPT_SUBSTRUCT("", input_opts, input_config, 0),
 
@@ -864,6 +902,7 @@ const struct MPOpts mp_default_opts = {
     .cursor_autohide_delay = 1000,
     .video_osd = 1,
     .osd_level = 1,
+    .perf_overlay_interval = 1.0,
     .osd_duration = 1000,
     .osd_bar_align_y = 0.5,
     .osd_bar_w = 75.0,
@@ -894,10 +933,12 @@ const struct MPOpts mp_default_opts = {
     .sync_audio_drop_size = 0.020,
     .load_config = 1,
     .position_resume = 1,
+    .watch_later_db_entries = 10000,
     .autoload_files = 1,
     .demuxer_thread = 1,
     .hls_bitrate = INT_MAX,
     .cache_pausing = 1,
+    .live_catchup_speed = 1.1,
     .chapterrange = {-1, -1},
     .ab_loop = {MP_NOPTS_VALUE, MP_NOPTS_VALUE},
     .edition_id = -1,
@@ -947,6 +988,7 @@ const struct MPOpts mp_default_opts = {
     .ass_shaper = 1,
     .use_embedded_fonts = 1,
     .screenshot_template = "mpv-shot%n",
+    .record_file_buffer = 32 * 1024 * 1024,
 
     .hwdec_api = HAVE_RPI ? HWDEC_RPI : 0,
     .hwdec_codecs = "h264,vc1,wmv3,hevc,mpeg2video,vp9",
@@ -960,6 +1002,7 @@ const struct MPOpts mp_default_opts = {
     .index_mode = 1,
 
     .mf_fps = 1.0,
+    .mf_prefetch = 4,
 
     .display_tags = (char **)(const char*[]){
         "Artist", "Album", "Album_Artist", "Comment", "Composer", "Genre",
@@ -50,6 +50,8 @@ typedef struct mp_vo_opts {
 
     char *mmcss_profile;
 
+    double frame_timing_log;
+
     // vo_wayland, vo_drm
     struct sws_opts *sws_opts;
     // vo_opengl, vo_opengl_cb
@@ -72,6 +74,8 @@ typedef struct MPOpts {
     int property_print_help;
     int use_terminal;
     char *dump_stats;
+    char *dump_trace;
+    char *frame_timing_dump;
     int verbose;
     int msg_really_quiet;
     char **msg_levels;
@@ -79,6 +83,7 @@ typedef struct MPOpts {
     int msg_module;
     int msg_time;
     char *log_file;
+    int log_file_async;
 
     int operation_mode;
 
@@ -90,8 +95,10 @@ typedef struct MPOpts {
     char *lua_ytdl_format;
     char **lua_ytdl_raw_options;
     int lua_load_stats;
+    int lua_shared_thread;
 
     int auto_load_scripts;
+    int deferred_init;
 
     struct m_obj_settings *audio_driver_list;
     char *audio_device;
@@ -112,6 +119,7 @@ typedef struct MPOpts {
     float softvol_max;
     int gapless_audio;
     double audio_buffer;
+    double audio_buffer_max;
 
     mp_vo_opts *vo;
 
@@ -130,16 +138,24 @@ typedef struct MPOpts {
 
     char *audio_decoders;
     char *video_decoders;
+    int audio_dec_queue;
+    int video_dec_queue;
+    int audio_filter_queue;
+    int video_filter_queue;
     char *audio_spdif;
 
     int osd_level;
     int osd_duration;
     int osd_fractions;
     int video_osd;
+    int perf_overlay;
+    double perf_overlay_interval;
 
     int untimed;
     char *stream_dump;
     char *record_file;
+    int record_file_buffer;
+    int record_file_overflow;
     int stop_playback_on_init_failure;
     int loop_times;
     int loop_file;
@@ -168,6 +184,8 @@ typedef struct MPOpts {
     int hr_seek;
     float hr_seek_demuxer_offset;
     int hr_seek_framedrop;
+    int scrub_keyframes;
+    int backstep_cache_frames;
     float audio_delay;
     float default_max_pts_correction;
     int autosync;
@@ -196,11 +214,14 @@ typedef struct MPOpts {
     int write_filename_in_watch_later_config;
     int ignore_path_in_watch_later_config;
     char *watch_later_directory;
+    int watch_later_db;
+    int watch_later_db_entries;
     int pause;
     int keep_open;
     int keep_open_pause;
     double image_display_duration;
     char *lavfi_complex;
+    int lavfi_complex_keep_graph;
     int stream_id[2][STREAM_TYPE_COUNT];
     int stream_id_ff[STREAM_TYPE_COUNT];
     char **stream_lang[STREAM_TYPE_COUNT];
@@ -223,10 +244,13 @@ typedef struct MPOpts {
     char *demuxer_name;
     int demuxer_thread;
     int prefetch_open;
+    double prefetch_secs;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
 
     int cache_pausing;
+    double live_latency_target;
+    double live_catchup_speed;
 
     struct image_writer_opts *screenshot_image_opts;
     char *screenshot_template;
@@ -285,6 +309,9 @@ typedef struct MPOpts {
     int ass_hinting;
     int ass_shaper;
     int ass_justify;
+    int ass_prefetch;
+    int ass_glyph_cache;
+    int ass_bitmap_cache;
     int sub_clear_on_seek;
     int teletext_page;
 
@@ -292,8 +319,12 @@ typedef struct MPOpts {
     char *hwdec_codecs;
     int videotoolbox_format;
     int hwdec_image_format;
+    struct m_geometry hwdec_pool_size;
 
     int w32_priority;
+    char **thread_affinity;
+    char **thread_priority;
+    int memory_budget;
 
     struct tv_params *tv_params;
     struct pvr_params *stream_pvr_opts;
@@ -306,6 +337,7 @@ typedef struct MPOpts {
 
     double mf_fps;
     char *mf_type;
+    int mf_prefetch;
 
     struct demux_rawaudio_opts *demux_rawaudio;
     struct demux_rawvideo_opts *demux_rawvideo;
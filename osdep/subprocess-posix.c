@@ -23,11 +23,14 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
 
 #include "osdep/subprocess.h"
 
 #include "osdep/io.h"
 #include "common/common.h"
+#include "misc/bstr.h"
 #include "stream/stream.h"
 
 extern char **environ;
@@ -157,3 +160,123 @@ done:
 
     return status;
 }
+
+struct mp_subprocess_pipe {
+    pid_t pid;
+    int in_fd;      // socket, so writing to a dead process can't raise SIGPIPE
+    int out_fd;
+    bstr buf;       // stdout data not returned yet
+};
+
+static void destroy_pipe(void *ptr)
+{
+    struct mp_subprocess_pipe *p = ptr;
+    SAFE_CLOSE(p->in_fd);
+    SAFE_CLOSE(p->out_fd);
+    if (p->pid > 0) {
+        kill(p->pid, SIGKILL);
+        while (waitpid(p->pid, NULL, 0) < 0 && errno == EINTR) {}
+    }
+}
+
+struct mp_subprocess_pipe *mp_subprocess_pipe_create(void *ta_parent,
+                                                     char **args)
+{
+    struct mp_subprocess_pipe *p = talloc_zero(ta_parent, struct mp_subprocess_pipe);
+    *p = (struct mp_subprocess_pipe){ .pid = -1, .in_fd = -1, .out_fd = -1 };
+    talloc_set_destructor(p, destroy_pipe);
+
+    posix_spawn_file_actions_t fa;
+    bool fa_destroy = false;
+    bool ok = false;
+    int p_stdin[2] = {-1, -1};
+    int p_stdout[2] = {-1, -1};
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, p_stdin) < 0)
+        goto done;
+    if (mp_make_cloexec_pipe(p_stdout) < 0)
+        goto done;
+
+    if (posix_spawn_file_actions_init(&fa))
+        goto done;
+    fa_destroy = true;
+    if (posix_spawn_file_actions_adddup2(&fa, p_stdin[0], 0))
+        goto done;
+    if (posix_spawn_file_actions_adddup2(&fa, p_stdout[1], 1))
+        goto done;
+
+    if (posix_spawnp(&p->pid, args[0], &fa, NULL, args, environ)) {
+        p->pid = -1;
+        goto done;
+    }
+
+    p->in_fd = p_stdin[1];
+    p_stdin[1] = -1;
+    p->out_fd = p_stdout[0];
+    p_stdout[0] = -1;
+    ok = true;
+
+done:
+    if (fa_destroy)
+        posix_spawn_file_actions_destroy(&fa);
+    SAFE_CLOSE(p_stdin[0]);
+    SAFE_CLOSE(p_stdin[1]);
+    SAFE_CLOSE(p_stdout[0]);
+    SAFE_CLOSE(p_stdout[1]);
+    if (!ok)
+        TA_FREEP(&p);
+    return p;
+}
+
+bool mp_subprocess_pipe_write(struct mp_subprocess_pipe *p, const char *data,
+                              size_t size)
+{
+    while (size) {
+        ssize_t r = send(p->in_fd, data, size, MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        data += r;
+        size -= r;
+    }
+    return true;
+}
+
+char *mp_subprocess_pipe_read_line(struct mp_subprocess_pipe *p,
+                                   void *ta_parent, struct mp_cancel *cancel)
+{
+    while (1) {
+        char *nl = p->buf.len ? memchr(p->buf.start, '\n', p->buf.len) : NULL;
+        if (nl) {
+            size_t len = nl - (char *)p->buf.start;
+            char *res = bstrdup0(ta_parent, (bstr){p->buf.start, len});
+            p->buf.len -= len + 1;
+            memmove(p->buf.start, nl + 1, p->buf.len);
+            return res;
+        }
+
+        if (p->out_fd < 0)
+            return NULL;
+
+        struct pollfd fds[] = {
+            {.events = POLLIN, .fd = p->out_fd},
+            {.events = POLLIN, .fd = cancel ? mp_cancel_get_fd(cancel) : -1},
+        };
+        if (sparse_poll(fds, MP_ARRAY_SIZE(fds), -1) < 0 && errno != EINTR)
+            return NULL;
+        if (fds[1].revents)
+            return NULL;
+        if (fds[0].revents) {
+            char buf[4096];
+            ssize_t r = read(p->out_fd, buf, sizeof(buf));
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0) {
+                SAFE_CLOSE(p->out_fd);
+                continue;
+            }
+            bstr_xappend(p, &p->buf, (bstr){buf, r});
+        }
+    }
+}
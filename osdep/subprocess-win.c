@@ -357,3 +357,21 @@ done:
     talloc_free(tmp);
     return status;
 }
+
+struct mp_subprocess_pipe *mp_subprocess_pipe_create(void *ta_parent,
+                                                     char **args)
+{
+    return NULL;
+}
+
+bool mp_subprocess_pipe_write(struct mp_subprocess_pipe *p, const char *data,
+                              size_t size)
+{
+    return false;
+}
+
+char *mp_subprocess_pipe_read_line(struct mp_subprocess_pipe *p,
+                                   void *ta_parent, struct mp_cancel *cancel)
+{
+    return NULL;
+}
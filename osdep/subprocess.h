@@ -18,6 +18,7 @@
 #ifndef MP_SUBPROCESS_H_
 #define MP_SUBPROCESS_H_
 
+#include <stdbool.h>
 #include <stddef.h>
 
 struct mp_cancel;
@@ -36,4 +37,20 @@ int mp_subprocess(char **args, struct mp_cancel *cancel, void *ctx,
 struct mp_log;
 void mp_subprocess_detached(struct mp_log *log, char **args);
 
+// A subprocess that keeps running, with pipes connected to its stdin and
+// stdout, for line-based request/response protocols. stderr is inherited.
+// Freeing it with talloc_free() kills the process.
+struct mp_subprocess_pipe;
+
+// Returns NULL on failure (or if not supported on this platform).
+struct mp_subprocess_pipe *mp_subprocess_pipe_create(void *ta_parent,
+                                                     char **args);
+// Write data to the process' stdin. Returns false if it's gone.
+bool mp_subprocess_pipe_write(struct mp_subprocess_pipe *p, const char *data,
+                              size_t size);
+// Read the next line from stdout (without the line break), allocated under
+// ta_parent. Returns NULL on EOF, errors, or if cancel was triggered.
+char *mp_subprocess_pipe_read_line(struct mp_subprocess_pipe *p,
+                                   void *ta_parent, struct mp_cancel *cancel);
+
 #endif
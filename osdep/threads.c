@@ -16,14 +16,25 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "config.h"
 
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "mpv_talloc.h"
 #include "threads.h"
 #include "timer.h"
 
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *sched_ta;
+static char **sched_affinity;
+static char **sched_priority;
+
 int mpthread_mutex_init_recursive(pthread_mutex_t *mutex)
 {
     pthread_mutexattr_t attr;
@@ -34,6 +45,121 @@ int mpthread_mutex_init_recursive(pthread_mutex_t *mutex)
     return r;
 }
 
+#if HAVE_PTHREAD_AFFINITY
+// Parse a CPU list like "0-3,8".
+static bool parse_cpus(const char *s, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    bstr rest = bstr0(s);
+    while (rest.len) {
+        bstr item = bstr_split(rest, ",", &rest);
+        bstr_eatstart0(&rest, ",");
+        bstr end;
+        long long a = bstrtoll(item, &end, 10);
+        long long b = a;
+        if (bstr_eatstart0(&end, "-"))
+            b = bstrtoll(end, &end, 10);
+        if (end.len || a < 0 || b < a || b >= CPU_SETSIZE)
+            return false;
+        for (long long n = a; n <= b; n++)
+            CPU_SET(n, set);
+    }
+    return CPU_COUNT(set) > 0;
+}
+#endif
+
+// Parse "fifo", "rr", "fifo-10" etc.
+static bool parse_policy(const char *s, int *policy, int *prio)
+{
+    bstr rest;
+    bstr name = bstr_split(bstr0(s), "-", &rest);
+    if (bstr_equals0(name, "fifo")) {
+        *policy = SCHED_FIFO;
+    } else if (bstr_equals0(name, "rr")) {
+        *policy = SCHED_RR;
+    } else {
+        return false;
+    }
+    *prio = sched_get_priority_min(*policy);
+    if (bstr_eatstart0(&rest, "-")) {
+        *prio = bstrtoll(rest, &rest, 10);
+        if (*prio < sched_get_priority_min(*policy) ||
+            *prio > sched_get_priority_max(*policy))
+            return false;
+    }
+    return !rest.len;
+}
+
+static const char *find_key(char **list, const char *key)
+{
+    for (int n = 0; list && list[n] && list[n + 1]; n += 2) {
+        if (strcmp(list[n], key) == 0)
+            return list[n + 1];
+    }
+    return NULL;
+}
+
+static char **dup_list(void *ta_parent, char **list)
+{
+    int num = 0;
+    while (list && list[num])
+        num++;
+    char **res = talloc_array(ta_parent, char *, num + 1);
+    for (int n = 0; n < num; n++)
+        res[n] = talloc_strdup(res, list[n]);
+    res[num] = NULL;
+    return res;
+}
+
+void mpthread_set_sched_opts(struct mp_log *log, char **affinity,
+                             char **priority)
+{
+    for (int n = 0; affinity && affinity[n] && affinity[n + 1]; n += 2) {
+#if HAVE_PTHREAD_AFFINITY
+        cpu_set_t set;
+        if (!parse_cpus(affinity[n + 1], &set))
+            mp_err(log, "Invalid CPU list for thread '%s': %s\n",
+                   affinity[n], affinity[n + 1]);
+#else
+        mp_warn(log, "Setting thread affinity is not supported.\n");
+        break;
+#endif
+    }
+    for (int n = 0; priority && priority[n] && priority[n + 1]; n += 2) {
+        int policy, prio;
+        if (!parse_policy(priority[n + 1], &policy, &prio))
+            mp_err(log, "Invalid scheduling policy for thread '%s': %s\n",
+                   priority[n], priority[n + 1]);
+    }
+
+    pthread_mutex_lock(&sched_lock);
+    talloc_free(sched_ta);
+    sched_ta = talloc_new(NULL);
+    sched_affinity = dup_list(sched_ta, affinity);
+    sched_priority = dup_list(sched_ta, priority);
+    pthread_mutex_unlock(&sched_lock);
+}
+
+// Apply the settings for the named thread to the calling thread. Failures are
+// ignored (setting real-time priority usually requires privileges).
+static void apply_sched(const char *name)
+{
+    pthread_mutex_lock(&sched_lock);
+#if HAVE_PTHREAD_AFFINITY
+    const char *cpus = find_key(sched_affinity, name);
+    cpu_set_t set;
+    if (cpus && parse_cpus(cpus, &set))
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+    const char *sched = find_key(sched_priority, name);
+    int policy, prio;
+    if (sched && parse_policy(sched, &policy, &prio)) {
+        struct sched_param param = { .sched_priority = prio };
+        pthread_setschedparam(pthread_self(), policy, &param);
+    }
+    pthread_mutex_unlock(&sched_lock);
+}
+
 void mpthread_set_name(const char *name)
 {
     char tname[80];
@@ -48,4 +174,5 @@ void mpthread_set_name(const char *name)
 #elif HAVE_OSX_THREAD_NAME
     pthread_setname_np(tname);
 #endif
+    apply_sched(name);
 }
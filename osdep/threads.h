@@ -7,7 +7,18 @@
 // Helper to reduce boiler plate.
 int mpthread_mutex_init_recursive(pthread_mutex_t *mutex);
 
-// Set thread name (for debuggers).
+// Set thread name (for debuggers). This also applies the scheduling settings
+// set with mpthread_set_sched_opts() for this name.
 void mpthread_set_name(const char *name);
 
+struct mp_log;
+
+// Set the CPU affinity and real-time scheduling settings used for named
+// threads. Both are key/value lists (as in OPT_KEYVALUELIST), mapping thread
+// names to CPU lists ("0-3,8") and to scheduling policies ("fifo", "rr",
+// optionally with priority, e.g. "fifo-10"). This is process-wide, and
+// affects only threads started after the call.
+void mpthread_set_sched_opts(struct mp_log *log, char **affinity,
+                             char **priority);
+
 #endif
@@ -119,6 +119,20 @@ struct timespec mp_time_us_to_timespec(int64_t time_us)
     return ts;
 }
 
+int64_t mp_time_us_from_monotonic(int64_t monotonic_us)
+{
+    int64_t unow = mp_time_us();
+#if defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0 && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        int64_t mnow = ts.tv_sec * INT64_C(1000000) + ts.tv_nsec / 1000;
+        int64_t r = unow - (mnow - monotonic_us);
+        return MPMAX(r, 1);
+    }
+#endif
+    return unow;
+}
+
 struct timespec mp_rel_time_to_timespec(double timeout_sec)
 {
     return mp_time_us_to_timespec(mp_add_timeout(mp_time_us(), timeout_sec));
@@ -52,6 +52,11 @@ int64_t mp_add_timeout(int64_t time_us, double timeout_sec);
 // Convert the mp time in microseconds to a timespec using CLOCK_REALTIME.
 struct timespec mp_time_us_to_timespec(int64_t time_us);
 
+// Convert a CLOCK_MONOTONIC timestamp in microseconds (e.g. as reported by
+// DRM page flip events) to mp_time_us(). Returns the current time if the
+// platform has no monotonic clock.
+int64_t mp_time_us_from_monotonic(int64_t monotonic_us);
+
 // Convert the relative timeout in seconds to a timespec.
 // The timespec is absolute, using CLOCK_REALTIME.
 struct timespec mp_rel_time_to_timespec(double timeout_sec);
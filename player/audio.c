@@ -57,8 +57,213 @@ enum {
 
 #if HAVE_LIBAF
 
+#include <pthread.h>
+
 #include "audio/audio.h"
 #include "audio/filter/af.h"
+#include "misc/dec_thread.h"
+
+// Runs the filter chain on a separate thread (--af-queue-frames). The player
+// pushes decoded frames into the input queue, and fetches filtered frames from
+// the dec_thread queue. All other accesses to the filter chain pause or stop
+// the thread first (see af_worker_pause()).
+struct af_worker {
+    struct af_stream *afs;
+    struct mp_dec_thread *thread;
+    int max_input;
+
+    pthread_mutex_t lock;
+    // --- the following fields are protected by lock
+    struct mp_audio **in;
+    int num_in;
+    double in_duration;     // of queued input frames
+    double af_delay;        // af_calc_delay() after the last filter call
+    double out_duration;    // of filtered frames not fetched by the player yet
+    bool error;
+};
+
+static double mpa_duration(struct mp_audio *mpa)
+{
+    return mpa->rate > 0 ? mpa->samples / (double)mpa->rate : 0;
+}
+
+static int af_worker_step(void *ctx, void **frame)
+{
+    struct af_worker *w = ctx;
+
+    pthread_mutex_lock(&w->lock);
+    struct mp_audio *in = NULL;
+    if (w->num_in) {
+        in = w->in[0];
+        MP_TARRAY_REMOVE_AT(w->in, w->num_in, 0);
+        w->in_duration -= mpa_duration(in);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    int res = in ? DATA_AGAIN : DATA_WAIT;
+    struct mp_audio *out = NULL;
+    bool error = (in && af_filter_frame(w->afs, in) < 0) ||
+                 af_output_frame(w->afs, false) < 0;
+    if (!error)
+        out = af_read_output_frame(w->afs);
+    if (out)
+        res = DATA_OK;
+
+    pthread_mutex_lock(&w->lock);
+    w->af_delay = af_calc_delay(w->afs);
+    if (out)
+        w->out_duration += mpa_duration(out);
+    w->error |= error;
+    pthread_mutex_unlock(&w->lock);
+
+    *frame = out;
+    return error ? DATA_EOF : res;
+}
+
+static void af_worker_free_frame(void *frame)
+{
+    talloc_free(frame);
+}
+
+static const struct mp_dec_thread_fns af_worker_fns = {
+    .step = af_worker_step,
+    .free_frame = af_worker_free_frame,
+};
+
+static void af_worker_destroy(void *ptr)
+{
+    struct af_worker *w = ptr;
+    // Join the thread before freeing anything it could access.
+    talloc_free(w->thread);
+    for (int n = 0; n < w->num_in; n++)
+        talloc_free(w->in[n]);
+    pthread_mutex_destroy(&w->lock);
+}
+
+static void af_worker_create(struct MPContext *mpctx, struct ao_chain *ao_c)
+{
+    struct af_worker *w = talloc_zero(NULL, struct af_worker);
+    w->afs = ao_c->af;
+    w->max_input = mpctx->opts->audio_filter_queue;
+    pthread_mutex_init(&w->lock, NULL);
+    talloc_set_destructor(w, af_worker_destroy);
+
+    w->thread = mp_dec_thread_create(NULL, "af", &af_worker_fns, w,
+                                     w->max_input, mp_wakeup_core_cb, mpctx);
+    if (!w->thread) {
+        MP_ERR(mpctx, "Could not create audio filter thread.\n");
+        talloc_free(w);
+        return;
+    }
+    ao_c->af_worker = w;
+}
+
+// Wait until the thread is idle, so the filter chain can be accessed. The
+// thread is restarted the next time audio is filtered. Frames that were
+// already filtered are still returned.
+static void af_worker_pause(struct ao_chain *ao_c)
+{
+    if (ao_c && ao_c->af_worker)
+        mp_dec_thread_pause(ao_c->af_worker->thread);
+}
+
+// Like af_worker_pause(), but also drop all queued data (for seeks/reinit).
+static void af_worker_stop(struct ao_chain *ao_c)
+{
+    struct af_worker *w = ao_c ? ao_c->af_worker : NULL;
+    if (!w)
+        return;
+    mp_dec_thread_stop(w->thread);
+    for (int n = 0; n < w->num_in; n++)
+        talloc_free(w->in[n]);
+    w->num_in = 0;
+    w->in_duration = 0;
+    w->af_delay = 0;
+    w->out_duration = 0;
+    w->error = false;
+}
+
+// Queue a frame for filtering. Returns false if the input queue is full.
+static bool af_worker_write(struct ao_chain *ao_c, struct mp_audio *mpa)
+{
+    struct af_worker *w = ao_c->af_worker;
+    pthread_mutex_lock(&w->lock);
+    MP_TARRAY_APPEND(w, w->in, w->num_in, mpa);
+    w->in_duration += mpa_duration(mpa);
+    bool full = w->num_in >= w->max_input;
+    pthread_mutex_unlock(&w->lock);
+    mp_dec_thread_kick(w->thread);
+    return !full;
+}
+
+// Like af_output_frame() + af_read_output_frame(). Sets *out to NULL if no
+// frame is available yet. If eof is set, the remaining input is filtered and
+// drained synchronously.
+static int af_worker_read(struct ao_chain *ao_c, bool eof, struct mp_audio **out)
+{
+    struct af_worker *w = ao_c->af_worker;
+    *out = NULL;
+
+    if (eof) {
+        mp_dec_thread_pause(w->thread);
+    } else {
+        mp_dec_thread_kick(w->thread);
+    }
+
+    void *frame = NULL;
+    int r = mp_dec_thread_get(w->thread, &frame);
+
+    pthread_mutex_lock(&w->lock);
+    if (frame)
+        w->out_duration = MPMAX(w->out_duration - mpa_duration(frame), 0);
+    bool error = w->error;
+    pthread_mutex_unlock(&w->lock);
+
+    if (r == DATA_OK) {
+        *out = frame;
+        return 0;
+    }
+    if (error)
+        return -1;
+    if (!eof)
+        return 0;
+
+    // The thread is paused, so we can use the filter chain directly.
+    int res = 0;
+    for (int n = 0; n < w->num_in; n++) {
+        if (res >= 0 && af_filter_frame(w->afs, w->in[n]) < 0)
+            res = -1;
+        if (res < 0)
+            talloc_free(w->in[n]);
+    }
+    w->num_in = 0;
+    w->in_duration = 0;
+    if (res >= 0 && af_output_frame(w->afs, true) < 0)
+        res = -1;
+    if (res >= 0)
+        *out = af_read_output_frame(w->afs);
+    w->af_delay = af_calc_delay(w->afs);
+    return res;
+}
+
+// Filter delay (in output time) plus the duration of queued frames.
+static double af_get_delay(struct MPContext *mpctx, struct ao_chain *ao_c)
+{
+    struct af_worker *w = ao_c->af_worker;
+    if (!w)
+        return af_calc_delay(ao_c->af);
+
+    pthread_mutex_lock(&w->lock);
+    double delay = w->af_delay + w->out_duration +
+                   w->in_duration / mpctx->audio_speed;
+    pthread_mutex_unlock(&w->lock);
+    return delay;
+}
+
+void audio_pause_filters(struct MPContext *mpctx)
+{
+    af_worker_pause(mpctx->ao_chain);
+}
 
 // Use pitch correction only for speed adjustments by the user, not minor sync
 // correction ones.
@@ -78,6 +283,8 @@ static bool update_speed_filters(struct MPContext *mpctx)
     if (afs->initialized < 1)
         return false;
 
+    af_worker_pause(mpctx->ao_chain);
+
     // Make sure only exactly one filter changes speed; resetting them all
     // and setting 1 filter is the easiest way to achieve this.
     af_control_all(afs, AF_CONTROL_SET_PLAYBACK_SPEED, &(double){1});
@@ -180,6 +387,8 @@ void audio_update_volume(struct MPContext *mpctx)
     if (!ao_c || ao_c->af->initialized < 1)
         return;
 
+    af_worker_pause(ao_c);
+
     float gain = MPMAX(opts->softvol_volume / 100.0, 0);
     gain = pow(gain, 3);
     gain *= compute_replaygain(mpctx);
@@ -212,6 +421,8 @@ void audio_update_balance(struct MPContext *mpctx)
     if (!ao_c || ao_c->af->initialized < 1)
         return;
 
+    af_worker_pause(ao_c);
+
     float val = opts->balance;
 
     if (af_control_any_rev(ao_c->af, AF_CONTROL_SET_PAN_BALANCE, &val))
@@ -242,6 +453,8 @@ static int recreate_audio_filters(struct MPContext *mpctx)
 {
     assert(mpctx->ao_chain);
 
+    af_worker_stop(mpctx->ao_chain);
+
     struct af_stream *afs = mpctx->ao_chain->af;
     if (afs->initialized < 1 && af_init(afs) < 0)
         goto fail;
@@ -273,8 +486,9 @@ int reinit_audio_filters(struct MPContext *mpctx)
 
     double delay = 0;
     if (ao_c->af->initialized > 0)
-        delay = af_calc_delay(ao_c->af);
+        delay = af_get_delay(mpctx, ao_c);
 
+    af_worker_stop(ao_c);
     af_uninit(ao_c->af);
     if (recreate_audio_filters(mpctx) < 0)
         return -1;
@@ -291,14 +505,16 @@ int reinit_audio_filters(struct MPContext *mpctx)
 void audio_update_volume(struct MPContext *mpctx) {}
 void audio_update_balance(struct MPContext *mpctx) {}
 int reinit_audio_filters(struct MPContext *mpctx) { return 0; }
+void audio_pause_filters(struct MPContext *mpctx) {}
 
 #endif /* else HAVE_LIBAF */
 
 // Call this if opts->playback_speed or mpctx->speed_factor_* change.
 void update_playback_speed(struct MPContext *mpctx)
 {
-    mpctx->audio_speed = mpctx->opts->playback_speed * mpctx->speed_factor_a;
-    mpctx->video_speed = mpctx->opts->playback_speed * mpctx->speed_factor_v;
+    double speed = mpctx->opts->playback_speed * mpctx->speed_factor_live;
+    mpctx->audio_speed = speed * mpctx->speed_factor_a;
+    mpctx->video_speed = speed * mpctx->speed_factor_v;
 
 #if HAVE_LIBAF
     if (!mpctx->ao_chain || mpctx->ao_chain->af->initialized < 1)
@@ -316,6 +532,7 @@ static void ao_chain_reset_state(struct ao_chain *ao_c)
     TA_FREEP(&ao_c->input_frame);
     TA_FREEP(&ao_c->output_frame);
 #if HAVE_LIBAF
+    af_worker_stop(ao_c);
     af_seek_reset(ao_c->af);
 #endif
     if (ao_c->conv)
@@ -367,6 +584,7 @@ static void ao_chain_uninit(struct ao_chain *ao_c)
         lavfi_set_connected(ao_c->filter_src, false);
 
 #if HAVE_LIBAF
+    talloc_free(ao_c->af_worker);
     af_destroy(ao_c->af);
 #endif
     talloc_free(ao_c->conv);
@@ -403,6 +621,28 @@ static char *audio_config_to_str_buf(char *buf, size_t buf_sz, int rate,
     return buf;
 }
 
+// Whether the already opened AO can play the new decoder format without
+// reopening it and without loss of quality: the sample rate and channel layout
+// must match, and only conversion to an equal or wider sample format is needed.
+static bool ao_can_keep_format(struct MPContext *mpctx, struct mp_aframe *fmt)
+{
+    int ao_rate, ao_format;
+    struct mp_chmap ao_channels, channels;
+    ao_get_format(mpctx->ao, &ao_rate, &ao_format, &ao_channels);
+    int format = mp_aframe_get_format(fmt);
+    if (!mp_aframe_get_chmap(fmt, &channels))
+        return false;
+    if (!af_fmt_is_pcm(format) || !af_fmt_is_pcm(ao_format))
+        return false;
+    if (ao_rate != mp_aframe_get_rate(fmt) ||
+        !mp_chmap_equals(&ao_channels, &channels))
+        return false;
+    if (af_fmt_is_float(ao_format))
+        return true;
+    return !af_fmt_is_float(format) &&
+           af_fmt_to_bytes(ao_format) >= af_fmt_to_bytes(format);
+}
+
 static void reinit_audio_filters_and_output(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -417,9 +657,11 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
         return;
     }
 
-    // Weak gapless audio: drain AO on decoder format changes
+    // Weak gapless audio: drain AO on decoder format changes, unless the new
+    // format can be converted to the AO format losslessly.
     if (mpctx->ao_decoder_fmt && mpctx->ao && opts->gapless_audio < 0 &&
-        !mp_aframe_config_equals(mpctx->ao_decoder_fmt, ao_c->input_format))
+        !mp_aframe_config_equals(mpctx->ao_decoder_fmt, ao_c->input_format) &&
+        !ao_can_keep_format(mpctx, ao_c->input_format))
     {
         uninit_audio_out(mpctx);
     }
@@ -446,6 +688,8 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
     if (mpctx->ao && mp_audio_config_equals(&in_format, &afs->input))
         return;
 
+    af_worker_stop(ao_c);
+
     afs->output = (struct mp_audio){0};
     afs->output.rate = out_rate;
     mp_audio_set_format(&afs->output, out_format);
@@ -620,6 +864,11 @@ int init_audio_decoder(struct MPContext *mpctx, struct track *track)
     if (!audio_init_best_codec(d_audio))
         goto init_error;
 
+    if (d_audio->opts->audio_dec_queue > 0 &&
+        !audio_init_thread(d_audio, d_audio->opts->audio_dec_queue,
+                           mp_wakeup_core_cb, mpctx))
+        goto init_error;
+
     return 1;
 
 init_error:
@@ -658,6 +907,8 @@ void reinit_audio_chain_src(struct MPContext *mpctx, struct track *track)
     ao_c->af = af_new(mpctx->global);
     if (track && track->stream)
         ao_c->af->replaygain_data = track->stream->codec->replaygain_data;
+    if (mpctx->opts->audio_filter_queue > 0)
+        af_worker_create(mpctx, ao_c);
 #else
     ao_c->conv = mp_aconverter_create(mpctx->global, mpctx->log, NULL);
 #endif
@@ -714,7 +965,7 @@ double written_audio_pts(struct MPContext *mpctx)
     if (ao_c->af->initialized < 1)
         return MP_NOPTS_VALUE;
 
-    buffered_output += af_calc_delay(ao_c->af);
+    buffered_output += af_get_delay(mpctx, ao_c);
 #endif
 
     if (ao_c->conv)
@@ -904,9 +1155,15 @@ static bool copy_output(struct MPContext *mpctx, struct ao_chain *ao_c,
             TA_FREEP(&ao_c->output_frame);
 #if HAVE_LIBAF
             struct af_stream *afs = mpctx->ao_chain->af;
-            if (af_output_frame(afs, eof) < 0)
-                return true; // error, stop doing stuff
-            struct mp_audio *mpa = af_read_output_frame(afs);
+            struct mp_audio *mpa = NULL;
+            if (ao_c->af_worker) {
+                if (af_worker_read(ao_c, eof, &mpa) < 0)
+                    return true; // error, stop doing stuff
+            } else {
+                if (af_output_frame(afs, eof) < 0)
+                    return true; // error, stop doing stuff
+                mpa = af_read_output_frame(afs);
+            }
             ao_c->output_frame = mp_audio_to_aframe(mpa);
             talloc_free(mpa);
 #else
@@ -1050,8 +1307,16 @@ static int filter_audio(struct MPContext *mpctx, struct mp_audio_buffer *outbuf,
         ao_c->input_frame = NULL;
         if (!mpa)
             abort();
-        if (af_filter_frame(afs, mpa) < 0)
+        if (ao_c->af_worker) {
+            // Let the filter thread catch up once its input queue is full;
+            // it wakes us up when there's new output.
+            if (!af_worker_write(ao_c, mpa)) {
+                res = AD_WAIT;
+                break;
+            }
+        } else if (af_filter_frame(afs, mpa) < 0) {
             return AD_ERR;
+        }
 #else
         if (mp_aconverter_write_input(ao_c->conv, ao_c->input_frame))
             ao_c->input_frame = NULL;
@@ -1205,7 +1470,7 @@ void fill_audio_out_buffers(struct MPContext *mpctx)
              * implementation would require draining buffered old-format audio
              * while displaying video, then doing the output format switch.
              */
-            if (mpctx->opts->gapless_audio < 1)
+            if (!mpctx->opts->gapless_audio)
                 uninit_audio_out(mpctx);
             reinit_audio_filters_and_output(mpctx);
             mp_wakeup_core(mpctx);
@@ -31,12 +31,14 @@
 #include "input/cmd_list.h"
 #include "misc/ctype.h"
 #include "misc/dispatch.h"
+#include "misc/node.h"
 #include "misc/rendezvous.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/m_property.h"
 #include "options/path.h"
 #include "options/parse_configfile.h"
+#include "osdep/atomic.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
 #include "osdep/io.h"
@@ -86,6 +88,8 @@ struct observe_property {
     bool need_new_value;    // a new value should be retrieved
     bool updating;          // a new value is being retrieved
     bool dead;              // property unobserved while retrieving value
+    int64_t min_interval;   // minimum time between change events (us), or 0
+    int64_t next_update;    // mp_time_us() at which min_interval has passed
     bool new_value_valid, user_value_valid;
     union m_option_value new_value, user_value;
     struct mpv_handle *client;
@@ -114,24 +118,34 @@ struct mpv_handle {
     void *wakeup_cb_ctx;
     int wakeup_pipe[2];
 
+    // -- event queue
+    // This is a SPSC ringbuffer. The producer side (append_event()) is always
+    // called with mp_client_api.lock held, so there is only one producer at a
+    // time. The consumer is mpv_wait_event(), which the API user must not call
+    // concurrently, and which does not need any lock to read events.
+    mpv_event *events;      // ringbuffer of max_events entries
+    int max_events;         // allocated number of entries in events
+    int first_event;        // events[first_event] is the first readable event
+                            // (only accessed by the consumer)
+    int next_event;         // next entry written (only accessed by the producer)
+    atomic_int num_events;  // number of readable events
+    atomic_int used_events; // num_events + reserved_events (for overflow checks)
+    atomic_int reserved_events; // number of entries reserved for replies
+    atomic_bool choked;     // recovering from queue overflow
+    atomic_ullong event_mask;
+    atomic_ullong property_event_masks; // or-ed together event masks of all
+                                        // properties (written with lock held)
+
     // -- protected by lock
 
-    uint64_t event_mask;
     bool queued_wakeup;
     int suspend_count;
 
-    mpv_event *events;      // ringbuffer of max_events entries
-    int max_events;         // allocated number of entries in events
-    int first_event;        // events[first_event] is the first readable event
-    int num_events;         // number of readable events
-    int reserved_events;    // number of entries reserved for replies
-    bool choked;            // recovering from queue overflow
-
     struct observe_property **properties;
     int num_properties;
     int lowest_changed;     // attempt at making change processing incremental
     int properties_updating;
-    uint64_t property_event_masks; // or-ed together event masks of all properties
+    int64_t next_property_update; // earliest time a throttled property is due
 
     bool fuzzy_initialized; // see scripting.c wait_loaded()
     struct mp_log_buffer *messages;
@@ -250,8 +264,9 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
         .cur_event = talloc_zero(client, struct mpv_event),
         .events = talloc_array(client, mpv_event, num_events),
         .max_events = num_events,
-        .event_mask = (1ULL << INTERNAL_EVENT_BASE) - 1, // exclude internal events
+        .event_mask = ATOMIC_VAR_INIT((1ULL << INTERNAL_EVENT_BASE) - 1), // exclude internal events
         .wakeup_pipe = {-1, -1},
+        .next_property_update = INT64_MAX,
     };
     pthread_mutex_init(&client->lock, NULL);
     pthread_mutex_init(&client->wakeup_lock, NULL);
@@ -352,7 +367,7 @@ static void unlock_core(mpv_handle *ctx)
 void mpv_wait_async_requests(mpv_handle *ctx)
 {
     pthread_mutex_lock(&ctx->lock);
-    while (ctx->reserved_events || ctx->properties_updating)
+    while (atomic_load(&ctx->reserved_events) || ctx->properties_updating)
         wait_wakeup(ctx, INT64_MAX);
     pthread_mutex_unlock(&ctx->lock);
 }
@@ -378,10 +393,11 @@ void mpv_detach_destroy(mpv_handle *ctx)
     for (int n = 0; n < clients->num_clients; n++) {
         if (clients->clients[n] == ctx) {
             MP_TARRAY_REMOVE_AT(clients->clients, clients->num_clients, n);
-            while (ctx->num_events) {
+            // No producer can access the queue anymore.
+            while (atomic_load(&ctx->num_events)) {
                 talloc_free(ctx->events[ctx->first_event].data);
                 ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
-                ctx->num_events--;
+                atomic_fetch_add(&ctx->num_events, -1);
             }
             mp_msg_log_buffer_destroy(ctx->messages);
             pthread_cond_destroy(&ctx->wakeup);
@@ -555,55 +571,62 @@ static void dup_event_data(struct mpv_event *ev)
     }
 }
 
+// Take an entry from the free space of the ring buffer. Returns false if full.
+static bool acquire_event_entry(struct mpv_handle *ctx)
+{
+    int used = atomic_load(&ctx->used_events);
+    while (used < ctx->max_events) {
+        if (atomic_compare_exchange_strong(&ctx->used_events, &used, used + 1))
+            return true;
+    }
+    return false;
+}
+
 // Reserve an entry in the ring buffer. This can be used to guarantee that the
 // reply can be made, even if the buffer becomes congested _after_ sending
 // the request.
 // Returns an error code if the buffer is full.
 static int reserve_reply(struct mpv_handle *ctx)
 {
-    int res = MPV_ERROR_EVENT_QUEUE_FULL;
-    pthread_mutex_lock(&ctx->lock);
-    if (ctx->reserved_events + ctx->num_events < ctx->max_events && !ctx->choked)
-    {
-        ctx->reserved_events++;
-        res = 0;
-    }
-    pthread_mutex_unlock(&ctx->lock);
-    return res;
+    if (atomic_load(&ctx->choked) || !acquire_event_entry(ctx))
+        return MPV_ERROR_EVENT_QUEUE_FULL;
+    atomic_fetch_add(&ctx->reserved_events, 1);
+    return 0;
 }
 
-static int append_event(struct mpv_handle *ctx, struct mpv_event event, bool copy)
+// Write an event into an entry acquired with acquire_event_entry().
+// Must be called with mp_client_api.lock held (see mpv_handle.events).
+static void append_event(struct mpv_handle *ctx, struct mpv_event event)
 {
-    if (ctx->num_events + ctx->reserved_events >= ctx->max_events)
-        return -1;
-    if (copy)
-        dup_event_data(&event);
-    ctx->events[(ctx->first_event + ctx->num_events) % ctx->max_events] = event;
-    ctx->num_events++;
+    ctx->events[ctx->next_event] = event;
+    ctx->next_event = (ctx->next_event + 1) % ctx->max_events;
+    // Publishes the entry to the consumer.
+    atomic_fetch_add(&ctx->num_events, 1);
     wakeup_client(ctx);
-    return 0;
 }
 
+// Must be called with mp_client_api.lock held.
 static int send_event(struct mpv_handle *ctx, struct mpv_event *event, bool copy)
 {
-    pthread_mutex_lock(&ctx->lock);
     uint64_t mask = 1ULL << event->event_id;
-    if (ctx->property_event_masks & mask)
+    if (atomic_load(&ctx->property_event_masks) & mask) {
+        pthread_mutex_lock(&ctx->lock);
         notify_property_events(ctx, mask);
-    int r;
-    if (!(ctx->event_mask & mask)) {
-        r = 0;
-    } else if (ctx->choked) {
-        r = -1;
-    } else {
-        r = append_event(ctx, *event, copy);
-        if (r < 0) {
-            MP_ERR(ctx, "Too many events queued.\n");
-            ctx->choked = true;
-        }
+        pthread_mutex_unlock(&ctx->lock);
     }
-    pthread_mutex_unlock(&ctx->lock);
-    return r;
+    if (!(atomic_load(&ctx->event_mask) & mask))
+        return 0;
+    if (atomic_load(&ctx->choked))
+        return -1;
+    if (!acquire_event_entry(ctx)) {
+        MP_ERR(ctx, "Too many events queued.\n");
+        atomic_store(&ctx->choked, true);
+        return -1;
+    }
+    if (copy)
+        dup_event_data(event);
+    append_event(ctx, *event);
+    return 0;
 }
 
 // Send a reply; the reply must have been previously reserved with
@@ -612,13 +635,16 @@ static void send_reply(struct mpv_handle *ctx, uint64_t userdata,
                        struct mpv_event *event)
 {
     event->reply_userdata = userdata;
-    pthread_mutex_lock(&ctx->lock);
+    pthread_mutex_lock(&ctx->clients->lock);
+    append_event(ctx, *event);
     // If this fails, reserve_reply() probably wasn't called.
-    assert(ctx->reserved_events > 0);
-    ctx->reserved_events--;
-    if (append_event(ctx, *event, false) < 0)
-        abort(); // not reached
-    pthread_mutex_unlock(&ctx->lock);
+    int reserved = atomic_fetch_add(&ctx->reserved_events, -1);
+    assert(reserved > 0);
+    (void)reserved;
+    // For mpv_wait_async_requests(). Holding the lock also guarantees that
+    // mpv_detach_destroy() can't free ctx before we're done.
+    wakeup_client(ctx);
+    pthread_mutex_unlock(&ctx->clients->lock);
 }
 
 static void status_reply(struct mpv_handle *ctx, int event,
@@ -642,9 +668,8 @@ bool mp_client_event_is_registered(struct MPContext *mpctx, int event)
     if (!clients->event_masks) { // lazy update
         for (int n = 0; n < clients->num_clients; n++) {
             struct mpv_handle *ctx = clients->clients[n];
-            pthread_mutex_lock(&ctx->lock);
-            clients->event_masks |= ctx->event_mask | ctx->property_event_masks;
-            pthread_mutex_unlock(&ctx->lock);
+            clients->event_masks |= atomic_load(&ctx->event_mask) |
+                                    atomic_load(&ctx->property_event_masks);
         }
     }
     bool r = clients->event_masks & (1ULL << event);
@@ -728,10 +753,12 @@ int mpv_request_event(mpv_handle *ctx, mpv_event_id event, int enable)
     if (event == MPV_EVENT_SHUTDOWN && !enable)
         return MPV_ERROR_INVALID_PARAMETER;
     assert(event < (int)INTERNAL_EVENT_BASE); // excluded above; they have no name
-    pthread_mutex_lock(&ctx->lock);
     uint64_t bit = 1ULL << event;
-    ctx->event_mask = enable ? ctx->event_mask | bit : ctx->event_mask & ~bit;
-    pthread_mutex_unlock(&ctx->lock);
+    if (enable) {
+        atomic_fetch_or(&ctx->event_mask, bit);
+    } else {
+        atomic_fetch_and(&ctx->event_mask, ~bit);
+    }
     invalidate_global_event_mask(ctx);
     return 0;
 }
@@ -758,8 +785,8 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
         if (ctx->queued_wakeup)
             deadline = 0;
         // Recover from overflow.
-        if (ctx->choked && !ctx->num_events) {
-            ctx->choked = false;
+        if (atomic_load(&ctx->choked) && !atomic_load(&ctx->num_events)) {
+            atomic_store(&ctx->choked, false);
             event->event_id = MPV_EVENT_QUEUE_OVERFLOW;
             break;
         }
@@ -768,10 +795,11 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
             MP_ERR(ctx, "attempting to wait while core is suspended");
             break;
         }
-        if (ctx->num_events) {
+        if (atomic_load(&ctx->num_events)) {
             *event = ctx->events[ctx->first_event];
             ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
-            ctx->num_events--;
+            atomic_fetch_add(&ctx->num_events, -1);
+            atomic_fetch_add(&ctx->used_events, -1);
             talloc_steal(event, event->data);
             break;
         }
@@ -781,8 +809,10 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
         // Pop item from message queue, and return as event.
         if (gen_log_message_event(ctx))
             break;
-        int r = wait_wakeup(ctx, deadline);
-        if (r == ETIMEDOUT)
+        // Also wake up for changed properties delayed by their min_interval.
+        int64_t wait_until = MPMIN(deadline, ctx->next_property_update);
+        int r = wait_wakeup(ctx, wait_until);
+        if (r == ETIMEDOUT && wait_until == deadline)
             break;
     }
     ctx->queued_wakeup = false;
@@ -1312,6 +1342,99 @@ int mpv_get_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
     return run_async(ctx, getproperty_fn, req);
 }
 
+struct getproperties_request {
+    struct MPContext *mpctx;
+    const char **names;
+    struct mpv_node *res;
+};
+
+static void getproperties_fn(void *arg)
+{
+    struct getproperties_request *req = arg;
+    node_init(req->res, MPV_FORMAT_NODE_MAP, NULL);
+    for (int n = 0; req->names[n]; n++) {
+        struct mpv_node *entry =
+            node_map_add(req->res, req->names[n], MPV_FORMAT_NONE);
+        struct mpv_node node;
+        struct getproperty_request r = {
+            .mpctx = req->mpctx,
+            .name = req->names[n],
+            .format = MPV_FORMAT_NODE,
+            .data = &node,
+        };
+        getproperty_fn(&r);
+        if (r.status >= 0) {
+            talloc_steal(req->res->u.list, node_get_alloc(&node));
+            *entry = node;
+        }
+    }
+}
+
+int mpv_get_properties(mpv_handle *ctx, const char **names, mpv_node *result)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!names || !result)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    struct getproperties_request req = {
+        .mpctx = ctx->mpctx,
+        .names = names,
+        .res = result,
+    };
+    run_locked(ctx, getproperties_fn, &req);
+    return 0;
+}
+
+struct setproperties_request {
+    struct MPContext *mpctx;
+    struct mpv_node *props;
+    int status;
+};
+
+static void setproperties_fn(void *arg)
+{
+    struct setproperties_request *req = arg;
+    struct mpv_node_list *list = req->props->u.list;
+    req->status = 0;
+    for (int n = 0; n < list->num; n++) {
+        struct setproperty_request r = {
+            .mpctx = req->mpctx,
+            .name = list->keys[n],
+            .format = MPV_FORMAT_NODE,
+            .data = &list->values[n],
+        };
+        setproperty_fn(&r);
+        if (r.status < 0 && req->status >= 0)
+            req->status = r.status;
+    }
+}
+
+int mpv_set_properties(mpv_handle *ctx, mpv_node *props)
+{
+    if (!props || props->format != MPV_FORMAT_NODE_MAP)
+        return MPV_ERROR_INVALID_PARAMETER;
+    if (!ctx->mpctx->initialized) {
+        // Same as mpv_set_property(), which handles option semantics.
+        int status = 0;
+        struct mpv_node_list *list = props->u.list;
+        for (int n = 0; n < list->num; n++) {
+            int r = mpv_set_property(ctx, list->keys[n], MPV_FORMAT_NODE,
+                                     &list->values[n]);
+            if (r < 0 && status >= 0)
+                status = r;
+        }
+        return status;
+    }
+
+    struct setproperties_request req = {
+        .mpctx = ctx->mpctx,
+        .props = props,
+    };
+    run_locked(ctx, setproperties_fn, &req);
+    return req.status;
+}
+
 static void property_free(void *p)
 {
     struct observe_property *prop = p;
@@ -1325,6 +1448,15 @@ static void property_free(void *p)
 int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
                          const char *name, mpv_format format)
 {
+    return mpv_observe_property_interval(ctx, userdata, name, format, 0);
+}
+
+int mpv_observe_property_interval(mpv_handle *ctx, uint64_t userdata,
+                                  const char *name, mpv_format format,
+                                  double min_interval)
+{
+    if (!(min_interval >= 0))
+        return MPV_ERROR_INVALID_PARAMETER;
     if (format != MPV_FORMAT_NONE && !get_mp_type_get(format))
         return MPV_ERROR_PROPERTY_FORMAT;
     // Explicitly disallow this, because it would require a special code path.
@@ -1343,9 +1475,10 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
         .format = format,
         .changed = true,
         .need_new_value = true,
+        .min_interval = MPMIN(min_interval, 1e6) * 1e6,
     };
     MP_TARRAY_APPEND(ctx, ctx->properties, ctx->num_properties, prop);
-    ctx->property_event_masks |= prop->event_mask;
+    atomic_fetch_or(&ctx->property_event_masks, prop->event_mask);
     ctx->lowest_changed = 0;
     pthread_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
@@ -1355,7 +1488,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
 int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
 {
     pthread_mutex_lock(&ctx->lock);
-    ctx->property_event_masks = 0;
+    uint64_t masks = 0;
     int count = 0;
     for (int n = ctx->num_properties - 1; n >= 0; n--) {
         struct observe_property *prop = ctx->properties[n];
@@ -1373,8 +1506,9 @@ int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
             count++;
         }
         if (!prop->dead)
-            ctx->property_event_masks |= prop->event_mask;
+            masks |= prop->event_mask;
     }
+    atomic_store(&ctx->property_event_masks, masks);
     ctx->lowest_changed = 0;
     pthread_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
@@ -1468,10 +1602,24 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
         return false;
     int start = ctx->lowest_changed;
     ctx->lowest_changed = ctx->num_properties;
+    ctx->next_property_update = INT64_MAX;
+    int64_t now = 0;
     for (int n = start; n < ctx->num_properties; n++) {
         struct observe_property *prop = ctx->properties[n];
         if ((prop->changed || prop->updating) && n < ctx->lowest_changed)
             ctx->lowest_changed = n;
+        if (prop->changed && prop->min_interval) {
+            // Coalesce changes until the interval has passed. The property
+            // is not even read until then.
+            if (!now)
+                now = mp_time_us();
+            if (now < prop->next_update) {
+                ctx->next_property_update =
+                    MPMIN(ctx->next_property_update, prop->next_update);
+                continue;
+            }
+            prop->next_update = now + prop->min_interval;
+        }
         if (prop->changed) {
             bool get_value = prop->need_new_value;
             prop->need_new_value = false;
@@ -1718,6 +1866,26 @@ int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int w, int h)
 {
     return MPV_ERROR_NOT_IMPLEMENTED;
 }
+int mpv_opengl_cb_draw_ahead(mpv_opengl_cb_context *ctx, int fbo, int w, int h,
+                             int64_t target_time)
+{
+    return MPV_ERROR_NOT_IMPLEMENTED;
+}
+int mpv_opengl_cb_set_render_ahead(mpv_opengl_cb_context *ctx, int frames)
+{
+    return MPV_ERROR_NOT_IMPLEMENTED;
+}
+mpv_opengl_cb_context *mpv_opengl_cb_create_view(mpv_opengl_cb_context *ctx)
+{
+    return NULL;
+}
+void mpv_opengl_cb_destroy_view(mpv_opengl_cb_context *view)
+{
+}
+int mpv_opengl_cb_set_fast_rendering(mpv_opengl_cb_context *ctx, int fast)
+{
+    return MPV_ERROR_NOT_IMPLEMENTED;
+}
 int mpv_opengl_cb_report_flip(mpv_opengl_cb_context *ctx, int64_t time)
 {
     return MPV_ERROR_NOT_IMPLEMENTED;
@@ -39,6 +39,7 @@
 #include "common/msg.h"
 #include "common/msg_control.h"
 #include "command.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 #include "common/common.h"
 #include "input/input.h"
@@ -46,6 +47,8 @@
 #include "stream/stream.h"
 #include "demux/demux.h"
 #include "demux/stheader.h"
+#include "common/mem_budget.h"
+#include "common/perf.h"
 #include "common/playlist.h"
 #include "sub/osd.h"
 #include "sub/dec_sub.h"
@@ -56,6 +59,7 @@
 #include "video/decode/vd.h"
 #include "video/out/vo.h"
 #include "video/csputils.h"
+#include "video/mp_image_pool.h"
 #include "audio/aframe.h"
 #include "audio/format.h"
 #include "audio/out/ao.h"
@@ -64,6 +68,7 @@
 #include "video/out/bitmap_packer.h"
 #include "options/path.h"
 #include "screenshot.h"
+#include "preview.h"
 #include "misc/node.h"
 
 #include "osdep/io.h"
@@ -82,6 +87,7 @@
 struct command_ctx {
     // All properties, terminated with a {0} item.
     struct m_property *properties;
+    struct m_property_index *properties_index;
 
     bool is_idle;
 
@@ -362,7 +368,8 @@ int mp_on_set_option(void *ctx, struct m_config_option *co, void *data, int flag
     // property implementation is trivial, and can break some obscure features
     // like --profile and --include if non-trivial flags are involved (which
     // the bridge would drop).
-    struct m_property *prop = m_property_list_find(cmd->properties, name);
+    struct m_property *prop =
+        m_property_index_find(cmd->properties_index, bstr0(name));
     if (prop && prop->is_option)
         goto direct_option;
 
@@ -1463,6 +1470,7 @@ static int mp_property_filter_metadata(void *ctx, struct m_property *prop,
             if (!(mpctx->ao_chain && mpctx->ao_chain->af))
                 return M_PROPERTY_UNAVAILABLE;
             struct af_stream *af = mpctx->ao_chain->af;
+            audio_pause_filters(mpctx);
             res = af_control_by_label(af, AF_CONTROL_GET_METADATA, &metadata, key);
 #endif
         }
@@ -1486,6 +1494,36 @@ static int mp_property_filter_metadata(void *ctx, struct m_property *prop,
     return M_PROPERTY_NOT_IMPLEMENTED;
 }
 
+static int mp_property_filter_perf(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    const char *type = prop->priv;
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        if (strcmp(type, "vf") == 0) {
+            if (!mpctx->vo_chain)
+                return M_PROPERTY_UNAVAILABLE;
+            vf_get_perf_node(mpctx->vo_chain->vf, arg);
+            return M_PROPERTY_OK;
+        }
+#if HAVE_LIBAF
+        if (!(mpctx->ao_chain && mpctx->ao_chain->af))
+            return M_PROPERTY_UNAVAILABLE;
+        audio_pause_filters(mpctx);
+        af_get_perf_node(mpctx->ao_chain->af, arg);
+        return M_PROPERTY_OK;
+#else
+        return M_PROPERTY_UNAVAILABLE;
+#endif
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 static int mp_property_pause(void *ctx, struct m_property *prop,
                              int action, void *arg)
 {
@@ -1622,6 +1660,13 @@ static int mp_property_cache_used(void *ctx, struct m_property *prop,
     return property_int_kb_size(info.fill / 1024, action, arg);
 }
 
+static int mp_property_image_pool_used(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    return property_int_kb_size(mp_image_pool_get_total_bytes() / 1024,
+                                action, arg);
+}
+
 static int mp_property_cache_free(void *ctx, struct m_property *prop,
                                   int action, void *arg)
 {
@@ -1685,6 +1730,48 @@ static int mp_property_demuxer_cache_duration(void *ctx, struct m_property *prop
     return m_property_double_ro(action, arg, s.ts_duration);
 }
 
+static int mp_property_live_latency(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    double latency = get_live_latency(mpctx);
+    if (latency == MP_NOPTS_VALUE)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, latency);
+}
+
+static int mp_property_preview_frame(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    int64_t count;
+    struct mp_image *img = preview_get_frame(mpctx, &count);
+    if (!img)
+        return M_PROPERTY_UNAVAILABLE;
+
+    int r = M_PROPERTY_NOT_IMPLEMENTED;
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        r = M_PROPERTY_OK;
+        break;
+    case M_PROPERTY_GET: {
+        struct mpv_node node;
+        node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+        if (img->pts != MP_NOPTS_VALUE)
+            node_map_add(&node, "time", MPV_FORMAT_DOUBLE)->u.double_ = img->pts;
+        node_map_add(&node, "w", MPV_FORMAT_INT64)->u.int64 = img->w;
+        node_map_add(&node, "h", MPV_FORMAT_INT64)->u.int64 = img->h;
+        node_map_add(&node, "count", MPV_FORMAT_INT64)->u.int64 = count;
+        *(struct mpv_node *)arg = node;
+        r = M_PROPERTY_OK;
+        break;
+    }
+    }
+    talloc_free(img);
+    return r;
+}
+
 static int mp_property_demuxer_cache_time(void *ctx, struct m_property *prop,
                                           int action, void *arg)
 {
@@ -1755,6 +1842,8 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
     node_map_add_flag(r, "eof", s.eof);
     node_map_add_flag(r, "underrun", s.underrun);
     node_map_add_flag(r, "idle", s.idle);
+    if (s.bytes_per_second > 0)
+        node_map_add_int64(r, "raw-input-rate", llrint(s.bytes_per_second));
 
     return M_PROPERTY_OK;
 }
@@ -2012,6 +2101,29 @@ static int mp_property_ao(void *ctx, struct m_property *p, int action, void *arg
                                     mpctx->ao ? ao_get_name(mpctx->ao) : NULL);
 }
 
+static int mp_property_ao_buffer(void *ctx, struct m_property *prop,
+                                 int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->ao)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct ao_buffer_state st;
+    ao_get_buffer_state(mpctx->ao, &st);
+    double latency = ao_get_delay(mpctx->ao);
+
+    struct m_sub_property props[] = {
+        {"target",      SUB_PROP_DOUBLE(st.target)},
+        {"device",      SUB_PROP_DOUBLE(st.device)},
+        {"underruns",   SUB_PROP_INT(st.underruns)},
+        {"late",        SUB_PROP_INT(st.late)},
+        {"latency",     SUB_PROP_DOUBLE(latency)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
 /// Audio delay (RW)
 static int mp_property_audio_delay(void *ctx, struct m_property *prop,
                                    int action, void *arg)
@@ -2471,6 +2583,107 @@ static int mp_property_hwdec(void *ctx, struct m_property *prop,
     return mp_property_generic_option(mpctx, prop, action, arg);
 }
 
+static int mp_property_decoder_threads(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    struct dec_video *vd = track ? track->d_video : NULL;
+
+    struct vd_threads_info info;
+    if (!vd || video_vd_control(vd, VDCTRL_GET_THREADS, &info) != CONTROL_TRUE)
+        return M_PROPERTY_UNAVAILABLE;
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET: {
+        struct mpv_node node;
+        node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+        node_map_add(&node, "threads", MPV_FORMAT_INT64)->u.int64 = info.threads;
+        if (info.timed_frames) {
+            node_map_add(&node, "frame-time", MPV_FORMAT_DOUBLE)->u.double_ =
+                info.frame_time;
+        }
+        double fps = vd->fps;
+        if (info.timed_frames && fps > 0) {
+            node_map_add(&node, "load", MPV_FORMAT_DOUBLE)->u.double_ =
+                info.frame_time * fps;
+        }
+        *(struct mpv_node *)arg = node;
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_decoder_dr(void *ctx, struct m_property *prop,
+                                  int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    struct dec_video *vd = track ? track->d_video : NULL;
+
+    struct vd_dr_info info;
+    if (!vd || video_vd_control(vd, VDCTRL_GET_DR_INFO, &info) != CONTROL_TRUE)
+        return M_PROPERTY_UNAVAILABLE;
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET: {
+        struct mpv_node node;
+        node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+        node_map_add(&node, "active", MPV_FORMAT_FLAG)->u.flag = info.active;
+        node_map_add(&node, "frames", MPV_FORMAT_INT64)->u.int64 = info.frames;
+        node_map_add(&node, "direct-frames", MPV_FORMAT_INT64)->u.int64 =
+            info.direct_frames;
+        if (info.frames) {
+            node_map_add(&node, "hit-rate", MPV_FORMAT_DOUBLE)->u.double_ =
+                info.direct_frames / (double)info.frames;
+        }
+        *(struct mpv_node *)arg = node;
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_hwdec_pool(void *ctx, struct m_property *prop,
+                                  int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    struct dec_video *vd = track ? track->d_video : NULL;
+
+    struct vd_hwdec_pool_info info;
+    if (!vd || video_vd_control(vd, VDCTRL_GET_HWDEC_POOL, &info) != CONTROL_TRUE)
+        return M_PROPERTY_UNAVAILABLE;
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET: {
+        struct mpv_node node;
+        node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+        node_map_add(&node, "w", MPV_FORMAT_INT64)->u.int64 = info.w;
+        node_map_add(&node, "h", MPV_FORMAT_INT64)->u.int64 = info.h;
+        if (info.surfaces) {
+            node_map_add(&node, "surfaces", MPV_FORMAT_INT64)->u.int64 =
+                info.surfaces;
+            node_map_add(&node, "bytes", MPV_FORMAT_INT64)->u.int64 =
+                info.bytes;
+        }
+        *(struct mpv_node *)arg = node;
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 static int mp_property_hwdec_current(void *ctx, struct m_property *prop,
                                      int action, void *arg)
 {
@@ -2815,7 +3028,7 @@ static int mp_property_win_minimized(void *ctx, struct m_property *prop,
         return M_PROPERTY_UNAVAILABLE;
 
     int state = 0;
-    if (vo_control(vo, VOCTRL_GET_WIN_STATE, &state) < 1)
+    if (!vo_get_win_state(vo, &state))
         return M_PROPERTY_UNAVAILABLE;
 
     return m_property_flag_ro(action, arg, state & VO_WIN_STATE_MINIMIZED);
@@ -2986,6 +3199,151 @@ out:
     return ret;
 }
 
+static void get_pass_hist(struct mpv_node *node, const struct mp_pass_hist *h)
+{
+    node_map_add(node, "count", MPV_FORMAT_INT64)->u.int64 = h->count;
+    node_map_add(node, "p50", MPV_FORMAT_INT64)->u.int64 =
+        mp_pass_hist_percentile(h, 0.5);
+    node_map_add(node, "p90", MPV_FORMAT_INT64)->u.int64 =
+        mp_pass_hist_percentile(h, 0.9);
+    node_map_add(node, "p99", MPV_FORMAT_INT64)->u.int64 =
+        mp_pass_hist_percentile(h, 0.99);
+    node_map_add(node, "p999", MPV_FORMAT_INT64)->u.int64 =
+        mp_pass_hist_percentile(h, 0.999);
+    struct mpv_node *buckets = node_map_add(node, "buckets", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < VO_PERF_HIST_BUCKETS; n++) {
+        if (!h->buckets[n])
+            continue;
+        struct mpv_node *b = node_array_add(buckets, MPV_FORMAT_NODE_MAP);
+        node_map_add(b, "max", MPV_FORMAT_INT64)->u.int64 =
+            mp_pass_hist_bucket_max(n);
+        node_map_add(b, "count", MPV_FORMAT_INT64)->u.int64 = h->buckets[n];
+    }
+}
+
+static void get_frame_hist(struct mpv_node *node, struct mp_frame_perf *perf)
+{
+    get_pass_hist(node_map_add(node, "total", MPV_FORMAT_NODE_MAP),
+                  &perf->total);
+    struct mpv_node *passes = node_map_add(node, "passes", MPV_FORMAT_NODE_ARRAY);
+    for (int i = 0; i < perf->count; i++) {
+        struct mpv_node *pass = node_array_add(passes, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(pass, "desc", perf->desc[i]);
+        get_pass_hist(pass, &perf->hist[i]);
+    }
+}
+
+static int mp_property_vo_pass_histograms(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        break;
+    default:
+        return M_PROPERTY_NOT_IMPLEMENTED;
+    }
+
+    struct voctrl_performance_data *data = talloc_ptrtype(NULL, data);
+    if (vo_control(mpctx->video_out, VOCTRL_PERFORMANCE_DATA, data) <= 0) {
+        talloc_free(data);
+        return M_PROPERTY_UNAVAILABLE;
+    }
+
+    struct mpv_node node;
+    node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+    get_frame_hist(node_map_add(&node, "fresh", MPV_FORMAT_NODE_MAP),
+                   &data->fresh);
+    get_frame_hist(node_map_add(&node, "redraw", MPV_FORMAT_NODE_MAP),
+                   &data->redraw);
+    *(struct mpv_node *)arg = node;
+
+    talloc_free(data);
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_vo_gpu_memory(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        break;
+    default:
+        return M_PROPERTY_NOT_IMPLEMENTED;
+    }
+
+    struct voctrl_performance_data *data = talloc_ptrtype(NULL, data);
+    if (vo_control(mpctx->video_out, VOCTRL_PERFORMANCE_DATA, data) <= 0 ||
+        !data->gpu_mem.num_heaps)
+    {
+        talloc_free(data);
+        return M_PROPERTY_UNAVAILABLE;
+    }
+
+    struct mp_gpu_mem_stats *mem = &data->gpu_mem;
+    struct mpv_node node;
+    node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add(&node, "released", MPV_FORMAT_INT64)->u.int64 = mem->released;
+    struct mpv_node *heaps = node_map_add(&node, "heaps", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < mem->num_heaps; n++) {
+        struct mp_gpu_mem_heap *h = &mem->heaps[n];
+        struct mpv_node *heap = node_array_add(heaps, MPV_FORMAT_NODE_MAP);
+        node_map_add(heap, "usage", MPV_FORMAT_INT64)->u.int64 = h->usage;
+        node_map_add(heap, "flags", MPV_FORMAT_INT64)->u.int64 = h->flags;
+        node_map_add(heap, "slabs", MPV_FORMAT_INT64)->u.int64 = h->num_slabs;
+        node_map_add(heap, "free-regions", MPV_FORMAT_INT64)->u.int64 =
+            h->num_regions;
+        node_map_add(heap, "size", MPV_FORMAT_INT64)->u.int64 = h->size;
+        node_map_add(heap, "used", MPV_FORMAT_INT64)->u.int64 = h->used;
+    }
+    *(struct mpv_node *)arg = node;
+
+    talloc_free(data);
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_vo_shader_cache(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct voctrl_performance_data *data = talloc_ptrtype(NULL, data);
+    if (vo_control(mpctx->video_out, VOCTRL_PERFORMANCE_DATA, data) <= 0) {
+        talloc_free(data);
+        return M_PROPERTY_UNAVAILABLE;
+    }
+
+    struct mp_shader_cache_perf *perf = &data->shader_cache;
+    struct m_sub_property props[] = {
+        {"hits",            SUB_PROP_INT64(perf->hits)},
+        {"misses",          SUB_PROP_INT64(perf->misses)},
+        {"evictions",       SUB_PROP_INT64(perf->evictions)},
+        {"compile-time",    SUB_PROP_INT64(perf->compile_time)},
+        {"entries",         SUB_PROP_INT(perf->entries)},
+        {"max-entries",     SUB_PROP_INT(perf->max_entries)},
+        {0}
+    };
+
+    int ret = m_property_read_sub(props, action, arg);
+    talloc_free(data);
+    return ret;
+}
+
 static int mp_property_vo(void *ctx, struct m_property *p, int action, void *arg)
 {
     MPContext *mpctx = ctx;
@@ -3170,6 +3528,37 @@ static int mp_property_sub_text(void *ctx, struct m_property *prop,
     return m_property_strdup_ro(action, arg, text);
 }
 
+static int mp_property_sub_times(void *ctx, struct m_property *prop,
+                                 int action, void *arg, bool end)
+{
+    MPContext *mpctx = ctx;
+    struct track *track = mpctx->current_track[0][STREAM_SUB];
+    struct dec_sub *sub = track ? track->d_sub : NULL;
+    double pts = mpctx->playback_pts;
+    if (!sub || pts == MP_NOPTS_VALUE)
+        return M_PROPERTY_UNAVAILABLE;
+
+    double delay = mpctx->opts->sub_delay;
+    struct sd_times times = sub_get_times(sub, pts - delay);
+    double t = end ? times.end : times.start;
+    if (t == MP_NOPTS_VALUE)
+        return M_PROPERTY_UNAVAILABLE;
+
+    return property_time(action, arg, t + delay);
+}
+
+static int mp_property_sub_start(void *ctx, struct m_property *prop,
+                                 int action, void *arg)
+{
+    return mp_property_sub_times(ctx, prop, action, arg, false);
+}
+
+static int mp_property_sub_end(void *ctx, struct m_property *prop,
+                               int action, void *arg)
+{
+    return mp_property_sub_times(ctx, prop, action, arg, true);
+}
+
 static int mp_property_cursor_autohide(void *ctx, struct m_property *prop,
                                        int action, void *arg)
 {
@@ -3446,7 +3835,7 @@ static int mp_property_playlist(void *ctx, struct m_property *prop,
                     p = s;
             }
             const char *m = pl->current == e ? list_current : list_normal;
-            res = talloc_asprintf_append(res, "%s%s\n", m, p);
+            res = talloc_asprintf_append_buffer(res, "%s%s\n", m, p);
         }
 
         *(char **)arg =
@@ -3674,6 +4063,43 @@ static int mp_property_version(void *ctx, struct m_property *prop,
     return m_property_strdup_ro(action, arg, mpv_version);
 }
 
+static int mp_property_perf_counters(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        mp_perf_get_node(mpctx->global->perf, arg);
+        return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_startup_timings(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET: {
+        struct mpv_node node;
+        node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+        for (int n = 0; n < mpctx->num_init_phases; n++) {
+            struct init_phase *p = &mpctx->init_phases[n];
+            node_map_add(&node, p->name, MPV_FORMAT_DOUBLE)->u.double_ = p->time;
+        }
+        *(struct mpv_node *)arg = node;
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 static int mp_property_configuration(void *ctx, struct m_property *prop,
                                      int action, void *arg)
 {
@@ -3965,6 +4391,8 @@ static const struct m_property mp_properties_base[] = {
     {"chapter-metadata", mp_property_chapter_metadata},
     {"vf-metadata", mp_property_filter_metadata, .priv = "vf"},
     {"af-metadata", mp_property_filter_metadata, .priv = "af"},
+    {"vf-perf", mp_property_filter_perf, .priv = "vf"},
+    {"af-perf", mp_property_filter_perf, .priv = "af"},
     {"pause", mp_property_pause},
     {"core-idle", mp_property_core_idle},
     {"eof-reached", mp_property_eof_reached},
@@ -3975,8 +4403,10 @@ static const struct m_property mp_properties_base[] = {
     {"cache-used", mp_property_cache_used},
     {"cache-size", mp_property_cache_size},
     {"cache-idle", mp_property_cache_idle},
+    {"image-pool-used", mp_property_image_pool_used},
     {"cache-speed", mp_property_cache_speed},
     {"demuxer-cache-duration", mp_property_demuxer_cache_duration},
+    {"live-latency", mp_property_live_latency},
     {"demuxer-cache-time", mp_property_demuxer_cache_time},
     {"demuxer-cache-idle", mp_property_demuxer_cache_idle},
     {"demuxer-start-time", mp_property_demuxer_start_time},
@@ -4015,6 +4445,7 @@ static const struct m_property mp_properties_base[] = {
     {"audio-device", mp_property_audio_device},
     {"audio-device-list", mp_property_audio_devices},
     {"current-ao", mp_property_ao},
+    {"ao-buffer", mp_property_ao_buffer},
 
     // Video
     {"fullscreen", mp_property_fullscreen},
@@ -4035,6 +4466,9 @@ static const struct m_property mp_properties_base[] = {
     {"window-scale", mp_property_window_scale},
     {"vo-configured", mp_property_vo_configured},
     {"vo-passes", mp_property_vo_passes},
+    {"vo-pass-histograms", mp_property_vo_pass_histograms},
+    {"vo-shader-cache", mp_property_vo_shader_cache},
+    {"vo-gpu-memory", mp_property_vo_gpu_memory},
     {"current-vo", mp_property_vo},
     {"container-fps", mp_property_fps},
     {"estimated-vf-fps", mp_property_vf_fps},
@@ -4043,6 +4477,10 @@ static const struct m_property mp_properties_base[] = {
     {"program", mp_property_program},
     {"hwdec", mp_property_hwdec},
     {"hwdec-current", mp_property_hwdec_current},
+    {"decoder-threads", mp_property_decoder_threads},
+    {"hwdec-pool", mp_property_hwdec_pool},
+    {"decoder-dr", mp_property_decoder_dr},
+    {"preview-frame", mp_property_preview_frame},
     {"hwdec-interop", mp_property_hwdec_interop},
 
     {"estimated-frame-count", mp_property_frame_count},
@@ -4062,6 +4500,8 @@ static const struct m_property mp_properties_base[] = {
     {"sub-speed", mp_property_sub_speed},
     {"sub-pos", mp_property_sub_pos},
     {"sub-text", mp_property_sub_text},
+    {"sub-start", mp_property_sub_start},
+    {"sub-end", mp_property_sub_end},
 
     {"vf", mp_property_vf},
     {"af", mp_property_af},
@@ -4116,6 +4556,8 @@ static const struct m_property mp_properties_base[] = {
     {"encoder-list", mp_property_encoders},
 
     {"mpv-version", mp_property_version},
+    {"startup-timings", mp_property_startup_timings},
+    {"perf-counters", mp_property_perf_counters},
     {"mpv-configuration", mp_property_configuration},
     {"ffmpeg-version", mp_property_ffmpeg},
 
@@ -4157,8 +4599,9 @@ static const char *const *const mp_event_property_change[] = {
       "estimated-vf-fps", "drop-frame-count", "vo-drop-frame-count",
       "total-avsync-change", "audio-speed-correction", "video-speed-correction",
       "vo-delayed-frame-count", "mistimed-frame-count", "vsync-ratio",
-      "estimated-display-fps", "vsync-jitter", "sub-text", "audio-bitrate",
-      "video-bitrate", "sub-bitrate", "decoder-frame-drop-count",
+      "estimated-display-fps", "vsync-jitter", "sub-text", "sub-start",
+      "sub-end", "audio-bitrate", "video-bitrate", "sub-bitrate",
+      "decoder-frame-drop-count",
       "frame-drop-count"),
     E(MPV_EVENT_VIDEO_RECONFIG, "video-out-params", "video-params",
       "video-format", "video-codec", "video-bitrate", "dwidth", "dheight",
@@ -4257,7 +4700,8 @@ static int mp_property_do_silent(const char *name, int action, void *val,
 {
     struct command_ctx *cmd = ctx->command_ctx;
     cmd->silence_option_deprecations += 1;
-    int r = m_property_do(ctx->log, cmd->properties, name, action, val, ctx);
+    int r = m_property_do(ctx->log, cmd->properties_index, name, action, val,
+                          ctx);
     cmd->silence_option_deprecations -= 1;
     if (r == M_PROPERTY_OK && is_property_set(action, val))
         mp_notify_property(ctx, (char *)name);
@@ -4291,7 +4735,7 @@ int mp_property_do(const char *name, int action, void *val,
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    return m_properties_expand_string(ctx->properties, str, mpctx);
+    return m_properties_expand_string(ctx->properties_index, str, mpctx);
 }
 
 // Before expanding properties, parse C-style escapes like "\n"
@@ -4878,6 +5322,9 @@ static struct mpv_node *add_map_entry(struct mpv_node *dst, const char *key)
 #define ADD_MAP_CSTR(dst, name, s) (*add_map_entry(dst, name) = \
     (struct mpv_node){ .format = MPV_FORMAT_STRING, .u.string = (s) });
 
+#define ADD_MAP_DOUBLE(dst, name, d) (*add_map_entry(dst, name) = \
+    (struct mpv_node){ .format = MPV_FORMAT_DOUBLE, .u.double_ = (d) });
+
 int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *res)
 {
     struct command_ctx *cmdctx = mpctx->command_ctx;
@@ -5437,10 +5884,19 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
                            async);
         break;
 
-    case MP_CMD_SCREENSHOT_RAW: {
+    case MP_CMD_PREVIEW:
+        if (!preview_request(mpctx, cmd->args[0].v.d, cmd->args[1].v.i,
+                             cmd->args[2].v.i))
+            return -1;
+        break;
+
+    case MP_CMD_SCREENSHOT_RAW:
+    case MP_CMD_PREVIEW_RAW: {
         if (!res)
             return -1;
-        struct mp_image *img = screenshot_get_rgb(mpctx, cmd->args[0].v.i);
+        struct mp_image *img = cmd->id == MP_CMD_PREVIEW_RAW
+                             ? preview_get_frame(mpctx, NULL)
+                             : screenshot_get_rgb(mpctx, cmd->args[0].v.i);
         if (!img)
             return -1;
         struct mpv_node_list *info = talloc_zero(NULL, struct mpv_node_list);
@@ -5457,6 +5913,8 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
         };
         *add_map_entry(res, "data") =
             (struct mpv_node){.format = MPV_FORMAT_BYTE_ARRAY, .u.ba = ba,};
+        if (cmd->id == MP_CMD_PREVIEW_RAW && img->pts != MP_NOPTS_VALUE)
+            ADD_MAP_DOUBLE(res, "time", img->pts);
         break;
     }
 
@@ -5531,6 +5989,7 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
     case MP_CMD_AF_COMMAND:
         if (!mpctx->ao_chain)
             return -1;
+        audio_pause_filters(mpctx);
         return af_send_command(mpctx->ao_chain->af, cmd->args[0].v.s,
                                cmd->args[1].v.s, cmd->args[2].v.s);
 #endif
@@ -5614,6 +6073,11 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
         break;
     }
 
+    case MP_CMD_DUMP_FRAME_TIMINGS:
+        if (!write_frame_timings(mpctx, cmd->args[0].v.s))
+            return -1;
+        break;
+
     case MP_CMD_HOOK_ADD:
         if (!cmd->sender) {
             MP_ERR(mpctx, "Can be used from client API only.\n");
@@ -5777,6 +6241,8 @@ void command_init(struct MPContext *mpctx)
             ctx->properties[count++] = prop;
         }
     }
+
+    ctx->properties_index = m_property_index_create(ctx, ctx->properties);
 }
 
 static void command_event(struct MPContext *mpctx, int event, void *arg)
@@ -5820,11 +6286,13 @@ void mp_notify(struct MPContext *mpctx, int event, void *arg)
 
 static void update_priority(struct MPContext *mpctx)
 {
-#if HAVE_WIN32_DESKTOP
     struct MPOpts *opts = mpctx->opts;
+#if HAVE_WIN32_DESKTOP
     if (opts->w32_priority > 0)
         SetPriorityClass(GetCurrentProcess(), opts->w32_priority);
 #endif
+    mpthread_set_sched_opts(mpctx->log, opts->thread_affinity,
+                            opts->thread_priority);
 }
 
 void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags)
@@ -5883,6 +6351,11 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags)
     if (flags & UPDATE_PRIORITY)
         update_priority(mpctx);
 
+    if (flags & UPDATE_MEM_BUDGET) {
+        mp_mem_budget_set_limit(mpctx->global->mem_budget,
+                                mpctx->opts->memory_budget * 1024LL * 1024);
+    }
+
     if (flags & UPDATE_SCREENSAVER)
         update_screensaver_state(mpctx);
 
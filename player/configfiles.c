@@ -33,6 +33,7 @@
 #include "common/encode.h"
 #include "common/msg.h"
 #include "misc/ctype.h"
+#include "misc/kv_store.h"
 #include "options/path.h"
 #include "options/m_config.h"
 #include "options/parse_configfile.h"
@@ -163,12 +164,14 @@ void mp_load_auto_profiles(struct MPContext *mpctx)
 }
 
 #define MP_WATCH_LATER_CONF "watch_later"
+#define MP_WATCH_LATER_DB "watch_later.db"
 
-static char *mp_get_playback_resume_config_filename(struct MPContext *mpctx,
-                                                    const char *fname)
+// Compute the key identifying fname in the watch later state.
+static bool get_playback_resume_key(struct MPContext *mpctx, const char *fname,
+                                    uint8_t md5[16])
 {
     struct MPOpts *opts = mpctx->opts;
-    char *res = NULL;
+    bool res = false;
     void *tmp = talloc_new(NULL);
     const char *realpath = fname;
     bstr bfname = bstr0(fname);
@@ -187,12 +190,16 @@ static char *mp_get_playback_resume_config_filename(struct MPContext *mpctx,
     if ((bstr_startswith0(bfname, "br://") || bstr_startswith0(bfname, "bd://") ||
          bstr_startswith0(bfname, "bluray://")) && opts->bluray_device)
         realpath = talloc_asprintf(tmp, "%s - %s", realpath, opts->bluray_device);
-    uint8_t md5[16];
     av_md5_sum(md5, realpath, strlen(realpath));
-    char *conf = talloc_strdup(tmp, "");
-    for (int i = 0; i < 16; i++)
-        conf = talloc_asprintf_append(conf, "%02X", md5[i]);
+    res = true;
 
+exit:
+    talloc_free(tmp);
+    return res;
+}
+
+static char *get_watch_later_dir(struct MPContext *mpctx)
+{
     if (!mpctx->cached_watch_later_configdir) {
         char *wl_dir = mpctx->opts->watch_later_directory;
         if (wl_dir && wl_dir[0]) {
@@ -206,12 +213,66 @@ static char *mp_get_playback_resume_config_filename(struct MPContext *mpctx,
             mp_find_user_config_file(mpctx, mpctx->global, MP_WATCH_LATER_CONF);
     }
 
-    if (mpctx->cached_watch_later_configdir)
-        res = mp_path_join(NULL, mpctx->cached_watch_later_configdir, conf);
+    return mpctx->cached_watch_later_configdir;
+}
 
-exit:
-    talloc_free(tmp);
-    return res;
+static char *mp_get_playback_resume_config_filename(struct MPContext *mpctx,
+                                                    const char *fname)
+{
+    uint8_t md5[16];
+    char *dir = get_watch_later_dir(mpctx);
+    if (!dir || !get_playback_resume_key(mpctx, fname, md5))
+        return NULL;
+    char conf[33];
+    for (int i = 0; i < 16; i++)
+        snprintf(conf + i * 2, 3, "%02X", md5[i]);
+    return mp_path_join(NULL, dir, conf);
+}
+
+// Returns NULL if the watch later state is stored in separate files.
+static struct kv_store *get_watch_later_db(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    if (!opts->watch_later_db)
+        return NULL;
+    if (!mpctx->watch_later_db) {
+        char *dir = get_watch_later_dir(mpctx);
+        if (!dir)
+            return NULL;
+        char *path = mp_path_join(NULL, dir, MP_WATCH_LATER_DB);
+        mpctx->watch_later_db =
+            kv_store_open(mpctx, path, opts->watch_later_db_entries);
+        talloc_free(path);
+    }
+    return mpctx->watch_later_db;
+}
+
+static void write_resume_state(struct MPContext *mpctx, const char *fname,
+                               const char *data)
+{
+    char *dir = get_watch_later_dir(mpctx);
+    if (!dir)
+        return;
+    mp_mk_config_dir(mpctx->global, dir);
+
+    struct kv_store *db = get_watch_later_db(mpctx);
+    if (db) {
+        uint8_t md5[16];
+        if (get_playback_resume_key(mpctx, fname, md5) &&
+            !kv_store_put(db, md5, bstr0(data)))
+            MP_WARN(mpctx, "Could not write to the watch later database.\n");
+        return;
+    }
+
+    char *conffile = mp_get_playback_resume_config_filename(mpctx, fname);
+    if (conffile) {
+        FILE *file = fopen(conffile, "wb");
+        if (file) {
+            fputs(data, file);
+            fclose(file);
+        }
+        talloc_free(conffile);
+    }
 }
 
 static const char *const backup_properties[] = {
@@ -284,34 +345,28 @@ static bool needs_config_quoting(const char *s)
     return false;
 }
 
-static void write_filename(struct MPContext *mpctx, FILE *file, char *filename)
+static void write_filename(struct MPContext *mpctx, char **conf, char *filename)
 {
     if (mpctx->opts->write_filename_in_watch_later_config) {
         char write_name[1024] = {0};
         for (int n = 0; filename[n] && n < sizeof(write_name) - 1; n++)
             write_name[n] = (unsigned char)filename[n] < 32 ? '_' : filename[n];
-        fprintf(file, "# %s\n", write_name);
+        *conf = talloc_asprintf_append(*conf, "# %s\n", write_name);
     }
 }
 
 static void write_redirect(struct MPContext *mpctx, char *path)
 {
-    char *conffile = mp_get_playback_resume_config_filename(mpctx, path);
-    if (conffile) {
-        FILE *file = fopen(conffile, "wb");
-        if (file) {
-            fprintf(file, "# redirect entry\n");
-            write_filename(mpctx, file, path);
-            fclose(file);
-        }
-        talloc_free(conffile);
-    }
+    char *conf = talloc_strdup(NULL, "# redirect entry\n");
+    write_filename(mpctx, &conf, path);
+    write_resume_state(mpctx, path, conf);
+    talloc_free(conf);
 }
 
 void mp_write_watch_later_conf(struct MPContext *mpctx)
 {
     struct playlist_entry *cur = mpctx->playing;
-    char *conffile = NULL;
+    char *conf = NULL;
     if (!cur)
         goto exit;
 
@@ -321,23 +376,17 @@ void mp_write_watch_later_conf(struct MPContext *mpctx)
         goto exit;
     }
 
-    conffile = mp_get_playback_resume_config_filename(mpctx, cur->filename);
-    if (!conffile)
+    if (!get_watch_later_dir(mpctx))
         goto exit;
 
-    mp_mk_config_dir(mpctx->global, mpctx->cached_watch_later_configdir);
-
     MP_INFO(mpctx, "Saving state.\n");
 
-    FILE *file = fopen(conffile, "wb");
-    if (!file)
-        goto exit;
-
-    write_filename(mpctx, file, cur->filename);
+    conf = talloc_strdup(NULL, "");
+    write_filename(mpctx, &conf, cur->filename);
 
     double pos = get_current_time(mpctx);
     if (pos != MP_NOPTS_VALUE)
-        fprintf(file, "start=%f\n", pos);
+        conf = talloc_asprintf_append(conf, "start=%f\n", pos);
     for (int i = 0; backup_properties[i]; i++) {
         const char *pname = backup_properties[i];
         char *val = NULL;
@@ -350,15 +399,16 @@ void mp_write_watch_later_conf(struct MPContext *mpctx)
             if (!prev || strcmp(prev, val) != 0) {
                 if (needs_config_quoting(val)) {
                     // e.g. '%6%STRING'
-                    fprintf(file, "%s=%%%d%%%s\n", pname, (int)strlen(val), val);
+                    conf = talloc_asprintf_append(conf, "%s=%%%d%%%s\n", pname,
+                                                  (int)strlen(val), val);
                 } else {
-                    fprintf(file, "%s=%s\n", pname, val);
+                    conf = talloc_asprintf_append(conf, "%s=%s\n", pname, val);
                 }
             }
         }
         talloc_free(val);
     }
-    fclose(file);
+    write_resume_state(mpctx, cur->filename, conf);
 
     // This allows us to recursively resume directories etc., whose entries are
     // expanded the first time it's "played". For example, if "/a/b/c.mkv" is
@@ -392,13 +442,31 @@ void mp_write_watch_later_conf(struct MPContext *mpctx)
     }
 
 exit:
-    talloc_free(conffile);
+    talloc_free(conf);
 }
 
 void mp_load_playback_resume(struct MPContext *mpctx, const char *file)
 {
     if (!mpctx->opts->position_resume)
         return;
+
+    struct kv_store *db = get_watch_later_db(mpctx);
+    uint8_t md5[16];
+    if (db && get_playback_resume_key(mpctx, file, md5)) {
+        bstr data = kv_store_get(db, NULL, md5);
+        if (data.start) {
+            m_config_backup_opt(mpctx->mconfig, "start");
+            MP_INFO(mpctx, "Resuming playback. This behavior can "
+                   "be disabled with --no-resume-playback.\n");
+            m_config_parse(mpctx->mconfig, MP_WATCH_LATER_DB, data, NULL,
+                           M_SETOPT_PRESERVE_CMDLINE | M_SETOPT_FROM_CONFIG_FILE);
+            kv_store_remove(db, md5);
+            talloc_free(data.start);
+            return;
+        }
+    }
+
+    // Also used for state written before the database was enabled.
     char *fname = mp_get_playback_resume_config_filename(mpctx, file);
     if (fname && mp_path_exists(fname)) {
         // Never apply the saved start position to following files
@@ -421,7 +489,12 @@ struct playlist_entry *mp_check_playlist_resume(struct MPContext *mpctx,
 {
     if (!mpctx->opts->position_resume)
         return NULL;
+    struct kv_store *db = get_watch_later_db(mpctx);
     for (struct playlist_entry *e = playlist->first; e; e = e->next) {
+        uint8_t md5[16];
+        if (db && get_playback_resume_key(mpctx, e->filename, md5) &&
+            kv_store_has(db, md5))
+            return e;
         char *conf = mp_get_playback_resume_config_filename(mpctx, e->filename);
         bool exists = conf && mp_path_exists(conf);
         talloc_free(conf);
@@ -200,6 +200,7 @@ struct ao_chain {
     bool pts_reset;
 
     struct af_stream *af;
+    struct af_worker *af_worker; // if af runs on a separate thread
     struct mp_aconverter *conv; // if af unavailable
     struct ao *ao;
     struct mp_audio_buffer *ao_buffer;
@@ -239,6 +240,13 @@ enum playback_status {
 
 #define NUM_PTRACKS 2
 
+struct init_phase {
+    const char *name;
+    double time;        // seconds since mp_initialize() was entered
+};
+
+#define MAX_INIT_PHASES 8
+
 typedef struct MPContext {
     bool initialized;
     bool autodetach;
@@ -274,10 +282,12 @@ typedef struct MPContext {
     double osd_msg_visible;
     double osd_msg_next_duration;
     double osd_last_update;
+    double term_status_last_update;
     bool osd_force_update, osd_idle_update;
     char *osd_msg_text;
     bool osd_show_pos;
     struct osd_progbar_state osd_progbar;
+    struct perf_overlay *perf_overlay; // --perf-overlay state, if enabled
 
     struct playlist *playlist;
     struct playlist_entry *playing; // currently playing file
@@ -329,13 +339,23 @@ typedef struct MPContext {
     // The +1 is for adding 1 additional frame in backstep mode.
     struct mp_image *next_frames[VO_MAX_REQ_FRAMES + 1];
     int num_next_frames;
+    // mp_time_us() at which each of next_frames was added (frame timing log).
+    int64_t next_frames_time[VO_MAX_REQ_FRAMES + 1];
     struct mp_image *saved_frame;   // for hrseek_lastframe and hrseek_backstep
+    // Recently displayed frames (--backstep-cache-frames), oldest first.
+    struct mp_image **backstep_frames;
+    int num_backstep_frames;
+    // Index of the displayed backstep_frames entry, or -1 if the displayed
+    // frame is the most recent one (i.e. normal playback state).
+    int backstep_pos;
 
     enum playback_status video_status, audio_status;
     bool restart_complete;
     // Factors to multiply with opts->playback_speed to get the total audio or
     // video speed (usually 1.0, but can be set to by the sync code).
     double speed_factor_v, speed_factor_a;
+    // Applies to both audio and video (set by --live-latency-target).
+    double speed_factor_live;
     // Redundant values set from opts->playback_speed and speed_factor_*.
     // update_playback_speed() updates them from the other fields.
     double audio_speed, video_speed;
@@ -365,6 +385,10 @@ typedef struct MPContext {
     double total_avsync_change;
     // Used to compute the number of frames dropped in a row.
     int dropped_frames_start;
+    // VO drop/delay counts at the last --frame-timing-dump check, and the
+    // time of the last automatic dump.
+    int64_t timing_dump_drops;
+    double timing_dump_last;
     // A-V sync difference when last frame was displayed. Kept to display
     // the same value if the status line is updated at a time where no new
     // video frame is shown.
@@ -396,6 +420,7 @@ typedef struct MPContext {
     double next_cache_update;
 
     double sleeptime;      // number of seconds to sleep before next iteration
+    double sleeptime_lazy; // same, for timers that tolerate TIMER_SLACK delay
 
     double mouse_timer;
     unsigned int mouse_event_ts;
@@ -403,6 +428,12 @@ typedef struct MPContext {
 
     // used to prevent hanging in some error cases
     double start_timestamp;
+    // Time of the last seek (for --scrub-keyframes).
+    double last_seek_time;
+    // Seeks happen in quick succession (only with --scrub-keyframes).
+    bool scrubbing;
+    // For --hls-bitrate=auto: time of the next check, and of the last switch.
+    double abr_next_check, abr_last_switch;
 
     // Timestamp from the last time some timing functions read the
     // current time, in microseconds.
@@ -442,13 +473,17 @@ typedef struct MPContext {
     struct mp_recorder *recorder;
 
     char *cached_watch_later_configdir;
+    struct kv_store *watch_later_db;
 
     struct screenshot_ctx *screenshot_ctx;
+    struct mp_preview *preview;
     struct command_ctx *command_ctx;
     struct encode_lavc_context *encode_lavc_ctx;
 
     struct mp_ipc_ctx *ipc_ctx;
 
+    struct mp_lua_shared *lua_shared; // for --lua-shared-thread
+
     struct mpv_opengl_cb_context *gl_cb_ctx;
 
     pthread_mutex_t lock;
@@ -466,10 +501,17 @@ typedef struct MPContext {
     char *open_url;
     char *open_format;
     int open_url_flags;
+    bool open_for_prefetch; // start reading packets after opening
     // --- All fields below are owned by open_thread, unless open_done was set
     //     to true.
     struct demuxer *open_res_demuxer;
     int open_res_error;
+
+    // Startup timing, and state for --deferred-init.
+    double init_start;
+    struct init_phase init_phases[MAX_INIT_PHASES];
+    int num_init_phases;
+    bool scripts_deferred;
 } MPContext;
 
 // audio.c
@@ -488,6 +530,7 @@ int init_audio_decoder(struct MPContext *mpctx, struct track *track);
 void reinit_audio_chain_src(struct MPContext *mpctx, struct track *track);
 void audio_update_volume(struct MPContext *mpctx);
 void audio_update_balance(struct MPContext *mpctx);
+void audio_pause_filters(struct MPContext *mpctx);
 void reload_audio_output(struct MPContext *mpctx);
 
 // configfiles.c
@@ -538,6 +581,7 @@ void mp_destroy(struct MPContext *mpctx);
 void mp_print_version(struct mp_log *log, int always);
 void mp_update_logging(struct MPContext *mpctx, bool preinit);
 void issue_refresh_seek(struct MPContext *mpctx, enum seek_precision min_prec);
+void mp_mark_init_phase(struct MPContext *mpctx, const char *name);
 
 // misc.c
 double rel_time_to_abs(struct MPContext *mpctx, struct m_rel_time t);
@@ -564,6 +608,7 @@ void set_osd_bar_chapters(struct MPContext *mpctx, int type);
 // playloop.c
 void mp_wait_events(struct MPContext *mpctx);
 void mp_set_timeout(struct MPContext *mpctx, double sleeptime);
+void mp_set_timeout_lazy(struct MPContext *mpctx, double sleeptime);
 void mp_wakeup_core(struct MPContext *mpctx);
 void mp_wakeup_core_cb(void *ctx);
 void mp_process_input(struct MPContext *mpctx);
@@ -586,6 +631,7 @@ char *chapter_name(struct MPContext *mpctx, int chapter);
 double chapter_start_time(struct MPContext *mpctx, int chapter);
 int get_chapter_count(struct MPContext *mpctx);
 int get_cache_buffering_percentage(struct MPContext *mpctx);
+double get_live_latency(struct MPContext *mpctx);
 void execute_queued_seek(struct MPContext *mpctx);
 void run_playloop(struct MPContext *mpctx);
 void mp_idle(struct MPContext *mpctx);
@@ -599,12 +645,19 @@ struct mp_scripting {
     const char *name;       // e.g. "lua script"
     const char *file_ext;   // e.g. "lua"
     int (*load)(struct mpv_handle *client, const char *filename);
+    // Optional; load the script without creating a thread for it. Called on
+    // the playback thread, takes over the client.
+    int (*load_shared)(struct MPContext *mpctx, struct mpv_handle *client,
+                       const char *filename);
 };
 void mp_load_scripts(struct MPContext *mpctx);
 void mp_load_builtin_scripts(struct MPContext *mpctx);
 int mp_load_script(struct MPContext *mpctx, const char *fname);
 int mp_load_user_script(struct MPContext *mpctx, const char *fname);
 
+// lua.c
+void mp_lua_shared_uninit(struct MPContext *mpctx);
+
 // sub.c
 void reset_subtitle_state(struct MPContext *mpctx);
 void reinit_sub(struct MPContext *mpctx, struct track *track);
@@ -612,6 +665,7 @@ void reinit_sub_all(struct MPContext *mpctx);
 void uninit_sub(struct MPContext *mpctx, struct track *track);
 void uninit_sub_all(struct MPContext *mpctx);
 void update_osd_msg(struct MPContext *mpctx);
+void update_perf_overlay(struct MPContext *mpctx);
 bool update_subtitles(struct MPContext *mpctx, double video_pts);
 
 // video.c
@@ -623,6 +677,8 @@ void reinit_video_chain(struct MPContext *mpctx);
 void reinit_video_chain_src(struct MPContext *mpctx, struct track *track);
 int reinit_video_filters(struct MPContext *mpctx);
 void write_video(struct MPContext *mpctx);
+bool write_frame_timings(struct MPContext *mpctx, const char *filename);
+bool step_backstep_cache(struct MPContext *mpctx, int dir);
 void mp_force_video_refresh(struct MPContext *mpctx);
 void uninit_video_out(struct MPContext *mpctx);
 void uninit_video_chain(struct MPContext *mpctx);
@@ -328,6 +328,12 @@ static void af_push_file(js_State *J, const char *fname, int limit, void *af)
     add_af_file(af, f);
 
     int len = MPMIN(limit, 32 * 1024);  // initial allocation, size*2 strategy
+    // For regular files, read everything with a single allocation. The extra
+    // byte makes the first fread() hit EOF.
+    struct stat st;
+    if (fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size < limit)
+        len = st.st_size + 1;
     int got = 0;
     char *s = NULL;
     while ((s = talloc_realloc(af, s, char, len))) {
@@ -43,6 +43,7 @@
 #include "audio/fmt-conversion.h"
 #include "video/fmt-conversion.h"
 #include "video/hwdec.h"
+#include "video/sws_utils.h"
 
 #include "lavfi.h"
 
@@ -74,6 +75,10 @@ struct lavfi {
     // Filter can't be put into a working state.
     bool failed;
 
+    // Convert video input to the format the graph was created with, instead
+    // of recreating the graph on format changes.
+    bool keep_graph;
+
     struct lavfi_pad **pads;
     int num_pads;
 
@@ -110,6 +115,9 @@ struct lavfi_pad {
     struct mp_image *in_fmt_v;
     struct mp_aframe *in_fmt_a;
 
+    // for converting video input to in_fmt_v (if lavfi.keep_graph is set)
+    struct mp_sws_context *sws;
+
     // -- dir==LAVFI_OUT
 
     bool output_needed; // caller has signaled it needs new output
@@ -258,6 +266,14 @@ void lavfi_destroy(struct lavfi *c)
     talloc_free(c);
 }
 
+// If enabled, video input frames that don't match the format the graph was
+// initialized with are scaled/converted to it, so that the graph doesn't need
+// to be recreated. (Audio format changes still recreate it.)
+void lavfi_set_keep_graph(struct lavfi *c, bool keep)
+{
+    c->keep_graph = keep;
+}
+
 const char *lavfi_get_graph(struct lavfi *c)
 {
     return c->graph_string;
@@ -325,10 +341,41 @@ static bool is_aformat_ok(struct mp_aframe *a, struct mp_aframe *b)
 static bool is_vformat_ok(struct mp_image *a, struct mp_image *b)
 {
     return a->imgfmt == b->imgfmt &&
-           a->w == b->w && a->h && b->h &&
+           a->w == b->w && a->h == b->h &&
            a->params.p_w == b->params.p_w && a->params.p_h == b->params.p_h;
 }
 
+// Convert pad->pending_v to the format the graph was initialized with. Return
+// false if that's not possible (hardware frames etc.).
+static bool convert_input_v(struct lavfi *c, struct lavfi_pad *pad)
+{
+    struct mp_image *in = pad->pending_v, *fmt = pad->in_fmt_v;
+    if (in->hwctx || fmt->hwctx || !mp_sws_supported_format(in->imgfmt) ||
+        !mp_sws_supported_format(fmt->imgfmt))
+        return false;
+
+    if (!pad->sws) {
+        pad->sws = mp_sws_alloc(pad);
+        pad->sws->log = c->log;
+        pad->sws->flags = mp_sws_hq_flags;
+        pad->sws->threads = 0;
+    }
+
+    struct mp_image *out = mp_image_alloc(fmt->imgfmt, fmt->w, fmt->h);
+    if (!out)
+        return false;
+    mp_image_copy_attributes(out, in);
+    out->params.p_w = fmt->params.p_w;
+    out->params.p_h = fmt->params.p_h;
+    if (mp_sws_scale(pad->sws, out, in) < 0) {
+        talloc_free(out);
+        return false;
+    }
+    talloc_free(in);
+    pad->pending_v = out;
+    return true;
+}
+
 static void check_format_changes(struct lavfi *c)
 {
     // check each pad for new input format
@@ -341,9 +388,13 @@ static void check_format_changes(struct lavfi *c)
             c->draining_new_format |= !is_aformat_ok(pad->pending_a,
                                                      pad->in_fmt_a);
         }
-        if (pad->type == STREAM_VIDEO && pad->pending_v && pad->in_fmt_v) {
-            c->draining_new_format |= !is_vformat_ok(pad->pending_v,
-                                                     pad->in_fmt_v);
+        if (pad->type == STREAM_VIDEO && pad->pending_v && pad->in_fmt_v &&
+            !is_vformat_ok(pad->pending_v, pad->in_fmt_v))
+        {
+            // Don't bother with the dummy format used for EOF pads.
+            if (!(c->keep_graph && !pad->buffer_is_eof &&
+                  convert_input_v(c, pad)))
+                c->draining_new_format = true;
         }
     }
 
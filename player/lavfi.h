@@ -14,6 +14,7 @@ enum lavfi_direction {
 
 struct lavfi *lavfi_create(struct mp_log *log, char *graph_string);
 const char *lavfi_get_graph(struct lavfi *c);
+void lavfi_set_keep_graph(struct lavfi *c, bool keep);
 void lavfi_destroy(struct lavfi *c);
 struct lavfi_pad *lavfi_find_pad(struct lavfi *c, char *name);
 enum lavfi_direction lavfi_pad_direction(struct lavfi_pad *pad);
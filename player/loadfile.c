@@ -32,6 +32,7 @@
 
 #include "common/msg.h"
 #include "common/global.h"
+#include "common/mem_budget.h"
 #include "options/path.h"
 #include "options/m_config.h"
 #include "options/parse_configfile.h"
@@ -42,6 +43,7 @@
 #include "common/encode.h"
 #include "common/recorder.h"
 #include "input/input.h"
+#include "misc/thread_pool.h"
 
 #include "audio/decode/dec_audio.h"
 #include "audio/out/ao.h"
@@ -54,6 +56,7 @@
 
 #include "core.h"
 #include "command.h"
+#include "preview.h"
 #include "libmpv/client.h"
 
 // Called by foreign threads when playback should be stopped and such.
@@ -340,11 +343,14 @@ static bool compare_track(struct track *t1, struct track *t2, char **langs,
         return t1->default_track;
     if (t1->attached_picture != t2->attached_picture)
         return !t1->attached_picture;
-    if (t1->stream && t2->stream && opts->hls_bitrate >= 0 &&
+    // With "auto", start with the lowest bitrate, and let
+    // handle_adaptive_bitrate() switch up once the bandwidth is known.
+    int hls_bitrate = opts->hls_bitrate == -2 ? 0 : opts->hls_bitrate;
+    if (t1->stream && t2->stream && hls_bitrate >= 0 &&
         t1->stream->hls_bitrate != t2->stream->hls_bitrate)
     {
-        bool t1_ok = t1->stream->hls_bitrate <= opts->hls_bitrate;
-        bool t2_ok = t2->stream->hls_bitrate <= opts->hls_bitrate;
+        bool t1_ok = t1->stream->hls_bitrate <= hls_bitrate;
+        bool t2_ok = t2->stream->hls_bitrate <= hls_bitrate;
         if (t1_ok != t2_ok)
             return t1_ok;
         if (t1_ok && t2_ok)
@@ -568,32 +574,74 @@ bool mp_remove_track(struct MPContext *mpctx, struct track *track)
     return true;
 }
 
-// Add the given file as additional track. Only tracks of type "filter" are
-// included; pass STREAM_TYPE_COUNT to disable filtering.
-struct track *mp_add_external_file(struct MPContext *mpctx, char *filename,
-                                   enum stream_type filter)
+// Maximum number of external files opened at the same time.
+#define MAX_OPEN_THREADS 8
+
+// An external file to be opened. The opening can happen on a worker thread;
+// adding the tracks is done on the playback thread.
+struct external_file {
+    char *filename;
+    enum stream_type filter;
+    struct demuxer_params params;
+    struct mpv_global *global;
+    struct mp_cancel *cancel;
+    bool opened;
+    struct demuxer *demuxer;    // result (NULL on failure)
+};
+
+static void init_external_file(struct MPContext *mpctx,
+                               struct external_file *f, char *filename,
+                               enum stream_type filter)
 {
     struct MPOpts *opts = mpctx->opts;
-    if (!filename)
-        return NULL;
 
-    char *disp_filename = filename;
-    if (strncmp(disp_filename, "memory://", 9) == 0)
-        disp_filename = "memory://"; // avoid noise
+    *f = (struct external_file){
+        .filename = filename,
+        .filter = filter,
+        .global = mpctx->global,
+        .cancel = mpctx->playback_abort,
+    };
 
-    struct demuxer_params params = {0};
+    // Tracks from the main file (e.g. --audio-file pointing to the same
+    // container) read the same bytes, so share the main stream's cache.
+    if (mpctx->demuxer && mpctx->demuxer->stream)
+        f->params.shared_cache = mpctx->demuxer->stream;
 
     switch (filter) {
     case STREAM_SUB:
-        params.force_format = opts->sub_demuxer_name;
+        f->params.force_format = opts->sub_demuxer_name;
+        // Subtitles are small; don't reserve much of the budget for them.
+        f->params.mem_prio = MP_MEM_PRIO_LOW;
         break;
     case STREAM_AUDIO:
-        params.force_format = opts->audio_demuxer_name;
+        f->params.force_format = opts->audio_demuxer_name;
         break;
     }
+}
+
+// Thread-safe (doesn't access the player context).
+static void open_external_file(void *ctx)
+{
+    struct external_file *f = ctx;
+    f->demuxer = demux_open_url(f->filename, &f->params, f->cancel, f->global);
+    f->opened = true;
+}
 
-    struct demuxer *demuxer =
-        demux_open_url(filename, &params, mpctx->playback_abort, mpctx->global);
+// Add the tracks of an opened external file. Returns one of the added tracks,
+// or NULL on failure.
+static struct track *attach_external_file(struct MPContext *mpctx,
+                                          struct external_file *f)
+{
+    struct MPOpts *opts = mpctx->opts;
+    char *filename = f->filename;
+    enum stream_type filter = f->filter;
+
+    char *disp_filename = filename;
+    if (strncmp(disp_filename, "memory://", 9) == 0)
+        disp_filename = "memory://"; // avoid noise
+
+    struct demuxer *demuxer = f->demuxer;
+    f->demuxer = NULL;
     if (!demuxer)
         goto err_out;
     enable_demux_thread(mpctx, demuxer);
@@ -627,11 +675,69 @@ err_out:
     return false;
 }
 
-static void open_external_files(struct MPContext *mpctx, char **files,
-                                enum stream_type filter)
+// Add the given file as additional track. Only tracks of type "filter" are
+// included; pass STREAM_TYPE_COUNT to disable filtering.
+struct track *mp_add_external_file(struct MPContext *mpctx, char *filename,
+                                   enum stream_type filter)
+{
+    if (!filename)
+        return NULL;
+
+    struct external_file f;
+    init_external_file(mpctx, &f, filename, filter);
+    open_external_file(&f);
+    return attach_external_file(mpctx, &f);
+}
+
+// Like mp_add_external_file() for each entry, but open the files concurrently
+// (opening each involves stream and demuxer probing, which is slow over a
+// network). The tracks are still added in the given order. If tracks is not
+// NULL, tracks[n] is set to the result for files[n].
+static void add_external_files(struct MPContext *mpctx,
+                               struct external_file *files, int num_files,
+                               struct track **tracks)
+{
+    if (num_files > 1) {
+        struct mp_thread_pool *pool =
+            mp_thread_pool_create(NULL, MPMIN(num_files, MAX_OPEN_THREADS));
+        for (int n = 0; pool && n < num_files; n++)
+            mp_thread_pool_queue(pool, open_external_file, &files[n]);
+        talloc_free(pool); // waits until all work is done
+    }
+
+    for (int n = 0; n < num_files; n++) {
+        if (!files[n].opened)
+            open_external_file(&files[n]);
+        struct track *t = attach_external_file(mpctx, &files[n]);
+        if (tracks)
+            tracks[n] = t;
+    }
+}
+
+static void open_external_files(struct MPContext *mpctx)
 {
-    for (int n = 0; files && files[n]; n++)
-        mp_add_external_file(mpctx, files[n], filter);
+    struct MPOpts *opts = mpctx->opts;
+    struct {
+        char **list;
+        enum stream_type filter;
+    } lists[] = {
+        {opts->audio_files, STREAM_AUDIO},
+        {opts->sub_name, STREAM_SUB},
+        {opts->external_files, STREAM_TYPE_COUNT},
+    };
+
+    struct external_file *files = NULL;
+    int num_files = 0;
+    for (int i = 0; i < MP_ARRAY_SIZE(lists); i++) {
+        for (int n = 0; lists[i].list && lists[i].list[n]; n++) {
+            MP_TARRAY_GROW(NULL, files, num_files);
+            init_external_file(mpctx, &files[num_files++], lists[i].list[n],
+                               lists[i].filter);
+        }
+    }
+
+    add_external_files(mpctx, files, num_files, NULL);
+    talloc_free(files);
 }
 
 void autoload_external_files(struct MPContext *mpctx)
@@ -658,9 +764,11 @@ void autoload_external_files(struct MPContext *mpctx)
             sc[mpctx->tracks[n]->type]++;
     }
 
+    struct external_file *files = NULL;
+    char **langs = NULL;
+    int num_files = 0;
     for (int i = 0; list && list[i].fname; i++) {
         char *filename = list[i].fname;
-        char *lang = list[i].lang;
         for (int n = 0; n < mpctx->num_tracks; n++) {
             struct track *t = mpctx->tracks[n];
             if (t->demuxer && strcmp(t->demuxer->filename, filename) == 0)
@@ -670,13 +778,24 @@ void autoload_external_files(struct MPContext *mpctx)
             goto skip;
         if (list[i].type == STREAM_AUDIO && !sc[STREAM_VIDEO])
             goto skip;
-        struct track *track = mp_add_external_file(mpctx, filename, list[i].type);
+        MP_TARRAY_GROW(tmp, files, num_files);
+        MP_TARRAY_GROW(tmp, langs, num_files);
+        init_external_file(mpctx, &files[num_files], filename, list[i].type);
+        langs[num_files] = list[i].lang;
+        num_files++;
+    skip:;
+    }
+
+    struct track **tracks = talloc_array(tmp, struct track *, num_files);
+    add_external_files(mpctx, files, num_files, tracks);
+
+    for (int n = 0; n < num_files; n++) {
+        struct track *track = tracks[n];
         if (track) {
             track->auto_loaded = true;
             if (!track->lang)
-                track->lang = talloc_strdup(track, lang);
+                track->lang = talloc_strdup(track, langs[n]);
         }
-    skip:;
     }
 
     talloc_free(tmp);
@@ -803,6 +922,31 @@ static void load_per_file_options(m_config_t *conf,
     }
 }
 
+// Select the likely audio and video tracks (container default flags, else the
+// first one), and start the demuxer thread to fill the packet queue while
+// the current file is still playing. The real track selection is done when
+// the file is played, so this only needs to be a good guess.
+static void prebuffer_demuxer(struct demuxer *demuxer)
+{
+    if (demuxer->fully_read)
+        return;
+
+    static const enum stream_type types[] = {STREAM_VIDEO, STREAM_AUDIO};
+    for (int t = 0; t < MP_ARRAY_SIZE(types); t++) {
+        struct sh_stream *best = NULL;
+        for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+            struct sh_stream *sh = demux_get_stream(demuxer, n);
+            if (sh->type != types[t] || sh->attached_picture)
+                continue;
+            if (!best || (sh->default_track && !best->default_track))
+                best = sh;
+        }
+        if (best)
+            demuxer_select_track(demuxer, best, MP_NOPTS_VALUE, true);
+    }
+    demux_start_thread(demuxer);
+}
+
 static void *open_demux_thread(void *ctx)
 {
     struct MPContext *mpctx = ctx;
@@ -811,12 +955,15 @@ static void *open_demux_thread(void *ctx)
         .force_format = mpctx->open_format,
         .stream_flags = mpctx->open_url_flags,
         .initial_readahead = true,
+        .mem_prio = MP_MEM_PRIO_HIGH,
     };
     mpctx->open_res_demuxer =
         demux_open_url(mpctx->open_url, &p, mpctx->open_cancel, mpctx->global);
 
     if (mpctx->open_res_demuxer) {
         MP_VERBOSE(mpctx, "Opening done: %s\n", mpctx->open_url);
+        if (mpctx->open_for_prefetch)
+            prebuffer_demuxer(mpctx->open_res_demuxer);
     } else {
         MP_VERBOSE(mpctx, "Opening failed or was aborted: %s\n", mpctx->open_url);
 
@@ -853,7 +1000,8 @@ static void cancel_open(struct MPContext *mpctx)
 }
 
 // Setup all the field to open this url, and make sure a thread is running.
-static void start_open(struct MPContext *mpctx, char *url, int url_flags)
+static void start_open(struct MPContext *mpctx, char *url, int url_flags,
+                       bool for_prefetch)
 {
     cancel_open(mpctx);
 
@@ -866,6 +1014,7 @@ static void start_open(struct MPContext *mpctx, char *url, int url_flags)
     mpctx->open_url = talloc_strdup(NULL, url);
     mpctx->open_format = talloc_strdup(NULL, mpctx->opts->demuxer_name);
     mpctx->open_url_flags = url_flags;
+    mpctx->open_for_prefetch = for_prefetch && mpctx->opts->demuxer_thread;
     if (mpctx->opts->load_unsafe_playlists)
         mpctx->open_url_flags = 0;
 
@@ -902,7 +1051,7 @@ static void open_demux_reentrant(struct MPContext *mpctx)
     }
 
     if (!mpctx->open_active)
-        start_open(mpctx, url, mpctx->playing->stream_flags);
+        start_open(mpctx, url, mpctx->playing->stream_flags, false);
 
     // User abort should cancel the opener now.
     pthread_mutex_lock(&mpctx->lock);
@@ -939,7 +1088,7 @@ void prefetch_next(struct MPContext *mpctx)
     struct playlist_entry *new_entry = mp_next_file(mpctx, +1, false, false);
     if (new_entry && !mpctx->open_active && new_entry->filename) {
         MP_VERBOSE(mpctx, "Prefetching: %s\n", new_entry->filename);
-        start_open(mpctx, new_entry->filename, new_entry->stream_flags);
+        start_open(mpctx, new_entry->filename, new_entry->stream_flags, true);
     }
 }
 
@@ -1017,6 +1166,7 @@ static int reinit_complex_filters(struct MPContext *mpctx, bool force_uninit)
     mpctx->lavfi = lavfi_create(mpctx->log, graph);
     if (!mpctx->lavfi)
         goto done;
+    lavfi_set_keep_graph(mpctx->lavfi, mpctx->opts->lavfi_complex_keep_graph);
 
     if (lavfi_has_failed(mpctx->lavfi))
         goto done;
@@ -1157,6 +1307,8 @@ static void play_current_file(struct MPContext *mpctx)
     mpctx->max_frames = -1;
     mpctx->video_speed = mpctx->audio_speed = opts->playback_speed;
     mpctx->speed_factor_a = mpctx->speed_factor_v = 1.0;
+    mpctx->speed_factor_live = 1.0;
+    mpctx->abr_next_check = mpctx->abr_last_switch = 0;
     mpctx->display_sync_error = 0.0;
     mpctx->display_sync_active = false;
     mpctx->seek = (struct seek_params){ 0 };
@@ -1239,9 +1391,7 @@ reopen_file:
     load_chapters(mpctx);
     add_demuxer_tracks(mpctx, mpctx->demuxer);
 
-    open_external_files(mpctx, opts->audio_files, STREAM_AUDIO);
-    open_external_files(mpctx, opts->sub_name, STREAM_SUB);
-    open_external_files(mpctx, opts->external_files, STREAM_TYPE_COUNT);
+    open_external_files(mpctx);
     autoload_external_files(mpctx);
 
     check_previous_track_selection(mpctx);
@@ -1379,6 +1529,7 @@ terminate_playback:
     uninit_video_chain(mpctx);
     uninit_sub_all(mpctx);
     uninit_demuxer(mpctx);
+    preview_uninit(mpctx);
     if (!opts->gapless_audio && !mpctx->encode_lavc_ctx)
         uninit_audio_out(mpctx);
 
@@ -1550,9 +1701,9 @@ static void set_track_recorder_sink(struct track *track,
     if (track->d_sub)
         sub_set_recorder_sink(track->d_sub, sink);
     if (track->d_video)
-        track->d_video->recorder_sink = sink;
+        video_set_recorder_sink(track->d_video, sink);
     if (track->d_audio)
-        track->d_audio->recorder_sink = sink;
+        audio_set_recorder_sink(track->d_audio, sink);
     track->remux_sink = sink;
 }
 
@@ -23,6 +23,7 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <lua.h>
 #include <lualib.h>
@@ -83,6 +84,13 @@ struct script_ctx {
     struct mp_log *log;
     struct mpv_handle *client;
     struct MPContext *mpctx;
+
+    // For scripts run by struct mp_lua_shared.
+    struct mp_lua_shared *shared;
+    bool load_error;        // the script failed to load
+    bool own_thread;        // has a custom mp_event_loop, needs its own thread
+    bool woken;             // wakeup callback was called (protected by lock)
+    int64_t next_timer;     // mp_time_us() time of the next timer, or 0
 };
 
 #if LUA_VERSION_NUM <= 501
@@ -255,6 +263,9 @@ static int load_scripts(lua_State *L)
 
     require(L, "mp.defaults");
 
+    lua_getglobal(L, "mp_event_loop"); // fn
+    lua_setfield(L, LUA_REGISTRYINDEX, "default_event_loop"); // -
+
     if (fname[0] == '@') {
         require(L, fname);
     } else {
@@ -264,6 +275,14 @@ static int load_scripts(lua_State *L)
     lua_getglobal(L, "mp_event_loop"); // fn
     if (lua_isnil(L, -1))
         luaL_error(L, "no event loop function\n");
+    if (ctx->shared) {
+        // The event loop is run by the shared thread instead, unless the
+        // script replaced it.
+        lua_getfield(L, LUA_REGISTRYINDEX, "default_event_loop"); // fn def
+        ctx->own_thread = !lua_rawequal(L, -1, -2);
+        lua_pop(L, 2); // -
+        return 0;
+    }
     lua_call(L, 0, 0); // -
 
     return 0;
@@ -327,6 +346,10 @@ static int run_lua(lua_State *L)
     lua_setfield(L, LUA_REGISTRYINDEX, "ARRAY"); // mp table
     lua_setfield(L, -2, "ARRAY"); // mp
 
+    // used by script_wait_event()
+    lua_newtable(L); // mp table
+    lua_setfield(L, LUA_REGISTRYINDEX, "EVENT_CACHE"); // mp
+
     lua_pop(L, 1); // -
 
     assert(lua_gettop(L) == 0);
@@ -353,6 +376,7 @@ static int run_lua(lua_State *L)
     if (lua_pcall(L, 0, 0, -2)) { // errf [error]
         const char *e = lua_tostring(L, -1);
         MP_FATAL(ctx, "Lua error: %s\n", e ? e : "(unknown)");
+        ctx->load_error = true;
     }
 
     return 0;
@@ -473,6 +497,26 @@ static int script_wait_event(lua_State *L)
 
     mpv_event *event = mpv_wait_event(ctx->client, luaL_optnumber(L, 1, 1e20));
 
+    // Timeouts and "tick" happen at a high rate and carry no data, so reuse
+    // one table per event type instead of allocating a new one each time.
+    if ((event->event_id == MPV_EVENT_NONE || event->event_id == MPV_EVENT_TICK)
+        && !event->reply_userdata && event->error >= 0)
+    {
+        lua_getfield(L, LUA_REGISTRYINDEX, "EVENT_CACHE"); // cache
+        lua_rawgeti(L, -1, event->event_id); // cache event
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1); // cache
+            lua_newtable(L); // cache event
+            const char *name = mpv_event_name(event->event_id);
+            lua_pushstring(L, name); // cache event name
+            lua_setfield(L, -2, "event"); // cache event
+            lua_pushvalue(L, -1); // cache event event
+            lua_rawseti(L, -3, event->event_id); // cache event
+        }
+        lua_remove(L, -2); // event
+        return 1;
+    }
+
     lua_newtable(L); // event
     lua_pushstring(L, mpv_event_name(event->event_id)); // event name
     lua_setfield(L, -2, "event"); // event
@@ -835,6 +879,17 @@ static int script_get_property_number(lua_State *L)
     }
 }
 
+// Entry points for the LuaJIT FFI fast path in defaults.lua. Calling these
+// through the FFI skips the Lua C API wrappers above.
+static int script_raw_ffi_entry_points(lua_State *L)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    lua_pushlightuserdata(L, ctx->client);
+    lua_pushlightuserdata(L, (void *)mpv_get_property);
+    lua_pushlightuserdata(L, (void *)mpv_error_string);
+    return 3;
+}
+
 static void pushnode(lua_State *L, mpv_node *node)
 {
     luaL_checkstack(L, 6, "stack overflow");
@@ -856,7 +911,9 @@ static void pushnode(lua_State *L, mpv_node *node)
         lua_pushboolean(L, node->u.flag);
         break;
     case MPV_FORMAT_NODE_ARRAY:
-        lua_newtable(L); // table
+        // Preallocate, so that large lists (track-list, chapter-list) don't
+        // go through repeated rehashing while being filled.
+        lua_createtable(L, node->u.list->num, 0); // table
         lua_getfield(L, LUA_REGISTRYINDEX, "ARRAY"); // table mt
         lua_setmetatable(L, -2); // table
         for (int n = 0; n < node->u.list->num; n++) {
@@ -865,7 +922,7 @@ static void pushnode(lua_State *L, mpv_node *node)
         }
         break;
     case MPV_FORMAT_NODE_MAP:
-        lua_newtable(L); // table
+        lua_createtable(L, 0, node->u.list->num); // table
         lua_getfield(L, LUA_REGISTRYINDEX, "MAP"); // table mt
         lua_setmetatable(L, -2); // table
         for (int n = 0; n < node->u.list->num; n++) {
@@ -929,7 +986,9 @@ static int script_raw_observe_property(lua_State *L)
     uint64_t id = luaL_checknumber(L, 1);
     const char *name = luaL_checkstring(L, 2);
     mpv_format format = check_property_format(L, 3);
-    return check_error(L, mpv_observe_property(ctx->client, id, name, format));
+    double interval = luaL_optnumber(L, 4, 0);
+    return check_error(L, mpv_observe_property_interval(ctx->client, id, name,
+                                                        format, interval));
 }
 
 static int script_raw_unobserve_property(lua_State *L)
@@ -973,6 +1032,19 @@ static int script_set_osd_ass(lua_State *L)
     return 0;
 }
 
+static int script_set_osd_ass_elem(lua_State *L)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    int id = luaL_checkinteger(L, 1);
+    int res_x = luaL_checkinteger(L, 2);
+    int res_y = luaL_checkinteger(L, 3);
+    const char *text = luaL_optstring(L, 4, NULL);
+    osd_set_external_elem(ctx->mpctx->osd, ctx->client, res_x, res_y, id,
+                          (char *)text);
+    mp_wakeup_core(ctx->mpctx);
+    return 0;
+}
+
 static int script_get_osd_size(lua_State *L)
 {
     struct MPContext *mpctx = get_mpctx(L);
@@ -1210,6 +1282,90 @@ static int script_subprocess_detached(lua_State *L)
     return 1;
 }
 
+#define WORKER_MT "mp_subprocess_worker"
+
+static int worker_gc(lua_State *L)
+{
+    struct mp_subprocess_pipe **w = luaL_checkudata(L, 1, WORKER_MT);
+    talloc_free(*w);
+    *w = NULL;
+    return 0;
+}
+
+static int worker_request(lua_State *L)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    struct mp_subprocess_pipe **w = luaL_checkudata(L, 1, WORKER_MT);
+    size_t len;
+    const char *req = luaL_checklstring(L, 2, &len);
+    if (memchr(req, '\n', len))
+        luaL_error(L, "request must not contain line breaks");
+    struct mp_cancel *cancel = NULL;
+    if (lua_isnoneornil(L, 3) || lua_toboolean(L, 3))
+        cancel = ctx->mpctx->playback_abort;
+    void *tmp = mp_lua_PITA(L);
+
+    char *res = NULL;
+    if (*w && mp_subprocess_pipe_write(*w, req, len) &&
+        mp_subprocess_pipe_write(*w, "\n", 1))
+        res = mp_subprocess_pipe_read_line(*w, tmp, cancel);
+    if (!res) {
+        // The process is gone, or its protocol state is unknown now.
+        TA_FREEP(w);
+        lua_pushnil(L);
+        lua_pushstring(L, "error");
+        return 2;
+    }
+    lua_pushstring(L, res);
+    return 1;
+}
+
+static int script_subprocess_worker(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    void *tmp = mp_lua_PITA(L);
+
+    lua_getfield(L, 1, "args"); // args
+    int num_args = mp_lua_len(L, -1);
+    char *args[256];
+    if (num_args > MP_ARRAY_SIZE(args) - 1) // last needs to be NULL
+        luaL_error(L, "too many arguments");
+    if (num_args < 1)
+        luaL_error(L, "program name missing");
+    for (int n = 0; n < num_args; n++) {
+        lua_pushinteger(L, n + 1); // args n
+        lua_gettable(L, -2); // args arg
+        args[n] = talloc_strdup(tmp, lua_tostring(L, -1));
+        if (!args[n])
+            luaL_error(L, "program arguments must be strings");
+        lua_pop(L, 1); // args
+    }
+    args[num_args] = NULL;
+    lua_pop(L, 1); // -
+
+    struct mp_subprocess_pipe **w = lua_newuserdata(L, sizeof(*w)); // w
+    *w = NULL;
+    if (luaL_newmetatable(L, WORKER_MT)) { // w mt
+        lua_pushcfunction(L, worker_gc); // w mt gc
+        lua_setfield(L, -2, "__gc"); // w mt
+        lua_newtable(L); // w mt methods
+        lua_pushcfunction(L, worker_request); // w mt methods fn
+        lua_setfield(L, -2, "request"); // w mt methods
+        lua_pushcfunction(L, worker_gc); // w mt methods fn
+        lua_setfield(L, -2, "close"); // w mt methods
+        lua_setfield(L, -2, "__index"); // w mt
+    }
+    lua_setmetatable(L, -2); // w
+
+    *w = mp_subprocess_pipe_create(NULL, args);
+    if (!*w) {
+        lua_pushnil(L);
+        lua_pushstring(L, "init");
+        return 2;
+    }
+    return 1;
+}
+
 static int script_parse_json(lua_State *L)
 {
     mp_lua_optarg(L, 2);
@@ -1218,7 +1374,7 @@ static int script_parse_json(lua_State *L)
     bool trail = lua_toboolean(L, 2);
     bool ok = false;
     struct mpv_node node;
-    if (json_parse(tmp, &node, &text, 32) >= 0) {
+    if (json_parse(talloc_new_arena(tmp), &node, &text, 32) >= 0) {
         json_skip_whitespace(&text);
         ok = !text[0] || trail;
     }
@@ -1269,6 +1425,7 @@ static const struct fn_entry main_fns[] = {
     FN_ENTRY(commandv),
     FN_ENTRY(command_native),
     FN_ENTRY(get_property_bool),
+    FN_ENTRY(raw_ffi_entry_points),
     FN_ENTRY(get_property_number),
     FN_ENTRY(get_property_native),
     FN_ENTRY(set_property),
@@ -1278,6 +1435,7 @@ static const struct fn_entry main_fns[] = {
     FN_ENTRY(raw_observe_property),
     FN_ENTRY(raw_unobserve_property),
     FN_ENTRY(set_osd_ass),
+    FN_ENTRY(set_osd_ass_elem),
     FN_ENTRY(get_osd_size),
     FN_ENTRY(get_osd_margins),
     FN_ENTRY(get_mouse_pos),
@@ -1295,6 +1453,7 @@ static const struct fn_entry utils_fns[] = {
     FN_ENTRY(join_path),
     FN_ENTRY(subprocess),
     FN_ENTRY(subprocess_detached),
+    FN_ENTRY(subprocess_worker),
     FN_ENTRY(parse_json),
     FN_ENTRY(format_json),
     {0}
@@ -1332,8 +1491,286 @@ static void add_functions(struct script_ctx *ctx)
     register_package_fns(L, "mp.utils", utils_fns);
 }
 
+// Runs all Lua scripts on a single thread (--lua-shared-thread). Each script
+// still has its own Lua state and client handle, but instead of blocking in
+// mpv_wait_event(), the thread calls mp.dispatch_events(false) for each script
+// that was woken up or has a timer due, and then sleeps until the next wakeup
+// or timer of any script.
+struct mp_lua_shared {
+    struct MPContext *mpctx;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+
+    // --- protected by lock
+    bool terminate;
+    struct script_ctx **pending;    // not loaded yet
+    int num_pending;
+    struct script_ctx **scripts;
+    int num_scripts;
+};
+
+static void shared_wakeup_cb(void *p)
+{
+    struct script_ctx *ctx = p;
+    struct mp_lua_shared *shared = ctx->shared;
+    pthread_mutex_lock(&shared->lock);
+    ctx->woken = true;
+    pthread_cond_signal(&shared->wakeup);
+    pthread_mutex_unlock(&shared->lock);
+}
+
+static void destroy_script(struct script_ctx *ctx)
+{
+    if (ctx->state)
+        lua_close(ctx->state);
+    mpv_detach_destroy(ctx->client);
+    talloc_free(ctx);
+}
+
+static int call_event_loop(lua_State *L)
+{
+    lua_getglobal(L, "mp_event_loop"); // fn
+    lua_call(L, 0, 0); // -
+    return 0;
+}
+
+// For scripts which replaced mp_event_loop; run like a normal script.
+static void *own_script_thread(void *p)
+{
+    pthread_detach(pthread_self());
+
+    struct script_ctx *ctx = p;
+    lua_State *L = ctx->state;
+
+    char name[90];
+    snprintf(name, sizeof(name), "lua script (%s)", ctx->name);
+    mpthread_set_name(name);
+
+    lua_pushcfunction(L, error_handler); // errf
+    lua_pushcfunction(L, call_event_loop); // errf fn
+    if (lua_pcall(L, 0, 0, -2)) { // errf [error]
+        const char *e = lua_tostring(L, -1);
+        MP_FATAL(ctx, "Lua error: %s\n", e ? e : "(unknown)");
+    }
+
+    destroy_script(ctx);
+    return NULL;
+}
+
+static int dispatch_events(lua_State *L)
+{
+    lua_getglobal(L, "mp"); // mp
+    lua_getfield(L, -1, "dispatch_events"); // mp fn
+    lua_pushboolean(L, 0); // mp fn false
+    lua_call(L, 1, 0); // mp
+    lua_getfield(L, -1, "keep_running"); // mp keep_running
+    lua_getfield(L, -2, "get_next_timeout"); // mp keep_running fn
+    lua_call(L, 0, 1); // mp keep_running timeout
+    return 2;
+}
+
+// Process all pending events and timers of the script. Returns false if the
+// script has terminated.
+static bool run_script(struct script_ctx *ctx)
+{
+    lua_State *L = ctx->state;
+
+    lua_pushcfunction(L, error_handler); // errf
+    lua_pushcfunction(L, dispatch_events); // errf fn
+    if (lua_pcall(L, 0, 2, -2)) { // errf [error]
+        const char *e = lua_tostring(L, -1);
+        MP_FATAL(ctx, "Lua error: %s\n", e ? e : "(unknown)");
+        lua_pop(L, 2); // -
+        return false;
+    }
+    // errf keep_running timeout
+    bool keep_running = lua_toboolean(L, -2);
+    ctx->next_timer = 0;
+    if (lua_isnumber(L, -1)) {
+        double timeout = MPMAX(lua_tonumber(L, -1), 0);
+        ctx->next_timer = mp_time_us() + (int64_t)(MPMIN(timeout, 1e9) * 1e6);
+    }
+    lua_pop(L, 3); // -
+    return keep_running;
+}
+
+// Returns false if the script should be destroyed.
+static bool init_shared_script(struct script_ctx *ctx)
+{
+    ctx->state = luaL_newstate();
+    if (!ctx->state) {
+        MP_FATAL(ctx, "Could not initialize Lua.\n");
+        return false;
+    }
+
+    mpv_set_wakeup_callback(ctx->client, shared_wakeup_cb, ctx);
+
+    if (mp_cpcall(ctx->state, run_lua, ctx)) {
+        const char *err = "unknown error";
+        if (lua_type(ctx->state, -1) == LUA_TSTRING) // avoid allocation
+            err = lua_tostring(ctx->state, -1);
+        MP_FATAL(ctx, "Lua error: %s\n", err);
+        return false;
+    }
+    return !ctx->load_error;
+}
+
+static void *shared_thread(void *p)
+{
+    struct mp_lua_shared *shared = p;
+    mpthread_set_name("lua scripts");
+
+    pthread_mutex_lock(&shared->lock);
+    while (1) {
+        while (shared->num_pending) {
+            struct script_ctx *ctx = shared->pending[0];
+            MP_TARRAY_REMOVE_AT(shared->pending, shared->num_pending, 0);
+            pthread_mutex_unlock(&shared->lock);
+
+            bool ok = init_shared_script(ctx);
+            if (ok && ctx->own_thread) {
+                MP_VERBOSE(ctx, "Custom event loop, using a separate thread.\n");
+                mpv_set_wakeup_callback(ctx->client, NULL, NULL);
+                pthread_t thread;
+                if (pthread_create(&thread, NULL, own_script_thread, ctx))
+                    destroy_script(ctx);
+                ctx = NULL;
+            } else if (!ok) {
+                mpv_set_wakeup_callback(ctx->client, NULL, NULL);
+                destroy_script(ctx);
+                ctx = NULL;
+            }
+
+            pthread_mutex_lock(&shared->lock);
+            if (ctx) {
+                ctx->woken = true; // run the initial event dispatch
+                MP_TARRAY_APPEND(shared, shared->scripts, shared->num_scripts,
+                                 ctx);
+            }
+        }
+
+        if (shared->terminate && !shared->num_scripts)
+            break;
+
+        int64_t now = mp_time_us();
+        int64_t wait_until = 0;
+        struct script_ctx *ctx = NULL;
+        for (int n = 0; n < shared->num_scripts; n++) {
+            struct script_ctx *c = shared->scripts[n];
+            if (c->woken || (c->next_timer && c->next_timer <= now)) {
+                ctx = c;
+                break;
+            }
+            if (c->next_timer && (!wait_until || c->next_timer < wait_until))
+                wait_until = c->next_timer;
+        }
+
+        if (!ctx) {
+            if (wait_until) {
+                struct timespec ts = mp_time_us_to_timespec(wait_until);
+                pthread_cond_timedwait(&shared->wakeup, &shared->lock, &ts);
+            } else {
+                pthread_cond_wait(&shared->wakeup, &shared->lock);
+            }
+            continue;
+        }
+
+        // Rotate, so that a busy script can't starve the others.
+        for (int n = 0; n < shared->num_scripts; n++) {
+            if (shared->scripts[n] == ctx) {
+                MP_TARRAY_REMOVE_AT(shared->scripts, shared->num_scripts, n);
+                break;
+            }
+        }
+        MP_TARRAY_APPEND(shared, shared->scripts, shared->num_scripts, ctx);
+
+        ctx->woken = false;
+        pthread_mutex_unlock(&shared->lock);
+
+        bool alive = run_script(ctx);
+        if (!alive)
+            mpv_set_wakeup_callback(ctx->client, NULL, NULL);
+
+        pthread_mutex_lock(&shared->lock);
+        if (!alive) {
+            for (int n = 0; n < shared->num_scripts; n++) {
+                if (shared->scripts[n] == ctx) {
+                    MP_TARRAY_REMOVE_AT(shared->scripts, shared->num_scripts, n);
+                    break;
+                }
+            }
+            pthread_mutex_unlock(&shared->lock);
+            destroy_script(ctx);
+            pthread_mutex_lock(&shared->lock);
+        }
+    }
+    pthread_mutex_unlock(&shared->lock);
+
+    return NULL;
+}
+
+// Queue the script for loading on the shared thread, which is started on first
+// use. Takes over the client handle.
+static int load_lua_shared(struct MPContext *mpctx, struct mpv_handle *client,
+                           const char *fname)
+{
+    struct mp_lua_shared *shared = mpctx->lua_shared;
+    if (!shared) {
+        shared = talloc_ptrtype(NULL, shared);
+        *shared = (struct mp_lua_shared){ .mpctx = mpctx };
+        pthread_mutex_init(&shared->lock, NULL);
+        pthread_cond_init(&shared->wakeup, NULL);
+        if (pthread_create(&shared->thread, NULL, shared_thread, shared)) {
+            pthread_cond_destroy(&shared->wakeup);
+            pthread_mutex_destroy(&shared->lock);
+            talloc_free(shared);
+            mpv_detach_destroy(client);
+            return -1;
+        }
+        mpctx->lua_shared = shared;
+    }
+
+    struct script_ctx *ctx = talloc_ptrtype(NULL, ctx);
+    *ctx = (struct script_ctx) {
+        .mpctx = mpctx,
+        .client = client,
+        .name = mpv_client_name(client),
+        .log = mp_client_get_log(client),
+        .filename = talloc_strdup(ctx, fname),
+        .shared = shared,
+    };
+
+    pthread_mutex_lock(&shared->lock);
+    MP_TARRAY_APPEND(shared, shared->pending, shared->num_pending, ctx);
+    pthread_cond_signal(&shared->wakeup);
+    pthread_mutex_unlock(&shared->lock);
+    return 0;
+}
+
+// Stop the shared thread. All clients must have been destroyed at this point
+// (so all scripts have terminated, or are about to).
+void mp_lua_shared_uninit(struct MPContext *mpctx)
+{
+    struct mp_lua_shared *shared = mpctx->lua_shared;
+    if (!shared)
+        return;
+
+    pthread_mutex_lock(&shared->lock);
+    shared->terminate = true;
+    pthread_cond_signal(&shared->wakeup);
+    pthread_mutex_unlock(&shared->lock);
+    pthread_join(shared->thread, NULL);
+
+    pthread_cond_destroy(&shared->wakeup);
+    pthread_mutex_destroy(&shared->lock);
+    talloc_free(shared);
+    mpctx->lua_shared = NULL;
+}
+
 const struct mp_scripting mp_scripting_lua = {
     .name = "lua script",
     .file_ext = "lua",
     .load = load_lua,
+    .load_shared = load_lua_shared,
 };
@@ -11,6 +11,43 @@ mp.ARRAY.type = "ARRAY"
 mp.MAP.info = "native map"
 mp.MAP.type = "MAP"
 
+-- With LuaJIT, call the client API directly through the FFI for getters that
+-- scripts tend to poll at a high rate.
+local has_ffi, ffi = pcall(require, "ffi")
+if jit and has_ffi then
+    local client, get_property, error_string = mp.raw_ffi_entry_points()
+    get_property = ffi.cast("int (*)(void *, const char *, int, void *)",
+                            get_property)
+    error_string = ffi.cast("const char *(*)(int)", error_string)
+    local FORMAT_FLAG, FORMAT_DOUBLE = 3, 5 -- mpv_format values
+    local flag = ffi.new("int[1]")
+    local number = ffi.new("double[1]")
+
+    local function check_name(name)
+        local t = type(name)
+        if t ~= "string" and t ~= "number" then
+            error("property name must be a string", 3)
+        end
+        return tostring(name)
+    end
+
+    function mp.get_property_bool(name, def)
+        local err = get_property(client, check_name(name), FORMAT_FLAG, flag)
+        if err >= 0 then
+            return flag[0] ~= 0
+        end
+        return def, ffi.string(error_string(err))
+    end
+
+    function mp.get_property_number(name, def)
+        local err = get_property(client, check_name(name), FORMAT_DOUBLE, number)
+        if err >= 0 then
+            return number[0]
+        end
+        return def, ffi.string(error_string(err))
+    end
+end
+
 function mp.get_script_name()
     return mp.script_name
 end
@@ -344,11 +381,11 @@ end
 local property_id = 0
 local properties = {}
 
-function mp.observe_property(name, t, cb)
+function mp.observe_property(name, t, cb, interval)
     local id = property_id + 1
     property_id = id
     properties[id] = cb
-    mp.raw_observe_property(id, name, t)
+    mp.raw_observe_property(id, name, t, interval)
 end
 
 function mp.unobserve_property(cb)
@@ -104,6 +104,7 @@ local state = {
     enabled = true,
     input_enabled = true,
     showhide_enabled = false,
+    chapter_list = {},                      -- last value of chapter-list
 }
 
 
@@ -1735,7 +1736,7 @@ function osc_init()
     ne.slider.markerF = function ()
         local duration = mp.get_property_number("duration", nil)
         if not (duration == nil) then
-            local chapters = mp.get_property_native("chapter-list", {})
+            local chapters = state.chapter_list
             local markers = {}
             for n = 1, #chapters do
                 markers[n] = (chapters[n].time / duration * 100)
@@ -2280,6 +2281,9 @@ validate_user_opts()
 mp.register_event("start-file", request_init)
 mp.register_event("tracks-changed", request_init)
 mp.observe_property("playlist", nil, request_init)
+mp.observe_property("chapter-list", "native", function(_, list)
+    state.chapter_list = list or {}
+end)
 
 mp.register_script_message("osc-message", show_message)
 mp.register_script_message("osc-chapterlist", function(dur)
@@ -347,6 +347,16 @@ local function append_perfdata(s, dedicated_page)
                             frame:gsub("^%l", string.upper))
         end
     end
+
+    local sc = mp.get_property_native("vo-shader-cache")
+    if dedicated_page and sc then
+        s[#s+1] = format("%s%s%s%s%d hits, %d misses, %d evicted, " ..
+                         "%d/%d entries, %d ms compiling",
+                         o.nl, o.indent, b("Shader Cache:"), o.prefix_sep,
+                         sc["hits"], sc["misses"], sc["evictions"],
+                         sc["entries"], sc["max-entries"],
+                         math.floor(sc["compile-time"] / 1e6))
+    end
 end
 
 
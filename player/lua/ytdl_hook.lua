@@ -3,23 +3,137 @@ local msg = require 'mp.msg'
 local options = require 'mp.options'
 
 local o = {
-    exclude = ""
+    exclude = "",
+    -- keep one youtube-dl process running (needs python), instead of starting
+    -- a new one for each URL
+    worker = false,
+    python = "python3",
+    -- seconds to reuse the youtube-dl result for the same URL and options
+    cache_ttl = 300,
 }
 options.read_options(o)
 
 local ytdl = {
     path = "youtube-dl",
     searched = false,
-    blacklisted = {}
+    blacklisted = {},
+    worker = nil,
+    worker_ok = false,
+    worker_disabled = false,
 }
 
 local chapter_list = {}
 
+-- youtube-dl results by command line: {time=..., json=...}
+local result_cache = {}
+
+-- Runs youtube-dl's main() for each request line (a JSON array of arguments),
+-- and writes one response line with the exit status and captured stdout.
+-- youtube-dl is imported from the module path, or from the youtube-dl
+-- executable itself (which is a zip file with the module).
+local worker_code = [[
+import io, json, os, shutil, sys
+try:
+    import youtube_dl
+except ImportError:
+    path = sys.argv[1]
+    if not os.path.isfile(path):
+        path = shutil.which(path) or path
+    sys.path.insert(0, path)
+    import youtube_dl
+for line in sys.stdin:
+    out = io.StringIO()
+    sys.stdout, stdout = out, sys.stdout
+    try:
+        youtube_dl.main(json.loads(line))
+        status = 0
+    except SystemExit as e:
+        if isinstance(e.code, int):
+            status = e.code
+        else:
+            status = int(e.code is not None)
+            if e.code:
+                sys.stderr.write("%s\n" % e.code)
+    except Exception as e:
+        sys.stderr.write("youtube-dl worker: %s\n" % e)
+        status = 1
+    finally:
+        sys.stdout = stdout
+    sys.stdout.write(json.dumps({"status": status, "stdout": out.getvalue()}))
+    sys.stdout.write("\n")
+    sys.stdout.flush()
+]]
+
 local function exec(args)
     local ret = utils.subprocess({args = args})
     return ret.status, ret.stdout, ret
 end
 
+-- Like exec(), but send the command to the worker process. Returns nil if the
+-- worker can't be used.
+local function exec_worker(args)
+    if ytdl.worker_disabled then
+        return nil
+    end
+    if not ytdl.worker then
+        ytdl.worker = utils.subprocess_worker({
+            args = {o.python, "-c", worker_code, args[1]}
+        })
+    end
+
+    local res = nil
+    if ytdl.worker then
+        local params = {}
+        for i = 2, #args do
+            params[#params + 1] = args[i]
+        end
+        res = ytdl.worker:request(utils.format_json(params))
+        res = res and utils.parse_json(res)
+    end
+    if res == nil then
+        if ytdl.worker then
+            ytdl.worker:close()
+            ytdl.worker = nil
+        end
+        if not ytdl.worker_ok then
+            msg.warn("youtube-dl worker not working, starting youtube-dl " ..
+                     "for each URL instead")
+            ytdl.worker_disabled = true
+        end
+        return nil
+    end
+    ytdl.worker_ok = true
+    return res.status, res.stdout, {}
+end
+
+local function run_ytdl(args)
+    local key = table.concat(args, "\0")
+    local now = mp.get_time()
+    local cached = result_cache[key]
+    if cached and now - cached.time < o.cache_ttl then
+        msg.verbose("using cached youtube-dl result")
+        return 0, cached.json, {}
+    end
+
+    local es, json, result = nil, nil, nil
+    if o.worker then
+        es, json, result = exec_worker(args)
+    end
+    if es == nil then
+        es, json, result = exec(args)
+    end
+
+    if o.cache_ttl > 0 and es == 0 and json and json ~= "" then
+        for k, v in pairs(result_cache) do
+            if now - v.time >= o.cache_ttl then
+                result_cache[k] = nil
+            end
+        end
+        result_cache[key] = {time = now, json = json}
+    end
+    return es, json, result
+end
+
 -- return true if it was explicitly set on the command line
 local function option_was_set(name)
     return mp.get_property_bool("option-info/" ..name.. "/set-from-commandline",
@@ -362,7 +476,7 @@ mp.add_hook("on_load", 10, function ()
         table.insert(command, "--")
         table.insert(command, url)
         msg.debug("Running: " .. table.concat(command,' '))
-        local es, json, result = exec(command)
+        local es, json, result = run_ytdl(command)
 
         if (es < 0) or (json == nil) or (json == "") then
             if not result.killed_by_us then
@@ -44,6 +44,8 @@
 #include "common/global.h"
 #include "options/parse_configfile.h"
 #include "options/parse_commandline.h"
+#include "common/mem_budget.h"
+#include "common/perf.h"
 #include "common/playlist.h"
 #include "options/options.h"
 #include "options/path.h"
@@ -168,6 +170,10 @@ void mp_destroy(struct MPContext *mpctx)
 {
     shutdown_clients(mpctx);
 
+#if HAVE_LUA
+    mp_lua_shared_uninit(mpctx);
+#endif
+
     mp_uninit_ipc(mpctx->ipc_ctx);
     mpctx->ipc_ctx = NULL;
 
@@ -326,11 +332,14 @@ struct MPContext *mp_create(void)
         .playlist = talloc_struct(mpctx, struct playlist, {0}),
         .dispatch = mp_dispatch_create(mpctx),
         .playback_abort = mp_cancel_new(mpctx),
+        .backstep_pos = -1,
     };
 
     pthread_mutex_init(&mpctx->lock, NULL);
 
     mpctx->global = talloc_zero(mpctx, struct mpv_global);
+    mpctx->global->perf = mp_perf_create(mpctx->global);
+    mpctx->global->mem_budget = mp_mem_budget_create(mpctx->global);
 
     // Nothing must call mp_msg*() and related before this
     mp_msg_init(mpctx->global);
@@ -376,12 +385,30 @@ struct MPContext *mp_create(void)
 // undone later.
 // If options is not NULL, apply them as command line player arguments.
 // Returns: <0 on error, 0 on success.
+// Record that the named startup phase was completed (only the first call for
+// each name counts). Exposed by the "startup-timings" property.
+void mp_mark_init_phase(struct MPContext *mpctx, const char *name)
+{
+    for (int n = 0; n < mpctx->num_init_phases; n++) {
+        if (strcmp(mpctx->init_phases[n].name, name) == 0)
+            return;
+    }
+    if (mpctx->num_init_phases >= MAX_INIT_PHASES)
+        return;
+    double t = mp_time_sec() - mpctx->init_start;
+    mpctx->init_phases[mpctx->num_init_phases++] =
+        (struct init_phase){ .name = name, .time = t };
+    MP_VERBOSE(mpctx, "Startup phase '%s' done after %.3f s.\n", name, t);
+}
+
 int mp_initialize(struct MPContext *mpctx, char **options)
 {
     struct MPOpts *opts = mpctx->opts;
 
     assert(!mpctx->initialized);
 
+    mpctx->init_start = mp_time_sec();
+
     // Preparse the command line, so we can init the terminal early.
     if (options)
         m_config_preparse_command_line(mpctx->mconfig, mpctx->global, options);
@@ -413,8 +440,10 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     }
 
     mp_get_resume_defaults(mpctx);
+    mp_mark_init_phase(mpctx, "config");
 
     mp_input_load_config(mpctx->input);
+    mp_mark_init_phase(mpctx, "input");
 
     // From this point on, all mpctx members are initialized.
     mpctx->initialized = true;
@@ -422,8 +451,12 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     mpctx->mconfig->option_set_callback_cb = mpctx;
     mpctx->mconfig->option_change_callback = mp_option_change_callback;
     mpctx->mconfig->option_change_callback_ctx = mpctx;
-    // Run all update handlers.
-    mp_option_change_callback(mpctx, NULL, UPDATE_OPTS_MASK);
+    // Run all update handlers. With --deferred-init, builtin scripts are
+    // loaded together with the user scripts later.
+    int update_flags = UPDATE_OPTS_MASK;
+    if (opts->deferred_init)
+        update_flags &= ~UPDATE_BUILTIN_SCRIPTS;
+    mp_option_change_callback(mpctx, NULL, update_flags);
 
     if (handle_help_options(mpctx))
         return -2;
@@ -468,11 +501,19 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     MP_WARN(mpctx, "There will be no OSD and no text subtitles.\n");
 #endif
 
-    mp_load_scripts(mpctx);
+    if (opts->deferred_init) {
+        // Loaded by the playloop once the first file is playing.
+        mpctx->scripts_deferred = true;
+        osd_preload_fonts(mpctx->osd);
+    } else {
+        mp_load_scripts(mpctx);
+        mp_mark_init_phase(mpctx, "scripts");
+    }
 
     if (opts->force_vo == 2 && handle_force_window(mpctx, false) < 0)
         return -1;
 
+    mp_mark_init_phase(mpctx, "init");
     MP_STATS(mpctx, "end init");
 
     return 0;
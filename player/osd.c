@@ -33,6 +33,8 @@
 #include "common/common.h"
 #include "options/m_property.h"
 #include "common/encode.h"
+#include "common/global.h"
+#include "common/perf.h"
 
 #include "osdep/terminal.h"
 #include "osdep/timer.h"
@@ -506,7 +508,7 @@ void update_osd_msg(struct MPContext *mpctx)
         double delay = 0.050; // update the OSD at most this often
         double diff = now - mpctx->osd_last_update;
         if (diff < delay) {
-            mp_set_timeout(mpctx, delay - diff);
+            mp_set_timeout_lazy(mpctx, delay - diff);
             return;
         }
     }
@@ -517,7 +519,7 @@ void update_osd_msg(struct MPContext *mpctx)
     if (mpctx->osd_visible) {
         double sleep = mpctx->osd_visible - now;
         if (sleep > 0) {
-            mp_set_timeout(mpctx, sleep);
+            mp_set_timeout_lazy(mpctx, sleep);
             mpctx->osd_idle_update = true;
         } else {
             mpctx->osd_visible = 0;
@@ -529,7 +531,7 @@ void update_osd_msg(struct MPContext *mpctx)
     if (mpctx->osd_function_visible) {
         double sleep = mpctx->osd_function_visible - now;
         if (sleep > 0) {
-            mp_set_timeout(mpctx, sleep);
+            mp_set_timeout_lazy(mpctx, sleep);
             mpctx->osd_idle_update = true;
         } else {
             mpctx->osd_function_visible = 0;
@@ -547,7 +549,7 @@ void update_osd_msg(struct MPContext *mpctx)
     if (mpctx->osd_msg_visible) {
         double sleep = mpctx->osd_msg_visible - now;
         if (sleep > 0) {
-            mp_set_timeout(mpctx, sleep);
+            mp_set_timeout_lazy(mpctx, sleep);
             mpctx->osd_idle_update = true;
         } else {
             talloc_free(mpctx->osd_msg_text);
@@ -565,7 +567,18 @@ void update_osd_msg(struct MPContext *mpctx)
     }
 
     term_osd_set_text_lazy(mpctx, mpctx->osd_msg_text);
-    term_osd_print_status_lazy(mpctx);
+
+    // Forced updates happen on every video frame. The status line and window
+    // title are meant for humans and expanding them is relatively expensive,
+    // so don't rebuild them more often than the OSD is updated when idle.
+    double status_wait = mpctx->term_status_last_update + 0.050 - now;
+    if (status_wait > 0 && status_wait <= 0.050) {
+        mp_set_timeout_lazy(mpctx, status_wait);
+        mpctx->osd_idle_update = true;
+    } else {
+        mpctx->term_status_last_update = now;
+        term_osd_print_status_lazy(mpctx);
+    }
     term_osd_update(mpctx);
 
     if (!opts->video_osd)
@@ -584,3 +597,117 @@ void update_osd_msg(struct MPContext *mpctx)
     osd_set_text(osd, text);
     talloc_free(text);
 }
+
+struct perf_overlay {
+    double last_update;
+    int64_t counters[MP_PERF_NUM_COUNTERS];
+    struct mp_perf_timer_stats timers[MP_PERF_NUM_TIMERS];
+};
+
+// Append s with the characters that have a special meaning in ASS removed.
+static void sadd_ass_plain(char **buf, const char *s)
+{
+    for (; s && *s; s++) {
+        if (*s != '{' && *s != '}' && *s != '\\')
+            *buf = talloc_asprintf_append_buffer(*buf, "%c", *s);
+    }
+}
+
+static void sadd_vo_perf(char **buf, struct mp_frame_perf *perf)
+{
+    uint64_t last = 0, avg = 0, peak = 0;
+    for (int i = 0; i < perf->count; i++) {
+        last += perf->perf[i].last;
+        avg += perf->perf[i].avg;
+        peak += perf->perf[i].peak;
+    }
+    *buf = talloc_asprintf_append_buffer(*buf,
+                "{\\b1}Frame rendering{\\b0}: last %.2f ms, avg %.2f ms, "
+                "peak %.2f ms\\N", last / 1e6, avg / 1e6, peak / 1e6);
+    for (int i = 0; i < perf->count; i++) {
+        struct mp_pass_perf *pass = &perf->perf[i];
+        *buf = talloc_asprintf_append_buffer(*buf, "    ");
+        sadd_ass_plain(buf, perf->desc[i]);
+        *buf = talloc_asprintf_append_buffer(*buf,
+                ": avg %d us, peak %d us\\N",
+                (int)(pass->avg / 1000), (int)(pass->peak / 1000));
+    }
+}
+
+// Format the overlay text. Rates and averages are over the elapsed time since
+// the previous update, and are left out on the first update.
+static char *get_perf_overlay_text(struct MPContext *mpctx,
+                                   struct perf_overlay *ov, double elapsed)
+{
+    struct mp_perf *perf = mpctx->global->perf;
+    char *text = talloc_strdup(NULL, "{\\an7\\fs20\\bord1.5\\q2}");
+
+    if (mpctx->video_out) {
+        struct voctrl_performance_data *data = talloc_ptrtype(NULL, data);
+        if (vo_control(mpctx->video_out, VOCTRL_PERFORMANCE_DATA, data) > 0)
+            sadd_vo_perf(&text, &data->fresh);
+        talloc_free(data);
+    }
+
+    for (int n = 0; n < MP_PERF_NUM_TIMERS; n++) {
+        struct mp_perf_timer_stats st;
+        mp_perf_get_timer(perf, n, &st);
+        int64_t count = st.count - ov->timers[n].count;
+        int64_t total = st.total_us - ov->timers[n].total_us;
+        if (elapsed > 0 && count > 0) {
+            text = talloc_asprintf_append_buffer(text,
+                    "%s: %.1f/s, avg %.2f ms, max %.2f ms\\N",
+                    mp_perf_timer_name(n), count / elapsed,
+                    total / 1e3 / count, st.max_us / 1e3);
+        }
+        ov->timers[n] = st;
+    }
+
+    for (int n = 0; n < MP_PERF_NUM_COUNTERS; n++) {
+        int64_t v = mp_perf_get_counter(perf, n);
+        if (elapsed > 0) {
+            text = talloc_asprintf_append_buffer(text,
+                    "%s: %"PRId64" (%.1f/s)\\N", mp_perf_counter_name(n), v,
+                    (v - ov->counters[n]) / elapsed);
+        }
+        ov->counters[n] = v;
+    }
+
+    return text;
+}
+
+// Update the native performance overlay (--perf-overlay). The text is rebuilt
+// only every --perf-overlay-interval seconds; in between, the OSD keeps the
+// rendered bitmap, so the overlay adds no per-frame work.
+void update_perf_overlay(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct perf_overlay *ov = mpctx->perf_overlay;
+
+    if (!opts->perf_overlay || !opts->video_osd || !mpctx->global->perf) {
+        if (ov) {
+            osd_set_external(mpctx->osd, ov, 0, 0, NULL);
+            TA_FREEP(&mpctx->perf_overlay);
+        }
+        return;
+    }
+
+    double now = mp_time_sec();
+    double elapsed = 0;
+    if (ov) {
+        elapsed = now - ov->last_update;
+        double wait = opts->perf_overlay_interval - elapsed;
+        if (wait > 0) {
+            mp_set_timeout_lazy(mpctx, wait);
+            return;
+        }
+    } else {
+        ov = mpctx->perf_overlay = talloc_zero(mpctx, struct perf_overlay);
+    }
+    ov->last_update = now;
+    mp_set_timeout_lazy(mpctx, opts->perf_overlay_interval);
+
+    char *text = get_perf_overlay_text(mpctx, ov, elapsed);
+    osd_set_external(mpctx->osd, ov, 0, 0, text);
+    talloc_free(text);
+}
@@ -51,20 +51,29 @@
 #include "client.h"
 #include "command.h"
 
+// Maximum delay for timers set with mp_set_timeout_lazy().
+#define TIMER_SLACK 0.05
+
 // Wait until mp_wakeup_core() is called, since the last time
 // mp_wait_events() was called.
 void mp_wait_events(struct MPContext *mpctx)
 {
-    bool sleeping = mpctx->sleeptime > 0;
+    // Lazy timers are allowed to fire late, so that they can share a wakeup
+    // with other timers or regular playback work.
+    double sleeptime = MPMIN(mpctx->sleeptime,
+                             mpctx->sleeptime_lazy + TIMER_SLACK);
+
+    bool sleeping = sleeptime > 0;
     if (sleeping)
         MP_STATS(mpctx, "start sleep");
 
     mpctx->in_dispatch = true;
 
-    mp_dispatch_queue_process(mpctx->dispatch, mpctx->sleeptime);
+    mp_dispatch_queue_process(mpctx->dispatch, sleeptime);
 
     mpctx->in_dispatch = false;
     mpctx->sleeptime = INFINITY;
+    mpctx->sleeptime_lazy = INFINITY;
 
     if (sleeping)
         MP_STATS(mpctx, "end sleep");
@@ -82,6 +91,18 @@ void mp_set_timeout(struct MPContext *mpctx, double sleeptime)
         mp_wakeup_core(mpctx);
 }
 
+// Like mp_set_timeout(), but for housekeeping timers (OSD expiry, cursor
+// autohide, cache status updates...) which don't need to run exactly on time.
+// The playloop may wake up to TIMER_SLACK seconds later, which lets these
+// timers coalesce instead of each causing a separate wakeup.
+void mp_set_timeout_lazy(struct MPContext *mpctx, double sleeptime)
+{
+    mpctx->sleeptime_lazy = MPMIN(mpctx->sleeptime_lazy, sleeptime);
+
+    if (mpctx->in_dispatch && isfinite(sleeptime))
+        mp_wakeup_core(mpctx);
+}
+
 // Cause the playloop to run. This can be called from any thread. If called
 // from within the playloop itself, it will be run immediately again, instead
 // of going to sleep in the next mp_wait_events().
@@ -171,6 +192,13 @@ void set_pause_state(struct MPContext *mpctx, bool user_pause)
             mpctx->time_frame -= get_relative_time(mpctx);
         } else {
             (void)get_relative_time(mpctx); // ignore time that passed during pause
+            // A frame from the backstep cache is displayed, but the decoder
+            // is still positioned after the most recent frame.
+            if (mpctx->backstep_pos >= 0) {
+                queue_seek(mpctx, MPSEEK_ABSOLUTE, mpctx->video_pts,
+                           MPSEEK_VERY_EXACT, 0);
+                mpctx->backstep_pos = -1;
+            }
         }
     }
 
@@ -199,6 +227,8 @@ void add_step_frame(struct MPContext *mpctx, int dir)
 {
     if (!mpctx->vo_chain)
         return;
+    if (step_backstep_cache(mpctx, dir))
+        return;
     if (dir > 0) {
         mpctx->step_frames += 1;
         set_pause_state(mpctx, false);
@@ -246,6 +276,9 @@ void reset_playback_state(struct MPContext *mpctx)
     update_core_idle_state(mpctx);
 }
 
+// Seeks closer together than this (in seconds) are considered scrubbing.
+#define SCRUB_INTERVAL 0.5
+
 static void mp_seek(MPContext *mpctx, struct seek_params seek)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -325,6 +358,16 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
         demux_flags = (demux_flags | SEEK_HR) & ~SEEK_FORWARD;
     }
 
+    // Decoder threads must not read packets from after the seek before they
+    // are reset (reset_playback_state() below would discard them).
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *track = mpctx->tracks[n];
+        if (track->d_video && track->d_video->thread)
+            video_reset(track->d_video);
+        if (track->d_audio && track->d_audio->thread)
+            audio_reset_decoding(track->d_audio);
+    }
+
     demux_seek(mpctx->demuxer, demux_pts, demux_flags);
 
     // Seek external, extra files too:
@@ -366,6 +409,10 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
         mpctx->stop_play = KEEP_PLAYING;
 
     mpctx->start_timestamp = mp_time_sec();
+    mpctx->scrubbing = opts->scrub_keyframes && !hr_seek &&
+                       mpctx->start_timestamp - mpctx->last_seek_time <
+                       SCRUB_INTERVAL;
+    mpctx->last_seek_time = mpctx->start_timestamp;
     mp_wakeup_core(mpctx);
 
     mp_notify(mpctx, MPV_EVENT_SEEK, NULL);
@@ -430,9 +477,17 @@ void execute_queued_seek(struct MPContext *mpctx)
          * try to finish showing a frame from one location before doing
          * another seek (which could lead to unchanging display). */
         bool delay = mpctx->seek.flags & MPSEEK_FLAG_DELAY;
-        if (delay && mpctx->video_status < STATUS_PLAYING &&
-            mp_time_sec() - mpctx->start_timestamp < 0.3)
+        /* Likewise when scrubbing (e.g. dragging the OSC seekbar): every seek
+         * resets the demuxer and decoders, so starting a new one before the
+         * previous one showed a frame only throws away work. Newer targets
+         * replace older ones in mpctx->seek while waiting, so only the
+         * latest one is executed. */
+        delay |= mpctx->scrubbing;
+        double wait = mpctx->start_timestamp + 0.3 - mp_time_sec();
+        if (delay && mpctx->video_status < STATUS_PLAYING && wait > 0) {
+            mp_set_timeout(mpctx, wait);
             return;
+        }
         mp_seek(mpctx, mpctx->seek);
         mpctx->seek = (struct seek_params){0};
     }
@@ -586,7 +641,7 @@ static void handle_osd_redraw(struct MPContext *mpctx)
     // Don't redraw immediately during a seek (makes it significantly slower).
     bool use_video = mpctx->vo_chain && !mpctx->vo_chain->is_coverart;
     if (use_video && mp_time_sec() - mpctx->start_timestamp < 0.1) {
-        mp_set_timeout(mpctx, 0.1);
+        mp_set_timeout_lazy(mpctx, 0.1);
         return;
     }
     bool want_redraw = osd_query_and_reset_want_redraw(mpctx->osd) ||
@@ -596,6 +651,182 @@ static void handle_osd_redraw(struct MPContext *mpctx)
     vo_redraw(mpctx->video_out);
 }
 
+// Return how far the playback position lags behind the newest data received by
+// the demuxer, or MP_NOPTS_VALUE if unknown. For live streams, this is the
+// latency added by the player.
+double get_live_latency(struct MPContext *mpctx)
+{
+    if (!mpctx->demuxer || mpctx->playback_pts == MP_NOPTS_VALUE)
+        return MP_NOPTS_VALUE;
+
+    struct demux_ctrl_reader_state s;
+    if (demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_READER_STATE, &s) < 1 ||
+        s.ts_end == MP_NOPTS_VALUE)
+        return MP_NOPTS_VALUE;
+
+    return MPMAX(s.ts_end - mpctx->playback_pts, 0);
+}
+
+// With --live-latency-target, play faster while the latency is too high.
+static void handle_live_latency(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    double target = opts->live_latency_target;
+    double factor = 1.0;
+
+    double latency = get_live_latency(mpctx);
+    if (target > 0 && latency != MP_NOPTS_VALUE && mpctx->restart_complete &&
+        !mpctx->paused)
+    {
+        // Start above 1.5x the target, and keep going until it's reached.
+        bool catching_up = mpctx->speed_factor_live > 1.0;
+        if (latency > target * (catching_up ? 1.0 : 1.5))
+            factor = opts->live_catchup_speed;
+    }
+
+    if (factor != mpctx->speed_factor_live) {
+        if (factor > 1.0) {
+            MP_VERBOSE(mpctx, "Latency is %f seconds, catching up.\n", latency);
+        } else {
+            MP_VERBOSE(mpctx, "Stopped catching up.\n");
+        }
+        mpctx->speed_factor_live = factor;
+        update_playback_speed(mpctx);
+    }
+}
+
+// Minimum time between bandwidth checks, and between switching up.
+#define ABR_CHECK_INTERVAL 2.0
+#define ABR_UP_HOLD_TIME 10.0
+// Fraction of the measured bandwidth a variant may use.
+#define ABR_SAFETY 0.8
+// Switch down only if less than this is buffered (seconds); switch up only if
+// at least this much is buffered.
+#define ABR_BUFFER_SECS 5.0
+
+// Return the track of the given type that belongs to the variant with the
+// given bitrate. Prefer the same language as cur.
+static struct track *find_variant_track(struct MPContext *mpctx,
+                                        enum stream_type type, int bitrate,
+                                        struct track *cur)
+{
+    struct track *res = NULL;
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *t = mpctx->tracks[n];
+        if (t->type != type || t->is_external || !t->stream ||
+            t->stream->hls_bitrate != bitrate)
+            continue;
+        bool same_lang = cur && cur->lang && t->lang &&
+                         strcmp(cur->lang, t->lang) == 0;
+        if (!res || same_lang)
+            res = t;
+        if (same_lang)
+            break;
+    }
+    return res;
+}
+
+// With --hls-bitrate=auto, switch between the variants of an adaptive stream
+// (exposed as tracks with different hls_bitrate) depending on the rate at
+// which the demuxer reads data, and the amount of buffered data. Switching
+// tracks makes the demuxer resume the new variant at the current position.
+static void handle_adaptive_bitrate(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    if (opts->hls_bitrate != -2 || !mpctx->demuxer || !mpctx->restart_complete)
+        return;
+
+    double now = mp_time_sec();
+    if (now < mpctx->abr_next_check) {
+        mp_set_timeout_lazy(mpctx, mpctx->abr_next_check - now);
+        return;
+    }
+    mpctx->abr_next_check = now + ABR_CHECK_INTERVAL;
+    mp_set_timeout_lazy(mpctx, ABR_CHECK_INTERVAL);
+
+    // The variant is determined by the video track (or audio if there's none).
+    enum stream_type type = STREAM_VIDEO;
+    struct track *cur = mpctx->current_track[0][STREAM_VIDEO];
+    if (!cur) {
+        type = STREAM_AUDIO;
+        cur = mpctx->current_track[0][STREAM_AUDIO];
+    }
+    if (!cur || cur->is_external || !cur->stream ||
+        cur->stream->hls_bitrate <= 0)
+        return;
+
+    struct demux_ctrl_reader_state s = {.ts_duration = -1};
+    demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_READER_STATE, &s);
+    if (s.bytes_per_second <= 0 || s.eof)
+        return;
+    double bandwidth = s.bytes_per_second * 8;
+
+    // Highest bitrate that fits, or the lowest one if none does.
+    int cur_rate = cur->stream->hls_bitrate;
+    int target = -1, lowest = -1;
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *t = mpctx->tracks[n];
+        if (t->type != type || t->is_external || !t->stream ||
+            t->stream->hls_bitrate <= 0)
+            continue;
+        int rate = t->stream->hls_bitrate;
+        if (lowest < 0 || rate < lowest)
+            lowest = rate;
+        if (rate <= bandwidth * ABR_SAFETY && rate > target)
+            target = rate;
+    }
+    if (target < 0)
+        target = lowest;
+    if (target == cur_rate)
+        return;
+
+    // Switching down can wait while there's enough data buffered. Switching
+    // up needs a buffer to cover the refresh, and is rate limited to avoid
+    // oscillating between variants.
+    bool low_buffer = s.underrun || s.ts_duration < ABR_BUFFER_SECS;
+    if (target < cur_rate && !low_buffer)
+        return;
+    if (target > cur_rate &&
+        (low_buffer || now - mpctx->abr_last_switch < ABR_UP_HOLD_TIME))
+        return;
+
+    struct track *track = find_variant_track(mpctx, type, target, cur);
+    if (!track)
+        return;
+
+    MP_INFO(mpctx, "Switching to %d kbit/s variant (bandwidth %d kbit/s).\n",
+            target / 1000, (int)(bandwidth / 1000));
+
+    // Audio is usually part of the same variant, switch it along.
+    struct track *audio = mpctx->current_track[0][STREAM_AUDIO];
+    if (type == STREAM_VIDEO && audio && audio->stream &&
+        audio->stream->hls_bitrate == cur_rate)
+    {
+        struct track *new_audio =
+            find_variant_track(mpctx, STREAM_AUDIO, target, audio);
+        if (new_audio)
+            mp_switch_track(mpctx, STREAM_AUDIO, new_audio, 0);
+    }
+    mp_switch_track(mpctx, type, track, 0);
+
+    mpctx->abr_last_switch = now;
+}
+
+// Leave keyframe-only decoding once the user stopped scrubbing.
+static void handle_scrubbing(struct MPContext *mpctx)
+{
+    if (!mpctx->scrubbing)
+        return;
+
+    double left = mpctx->last_seek_time + SCRUB_INTERVAL - mp_time_sec();
+    if (left > 0) {
+        mp_set_timeout_lazy(mpctx, left);
+    } else {
+        MP_VERBOSE(mpctx, "Scrubbing ended.\n");
+        mpctx->scrubbing = false;
+    }
+}
+
 static void handle_pause_on_low_cache(struct MPContext *mpctx)
 {
     bool force_update = false;
@@ -629,7 +860,7 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
                 update_internal_pause_state(mpctx);
                 force_update = true;
             }
-            mp_set_timeout(mpctx, 0.2);
+            mp_set_timeout_lazy(mpctx, 0.2);
         } else {
             if (opts->cache_pausing && s.underrun) {
                 mpctx->paused_for_cache = true;
@@ -653,7 +884,7 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
             force_update = true;
         }
         if (mpctx->next_cache_update > 0)
-            mp_set_timeout(mpctx, mpctx->next_cache_update - now);
+            mp_set_timeout_lazy(mpctx, mpctx->next_cache_update - now);
     }
 
     if (mpctx->cache_buffer != cache_buffer) {
@@ -674,6 +905,13 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
     if (s.eof && !busy)
         prefetch_next(mpctx);
 
+    if (opts->prefetch_secs > 0) {
+        double len = get_time_length(mpctx);
+        double pos = get_current_time(mpctx);
+        if (len > 0 && pos != MP_NOPTS_VALUE && len - pos <= opts->prefetch_secs)
+            prefetch_next(mpctx);
+    }
+
     if (force_update)
         mp_notify(mpctx, MP_EVENT_CACHE_UPDATE, NULL);
 }
@@ -702,7 +940,7 @@ static void handle_cursor_autohide(struct MPContext *mpctx)
     }
 
     if (mpctx->mouse_timer > now) {
-        mp_set_timeout(mpctx, mpctx->mouse_timer - now);
+        mp_set_timeout_lazy(mpctx, mpctx->mouse_timer - now);
     } else {
         mouse_cursor_visible = false;
     }
@@ -922,8 +1160,9 @@ err:
 static void handle_dummy_ticks(struct MPContext *mpctx)
 {
     if (mpctx->video_status == STATUS_EOF || mpctx->paused) {
-        if (mp_time_sec() - mpctx->last_idle_tick > 0.050) {
-            mpctx->last_idle_tick = mp_time_sec();
+        double now = mp_time_sec();
+        if (now - mpctx->last_idle_tick > 0.050) {
+            mpctx->last_idle_tick = now;
             mp_notify(mpctx, MPV_EVENT_TICK, NULL);
         }
     }
@@ -975,6 +1214,7 @@ static void handle_playback_restart(struct MPContext *mpctx)
     if (!mpctx->restart_complete) {
         mpctx->hrseek_active = false;
         mpctx->restart_complete = true;
+        mp_mark_init_phase(mpctx, "first-frame");
         mpctx->current_seek = (struct seek_params){0};
         mpctx->audio_allow_second_chance_seek = false;
         handle_playback_time(mpctx);
@@ -1057,6 +1297,21 @@ static void handle_complex_filter_decoders(struct MPContext *mpctx)
     }
 }
 
+// Load the scripts skipped by --deferred-init, as soon as the first file has
+// started playing (or if there is no file being played).
+static void handle_deferred_init(struct MPContext *mpctx)
+{
+    if (!mpctx->scripts_deferred)
+        return;
+    if (mpctx->playing && !mpctx->restart_complete && !mpctx->stop_play)
+        return;
+
+    mpctx->scripts_deferred = false;
+    mp_load_builtin_scripts(mpctx);
+    mp_load_scripts(mpctx);
+    mp_mark_init_phase(mpctx, "scripts");
+}
+
 void run_playloop(struct MPContext *mpctx)
 {
 #if HAVE_ENCODING
@@ -1085,12 +1340,14 @@ void run_playloop(struct MPContext *mpctx)
     write_video(mpctx);
 
     handle_playback_restart(mpctx);
+    handle_deferred_init(mpctx);
 
     handle_playback_time(mpctx);
 
     handle_dummy_ticks(mpctx);
 
     update_osd_msg(mpctx);
+    update_perf_overlay(mpctx);
     if (mpctx->video_status == STATUS_EOF)
         update_subtitles(mpctx, mpctx->playback_pts);
 
@@ -1113,6 +1370,12 @@ void run_playloop(struct MPContext *mpctx)
 
     handle_pause_on_low_cache(mpctx);
 
+    handle_live_latency(mpctx);
+
+    handle_adaptive_bitrate(mpctx);
+
+    handle_scrubbing(mpctx);
+
     mp_process_input(mpctx);
 
     handle_chapter_change(mpctx);
@@ -1124,6 +1387,7 @@ void run_playloop(struct MPContext *mpctx)
 
 void mp_idle(struct MPContext *mpctx)
 {
+    handle_deferred_init(mpctx);
     handle_dummy_ticks(mpctx);
     mp_wait_events(mpctx);
     mp_process_input(mpctx);
@@ -1131,6 +1395,7 @@ void mp_idle(struct MPContext *mpctx)
     handle_cursor_autohide(mpctx);
     handle_vo_events(mpctx);
     update_osd_msg(mpctx);
+    update_perf_overlay(mpctx);
     handle_osd_redraw(mpctx);
 }
 
@@ -0,0 +1,332 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <pthread.h>
+
+#include "mpv_talloc.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/playlist.h"
+#include "demux/demux.h"
+#include "demux/stheader.h"
+#include "misc/dispatch.h"
+#include "options/m_config.h"
+#include "options/options.h"
+#include "osdep/threads.h"
+#include "stream/stream.h"
+#include "video/decode/dec_video.h"
+#include "video/hwdec.h"
+#include "video/mp_image.h"
+#include "video/sws_utils.h"
+
+#include "command.h"
+#include "core.h"
+#include "preview.h"
+
+// Give up on a request if the decoder didn't output a frame after this many
+// packets (e.g. broken files, or seeking failed entirely).
+#define MAX_PACKETS 500
+
+struct mp_preview {
+    struct mp_log *log;
+    struct mpv_global *global;
+    struct MPContext *mpctx;
+    char *filename;
+    int stream_flags;
+    struct mp_cancel *cancel;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+
+    // --- the following fields are protected by lock
+    bool terminate;
+    bool have_request;
+    double req_pts;
+    int req_w, req_h;
+    struct mp_image *frame;     // last result
+    int64_t frame_count;        // number of results so far
+
+    // --- preview thread only
+    struct m_config_cache *opts_cache;
+    struct demuxer *demuxer;
+    struct dec_video *d_video;
+    bool open_failed;
+};
+
+static bool open_file(struct mp_preview *p)
+{
+    if (p->d_video)
+        return true;
+    if (p->open_failed)
+        return false;
+    p->open_failed = true;
+
+    struct MPOpts *opts = p->opts_cache->opts;
+
+    struct demuxer_params params = {
+        .stream_flags = p->stream_flags,
+        .disable_cache = true,
+    };
+    p->demuxer = demux_open_url(p->filename, &params, p->cancel, p->global);
+    if (!p->demuxer) {
+        MP_VERBOSE(p, "Could not open file.\n");
+        return false;
+    }
+
+    if (opts->rebase_start_time)
+        demux_set_ts_offset(p->demuxer, -p->demuxer->start_time);
+
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux_get_num_stream(p->demuxer); n++) {
+        struct sh_stream *s = demux_get_stream(p->demuxer, n);
+        if (s->type == STREAM_VIDEO && !s->attached_picture) {
+            sh = s;
+            break;
+        }
+    }
+    if (!sh) {
+        MP_VERBOSE(p, "No video stream.\n");
+        return false;
+    }
+    demuxer_select_track(p->demuxer, sh, MP_NOPTS_VALUE, true);
+
+    // Always decode in software; the hwdec context belongs to the VO.
+    opts->hwdec_api = HWDEC_NONE;
+
+    struct dec_video *d_video = talloc_zero(NULL, struct dec_video);
+    d_video->global = p->global;
+    d_video->log = mp_log_new(d_video, p->log, "!vd");
+    d_video->opts = opts;
+    d_video->header = sh;
+    d_video->codec = sh->codec;
+    d_video->fps = sh->codec->fps;
+    if (!video_init_best_codec(d_video)) {
+        video_uninit(d_video);
+        return false;
+    }
+    p->d_video = d_video;
+
+    p->open_failed = false;
+    return true;
+}
+
+static void close_file(struct mp_preview *p)
+{
+    video_uninit(p->d_video);
+    p->d_video = NULL;
+    if (p->demuxer)
+        free_demuxer_and_stream(p->demuxer);
+    p->demuxer = NULL;
+}
+
+static bool new_request_pending(struct mp_preview *p)
+{
+    pthread_mutex_lock(&p->lock);
+    bool r = p->have_request || p->terminate;
+    pthread_mutex_unlock(&p->lock);
+    return r;
+}
+
+static struct mp_image *scale_frame(struct mp_preview *p, struct mp_image *img,
+                                    int w, int h)
+{
+    int d_w, d_h;
+    mp_image_params_get_dsize(&img->params, &d_w, &d_h);
+    if (d_w < 1 || d_h < 1)
+        return NULL;
+
+    // Fit into the requested size, keeping the aspect ratio.
+    double scale = 1.0;
+    if (w > 0)
+        scale = MPMIN(scale, w / (double)d_w);
+    if (h > 0)
+        scale = MPMIN(scale, h / (double)d_h);
+    int dst_w = MPMAX(lrint(d_w * scale), 1);
+    int dst_h = MPMAX(lrint(d_h * scale), 1);
+
+    struct mp_image_params params = {
+        .imgfmt = IMGFMT_BGR0,
+        .w = dst_w,
+        .h = dst_h,
+        .p_w = 1,
+        .p_h = 1,
+    };
+    mp_image_params_guess_csp(&params);
+
+    struct mp_image *dst = mp_image_alloc(params.imgfmt, dst_w, dst_h);
+    if (!dst)
+        return NULL;
+    mp_image_copy_attributes(dst, img);
+    dst->params = params;
+
+    if (mp_image_swscale(dst, img, mp_sws_fast_flags) < 0) {
+        MP_ERR(p, "Error when converting image.\n");
+        talloc_free(dst);
+        return NULL;
+    }
+    return dst;
+}
+
+// Seek to the keyframe before pts, and return the first frame decoded from it.
+// Decoding only the keyframe means seeking is as fast as the demuxer allows,
+// at the cost of the result being up to a GOP before the requested position.
+static struct mp_image *decode_frame(struct mp_preview *p, double pts)
+{
+    if (!open_file(p))
+        return NULL;
+
+    video_reset(p->d_video);
+    if (!demux_seek(p->demuxer, pts, 0)) {
+        MP_VERBOSE(p, "Seeking failed.\n");
+        return NULL;
+    }
+
+    struct mp_image *img = NULL;
+    for (int n = 0; n < MAX_PACKETS; n++) {
+        // The user moved on; don't bother finishing this one.
+        if (new_request_pending(p))
+            break;
+        video_work(p->d_video);
+        int r = video_get_frame(p->d_video, &img);
+        if (r == DATA_OK || r == DATA_EOF)
+            break;
+    }
+    return img;
+}
+
+static void notify_frame(void *ctx)
+{
+    struct MPContext *mpctx = ctx;
+    mp_notify_property(mpctx, "preview-frame");
+}
+
+static void *preview_thread(void *ctx)
+{
+    struct mp_preview *p = ctx;
+    mpthread_set_name("preview");
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->terminate) {
+        if (!p->have_request) {
+            pthread_cond_wait(&p->wakeup, &p->lock);
+            continue;
+        }
+        double pts = p->req_pts;
+        int w = p->req_w, h = p->req_h;
+        p->have_request = false;
+        pthread_mutex_unlock(&p->lock);
+
+        struct mp_image *res = NULL;
+        struct mp_image *img = decode_frame(p, pts);
+        if (img) {
+            res = scale_frame(p, img, w, h);
+            talloc_free(img);
+        }
+
+        pthread_mutex_lock(&p->lock);
+        if (res) {
+            talloc_free(p->frame);
+            p->frame = res;
+            p->frame_count++;
+            mp_dispatch_enqueue(p->mpctx->dispatch, notify_frame, p->mpctx);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    close_file(p);
+    return NULL;
+}
+
+static struct mp_preview *preview_create(struct MPContext *mpctx)
+{
+    struct mp_preview *p = talloc_zero(NULL, struct mp_preview);
+    p->log = mp_log_new(p, mpctx->log, "preview");
+    p->global = mpctx->global;
+    p->mpctx = mpctx;
+    p->filename = talloc_strdup(p, mpctx->stream_open_filename);
+    p->stream_flags = mpctx->playing ? mpctx->playing->stream_flags : 0;
+    p->cancel = mp_cancel_new(p);
+    p->opts_cache = m_config_cache_alloc(p, mpctx->global, NULL);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+
+    if (pthread_create(&p->thread, NULL, preview_thread, p)) {
+        pthread_cond_destroy(&p->wakeup);
+        pthread_mutex_destroy(&p->lock);
+        talloc_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+bool preview_request(struct MPContext *mpctx, double pts, int w, int h)
+{
+    if (!mpctx->demuxer || !mpctx->stream_open_filename)
+        return false;
+
+    if (!mpctx->preview)
+        mpctx->preview = preview_create(mpctx);
+    struct mp_preview *p = mpctx->preview;
+    if (!p)
+        return false;
+
+    pthread_mutex_lock(&p->lock);
+    p->have_request = true;
+    p->req_pts = pts;
+    p->req_w = w;
+    p->req_h = h;
+    pthread_cond_signal(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+    return true;
+}
+
+struct mp_image *preview_get_frame(struct MPContext *mpctx, int64_t *count)
+{
+    struct mp_preview *p = mpctx->preview;
+    if (!p)
+        return NULL;
+
+    pthread_mutex_lock(&p->lock);
+    struct mp_image *res = p->frame ? mp_image_new_ref(p->frame) : NULL;
+    if (count)
+        *count = p->frame_count;
+    pthread_mutex_unlock(&p->lock);
+    return res;
+}
+
+void preview_uninit(struct MPContext *mpctx)
+{
+    struct mp_preview *p = mpctx->preview;
+    if (!p)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    p->terminate = true;
+    pthread_cond_signal(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+    mp_cancel_trigger(p->cancel);
+    pthread_join(p->thread, NULL);
+
+    talloc_free(p->frame);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+    talloc_free(p);
+    mpctx->preview = NULL;
+}
@@ -0,0 +1,42 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPLAYER_PREVIEW_H
+#define MPLAYER_PREVIEW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct MPContext;
+
+// Request a preview frame of the current file at the given timestamp, scaled
+// to fit into w x h (0 for either means unscaled in this dimension). This
+// returns immediately; the frame is decoded on a separate thread with its own
+// demuxer and decoder instance, and the "preview-frame" property is updated
+// once it's done. A new request replaces a pending one. Returns false if
+// there is no file to take previews from.
+bool preview_request(struct MPContext *mpctx, double pts, int w, int h);
+
+// Return a new reference to the most recent preview frame (a IMGFMT_BGR0
+// image), or NULL if there is none yet. If count is not NULL, it is set to
+// the number of preview frames decoded so far (changes with each new frame).
+struct mp_image *preview_get_frame(struct MPContext *mpctx, int64_t *count);
+
+// Stop the preview thread and close the file (on end of playback).
+void preview_uninit(struct MPContext *mpctx);
+
+#endif /* MPLAYER_PREVIEW_H */
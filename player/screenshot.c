@@ -19,6 +19,8 @@
 #include <string.h>
 #include <time.h>
 
+#include <libavutil/cpu.h>
+
 #include "config.h"
 
 #include "osdep/io.h"
@@ -44,6 +46,11 @@
 #define MODE_FULL_WINDOW 1
 #define MODE_SUBTITLES 2
 
+// Maximum number of screenshots queued for asynchronous writing. If there are
+// more, further screenshots are written synchronously, which throttles the
+// playloop (mostly relevant for "each-frame" mode).
+#define MAX_QUEUED 8
+
 typedef struct screenshot_ctx {
     struct MPContext *mpctx;
 
@@ -53,6 +60,7 @@ typedef struct screenshot_ctx {
 
     int frameno;
 
+    int queued; // number of items on the thread pool (under dispatch lock)
     struct mp_thread_pool *thread_pool;
 } screenshot_ctx;
 
@@ -113,6 +121,13 @@ static void write_screenshot_thread(void *arg)
     screenshot_msg(ctx, MSGL_INFO, "Screenshot: '%s'", item->filename);
     UNLOCK(item)
 
+    // Deferred from screenshot_get() so the readback doesn't block the core.
+    if (item->img && (item->img->fmt.flags & MP_IMGFLAG_HWACCEL)) {
+        struct mp_image *nimage = mp_image_hw_download(item->img, NULL);
+        talloc_free(item->img);
+        item->img = talloc_steal(item, nimage);
+    }
+
     if (!item->img || !write_image(item->img, &item->opts, item->filename,
                                    item->mpctx->log))
     {
@@ -125,6 +140,7 @@ static void write_screenshot_thread(void *arg)
         mp_dispatch_lock(item->mpctx->dispatch);
         screenshot_msg(ctx, MSGL_V, "Screenshot writing done.");
         item->mpctx->outstanding_async -= 1;
+        ctx->queued -= 1;
         mp_wakeup_core(item->mpctx);
         mp_dispatch_unlock(item->mpctx->dispatch);
     }
@@ -147,12 +163,17 @@ static void write_screenshot(struct MPContext *mpctx, struct mp_image *img,
         .opts = opts ? *opts : *gopts,
     };
 
-    if (async) {
-        if (!ctx->thread_pool)
-            ctx->thread_pool = mp_thread_pool_create(ctx, 1);
+    if (async && ctx->queued < MAX_QUEUED) {
+        if (!ctx->thread_pool) {
+            // Images are encoded independently (and filenames are chosen on
+            // the core thread), so several can be written in parallel.
+            int threads = MPCLAMP(av_cpu_count(), 1, MAX_QUEUED);
+            ctx->thread_pool = mp_thread_pool_create(ctx, threads);
+        }
         if (ctx->thread_pool) {
             item->on_thread = true;
             mpctx->outstanding_async += 1;
+            ctx->queued += 1;
             mp_thread_pool_queue(ctx->thread_pool, write_screenshot_thread, item);
             item = NULL;
         }
@@ -390,7 +411,10 @@ static void add_subs(struct MPContext *mpctx, struct mp_image *image)
                       OSD_DRAW_SUB_ONLY, image);
 }
 
-static struct mp_image *screenshot_get(struct MPContext *mpctx, int mode)
+// If hw is true, the returned image may be a hardware surface, and the caller
+// must download it with mp_image_hw_download() before accessing the data.
+static struct mp_image *screenshot_get(struct MPContext *mpctx, int mode,
+                                       bool hw)
 {
     struct mp_image *image = NULL;
     if (mode == MODE_SUBTITLES && osd_get_render_subs_in_filter(mpctx->osd))
@@ -407,7 +431,9 @@ static struct mp_image *screenshot_get(struct MPContext *mpctx, int mode)
         }
     }
 
-    if (image && (image->fmt.flags & MP_IMGFLAG_HWACCEL)) {
+    if (image && (image->fmt.flags & MP_IMGFLAG_HWACCEL) &&
+        (!hw || mode == MODE_SUBTITLES))
+    {
         struct mp_image *nimage = mp_image_hw_download(image, NULL);
         talloc_free(image);
         image = nimage;
@@ -421,7 +447,7 @@ static struct mp_image *screenshot_get(struct MPContext *mpctx, int mode)
 
 struct mp_image *screenshot_get_rgb(struct MPContext *mpctx, int mode)
 {
-    struct mp_image *mpi = screenshot_get(mpctx, mode);
+    struct mp_image *mpi = screenshot_get(mpctx, mode, false);
     if (!mpi)
         return NULL;
     struct mp_image *res = convert_image(mpi, IMGFMT_BGR0, mpctx->log);
@@ -441,7 +467,7 @@ void screenshot_to_file(struct MPContext *mpctx, const char *filename, int mode,
     int format = image_writer_format_from_ext(ext);
     if (format)
         opts.format = format;
-    struct mp_image *image = screenshot_get(mpctx, mode);
+    struct mp_image *image = screenshot_get(mpctx, mode, async);
     if (!image) {
         screenshot_msg(ctx, MSGL_ERR, "Taking screenshot failed.");
         goto end;
@@ -472,7 +498,7 @@ void screenshot_request(struct MPContext *mpctx, int mode, bool each_frame,
     ctx->mode = mode;
     ctx->osd = osd;
 
-    struct mp_image *image = screenshot_get(mpctx, mode);
+    struct mp_image *image = screenshot_get(mpctx, mode, async);
 
     if (image) {
         struct image_writer_opts *opts = mpctx->opts->screenshot_image_opts;
@@ -495,5 +521,6 @@ void screenshot_flip(struct MPContext *mpctx)
         return;
 
     ctx->each_frame = false;
-    screenshot_request(mpctx, ctx->mode, true, ctx->osd, false);
+    // Always write asynchronously; MAX_QUEUED limits how far this can lag.
+    screenshot_request(mpctx, ctx->mode, true, ctx->osd, true);
 }
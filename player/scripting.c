@@ -142,6 +142,16 @@ int mp_load_script(struct MPContext *mpctx, const char *fname)
 
     MP_VERBOSE(arg, "Loading %s %s...\n", backend->name, fname);
 
+    if (backend->load_shared && mpctx->opts->lua_shared_thread) {
+        mpv_handle *client = arg->client;
+        talloc_free(arg);
+        if (backend->load_shared(mpctx, client, fname) < 0)
+            return -1;
+        wait_loaded(mpctx);
+        MP_VERBOSE(mpctx, "Done loading %s.\n", fname);
+        return 0;
+    }
+
     pthread_t thread;
     if (pthread_create(&thread, NULL, script_thread, arg)) {
         mpv_detach_destroy(arg->client);
@@ -225,24 +235,29 @@ void mp_load_builtin_scripts(struct MPContext *mpctx)
 
 void mp_load_scripts(struct MPContext *mpctx)
 {
+    MP_STATS(mpctx, "start load scripts");
+
     // Load scripts from options
     char **files = mpctx->opts->script_files;
     for (int n = 0; files && files[n]; n++) {
         if (files[n][0])
             mp_load_user_script(mpctx, files[n]);
     }
-    if (!mpctx->opts->auto_load_scripts)
-        return;
 
-    // Load all scripts
-    void *tmp = talloc_new(NULL);
-    char **scriptsdir = mp_find_all_config_files(tmp, mpctx->global, "scripts");
-    for (int i = 0; scriptsdir && scriptsdir[i]; i++) {
-        files = list_script_files(tmp, scriptsdir[i]);
-        for (int n = 0; files && files[n]; n++)
-            mp_load_script(mpctx, files[n]);
+    if (mpctx->opts->auto_load_scripts) {
+        // Load all scripts
+        void *tmp = talloc_new(NULL);
+        char **scriptsdir =
+            mp_find_all_config_files(tmp, mpctx->global, "scripts");
+        for (int i = 0; scriptsdir && scriptsdir[i]; i++) {
+            files = list_script_files(tmp, scriptsdir[i]);
+            for (int n = 0; files && files[n]; n++)
+                mp_load_script(mpctx, files[n]);
+        }
+        talloc_free(tmp);
     }
-    talloc_free(tmp);
+
+    MP_STATS(mpctx, "end load scripts");
 }
 
 #if HAVE_CPLUGINS
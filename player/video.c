@@ -15,7 +15,10 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <inttypes.h>
 #include <math.h>
@@ -31,6 +34,7 @@
 #include "common/common.h"
 #include "common/encode.h"
 #include "options/m_property.h"
+#include "options/path.h"
 #include "osdep/timer.h"
 
 #include "audio/out/ao.h"
@@ -244,6 +248,10 @@ void reset_video_state(struct MPContext *mpctx)
         mp_image_unrefp(&mpctx->next_frames[n]);
     mpctx->num_next_frames = 0;
     mp_image_unrefp(&mpctx->saved_frame);
+    for (int n = 0; n < mpctx->num_backstep_frames; n++)
+        mp_image_unrefp(&mpctx->backstep_frames[n]);
+    mpctx->num_backstep_frames = 0;
+    mpctx->backstep_pos = -1;
 
     mpctx->delay = 0;
     mpctx->time_frame = 0;
@@ -339,6 +347,11 @@ int init_video_decoder(struct MPContext *mpctx, struct track *track)
     if (!video_init_best_codec(d_video))
         goto err_out;
 
+    if (d_video->opts->video_dec_queue > 0 &&
+        !video_init_thread(d_video, d_video->opts->video_dec_queue,
+                           mp_wakeup_core_cb, mpctx))
+        goto err_out;
+
     return 1;
 
 err_out:
@@ -491,6 +504,7 @@ static int decode_image(struct MPContext *mpctx)
         video_set_start(d_video, hrseek ? mpctx->hrseek_pts : MP_NOPTS_VALUE);
 
         video_set_framedrop(d_video, check_framedrop(mpctx, vo_c));
+        video_set_keyframes_only(d_video, mpctx->scrubbing);
 
         video_work(d_video);
         res = video_get_frame(d_video, &vo_c->input_mpi);
@@ -530,6 +544,8 @@ static int video_filter(struct MPContext *mpctx, bool eof)
         // Drain the filter chain.
         if (vf_output_frame(vf, true) > 0)
             return VD_PROGRESS;
+        if (vf_is_busy(vf, true))
+            return VD_WAIT;
 
         // The filter chain is drained; execute the filter format change.
         vf->initialized = 0;
@@ -560,11 +576,15 @@ static int video_filter(struct MPContext *mpctx, bool eof)
 
     // If something was decoded, and the filter chain is ready, filter it.
     if (!need_vf_reconfig && vo_c->input_mpi) {
+        if (vf_is_busy(vf, false))
+            return VD_WAIT;
         vf_filter_frame(vf, vo_c->input_mpi);
         vo_c->input_mpi = NULL;
         return VD_PROGRESS;
     }
 
+    if (eof && vf_is_busy(vf, true))
+        return VD_WAIT;
     return eof ? VD_EOF : VD_PROGRESS;
 }
 
@@ -691,8 +711,10 @@ static void shift_frames(struct MPContext *mpctx)
     if (mpctx->num_next_frames < 1)
         return;
     talloc_free(mpctx->next_frames[0]);
-    for (int n = 0; n < mpctx->num_next_frames - 1; n++)
+    for (int n = 0; n < mpctx->num_next_frames - 1; n++) {
         mpctx->next_frames[n] = mpctx->next_frames[n + 1];
+        mpctx->next_frames_time[n] = mpctx->next_frames_time[n + 1];
+    }
     mpctx->num_next_frames -= 1;
 }
 
@@ -722,6 +744,7 @@ static void add_new_frame(struct MPContext *mpctx, struct mp_image *frame)
 {
     assert(mpctx->num_next_frames < MP_ARRAY_SIZE(mpctx->next_frames));
     assert(frame);
+    mpctx->next_frames_time[mpctx->num_next_frames] = mp_time_us();
     mpctx->next_frames[mpctx->num_next_frames++] = frame;
     if (mpctx->num_next_frames == 1)
         handle_new_frame(mpctx);
@@ -909,15 +932,39 @@ static double calc_best_speed(double vsync, double frame)
     return best_scale;
 }
 
+static int cmp_double(const void *a, const void *b)
+{
+    double da = *(const double *)a, db = *(const double *)b;
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
 static double find_best_speed(struct MPContext *mpctx, double vsync)
 {
+    double durs[MAX_NUM_VO_PTS];
+    int num_durs = 0;
+    for (int n = 0; n < mpctx->num_past_frames && n < MAX_NUM_VO_PTS; n++) {
+        double dur = mpctx->past_frames[n].approx_duration;
+        if (dur > 0)
+            durs[num_durs++] = dur;
+    }
+    if (!num_durs)
+        return 1;
+
+    // Reject outliers (e.g. frames following a timestamp discontinuity, or
+    // single frames with a different rate in VFR content), which would
+    // otherwise pull the average around and make the speed jitter.
+    double sorted[MAX_NUM_VO_PTS];
+    memcpy(sorted, durs, num_durs * sizeof(durs[0]));
+    qsort(sorted, num_durs, sizeof(sorted[0]), cmp_double);
+    double median = sorted[num_durs / 2];
+    double tolerance = MPMAX(median * 0.1, 0.001 * 3 + 0.0001);
+
     double total = 0;
     int num = 0;
-    for (int n = 0; n < mpctx->num_past_frames; n++) {
-        double dur = mpctx->past_frames[n].approx_duration;
-        if (dur <= 0)
+    for (int n = 0; n < num_durs; n++) {
+        if (fabs(durs[n] - median) > tolerance)
             continue;
-        total += calc_best_speed(vsync, dur / mpctx->opts->playback_speed);
+        total += calc_best_speed(vsync, durs[n] / mpctx->opts->playback_speed);
         num++;
     }
     return num > 0 ? total / num : 1;
@@ -1018,6 +1065,9 @@ static void adjust_audio_resample_speed(struct MPContext *mpctx, double vsync)
     }
 }
 
+// Minimum change of the estimated video speed factor before it is applied.
+#define DS_SPEED_HYSTERESIS 0.0001
+
 // Manipulate frame timing for display sync, or do nothing for normal timing.
 static void handle_display_sync_frame(struct MPContext *mpctx,
                                       struct vo_frame *frame)
@@ -1026,7 +1076,8 @@ static void handle_display_sync_frame(struct MPContext *mpctx,
     struct vo *vo = mpctx->video_out;
     int mode = opts->video_sync;
 
-    if (!mpctx->display_sync_active) {
+    bool was_active = mpctx->display_sync_active;
+    if (!was_active) {
         mpctx->display_sync_error = 0.0;
         mpctx->display_sync_drift_dir = 0;
     }
@@ -1053,13 +1104,18 @@ static void handle_display_sync_frame(struct MPContext *mpctx,
     if (adjusted_duration > 0.5)
         return;
 
-    mpctx->speed_factor_v = 1.0;
+    double speed = 1.0;
     if (mode != VS_DISP_VDROP) {
         double best = find_best_speed(mpctx, vsync);
         // If it doesn't work, play at normal speed.
         if (fabs(best - 1.0) <= opts->sync_max_video_change / 100)
-            mpctx->speed_factor_v = best;
+            speed = best;
     }
+    // Don't follow tiny fluctuations of the estimate. Every speed change
+    // reconfigures the audio resampler, and the remaining error is absorbed
+    // by the drift compensation anyway.
+    if (!was_active || fabs(speed - mpctx->speed_factor_v) > DS_SPEED_HYSTERESIS)
+        mpctx->speed_factor_v = speed;
 
     double av_diff = mpctx->last_av_difference;
     if (fabs(av_diff) > 0.5) {
@@ -1226,6 +1282,160 @@ static void calculate_frame_duration(struct MPContext *mpctx)
     MP_STATS(mpctx, "value %f frame-duration-approx", MPMAX(0, approx_duration));
 }
 
+// Remember a frame that is being displayed for step_backstep_cache().
+static void add_backstep_frame(struct MPContext *mpctx, struct mp_image *img)
+{
+    int max = mpctx->opts->backstep_cache_frames;
+    if (max < 1 || img->pts == MP_NOPTS_VALUE)
+        return;
+
+    // Timestamps must be monotonic, or stepping through the cache is useless.
+    int num = mpctx->num_backstep_frames;
+    if (num && mpctx->backstep_frames[num - 1]->pts >= img->pts) {
+        for (int n = 0; n < num; n++)
+            mp_image_unrefp(&mpctx->backstep_frames[n]);
+        mpctx->num_backstep_frames = 0;
+    }
+
+    struct mp_image *ref = mp_image_new_ref(img);
+    if (!ref)
+        return;
+
+    while (mpctx->num_backstep_frames >= max) {
+        talloc_free(mpctx->backstep_frames[0]);
+        MP_TARRAY_REMOVE_AT(mpctx->backstep_frames, mpctx->num_backstep_frames, 0);
+    }
+    MP_TARRAY_APPEND(mpctx, mpctx->backstep_frames, mpctx->num_backstep_frames,
+                     ref);
+    mpctx->backstep_pos = -1;
+}
+
+// Display the previous (dir<0) or next (dir>0) frame from the frames cached by
+// add_backstep_frame(), relative to the currently displayed frame. This is
+// instant, and leaves the decoder and the queued frames alone. Stepping
+// forward to the most recent frame returns to the normal playback state.
+// Returns false if no such frame is cached, or the VO can't take it right
+// now; the caller should fall back to decoding the frame then.
+bool step_backstep_cache(struct MPContext *mpctx, int dir)
+{
+    struct vo_chain *vo_c = mpctx->vo_chain;
+    int num = mpctx->num_backstep_frames;
+    if (!vo_c || vo_c->is_coverart || !num || !mpctx->paused ||
+        mpctx->video_status < STATUS_READY || mpctx->hrseek_active ||
+        mpctx->seek.type)
+        return false;
+
+    int pos = mpctx->backstep_pos >= 0 ? mpctx->backstep_pos : num - 1;
+    pos += dir;
+    if (pos < 0 || pos >= num)
+        return false;
+
+    struct vo *vo = vo_c->vo;
+    if (!vo_is_ready_for_frame(vo, -1))
+        return false;
+
+    struct mp_image *img = mpctx->backstep_frames[pos];
+    struct vo_frame dummy = {
+        .duration = -1,
+        .still = true,
+        .num_frames = 1,
+        .num_vsyncs = 1,
+        .audio_pts = MP_NOPTS_VALUE,
+    };
+    dummy.frames[0] = img;
+    vo_queue_frame(vo, vo_frame_ref(&dummy));
+
+    MP_VERBOSE(mpctx, "Showing cached frame at %f.\n", img->pts);
+
+    mpctx->backstep_pos = pos == num - 1 ? -1 : pos;
+    mpctx->video_pts = img->pts;
+    mpctx->last_vo_pts = img->pts;
+    mpctx->playback_pts = img->pts;
+
+    osd_set_force_video_pts(mpctx->osd, MP_NOPTS_VALUE);
+    update_subtitles(mpctx, img->pts);
+    mpctx->osd_force_update = true;
+    update_osd_msg(mpctx);
+    mp_notify(mpctx, MPV_EVENT_TICK, NULL);
+    mp_wakeup_core(mpctx);
+    return true;
+}
+
+static double pts_or_nan(double pts)
+{
+    return pts == MP_NOPTS_VALUE ? NAN : pts;
+}
+
+// Write the VO's frame timing log (--frame-timing-log) to the given file, one
+// line per frame, for offline analysis with TOOLS/frame-timings.py.
+bool write_frame_timings(struct MPContext *mpctx, const char *filename)
+{
+    struct vo *vo = mpctx->video_out;
+    if (!vo || mpctx->opts->vo->frame_timing_log <= 0) {
+        MP_ERR(mpctx, "No frame timings (enable --frame-timing-log).\n");
+        return false;
+    }
+
+    char *path = mp_get_user_path(NULL, mpctx->global, filename);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        MP_ERR(mpctx, "Could not open '%s' for writing.\n", path);
+        talloc_free(path);
+        return false;
+    }
+
+    struct vo_frame_timing *t = NULL;
+    int num = vo_get_frame_timings(vo, NULL, &t);
+    fprintf(f, "# frame-id video-pts audio-pts decoded queued target "
+               "render-start render-end swap-start swap-end vsync "
+               "dropped delayed\n");
+    for (int n = 0; n < num; n++) {
+        fprintf(f, "%"PRIu64" %f %f %"PRId64" %"PRId64" %"PRId64" %"PRId64
+                " %"PRId64" %"PRId64" %"PRId64" %"PRId64" %d %d\n",
+                t[n].frame_id, pts_or_nan(t[n].video_pts),
+                pts_or_nan(t[n].audio_pts), t[n].decoded, t[n].queued,
+                t[n].target, t[n].render_start, t[n].render_end,
+                t[n].swap_start, t[n].swap_end, t[n].vsync,
+                t[n].dropped, t[n].delayed);
+    }
+    talloc_free(t);
+
+    bool ok = !ferror(f);
+    ok &= fclose(f) == 0;
+    if (ok) {
+        MP_INFO(mpctx, "Wrote %d frame timings to '%s'.\n", num, path);
+    } else {
+        MP_ERR(mpctx, "Error writing '%s'.\n", path);
+    }
+    talloc_free(path);
+    return ok;
+}
+
+// Dump the frame timing log to --frame-timing-dump when the VO dropped or
+// delayed a frame. Dumps are at least one log length apart, so a burst of
+// drops doesn't overwrite the dump with a log that no longer shows its start.
+static void check_frame_timing_dump(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct vo *vo = mpctx->video_out;
+
+    if (!opts->frame_timing_dump || !opts->frame_timing_dump[0] ||
+        opts->vo->frame_timing_log <= 0)
+        return;
+
+    int64_t drops = vo_get_drop_count(vo) + vo_get_delayed_count(vo);
+    bool new_drops = drops > mpctx->timing_dump_drops;
+    mpctx->timing_dump_drops = drops;
+
+    double now = mp_time_sec();
+    if (!new_drops || (mpctx->timing_dump_last &&
+                       now - mpctx->timing_dump_last < opts->vo->frame_timing_log))
+        return;
+
+    mpctx->timing_dump_last = now;
+    write_frame_timings(mpctx, opts->frame_timing_dump);
+}
+
 void write_video(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -1364,6 +1574,9 @@ void write_video(struct MPContext *mpctx)
         .still = mpctx->step_frames > 0,
         .num_frames = MPMIN(mpctx->num_next_frames, req),
         .num_vsyncs = 1,
+        .decoded_time = mpctx->next_frames_time[0],
+        .audio_pts = opts->vo->frame_timing_log > 0 ? playing_audio_pts(mpctx)
+                                                    : MP_NOPTS_VALUE,
     };
     for (int n = 0; n < dummy.num_frames; n++)
         dummy.frames[n] = mpctx->next_frames[n];
@@ -1385,6 +1598,8 @@ void write_video(struct MPContext *mpctx)
     mpctx->last_frame_duration =
         mpctx->next_frames[0]->pkt_duration / mpctx->video_speed;
 
+    add_backstep_frame(mpctx, mpctx->next_frames[0]);
+
     shift_frames(mpctx);
 
     schedule_frame(mpctx, frame);
@@ -1424,6 +1639,8 @@ void write_video(struct MPContext *mpctx)
             mpctx->max_frames--;
     }
 
+    check_frame_timing_dump(mpctx);
+
     mp_wakeup_core(mpctx);
     return;
 
@@ -52,6 +52,7 @@
 #include "osdep/timer.h"
 #include "osdep/threads.h"
 
+#include "common/mem_budget.h"
 #include "common/msg.h"
 #include "common/tags.h"
 #include "options/options.h"
@@ -102,8 +103,17 @@ struct priv {
     int64_t seek_limit;     // keep filling cache if distance is less that seek limit
     bool seekable;          // underlying stream is seekable
 
+    // Share of the global memory budget. want_* are the sizes requested by
+    // the user, cur_size the readahead size actually set.
+    struct mp_mem_client *mem;
+    int64_t want_size, want_back, cur_size;
+
     struct mp_log *log;
 
+    // Number of streams referencing this (the cache stream, and the readers
+    // created with stream_cache_init_reader()). Protected by the mutex.
+    int refs;
+
     // Owned by the main thread
     stream_t *cache;        // wrapper stream, used by demuxer etc.
 
@@ -507,6 +517,46 @@ static bool control_needs_flush(int stream_ctrl)
     return false;
 }
 
+// Return the readahead and backbuffer sizes, reduced proportionally if the
+// global memory budget grants less than the requested sizes.
+static void get_budget_sizes(struct priv *s, int64_t *size, int64_t *back)
+{
+    int64_t wanted = s->want_size + s->want_back;
+    int64_t limit = mp_mem_client_get_limit(s->mem, wanted);
+    *size = s->want_size;
+    *back = s->want_back;
+    if (limit < wanted) {
+        *size = s->want_size * limit / wanted;
+        *back = limit - *size;
+    }
+}
+
+static int resize_cache_budget(struct priv *s)
+{
+    int64_t size, back;
+    get_budget_sizes(s, &size, &back);
+    int64_t old_back = s->back_size;
+    s->back_size = back;
+    int r = resize_cache(s, size);
+    if (r == STREAM_OK) {
+        s->cur_size = size;
+    } else {
+        s->back_size = old_back;
+    }
+    return r;
+}
+
+// Runs in the cache thread. Resize the cache if the memory budget changed
+// significantly (reallocating copies the cache contents).
+static void update_budget(struct priv *s)
+{
+    int64_t size, back;
+    get_budget_sizes(s, &size, &back);
+    int64_t cur = s->cur_size + s->back_size;
+    if (llabs(size + back - cur) > cur / 8)
+        resize_cache_budget(s);
+}
+
 // Runs in the cache thread
 static void cache_execute_control(struct priv *s)
 {
@@ -515,7 +565,9 @@ static void cache_execute_control(struct priv *s)
 
     switch (s->control) {
     case STREAM_CTRL_SET_CACHE_SIZE:
-        s->control_res = resize_cache(s, *(int64_t *)s->control_arg);
+        s->want_size = *(int64_t *)s->control_arg;
+        mp_mem_client_set_wanted(s->mem, s->want_size + s->want_back);
+        s->control_res = resize_cache_budget(s);
         break;
     default:
         s->control_res = stream_control(s->stream, s->control, s->control_arg);
@@ -549,6 +601,7 @@ static void *cache_thread(void *arg)
     while (s->control != CACHE_CTRL_QUIT) {
         if (mp_time_sec() - last > CACHE_UPDATE_CONTROLS_TIME) {
             update_cached_controls(s);
+            update_budget(s);
             last = mp_time_sec();
         }
         if (s->control > 0) {
@@ -702,6 +755,21 @@ done:
     return r;
 }
 
+// Drop a reference; free the cache if it was the last one.
+static void cache_unref(struct priv *s)
+{
+    pthread_mutex_lock(&s->mutex);
+    bool last = --s->refs == 0;
+    pthread_mutex_unlock(&s->mutex);
+    if (!last)
+        return;
+    pthread_mutex_destroy(&s->mutex);
+    pthread_cond_destroy(&s->wakeup);
+    mp_mem_client_free(s->mem);
+    free(s->buffer);
+    talloc_free(s);
+}
+
 static void cache_uninit(stream_t *cache)
 {
     struct priv *s = cache->priv;
@@ -713,10 +781,104 @@ static void cache_uninit(stream_t *cache)
         pthread_mutex_unlock(&s->mutex);
         pthread_join(s->cache_thread, NULL);
     }
-    pthread_mutex_destroy(&s->mutex);
-    pthread_cond_destroy(&s->wakeup);
-    free(s->buffer);
-    talloc_free(s);
+    // Readers may still use the buffer contents, but nothing else.
+    pthread_mutex_lock(&s->mutex);
+    s->cache = NULL;
+    s->stream = NULL;
+    s->log = mp_null_log;
+    pthread_mutex_unlock(&s->mutex);
+    cache_unref(s);
+}
+
+// A reader with its own read position, which shares the buffer of a cache.
+struct reader_priv {
+    struct priv *s;
+    stream_t *fallback;     // opened on demand for data not in the buffer
+    int64_t hits, misses;   // bytes read from the buffer/fallback stream
+};
+
+static int reader_fill_buffer(stream_t *reader, char *buffer, int max_len)
+{
+    struct reader_priv *p = reader->priv;
+    struct priv *s = p->s;
+
+    pthread_mutex_lock(&s->mutex);
+    int len = read_buffer(s, buffer, max_len, reader->pos);
+    pthread_mutex_unlock(&s->mutex);
+    if (len > 0) {
+        p->hits += len;
+        return len;
+    }
+
+    if (!p->fallback) {
+        MP_VERBOSE(reader, "Opening separate stream for uncached data.\n");
+        p->fallback = stream_create(reader->url, STREAM_READ, reader->cancel,
+                                    reader->global);
+        if (!p->fallback)
+            return -1;
+    }
+    if (stream_tell(p->fallback) != reader->pos &&
+        !stream_seek(p->fallback, reader->pos))
+        return -1;
+    len = stream_read_partial(p->fallback, buffer, max_len);
+    p->misses += MPMAX(len, 0);
+    return len;
+}
+
+static int reader_seek(stream_t *reader, int64_t pos)
+{
+    return 1;
+}
+
+static int reader_control(stream_t *reader, int cmd, void *arg)
+{
+    struct reader_priv *p = reader->priv;
+    int r = STREAM_UNSUPPORTED;
+    if (cmd == STREAM_CTRL_GET_SIZE) {
+        pthread_mutex_lock(&p->s->mutex);
+        if (p->s->stream_size >= 0) {
+            *(int64_t *)arg = p->s->stream_size;
+            r = STREAM_OK;
+        }
+        pthread_mutex_unlock(&p->s->mutex);
+    }
+    return r;
+}
+
+static void reader_close(stream_t *reader)
+{
+    struct reader_priv *p = reader->priv;
+    MP_VERBOSE(reader, "%"PRId64" bytes read from shared cache, %"PRId64
+               " bytes from separate stream.\n", p->hits, p->misses);
+    free_stream(p->fallback);
+    cache_unref(p->s);
+}
+
+// Make reader a stream with an independent read position, which reads data
+// from the buffer of the given cache stream if possible, so that several
+// demuxers opening the same source don't read the same bytes twice. The cache
+// is driven by the reads of its primary user only; data that isn't in its
+// buffer is read from a separately opened stream.
+// Return 1 on success, or -1 if cache is not a stream cache.
+int stream_cache_init_reader(stream_t *reader, stream_t *cache)
+{
+    if (cache->close != cache_uninit)
+        return -1;
+    struct priv *s = cache->priv;
+
+    pthread_mutex_lock(&s->mutex);
+    s->refs++;
+    pthread_mutex_unlock(&s->mutex);
+
+    struct reader_priv *p = talloc_zero(reader, struct reader_priv);
+    p->s = s;
+    reader->priv = p;
+    reader->seekable = s->seekable;
+    reader->fill_buffer = reader_fill_buffer;
+    reader->seek = reader_seek;
+    reader->control = reader_control;
+    reader->close = reader_close;
+    return 1;
 }
 
 // return 1 on success, 0 if the cache is disabled/not needed, and -1 on error
@@ -729,6 +891,7 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
 
     struct priv *s = talloc_zero(NULL, struct priv);
     s->log = cache->log;
+    s->refs = 1;
     s->eof_pos = -1;
     s->enable_readahead = true;
 
@@ -737,12 +900,16 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
     s->speed_start = mp_time_us();
 
     s->seek_limit = opts->seek_min * 1024ULL;
-    s->back_size = opts->back_buffer * 1024ULL;
+    s->want_size = opts->size * 1024ULL;
+    s->want_back = opts->back_buffer * 1024ULL;
+    s->mem = mp_mem_client_new(cache->global, MP_MEM_PRIO_LOW,
+                               s->want_size + s->want_back);
 
     s->stream_size = stream_get_size(stream);
 
-    if (resize_cache(s, opts->size * 1024ULL) != STREAM_OK) {
+    if (resize_cache_budget(s) != STREAM_OK) {
         MP_ERR(s, "Failed to allocate cache buffer.\n");
+        mp_mem_client_free(s->mem);
         talloc_free(s);
         return -1;
     }
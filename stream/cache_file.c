@@ -17,6 +17,14 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+
+#if HAVE_POSIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "osdep/io.h"
 
@@ -33,6 +41,11 @@
 struct priv {
     struct stream *original;
     FILE *cache_file;
+    // If non-NULL, the cache file mapped for max_size bytes. Then reads are
+    // done from the mapping, and writes with pwrite() (which reports ENOSPC
+    // as error, instead of raising SIGBUS on a write to the mapping).
+    uint8_t *map;
+    int64_t map_file_size;  // size of the cache file if map is set
     uint8_t *block_bits;    // 1 bit for each BLOCK_SIZE, whether block was read
     int64_t size;           // currently known size
     int64_t max_size;       // max. size for block_bits and cache_file
@@ -55,6 +68,41 @@ static void set_bit(struct priv *p, int64_t pos, bool bit)
     p->block_bits[block / 8] = (p->block_bits[block / 8] & ~m) | (bit ? m : 0);
 }
 
+static bool write_block(struct priv *p, int64_t pos, char *data, int len)
+{
+#if HAVE_POSIX
+    if (p->map) {
+        int fd = fileno(p->cache_file);
+        while (len > 0) {
+            ssize_t r = pwrite(fd, data, len, pos);
+            if (r <= 0)
+                return false;
+            data += r;
+            pos += r;
+            len -= r;
+        }
+        p->map_file_size = MPMAX(p->map_file_size, pos);
+        return true;
+    }
+#endif
+    if (fseeko(p->cache_file, pos, SEEK_SET))
+        return false;
+    return fwrite(data, len, 1, p->cache_file) == 1;
+}
+
+static int read_data(struct priv *p, int64_t pos, char *buffer, int len)
+{
+    if (p->map) {
+        // (Like fread(), don't read past the end of the file.)
+        len = MPMIN(len, MPMAX(p->map_file_size - pos, 0));
+        memcpy(buffer, p->map + pos, len);
+        return len;
+    }
+    if (fseeko(p->cache_file, pos, SEEK_SET))
+        return -1;
+    return fread(buffer, 1, len, p->cache_file);
+}
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
@@ -85,20 +133,18 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
                 return -1;
             }
         }
-        if (fseeko(p->cache_file, aligned, SEEK_SET))
-            return -1;
-        if (fwrite(tmp, r, 1, p->cache_file) != 1)
+        if (r <= 0 || !write_block(p, aligned, tmp, r))
             return -1;
         set_bit(p, aligned, 1);
     }
-    if (fseeko(p->cache_file, s->pos, SEEK_SET))
-        return -1;
     // align/limit to blocks
     max_len = MPMIN(max_len, BLOCK_SIZE - (s->pos % BLOCK_SIZE));
     // Limit to max. known file size
     if (p->size >= 0)
         max_len = MPMIN(max_len, p->size - s->pos);
-    return fread(buffer, 1, max_len, p->cache_file);
+    if (max_len <= 0)
+        return 0;
+    return read_data(p, s->pos, buffer, max_len);
 }
 
 static int seek(stream_t *s, int64_t newpos)
@@ -115,6 +161,10 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+#if HAVE_POSIX
+    if (p->map)
+        munmap(p->map, p->max_size);
+#endif
     if (p->cache_file)
         fclose(p->cache_file);
     talloc_free(p);
@@ -149,6 +199,20 @@ int stream_file_cache_init(stream_t *cache, stream_t *stream,
     // file_max can be INT_MAX, so this is at most about 256MB
     p->block_bits = talloc_zero_size(p, (p->max_size / BLOCK_SIZE + 1) / 8 + 1);
 
+#if HAVE_POSIX
+    // Mapping beyond the end of the file is allowed; only blocks that were
+    // written (and thus are within the file) are ever accessed.
+    if ((uint64_t)p->max_size <= SIZE_MAX) {
+        void *map = mmap(NULL, p->max_size, PROT_READ, MAP_SHARED,
+                         fileno(file), 0);
+        if (map != MAP_FAILED) {
+            p->map = map;
+        } else {
+            MP_VERBOSE(cache, "can't map cache file, using normal I/O\n");
+        }
+    }
+#endif
+
     cache->seek = seek;
     cache->fill_buffer = fill_buffer;
     cache->control = control;
@@ -0,0 +1,117 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "osdep/io.h"
+#include "disc_cache.h"
+
+// Maximum number of discs remembered.
+#define MAX_DISC_CACHE 16
+
+struct disc_entry {
+    char *key;
+    struct disc_nav *nav;
+};
+
+// Parsing the title list of a disc requires reading many small files (IFO,
+// MPLS, CLPI), which is slow on optical drives and network storage. Keep the
+// result for the rest of the session, so that reopening the disc (e.g. for
+// the next playlist entry or another title) doesn't parse it again.
+static pthread_mutex_t disc_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct disc_entry *disc_cache;
+static int num_disc_cache;
+
+char *disc_cache_key(void *ta_parent, const char *path, const char *label)
+{
+    struct stat st;
+    if (!path || stat(path, &st) != 0)
+        return NULL;
+    return talloc_asprintf(ta_parent, "%s|%"PRId64"|%"PRId64"|%s", path,
+                           (int64_t)st.st_size, (int64_t)st.st_mtime,
+                           label ? label : "");
+}
+
+struct disc_nav *disc_nav_new(void *ta_parent, int num_titles)
+{
+    struct disc_nav *nav = talloc_zero(ta_parent, struct disc_nav);
+    nav->num_titles = MPMAX(num_titles, 0);
+    nav->titles = talloc_zero_array(nav, struct disc_title, nav->num_titles);
+    for (int n = 0; n < nav->num_titles; n++)
+        nav->titles[n].playlist = -1;
+    return nav;
+}
+
+static struct disc_nav *copy_nav(void *ta_parent, struct disc_nav *src)
+{
+    struct disc_nav *nav = disc_nav_new(ta_parent, src->num_titles);
+    for (int n = 0; n < nav->num_titles; n++) {
+        struct disc_title *t = &nav->titles[n];
+        *t = src->titles[n];
+        t->chapters = talloc_memdup(nav, t->chapters,
+                                    t->num_chapters * sizeof(t->chapters[0]));
+    }
+    return nav;
+}
+
+struct disc_nav *disc_cache_get(void *ta_parent, const char *key)
+{
+    struct disc_nav *res = NULL;
+    if (!key)
+        return NULL;
+    pthread_mutex_lock(&disc_cache_lock);
+    for (int n = 0; n < num_disc_cache; n++) {
+        if (strcmp(disc_cache[n].key, key) == 0) {
+            res = copy_nav(ta_parent, disc_cache[n].nav);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&disc_cache_lock);
+    return res;
+}
+
+void disc_cache_put(const char *key, struct disc_nav *nav)
+{
+    if (!key || !nav)
+        return;
+    pthread_mutex_lock(&disc_cache_lock);
+    for (int n = 0; n < num_disc_cache; n++) {
+        if (strcmp(disc_cache[n].key, key) == 0) {
+            talloc_free(disc_cache[n].key);
+            talloc_free(disc_cache[n].nav);
+            MP_TARRAY_REMOVE_AT(disc_cache, num_disc_cache, n);
+            break;
+        }
+    }
+    if (num_disc_cache >= MAX_DISC_CACHE) {
+        talloc_free(disc_cache[0].key);
+        talloc_free(disc_cache[0].nav);
+        MP_TARRAY_REMOVE_AT(disc_cache, num_disc_cache, 0);
+    }
+    struct disc_entry e = {
+        .key = talloc_strdup(NULL, key),
+        .nav = copy_nav(NULL, nav),
+    };
+    MP_TARRAY_APPEND(NULL, disc_cache, num_disc_cache, e);
+    pthread_mutex_unlock(&disc_cache_lock);
+}
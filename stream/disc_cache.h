@@ -0,0 +1,34 @@
+#ifndef MP_DISC_CACHE_H
+#define MP_DISC_CACHE_H
+
+#include <stdbool.h>
+
+// Navigation info of a disc title. For DVDs, entries are filled lazily, and
+// valid is false until the title was described.
+struct disc_title {
+    bool valid;
+    int playlist;       // Blu-ray playlist number (.mpls), -1 if unused
+    double duration;    // in seconds
+    int num_chapters;
+    double *chapters;   // start time of each chapter in seconds
+};
+
+struct disc_nav {
+    int num_titles;
+    struct disc_title *titles;
+};
+
+// Return a string identifying the disc at path (a device, image file or
+// directory), or NULL if it can't be identified. label should be something
+// cheap to read that changes with the disc, such as the volume name.
+char *disc_cache_key(void *ta_parent, const char *path, const char *label);
+
+// Return a copy of the cached navigation info, or NULL if there is none.
+struct disc_nav *disc_cache_get(void *ta_parent, const char *key);
+
+// Store a copy of nav, replacing any previous entry with the same key.
+void disc_cache_put(const char *key, struct disc_nav *nav);
+
+struct disc_nav *disc_nav_new(void *ta_parent, int num_titles);
+
+#endif
@@ -40,6 +40,8 @@
 #include "dvbin.h"
 #include "dvb_tune.h"
 #include "common/msg.h"
+#include "osdep/timer.h"
+#include "stream.h"
 
 /* Keep in sync with enum fe_delivery_system. */
 static const char *dvb_delsys_str[] = {
@@ -197,6 +199,7 @@ int dvb_open_devices(dvb_priv_t *priv, unsigned int n, unsigned int demux_cnt)
         } else {
             MP_VERBOSE(priv, "OPEN(%d), file %s: FD=%d, CNT=%d\n", i, demux_dev,
                        state->demux_fds[i], state->demux_fds_cnt);
+            state->demux_pids[i] = -1;
             state->demux_fds_cnt++;
         }
     }
@@ -235,8 +238,10 @@ int dvb_fix_demuxes(dvb_priv_t *priv, unsigned int cnt)
             if (state->demux_fds[i] < 0) {
                 MP_ERR(priv, "ERROR OPENING DEMUX 0: %d\n", errno);
                 return 0;
-            } else
+            } else {
+                state->demux_pids[i] = -1;
                 state->demux_fds_cnt++;
+            }
         }
     }
 
@@ -291,7 +296,7 @@ int dvb_get_pmt_pid(dvb_priv_t *priv, int devno, int service_id)
     fparams.flags = DMX_IMMEDIATE_START | DMX_CHECK_CRC;
 
     int pat_fd;
-    if ((pat_fd = open(demux_dev, O_RDWR)) < 0) {
+    if ((pat_fd = open(demux_dev, O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0) {
         MP_ERR(priv, "Opening PAT DEMUX failed, error: %d", errno);
         return -1;
     }
@@ -309,8 +314,20 @@ int dvb_get_pmt_pid(dvb_priv_t *priv, int devno, int service_id)
 
     int pmt_pid = -1;
 
+    // The PAT is repeated at least every 100ms; give up after a few seconds
+    // instead of blocking forever on a dead multiplex.
+    int64_t deadline = mp_time_us() + 5 * 1000000;
     bool pat_read = false;
     while (!pat_read) {
+        struct pollfd pfd = { .fd = pat_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 100) <= 0) {
+            if (mp_cancel_test(priv->cancel) || mp_time_us() > deadline) {
+                MP_ERR(priv, "PAT: timeout reading sections\n");
+                close(pat_fd);
+                return -1;
+            }
+            continue;
+        }
         if (((bytes_read =
                   read(pat_fd, bufptr,
                        sizeof(buft))) < 0) && errno == EOVERFLOW)
@@ -363,33 +380,35 @@ static void print_status(dvb_priv_t *priv, fe_status_t festatus)
     MP_VERBOSE(priv, "\n");
 }
 
+// Wait until the frontend reports a lock, it gives up, tmout seconds pass, or
+// the stream is cancelled. Returns as soon as the lock is reported (frontend
+// events wake up the poll() call).
 static int check_status(dvb_priv_t *priv, int fd_frontend, int tmout)
 {
     int32_t strength;
-    fe_status_t festatus;
+    fe_status_t festatus = 0, last_status = 0;
     struct pollfd pfd[1];
-    int ok = 0, locks = 0;
-    time_t tm1, tm2;
 
     pfd[0].fd = fd_frontend;
     pfd[0].events = POLLPRI;
 
     MP_VERBOSE(priv, "Getting frontend status\n");
-    tm1 = tm2 = time((time_t *) NULL);
-    while (!ok) {
+    int64_t deadline = mp_time_us() + tmout * (int64_t)1000000;
+    while (1) {
+        // Poll in short intervals to react to cancellation. Some drivers
+        // don't send events, so read the status after each interval anyway.
+        poll(pfd, 1, 100);
         festatus = 0;
-        if (poll(pfd, 1, tmout * 1000) > 0) {
-            if (pfd[0].revents & POLLPRI) {
-                if (ioctl(fd_frontend, FE_READ_STATUS, &festatus) >= 0) {
-                    if (festatus & FE_HAS_LOCK)
-                        locks++;
-                }
-            }
+        if (ioctl(fd_frontend, FE_READ_STATUS, &festatus) >= 0 &&
+            festatus != last_status)
+        {
+            print_status(priv, festatus);
+            last_status = festatus;
         }
-        usleep(10000);
-        tm2 = time((time_t *) NULL);
-        if ((festatus & FE_TIMEDOUT) || (locks >= 2) || (tm2 - tm1 >= tmout))
-            ok = 1;
+        if (festatus & (FE_HAS_LOCK | FE_TIMEDOUT))
+            break;
+        if (mp_time_us() >= deadline || mp_cancel_test(priv->cancel))
+            break;
     }
 
     if (festatus & FE_HAS_LOCK) {
@@ -408,8 +427,6 @@ static int check_status(dvb_priv_t *priv, int fd_frontend, int tmout)
         strength = 0;
         if (ioctl(fd_frontend, FE_READ_UNCORRECTED_BLOCKS, &strength) >= 0)
             MP_VERBOSE(priv, "UNC: %d\n", strength);
-
-        print_status(priv, festatus);
     } else {
         MP_ERR(priv, "Not able to lock to the signal on the given frequency, "
                "timeout: %d\n", tmout);
@@ -102,6 +102,7 @@ typedef struct {
     int fe_fd;
     int dvr_fd;
     int demux_fd[3], demux_fds[DMX_FILTER_SIZE], demux_fds_cnt;
+    int demux_pids[DMX_FILTER_SIZE]; // PID filtered by demux_fds[n], or -1
 
     int is_on;
     int retry;
@@ -113,6 +114,7 @@ typedef struct {
 
 typedef struct {
     struct mp_log *log;
+    struct mp_cancel *cancel;
 
     dvb_state_t *state;
 
@@ -286,6 +286,8 @@ struct stream *stream_create(const char *url, int flags,
     struct stream *s = NULL;
     assert(url);
 
+    mp_msg(log, MSGL_STATS, "start stream open");
+
     if (strlen(url) > INT_MAX / 8)
         goto done;
 
@@ -322,6 +324,7 @@ struct stream *stream_create(const char *url, int flags,
     }
 
 done:
+    mp_msg(log, MSGL_STATS, "end stream open");
     talloc_free(log);
     return s;
 }
@@ -719,6 +722,26 @@ static int stream_enable_cache(stream_t **stream, struct mp_cache_opts *opts)
     return res;
 }
 
+// Create a stream reading the same data as the cached stream cache, but with
+// its own read position, sharing the cache's buffer. Returns NULL if cache
+// is not a cached stream.
+struct stream *stream_create_cache_reader(struct stream *cache,
+                                          struct mp_cancel *c,
+                                          struct mpv_global *global)
+{
+    if (!cache->caching)
+        return NULL;
+    stream_t *reader = open_cache(cache, "cache-reader");
+    reader->underlying = NULL; // owned by the primary user
+    reader->cancel = c;
+    reader->global = global;
+    if (stream_cache_init_reader(reader, cache) < 1) {
+        free_stream(reader);
+        return NULL;
+    }
+    return reader;
+}
+
 // Do some crazy stuff to call stream_enable_cache() with the global options.
 int stream_enable_cache_defaults(stream_t **stream)
 {
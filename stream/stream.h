@@ -201,12 +201,16 @@ int stream_fill_buffer(stream_t *s);
 struct mp_cache_opts;
 bool stream_wants_cache(stream_t *stream, struct mp_cache_opts *opts);
 int stream_enable_cache_defaults(stream_t **stream);
+struct stream *stream_create_cache_reader(struct stream *cache,
+                                          struct mp_cancel *c,
+                                          struct mpv_global *global);
 
 // Internal
 int stream_cache_init(stream_t *cache, stream_t *stream,
                       struct mp_cache_opts *opts);
 int stream_file_cache_init(stream_t *cache, stream_t *stream,
                            struct mp_cache_opts *opts);
+int stream_cache_init_reader(stream_t *reader, stream_t *cache);
 
 int stream_write_buffer(stream_t *s, unsigned char *buf, int len);
 
@@ -266,6 +270,7 @@ int mp_cancel_get_fd(struct mp_cancel *c);
 // stream_file.c
 char *mp_file_url_to_filename(void *talloc_ctx, bstr url);
 char *mp_file_get_path(void *talloc_ctx, bstr url);
+bool mp_path_is_network(const char *path);
 
 // stream_lavf.c
 struct AVDictionary;
@@ -29,6 +29,8 @@
 #include <string.h>
 #include <strings.h>
 #include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <libbluray/bluray.h>
 #include <libbluray/meta_data.h>
@@ -44,6 +46,8 @@
 #include "options/m_config.h"
 #include "options/path.h"
 #include "stream.h"
+#include "disc_cache.h"
+#include "osdep/io.h"
 #include "osdep/timer.h"
 #include "sub/osd.h"
 #include "sub/img_convert.h"
@@ -72,9 +76,18 @@
 #define AACS_ERROR_MMC_FAILURE    -7 /* MMC failed */
 #define AACS_ERROR_NO_DK          -8 /* no matching device key */
 
+struct playlist_info {
+    int playlist, angle;
+    BLURAY_TITLE_INFO *info;
+};
+
 struct bluray_priv_s {
     BLURAY *bd;
-    BLURAY_TITLE_INFO *title_info;
+    BLURAY_TITLE_INFO *title_info; // points into playlist_infos
+    // Parsed playlists, so that switching back and forth between titles or
+    // angles doesn't parse the MPLS/CLPI files again.
+    struct playlist_info *playlist_infos;
+    int num_playlist_infos;
     int num_titles;
     int current_angle;
     int current_title;
@@ -89,11 +102,29 @@ struct bluray_priv_s {
 
 static void destruct(struct bluray_priv_s *priv)
 {
-    if (priv->title_info)
-        bd_free_title_info(priv->title_info);
+    for (int n = 0; n < priv->num_playlist_infos; n++)
+        bd_free_title_info(priv->playlist_infos[n].info);
+    priv->num_playlist_infos = 0;
+    priv->title_info = NULL;
     bd_close(priv->bd);
 }
 
+static BLURAY_TITLE_INFO *get_playlist_info(struct bluray_priv_s *priv,
+                                            int playlist, int angle)
+{
+    for (int n = 0; n < priv->num_playlist_infos; n++) {
+        struct playlist_info *e = &priv->playlist_infos[n];
+        if (e->playlist == playlist && e->angle == angle)
+            return e->info;
+    }
+    BLURAY_TITLE_INFO *info = bd_get_playlist_info(priv->bd, playlist, angle);
+    if (info) {
+        struct playlist_info e = {playlist, angle, info};
+        MP_TARRAY_APPEND(priv, priv->playlist_infos, priv->num_playlist_infos, e);
+    }
+    return info;
+}
+
 inline static int play_playlist(struct bluray_priv_s *priv, int playlist)
 {
     return bd_select_playlist(priv->bd, playlist);
@@ -125,27 +156,21 @@ static void handle_event(stream_t *s, const BD_EVENT *ev)
     case BD_EVENT_PLAYLIST:
         b->current_playlist = ev->param;
         b->current_title = bd_get_current_title(b->bd);
-        if (b->title_info)
-            bd_free_title_info(b->title_info);
-        b->title_info = bd_get_playlist_info(b->bd, b->current_playlist,
-                                             b->current_angle);
+        b->title_info = get_playlist_info(b, b->current_playlist,
+                                          b->current_angle);
         break;
     case BD_EVENT_TITLE:
         if (ev->param == BLURAY_TITLE_FIRST_PLAY) {
             b->current_title = bd_get_current_title(b->bd);
         } else
             b->current_title = ev->param;
-        if (b->title_info) {
-            bd_free_title_info(b->title_info);
-            b->title_info = NULL;
-        }
+        b->title_info = NULL;
         break;
     case BD_EVENT_ANGLE:
         b->current_angle = ev->param;
         if (b->title_info) {
-            bd_free_title_info(b->title_info);
-            b->title_info = bd_get_playlist_info(b->bd, b->current_playlist,
-                                                 b->current_angle);
+            b->title_info = get_playlist_info(b, b->current_playlist,
+                                              b->current_angle);
         }
         break;
     case BD_EVENT_POPUP:
@@ -414,27 +439,48 @@ static int bluray_stream_open_internal(stream_t *s)
             return STREAM_UNSUPPORTED;
         }
 
+        const struct meta_dl *meta = bd_get_meta(bd);
+        char *key = disc_cache_key(b, device, meta ? meta->di_name : NULL);
+        struct disc_nav *nav = disc_cache_get(b, key);
+        if (nav && nav->num_titles != b->num_titles)
+            nav = NULL;
+        if (nav) {
+            MP_VERBOSE(s, "Using cached title list.\n");
+        } else {
+            /* parse titles information */
+            nav = disc_nav_new(b, b->num_titles);
+            for (int i = 0; i < b->num_titles; i++) {
+                BLURAY_TITLE_INFO *ti = bd_get_title_info(bd, i, 0);
+                if (!ti)
+                    continue;
+                nav->titles[i] = (struct disc_title){
+                    .valid = true,
+                    .playlist = ti->playlist,
+                    .duration = BD_TIME_TO_MP(ti->duration),
+                };
+                bd_free_title_info(ti);
+            }
+            disc_cache_put(key, nav);
+        }
+
         MP_VERBOSE(s, "List of available titles:\n");
 
-        /* parse titles information */
-        uint64_t max_duration = 0;
-        for (int i = 0; i < b->num_titles; i++) {
-            BLURAY_TITLE_INFO *ti = bd_get_title_info(bd, i, 0);
-            if (!ti)
+        double max_duration = 0;
+        for (int i = 0; i < nav->num_titles; i++) {
+            struct disc_title *t = &nav->titles[i];
+            if (!t->valid)
                 continue;
 
-            char *time = mp_format_time(ti->duration / 90000, false);
+            char *time = mp_format_time(t->duration, false);
             MP_VERBOSE(s, "idx: %3d duration: %s (playlist: %05d.mpls)\n",
-                       i, time, ti->playlist);
+                       i, time, t->playlist);
             talloc_free(time);
 
             /* try to guess which title may contain the main movie */
-            if (ti->duration > max_duration) {
-                max_duration = ti->duration;
+            if (t->duration > max_duration) {
+                max_duration = t->duration;
                 title_guess = i;
             }
-
-            bd_free_title_info(ti);
         }
     }
 
@@ -454,6 +500,13 @@ static int bluray_stream_open_internal(stream_t *s)
     s->priv        = b;
     s->demuxer     = "+disc";
 
+    // Let the stream cache read ahead if the disc is on a network share or
+    // an optical drive, which can't sustain high bitrates with blocking reads.
+    struct stat st;
+    if (mp_path_is_network(device) ||
+        (stat(device, &st) == 0 && !S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)))
+        s->streaming = true;
+
     MP_VERBOSE(s, "Blu-ray successfully opened.\n");
 
     return STREAM_OK;
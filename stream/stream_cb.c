@@ -1,13 +1,16 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <assert.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "osdep/io.h"
+#include "osdep/timer.h"
 
 #include "common/common.h"
 #include "common/msg.h"
@@ -18,8 +21,23 @@
 #include "player/client.h"
 #include "libmpv/stream_cb.h"
 
+// How often a pending async read checks for cancellation (in seconds).
+#define CANCEL_POLL_INTERVAL 0.05
+
+struct mpv_stream_cb_read_request {
+    struct priv *p;
+};
+
 struct priv {
     mpv_stream_cb_info info;
+
+    // For read_async_fn. There is at most 1 pending read.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct mpv_stream_cb_read_request req;
+    // --- protected by lock
+    bool pending;
+    int64_t result;
 };
 
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
@@ -28,6 +46,51 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
     return (int)p->info.read_fn(p->info.cookie, buffer, (size_t)max_len);
 }
 
+static int fill_buffer_async(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+
+    pthread_mutex_lock(&p->lock);
+    assert(!p->pending);
+    p->pending = true;
+    p->result = -1;
+    pthread_mutex_unlock(&p->lock);
+
+    // (Might call mpv_stream_cb_read_done() before returning.)
+    p->info.read_async_fn(p->info.cookie, &p->req, buffer, (uint64_t)max_len);
+
+    pthread_mutex_lock(&p->lock);
+    bool cancelled = false;
+    while (p->pending) {
+        if (!cancelled && mp_cancel_test(s->cancel)) {
+            cancelled = true;
+            if (p->info.cancel_fn) {
+                pthread_mutex_unlock(&p->lock);
+                p->info.cancel_fn(p->info.cookie, &p->req);
+                pthread_mutex_lock(&p->lock);
+                continue;
+            }
+        }
+        struct timespec ts = mp_rel_time_to_timespec(CANCEL_POLL_INTERVAL);
+        pthread_cond_timedwait(&p->wakeup, &p->lock, &ts);
+    }
+    int64_t r = p->result;
+    pthread_mutex_unlock(&p->lock);
+
+    return r < 0 ? -1 : (int)MPMIN(r, max_len);
+}
+
+void mpv_stream_cb_read_done(mpv_stream_cb_read_request *req, int64_t result)
+{
+    struct priv *p = req->p;
+    pthread_mutex_lock(&p->lock);
+    assert(p->pending);
+    p->result = result;
+    p->pending = false;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
@@ -56,11 +119,13 @@ static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
     p->info.close_fn(p->info.cookie);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
 }
 
 static int open_cb(stream_t *stream)
 {
-    struct priv *p = talloc_ptrtype(stream, p);
+    struct priv *p = talloc_zero(stream, struct priv);
     stream->priv = p;
 
     bstr bproto = mp_split_proto(bstr0(stream->url), NULL);
@@ -81,19 +146,22 @@ static int open_cb(stream_t *stream)
         return STREAM_ERROR;
     }
 
-    if (!info.read_fn || !info.close_fn) {
+    if (!(info.read_fn || info.read_async_fn) || !info.close_fn) {
         MP_FATAL(stream, "required read_fn or close_fn callbacks not set.\n");
         return STREAM_ERROR;
     }
 
     p->info = info;
+    p->req.p = p;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
 
     if (p->info.seek_fn && p->info.seek_fn(p->info.cookie, 0) >= 0) {
         stream->seek = seek;
         stream->seekable = true;
     }
     stream->fast_skip = true;
-    stream->fill_buffer = fill_buffer;
+    stream->fill_buffer = info.read_async_fn ? fill_buffer_async : fill_buffer;
     stream->control = control;
     stream->read_chunk = 64 * 1024;
     stream->close = s_close;
@@ -36,6 +36,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include "mpv_talloc.h"
 
@@ -45,6 +46,7 @@
 #include "options/options.h"
 
 #include "common/msg.h"
+#include "osdep/threads.h"
 
 #include "config.h"
 #if !HAVE_GPL
@@ -58,8 +60,28 @@ typedef struct cdda_params {
     int start_sector;
     int end_sector;
 
+    // Background reader, if readahead is enabled. The ring contains the
+    // sectors starting at p->sector. Everything below is protected by lock,
+    // except cdp, which is only accessed by the reader thread.
+    pthread_t reader;
+    bool reader_running;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    char *ring;
+    int ring_size;          // in sectors
+    int ring_start;         // index of the first buffered sector
+    int ring_count;         // number of buffered sectors
+    int read_sector;        // next sector the reader reads
+    bool read_eof;
+    bool seek_pending;
+    bool terminate;
+    int cur_speed;
+
     // options
     int speed;
+    int quiet_speed;
+    int readahead;
+    int retries;
     int paranoia_mode;
     int sector_size;
     int search_overlap;
@@ -75,6 +97,9 @@ typedef struct cdda_params {
 const struct m_sub_options stream_cdda_conf = {
     .opts = (const m_option_t[]) {
         OPT_INTRANGE("speed", speed, 0, 1, 100),
+        OPT_INTRANGE("quiet-speed", quiet_speed, 0, 1, 100),
+        OPT_INTRANGE("readahead", readahead, 0, 0, 600),
+        OPT_INTRANGE("retries", retries, 0, 0, 1000),
         OPT_INTRANGE("paranoia", paranoia_mode, 0, 0, 2),
         OPT_INTRANGE("sector-size", sector_size, 0, 1, 100),
         OPT_INTRANGE("overlap", search_overlap, 0, 0, 75),
@@ -89,6 +114,8 @@ const struct m_sub_options stream_cdda_conf = {
     .defaults = &(const struct cdda_params){
         .search_overlap = -1,
         .skip = 1,
+        .readahead = 10,
+        .retries = 20,
     },
 };
 
@@ -153,10 +180,96 @@ static void cdparanoia_callback(long int inpos, paranoia_cb_mode_t function)
 {
 }
 
+// Run paranoia verification on a separate thread, so that retries on bad
+// sectors don't stall the stream, as long as the ring has data left.
+static void *reader_thread(void *arg)
+{
+    cdda_priv *p = arg;
+    mpthread_set_name("cdda");
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->terminate) {
+        if (p->seek_pending) {
+            p->seek_pending = false;
+            p->read_sector = p->sector;
+            p->read_eof = false;
+            int sector = p->read_sector;
+            pthread_mutex_unlock(&p->lock);
+            paranoia_seek(p->cdp, sector, SEEK_SET);
+            pthread_mutex_lock(&p->lock);
+            continue;
+        }
+
+        if (p->read_eof || p->ring_count >= p->ring_size) {
+            pthread_cond_wait(&p->wakeup, &p->lock);
+            continue;
+        }
+
+        if (p->read_sector > p->end_sector) {
+            p->read_eof = true;
+            pthread_cond_broadcast(&p->wakeup);
+            continue;
+        }
+
+        // Reading a mostly full ring is only about keeping up with playback,
+        // so let the drive spin slower (and more quietly).
+        int speed = p->ring_count >= p->ring_size / 2 ? p->quiet_speed : p->speed;
+        bool set_speed = p->quiet_speed > 0 && speed != p->cur_speed;
+        p->cur_speed = speed;
+
+        pthread_mutex_unlock(&p->lock);
+        if (set_speed)
+            cdda_speed_set(p->cd, speed > 0 ? speed : -1);
+        int16_t *buf = paranoia_read_limited(p->cdp, cdparanoia_callback,
+                                             p->retries);
+        pthread_mutex_lock(&p->lock);
+
+        if (p->seek_pending)
+            continue;
+        if (buf) {
+            int idx = (p->ring_start + p->ring_count) % p->ring_size;
+            memcpy(p->ring + idx * CDIO_CD_FRAMESIZE_RAW, buf,
+                   CDIO_CD_FRAMESIZE_RAW);
+            p->ring_count++;
+            p->read_sector++;
+        } else {
+            p->read_eof = true;
+        }
+        pthread_cond_broadcast(&p->wakeup);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static bool read_sector(cdda_priv *p, char *buffer)
+{
+    if (!p->reader_running) {
+        int16_t *buf = paranoia_read_limited(p->cdp, cdparanoia_callback,
+                                             p->retries);
+        if (!buf)
+            return false;
+        memcpy(buffer, buf, CDIO_CD_FRAMESIZE_RAW);
+        return true;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->ring_count && (!p->read_eof || p->seek_pending))
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    bool ok = p->ring_count > 0;
+    if (ok) {
+        memcpy(buffer, p->ring + p->ring_start * CDIO_CD_FRAMESIZE_RAW,
+               CDIO_CD_FRAMESIZE_RAW);
+        p->ring_start = (p->ring_start + 1) % p->ring_size;
+        p->ring_count--;
+        pthread_cond_broadcast(&p->wakeup);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return ok;
+}
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     cdda_priv *p = (cdda_priv *)s->priv;
-    int16_t *buf;
     int i;
 
     if (max_len < CDIO_CD_FRAMESIZE_RAW)
@@ -166,12 +279,14 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
         return 0;
     }
 
-    buf = paranoia_read(p->cdp, cdparanoia_callback);
-    if (!buf)
+    if (!read_sector(p, buffer))
         return 0;
 
+    if (p->reader_running)
+        pthread_mutex_lock(&p->lock);
     p->sector++;
-    memcpy(buffer, buf, CDIO_CD_FRAMESIZE_RAW);
+    if (p->reader_running)
+        pthread_mutex_unlock(&p->lock);
 
     for (i = 0; i < p->cd->tracks; i++) {
         if (p->cd->disc_toc[i].dwStartSector == p->sector - 1) {
@@ -195,7 +310,11 @@ static int seek(stream_t *s, int64_t newpos)
 
     sec = newpos / CDIO_CD_FRAMESIZE_RAW;
     if (newpos < 0 || sec > p->end_sector) {
+        if (p->reader_running)
+            pthread_mutex_lock(&p->lock);
         p->sector = p->end_sector + 1;
+        if (p->reader_running)
+            pthread_mutex_unlock(&p->lock);
         return 0;
     }
 
@@ -213,6 +332,16 @@ static int seek(stream_t *s, int64_t newpos)
     if (current_track != seeked_track && !seek_to_track)
         print_track_info(s, seeked_track + 1);
 
+    if (p->reader_running) {
+        pthread_mutex_lock(&p->lock);
+        p->sector = sec;
+        p->ring_start = p->ring_count = 0;
+        p->seek_pending = true;
+        pthread_cond_broadcast(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+        return 1;
+    }
+
     p->sector = sec;
 
     paranoia_seek(p->cdp, sec, SEEK_SET);
@@ -222,6 +351,15 @@ static int seek(stream_t *s, int64_t newpos)
 static void close_cdda(stream_t *s)
 {
     cdda_priv *p = (cdda_priv *)s->priv;
+    if (p->reader_running) {
+        pthread_mutex_lock(&p->lock);
+        p->terminate = true;
+        pthread_cond_broadcast(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+        pthread_join(p->reader, NULL);
+        pthread_cond_destroy(&p->wakeup);
+        pthread_mutex_destroy(&p->lock);
+    }
     paranoia_free(p->cdp);
     cdda_close(p->cd);
 }
@@ -376,6 +514,22 @@ static int open_cdda(stream_t *st)
 
     paranoia_seek(priv->cdp, priv->start_sector, SEEK_SET);
     priv->sector = priv->start_sector;
+    priv->read_sector = priv->sector;
+    priv->cur_speed = p->speed;
+
+    if (p->readahead > 0) {
+        priv->ring_size = p->readahead * CDIO_CD_FRAMES_PER_SEC;
+        priv->ring = talloc_size(st, priv->ring_size * CDIO_CD_FRAMESIZE_RAW);
+        pthread_mutex_init(&priv->lock, NULL);
+        pthread_cond_init(&priv->wakeup, NULL);
+        priv->reader_running = true;
+        if (pthread_create(&priv->reader, NULL, reader_thread, priv)) {
+            MP_WARN(st, "Failed to start reader thread.\n");
+            priv->reader_running = false;
+            pthread_cond_destroy(&priv->wakeup);
+            pthread_mutex_destroy(&priv->lock);
+        }
+    }
 
     st->priv = priv;
     st->sector_size = CDIO_CD_FRAMESIZE_RAW;
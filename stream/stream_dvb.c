@@ -759,6 +759,39 @@ static int dvb_streaming_read(stream_t *stream, char *buffer, int size)
     return pos;
 }
 
+// Return the index of the demux fd filtering the given PID (-1 for a free
+// one), or -1 if none.
+static int find_filter(dvb_state_t *state, int pid)
+{
+    for (int i = 0; i < state->demux_fds_cnt; i++) {
+        if (state->demux_pids[i] == pid)
+            return i;
+    }
+    return -1;
+}
+
+// Stop the PID filters that are not used by the given channel.
+static void stop_unused_filters(dvb_priv_t *priv, dvb_channel_t *channel)
+{
+    dvb_state_t *state = priv->state;
+    for (int i = 0; i < state->demux_fds_cnt; i++) {
+        int pid = state->demux_pids[i];
+        if (pid == -1)
+            continue;
+        bool used = false;
+        for (int n = 0; n < channel->pids_cnt; n++)
+            used |= channel->pids[n] == pid;
+        // Never keep duplicates.
+        for (int n = 0; n < i; n++)
+            used &= state->demux_pids[n] != pid;
+        if (!used) {
+            ioctl(state->demux_fds[i], DMX_STOP);
+            state->demux_pids[i] = -1;
+        }
+    }
+    MP_VERBOSE(priv, "Keeping PID filters for the same multiplex.\n");
+}
+
 int dvb_set_channel(stream_t *stream, unsigned int adapter, unsigned int n)
 {
     dvb_channels_list_t *new_list;
@@ -784,9 +817,18 @@ int dvb_set_channel(stream_t *stream, unsigned int adapter, unsigned int n)
     }
     channel = &(new_list->channels[n]);
 
+    // A service of the same multiplex needs no tuning, and the PID filters
+    // the services have in common (PAT, SDT, ...) can stay in place.
+    bool same_mux = state->is_on && state->cur_adapter == adapter &&
+                    channel->freq == state->last_freq;
+
     if (state->is_on) {  //the fds are already open and we have to stop the demuxers
-        /* Remove all demuxes. */
-        dvb_fix_demuxes(priv, 0);
+        /* Remove all demuxes, or just stop the ones not needed anymore. */
+        if (same_mux) {
+            stop_unused_filters(priv, channel);
+        } else {
+            dvb_fix_demuxes(priv, 0);
+        }
 
         state->retry = 0;
         //empty both the stream's and driver's buffer
@@ -799,9 +841,9 @@ int dvb_set_channel(stream_t *stream, unsigned int adapter, unsigned int n)
                 return 0;
             }
         } else {
-            // close all demux_fds with pos > pids required for the new channel
-            // or open other demux_fds if we have too few
-            if (!dvb_fix_demuxes(priv, channel->pids_cnt))
+            // open other demux_fds if we have too few
+            if (state->demux_fds_cnt < channel->pids_cnt &&
+                !dvb_fix_demuxes(priv, channel->pids_cnt))
                 return 0;
         }
     } else {
@@ -851,15 +893,20 @@ int dvb_set_channel(stream_t *stream, unsigned int adapter, unsigned int n)
 
     // sets demux filters and restart the stream
     for (i = 0; i < channel->pids_cnt; i++) {
-        if (channel->pids[i] == -1) {
+        int pid = channel->pids[i];
+        if (pid == -1) {
             // In case PMT was not resolved, skip it here.
             MP_ERR(stream, "DVB_SET_CHANNEL: PMT-PID not found, "
                            "teletext-decoding may fail.\n");
-        } else {
-            if (!dvb_set_ts_filt(priv, state->demux_fds[i], channel->pids[i],
-                                 DMX_PES_OTHER))
-                return 0;
+            continue;
         }
+        if (find_filter(state, pid) >= 0)
+            continue; // kept from the previous service
+        int fd = find_filter(state, -1);
+        if (fd < 0 || !dvb_set_ts_filt(priv, state->demux_fds[fd], pid,
+                                       DMX_PES_OTHER))
+            return 0;
+        state->demux_pids[fd] = pid;
     }
 
     return 1;
@@ -1068,6 +1115,7 @@ static int dvb_open(stream_t *stream)
     priv = stream->priv;
     priv->state = state;
     priv->log = stream->log;
+    priv->cancel = stream->cancel;
     if (state == NULL) {
         MP_ERR(stream, "DVB CONFIGURATION IS EMPTY, exit\n");
         pthread_mutex_unlock(&global_dvb_state_lock);
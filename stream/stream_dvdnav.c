@@ -42,6 +42,7 @@
 #include "options/path.h"
 #include "osdep/timer.h"
 #include "stream.h"
+#include "disc_cache.h"
 #include "demux/demux.h"
 #include "video/out/vo.h"
 #include "stream_dvd_common.h"
@@ -64,6 +65,11 @@ struct priv {
     int track;
     char *device;
 
+    // Title and chapter times, shared with other streams opening the same
+    // disc (see disc_cache.h).
+    char *nav_key;
+    struct disc_nav *nav;
+
     struct dvd_opts *opts;
 };
 
@@ -154,6 +160,48 @@ static int mp_dvdnav_number_of_subs(stream_t *stream)
     return n;
 }
 
+static struct disc_nav *get_nav(stream_t *s)
+{
+    struct priv *priv = s->priv;
+    if (!priv->nav) {
+        int32_t num_titles = 0;
+        if (dvdnav_get_number_of_titles(priv->dvdnav, &num_titles) !=
+            DVDNAV_STATUS_OK)
+            return NULL;
+        priv->nav = disc_cache_get(priv, priv->nav_key);
+        if (!priv->nav || priv->nav->num_titles != num_titles)
+            priv->nav = disc_nav_new(priv, num_titles);
+    }
+    return priv->nav;
+}
+
+// Return the description of the given title (starting with 1), or NULL if
+// there is no such title.
+static struct disc_title *get_title(stream_t *s, int title)
+{
+    struct priv *priv = s->priv;
+    struct disc_nav *nav = get_nav(s);
+    if (!nav || title < 1 || title > nav->num_titles)
+        return NULL;
+    struct disc_title *t = &nav->titles[title - 1];
+    if (!t->valid) {
+        uint64_t *parts = NULL, duration = 0;
+        int n = dvdnav_describe_title_chapters(priv->dvdnav, title, &parts,
+                                               &duration);
+        if (!parts)
+            return NULL;
+        t->valid = true;
+        t->duration = duration / 90000.0;
+        t->num_chapters = n;
+        t->chapters = talloc_array(priv->nav, double, n);
+        for (int i = 0; i < n; i++)
+            t->chapters[i] = i > 0 ? parts[i - 1] / 90000.0 : 0;
+        free(parts);
+        disc_cache_put(priv->nav_key, priv->nav);
+    }
+    return t;
+}
+
 static int fill_buffer(stream_t *s, char *buf, int max_len)
 {
     struct priv *priv = s->priv;
@@ -255,14 +303,10 @@ static int control(stream_t *stream, int cmd, void *arg)
         int chapter = *ch;
         if (dvdnav_current_title_info(dvdnav, &tit, &part) != DVDNAV_STATUS_OK)
             break;
-        uint64_t *parts = NULL, duration = 0;
-        int n = dvdnav_describe_title_chapters(dvdnav, tit, &parts, &duration);
-        if (!parts)
+        struct disc_title *t = get_title(stream, tit);
+        if (!t || chapter < 0 || chapter + 1 > t->num_chapters)
             break;
-        if (chapter < 0 || chapter + 1 > n)
-            break;
-        *ch = chapter > 0 ? parts[chapter - 1] / 90000.0 : 0;
-        free(parts);
+        *ch = t->chapters[chapter];
         return 1;
     }
     case STREAM_CTRL_GET_TIME_LENGTH: {
@@ -294,19 +338,11 @@ static int control(stream_t *stream, int cmd, void *arg)
         return STREAM_OK;
     }
     case STREAM_CTRL_GET_TITLE_LENGTH: {
-        int t = *(double *)arg;
-        int32_t num_titles = 0;
-        if (dvdnav_get_number_of_titles(dvdnav, &num_titles) != DVDNAV_STATUS_OK)
-            break;
-        if (t < 0 || t >= num_titles)
-            break;
-        uint64_t duration = 0;
-        uint64_t *parts = NULL;
-        dvdnav_describe_title_chapters(dvdnav, t + 1, &parts, &duration);
-        if (!parts)
+        int title = *(double *)arg;
+        struct disc_title *t = get_title(stream, title + 1);
+        if (!t)
             break;
-        free(parts);
-        *(double *)arg = duration / 90000.0;
+        *(double *)arg = t->duration;
         return STREAM_OK;
     }
     case STREAM_CTRL_GET_CURRENT_TITLE: {
@@ -446,7 +482,9 @@ static struct priv *new_dvdnav_stream(stream_t *stream, char *filename)
     if (dvdnav_set_PGC_positioning_flag(priv->dvdnav, 1) != DVDNAV_STATUS_OK)
         MP_ERR(stream, "stream_dvdnav, failed to set PGC positioning\n");
     /* report the title?! */
+    title_str = NULL;
     dvdnav_get_title_string(priv->dvdnav, &title_str);
+    priv->nav_key = disc_cache_key(priv, priv->filename, title_str);
 
     return priv;
 }
@@ -472,28 +510,22 @@ static int open_s_internal(stream_t *stream)
     }
 
     if (p->track == TITLE_LONGEST) { // longest
-        dvdnav_t *dvdnav = priv->dvdnav;
-        uint64_t best_length = 0;
+        double best_length = 0;
         int best_title = -1;
-        int32_t num_titles;
-        if (dvdnav_get_number_of_titles(dvdnav, &num_titles) == DVDNAV_STATUS_OK) {
-            MP_VERBOSE(stream, "List of available titles:\n");
-            for (int n = 1; n <= num_titles; n++) {
-                uint64_t *parts = NULL, duration = 0;
-                dvdnav_describe_title_chapters(dvdnav, n, &parts, &duration);
-                if (parts) {
-                    if (duration > best_length) {
-                        best_length = duration;
-                        best_title = n;
-                    }
-                    if (duration > 90000) { // arbitrarily ignore <1s titles
-                        char *time = mp_format_time(duration / 90000, false);
-                        MP_VERBOSE(stream, "title: %3d duration: %s\n",
-                                   n - 1, time);
-                        talloc_free(time);
-                    }
-                    free(parts);
-                }
+        MP_VERBOSE(stream, "List of available titles:\n");
+        struct disc_nav *nav = get_nav(stream);
+        for (int n = 1; nav && n <= nav->num_titles; n++) {
+            struct disc_title *t = get_title(stream, n);
+            if (!t)
+                continue;
+            if (t->duration > best_length) {
+                best_length = t->duration;
+                best_title = n;
+            }
+            if (t->duration > 1) { // arbitrarily ignore <1s titles
+                char *time = mp_format_time(t->duration, false);
+                MP_VERBOSE(stream, "title: %3d duration: %s\n", n - 1, time);
+                talloc_free(time);
             }
         }
         p->track = best_title - 1;
@@ -34,6 +34,7 @@
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "osdep/timer.h"
 #include "stream.h"
 #include "options/m_option.h"
 #include "options/path.h"
@@ -57,12 +58,51 @@
 #endif
 #endif
 
+// Read ahead this many seconds of data (at the measured read rate).
+#define READAHEAD_SECS 10
+#define READAHEAD_MIN (1 * 1024 * 1024)
+#define READAHEAD_MAX (256 * 1024 * 1024)
+
 struct priv {
     int fd;
     bool close;
     bool use_poll;
+    // for adaptive readahead (regular files only)
+    bool readahead;
+    int64_t ra_end;         // end of the file range advised to the kernel
+    int64_t speed_start;    // time at which speed_amount started counting
+    int64_t speed_amount;
+    double speed;           // bytes/second read in the last measured interval
 };
 
+// Tell the kernel to asynchronously read the data that will probably be
+// requested next. The default kernel readahead window is often too small for
+// high bitrate files on slow (spinning/network) storage.
+static void update_readahead(stream_t *s, int64_t pos)
+{
+#if HAVE_POSIX_FADVISE
+    struct priv *p = s->priv;
+
+    int64_t now = mp_time_us();
+    if (p->speed_start + 1000000 <= now) {
+        p->speed = p->speed_amount * 1e6 / (now - p->speed_start);
+        p->speed_amount = 0;
+        p->speed_start = now;
+    }
+
+    int64_t window = MPCLAMP(p->speed * READAHEAD_SECS, READAHEAD_MIN,
+                             READAHEAD_MAX);
+    // Advise in chunks of half the window, to keep the number of syscalls low.
+    if (pos + window / 2 < p->ra_end)
+        return;
+    int64_t start = MPMAX(p->ra_end, pos);
+    int64_t end = pos + window;
+    if (end > start)
+        posix_fadvise(p->fd, start, end - start, POSIX_FADV_WILLNEED);
+    p->ra_end = end;
+#endif
+}
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
@@ -79,6 +119,10 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
     }
 #endif
     int r = read(p->fd, buffer, max_len);
+    if (r > 0 && p->readahead) {
+        p->speed_amount += r;
+        update_readahead(s, s->pos + r);
+    }
     return (r <= 0) ? -1 : r;
 }
 
@@ -100,6 +144,7 @@ static int write_buffer(stream_t *s, char *buffer, int len)
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
+    p->ra_end = newpos; // restart readahead at new position
     return lseek(p->fd, newpos, SEEK_SET) != (off_t)-1;
 }
 
@@ -227,6 +272,17 @@ static bool check_stream_network(int fd)
 }
 #endif
 
+// Return whether the file or directory at path is on a network filesystem.
+bool mp_path_is_network(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    bool r = check_stream_network(fd);
+    close(fd);
+    return r;
+}
+
 static int open_f(stream_t *stream)
 {
     struct priv *p = talloc_ptrtype(stream, p);
@@ -293,6 +349,13 @@ static int open_f(stream_t *stream)
                 int val = fcntl(p->fd, F_GETFL) & ~(unsigned)O_NONBLOCK;
                 fcntl(p->fd, F_SETFL, val);
             }
+#endif
+#if HAVE_POSIX_FADVISE
+            if (S_ISREG(st.st_mode) && !write) {
+                p->readahead = true;
+                p->speed_start = mp_time_us();
+                posix_fadvise(p->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            }
 #endif
         }
         p->close = true;
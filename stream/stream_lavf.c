@@ -15,6 +15,8 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
+
 #include <libavformat/avformat.h>
 #include <libavformat/avio.h>
 #include <libavutil/opt.h>
@@ -24,6 +26,9 @@
 #include "common/msg.h"
 #include "common/tags.h"
 #include "common/av_common.h"
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 #include "stream.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
@@ -46,6 +51,7 @@ struct stream_lavf_params {
     char *tls_cert_file;
     char *tls_key_file;
     double timeout;
+    int http_connections;
 };
 
 const struct m_sub_options stream_lavf_conf = {
@@ -61,24 +67,84 @@ const struct m_sub_options stream_lavf_conf = {
         OPT_STRING("tls-cert-file", tls_cert_file, M_OPT_FILE),
         OPT_STRING("tls-key-file", tls_key_file, M_OPT_FILE),
         OPT_DOUBLE("network-timeout", timeout, M_OPT_MIN, .min = 0),
+        OPT_INTRANGE("http-connections", http_connections, 0, 1, 16),
         {0}
     },
     .size = sizeof(struct stream_lavf_params),
     .defaults = &(const struct stream_lavf_params){
         .useragent = (char *)mpv_version,
+        .http_connections = 1,
     },
 };
 
+struct priv {
+    AVIOContext *avio;
+    struct par_reader *par; // if non-NULL, used for reading instead of avio
+};
+
+// Size of the byte ranges fetched by each connection in parallel mode.
+#define PAR_CHUNK_SIZE (2 * 1024 * 1024)
+// Maximum size of a single read from a connection.
+#define PAR_READ_SIZE (64 * 1024)
+
+// Parallel mode: each connection has a slot, which is filled with a byte range
+// of the file. The reader consumes the slot containing the current position;
+// once it is consumed, the slot is reassigned to the next range that is not
+// being fetched yet, so the connections keep PAR_CHUNK_SIZE * num_slots bytes
+// ahead of the reader.
+struct par_slot {
+    struct par_reader *r;
+    pthread_t thread;
+    AVIOContext *avio;      // owned by the slot's thread
+    uint8_t *tmp;           // PAR_READ_SIZE bytes, owned by the slot's thread
+    uint8_t *data;          // PAR_CHUNK_SIZE bytes
+    // --- protected by par_reader.lock
+    int64_t start;          // file position of the data (-1 if unused)
+    int64_t size;           // size of the assigned range
+    int64_t filled;         // bytes fetched so far
+    bool done;              // range fully fetched, or error (filled < size)
+    uint64_t gen;           // incremented on each reassignment
+};
+
+struct par_reader {
+    struct stream *stream;
+    char *url;
+    AVDictionary *opts;
+    int64_t size;           // file size
+    atomic_bool abort;      // interrupts blocking reads on termination
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    bool terminate;
+    int64_t next_start;     // start of the next range to be assigned
+    struct par_slot *slots;
+    int num_slots;
+};
+
 static const char *const http_like[];
 
 static int open_f(stream_t *stream);
 static struct mp_tags *read_icy(stream_t *stream);
+static int par_fill_buffer(stream_t *s, char *buffer, int max_len);
+static void par_destroy(struct par_reader *r);
 
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
-    AVIOContext *avio = s->priv;
+    struct priv *p = s->priv;
+    AVIOContext *avio = p ? p->avio : NULL;
     if (!avio)
         return -1;
+    if (p->par) {
+        int r = par_fill_buffer(s, buffer, max_len);
+        if (r >= 0)
+            return r > 0 ? r : -1;
+        // A connection failed - continue with the main connection only.
+        MP_WARN(s, "Parallel fetching failed, using a single connection.\n");
+        par_destroy(p->par);
+        p->par = NULL;
+        if (avio_seek(avio, s->pos, SEEK_SET) < 0)
+            return -1;
+    }
 #if LIBAVFORMAT_VERSION_MICRO >= 100 && LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 81, 100)
     int r = avio_read_partial(avio, buffer, max_len);
 #else
@@ -89,7 +155,8 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
 
 static int write_buffer(stream_t *s, char *buffer, int len)
 {
-    AVIOContext *avio = s->priv;
+    struct priv *p = s->priv;
+    AVIOContext *avio = p ? p->avio : NULL;
     if (!avio)
         return -1;
     avio_write(avio, buffer, len);
@@ -101,9 +168,12 @@ static int write_buffer(stream_t *s, char *buffer, int len)
 
 static int seek(stream_t *s, int64_t newpos)
 {
-    AVIOContext *avio = s->priv;
+    struct priv *p = s->priv;
+    AVIOContext *avio = p ? p->avio : NULL;
     if (!avio)
         return -1;
+    if (p->par)
+        return 1; // par_fill_buffer() reads from s->pos
     if (avio_seek(avio, newpos, SEEK_SET) < 0) {
         return 0;
     }
@@ -112,19 +182,25 @@ static int seek(stream_t *s, int64_t newpos)
 
 static void close_f(stream_t *stream)
 {
-    AVIOContext *avio = stream->priv;
+    struct priv *p = stream->priv;
+    if (!p)
+        return;
+    if (p->par)
+        par_destroy(p->par);
     /* NOTE: As of 2011 write streams must be manually flushed before close.
      * Currently write_buffer() always flushes them after writing.
      * avio_close() could return an error, but we have no way to return that
      * with the current stream API.
      */
-    if (avio)
-        avio_close(avio);
+    if (p->avio)
+        avio_close(p->avio);
+    talloc_free(p);
 }
 
 static int control(stream_t *s, int cmd, void *arg)
 {
-    AVIOContext *avio = s->priv;
+    struct priv *p = s->priv;
+    AVIOContext *avio = p ? p->avio : NULL;
     if (!avio && cmd != STREAM_CTRL_RECONNECT)
         return -1;
     int64_t size;
@@ -138,6 +214,8 @@ static int control(stream_t *s, int cmd, void *arg)
         break;
     case STREAM_CTRL_AVSEEK: {
         struct stream_avseek *c = arg;
+        if (p->par)
+            break;
         int64_t r = avio_seek_time(avio, c->stream_index, c->timestamp, c->flags);
         if (r >= 0) {
             stream_drop_buffers(s);
@@ -251,23 +329,201 @@ void mp_setup_av_network_options(AVDictionary **dict, struct mpv_global *global,
 // Escape http URLs with unescaped, invalid characters in them.
 // libavformat's http protocol does not do this, and a patch to add this
 // in a 100% safe case (spaces only) was rejected.
-static char *normalize_url(void *ta_parent, const char *filename)
+static bool is_http_like(const char *filename)
 {
     bstr proto = mp_split_proto(bstr0(filename), NULL);
     for (int n = 0; http_like[n]; n++) {
         if (bstr_equals0(proto, http_like[n]))
-            // Escape everything but reserved characters.
-            // Also don't double-scape, so include '%'.
-            return mp_url_escape(ta_parent, filename, ":/?#[]@!$&'()*+,;=%");
+            return true;
     }
+    return false;
+}
+
+static char *normalize_url(void *ta_parent, const char *filename)
+{
+    // Escape everything but reserved characters.
+    // Also don't double-scape, so include '%'.
+    if (is_http_like(filename))
+        return mp_url_escape(ta_parent, filename, ":/?#[]@!$&'()*+,;=%");
     return (char *)filename;
 }
 
+static int par_interrupt_cb(void *ctx)
+{
+    struct par_reader *r = ctx;
+    return atomic_load(&r->abort) || mp_cancel_test(r->stream->cancel);
+}
+
+// Assign the next range to the slot (or mark it unused at EOF).
+// Must be called with r->lock held.
+static void par_assign(struct par_reader *r, struct par_slot *sl)
+{
+    sl->gen++;
+    sl->filled = 0;
+    sl->done = false;
+    if (r->next_start < r->size) {
+        sl->start = r->next_start;
+        sl->size = MPMIN(PAR_CHUNK_SIZE, r->size - sl->start);
+        r->next_start += sl->size;
+    } else {
+        sl->start = -1;
+        sl->size = 0;
+    }
+    pthread_cond_broadcast(&r->wakeup);
+}
+
+static void *par_thread(void *arg)
+{
+    struct par_slot *sl = arg;
+    struct par_reader *r = sl->r;
+    mpthread_set_name("lavf-http");
+
+    pthread_mutex_lock(&r->lock);
+    while (!r->terminate) {
+        if (sl->start < 0 || sl->done) {
+            pthread_cond_wait(&r->wakeup, &r->lock);
+            continue;
+        }
+        uint64_t gen = sl->gen;
+        int64_t pos = sl->start + sl->filled;
+        int len = MPMIN(sl->size - sl->filled, PAR_READ_SIZE);
+        pthread_mutex_unlock(&r->lock);
+
+        int res = -1;
+        if (!sl->avio) {
+            AVDictionary *dict = NULL;
+            av_dict_copy(&dict, r->opts, 0);
+            AVIOInterruptCB cb = {
+                .callback = par_interrupt_cb,
+                .opaque = r,
+            };
+            if (avio_open2(&sl->avio, r->url, AVIO_FLAG_READ, &cb, &dict) < 0)
+                sl->avio = NULL;
+            av_dict_free(&dict);
+        }
+        if (sl->avio && (avio_tell(sl->avio) == pos ||
+                         avio_seek(sl->avio, pos, SEEK_SET) >= 0))
+            res = avio_read(sl->avio, sl->tmp, len);
+
+        pthread_mutex_lock(&r->lock);
+        if (sl->gen == gen) {
+            if (res > 0) {
+                memcpy(sl->data + sl->filled, sl->tmp, res);
+                sl->filled += res;
+            }
+            // Incomplete ranges are treated as error by the reader.
+            sl->done = res <= 0 || sl->filled == sl->size;
+            pthread_cond_broadcast(&r->wakeup);
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+static void par_destroy(struct par_reader *r)
+{
+    pthread_mutex_lock(&r->lock);
+    r->terminate = true;
+    atomic_store(&r->abort, true);
+    pthread_cond_broadcast(&r->wakeup);
+    pthread_mutex_unlock(&r->lock);
+    for (int n = 0; n < r->num_slots; n++) {
+        struct par_slot *sl = &r->slots[n];
+        if (sl->r) {
+            pthread_join(sl->thread, NULL);
+            if (sl->avio)
+                avio_close(sl->avio);
+        }
+    }
+    av_dict_free(&r->opts);
+    pthread_cond_destroy(&r->wakeup);
+    pthread_mutex_destroy(&r->lock);
+    talloc_free(r);
+}
+
+static struct par_reader *par_create(struct stream *stream, const char *url,
+                                     AVDictionary *opts, int num, int64_t size)
+{
+    struct par_reader *r = talloc_zero(NULL, struct par_reader);
+    r->stream = stream;
+    r->url = talloc_strdup(r, url);
+    r->size = size;
+    av_dict_copy(&r->opts, opts, 0);
+    // The metadata would be interleaved from different positions.
+    av_dict_set(&r->opts, "icy", "0", 0);
+    atomic_init(&r->abort, false);
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->wakeup, NULL);
+    r->slots = talloc_zero_array(r, struct par_slot, num);
+    r->num_slots = num;
+    for (int n = 0; n < num; n++) {
+        struct par_slot *sl = &r->slots[n];
+        sl->data = talloc_size(r, PAR_CHUNK_SIZE);
+        sl->tmp = talloc_size(r, PAR_READ_SIZE);
+        sl->start = -1;
+        sl->r = r;
+        if (pthread_create(&sl->thread, NULL, par_thread, sl)) {
+            sl->r = NULL;
+            par_destroy(r);
+            return NULL;
+        }
+    }
+    return r;
+}
+
+// Returns >0 for bytes read, 0 on EOF, -1 if parallel fetching failed.
+static int par_fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    struct par_reader *r = p->par;
+    int64_t pos = s->pos;
+    if (pos >= r->size)
+        return 0;
+
+    int res = -1;
+    pthread_mutex_lock(&r->lock);
+    while (!mp_cancel_test(s->cancel)) {
+        struct par_slot *sl = NULL;
+        for (int n = 0; n < r->num_slots; n++) {
+            struct par_slot *cur = &r->slots[n];
+            // Skipped by a forward seek - don't keep the connection busy.
+            if (cur->start >= 0 && cur->start + cur->size <= pos &&
+                r->next_start > pos)
+                par_assign(r, cur);
+            if (cur->start >= 0 && pos >= cur->start &&
+                pos < cur->start + cur->size)
+                sl = cur;
+        }
+        if (!sl) {
+            // Seek or first read: restart all connections at this position.
+            MP_VERBOSE(s, "Fetching ranges at %"PRId64".\n", pos);
+            r->next_start = pos;
+            for (int n = 0; n < r->num_slots; n++)
+                par_assign(r, &r->slots[n]);
+            continue;
+        }
+        if (pos < sl->start + sl->filled) {
+            int64_t avail = sl->start + sl->filled - pos;
+            res = MPMIN(max_len, avail);
+            memcpy(buffer, sl->data + (pos - sl->start), res);
+            if (pos + res == sl->start + sl->size)
+                par_assign(r, sl);
+            break;
+        }
+        if (sl->done)
+            break;
+        struct timespec ts = mp_rel_time_to_timespec(0.1);
+        pthread_cond_timedwait(&r->wakeup, &r->lock, &ts);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return res;
+}
+
 static int open_f(stream_t *stream)
 {
     AVIOContext *avio = NULL;
     int res = STREAM_ERROR;
-    AVDictionary *dict = NULL;
+    AVDictionary *dict = NULL, *par_dict = NULL;
     void *temp = talloc_new(NULL);
 
     stream->seek = NULL;
@@ -313,6 +569,9 @@ static int open_f(stream_t *stream)
 
     filename = normalize_url(stream, filename);
 
+    // avio_open2() consumes the options it recognizes.
+    av_dict_copy(&par_dict, dict, 0);
+
     if (strncmp(filename, "rtmp", 4) == 0) {
         stream->demuxer = "lavf";
         stream->lavf_type = "flv";
@@ -338,7 +597,9 @@ static int open_f(stream_t *stream)
         }
     }
 
-    stream->priv = avio;
+    struct priv *p = talloc_zero(NULL, struct priv);
+    p->avio = avio;
+    stream->priv = p;
     stream->seekable = avio->seekable & AVIO_SEEKABLE_NORMAL;
     stream->seek = stream->seekable ? seek : NULL;
     stream->fill_buffer = fill_buffer;
@@ -347,9 +608,25 @@ static int open_f(stream_t *stream)
     stream->close = close_f;
     // enable cache (should be avoided for files, but no way to detect this)
     stream->streaming = true;
+
+    struct stream_lavf_params *opts =
+        mp_get_config_group(temp, stream->global, &stream_lavf_conf);
+    int64_t size = avio_size(avio);
+    if (opts->http_connections > 1 && flags == AVIO_FLAG_READ &&
+        stream->seekable && size > PAR_CHUNK_SIZE && is_http_like(filename))
+    {
+        p->par = par_create(stream, filename, par_dict,
+                            opts->http_connections, size);
+        if (p->par) {
+            MP_VERBOSE(stream, "Using %d connections.\n",
+                       opts->http_connections);
+        }
+    }
+
     res = STREAM_OK;
 
 out:
+    av_dict_free(&par_dict);
     av_dict_free(&dict);
     talloc_free(temp);
     return res;
@@ -357,7 +634,8 @@ out:
 
 static struct mp_tags *read_icy(stream_t *s)
 {
-    AVIOContext *avio = s->priv;
+    struct priv *p = s->priv;
+    AVIOContext *avio = p->avio;
 
     if (!avio->av_class)
         return NULL;
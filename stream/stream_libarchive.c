@@ -15,15 +15,75 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
+
 #include <archive.h>
 #include <archive_entry.h>
 
+#include <libavutil/intreadwrite.h>
+
 #include "misc/bstr.h"
 #include "common/common.h"
 #include "stream.h"
 
 #include "stream_libarchive.h"
 
+// A member of a ZIP archive that is stored as is (not compressed or
+// encrypted), and can be read directly from the archive file.
+struct zip_member {
+    char *name;
+    int64_t header_offset;  // offset of the local file header
+    int64_t size;
+};
+
+// Information about an archive that is expensive to gather, and is remembered
+// across opening the members of the same archive (e.g. when playing the
+// playlist created by demux_libarchive.c). Archives are identified by URL, and
+// the information is considered valid as long as the size doesn't change.
+struct archive_index {
+    char *url;
+    int64_t size;
+    char **volumes;         // other volumes (NULL terminated), NULL if unknown
+    bool zip_checked;       // zip_members was set (possibly empty)
+    struct zip_member *zip_members;
+    int num_zip_members;
+};
+
+// Maximum number of archives remembered in the index cache.
+#define MAX_INDEX_CACHE 4
+
+static pthread_mutex_t index_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct archive_index **index_cache; // MRU first
+static int num_index_cache;
+
+// Return the index entry for the given archive (creating it if needed), and
+// make it the most recently used one. Must be called with index_cache_lock.
+static struct archive_index *get_index(const char *url, int64_t size)
+{
+    struct archive_index *idx = NULL;
+    for (int n = 0; n < num_index_cache; n++) {
+        struct archive_index *cur = index_cache[n];
+        if (strcmp(cur->url, url) == 0) {
+            MP_TARRAY_REMOVE_AT(index_cache, num_index_cache, n);
+            if (cur->size == size) {
+                idx = cur;
+            } else {
+                talloc_free(cur);
+            }
+            break;
+        }
+    }
+    if (!idx) {
+        if (num_index_cache == MAX_INDEX_CACHE)
+            talloc_free(index_cache[--num_index_cache]);
+        idx = talloc_zero(NULL, struct archive_index);
+        idx->url = talloc_strdup(idx, url);
+        idx->size = size;
+    }
+    MP_TARRAY_INSERT_AT(NULL, index_cache, num_index_cache, 0, idx);
+    return idx;
+}
+
 struct mp_archive_volume {
     struct mp_archive *mpa;
     struct stream *src;
@@ -190,6 +250,7 @@ static char **find_volumes(struct stream *primary_stream)
     char **res = talloc_new(NULL);
     int    num = 0;
     struct bstr primary_url = bstr0(primary_stream->url);
+    int64_t size = stream_get_size(primary_stream);
 
     const struct file_pattern *pattern = patterns;
     while (pattern->match) {
@@ -201,6 +262,16 @@ static char **find_volumes(struct stream *primary_stream)
     if (!pattern->match)
         goto done;
 
+    // Probing for volumes opens every candidate file, so reuse the result.
+    pthread_mutex_lock(&index_cache_lock);
+    struct archive_index *idx = get_index(primary_stream->url, size);
+    for (int i = 0; idx->volumes && idx->volumes[i]; i++)
+        MP_TARRAY_APPEND(res, res, num, talloc_strdup(res, idx->volumes[i]));
+    bool cached = !!idx->volumes;
+    pthread_mutex_unlock(&index_cache_lock);
+    if (cached)
+        goto done;
+
     struct bstr base = bstr_splice(primary_url, 0, -strlen(pattern->match));
     for (int i = pattern->start; i <= pattern->stop; i++) {
         char* url = pattern->volume_url(res, pattern->format, base, i);
@@ -215,6 +286,17 @@ static char **find_volumes(struct stream *primary_stream)
         MP_TARRAY_APPEND(res, res, num, url);
     }
 
+    MP_TARRAY_APPEND(res, res, num, NULL);
+    num--;
+    pthread_mutex_lock(&index_cache_lock);
+    idx = get_index(primary_stream->url, size);
+    if (!idx->volumes) {
+        idx->volumes = talloc_array(idx, char *, num + 1);
+        for (int i = 0; i <= num; i++)
+            idx->volumes[i] = talloc_strdup(idx, res[i]);
+    }
+    pthread_mutex_unlock(&index_cache_lock);
+
 done:
     MP_TARRAY_APPEND(res, res, num, NULL);
     return res;
@@ -330,8 +412,144 @@ struct priv {
     struct stream *src;
     int64_t entry_size;
     char *entry_name;
+    int64_t direct_offset;  // if >= 0, entry data is read directly from src
 };
 
+// Parse the ZIP central directory, and add all stored members to idx. Only
+// plain single-disk non-zip64 archives are handled; anything else is left to
+// libarchive. Returns false if the archive could not be parsed.
+static bool read_zip_index(struct stream *src, struct archive_index *idx)
+{
+    int64_t size = stream_get_size(src);
+    if (size < 22)
+        return false;
+
+    // The end of central directory record is at the end of the file, possibly
+    // followed by a comment of up to 64K.
+    int tail_len = MPMIN(size, 22 + 0xFFFF);
+    uint8_t *tail = talloc_size(NULL, tail_len);
+    bool ok = false;
+    if (!stream_seek(src, size - tail_len) ||
+        stream_read(src, (char *)tail, tail_len) != tail_len)
+        goto done;
+    int eocd = -1;
+    for (int n = tail_len - 22; n >= 0; n--) {
+        if (AV_RL32(tail + n) == 0x06054b50) {
+            eocd = n;
+            break;
+        }
+    }
+    if (eocd < 0)
+        goto done;
+    uint8_t *e = tail + eocd;
+    int64_t cd_size = AV_RL32(e + 12);
+    int64_t cd_offset = AV_RL32(e + 16);
+    if (AV_RL16(e + 4) != 0 || AV_RL16(e + 6) != 0 ||
+        cd_offset == 0xFFFFFFFF || cd_size > 64 * 1024 * 1024 ||
+        cd_offset + cd_size > size)
+        goto done;
+
+    uint8_t *cd = talloc_size(tail, cd_size);
+    if (!stream_seek(src, cd_offset) || stream_read(src, (char *)cd, cd_size) != cd_size)
+        goto done;
+    for (int64_t pos = 0; pos + 46 <= cd_size;) {
+        uint8_t *c = cd + pos;
+        if (AV_RL32(c) != 0x02014b50)
+            break;
+        int flags = AV_RL16(c + 8);
+        int method = AV_RL16(c + 10);
+        int64_t csize = AV_RL32(c + 20);
+        int64_t usize = AV_RL32(c + 24);
+        int name_len = AV_RL16(c + 28);
+        int entry_len = 46 + name_len + AV_RL16(c + 30) + AV_RL16(c + 32);
+        int64_t offset = AV_RL32(c + 42);
+        if (pos + entry_len > cd_size)
+            break;
+        // Not encrypted, stored, no data descriptor with unknown sizes.
+        if (!(flags & 1) && method == 0 && csize == usize &&
+            csize != 0xFFFFFFFF && offset != 0xFFFFFFFF)
+        {
+            struct zip_member m = {
+                .name = talloc_strndup(idx, (char *)c + 46, name_len),
+                .header_offset = offset,
+                .size = usize,
+            };
+            MP_TARRAY_APPEND(idx, idx->zip_members, idx->num_zip_members, m);
+        }
+        pos += entry_len;
+    }
+    ok = true;
+done:
+    talloc_free(tail);
+    return ok;
+}
+
+// If the entry is a stored member of a ZIP archive, return the absolute
+// offset of its data in the archive file, and set *size. Otherwise return -1.
+static int64_t find_direct_entry(struct stream *src, const char *name,
+                                 int64_t *size)
+{
+    if (!src->seekable)
+        return -1;
+    bstr magic = stream_peek(src, 4);
+    if (magic.len < 4 || memcmp(magic.start, "PK\3\4", 4) != 0)
+        return -1;
+
+    struct zip_member m = {0};
+    pthread_mutex_lock(&index_cache_lock);
+    struct archive_index *idx = get_index(src->url, stream_get_size(src));
+    if (!idx->zip_checked) {
+        idx->zip_checked = true;
+        if (!read_zip_index(src, idx)) {
+            talloc_free(idx->zip_members);
+            idx->zip_members = NULL;
+            idx->num_zip_members = 0;
+        }
+    }
+    for (int n = 0; n < idx->num_zip_members; n++) {
+        if (strcmp(idx->zip_members[n].name, name) == 0) {
+            m = idx->zip_members[n];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&index_cache_lock);
+    if (!m.name)
+        return -1;
+
+    // The local header can have a different extra field length than the
+    // central directory entry, so it must be read to find the data.
+    uint8_t hdr[30];
+    if (!stream_seek(src, m.header_offset) ||
+        stream_read(src, (char *)hdr, sizeof(hdr)) != sizeof(hdr) ||
+        AV_RL32(hdr) != 0x04034b50 || AV_RL16(hdr + 8) != 0 ||
+        (AV_RL16(hdr + 6) & 1))
+        return -1;
+    int64_t offset = m.header_offset + 30 + AV_RL16(hdr + 26) +
+                     AV_RL16(hdr + 28);
+    if (offset + m.size > stream_get_size(src))
+        return -1;
+    *size = m.size;
+    return offset;
+}
+
+static int direct_fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    int64_t left = p->entry_size - s->pos;
+    if (left <= 0)
+        return 0;
+    if (stream_tell(p->src) != p->direct_offset + s->pos &&
+        !stream_seek(p->src, p->direct_offset + s->pos))
+        return -1;
+    return stream_read_partial(p->src, buffer, MPMIN(max_len, left));
+}
+
+static int direct_seek(stream_t *s, int64_t newpos)
+{
+    struct priv *p = s->priv;
+    return newpos <= p->entry_size ? 1 : -1;
+}
+
 static int reopen_archive(stream_t *s)
 {
     struct priv *p = s->priv;
@@ -454,6 +672,7 @@ static int archive_entry_open(stream_t *stream)
     char *name = strchr(base, '|');
     *name++ = '\0';
     p->entry_name = name;
+    p->direct_offset = -1;
     mp_url_unescape_inplace(base);
 
     p->src = stream_create(base, STREAM_READ | STREAM_SAFE_ONLY,
@@ -463,16 +682,26 @@ static int archive_entry_open(stream_t *stream)
         return STREAM_ERROR;
     }
 
-    int r = reopen_archive(stream);
-    if (r < STREAM_OK) {
-        archive_entry_close(stream);
-        return r;
-    }
-
-    stream->fill_buffer = archive_entry_fill_buffer;
-    if (p->src->seekable) {
-        stream->seek = archive_entry_seek;
+    // Stored ZIP members can be read (and seeked) directly, without
+    // libarchive, which can seek backwards only by restarting.
+    p->direct_offset = find_direct_entry(p->src, p->entry_name, &p->entry_size);
+    if (p->direct_offset >= 0) {
+        MP_VERBOSE(stream, "reading stored entry directly\n");
+        stream->fill_buffer = direct_fill_buffer;
+        stream->seek = direct_seek;
         stream->seekable = true;
+    } else {
+        int r = reopen_archive(stream);
+        if (r < STREAM_OK) {
+            archive_entry_close(stream);
+            return r;
+        }
+
+        stream->fill_buffer = archive_entry_fill_buffer;
+        if (p->src->seekable) {
+            stream->seek = archive_entry_seek;
+            stream->seekable = true;
+        }
     }
     stream->close = archive_entry_close;
     stream->control = archive_entry_control;
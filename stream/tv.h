@@ -90,6 +90,7 @@ typedef struct tvi_info_s
 
 
 struct priv;
+struct AVBufferRef;
 
 typedef struct tvi_functions_s
 {
@@ -101,6 +102,9 @@ typedef struct tvi_functions_s
     int (*get_video_framesize)(struct priv *priv);
     double (*grab_audio_frame)(struct priv *priv, char *buffer, int len);
     int (*get_audio_framesize)(struct priv *priv);
+    // Optional. Return a padded buffer with the next frame, or NULL.
+    double (*grab_video_buffer)(struct priv *priv, struct AVBufferRef **buf,
+                                int *len);
 } tvi_functions_t;
 
 typedef struct tvi_handle_s {
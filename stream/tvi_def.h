@@ -30,6 +30,10 @@ static double grab_video_frame(priv_t *priv, char *buffer, int len);
 static int get_video_framesize(priv_t *priv);
 static double grab_audio_frame(priv_t *priv, char *buffer, int len);
 static int get_audio_framesize(priv_t *priv);
+#ifdef TVI_GRAB_VIDEO_BUFFER
+static double grab_video_buffer(priv_t *priv, struct AVBufferRef **buf,
+                                int *len);
+#endif
 
 static const tvi_functions_t functions =
 {
@@ -40,7 +44,10 @@ static const tvi_functions_t functions =
     grab_video_frame,
     get_video_framesize,
     grab_audio_frame,
-    get_audio_framesize
+    get_audio_framesize,
+#ifdef TVI_GRAB_VIDEO_BUFFER
+    grab_video_buffer,
+#endif
 };
 
 /**
@@ -53,6 +53,9 @@ known issues:
 #if HAVE_LIBV4L2
 #include <libv4l2.h>
 #endif
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
 #include "common/msg.h"
 #include "common/common.h"
 #include "audio/format.h"
@@ -93,7 +96,8 @@ struct map {
 
 /** video ringbuffer entry */
 typedef struct {
-    unsigned char               *data;     ///< frame contents
+    AVBufferRef                 *buf;      ///< allocated from video_pool
+    unsigned char               *data;     ///< frame contents (buf->data)
     long long                   timestamp; ///< frame timestamp
     int                         framesize; ///< actual frame size
 } video_buffer_entry;
@@ -132,6 +136,7 @@ typedef struct priv {
     volatile int                video_head;
     volatile int                video_tail;
     volatile int                video_cnt;
+    AVBufferPool                *video_pool;
     pthread_t                   video_grabber_thread;
     pthread_mutex_t             video_buffer_mutex;
 
@@ -179,6 +184,7 @@ typedef struct tt_stream_props_s{
     int bufsize;      ///< required buffer size
 } tt_stream_props;
 
+#define TVI_GRAB_VIDEO_BUFFER
 #include "tvi_def.h"
 
 static void *audio_grabber(void *data);
@@ -1014,10 +1020,12 @@ static int uninit(priv_t *priv)
 
     if (priv->video_ringbuffer) {
         for (int n = 0; n < priv->video_buffer_size_current; n++) {
-            free(priv->video_ringbuffer[n].data);
+            av_buffer_unref(&priv->video_ringbuffer[n].buf);
         }
         free(priv->video_ringbuffer);
     }
+    // Buffers still referenced by demux packets are freed when released.
+    av_buffer_pool_uninit(&priv->video_pool);
     if (priv->tv_param->audio) {
         free(priv->audio_ringbuffer);
         free(priv->audio_skew_buffer);
@@ -1304,7 +1312,11 @@ static int start(priv_t *priv)
     }
 
     priv->video_ringbuffer = calloc(priv->video_buffer_size_max, sizeof(video_buffer_entry));
-    if (!priv->video_ringbuffer) {
+    // Frame buffers are passed to the demuxer as packet data, and return to
+    // the pool when the packet is freed.
+    priv->video_pool = av_buffer_pool_init(priv->format.fmt.pix.sizeimage +
+                                           AV_INPUT_BUFFER_PADDING_SIZE, NULL);
+    if (!priv->video_ringbuffer || !priv->video_pool) {
         MP_ERR(priv, "cannot allocate video buffer: %s\n", mp_strerror(errno));
         return 0;
     }
@@ -1377,9 +1389,22 @@ static int start(priv_t *priv)
     return 1;
 }
 
+// Allocate the frame buffer of a ringbuffer entry.
+static bool alloc_video_entry(priv_t *priv, video_buffer_entry *entry)
+{
+    int size = priv->format.fmt.pix.sizeimage;
+    entry->buf = av_buffer_pool_get(priv->video_pool);
+    if (!entry->buf)
+        return false;
+    entry->data = entry->buf->data;
+    memset(entry->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    return true;
+}
+
 // copies a video frame
 static inline void copy_frame(priv_t *priv, video_buffer_entry *dest, unsigned char *source,int len)
 {
+    len = MPMIN(len, priv->format.fmt.pix.sizeimage);
     dest->framesize=len;
     if(priv->tv_param->automute>0){
         if (v4l2_ioctl(priv->video_fd, VIDIOC_G_TUNER, &priv->tuner) >= 0) {
@@ -1401,7 +1426,6 @@ static void *video_grabber(void *data)
     priv_t *priv = (priv_t*)data;
     long long skew, prev_skew, xskew, interval, prev_interval, delta;
     int i;
-    int framesize = priv->format.fmt.pix.sizeimage;
     fd_set rdset;
     struct timeval timeout;
     struct v4l2_buffer buf;
@@ -1528,11 +1552,11 @@ static void *video_grabber(void *data)
         pthread_mutex_lock(&priv->video_buffer_mutex);
         if (priv->video_buffer_size_current < priv->video_buffer_size_max) {
             if (priv->video_cnt == priv->video_buffer_size_current) {
-                unsigned char *newbuf = malloc(framesize);
-                if (newbuf) {
+                video_buffer_entry newentry = {0};
+                if (alloc_video_entry(priv, &newentry)) {
                     memmove(priv->video_ringbuffer+priv->video_tail+1, priv->video_ringbuffer+priv->video_tail,
                             (priv->video_buffer_size_current-priv->video_tail)*sizeof(video_buffer_entry));
-                    priv->video_ringbuffer[priv->video_tail].data = newbuf;
+                    priv->video_ringbuffer[priv->video_tail] = newentry;
                     if ((priv->video_head >= priv->video_tail) && (priv->video_cnt > 0)) priv->video_head++;
                     priv->video_buffer_size_current++;
                 }
@@ -1577,7 +1601,8 @@ static void *video_grabber(void *data)
 }
 
 #define MAX_LOOP 500
-static double grab_video_frame(priv_t *priv, char *buffer, int len)
+// Start the grabber thread if needed, and wait until a frame is available.
+static bool wait_video_frame(priv_t *priv)
 {
     int loop_cnt = 0;
 
@@ -1588,8 +1613,15 @@ static double grab_video_frame(priv_t *priv, char *buffer, int len)
 
     while (priv->video_cnt == 0) {
         usleep(1000);
-        if (loop_cnt++ > MAX_LOOP) return 0;
+        if (loop_cnt++ > MAX_LOOP) return false;
     }
+    return true;
+}
+
+static double grab_video_frame(priv_t *priv, char *buffer, int len)
+{
+    if (!wait_video_frame(priv))
+        return 0;
 
     pthread_mutex_lock(&priv->video_buffer_mutex);
     long long interval = priv->video_ringbuffer[priv->video_head].timestamp;
@@ -1601,6 +1633,31 @@ static double grab_video_frame(priv_t *priv, char *buffer, int len)
     return interval == -1 ? MP_NOPTS_VALUE : interval*1e-6;
 }
 
+// Like grab_video_frame(), but return the ringbuffer's frame buffer itself
+// (padded with AV_INPUT_BUFFER_PADDING_SIZE), and put a new buffer from the
+// pool into the ringbuffer. This avoids copying the frame once more.
+static double grab_video_buffer(priv_t *priv, AVBufferRef **buf, int *len)
+{
+    *buf = NULL;
+    if (!wait_video_frame(priv))
+        return MP_NOPTS_VALUE;
+
+    pthread_mutex_lock(&priv->video_buffer_mutex);
+    video_buffer_entry *entry = &priv->video_ringbuffer[priv->video_head];
+    long long interval = entry->timestamp;
+    video_buffer_entry newentry = {0};
+    if (alloc_video_entry(priv, &newentry)) {
+        *buf = entry->buf;
+        *len = entry->framesize;
+        *entry = newentry;
+    }
+    priv->video_cnt--;
+    priv->video_head = (priv->video_head+1)%priv->video_buffer_size_current;
+    pthread_mutex_unlock(&priv->video_buffer_mutex);
+
+    return interval == -1 ? MP_NOPTS_VALUE : interval*1e-6;
+}
+
 static int get_video_framesize(priv_t *priv)
 {
     /*
@@ -100,6 +100,10 @@ void mp_ass_configure_fonts(ASS_Renderer *priv, struct osd_style_opts *opts,
     ass_set_fonts(priv, default_font, opts->font, 1, config, 1);
     mp_verbose(log, "Done.\n");
 
+    // 0 means libass defaults.
+    ass_set_cache_limits(priv, global->opts->ass_glyph_cache,
+                         global->opts->ass_bitmap_cache);
+
     talloc_free(tmp);
 }
 
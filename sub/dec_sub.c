@@ -58,6 +58,13 @@ struct dec_sub {
     double last_pkt_pts;
     bool preload_attempted;
 
+    // Packets read by sub_preload(), decoded by preload_thread.
+    struct demux_packet **preload_pkts;
+    int num_preload_pkts;
+    pthread_t preload_thread;
+    bool preload_active;
+    bool preload_abort;
+
     struct mp_codec_params *codec;
     double start, end;
 
@@ -81,6 +88,14 @@ void sub_destroy(struct dec_sub *sub)
 {
     if (!sub)
         return;
+    if (sub->preload_active) {
+        pthread_mutex_lock(&sub->lock);
+        sub->preload_abort = true;
+        pthread_mutex_unlock(&sub->lock);
+        pthread_join(sub->preload_thread, NULL);
+    }
+    for (int n = 0; n < sub->num_preload_pkts; n++)
+        talloc_free(sub->preload_pkts[n]);
     sub_reset(sub);
     sub->sd->driver->uninit(sub->sd);
     talloc_free(sub->sd);
@@ -184,6 +199,28 @@ bool sub_can_preload(struct dec_sub *sub)
     return r;
 }
 
+static void *preload_thread(void *p)
+{
+    struct dec_sub *sub = p;
+    mpthread_set_name("subpreload");
+
+    // Lock per packet, so the subtitles decoded so far can be rendered while
+    // the rest of the file is still being added.
+    for (int n = 0; n < sub->num_preload_pkts; n++) {
+        pthread_mutex_lock(&sub->lock);
+        bool stop = sub->preload_abort || !sub->sd->preload_ok;
+        if (!stop)
+            sub->sd->driver->decode(sub->sd, sub->preload_pkts[n]);
+        pthread_mutex_unlock(&sub->lock);
+        if (stop)
+            break;
+    }
+    return NULL;
+}
+
+// Read all packets from the stream, and decode them on a separate thread.
+// Reading is cheap (for fully read demuxers, the packets are already in
+// memory), but decoding large text subtitle files can take a while.
 void sub_preload(struct dec_sub *sub)
 {
     pthread_mutex_lock(&sub->lock);
@@ -194,8 +231,14 @@ void sub_preload(struct dec_sub *sub)
         struct demux_packet *pkt = demux_read_packet(sub->sh);
         if (!pkt)
             break;
-        sub->sd->driver->decode(sub->sd, pkt);
-        talloc_free(pkt);
+        MP_TARRAY_APPEND(sub, sub->preload_pkts, sub->num_preload_pkts, pkt);
+    }
+
+    if (pthread_create(&sub->preload_thread, NULL, preload_thread, sub)) {
+        for (int n = 0; n < sub->num_preload_pkts; n++)
+            sub->sd->driver->decode(sub->sd, sub->preload_pkts[n]);
+    } else {
+        sub->preload_active = true;
     }
 
     pthread_mutex_unlock(&sub->lock);
@@ -300,6 +343,22 @@ char *sub_get_text(struct dec_sub *sub, double pts)
     return text;
 }
 
+// Returns MP_NOPTS_VALUE for both fields if no event is visible, or if the
+// decoder doesn't support it.
+struct sd_times sub_get_times(struct dec_sub *sub, double pts)
+{
+    pthread_mutex_lock(&sub->lock);
+    struct sd_times res = { .start = MP_NOPTS_VALUE, .end = MP_NOPTS_VALUE };
+
+    sub->last_vo_pts = pts;
+    update_segment(sub);
+
+    if (sub->sd->driver->get_times)
+        res = sub->sd->driver->get_times(sub->sd, pts);
+    pthread_mutex_unlock(&sub->lock);
+    return res;
+}
+
 void sub_reset(struct dec_sub *sub)
 {
     pthread_mutex_lock(&sub->lock);
@@ -50,11 +50,33 @@ struct part {
     struct sub_cache *imgs;
 };
 
+// Sub-bitmaps (libass or RGBA) within one bounding box, composited into a
+// single image, so that drawing them onto a new video frame needs one blend
+// pass per plane (instead of one per sub-bitmap), and no conversion of the
+// video to 4:4:4 and back. Colors are premultiplied with alpha.
+struct ass_overlay {
+    struct mp_image *img;       // 4:4:4 with alpha, in the dst colorspace
+    struct mp_image *chroma;    // for 4:2:0 dst: img's planes 1-3 at half
+                                // resolution (stored in planes 0-2)
+};
+
+struct overlay_part {
+    int change_id;
+    int imgfmt;
+    enum mp_csp colorspace;
+    enum mp_csp_levels levels;
+    int w, h;
+    int num_overlays;
+    struct ass_overlay *overlays;
+};
+
 struct mp_draw_sub_cache
 {
     struct part *parts[MAX_OSD_PARTS];
+    struct overlay_part *overlay_parts[MAX_OSD_PARTS];
     struct mp_image *upsample_img;
     struct mp_image upsample_temp;
+    uint8_t *chroma_alpha;
 };
 
 
@@ -101,6 +123,23 @@ static void blend_const_alpha(void *dst, int dst_stride, int srcp,
         dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;   \
     }
 
+// Same as x / 255, but only valid for 0 <= x < 65535.
+static inline uint32_t div255(uint32_t x)
+{
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+// 8 bit version of BLEND_SRC_ALPHA. This has no branches in the inner loop
+// (alpha=0 yields dst unchanged anyway), so that the compiler can vectorize it.
+static void blend_src_alpha_8(uint8_t *dst_r, uint8_t *src_r, uint8_t *srca_r,
+                              int w)
+{
+    for (int x = 0; x < w; x++) {
+        uint32_t srcap = srca_r[x];
+        dst_r[x] = div255(src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127);
+    }
+}
+
 // dst = src * srca + dst * (1 - srca)
 static void blend_src_alpha(void *dst, int dst_stride, void *src,
                             int src_stride, uint8_t *srca, int srca_stride,
@@ -113,7 +152,7 @@ static void blend_src_alpha(void *dst, int dst_stride, void *src,
         if (bytes == 2) {
             BLEND_SRC_ALPHA(uint16_t)
         } else if (bytes == 1) {
-            BLEND_SRC_ALPHA(uint8_t)
+            blend_src_alpha_8(dst_rp, src_rp, srca_r, w);
         }
     }
 }
@@ -125,6 +164,22 @@ static void blend_src_alpha(void *dst, int dst_stride, void *src,
         dst_r[x] = (srcp * (MAX) + dst_r[x] * (65025 - srcp) + 32512) / 65025;  \
     }
 
+// dst = src + dst * (1 - srca), where src is premultiplied with srca
+static void blend_premul_8(uint8_t *dst, int dst_stride, uint8_t *src,
+                           int src_stride, uint8_t *srca, int srca_stride,
+                           int w, int h)
+{
+    for (int y = 0; y < h; y++) {
+        uint8_t *dst_r = dst + dst_stride * y;
+        uint8_t *src_r = src + src_stride * y;
+        uint8_t *srca_r = srca + srca_stride * y;
+        for (int x = 0; x < w; x++) {
+            uint32_t v = src_r[x] + div255(dst_r[x] * (255 - srca_r[x]) + 127);
+            dst_r[x] = MPMIN(v, 255);
+        }
+    }
+}
+
 // dst = src * srcmul + dst * (1 - src * srcmul)
 static void blend_src_dst_mul(void *dst, int dst_stride,
                               uint8_t *src, int src_stride, uint8_t srcmul,
@@ -246,6 +301,35 @@ static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
     }
 }
 
+// Downsample the w*h alpha mask a by 2x2, for blending onto 4:2:0 chroma
+// planes. (ox, oy) is the offset of the mask within the first chroma sample
+// (0 or 1). Pixels outside of the mask count as transparent. The result has
+// cw*ch pixels and a stride of cw, and is valid until the next call.
+static uint8_t *downsample_alpha_420(struct mp_draw_sub_cache *cache,
+                                     uint8_t *a, int a_stride, int ox, int oy,
+                                     int w, int h, int cw, int ch)
+{
+    MP_TARRAY_GROW(cache, cache->chroma_alpha, cw * ch);
+    uint8_t *out = cache->chroma_alpha;
+    for (int cy = 0; cy < ch; cy++) {
+        for (int cx = 0; cx < cw; cx++) {
+            int sum = 0;
+            for (int dy = 0; dy < 2; dy++) {
+                int y = cy * 2 + dy - oy;
+                if (y < 0 || y >= h)
+                    continue;
+                for (int dx = 0; dx < 2; dx++) {
+                    int x = cx * 2 + dx - ox;
+                    if (x >= 0 && x < w)
+                        sum += a[y * a_stride + x];
+                }
+            }
+            out[cy * cw + cx] = (sum + 2) >> 2;
+        }
+    }
+    return out;
+}
+
 static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
                      struct mp_image *temp, int bits, struct sub_bitmaps *sbs)
 {
@@ -262,12 +346,21 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
         mp_invert_cmat(&rgb2yuv, &yuv2rgb);
     }
 
+    // For 4:2:0, sub-bitmaps need not be aligned to chroma samples; crop the
+    // luma plane only, and handle chroma separately.
+    bool is_420 = temp->imgfmt == IMGFMT_420P;
+    struct mp_image luma = *temp;
+    if (is_420) {
+        mp_image_setfmt(&luma, IMGFMT_Y8);
+        mp_image_set_size(&luma, temp->w, temp->h);
+    }
+
     for (int i = 0; i < sbs->num_parts; ++i) {
         struct sub_bitmap *sb = &sbs->parts[i];
 
         struct mp_image dst;
         int src_x, src_y;
-        if (!get_sub_area(bb, temp, sb, &dst, &src_x, &src_y))
+        if (!get_sub_area(bb, &luma, sb, &dst, &src_x, &src_y))
             continue;
 
         int r = (sb->libass.color >> 24) & 0xFF;
@@ -286,6 +379,25 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
 
         int bytes = (bits + 7) / 8;
         uint8_t *alpha_p = (uint8_t *)sb->bitmap + src_y * sb->stride + src_x;
+        if (is_420) {
+            // Blend luma directly, and chroma with a downsampled alpha mask.
+            blend_const_alpha(dst.planes[0], dst.stride[0], color_yuv[0],
+                              alpha_p, sb->stride, a, dst.w, dst.h, 1);
+            int x0 = src_x + sb->x - bb.x0, y0 = src_y + sb->y - bb.y0;
+            struct mp_rect crc = {x0 >> 1, y0 >> 1,
+                                  (x0 + dst.w + 1) >> 1, (y0 + dst.h + 1) >> 1};
+            int cw = crc.x1 - crc.x0, ch = crc.y1 - crc.y0;
+            uint8_t *calpha = downsample_alpha_420(cache, alpha_p, sb->stride,
+                                                   x0 & 1, y0 & 1, dst.w, dst.h,
+                                                   cw, ch);
+            for (int p = 1; p < 3; p++) {
+                uint8_t *cdst = temp->planes[p] + crc.y0 * temp->stride[p] +
+                                crc.x0;
+                blend_const_alpha(cdst, temp->stride[p], color_yuv[p],
+                                  calpha, cw, a, cw, ch, 1);
+            }
+            continue;
+        }
         for (int p = 0; p < (temp->num_planes > 2 ? 3 : 1); p++) {
             blend_const_alpha(dst.planes[p], dst.stride[p], color_yuv[p],
                               alpha_p, sb->stride, a, dst.w, dst.h, bytes);
@@ -297,6 +409,127 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
     }
 }
 
+// Downsample a premultiplied plane by 2x2 (dst has half the size of src).
+static void downsample_plane_2x2(uint8_t *dst, int dst_stride, uint8_t *src,
+                                 int src_stride, int w, int h)
+{
+    for (int y = 0; y < (h + 1) / 2; y++) {
+        uint8_t *s0 = src + src_stride * (y * 2);
+        uint8_t *s1 = y * 2 + 1 < h ? s0 + src_stride : s0;
+        uint8_t *dst_r = dst + dst_stride * y;
+        for (int x = 0; x < (w + 1) / 2; x++) {
+            int x0 = x * 2, x1 = x0 + 1 < w ? x0 + 1 : x0;
+            dst_r[x] = (s0[x0] + s0[x1] + s1[x0] + s1[x1] + 2) >> 2;
+        }
+    }
+}
+
+// Composite all sub-bitmaps in bb into ov (allocated as child of part).
+// temp is the image (region) the overlay will be blended onto, and must have
+// 8 bit components.
+static void render_overlay(struct mp_draw_sub_cache *cache,
+                           struct overlay_part *part, struct mp_rect bb,
+                           struct mp_image *temp, struct sub_bitmaps *sbs,
+                           struct ass_overlay *ov)
+{
+    int flags = temp->fmt.flags & MP_IMGFLAG_RGB ? MP_IMGFLAG_RGB_P
+                                                 : MP_IMGFLAG_YUV_P;
+    int imgfmt = mp_imgfmt_find(0, 0, 4, 8, flags);
+    if (!imgfmt)
+        return;
+
+    struct mp_image *img = mp_image_alloc(imgfmt, temp->w, temp->h);
+    if (!img)
+        return;
+    img->params.color = temp->params.color;
+
+    // Blending onto transparent black yields premultiplied colors.
+    for (int p = 0; p < img->num_planes; p++)
+        memset_pic(img->planes[p], 0, img->w, img->h, img->stride[p]);
+
+    if (sbs->format == SUBBITMAP_RGBA) {
+        draw_rgba(cache, bb, img, 8, sbs);
+    } else {
+        draw_ass(cache, bb, img, 8, sbs);
+    }
+
+    if (temp->imgfmt == IMGFMT_420P) {
+        struct mp_image *chroma = mp_image_alloc(IMGFMT_444P, (img->w + 1) / 2,
+                                                 (img->h + 1) / 2);
+        if (!chroma) {
+            talloc_free(img);
+            return;
+        }
+        for (int p = 0; p < 3; p++) {
+            downsample_plane_2x2(chroma->planes[p], chroma->stride[p],
+                                 img->planes[p + 1], img->stride[p + 1],
+                                 img->w, img->h);
+        }
+        ov->chroma = talloc_steal(part, chroma);
+    }
+
+    ov->img = talloc_steal(part, img);
+}
+
+static void blend_overlay(struct mp_image *temp, struct ass_overlay *ov)
+{
+    struct mp_image *img = ov->img;
+    if (ov->chroma) {
+        struct mp_image *chroma = ov->chroma;
+        blend_premul_8(temp->planes[0], temp->stride[0], img->planes[0],
+                       img->stride[0], img->planes[3], img->stride[3],
+                       img->w, img->h);
+        for (int p = 1; p < 3; p++) {
+            blend_premul_8(temp->planes[p], temp->stride[p],
+                           chroma->planes[p - 1], chroma->stride[p - 1],
+                           chroma->planes[2], chroma->stride[2],
+                           chroma->w, chroma->h);
+        }
+    } else {
+        for (int p = 0; p < 3; p++) {
+            blend_premul_8(temp->planes[p], temp->stride[p], img->planes[p],
+                           img->stride[p], img->planes[3], img->stride[3],
+                           img->w, img->h);
+        }
+    }
+}
+
+static struct overlay_part *get_overlay_cache(struct mp_draw_sub_cache *cache,
+                                              struct sub_bitmaps *sbs,
+                                              struct mp_image *dst,
+                                              int num_overlays)
+{
+    struct overlay_part *part = cache->overlay_parts[sbs->render_index];
+    if (part) {
+        if (part->change_id != sbs->change_id
+            || part->imgfmt != dst->imgfmt
+            || part->colorspace != dst->params.color.space
+            || part->levels != dst->params.color.levels
+            || part->w != dst->w || part->h != dst->h
+            || part->num_overlays != num_overlays)
+        {
+            talloc_free(part);
+            part = NULL;
+        }
+    }
+    if (!part) {
+        part = talloc(cache, struct overlay_part);
+        *part = (struct overlay_part) {
+            .change_id = sbs->change_id,
+            .imgfmt = dst->imgfmt,
+            .colorspace = dst->params.color.space,
+            .levels = dst->params.color.levels,
+            .w = dst->w,
+            .h = dst->h,
+            .num_overlays = num_overlays,
+        };
+        part->overlays = talloc_zero_array(part, struct ass_overlay,
+                                           num_overlays);
+    }
+    cache->overlay_parts[sbs->render_index] = part;
+    return part;
+}
+
 static void get_swscale_alignment(const struct mp_image *img, int *out_xstep,
                                   int *out_ystep)
 {
@@ -510,6 +743,12 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
     struct mp_rect rc_list[MP_SUB_BB_LIST_MAX];
     int num_rc = mp_get_sub_bb_list(sbs, rc_list, MP_SUB_BB_LIST_MAX);
 
+    // The composited overlays are reused as long as the subtitles don't
+    // change. (Not for 16 bit or alpha formats.)
+    struct overlay_part *ov_part = NULL;
+    if (bits == 8 && !(dst->fmt.flags & MP_IMGFLAG_ALPHA))
+        ov_part = get_overlay_cache(cache_, sbs, dst, num_rc);
+
     for (int r = 0; r < num_rc; r++) {
         struct mp_rect bb = rc_list[r];
 
@@ -518,17 +757,33 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
 
         struct mp_image dst_region = *dst;
         mp_image_crop_rc(&dst_region, bb);
-        struct mp_image *temp = chroma_up(cache_, format, &dst_region);
+
+        struct ass_overlay *ov = ov_part ? &ov_part->overlays[r] : NULL;
+        if (ov && !ov->img)
+            render_overlay(cache_, ov_part, bb, &dst_region, sbs, ov);
+        if (ov && !ov->img)
+            ov = NULL;
+
+        // libass bitmaps and composited overlays are blended onto 4:2:0 video
+        // directly, without the conversion to 4:4:4 and back.
+        bool direct = dst->imgfmt == IMGFMT_420P &&
+                      (ov || sbs->format == SUBBITMAP_LIBASS);
+
+        struct mp_image *temp = direct ? &dst_region
+                                       : chroma_up(cache_, format, &dst_region);
         if (!temp)
             continue; // on OOM, skip region
 
-        if (sbs->format == SUBBITMAP_RGBA) {
+        if (ov) {
+            blend_overlay(temp, ov);
+        } else if (sbs->format == SUBBITMAP_RGBA) {
             draw_rgba(cache_, bb, temp, bits, sbs);
         } else if (sbs->format == SUBBITMAP_LIBASS) {
             draw_ass(cache_, bb, temp, bits, sbs);
         }
 
-        chroma_down(&dst_region, temp);
+        if (!direct)
+            chroma_down(&dst_region, temp);
     }
 
     if (cache) {
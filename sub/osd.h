@@ -150,6 +150,7 @@ struct dec_sub;
 struct osd_state *osd_create(struct mpv_global *global);
 void osd_changed(struct osd_state *osd);
 void osd_free(struct osd_state *osd);
+void osd_preload_fonts(struct osd_state *osd);
 
 bool osd_query_and_reset_want_redraw(struct osd_state *osd);
 
@@ -204,6 +205,8 @@ void osd_rescale_bitmaps(struct sub_bitmaps *imgs, int frame_w, int frame_h,
 // defined in osd_libass.c and osd_dummy.c
 void osd_set_external(struct osd_state *osd, void *id, int res_x, int res_y,
                       char *text);
+void osd_set_external_elem(struct osd_state *osd, void *id, int res_x,
+                           int res_y, int elem_id, char *text);
 void osd_get_text_size(struct osd_state *osd, int *out_screen_h, int *out_font_h);
 void osd_get_function_sym(char *buffer, size_t buffer_size, int osd_function);
 
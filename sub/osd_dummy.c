@@ -14,6 +14,10 @@ void osd_destroy_backend(struct osd_state *osd)
 {
 }
 
+void osd_preload_fonts(struct osd_state *osd)
+{
+}
+
 void osd_get_function_sym(char *buffer, size_t buffer_size, int osd_function)
 {
 }
@@ -29,6 +33,11 @@ void osd_set_external(struct osd_state *osd, void *id, int res_x, int res_y,
 {
 }
 
+void osd_set_external_elem(struct osd_state *osd, void *id, int res_x,
+                           int res_y, int elem_id, char *text)
+{
+}
+
 void osd_get_text_size(struct osd_state *osd, int *out_screen_h, int *out_font_h)
 {
     *out_screen_h = 0;
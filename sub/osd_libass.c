@@ -28,6 +28,7 @@
 #include "misc/bstr.h"
 #include "common/common.h"
 #include "common/msg.h"
+#include "osdep/threads.h"
 #include "osd.h"
 #include "osd_state.h"
 
@@ -43,6 +44,13 @@ static const char osd_font_pfb[] =
 
 void osd_init_backend(struct osd_state *osd)
 {
+    // All OSD objects (including script overlays) use the same library, so
+    // the font data is loaded only once. Each object still has its own
+    // renderer, because libass tracks changes between frames per renderer.
+    osd->ass_log = mp_log_new(osd, osd->log, "libass");
+    osd->ass_library = mp_ass_init(osd->global, osd->ass_log);
+    ass_add_font(osd->ass_library, "mpv-osd-symbols", (void *)osd_font_pfb,
+                 sizeof(osd_font_pfb) - 1);
 }
 
 static void create_ass_renderer(struct osd_state *osd, struct ass_state *ass)
@@ -51,9 +59,7 @@ static void create_ass_renderer(struct osd_state *osd, struct ass_state *ass)
         return;
 
     ass->log = mp_log_new(NULL, osd->log, "libass");
-    ass->library = mp_ass_init(osd->global, ass->log);
-    ass_add_font(ass->library, "mpv-osd-symbols", (void *)osd_font_pfb,
-                 sizeof(osd_font_pfb) - 1);
+    ass->library = osd->ass_library;
 
     ass->render = ass_renderer_init(ass->library);
     if (!ass->render)
@@ -72,8 +78,6 @@ static void destroy_ass_renderer(struct ass_state *ass)
     if (ass->render)
         ass_renderer_done(ass->render);
     ass->render = NULL;
-    if (ass->library)
-        ass_library_done(ass->library);
     ass->library = NULL;
     talloc_free(ass->log);
     ass->log = NULL;
@@ -81,12 +85,51 @@ static void destroy_ass_renderer(struct ass_state *ass)
 
 static void destroy_external(struct osd_external *ext)
 {
-    talloc_free(ext->text);
+    for (int n = 0; n < ext->num_elems; n++)
+        talloc_free(ext->elems[n].text);
+    talloc_free(ext->elems);
     destroy_ass_renderer(&ext->ass);
 }
 
+static void *preload_thread(void *arg)
+{
+    struct osd_state *osd = arg;
+    mpthread_set_name("osd-fonts");
+
+    // Font setup (fontconfig in particular) can take a long time, so it's done
+    // without holding the lock.
+    struct ass_state ass = {0};
+    create_ass_renderer(osd, &ass);
+
+    pthread_mutex_lock(&osd->lock);
+    struct ass_state *dst = &osd->objs[OSDTYPE_OSD]->ass;
+    if (!dst->render) {
+        *dst = ass;
+        ass = (struct ass_state){0};
+    }
+    pthread_mutex_unlock(&osd->lock);
+
+    destroy_ass_renderer(&ass);
+    return NULL;
+}
+
+// Set up the renderer and fonts for OSD text on a separate thread, instead of
+// when the first OSD text is rendered.
+void osd_preload_fonts(struct osd_state *osd)
+{
+    if (osd->preload_active)
+        return;
+    if (pthread_create(&osd->preload_thread, NULL, preload_thread, osd))
+        return;
+    osd->preload_active = true;
+}
+
 void osd_destroy_backend(struct osd_state *osd)
 {
+    if (osd->preload_active)
+        pthread_join(osd->preload_thread, NULL);
+    osd->preload_active = false;
+
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
         struct osd_object *obj = osd->objs[n];
         destroy_ass_renderer(&obj->ass);
@@ -94,6 +137,10 @@ void osd_destroy_backend(struct osd_state *osd)
             destroy_external(&obj->externals[i]);
         obj->num_externals = 0;
     }
+
+    if (osd->ass_library)
+        ass_library_done(osd->ass_library);
+    osd->ass_library = NULL;
 }
 
 static void update_playres(struct ass_state *ass, struct mp_osd_res *vo_res)
@@ -468,12 +515,28 @@ static void update_osd(struct osd_state *osd, struct osd_object *obj)
     update_progbar(osd, obj);
 }
 
+// Append an event for each non-empty line in text. Returns the event count.
+static int add_external_events(ASS_Track *track, const char *text)
+{
+    int num = 0;
+    bstr t = bstr0(text);
+    while (t.len) {
+        bstr line;
+        bstr_split_tok(t, "\n", &line, &t);
+        if (line.len) {
+            char *tmp = bstrdup0(NULL, line);
+            add_osd_ass_event(track, "OSD", tmp);
+            talloc_free(tmp);
+            num++;
+        }
+    }
+    return num;
+}
+
+// Rebuild the track (and styles) from scratch.
 static void update_external(struct osd_state *osd, struct osd_object *obj,
                             struct osd_external *ext)
 {
-    bstr t = bstr0(ext->text);
-    if (!t.len)
-        return;
     ext->ass.res_x = ext->res_x;
     ext->ass.res_y = ext->res_y;
     create_ass_track(osd, obj, &ext->ass);
@@ -487,60 +550,151 @@ static void update_external(struct osd_state *osd, struct osd_object *obj,
     const struct osd_style_opts *def = osd_style_conf.defaults;
     mp_ass_set_style(get_style(&ext->ass, "Default"), resy, def);
 
-    while (t.len) {
-        bstr line;
-        bstr_split_tok(t, "\n", &line, &t);
-        if (line.len) {
-            char *tmp = bstrdup0(NULL, line);
-            add_osd_ass_event(ext->ass.track, "OSD", tmp);
+    for (int n = 0; n < ext->num_elems; n++) {
+        struct osd_external_elem *elem = &ext->elems[n];
+        elem->num_events = add_external_events(ext->ass.track, elem->text);
+    }
+}
+
+// Replace only the events of ext->elems[index] with its current text (or
+// remove them if the text is NULL). Events of other elements are kept, so
+// libass doesn't see them as new.
+static void update_external_elem(struct osd_state *osd, struct osd_object *obj,
+                                 struct osd_external *ext, int index)
+{
+    ASS_Track *track = ext->ass.track;
+    if (!track) {
+        update_external(osd, obj, ext);
+        return;
+    }
+
+    struct osd_external_elem *elem = &ext->elems[index];
+    int start = 0;
+    for (int n = 0; n < index; n++)
+        start += ext->elems[n].num_events;
+
+    for (int n = 0; n < elem->num_events; n++)
+        ass_free_event(track, start + n);
+    int end = start + elem->num_events;
+    memmove(&track->events[start], &track->events[end],
+            (track->n_events - end) * sizeof(track->events[0]));
+    track->n_events -= elem->num_events;
+    elem->num_events = 0;
+
+    if (elem->text) {
+        // Append at the end, then rotate the new events into place.
+        int pos = track->n_events;
+        int num = add_external_events(track, elem->text);
+        if (num && pos > start) {
+            size_t size = num * sizeof(track->events[0]);
+            void *tmp = talloc_memdup(NULL, &track->events[pos], size);
+            memmove(&track->events[start + num], &track->events[start],
+                    (pos - start) * sizeof(track->events[0]));
+            memcpy(&track->events[start], tmp, size);
             talloc_free(tmp);
         }
+        elem->num_events = num;
     }
+
+    for (int n = 0; n < track->n_events; n++)
+        track->events[n].ReadOrder = n;
 }
 
-void osd_set_external(struct osd_state *osd, void *id, int res_x, int res_y,
-                      char *text)
+static struct osd_external *find_external(struct osd_object *obj, void *id)
 {
-    pthread_mutex_lock(&osd->lock);
-    struct osd_object *obj = osd->objs[OSDTYPE_EXTERNAL];
-    struct osd_external *entry = 0;
     for (int n = 0; n < obj->num_externals; n++) {
-        if (obj->externals[n].id == id) {
-            entry = &obj->externals[n];
-            break;
-        }
+        if (obj->externals[n].id == id)
+            return &obj->externals[n];
     }
+    return NULL;
+}
+
+static void remove_external(struct osd_state *osd, struct osd_object *obj,
+                            struct osd_external *entry)
+{
+    int index = entry - &obj->externals[0];
+    destroy_external(entry);
+    MP_TARRAY_REMOVE_AT(obj->externals, obj->num_externals, index);
+    obj->changed = true;
+    osd->want_redraw_notification = true;
+}
+
+// Set the text of a single element of the external OSD owned by id. Elements
+// are rendered in order of elem_id. If text is NULL, the element is removed.
+// Changing one element doesn't re-add the ASS events of the other elements.
+void osd_set_external_elem(struct osd_state *osd, void *id, int res_x,
+                           int res_y, int elem_id, char *text)
+{
+    pthread_mutex_lock(&osd->lock);
+    struct osd_object *obj = osd->objs[OSDTYPE_EXTERNAL];
+    struct osd_external *entry = find_external(obj, id);
     if (!entry && !text)
         goto done;
 
     if (!entry) {
-        struct osd_external new = { .id = id };
+        struct osd_external new = { .id = id, .res_x = res_x, .res_y = res_y };
         MP_TARRAY_APPEND(obj, obj->externals, obj->num_externals, new);
         entry = &obj->externals[obj->num_externals - 1];
     }
 
+    int index = 0;
+    while (index < entry->num_elems && entry->elems[index].id < elem_id)
+        index++;
+    bool found = index < entry->num_elems && entry->elems[index].id == elem_id;
+
     if (!text) {
-        int index = entry - &obj->externals[0];
-        destroy_external(entry);
-        MP_TARRAY_REMOVE_AT(obj->externals, obj->num_externals, index);
-        obj->changed = true;
-        osd->want_redraw_notification = true;
-        goto done;
+        if (!found)
+            goto done;
+        TA_FREEP(&entry->elems[index].text);
+        update_external_elem(osd, obj, entry, index);
+        MP_TARRAY_REMOVE_AT(entry->elems, entry->num_elems, index);
+        if (!entry->num_elems) {
+            remove_external(osd, obj, entry);
+            goto done;
+        }
+    } else {
+        if (!found) {
+            struct osd_external_elem new = { .id = elem_id };
+            MP_TARRAY_INSERT_AT(NULL, entry->elems, entry->num_elems, index,
+                                new);
+        }
+        struct osd_external_elem *elem = &entry->elems[index];
+        bool res_changed = entry->res_x != res_x || entry->res_y != res_y;
+        if (elem->text && strcmp(elem->text, text) == 0 && !res_changed)
+            goto done;
+        talloc_free(elem->text);
+        elem->text = talloc_strdup(NULL, text);
+        if (res_changed) {
+            // Styles depend on the resolution; redo everything.
+            entry->res_x = res_x;
+            entry->res_y = res_y;
+            update_external(osd, obj, entry);
+        } else {
+            update_external_elem(osd, obj, entry, index);
+        }
     }
+    obj->changed = true;
+    osd->want_redraw_notification = true;
+
+done:
+    pthread_mutex_unlock(&osd->lock);
+}
 
-    if (!entry->text || strcmp(entry->text, text) != 0 ||
-        entry->res_x != res_x || entry->res_y != res_y)
-    {
-        talloc_free(entry->text);
-        entry->text = talloc_strdup(NULL, text);
-        entry->res_x = res_x;
-        entry->res_y = res_y;
-        update_external(osd, obj, entry);
-        obj->changed = true;
-        osd->want_redraw_notification = true;
+// Set the whole external OSD owned by id to text. This is element 0; if text
+// is NULL, the external OSD and all its elements are removed.
+void osd_set_external(struct osd_state *osd, void *id, int res_x, int res_y,
+                      char *text)
+{
+    if (text) {
+        osd_set_external_elem(osd, id, res_x, res_y, 0, text);
+        return;
     }
 
-done:
+    pthread_mutex_lock(&osd->lock);
+    struct osd_object *obj = osd->objs[OSDTYPE_EXTERNAL];
+    struct osd_external *entry = find_external(obj, id);
+    if (entry)
+        remove_external(osd, obj, entry);
     pthread_mutex_unlock(&osd->lock);
 }
 
@@ -21,7 +21,7 @@ struct ass_state {
     struct mp_log *log;
     struct ass_track *track;
     struct ass_renderer *render;
-    struct ass_library *library;
+    struct ass_library *library;    // osd_state.ass_library (not owned)
     int res_x, res_y;
 };
 
@@ -55,11 +55,20 @@ struct osd_object {
     struct ass_image **ass_imgs;
 };
 
+struct osd_external_elem {
+    int id;
+    char *text;
+    int num_events;     // number of events it occupies in osd_external.ass
+};
+
 struct osd_external {
     void *id;
-    char *text;
     int res_x, res_y;
     struct ass_state ass;
+    // Sorted by id. Each element's events are stored contiguously in the
+    // track, so one element can be replaced without touching the others.
+    struct osd_external_elem *elems;
+    int num_elems;
 };
 
 struct osd_state {
@@ -78,6 +87,14 @@ struct osd_state {
     struct mp_log *log;
 
     struct mp_draw_sub_cache *draw_cache;
+
+    // Used by osd_libass.c for osd_preload_fonts().
+    pthread_t preload_thread;
+    bool preload_active;
+
+    // Used by osd_libass.c; shared by all ass_state instances.
+    struct mp_log *ass_log;
+    struct ass_library *ass_library;
 };
 
 // defined in osd_libass.c and osd_dummy.c
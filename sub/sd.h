@@ -40,6 +40,7 @@ struct sd_functions {
     void (*get_bitmaps)(struct sd *sd, struct mp_osd_res dim, int format,
                         double pts, struct sub_bitmaps *res);
     char *(*get_text)(struct sd *sd, double pts);
+    struct sd_times (*get_times)(struct sd *sd, double pts);
 };
 
 struct lavc_conv;
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
 #include <ass/ass.h>
@@ -30,12 +31,23 @@
 #include "common/common.h"
 #include "common/msg.h"
 #include "demux/demux.h"
+#include "misc/thread_pool.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
 #include "dec_sub.h"
 #include "ass_mp.h"
 #include "sd.h"
 
+// Everything that determines how a frame is rendered, except the timestamp.
+struct render_params {
+    struct mp_osd_res dim;
+    int format;
+    bool converted;
+    struct ass_track *track;
+    double scale;
+    int storage_w, storage_h;
+};
+
 struct sd_ass_priv {
     struct ass_library *ass_library;
     struct ass_renderer *ass_renderer;
@@ -53,6 +65,55 @@ struct sd_ass_priv {
     int64_t *seen_packets;
     int num_seen_packets;
     bool duration_unknown;
+
+    // Index over ass_track events, sorted by start time. Used to find the
+    // events visible at a given time without walking the whole track. Events
+    // added by libass are appended to the track, so the index can usually be
+    // extended; anything else that changes the event list must set
+    // ev_index_invalid to force a rebuild.
+    struct ev_ref *ev_index;
+    int num_ev_index;
+    bool ev_index_invalid;
+    int *ev_found;                  // result of find_events()
+    int num_ev_found;
+
+    // --sub-ass-prefetch: the next frame is rendered by prefetch_renderer on a
+    // worker thread. If the prediction was right, the renderer/packer pairs
+    // are swapped, so that ass_renderer/packer always own the bitmaps returned
+    // by the last get_bitmaps() call (libass and the packer free them on the
+    // next render).
+    struct mp_thread_pool *prefetch_pool;
+    struct ass_renderer *prefetch_renderer;
+    struct mp_ass_packer *prefetch_packer;
+    pthread_mutex_t prefetch_lock;
+    pthread_cond_t prefetch_wakeup;
+    bool prefetch_busy;             // protected by prefetch_lock
+    bool prefetch_valid;            // prefetch_res can be used
+    long long prefetch_ts;
+    struct render_params prefetch_params;
+    struct sub_bitmaps prefetch_res;
+    struct sub_bitmaps last_res;    // last packed result (before mangling)
+    double last_pts;
+
+    // Closed captions are converted to ASS on conv_pool, so that feeding them
+    // costs (almost) nothing on the caller's thread. Queued packets and the
+    // converted event lines are protected by conv_lock. The converter is used
+    // by the worker only while conv_busy is set. The lines are added to the
+    // track before it's accessed (update_converted()).
+    struct mp_thread_pool *conv_pool;
+    pthread_mutex_t conv_lock;
+    pthread_cond_t conv_wakeup;
+    struct demux_packet **conv_in;
+    int num_conv_in;
+    char **conv_out;
+    int num_conv_out;
+    bool conv_busy;
+};
+
+struct ev_ref {
+    long long start, end;
+    long long max_end;              // max. end of this and all previous entries
+    int index;                      // into ASS_Track.events
 };
 
 static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts);
@@ -127,19 +188,53 @@ static void add_subtitle_fonts(struct sd *sd)
     }
 }
 
+// Wait until the worker thread is done. Until then, it may access the track,
+// the prefetch renderer and the prefetch packer.
+static void wait_prefetch(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    if (!ctx->prefetch_pool)
+        return;
+    pthread_mutex_lock(&ctx->prefetch_lock);
+    while (ctx->prefetch_busy)
+        pthread_cond_wait(&ctx->prefetch_wakeup, &ctx->prefetch_lock);
+    pthread_mutex_unlock(&ctx->prefetch_lock);
+}
+
+// Like wait_prefetch(), but also drop the prefetched frame.
+static void cancel_prefetch(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    wait_prefetch(sd);
+    ctx->prefetch_valid = false;
+}
+
 static void enable_output(struct sd *sd, bool enable)
 {
     struct sd_ass_priv *ctx = sd->priv;
     if (enable == !!ctx->ass_renderer)
         return;
+    cancel_prefetch(sd);
     if (ctx->ass_renderer) {
         ass_renderer_done(ctx->ass_renderer);
         ctx->ass_renderer = NULL;
+        if (ctx->prefetch_renderer)
+            ass_renderer_done(ctx->prefetch_renderer);
+        ctx->prefetch_renderer = NULL;
     } else {
         ctx->ass_renderer = ass_renderer_init(ctx->ass_library);
 
         mp_ass_configure_fonts(ctx->ass_renderer, sd->opts->sub_style,
                                sd->global, sd->log);
+
+        if (ctx->prefetch_pool) {
+            ctx->prefetch_renderer = ass_renderer_init(ctx->ass_library);
+            if (ctx->prefetch_renderer) {
+                mp_ass_configure_fonts(ctx->prefetch_renderer,
+                                       sd->opts->sub_style, sd->global,
+                                       sd->log);
+            }
+        }
     }
 }
 
@@ -211,9 +306,24 @@ static int init(struct sd *sd)
     ctx->frame_fps = sd->codec->frame_based;
     update_subtitle_speed(sd);
 
+    pthread_mutex_init(&ctx->prefetch_lock, NULL);
+    pthread_cond_init(&ctx->prefetch_wakeup, NULL);
+    ctx->last_pts = MP_NOPTS_VALUE;
+    if (opts->ass_prefetch) {
+        ctx->prefetch_pool = mp_thread_pool_create(ctx, 1);
+        if (!ctx->prefetch_pool)
+            MP_WARN(sd, "Could not create subtitle prefetch thread.\n");
+    }
+
+    pthread_mutex_init(&ctx->conv_lock, NULL);
+    pthread_cond_init(&ctx->conv_wakeup, NULL);
+    if (strcmp(sd->codec->codec, "eia_608") == 0)
+        ctx->conv_pool = mp_thread_pool_create(ctx, 1);
+
     enable_output(sd, true);
 
     ctx->packer = mp_ass_packer_alloc(ctx);
+    ctx->prefetch_packer = mp_ass_packer_alloc(ctx);
 
     return 0;
 }
@@ -241,12 +351,213 @@ static bool check_packet_seen(struct sd *sd, int64_t pos)
     return false;
 }
 
+static int cmp_ev_ref(const void *a, const void *b)
+{
+    const struct ev_ref *ea = a, *eb = b;
+    if (ea->start != eb->start)
+        return ea->start < eb->start ? -1 : 1;
+    return ea->index - eb->index;
+}
+
+static void update_ev_index(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    ASS_Track *track = ctx->ass_track;
+
+    int first = ctx->ev_index_invalid ? 0 : ctx->num_ev_index;
+    if (first > track->n_events)
+        first = 0;
+
+    MP_TARRAY_GROW(ctx, ctx->ev_index, track->n_events);
+    bool sorted = true;
+    for (int n = first; n < track->n_events; n++) {
+        ASS_Event *event = &track->events[n];
+        struct ev_ref *ref = &ctx->ev_index[n];
+        *ref = (struct ev_ref){
+            .start = event->Start,
+            .end = event->Start + event->Duration,
+            .index = n,
+        };
+        if (n > 0 && ref->start < ref[-1].start)
+            sorted = false;
+    }
+    ctx->num_ev_index = track->n_events;
+    ctx->ev_index_invalid = false;
+    if (first == ctx->num_ev_index)
+        return;
+
+    // Out of order events (e.g. in muxed files after seeking) need a full
+    // sort. Otherwise only the new entries need their max_end computed.
+    if (!sorted) {
+        qsort(ctx->ev_index, ctx->num_ev_index, sizeof(ctx->ev_index[0]),
+              cmp_ev_ref);
+        first = 0;
+    }
+    for (int n = first; n < ctx->num_ev_index; n++) {
+        struct ev_ref *ref = &ctx->ev_index[n];
+        ref->max_end = ref->end;
+        if (n > 0 && ref[-1].max_end > ref->max_end)
+            ref->max_end = ref[-1].max_end;
+    }
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+// Find all events with start <= hi and end > lo, and put their indexes (into
+// ass_track->events, in ascending order) into ctx->ev_found. Returns the
+// number of events found.
+static int find_events(struct sd *sd, long long lo, long long hi)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    if (ctx->ev_index_invalid || ctx->num_ev_index != ctx->ass_track->n_events)
+        update_ev_index(sd);
+
+    // First entry with start > hi.
+    int a = 0, b = ctx->num_ev_index;
+    while (a < b) {
+        int mid = a + (b - a) / 2;
+        if (ctx->ev_index[mid].start > hi) {
+            b = mid;
+        } else {
+            a = mid + 1;
+        }
+    }
+
+    ctx->num_ev_found = 0;
+    for (int n = a - 1; n >= 0 && ctx->ev_index[n].max_end > lo; n--) {
+        if (ctx->ev_index[n].end > lo) {
+            MP_TARRAY_APPEND(ctx, ctx->ev_found, ctx->num_ev_found,
+                             ctx->ev_index[n].index);
+        }
+    }
+    qsort(ctx->ev_found, ctx->num_ev_found, sizeof(ctx->ev_found[0]), cmp_int);
+    return ctx->num_ev_found;
+}
+
 #define UNKNOWN_DURATION (INT_MAX / 1000)
 
+// Add converted event lines to the track.
+static void add_converted(struct sd *sd, char **lines, int num_lines)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    ASS_Track *track = ctx->ass_track;
+
+    for (int n = 0; n < num_lines; n++) {
+        char *ass_line = lines[n];
+        if (sd->opts->sub_filter_SDH)
+            ass_line = filter_SDH(sd, track->event_format, 0, ass_line, 0);
+        if (ass_line)
+            ass_process_data(track, ass_line, strlen(ass_line));
+        if (sd->opts->sub_filter_SDH)
+            talloc_free(ass_line);
+    }
+    if (ctx->duration_unknown) {
+        ctx->ev_index_invalid = true;
+        for (int n = 0; n < track->n_events - 1; n++) {
+            if (track->events[n].Duration == UNKNOWN_DURATION * 1000) {
+                track->events[n].Duration = track->events[n + 1].Start -
+                                            track->events[n].Start;
+            }
+        }
+    }
+}
+
+// Runs on the worker thread.
+static void convert_fn(void *arg)
+{
+    struct sd *sd = arg;
+    struct sd_ass_priv *ctx = sd->priv;
+
+    pthread_mutex_lock(&ctx->conv_lock);
+    while (ctx->num_conv_in) {
+        struct demux_packet *pkt = ctx->conv_in[0];
+        MP_TARRAY_REMOVE_AT(ctx->conv_in, ctx->num_conv_in, 0);
+        pthread_mutex_unlock(&ctx->conv_lock);
+
+        char **r = lavc_conv_decode(ctx->converter, pkt);
+        talloc_free(pkt);
+
+        pthread_mutex_lock(&ctx->conv_lock);
+        for (int n = 0; r && r[n]; n++) {
+            MP_TARRAY_APPEND(NULL, ctx->conv_out, ctx->num_conv_out,
+                             talloc_strdup(NULL, r[n]));
+        }
+    }
+    ctx->conv_busy = false;
+    pthread_cond_broadcast(&ctx->conv_wakeup);
+    pthread_mutex_unlock(&ctx->conv_lock);
+}
+
+static void queue_conversion(struct sd *sd, struct demux_packet *packet)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    struct demux_packet *pkt = demux_copy_packet(packet);
+    if (!pkt)
+        return;
+
+    pthread_mutex_lock(&ctx->conv_lock);
+    MP_TARRAY_APPEND(NULL, ctx->conv_in, ctx->num_conv_in, pkt);
+    if (!ctx->conv_busy) {
+        ctx->conv_busy = true;
+        mp_thread_pool_queue(ctx->conv_pool, convert_fn, sd);
+    }
+    pthread_mutex_unlock(&ctx->conv_lock);
+}
+
+// Add the events converted so far to the track. If wait is set, wait until
+// all queued packets were converted first.
+static void update_converted(struct sd *sd, bool wait)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    if (!ctx->conv_pool)
+        return;
+
+    pthread_mutex_lock(&ctx->conv_lock);
+    while (wait && ctx->conv_busy)
+        pthread_cond_wait(&ctx->conv_wakeup, &ctx->conv_lock);
+    char **lines = ctx->conv_out;
+    int num_lines = ctx->num_conv_out;
+    ctx->conv_out = NULL;
+    ctx->num_conv_out = 0;
+    pthread_mutex_unlock(&ctx->conv_lock);
+
+    if (num_lines) {
+        cancel_prefetch(sd);
+        add_converted(sd, lines, num_lines);
+    }
+    for (int n = 0; n < num_lines; n++)
+        talloc_free(lines[n]);
+    talloc_free(lines);
+}
+
+// Wait for the worker, and drop everything that wasn't added to the track yet.
+static void reset_conversion(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    pthread_mutex_lock(&ctx->conv_lock);
+    for (int n = 0; n < ctx->num_conv_in; n++)
+        talloc_free(ctx->conv_in[n]);
+    ctx->num_conv_in = 0;
+    while (ctx->conv_busy)
+        pthread_cond_wait(&ctx->conv_wakeup, &ctx->conv_lock);
+    for (int n = 0; n < ctx->num_conv_out; n++)
+        talloc_free(ctx->conv_out[n]);
+    ctx->num_conv_out = 0;
+    pthread_mutex_unlock(&ctx->conv_lock);
+}
+
 static void decode(struct sd *sd, struct demux_packet *packet)
 {
     struct sd_ass_priv *ctx = sd->priv;
     ASS_Track *track = ctx->ass_track;
+
     if (ctx->converter) {
         if (!sd->opts->sub_clear_on_seek && packet->pos >= 0 &&
             check_packet_seen(sd, packet->pos))
@@ -258,25 +569,19 @@ static void decode(struct sd *sd, struct demux_packet *packet)
             }
             packet->duration = UNKNOWN_DURATION;
         }
-        char **r = lavc_conv_decode(ctx->converter, packet);
-        for (int n = 0; r && r[n]; n++) {
-            char *ass_line = r[n];
-            if (sd->opts->sub_filter_SDH)
-                ass_line = filter_SDH(sd, track->event_format, 0, ass_line, 0);
-            if (ass_line)
-                ass_process_data(track, ass_line, strlen(ass_line));
-            if (sd->opts->sub_filter_SDH)
-                talloc_free(ass_line);
-        }
-        if (ctx->duration_unknown) {
-            for (int n = 0; n < track->n_events - 1; n++) {
-                if (track->events[n].Duration == UNKNOWN_DURATION * 1000) {
-                    track->events[n].Duration = track->events[n + 1].Start -
-                                                track->events[n].Start;
-                }
-            }
+        if (ctx->conv_pool) {
+            queue_conversion(sd, packet);
+            update_converted(sd, false);
+            return;
         }
+        cancel_prefetch(sd);
+        char **r = lavc_conv_decode(ctx->converter, packet);
+        int num = 0;
+        while (r && r[num])
+            num++;
+        add_converted(sd, r, num);
     } else {
+        cancel_prefetch(sd);
         // Note that for this packet format, libass has an internal mechanism
         // for discarding duplicate (already seen) packets.
         char *ass_line = packet->buffer;
@@ -294,12 +599,11 @@ static void decode(struct sd *sd, struct demux_packet *packet)
     }
 }
 
-static void configure_ass(struct sd *sd, struct mp_osd_res *dim,
-                          bool converted, ASS_Track *track)
+static void configure_ass(struct sd *sd, ASS_Renderer *priv,
+                          struct mp_osd_res *dim, bool converted,
+                          ASS_Track *track)
 {
     struct MPOpts *opts = sd->opts;
-    struct sd_ass_priv *ctx = sd->priv;
-    ASS_Renderer *priv = ctx->ass_renderer;
 
     ass_set_frame_size(priv, dim->w, dim->h);
     ass_set_margins(priv, dim->mt, dim->mb, dim->ml, dim->mr);
@@ -396,19 +700,13 @@ static long long find_timestamp(struct sd *sd, double pts)
     int keep = SUB_GAP_KEEP * 1000;
 
     // Find the "current" event.
-    ASS_Event *ev[2] = {0};
-    int n_ev = 0;
-    for (int n = 0; n < track->n_events; n++) {
-        ASS_Event *event = &track->events[n];
-        if (ts >= event->Start - threshold && ts <= END(event) + threshold) {
-            if (n_ev >= MP_ARRAY_SIZE(ev))
-                return ts; // multiple overlaps - give up (probably complex subs)
-            ev[n_ev++] = event;
-        }
-    }
-
+    int n_ev = find_events(sd, ts - threshold - 1, ts + threshold);
     if (n_ev != 2)
-        return ts;
+        return ts; // multiple overlaps - give up (probably complex subs)
+    ASS_Event *ev[2] = {
+        &track->events[priv->ev_found[0]],
+        &track->events[priv->ev_found[1]],
+    };
 
     // Simple/minor heuristic against destroying typesetting.
     if (ev[0]->Style != ev[1]->Style || has_overrides(ev[0]->Text) ||
@@ -444,6 +742,95 @@ static long long find_timestamp(struct sd *sd, double pts)
 
 #undef END
 
+static void apply_render_params(struct sd *sd, ASS_Renderer *renderer,
+                                struct render_params *p)
+{
+    configure_ass(sd, renderer, &p->dim, p->converted, p->track);
+    ass_set_pixel_aspect(renderer, p->scale);
+    ass_set_storage_size(renderer, p->storage_w, p->storage_h);
+}
+
+static bool render_params_equal(struct render_params *a,
+                                struct render_params *b)
+{
+    return osd_res_equals(a->dim, b->dim) && a->format == b->format &&
+           a->converted == b->converted && a->track == b->track &&
+           a->scale == b->scale && a->storage_w == b->storage_w &&
+           a->storage_h == b->storage_h;
+}
+
+// Whether a and b contain the same images at the same positions.
+static bool sub_bitmaps_equal(struct sub_bitmaps *a, struct sub_bitmaps *b)
+{
+    if (a->format != b->format || a->num_parts != b->num_parts ||
+        a->packed_w != b->packed_w || a->packed_h != b->packed_h)
+        return false;
+    int bpp = a->format == SUBBITMAP_RGBA ? 4 : 1;
+    for (int n = 0; n < a->num_parts; n++) {
+        struct sub_bitmap *pa = &a->parts[n], *pb = &b->parts[n];
+        if (pa->x != pb->x || pa->y != pb->y || pa->w != pb->w ||
+            pa->h != pb->h || pa->dw != pb->dw || pa->dh != pb->dh ||
+            pa->src_x != pb->src_x || pa->src_y != pb->src_y ||
+            pa->libass.color != pb->libass.color)
+            return false;
+        for (int y = 0; y < pa->h; y++) {
+            if (memcmp((char *)pa->bitmap + y * pa->stride,
+                       (char *)pb->bitmap + y * pb->stride, pa->w * bpp))
+                return false;
+        }
+    }
+    return true;
+}
+
+// Runs on the worker thread.
+static void prefetch_fn(void *arg)
+{
+    struct sd *sd = arg;
+    struct sd_ass_priv *ctx = sd->priv;
+    struct render_params *p = &ctx->prefetch_params;
+
+    apply_render_params(sd, ctx->prefetch_renderer, p);
+    int changed;
+    ASS_Image *imgs = ass_render_frame(ctx->prefetch_renderer, p->track,
+                                       ctx->prefetch_ts, &changed);
+    mp_ass_packer_pack(ctx->prefetch_packer, &imgs, 1, changed, p->format,
+                       &ctx->prefetch_res);
+
+    pthread_mutex_lock(&ctx->prefetch_lock);
+    ctx->prefetch_valid = true;
+    ctx->prefetch_busy = false;
+    pthread_cond_signal(&ctx->prefetch_wakeup);
+    pthread_mutex_unlock(&ctx->prefetch_lock);
+}
+
+// Start rendering the frame after pts, predicted from the time between the
+// last two get_bitmaps() calls.
+static void start_prefetch(struct sd *sd, struct render_params *params,
+                           double pts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    double frame_time = pts - ctx->last_pts;
+    if (ctx->last_pts == MP_NOPTS_VALUE || frame_time <= 0 || frame_time > 1)
+        return;
+
+    ctx->prefetch_ts = find_timestamp(sd, pts + frame_time);
+    ctx->prefetch_params = *params;
+
+    pthread_mutex_lock(&ctx->prefetch_lock);
+    ctx->prefetch_busy = true;
+    pthread_mutex_unlock(&ctx->prefetch_lock);
+
+    mp_thread_pool_queue(ctx->prefetch_pool, prefetch_fn, sd);
+}
+
+// Format of the bitmaps returned by mp_ass_packer_pack().
+static int packed_format(int preferred_osd_format)
+{
+    return preferred_osd_format == SUBBITMAP_RGBA ? SUBBITMAP_RGBA
+                                                  : SUBBITMAP_LIBASS;
+}
+
 static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
                         double pts, struct sub_bitmaps *res)
 {
@@ -453,32 +840,38 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
                   opts->ass_style_override == 5;
     bool converted = ctx->is_converted || no_ass;
     ASS_Track *track = no_ass ? ctx->shadow_track : ctx->ass_track;
-    ASS_Renderer *renderer = ctx->ass_renderer;
 
-    if (pts == MP_NOPTS_VALUE || !renderer)
+    wait_prefetch(sd);
+    update_converted(sd, true);
+
+    if (pts == MP_NOPTS_VALUE || !ctx->ass_renderer)
         return;
 
-    double scale = dim.display_par;
+    struct render_params params = {
+        .dim = dim,
+        .format = format,
+        .converted = converted,
+        .track = track,
+        .scale = dim.display_par,
+    };
     if (!converted && (!opts->ass_style_override ||
                        opts->ass_vsfilter_aspect_compat))
     {
         // Let's use the original video PAR for vsfilter compatibility:
         double par = ctx->video_params.p_w / (double)ctx->video_params.p_h;
         if (isnormal(par))
-            scale *= par;
+            params.scale *= par;
     }
-    configure_ass(sd, &dim, converted, track);
-    ass_set_pixel_aspect(renderer, scale);
     if (!converted && (!opts->ass_style_override ||
                        opts->ass_vsfilter_blur_compat))
     {
-        ass_set_storage_size(renderer, ctx->video_params.w, ctx->video_params.h);
-    } else {
-        ass_set_storage_size(renderer, 0, 0);
+        params.storage_w = ctx->video_params.w;
+        params.storage_h = ctx->video_params.h;
     }
     long long ts = find_timestamp(sd, pts);
     if (ctx->duration_unknown && pts != MP_NOPTS_VALUE) {
         mp_ass_flush_old_events(track, ts);
+        ctx->ev_index_invalid = true;
         ctx->num_seen_packets = 0;
         sd->preload_ok = false;
     }
@@ -486,9 +879,36 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
     if (no_ass)
         fill_plaintext(sd, pts);
 
-    int changed;
-    ASS_Image *imgs = ass_render_frame(renderer, track, ts, &changed);
-    mp_ass_packer_pack(ctx->packer, &imgs, 1, changed, format, res);
+    if (ctx->prefetch_valid && ctx->prefetch_ts == ts &&
+        render_params_equal(&ctx->prefetch_params, &params))
+    {
+        MPSWAP(struct ass_renderer *, ctx->ass_renderer, ctx->prefetch_renderer);
+        MPSWAP(struct mp_ass_packer *, ctx->packer, ctx->prefetch_packer);
+        *res = ctx->prefetch_res;
+        // libass reported changes relative to the frame the prefetch renderer
+        // rendered before, not relative to the last returned frame.
+        res->change_id = sub_bitmaps_equal(res, &ctx->last_res) ? 0 : 2;
+    } else if (track == ctx->ass_track && ctx->last_res.format &&
+               ctx->last_res.format == packed_format(format) &&
+               ctx->last_res.num_parts == 0 && !find_events(sd, ts, ts))
+    {
+        // Nothing was visible before, and nothing is visible now. libass
+        // would render nothing, and report no change.
+        *res = ctx->last_res;
+        res->change_id = 0;
+    } else {
+        apply_render_params(sd, ctx->ass_renderer, &params);
+        int changed;
+        ASS_Image *imgs = ass_render_frame(ctx->ass_renderer, track, ts,
+                                           &changed);
+        mp_ass_packer_pack(ctx->packer, &imgs, 1, changed, format, res);
+    }
+    ctx->prefetch_valid = false;
+    ctx->last_res = *res;
+
+    if (ctx->prefetch_renderer && !no_ass && !ctx->duration_unknown)
+        start_prefetch(sd, &params, pts);
+    ctx->last_pts = pts;
 
     if (!converted && res->num_parts > 0) {
         // mangle_colors() modifies the color field, so copy the thing.
@@ -577,23 +997,25 @@ static char *get_text(struct sd *sd, double pts)
     struct sd_ass_priv *ctx = sd->priv;
     ASS_Track *track = ctx->ass_track;
 
+    wait_prefetch(sd);
+    update_converted(sd, true);
+
     if (pts == MP_NOPTS_VALUE)
         return NULL;
     long long ipts = find_timestamp(sd, pts);
 
     struct buf b = {ctx->last_text, sizeof(ctx->last_text) - 1};
 
-    for (int i = 0; i < track->n_events; ++i) {
-        ASS_Event *event = track->events + i;
-        if (ipts >= event->Start && ipts < event->Start + event->Duration) {
-            if (event->Text) {
-                int start = b.len;
-                ass_to_plaintext(&b, event->Text);
-                if (is_whitespace_only(&b.start[start], b.len - start)) {
-                    b.len = start;
-                } else {
-                    append(&b, '\n');
-                }
+    int num = find_events(sd, ipts, ipts);
+    for (int i = 0; i < num; ++i) {
+        ASS_Event *event = track->events + ctx->ev_found[i];
+        if (event->Text) {
+            int start = b.len;
+            ass_to_plaintext(&b, event->Text);
+            if (is_whitespace_only(&b.start[start], b.len - start)) {
+                b.len = start;
+            } else {
+                append(&b, '\n');
             }
         }
     }
@@ -606,6 +1028,33 @@ static char *get_text(struct sd *sd, double pts)
     return ctx->last_text;
 }
 
+static struct sd_times get_times(struct sd *sd, double pts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    ASS_Track *track = ctx->ass_track;
+    struct sd_times res = { .start = MP_NOPTS_VALUE, .end = MP_NOPTS_VALUE };
+
+    wait_prefetch(sd);
+    update_converted(sd, true);
+
+    if (pts == MP_NOPTS_VALUE)
+        return res;
+    long long ipts = find_timestamp(sd, pts);
+
+    int num = find_events(sd, ipts, ipts);
+    for (int i = 0; i < num; i++) {
+        ASS_Event *event = track->events + ctx->ev_found[i];
+        double start = event->Start / 1000.0 * ctx->sub_speed;
+        double end = (event->Start + event->Duration) / 1000.0 * ctx->sub_speed;
+        if (res.start == MP_NOPTS_VALUE || res.start > start)
+            res.start = start;
+        if (res.end == MP_NOPTS_VALUE || res.end < end)
+            res.end = end;
+    }
+
+    return res;
+}
+
 static void fill_plaintext(struct sd *sd, double pts)
 {
     struct sd_ass_priv *ctx = sd->priv;
@@ -648,8 +1097,12 @@ static void fill_plaintext(struct sd *sd, double pts)
 static void reset(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
+    cancel_prefetch(sd);
+    reset_conversion(sd);
+    ctx->last_pts = MP_NOPTS_VALUE;
     if (sd->opts->sub_clear_on_seek || ctx->duration_unknown) {
         ass_flush_events(ctx->ass_track);
+        ctx->ev_index_invalid = true;
         ctx->num_seen_packets = 0;
         sd->preload_ok = false;
     }
@@ -661,12 +1114,23 @@ static void uninit(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
 
+    talloc_free(ctx->prefetch_pool); // waits for the worker
+    ctx->prefetch_pool = NULL;
+    reset_conversion(sd);
+    talloc_free(ctx->conv_pool);
+    ctx->conv_pool = NULL;
+    talloc_free(ctx->conv_in);
+    talloc_free(ctx->conv_out);
     if (ctx->converter)
         lavc_conv_uninit(ctx->converter);
     ass_free_track(ctx->ass_track);
     ass_free_track(ctx->shadow_track);
     enable_output(sd, false);
     ass_library_done(ctx->ass_library);
+    pthread_mutex_destroy(&ctx->prefetch_lock);
+    pthread_cond_destroy(&ctx->prefetch_wakeup);
+    pthread_mutex_destroy(&ctx->conv_lock);
+    pthread_cond_destroy(&ctx->conv_wakeup);
 }
 
 static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
@@ -674,6 +1138,8 @@ static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
     struct sd_ass_priv *ctx = sd->priv;
     switch (cmd) {
     case SD_CTRL_SUB_STEP: {
+        wait_prefetch(sd);
+        update_converted(sd, true);
         double *a = arg;
         long long ts = llrint(a[0] * (1000.0 / ctx->sub_speed));
         long long res = ass_step_sub(ctx->ass_track, ts, a[1]);
@@ -707,6 +1173,7 @@ const struct sd_functions sd_ass = {
     .decode = decode,
     .get_bitmaps = get_bitmaps,
     .get_text = get_text,
+    .get_times = get_times,
     .control = control,
     .reset = reset,
     .select = enable_output,
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/common.h>
@@ -30,6 +31,7 @@
 #include "common/msg.h"
 #include "common/av_common.h"
 #include "demux/stheader.h"
+#include "misc/thread_pool.h"
 #include "options/options.h"
 #include "video/mp_image.h"
 #include "video/out/bitmap_packer.h"
@@ -43,7 +45,11 @@ struct sub {
     bool valid;
     AVSubtitle avsub;
     struct sub_bitmap *inbitmaps;
+    struct AVSubtitleRect **inrects; // source of each inbitmaps entry
     int count;
+    int padding, extend;            // as determined by read_sub_bitmaps()
+    bool gray;
+    float gauss;
     struct mp_image *data;
     int bound_w, bound_h;
     int src_w, src_h;
@@ -69,6 +75,15 @@ struct sd_lavc_priv {
     struct seekpoint *seekpoints;
     int num_seekpoints;
     struct bitmap_packer *packer;
+
+    // Converting the paletted bitmaps to RGBA (and blurring them) is done on
+    // convert_pool, so decoding returns as soon as the layout is known. Only
+    // 1 sub is converted at a time; the worker may access it until converting
+    // is reset to NULL.
+    struct mp_thread_pool *convert_pool;
+    pthread_mutex_t convert_lock;
+    pthread_cond_t convert_wakeup;
+    struct sub *converting;         // protected by convert_lock
 };
 
 static int init(struct sd *sd)
@@ -109,6 +124,9 @@ static int init(struct sd *sd)
     priv->displayed_id = -1;
     priv->current_pts = MP_NOPTS_VALUE;
     priv->packer = talloc_zero(priv, struct bitmap_packer);
+    pthread_mutex_init(&priv->convert_lock, NULL);
+    pthread_cond_init(&priv->convert_wakeup, NULL);
+    priv->convert_pool = mp_thread_pool_create(priv, 1);
     return 0;
 
  error:
@@ -118,6 +136,15 @@ static int init(struct sd *sd)
     return -1;
 }
 
+// Wait until the worker is done with sub (or with any sub if sub==NULL).
+static void wait_convert(struct sd_lavc_priv *priv, struct sub *sub)
+{
+    pthread_mutex_lock(&priv->convert_lock);
+    while (priv->converting && (!sub || priv->converting == sub))
+        pthread_cond_wait(&priv->convert_wakeup, &priv->convert_lock);
+    pthread_mutex_unlock(&priv->convert_lock);
+}
+
 static void clear_sub(struct sub *sub)
 {
     sub->count = 0;
@@ -161,7 +188,67 @@ static void convert_pal(uint32_t *colors, size_t count, bool gray)
     }
 }
 
-// Initialize sub from sub->avsub.
+// Write the RGBA data for the bitmaps laid out by read_sub_bitmaps().
+// Runs on the worker thread if possible.
+static void convert_sub_bitmaps(struct sub *sub)
+{
+    int padding = sub->padding;
+    int extend = sub->extend;
+
+    for (int i = 0; i < sub->count; i++) {
+        struct sub_bitmap *b = &sub->inbitmaps[i];
+        struct AVSubtitleRect *r = sub->inrects[i];
+        uint8_t **data = r->data;
+        int *linesize = r->linesize;
+
+        assert(r->nb_colors > 0);
+        assert(r->nb_colors <= 256);
+        uint32_t pal[256] = {0};
+        memcpy(pal, data[1], r->nb_colors * 4);
+        convert_pal(pal, 256, sub->gray);
+
+        for (int y = -padding; y < b->h + padding; y++) {
+            uint32_t *out = (uint32_t*)((char*)b->bitmap + y * b->stride);
+            int start = 0;
+            for (int x = -padding; x < 0; x++)
+                out[x] = 0;
+            if (y >= 0 && y < b->h) {
+                uint8_t *in = data[0] + y * linesize[0];
+                for (int x = 0; x < b->w; x++)
+                    *out++ = pal[*in++];
+                start = b->w;
+            }
+            for (int x = start; x < b->w + padding; x++)
+                *out++ = 0;
+        }
+
+        b->bitmap = (char*)b->bitmap - extend * b->stride - extend * 4;
+        b->src_x -= extend;
+        b->src_y -= extend;
+        b->x -= extend;
+        b->y -= extend;
+        b->w += extend * 2;
+        b->h += extend * 2;
+
+        if (sub->gauss != 0.0f)
+            mp_blur_rgba_sub_bitmap(b, sub->gauss);
+    }
+}
+
+static void convert_fn(void *arg)
+{
+    struct sd_lavc_priv *priv = arg;
+
+    convert_sub_bitmaps(priv->converting);
+
+    pthread_mutex_lock(&priv->convert_lock);
+    priv->converting = NULL;
+    pthread_cond_broadcast(&priv->convert_wakeup);
+    pthread_mutex_unlock(&priv->convert_lock);
+}
+
+// Initialize sub from sub->avsub. This only computes the layout; the bitmap
+// data is written by convert_sub_bitmaps().
 static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
 {
     struct MPOpts *opts = sd->opts;
@@ -169,6 +256,7 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
     AVSubtitle *avsub = &sub->avsub;
 
     MP_TARRAY_GROW(priv, sub->inbitmaps, avsub->num_rects);
+    MP_TARRAY_GROW(priv, sub->inrects, avsub->num_rects);
 
     packer_set_size(priv->packer, avsub->num_rects);
 
@@ -181,13 +269,17 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
 
     priv->packer->padding = padding;
 
+    sub->padding = padding;
+    sub->extend = extend;
+    sub->gray = opts->sub_gray;
+    sub->gauss = opts->sub_gauss;
+
     // For the sake of libswscale, which in some cases takes sub-rects as
     // source images, and wants 16 byte start pointer and stride alignment.
     int align = 4;
 
     for (int i = 0; i < avsub->num_rects; i++) {
         struct AVSubtitleRect *r = avsub->rects[i];
-        struct sub_bitmap *b = &sub->inbitmaps[sub->count];
 
         if (r->type != SUBTITLE_BITMAP) {
             MP_ERR(sd, "unsupported subtitle type from libavcodec\n");
@@ -198,7 +290,7 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
         if (r->w <= 0 || r->h <= 0)
             continue;
 
-        b->bitmap = r; // save for later (dumb hack to avoid more complexity)
+        sub->inrects[sub->count] = r;
 
         priv->packer->in[sub->count] = (struct pos){r->w + (align - 1), r->h};
         sub->count++;
@@ -233,9 +325,7 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
     for (int i = 0; i < sub->count; i++) {
         struct sub_bitmap *b = &sub->inbitmaps[i];
         struct pos pos = priv->packer->result[i];
-        struct AVSubtitleRect *r = b->bitmap;
-        uint8_t **data = r->data;
-        int *linesize = r->linesize;
+        struct AVSubtitleRect *r = sub->inrects[i];
         b->w = r->w;
         b->h = r->h;
         b->x = r->x;
@@ -251,38 +341,15 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
 
         sub->src_w = FFMAX(sub->src_w, b->x + b->w);
         sub->src_h = FFMAX(sub->src_h, b->y + b->h);
+    }
 
-        assert(r->nb_colors > 0);
-        assert(r->nb_colors <= 256);
-        uint32_t pal[256] = {0};
-        memcpy(pal, data[1], r->nb_colors * 4);
-        convert_pal(pal, 256, opts->sub_gray);
-
-        for (int y = -padding; y < b->h + padding; y++) {
-            uint32_t *out = (uint32_t*)((char*)b->bitmap + y * b->stride);
-            int start = 0;
-            for (int x = -padding; x < 0; x++)
-                out[x] = 0;
-            if (y >= 0 && y < b->h) {
-                uint8_t *in = data[0] + y * linesize[0];
-                for (int x = 0; x < b->w; x++)
-                    *out++ = pal[*in++];
-                start = b->w;
-            }
-            for (int x = start; x < b->w + padding; x++)
-                *out++ = 0;
-        }
-
-        b->bitmap = (char*)b->bitmap - extend * b->stride - extend * 4;
-        b->src_x -= extend;
-        b->src_y -= extend;
-        b->x -= extend;
-        b->y -= extend;
-        b->w += extend * 2;
-        b->h += extend * 2;
-
-        if (apply_blur)
-            mp_blur_rgba_sub_bitmap(b, opts->sub_gauss);
+    if (priv->convert_pool) {
+        pthread_mutex_lock(&priv->convert_lock);
+        priv->converting = sub;
+        pthread_mutex_unlock(&priv->convert_lock);
+        mp_thread_pool_queue(priv->convert_pool, convert_fn, priv);
+    } else {
+        convert_sub_bitmaps(sub);
     }
 }
 
@@ -321,6 +388,9 @@ static void decode(struct sd *sd, struct demux_packet *packet)
     if (res < 0 || !got_sub)
         return;
 
+    // The previous sub might still be converted, and is modified below.
+    wait_convert(priv, NULL);
+
     if (sub.pts != AV_NOPTS_VALUE)
         pts = sub.pts / (double)AV_TIME_BASE;
 
@@ -410,6 +480,8 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res d, int format,
     if (!current)
         return;
 
+    wait_convert(priv, current);
+
     MP_TARRAY_GROW(priv, priv->outbitmaps, current->count);
     for (int n = 0; n < current->count; n++)
         priv->outbitmaps[n] = current->inbitmaps[n];
@@ -486,6 +558,7 @@ static void reset(struct sd *sd)
 {
     struct sd_lavc_priv *priv = sd->priv;
 
+    wait_convert(priv, NULL);
     for (int n = 0; n < MAX_QUEUE; n++)
         clear_sub(&priv->subs[n]);
     // lavc might not do this right for all codecs; may need close+reopen
@@ -498,9 +571,13 @@ static void uninit(struct sd *sd)
 {
     struct sd_lavc_priv *priv = sd->priv;
 
+    talloc_free(priv->convert_pool); // waits for the worker
+    priv->convert_pool = NULL;
     for (int n = 0; n < MAX_QUEUE; n++)
         clear_sub(&priv->subs[n]);
     avcodec_free_context(&priv->avctx);
+    pthread_mutex_destroy(&priv->convert_lock);
+    pthread_cond_destroy(&priv->convert_wakeup);
     talloc_free(priv);
 }
 
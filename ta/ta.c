@@ -64,12 +64,38 @@ struct ta_ext_header {
     struct ta_header *header;  // points back to normal header
     struct ta_header children; // list of children, with this as sentinel
     void (*destructor)(void *);
+    struct ta_arena *arena;    // set if this is an arena (see ta_new_arena())
 };
 
 // ta_ext_header.children.size is set to this
 #define CHILDREN_SENTINEL ((size_t)-1)
 
+// Allocations made from an arena are not linked into any list. They are marked
+// by next==NULL and prev pointing to the children sentinel of the arena (which
+// can't happen for normal allocations, where both are set or both are NULL).
+#define IS_ARENA_ALLOC(h) (!(h)->next && (h)->prev)
+#define ARENA_OF(h) ((h)->prev->ext->arena)
+
+#define ARENA_BLOCK_SIZE 4096
+
+struct ta_arena_block {
+    struct ta_arena_block *next;
+};
+
+// Note: this is the user allocation of the arena's ta context.
+struct ta_arena {
+    struct ta_ext_header *ext;  // of the arena's ta context
+    struct ta_arena_block *blocks;
+    char *pos;                  // free space in the current block
+    size_t avail;
+};
+
+#define ARENA_BLOCK_HEADER sizeof(union aligned_header)
+#define ALIGN_SIZE(s) (((s) + MIN_ALIGN - 1) & ~(size_t)(MIN_ALIGN - 1))
+
+static struct ta_arena *get_arena(struct ta_header *h);
 static void ta_dbg_add(struct ta_header *h);
+static void ta_dbg_add_arena(struct ta_header *h);
 static void ta_dbg_check_header(struct ta_header *h);
 static void ta_dbg_remove(struct ta_header *h);
 
@@ -83,7 +109,7 @@ static struct ta_header *get_header(void *ptr)
 static struct ta_ext_header *get_or_alloc_ext_header(void *ptr)
 {
     struct ta_header *h = get_header(ptr);
-    if (!h)
+    if (!h || IS_ARENA_ALLOC(h))
         return NULL;
     if (!h->ext) {
         h->ext = malloc(sizeof(struct ta_ext_header));
@@ -117,6 +143,17 @@ bool ta_set_parent(void *ptr, void *ta_parent)
     struct ta_header *ch = get_header(ptr);
     if (!ch)
         return true;
+    struct ta_header *ph = get_header(ta_parent);
+    if (IS_ARENA_ALLOC(ch)) {
+        // Arena memory can't be moved out of the arena.
+        if (!ph || get_arena(ph) != ARENA_OF(ch))
+            abort();
+        return true;
+    }
+    // Arena allocations can't have children; use the arena itself instead,
+    // which lives at least as long.
+    if (ph && IS_ARENA_ALLOC(ph))
+        ta_parent = PTR_FROM_HEADER(ARENA_OF(ph)->ext->header);
     struct ta_ext_header *parent_eh = get_or_alloc_ext_header(ta_parent);
     if (ta_parent && !parent_eh) // do nothing on OOM
         return false;
@@ -137,6 +174,76 @@ bool ta_set_parent(void *ptr, void *ta_parent)
     return true;
 }
 
+static struct ta_arena *get_arena(struct ta_header *h)
+{
+    if (!h)
+        return NULL;
+    if (IS_ARENA_ALLOC(h))
+        return ARENA_OF(h);
+    return h->ext ? h->ext->arena : NULL;
+}
+
+static void *arena_alloc(struct ta_arena *arena, size_t size)
+{
+    size_t need = sizeof(union aligned_header) + ALIGN_SIZE(size);
+    if (need > arena->avail) {
+        size_t bsize = ARENA_BLOCK_HEADER + need;
+        if (bsize < ARENA_BLOCK_SIZE)
+            bsize = ARENA_BLOCK_SIZE;
+        struct ta_arena_block *b = malloc(bsize);
+        if (!b)
+            return NULL;
+        b->next = arena->blocks;
+        arena->blocks = b;
+        arena->pos = (char *)b + ARENA_BLOCK_HEADER;
+        arena->avail = bsize - ARENA_BLOCK_HEADER;
+    }
+    struct ta_header *h = (struct ta_header *)arena->pos;
+    arena->pos += need;
+    arena->avail -= need;
+    *h = (struct ta_header) {.size = size, .prev = &arena->ext->children};
+    ta_dbg_add_arena(h);
+    return PTR_FROM_HEADER(h);
+}
+
+static void arena_free_blocks(struct ta_arena *arena)
+{
+    while (arena->blocks) {
+        struct ta_arena_block *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    arena->pos = NULL;
+    arena->avail = 0;
+}
+
+/* Create a ta context for short-lived trees of small allocations. Allocations
+ * that have the arena or any allocation made from it as parent are carved from
+ * large blocks instead of being malloc'ed individually. Their memory is
+ * released only when the arena is freed, or ta_free_children() is called on
+ * it. ta_free() on them runs no code, and ta_realloc_size() copies them.
+ *
+ * Restrictions for allocations made from an arena: they can't have a
+ * destructor, ta_find_parent() returns NULL, and they can't be moved out of
+ * the arena with ta_set_parent() (this aborts). Normal allocations can still
+ * use them as parent; they are attached to the arena context in this case.
+ *
+ * Returns NULL on OOM.
+ */
+void *ta_new_arena(void *ta_parent)
+{
+    struct ta_arena *arena = ta_zalloc_size(ta_parent, sizeof(*arena));
+    if (!arena)
+        return NULL;
+    arena->ext = get_or_alloc_ext_header(arena);
+    if (!arena->ext) {
+        ta_free(arena);
+        return NULL;
+    }
+    arena->ext->arena = arena;
+    return arena;
+}
+
 /* Allocate size bytes of memory. If ta_parent is not NULL, this is used as
  * parent allocation (if ta_parent is freed, this allocation is automatically
  * freed as well). size==0 allocates a block of size 0 (i.e. returns non-NULL).
@@ -146,6 +253,9 @@ void *ta_alloc_size(void *ta_parent, size_t size)
 {
     if (size >= MAX_ALLOC)
         return NULL;
+    struct ta_arena *arena = get_arena(get_header(ta_parent));
+    if (arena)
+        return arena_alloc(arena, size);
     struct ta_header *h = malloc(sizeof(union aligned_header) + size);
     if (!h)
         return NULL;
@@ -166,6 +276,13 @@ void *ta_zalloc_size(void *ta_parent, size_t size)
 {
     if (size >= MAX_ALLOC)
         return NULL;
+    struct ta_arena *arena = get_arena(get_header(ta_parent));
+    if (arena) {
+        void *ptr = arena_alloc(arena, size);
+        if (ptr)
+            memset(ptr, 0, size);
+        return ptr;
+    }
     struct ta_header *h = calloc(1, sizeof(union aligned_header) + size);
     if (!h)
         return NULL;
@@ -205,6 +322,16 @@ void *ta_realloc_size(void *ta_parent, void *ptr, size_t size)
     struct ta_header *old_h = h;
     if (h->size == size)
         return ptr;
+    if (IS_ARENA_ALLOC(h)) {
+        if (size < h->size) {
+            h->size = size;
+            return ptr;
+        }
+        void *nptr = arena_alloc(ARENA_OF(h), size);
+        if (nptr)
+            memcpy(nptr, ptr, h->size);
+        return nptr;
+    }
     ta_dbg_remove(h);
     h = realloc(h, sizeof(union aligned_header) + size);
     ta_dbg_add(h ? h : old_h);
@@ -248,6 +375,8 @@ void ta_free_children(void *ptr)
         return;
     while (eh->children.next != &eh->children)
         ta_free(PTR_FROM_HEADER(eh->children.next));
+    if (eh->arena)
+        arena_free_blocks(eh->arena);
 }
 
 /* Free the given allocation, and all of its direct and indirect children.
@@ -255,7 +384,7 @@ void ta_free_children(void *ptr)
 void ta_free(void *ptr)
 {
     struct ta_header *h = get_header(ptr);
-    if (!h)
+    if (!h || IS_ARENA_ALLOC(h))
         return;
     if (h->ext && h->ext->destructor)
         h->ext->destructor(ptr);
@@ -329,6 +458,12 @@ static void ta_dbg_add(struct ta_header *h)
     }
 }
 
+// Arena allocations are not tracked individually; the arena itself is.
+static void ta_dbg_add_arena(struct ta_header *h)
+{
+    h->canary = CANARY;
+}
+
 static void ta_dbg_check_header(struct ta_header *h)
 {
     if (h)
@@ -436,6 +571,7 @@ void *ta_dbg_mark_as_string(void *ptr)
 #else
 
 static void ta_dbg_add(struct ta_header *h){}
+static void ta_dbg_add_arena(struct ta_header *h){}
 static void ta_dbg_check_header(struct ta_header *h){}
 static void ta_dbg_remove(struct ta_header *h){}
 
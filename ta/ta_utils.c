@@ -52,9 +52,11 @@ static void dummy_dtor(void *p){}
  */
 void *ta_new_context(void *ta_parent)
 {
-    void *new = ta_alloc_size(ta_parent, 0);
+    // Not allocated from ta_parent directly, because arena allocations can't
+    // have an extended header.
+    void *new = ta_alloc_size(NULL, 0);
     // Force it to allocate an extended header.
-    if (!ta_set_destructor(new, dummy_dtor)) {
+    if (!ta_set_destructor(new, dummy_dtor) || !ta_set_parent(new, ta_parent)) {
         ta_free(new);
         new = NULL;
     }
@@ -136,12 +138,14 @@ char *ta_strndup(void *ta_parent, const char *str, size_t n)
 {
     if (!str)
         return NULL;
-    char *new = NULL;
-    strndup_append_at(&new, 0, str, n);
-    if (!ta_set_parent(new, ta_parent)) {
-        ta_free(new);
-        new = NULL;
-    }
+    n = strnlen(str, n);
+    // Allocated from ta_parent directly, so that it can come from an arena.
+    char *new = ta_alloc_size(ta_parent, n + 1);
+    if (!new)
+        return NULL;
+    memcpy(new, str, n);
+    new[n] = '\0';
+    ta_dbg_mark_as_string(new);
     return new;
 }
 
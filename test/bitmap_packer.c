@@ -0,0 +1,80 @@
+#include "test_helpers.h"
+#include "common/common.h"
+#include "mpv_talloc.h"
+#include "video/out/bitmap_packer.h"
+
+static bool overlaps(struct pos a, struct pos as, struct pos b, struct pos bs)
+{
+    return a.x < b.x + bs.x && b.x < a.x + as.x &&
+           a.y < b.y + bs.y && b.y < a.y + as.y;
+}
+
+static void check_packing(struct bitmap_packer *p, struct pos *sizes, int num)
+{
+    assert_true(p->used_width <= p->w && p->used_height <= p->h);
+    for (int i = 0; i < num; i++) {
+        struct pos a = p->result[i];
+        assert_true(a.x >= 0 && a.y >= 0);
+        assert_true(a.x + sizes[i].x <= p->used_width);
+        assert_true(a.y + sizes[i].y <= p->used_height);
+        for (int j = 0; j < i; j++)
+            assert_false(overlaps(a, sizes[i], p->result[j], sizes[j]));
+    }
+}
+
+static void test_pack(void **state) {
+    struct bitmap_packer *p = talloc_zero(NULL, struct bitmap_packer);
+    struct pos sizes[200];
+    int num = MP_ARRAY_SIZE(sizes);
+
+    packer_set_size(p, num);
+    for (int i = 0; i < num; i++) {
+        sizes[i] = (struct pos){1 + (i * 37) % 61, 1 + (i * 53) % 29};
+        p->in[i] = sizes[i];
+    }
+    assert_true(packer_pack(p) >= 0);
+    check_packing(p, sizes, num);
+
+    talloc_free(p);
+}
+
+static void test_pack_reuse(void **state) {
+    struct bitmap_packer *p = talloc_zero(NULL, struct bitmap_packer);
+    struct pos sizes[] = {{10, 20}, {30, 5}, {7, 7}, {40, 12}};
+    int num = MP_ARRAY_SIZE(sizes);
+
+    packer_set_size(p, num);
+    for (int i = 0; i < num; i++)
+        p->in[i] = sizes[i];
+    assert_true(packer_pack(p) >= 0);
+    check_packing(p, sizes, num);
+
+    // Same sizes: the layout must not change.
+    struct pos old[MP_ARRAY_SIZE(sizes)];
+    for (int i = 0; i < num; i++) {
+        old[i] = p->result[i];
+        p->in[i] = sizes[i];
+    }
+    assert_int_equal(packer_pack(p), 0);
+    for (int i = 0; i < num; i++) {
+        assert_int_equal(p->result[i].x, old[i].x);
+        assert_int_equal(p->result[i].y, old[i].y);
+    }
+
+    // Different sizes: repack.
+    sizes[2] = (struct pos){50, 3};
+    for (int i = 0; i < num; i++)
+        p->in[i] = sizes[i];
+    assert_true(packer_pack(p) >= 0);
+    check_packing(p, sizes, num);
+
+    talloc_free(p);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_pack),
+        cmocka_unit_test(test_pack_reuse),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,120 @@
+// Demuxer throughput benchmark. Opens each file given on the command line,
+// selects all streams, and reads all packets as fast as possible. Then it
+// seeks to a fixed sequence of positions and measures the time until the
+// first packet arrives after each seek.
+//
+//  test/demux_bench [-s SEEKS] file...
+//
+// Run it on a corpus of files (mkv, mp4, ts, ogg, ...) with builds to compare.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/av_log.h"
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/msg_control.h"
+#include "common/perf.h"
+#include "demux/demux.h"
+#include "demux/packet.h"
+#include "demux/stheader.h"
+#include "mpv_talloc.h"
+#include "options/m_config.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+
+static bool bench_file(struct mpv_global *global, const char *url, int seeks)
+{
+    int64_t t_open = mp_time_us();
+    struct demuxer *d = demux_open_url(url, NULL, NULL, global);
+    if (!d) {
+        printf("%s: could not open\n", url);
+        return false;
+    }
+    int64_t t_start = mp_time_us();
+
+    for (int n = 0; n < demux_get_num_stream(d); n++)
+        demuxer_select_track(d, demux_get_stream(d, n), MP_NOPTS_VALUE, true);
+
+    int64_t packets = 0, bytes = 0;
+    while (1) {
+        struct demux_packet *pkt = demux_read_any_packet(d);
+        if (!pkt)
+            break;
+        packets += 1;
+        bytes += pkt->len;
+        talloc_free(pkt);
+    }
+    double secs = (mp_time_us() - t_start) / 1e6;
+
+    printf("%s: %s, open %.2f ms, %"PRId64" packets, %"PRId64" bytes, "
+           "%.3f s, %.0f packets/s, %.2f MiB/s\n", url, d->desc->name,
+           (t_start - t_open) / 1e3, packets, bytes, secs,
+           secs > 0 ? packets / secs : 0,
+           secs > 0 ? bytes / secs / (1024 * 1024) : 0);
+
+    if (seeks > 0 && d->seekable) {
+        double total = 0, max = 0;
+        int done = 0;
+        for (int n = 0; n < seeks; n++) {
+            // Deterministic positions spread over the file.
+            double pos = ((n * 7919) % seeks + 0.5) / seeks;
+            int64_t t = mp_time_us();
+            if (!demux_seek(d, pos, SEEK_FACTOR))
+                continue;
+            struct demux_packet *pkt = demux_read_any_packet(d);
+            double ms = (mp_time_us() - t) / 1e3;
+            talloc_free(pkt);
+            total += ms;
+            max = MPMAX(max, ms);
+            done++;
+        }
+        printf("%s: %d seeks, avg %.2f ms, max %.2f ms\n", url, done,
+               done ? total / done : 0, max);
+    }
+
+    free_demuxer_and_stream(d);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int seeks = 20;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+        seeks = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc) {
+        fprintf(stderr, "Usage: %s [-s SEEKS] file...\n", argv[0]);
+        return 2;
+    }
+
+    mp_time_init();
+
+    void *tmp = talloc_new(NULL);
+    struct mpv_global *global = talloc_zero(tmp, struct mpv_global);
+    global->perf = mp_perf_create(global);
+    mp_msg_init(global);
+    struct mp_log *log = mp_log_new(tmp, global->log, "demux_bench");
+
+    struct m_config *config = m_config_new(tmp, log, sizeof(struct MPOpts),
+                                           &mp_default_opts, mp_opts);
+    config->global = global;
+    m_config_create_shadow(config);
+    global->opts = config->optstruct;
+    init_libav(global);
+
+    bool ok = true;
+    for (int n = first; n < argc; n++)
+        ok &= bench_file(global, argv[n], seeks);
+
+    uninit_libav(global);
+    talloc_free(config);
+    mp_msg_uninit(global);
+    talloc_free(tmp);
+    return ok ? 0 : 1;
+}
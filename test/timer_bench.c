@@ -0,0 +1,66 @@
+// Timer overhead benchmark. Measures the cost of mp_time_us() (and the raw
+// clock below it) when called in a tight loop, and reports the kernel clock
+// source on Linux. With the "tsc" clock source, clock_gettime() is handled in
+// the vDSO and costs some tens of nanoseconds; with others (hpet, acpi_pm,
+// common in VMs and on some boards) every call is a real syscall.
+//
+//  test/timer_bench [iterations]
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "osdep/timer.h"
+
+static volatile uint64_t sink;
+
+static void print_clocksource(void)
+{
+    FILE *f = fopen("/sys/devices/system/clocksource/clocksource0/"
+                    "current_clocksource", "r");
+    if (!f)
+        return;
+    char buf[64] = {0};
+    if (fgets(buf, sizeof(buf), f)) {
+        buf[strcspn(buf, "\n")] = '\0';
+        printf("clock source: %s\n", buf);
+    }
+    fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    int64_t iterations = argc > 1 ? atoll(argv[1]) : 10000000;
+    if (iterations < 1) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 2;
+    }
+
+    mp_time_init();
+    print_clocksource();
+
+    // Accumulate the results, so the calls can't be optimized away.
+    uint64_t sum = 0;
+
+    int64_t start = mp_time_us();
+    for (int64_t n = 0; n < iterations; n++)
+        sum += mp_raw_time_us();
+    int64_t raw = mp_time_us() - start;
+
+    start = mp_time_us();
+    for (int64_t n = 0; n < iterations; n++)
+        sum += mp_time_us();
+    int64_t wrapped = mp_time_us() - start;
+
+    // Smallest observable step, i.e. the effective resolution.
+    int64_t t0 = mp_time_us(), t1;
+    while ((t1 = mp_time_us()) == t0)
+        sum++;
+    sink = sum;
+
+    printf("mp_raw_time_us: %.1f ns/call\n", raw * 1000.0 / iterations);
+    printf("mp_time_us:     %.1f ns/call\n", wrapped * 1000.0 / iterations);
+    printf("resolution:     %"PRId64" us\n", t1 - t0);
+    return 0;
+}
@@ -27,12 +27,14 @@
 #include "common/msg.h"
 
 #include "osdep/timer.h"
+#include "misc/dec_thread.h"
 
 #include "stream/stream.h"
 #include "demux/demux.h"
 #include "demux/packet.h"
 
 #include "common/codecs.h"
+#include "common/perf.h"
 #include "common/recorder.h"
 
 #include "video/out/vo.h"
@@ -57,9 +59,17 @@ const vd_functions_t * const mpcodecs_vd_drivers[] = {
     NULL
 };
 
-void video_reset(struct dec_video *d_video)
+static int vd_control(struct dec_video *d_video, int cmd, void *arg)
 {
-    video_vd_control(d_video, VDCTRL_RESET, NULL);
+    const struct vd_functions *vd = d_video->vd_driver;
+    if (vd)
+        return vd->control(d_video, cmd, arg);
+    return CONTROL_UNKNOWN;
+}
+
+static void reset_decoder(struct dec_video *d_video)
+{
+    vd_control(d_video, VDCTRL_RESET, NULL);
     d_video->first_packet_pdts = MP_NOPTS_VALUE;
     d_video->start_pts = MP_NOPTS_VALUE;
     d_video->decoded_pts = MP_NOPTS_VALUE;
@@ -75,20 +85,41 @@ void video_reset(struct dec_video *d_video)
     talloc_free(d_video->new_segment);
     d_video->new_segment = NULL;
     d_video->start = d_video->end = MP_NOPTS_VALUE;
+    d_video->wait_keyframe = false;
+}
+
+void video_reset(struct dec_video *d_video)
+{
+    if (d_video->thread)
+        mp_dec_thread_stop(d_video->thread);
+    reset_decoder(d_video);
 }
 
 int video_vd_control(struct dec_video *d_video, int cmd, void *arg)
 {
-    const struct vd_functions *vd = d_video->vd_driver;
-    if (vd)
-        return vd->control(d_video, cmd, arg);
-    return CONTROL_UNKNOWN;
+    if (!d_video->thread)
+        return vd_control(d_video, cmd, arg);
+
+    // Frames queued by the thread were decoded with the old settings.
+    if (cmd == VDCTRL_REINIT || cmd == VDCTRL_FORCE_HWDEC_FALLBACK) {
+        mp_dec_thread_stop(d_video->thread);
+        return vd_control(d_video, cmd, arg);
+    }
+
+    mp_dec_thread_lock(d_video->thread);
+    int r = vd_control(d_video, cmd, arg);
+    mp_dec_thread_unlock(d_video->thread);
+    return r;
 }
 
 void video_uninit(struct dec_video *d_video)
 {
     if (!d_video)
         return;
+    if (d_video->thread) {
+        talloc_free(d_video->thread);
+        pthread_mutex_destroy(&d_video->thread_lock);
+    }
     mp_image_unrefp(&d_video->current_mpi);
     if (d_video->vd_driver) {
         MP_VERBOSE(d_video, "Uninit video.\n");
@@ -140,9 +171,11 @@ bool video_init_best_codec(struct dec_video *d_video)
     struct MPOpts *opts = d_video->opts;
 
     assert(!d_video->vd_driver);
-    video_reset(d_video);
+    reset_decoder(d_video);
     d_video->has_broken_packet_pts = -10; // needs 10 packets to reach decision
 
+    MP_STATS(d_video, "start video decoder init");
+
     struct mp_decoder_entry *decoder = NULL;
     struct mp_decoder_list *list = mp_select_video_decoders(d_video->log,
                                                             d_video->codec->codec,
@@ -180,6 +213,7 @@ bool video_init_best_codec(struct dec_video *d_video)
         MP_WARN(d_video, "Seeking will probably fail badly.\n");
     }
 
+    MP_STATS(d_video, "end video decoder init");
     talloc_free(list);
     return !!d_video->vd_driver;
 }
@@ -276,9 +310,11 @@ static bool send_packet(struct dec_video *d_video, struct demux_packet *packet)
         d_video->first_packet_pdts = pkt_pdts;
 
     MP_STATS(d_video, "start decode video");
+    int64_t t0 = mp_time_us();
 
     bool res = d_video->vd_driver->send_packet(d_video, packet);
 
+    mp_perf_time(d_video->global, MP_PERF_VIDEO_DECODE, mp_time_us() - t0);
     MP_STATS(d_video, "end decode video");
 
     // Stream recording can't deal with almost surely wrong fake DTS.
@@ -296,9 +332,11 @@ static bool receive_frame(struct dec_video *d_video, struct mp_image **out_image
     assert(!*out_image);
 
     MP_STATS(d_video, "start decode video");
+    int64_t t0 = mp_time_us();
 
     bool progress = d_video->vd_driver->receive_frame(d_video, &mpi);
 
+    mp_perf_time(d_video->global, MP_PERF_VIDEO_DECODE, mp_time_us() - t0);
     MP_STATS(d_video, "end decode video");
 
     // Error, EOF, discarded frame, dropped frame, or initial codec delay.
@@ -364,7 +402,7 @@ static bool receive_frame(struct dec_video *d_video, struct mp_image **out_image
         mpi->pts != MP_NOPTS_VALUE && d_video->fps > 0)
     {
         int delay = -1;
-        video_vd_control(d_video, VDCTRL_GET_BFRAMES, &delay);
+        vd_control(d_video, VDCTRL_GET_BFRAMES, &delay);
         mpi->pts -= MPMAX(delay, 0) / d_video->fps;
     }
 
@@ -372,25 +410,73 @@ static bool receive_frame(struct dec_video *d_video, struct mp_image **out_image
     return true;
 }
 
+static void lock_decoder(struct dec_video *d_video)
+{
+    if (d_video->thread)
+        mp_dec_thread_lock(d_video->thread);
+}
+
+static void unlock_decoder(struct dec_video *d_video)
+{
+    if (d_video->thread)
+        mp_dec_thread_unlock(d_video->thread);
+}
+
 void video_reset_params(struct dec_video *d_video)
 {
+    lock_decoder(d_video);
     d_video->last_format = (struct mp_image_params){0};
+    unlock_decoder(d_video);
 }
 
 void video_get_dec_params(struct dec_video *d_video, struct mp_image_params *p)
 {
+    lock_decoder(d_video);
     *p = d_video->dec_format;
+    unlock_decoder(d_video);
+}
+
+void video_set_recorder_sink(struct dec_video *d_video,
+                             struct mp_recorder_sink *sink)
+{
+    lock_decoder(d_video);
+    d_video->recorder_sink = sink;
+    unlock_decoder(d_video);
+}
+
+// Drop all packets that are not keyframes. (Used while scrubbing.)
+void video_set_keyframes_only(struct dec_video *d_video, bool enabled)
+{
+    if (d_video->thread) {
+        pthread_mutex_lock(&d_video->thread_lock);
+        d_video->thread_keyframes_only = enabled;
+        pthread_mutex_unlock(&d_video->thread_lock);
+    } else {
+        d_video->keyframes_only = enabled;
+    }
 }
 
 void video_set_framedrop(struct dec_video *d_video, bool enabled)
 {
-    d_video->framedrop_enabled = enabled;
+    if (d_video->thread) {
+        pthread_mutex_lock(&d_video->thread_lock);
+        d_video->thread_framedrop = enabled;
+        pthread_mutex_unlock(&d_video->thread_lock);
+    } else {
+        d_video->framedrop_enabled = enabled;
+    }
 }
 
 // Frames before the start timestamp can be dropped. (Used for hr-seek.)
 void video_set_start(struct dec_video *d_video, double start_pts)
 {
-    d_video->start_pts = start_pts;
+    if (d_video->thread) {
+        pthread_mutex_lock(&d_video->thread_lock);
+        d_video->thread_start_pts = start_pts;
+        pthread_mutex_unlock(&d_video->thread_lock);
+    } else {
+        d_video->start_pts = start_pts;
+    }
 }
 
 static bool is_new_segment(struct dec_video *d_video, struct demux_packet *p)
@@ -400,7 +486,7 @@ static bool is_new_segment(struct dec_video *d_video, struct demux_packet *p)
          p->codec != d_video->codec);
 }
 
-void video_work(struct dec_video *d_video)
+static void decode_step(struct dec_video *d_video)
 {
     if (d_video->current_mpi || !d_video->vd_driver)
         return;
@@ -418,6 +504,21 @@ void video_work(struct dec_video *d_video)
         d_video->packet = NULL;
     }
 
+    // Keep dropping until the next keyframe after keyframes_only was unset,
+    // because the following frames would reference dropped ones.
+    if (d_video->packet && !d_video->packet->keyframe &&
+        (d_video->keyframes_only || d_video->wait_keyframe))
+    {
+        talloc_free(d_video->packet);
+        d_video->packet = NULL;
+        d_video->wait_keyframe = true;
+        d_video->dropped_frames += 1;
+        d_video->current_state = DATA_AGAIN;
+        return;
+    }
+    if (d_video->packet && d_video->packet->keyframe)
+        d_video->wait_keyframe = false;
+
     double start_pts = d_video->start_pts;
     if (d_video->start != MP_NOPTS_VALUE && (start_pts == MP_NOPTS_VALUE ||
                                              d_video->start > start_pts))
@@ -471,7 +572,7 @@ void video_work(struct dec_video *d_video)
         d_video->new_segment = NULL;
 
         if (d_video->codec == new_segment->codec) {
-            video_reset(d_video);
+            reset_decoder(d_video);
         } else {
             d_video->codec = new_segment->codec;
             d_video->vd_driver->uninit(d_video);
@@ -487,12 +588,7 @@ void video_work(struct dec_video *d_video)
     }
 }
 
-// Fetch an image decoded with video_work(). Returns one of:
-//  DATA_OK:    *out_mpi is set to a new image
-//  DATA_WAIT:  waiting for demuxer; will receive a wakeup signal
-//  DATA_EOF:   end of file, no more frames to be expected
-//  DATA_AGAIN: dropped frame or something similar
-int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
+static int get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
 {
     *out_mpi = NULL;
     if (d_video->current_mpi) {
@@ -504,3 +600,81 @@ int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
         return DATA_AGAIN;
     return d_video->current_state;
 }
+
+void video_work(struct dec_video *d_video)
+{
+    if (d_video->thread) {
+        mp_dec_thread_kick(d_video->thread);
+    } else {
+        decode_step(d_video);
+    }
+}
+
+// Fetch an image decoded with video_work(). Returns one of:
+//  DATA_OK:    *out_mpi is set to a new image
+//  DATA_WAIT:  waiting for demuxer or decoder thread; will receive a wakeup
+//  DATA_EOF:   end of file, no more frames to be expected
+//  DATA_AGAIN: dropped frame or something similar
+int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
+{
+    if (!d_video->thread)
+        return get_frame(d_video, out_mpi);
+
+    void *frame;
+    int res = mp_dec_thread_get(d_video->thread, &frame);
+    *out_mpi = frame;
+    return res;
+}
+
+static int thread_step(void *ctx, void **frame)
+{
+    struct dec_video *d_video = ctx;
+
+    pthread_mutex_lock(&d_video->thread_lock);
+    d_video->framedrop_enabled = d_video->thread_framedrop;
+    d_video->keyframes_only = d_video->thread_keyframes_only;
+    d_video->start_pts = d_video->thread_start_pts;
+    pthread_mutex_unlock(&d_video->thread_lock);
+
+    if (!d_video->vd_driver)
+        return DATA_EOF;
+
+    decode_step(d_video);
+
+    struct mp_image *mpi;
+    int res = get_frame(d_video, &mpi);
+    *frame = mpi;
+    return res;
+}
+
+static void free_frame(void *frame)
+{
+    talloc_free(frame);
+}
+
+static const struct mp_dec_thread_fns thread_fns = {
+    .step = thread_step,
+    .free_frame = free_frame,
+};
+
+// Decode on a separate thread from now on, keeping up to queue_frames decoded
+// frames. wakeup(wakeup_ctx) is called when a new frame can be retrieved with
+// video_get_frame(). Must be called after video_init_best_codec().
+bool video_init_thread(struct dec_video *d_video, int queue_frames,
+                       void (*wakeup)(void *ctx), void *wakeup_ctx)
+{
+    assert(!d_video->thread);
+
+    pthread_mutex_init(&d_video->thread_lock, NULL);
+    d_video->thread_framedrop = d_video->framedrop_enabled;
+    d_video->thread_start_pts = d_video->start_pts;
+
+    d_video->thread = mp_dec_thread_create(d_video, "vd", &thread_fns, d_video,
+                                           queue_frames, wakeup, wakeup_ctx);
+    if (!d_video->thread) {
+        pthread_mutex_destroy(&d_video->thread_lock);
+        MP_ERR(d_video, "Could not create decoder thread.\n");
+        return false;
+    }
+    return true;
+}
@@ -19,12 +19,14 @@
 #define MPLAYER_DEC_VIDEO_H
 
 #include <stdbool.h>
+#include <pthread.h>
 
 #include "demux/stheader.h"
 #include "video/hwdec.h"
 #include "video/mp_image.h"
 
 struct mp_decoder_list;
+struct mp_dec_thread;
 struct vo;
 
 struct dec_video {
@@ -77,24 +79,38 @@ struct dec_video {
     struct demux_packet *new_segment;
     struct demux_packet *packet;
     bool framedrop_enabled;
+    bool keyframes_only;
+    bool wait_keyframe;
     struct mp_image *current_mpi;
     int current_state;
+
+    // Set if decoding runs on a separate thread (video_init_thread()).
+    struct mp_dec_thread *thread;
+    pthread_mutex_t thread_lock; // protects the fields below
+    bool thread_framedrop;
+    bool thread_keyframes_only;
+    double thread_start_pts;
 };
 
 struct mp_decoder_list *video_decoder_list(void);
 
 bool video_init_best_codec(struct dec_video *d_video);
 void video_uninit(struct dec_video *d_video);
+bool video_init_thread(struct dec_video *d_video, int queue_frames,
+                       void (*wakeup)(void *ctx), void *wakeup_ctx);
 
 void video_work(struct dec_video *d_video);
 int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi);
 
 void video_set_framedrop(struct dec_video *d_video, bool enabled);
+void video_set_keyframes_only(struct dec_video *d_video, bool enabled);
 void video_set_start(struct dec_video *d_video, double start_pts);
 
 int video_vd_control(struct dec_video *d_video, int cmd, void *arg);
 void video_reset(struct dec_video *d_video);
 void video_reset_params(struct dec_video *d_video);
 void video_get_dec_params(struct dec_video *d_video, struct mp_image_params *p);
+void video_set_recorder_sink(struct dec_video *d_video,
+                             struct mp_recorder_sink *sink);
 
 #endif /* MPLAYER_DEC_VIDEO_H */
@@ -61,10 +61,17 @@ typedef struct lavc_ctx {
     struct mp_hwdec_ctx *hwdec_dev;
     bool owns_hwdec_dev;
 
+    int threads;            // thread count of the current avctx
+    int adapt_threads;      // if !=0, thread count chosen by adapt_threads()
+    int64_t decode_time_acc;
+    double frame_time;      // average time spent decoding a frame (seconds)
+    int num_timed_frames;
+
     bool hwdec_request_reinit;
     int hwdec_fail_count;
 
     struct mp_image_pool *hwdec_swpool;
+    bool dr_download_failed;
 
     AVBufferRef *cached_hw_frames_ctx;
 
@@ -73,6 +80,7 @@ typedef struct lavc_ctx {
     bool dr_failed;
     struct mp_image_pool *dr_pool;
     int dr_imgfmt, dr_w, dr_h, dr_stride_align;
+    int64_t dr_frames, dr_direct_frames;
 } vd_ffmpeg_ctx;
 
 struct vd_lavc_hwdec {
@@ -51,6 +51,27 @@ enum vd_ctrl {
     VDCTRL_GET_BFRAMES,
     // framedrop mode: 0=none, 1=standard, 2=hrseek
     VDCTRL_SET_FRAMEDROP,
+    VDCTRL_GET_THREADS, // struct vd_threads_info*
+    VDCTRL_GET_HWDEC_POOL, // struct vd_hwdec_pool_info*
+    VDCTRL_GET_DR_INFO, // struct vd_dr_info*
+};
+
+struct vd_threads_info {
+    int threads;
+    double frame_time;
+    int timed_frames;
+};
+
+struct vd_dr_info {
+    bool active;            // last frame was decoded with DR
+    int64_t frames;         // frames allocated since the decoder was opened
+    int64_t direct_frames;  // frames allocated with DR
+};
+
+struct vd_hwdec_pool_info {
+    int w, h;           // surface size
+    int surfaces;       // 0 if the pool grows dynamically
+    int64_t bytes;      // estimated memory used by the surfaces
 };
 
 #endif /* MPLAYER_VD_H */
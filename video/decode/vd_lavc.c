@@ -18,12 +18,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <inttypes.h>
 #include <time.h>
 #include <stdbool.h>
+#include <math.h>
 #include <sys/types.h>
 
 #include <libavutil/common.h>
+#include <libavutil/cpu.h>
 #include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/intreadwrite.h>
 #include <libavutil/pixdesc.h>
 
@@ -34,6 +38,7 @@
 #include "misc/bstr.h"
 #include "common/av_common.h"
 #include "common/codecs.h"
+#include "osdep/timer.h"
 
 #include "video/fmt-conversion.h"
 
@@ -79,6 +84,7 @@ struct vd_lavc_params {
     int software_fallback;
     char **avopts;
     int dr;
+    int adaptive_threads;
 };
 
 static const struct m_opt_choice_alternatives discard_names[] = {
@@ -109,6 +115,7 @@ const struct m_sub_options vd_lavc_conf = {
                           ({"no", INT_MAX}, {"yes", 1})),
         OPT_KEYVALUELIST("o", avopts, 0),
         OPT_FLAG("dr", dr, 0),
+        OPT_FLAG("adaptive-threads", adaptive_threads, 0),
         {0}
     },
     .size = sizeof(struct vd_lavc_params),
@@ -432,6 +439,90 @@ static struct vd_lavc_hwdec *probe_hwdec(struct dec_video *vd, bool autoprobe,
     return NULL;
 }
 
+// Hardware decoders which failed for a given kind of stream are remembered for
+// the process lifetime, so that opening similar files doesn't go through the
+// same (often slow) failing device creation or decoder init again.
+#define HWDEC_CACHE_MAX 64
+
+struct hwdec_cache_entry {
+    char codec[32];
+    int profile;
+    int depth;
+    int size_class;
+    uint64_t failed;    // bit mask of (1 << enum hwdec_type)
+};
+
+static pthread_mutex_t hwdec_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct hwdec_cache_entry hwdec_cache[HWDEC_CACHE_MAX];
+static int hwdec_cache_num;
+
+static void hwdec_cache_key(struct dec_video *vd, struct hwdec_cache_entry *key)
+{
+    struct mp_codec_params *c = vd->codec;
+
+    *key = (struct hwdec_cache_entry){ .profile = FF_PROFILE_UNKNOWN };
+    snprintf(key->codec, sizeof(key->codec), "%s", c->codec ? c->codec : "");
+    if (c->lav_codecpar) {
+        key->profile = c->lav_codecpar->profile;
+        const AVPixFmtDescriptor *d = av_pix_fmt_desc_get(c->lav_codecpar->format);
+        key->depth = d ? d->comp[0].depth : 0;
+    }
+    // Hardware decoders typically have limits at 1080p and 4K.
+    int64_t pixels = (int64_t)c->disp_w * c->disp_h;
+    key->size_class = pixels <= 1920 * 1088 ? 0 : pixels <= 4096 * 2304 ? 1 : 2;
+}
+
+// Must be called with hwdec_cache_lock held.
+static struct hwdec_cache_entry *hwdec_cache_find(struct hwdec_cache_entry *key)
+{
+    for (int n = 0; n < hwdec_cache_num; n++) {
+        struct hwdec_cache_entry *e = &hwdec_cache[n];
+        if (strcmp(e->codec, key->codec) == 0 && e->profile == key->profile &&
+            e->depth == key->depth && e->size_class == key->size_class)
+            return e;
+    }
+    return NULL;
+}
+
+static uint64_t hwdec_cache_get_failed(struct dec_video *vd)
+{
+    struct hwdec_cache_entry key;
+    hwdec_cache_key(vd, &key);
+
+    pthread_mutex_lock(&hwdec_cache_lock);
+    struct hwdec_cache_entry *e = hwdec_cache_find(&key);
+    uint64_t failed = e ? e->failed : 0;
+    pthread_mutex_unlock(&hwdec_cache_lock);
+    return failed;
+}
+
+static void hwdec_cache_add_failed(struct dec_video *vd, enum hwdec_type type)
+{
+    struct hwdec_cache_entry key;
+    hwdec_cache_key(vd, &key);
+
+    pthread_mutex_lock(&hwdec_cache_lock);
+    struct hwdec_cache_entry *e = hwdec_cache_find(&key);
+    if (!e) {
+        // Full: evict the oldest entry.
+        if (hwdec_cache_num == HWDEC_CACHE_MAX) {
+            memmove(&hwdec_cache[0], &hwdec_cache[1],
+                    (HWDEC_CACHE_MAX - 1) * sizeof(hwdec_cache[0]));
+            hwdec_cache_num--;
+        }
+        e = &hwdec_cache[hwdec_cache_num++];
+        *e = key;
+    }
+    e->failed |= 1ULL << type;
+    pthread_mutex_unlock(&hwdec_cache_lock);
+}
+
+// Whether probing doesn't depend on the VO (and its hwdec interop).
+static bool hwdec_owns_dev(const struct vd_lavc_hwdec *hwdec)
+{
+    return hwdec->copying || hwdec->create_dev || hwdec->create_standalone_dev;
+}
+
 static void uninit(struct dec_video *vd)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
@@ -479,8 +570,18 @@ static void reinit(struct dec_video *vd)
                 if (hwdec_is_wrapper(other, decoder))
                     might_be_wrapper = true;
             }
+            uint64_t failed = hwdec_cache_get_failed(vd);
             for (int n = 0; hwdec_list[n]; n++) {
-                hwdec = probe_hwdec(vd, true, hwdec_list[n]->type, codec);
+                enum hwdec_type type = hwdec_list[n]->type;
+                if (failed & (1ULL << type)) {
+                    MP_VERBOSE(vd, "Skipping '%s' (failed before for this "
+                               "kind of stream).\n",
+                               m_opt_choice_str(mp_hwdec_names, type));
+                    continue;
+                }
+                hwdec = probe_hwdec(vd, true, type, codec);
+                if (!hwdec && hwdec_owns_dev(hwdec_list[n]))
+                    hwdec_cache_add_failed(vd, type);
                 if (hwdec) {
                     if (might_be_wrapper && !hwdec_is_wrapper(hwdec, decoder)) {
                         MP_VERBOSE(vd, "This hwaccel is not compatible.\n");
@@ -518,6 +619,24 @@ static void reinit(struct dec_video *vd)
         force_fallback(vd);
 }
 
+// Allocator for copy-back hwdecs: download directly into VO mapped buffers,
+// so that the VO doesn't need to copy the image again on upload.
+static struct mp_image *alloc_hw_download(void *data, int fmt, int w, int h)
+{
+    struct dec_video *vd = data;
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    if (!ctx->dr_download_failed) {
+        struct mp_image *img = vo_get_image(vd->vo, fmt, w, h, 64);
+        if (img)
+            return img;
+        MP_VERBOSE(vd, "DR for hwdec copy-back failed - disabling.\n");
+        ctx->dr_download_failed = true;
+    }
+
+    return mp_image_alloc(fmt, w, h);
+}
+
 static int init(struct dec_video *vd, const char *decoder)
 {
     vd_ffmpeg_ctx *ctx;
@@ -529,6 +648,9 @@ static int init(struct dec_video *vd, const char *decoder)
     ctx->hwdec_swpool = talloc_steal(ctx, mp_image_pool_new(17));
     ctx->dr_pool = talloc_steal(ctx, mp_image_pool_new(INT_MAX));
 
+    if (vd->vo && vd->opts->vd_lavc_params->dr)
+        mp_image_pool_set_allocator(ctx->hwdec_swpool, alloc_hw_download, vd);
+
     pthread_mutex_init(&ctx->dr_lock, NULL);
 
     reinit(vd);
@@ -602,7 +724,10 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
         ctx->max_delay_queue = ctx->hwdec->delay_queue;
         ctx->hw_probing = true;
     } else {
-        mp_set_avcodec_threads(vd->log, avctx, lavc_param->threads);
+        int threads = lavc_param->threads;
+        if (ctx->adapt_threads && !threads)
+            threads = ctx->adapt_threads;
+        mp_set_avcodec_threads(vd->log, avctx, threads);
     }
 
     if (!ctx->hwdec && vd->vo && lavc_param->dr) {
@@ -635,6 +760,12 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
     if (avcodec_open2(avctx, lavc_codec, NULL) < 0)
         goto error;
 
+    ctx->threads = MPMAX(avctx->thread_count, 1);
+    ctx->decode_time_acc = 0;
+    ctx->frame_time = 0;
+    ctx->num_timed_frames = 0;
+    ctx->dr_frames = ctx->dr_direct_frames = 0;
+
     return;
 
 error:
@@ -652,6 +783,40 @@ static void reset_avctx(struct dec_video *vd)
     ctx->hwdec_request_reinit = false;
 }
 
+// With --vd-lavc-adaptive-threads, pick a thread count just sufficient to
+// decode at about twice the frame rate, based on the measured decode time.
+// More threads than that mostly add latency (frame threading delays output by
+// one frame per thread). The thread count of an open decoder can't be changed,
+// so this reopens it, and is done on resets only, where the decoder state is
+// lost anyway.
+static void adapt_threads(struct dec_video *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    struct vd_lavc_params *lavc_param = vd->opts->vd_lavc_params;
+
+    if (!lavc_param->adaptive_threads || lavc_param->threads || ctx->hwdec ||
+        !ctx->avctx || ctx->num_timed_frames < 50 || vd->fps <= 0)
+        return;
+
+    // Assume the decoder scales linearly with the number of threads, i.e. the
+    // time the caller is blocked per frame is the single-thread cost / threads.
+    double cost = ctx->frame_time * ctx->threads;
+    int max_threads = MPMIN(MPMAX(av_cpu_count(), 1) + 1, 16);
+    int want = MPCLAMP((int)ceil(cost * vd->fps * 2), 1, max_threads);
+
+    // Avoid toggling back and forth between close values.
+    if (want <= ctx->threads && want > ctx->threads / 2)
+        return;
+
+    MP_VERBOSE(vd, "Decoding takes %.1f ms/frame with %d threads, switching "
+               "to %d threads.\n", ctx->frame_time * 1e3, ctx->threads, want);
+    ctx->adapt_threads = want;
+    uninit_avctx(vd);
+    init_avctx(vd, ctx->decoder, NULL);
+    if (!ctx->avctx)
+        MP_ERR(vd, "Could not reopen decoder.\n");
+}
+
 static void flush_all(struct dec_video *vd)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
@@ -697,6 +862,22 @@ static void uninit_avctx(struct dec_video *vd)
     ctx->hw_probing = false;
 }
 
+static void get_hwdec_pool_info(struct lavc_ctx *ctx,
+                                struct vd_hwdec_pool_info *info)
+{
+    AVHWFramesContext *fctx = (void *)ctx->cached_hw_frames_ctx->data;
+    *info = (struct vd_hwdec_pool_info){
+        .w = fctx->width,
+        .h = fctx->height,
+        .surfaces = fctx->initial_pool_size,
+    };
+    // Rough estimate; the real layout is up to the driver.
+    int size = av_image_get_buffer_size(fctx->sw_format, fctx->width,
+                                        fctx->height, 1);
+    if (size > 0)
+        info->bytes = (int64_t)size * info->surfaces;
+}
+
 static int init_generic_hwaccel(struct dec_video *vd, enum AVPixelFormat hw_fmt)
 {
     struct lavc_ctx *ctx = vd->priv;
@@ -755,19 +936,44 @@ static int init_generic_hwaccel(struct dec_video *vd, enum AVPixelFormat hw_fmt)
     if (ctx->hwdec->hwframes_refine)
         ctx->hwdec->hwframes_refine(ctx, new_frames_ctx);
 
-    // We might be able to reuse a previously allocated frame pool.
+    // We might be able to reuse a previously allocated frame pool. Surfaces
+    // larger than the video are fine (libavcodec itself aligns the size), so
+    // the pool is only reallocated if it's too small. This avoids expensive
+    // reallocations on resolution switches in adaptive streams.
     if (ctx->cached_hw_frames_ctx) {
         AVHWFramesContext *old_fctx = (void *)ctx->cached_hw_frames_ctx->data;
 
         if (new_fctx->format            != old_fctx->format ||
             new_fctx->sw_format         != old_fctx->sw_format ||
-            new_fctx->width             != old_fctx->width ||
-            new_fctx->height            != old_fctx->height ||
-            new_fctx->initial_pool_size != old_fctx->initial_pool_size)
+            new_fctx->width             >  old_fctx->width ||
+            new_fctx->height            >  old_fctx->height ||
+            !new_fctx->initial_pool_size != !old_fctx->initial_pool_size ||
+            new_fctx->initial_pool_size >  old_fctx->initial_pool_size)
+        {
+            // Grow, so that switching back doesn't reallocate again.
+            if (new_fctx->format == old_fctx->format &&
+                new_fctx->sw_format == old_fctx->sw_format)
+            {
+                new_fctx->width = MPMAX(new_fctx->width, old_fctx->width);
+                new_fctx->height = MPMAX(new_fctx->height, old_fctx->height);
+                if (new_fctx->initial_pool_size) {
+                    new_fctx->initial_pool_size =
+                        MPMAX(new_fctx->initial_pool_size,
+                              old_fctx->initial_pool_size);
+                }
+            }
             av_buffer_unref(&ctx->cached_hw_frames_ctx);
+        }
     }
 
     if (!ctx->cached_hw_frames_ctx) {
+        // Preallocate for the largest expected size right away.
+        struct m_geometry *gm = &vd->opts->hwdec_pool_size;
+        if (gm->wh_valid && !gm->w_per && !gm->h_per) {
+            new_fctx->width = MPMAX(new_fctx->width, FFALIGN(gm->w, 16));
+            new_fctx->height = MPMAX(new_fctx->height, FFALIGN(gm->h, 16));
+        }
+
         if (av_hwframe_ctx_init(new_frames_ctx) < 0) {
             MP_ERR(ctx, "Failed to allocate hw frames.\n");
             goto error;
@@ -775,6 +981,12 @@ static int init_generic_hwaccel(struct dec_video *vd, enum AVPixelFormat hw_fmt)
 
         ctx->cached_hw_frames_ctx = new_frames_ctx;
         new_frames_ctx = NULL;
+
+        struct vd_hwdec_pool_info info;
+        get_hwdec_pool_info(ctx, &info);
+        MP_VERBOSE(ctx, "Allocated hw frame pool: %dx%d, %d surfaces, "
+                   "%"PRId64" KiB.\n", info.w, info.h, info.surfaces,
+                   info.bytes / 1024);
     }
 
     ctx->avctx->hw_frames_ctx = av_buffer_ref(ctx->cached_hw_frames_ctx);
@@ -864,9 +1076,6 @@ static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags)
     if (!imgfmt)
         goto fallback;
 
-    if (p->dr_failed)
-        goto fallback;
-
     // (For simplicity, we realloc on any parameter change, instead of trying
     // to be clever.)
     if (stride_align != p->dr_stride_align || w != p->dr_w || h != p->dr_h ||
@@ -877,10 +1086,15 @@ static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags)
         p->dr_w = w;
         p->dr_h = h;
         p->dr_stride_align = stride_align;
+        // The VO might support the new parameters.
+        p->dr_failed = false;
         MP_VERBOSE(p, "DR parameter change to %dx%d %s align=%d\n", w, h,
                    mp_imgfmt_to_name(imgfmt), stride_align);
     }
 
+    if (p->dr_failed)
+        goto fallback;
+
     struct mp_image *img = mp_image_pool_get_no_alloc(p->dr_pool, imgfmt, w, h);
     if (!img) {
         MP_VERBOSE(p, "Allocating new DR image...\n");
@@ -910,14 +1124,19 @@ static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags)
     }
     talloc_free(img);
 
+    p->dr_frames++;
+    p->dr_direct_frames++;
     pthread_mutex_unlock(&p->dr_lock);
 
     return 0;
 
 fallback:
-    if (!p->dr_failed)
-        MP_VERBOSE(p, "DR failed - disabling.\n");
+    if (!p->dr_failed) {
+        MP_VERBOSE(p, "DR failed for %dx%d %s - disabling until the "
+                   "parameters change.\n", w, h, mp_imgfmt_to_name(imgfmt));
+    }
     p->dr_failed = true;
+    p->dr_frames++;
     pthread_mutex_unlock(&p->dr_lock);
 
     return avcodec_default_get_buffer2(avctx, pic, flags);
@@ -978,7 +1197,9 @@ static bool do_send_packet(struct dec_video *vd, struct demux_packet *pkt)
     AVPacket avpkt;
     mp_set_av_packet(&avpkt, pkt, &ctx->codec_timebase);
 
+    int64_t t = mp_time_us();
     int ret = avcodec_send_packet(avctx, pkt ? &avpkt : NULL);
+    ctx->decode_time_acc += mp_time_us() - t;
     if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
         return false;
 
@@ -1016,7 +1237,9 @@ static bool decode_frame(struct dec_video *vd)
     if (!prepare_decoding(vd))
         return true;
 
+    int64_t t = mp_time_us();
     int ret = avcodec_receive_frame(avctx, ctx->pic);
+    ctx->decode_time_acc += mp_time_us() - t;
     if (ret == AVERROR_EOF) {
         // If flushing was initialized earlier and has ended now, make it start
         // over in case we get new packets at some point in the future.
@@ -1031,10 +1254,17 @@ static bool decode_frame(struct dec_video *vd)
 
     ctx->hwdec_fail_count = 0;
 
+    // Time spent in libavcodec since the last frame, smoothed.
+    double frame_time = ctx->decode_time_acc / 1e6;
+    ctx->frame_time = ctx->num_timed_frames
+                    ? ctx->frame_time * 0.95 + frame_time * 0.05 : frame_time;
+    ctx->num_timed_frames += 1;
+    ctx->decode_time_acc = 0;
+
     AVFrameSideData *sd = NULL;
     sd = av_frame_get_side_data(ctx->pic, AV_FRAME_DATA_A53_CC);
     if (sd) {
-        struct demux_packet *cc = new_demux_packet_from(sd->data, sd->size);
+        struct demux_packet *cc = new_demux_packet_from(NULL, sd->data, sd->size);
         cc->pts = vd->codec_pts;
         cc->dts = vd->codec_dts;
         demuxer_feed_caption(vd->header, cc);
@@ -1069,6 +1299,10 @@ static bool receive_frame(struct dec_video *vd, struct mp_image **out_image)
     bool progress = decode_frame(vd);
 
     if (ctx->hwdec_failed) {
+        // If it failed right away, it probably doesn't support this stream.
+        if (ctx->hw_probing && ctx->hwdec && HWDEC_IS_AUTO(vd->opts->hwdec_api))
+            hwdec_cache_add_failed(vd, ctx->hwdec->type);
+
         // Failed hardware decoding? Try again in software.
         struct demux_packet **pkts = ctx->sent_packets;
         int num_pkts = ctx->num_sent_packets;
@@ -1137,6 +1371,7 @@ static int control(struct dec_video *vd, int cmd, void *arg)
     switch (cmd) {
     case VDCTRL_RESET:
         flush_all(vd);
+        adapt_threads(vd);
         return CONTROL_TRUE;
     case VDCTRL_SET_FRAMEDROP:
         ctx->framedrop_flags = *(int *)arg;
@@ -1154,6 +1389,34 @@ static int control(struct dec_video *vd, int cmd, void *arg)
         *(int *)arg = ctx->hwdec ? ctx->hwdec->type : 0;
         return CONTROL_TRUE;
     }
+    case VDCTRL_GET_THREADS: {
+        if (!ctx->avctx)
+            break;
+        *(struct vd_threads_info *)arg = (struct vd_threads_info){
+            .threads = ctx->threads,
+            .frame_time = ctx->frame_time,
+            .timed_frames = ctx->num_timed_frames,
+        };
+        return CONTROL_TRUE;
+    }
+    case VDCTRL_GET_DR_INFO: {
+        if (!ctx->avctx || ctx->avctx->get_buffer2 != get_buffer2_direct)
+            break;
+        pthread_mutex_lock(&ctx->dr_lock);
+        *(struct vd_dr_info *)arg = (struct vd_dr_info){
+            .active = ctx->dr_frames && !ctx->dr_failed,
+            .frames = ctx->dr_frames,
+            .direct_frames = ctx->dr_direct_frames,
+        };
+        pthread_mutex_unlock(&ctx->dr_lock);
+        return CONTROL_TRUE;
+    }
+    case VDCTRL_GET_HWDEC_POOL: {
+        if (!ctx->cached_hw_frames_ctx)
+            break;
+        get_hwdec_pool_info(ctx, arg);
+        return CONTROL_TRUE;
+    }
     case VDCTRL_FORCE_HWDEC_FALLBACK:
         if (ctx->hwdec) {
             force_fallback(vd);
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <assert.h>
 #include <sys/types.h>
+#include <pthread.h>
 #include <libavutil/buffer.h>
 #include <libavutil/common.h>
 #include <libavutil/mem.h>
@@ -29,10 +30,14 @@
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "common/perf.h"
+#include "misc/dec_thread.h"
+#include "misc/node.h"
 #include "options/m_option.h"
 #include "options/m_config.h"
 
 #include "options/options.h"
+#include "osdep/timer.h"
 
 #include "video/img_format.h"
 #include "video/mp_image.h"
@@ -61,6 +66,7 @@ extern const vf_info_t vf_info_vapoursynth_lazy;
 extern const vf_info_t vf_info_vdpaupp;
 extern const vf_info_t vf_info_buffer;
 extern const vf_info_t vf_info_d3d11vpp;
+extern const vf_info_t vf_info_hwmap;
 
 // list of available filters:
 static const vf_info_t *const filter_list[] = {
@@ -98,11 +104,17 @@ static const vf_info_t *const filter_list[] = {
 #endif
 #if HAVE_D3D_HWACCEL
     &vf_info_d3d11vpp,
+#endif
+#if HAVE_VAAPI && HAVE_DRMPRIME
+    &vf_info_hwmap,
 #endif
     NULL
 };
 
 static void vf_uninit_filter(vf_instance_t *vf);
+static void pipeline_pause(struct vf_chain *c);
+static void pipeline_resume(struct vf_chain *c);
+static void pipeline_destroy(struct vf_chain *c);
 
 static bool get_desc(struct m_obj_desc *dst, int index)
 {
@@ -133,26 +145,30 @@ const struct m_obj_list vf_obj_list = {
 // filter which does not return CONTROL_UNKNOWN for it.
 int vf_control_any(struct vf_chain *c, int cmd, void *arg)
 {
+    pipeline_pause(c);
+    int r = CONTROL_UNKNOWN;
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         if (cur->control) {
-            int r = cur->control(cur, cmd, arg);
+            r = cur->control(cur, cmd, arg);
             if (r != CONTROL_UNKNOWN)
-                return r;
+                break;
         }
     }
-    return CONTROL_UNKNOWN;
+    pipeline_resume(c);
+    return r;
 }
 
 int vf_control_by_label(struct vf_chain *c,int cmd, void *arg, bstr label)
 {
+    pipeline_pause(c);
     char *label_str = bstrdup0(NULL, label);
     struct vf_instance *cur = vf_find_by_label(c, label_str);
     talloc_free(label_str);
-    if (cur) {
-        return cur->control ? cur->control(cur, cmd, arg) : CONTROL_NA;
-    } else {
-        return CONTROL_UNKNOWN;
-    }
+    int r = CONTROL_UNKNOWN;
+    if (cur)
+        r = cur->control ? cur->control(cur, cmd, arg) : CONTROL_NA;
+    pipeline_resume(c);
+    return r;
 }
 
 static void vf_control_all(struct vf_chain *c, int cmd, void *arg)
@@ -167,7 +183,9 @@ int vf_send_command(struct vf_chain *c, char *label, char *cmd, char *arg)
 {
     char *args[2] = {cmd, arg};
     if (strcmp(label, "all") == 0) {
+        pipeline_pause(c);
         vf_control_all(c, VFCTRL_COMMAND, args);
+        pipeline_resume(c);
         return 0;
     } else {
         return vf_control_by_label(c, VFCTRL_COMMAND, args, bstr0(label));
@@ -193,8 +211,10 @@ struct mp_image *vf_alloc_out_image(struct vf_instance *vf)
     struct mp_image_params *p = &vf->fmt_out;
     assert(p->imgfmt);
     struct mp_image *img = mp_image_pool_get(vf->out_pool, p->imgfmt, p->w, p->h);
-    if (img)
+    if (img) {
         vf_fix_img_params(img, p);
+        mp_perf_stat_add(vf->perf, MP_PERF_STAT_ALLOCS, 1);
+    }
     return img;
 }
 
@@ -205,6 +225,8 @@ bool vf_make_out_image_writeable(struct vf_instance *vf, struct mp_image *img)
     assert(p->imgfmt);
     assert(p->imgfmt == img->imgfmt);
     assert(p->w == img->w && p->h == img->h);
+    if (!mp_image_is_writeable(img))
+        mp_perf_stat_add(vf->perf, MP_PERF_STAT_ALLOCS, 1);
     return mp_image_pool_make_writeable(vf->out_pool, img);
 }
 
@@ -216,6 +238,23 @@ static int vf_default_query_format(struct vf_instance *vf, unsigned int fmt)
     return vf_next_query_format(vf, fmt);
 }
 
+// Return per-filter statistics as node array (free with talloc_free(dst->u.list)).
+void vf_get_perf_node(struct vf_chain *c, struct mpv_node *dst)
+{
+    node_init(dst, MPV_FORMAT_NODE_ARRAY, NULL);
+    if (!c->first)
+        return;
+    for (struct vf_instance *vf = c->first->next; vf != c->last; vf = vf->next) {
+        struct mpv_node *e = node_array_add(dst, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "name", vf->info->name);
+        if (vf->label)
+            node_map_add_string(e, "label", vf->label);
+        node_map_add_flag(e, "autoinserted", vf->autoinserted);
+        node_map_add_int64(e, "queued", vf->num_out_queued);
+        mp_perf_stat_get_node(vf->perf, e);
+    }
+}
+
 void vf_print_filter_chain(struct vf_chain *c, int msglevel,
                            struct vf_instance *vf)
 {
@@ -263,6 +302,8 @@ static struct vf_instance *vf_open(struct vf_chain *c, const char *name,
         .out_pool = talloc_steal(vf, mp_image_pool_new(16)),
         .chain = c,
     };
+    vf->perf = mp_perf_stat_create(vf);
+    mp_image_pool_set_max_bytes(vf->out_pool, 256 * 1024 * 1024);
     struct m_config *config =
         m_config_from_obj_desc_and_args(vf, vf->log, c->global, &desc,
                                         name, c->opts->vf_defs, args);
@@ -316,6 +357,7 @@ static vf_instance_t *vf_open_filter(struct vf_chain *c, const char *name,
 void vf_remove_filter(struct vf_chain *c, struct vf_instance *vf)
 {
     assert(vf != c->first && vf != c->last); // these are sentinels
+    pipeline_destroy(c);
     struct vf_instance *prev = c->first;
     while (prev && prev->next != vf)
         prev = prev->next;
@@ -328,6 +370,7 @@ void vf_remove_filter(struct vf_chain *c, struct vf_instance *vf)
 struct vf_instance *vf_append_filter(struct vf_chain *c, const char *name,
                                      char **args)
 {
+    pipeline_destroy(c);
     struct vf_instance *vf = vf_open_filter(c, name, args);
     if (vf) {
         // Insert it before the last filter, which is the "out" pseudo-filter
@@ -375,14 +418,17 @@ void vf_add_output_frame(struct vf_instance *vf, struct mp_image *img)
     if (img) {
         vf_fix_img_params(img, &vf->fmt_out);
         MP_TARRAY_APPEND(vf, vf->out_queued, vf->num_out_queued, img);
+        mp_perf_stat_add(vf->perf, MP_PERF_STAT_FRAMES, 1);
     }
 }
 
 static bool vf_has_output_frame(struct vf_instance *vf)
 {
     if (!vf->num_out_queued && vf->filter_out) {
+        int64_t start = mp_time_us();
         if (vf->filter_out(vf) < 0)
             MP_ERR(vf, "Error filtering frame.\n");
+        mp_perf_stat_time(vf->perf, mp_time_us() - start);
     }
     return vf->num_out_queued > 0;
 }
@@ -403,19 +449,291 @@ static int vf_do_filter(struct vf_instance *vf, struct mp_image *img)
     if (img)
         assert(mp_image_params_equal(&img->params, &vf->fmt_in));
 
+    int64_t start = mp_time_us();
+    int r = 0;
     if (vf->filter_ext) {
-        int r = vf->filter_ext(vf, img);
+        r = vf->filter_ext(vf, img);
         if (r < 0)
             MP_ERR(vf, "Error filtering frame.\n");
-        return r;
     } else {
         if (img) {
             if (vf->filter)
                 img = vf->filter(vf, img);
             vf_add_output_frame(vf, img);
         }
-        return 0;
     }
+    mp_perf_stat_time(vf->perf, mp_time_us() - start);
+    return r;
+}
+
+// With --vf-queue-frames, each filter (except the "in" and "out" sentinels)
+// runs on its own thread, and up to that number of frames are queued after
+// each filter. Stage n fetches its input from stage n-1's queue; the first
+// stage reads from the input queue, which is fed by vf_filter_frame(). Output
+// from the last stage is moved to the out list by vf_output_frame(). Frame
+// order is preserved, because each stage processes its input sequentially.
+// All other accesses to filters pause or stop the threads first.
+struct vf_stage {
+    struct vf_pipeline *pipe;
+    struct vf_instance *vf;
+    struct vf_stage *prev, *next;
+    struct mp_dec_thread *thread;
+};
+
+struct vf_pipeline {
+    struct vf_chain *chain;
+    struct vf_stage **stages;
+    int num_stages;
+    int max_frames;
+
+    pthread_mutex_t lock;
+    // --- the following fields are protected by lock
+    bool paused;                // don't restart stages from wakeup callbacks
+    struct mp_image **in;
+    int num_in;
+    bool in_eof;
+
+    // --- the following fields are accessed by the core thread only
+    struct mp_image **out;
+    int num_out;
+    bool out_eof;               // last stage returned DATA_EOF
+};
+
+static void pipeline_wakeup_chain(struct vf_pipeline *pipe)
+{
+    struct vf_chain *c = pipe->chain;
+    if (c->wakeup_callback)
+        c->wakeup_callback(c->wakeup_callback_ctx);
+}
+
+static int stage_read_input(struct vf_stage *s, struct mp_image **img)
+{
+    *img = NULL;
+    if (s->prev)
+        return mp_dec_thread_get(s->prev->thread, (void **)img);
+
+    struct vf_pipeline *pipe = s->pipe;
+    int r = DATA_WAIT;
+    pthread_mutex_lock(&pipe->lock);
+    if (pipe->num_in) {
+        *img = pipe->in[0];
+        MP_TARRAY_REMOVE_AT(pipe->in, pipe->num_in, 0);
+        r = DATA_OK;
+    } else if (pipe->in_eof) {
+        r = DATA_EOF;
+    }
+    pthread_mutex_unlock(&pipe->lock);
+    if (r == DATA_OK)
+        pipeline_wakeup_chain(pipe); // there is room for new input
+    return r;
+}
+
+static int stage_step(void *ctx, void **frame)
+{
+    struct vf_stage *s = ctx;
+
+    // Frames queued from a previous call (filters can return several).
+    struct mp_image *out = vf_dequeue_output_frame(s->vf);
+    if (!out) {
+        struct mp_image *img;
+        int r = stage_read_input(s, &img);
+        if (r == DATA_WAIT)
+            return DATA_WAIT;
+        vf_do_filter(s->vf, img);
+        out = vf_dequeue_output_frame(s->vf);
+        if (!out)
+            return r == DATA_EOF ? DATA_EOF : DATA_AGAIN;
+    }
+    *frame = out;
+    return DATA_OK;
+}
+
+static void stage_free_frame(void *frame)
+{
+    talloc_free(frame);
+}
+
+static const struct mp_dec_thread_fns stage_fns = {
+    .step = stage_step,
+    .free_frame = stage_free_frame,
+};
+
+static void stage_wakeup(void *ctx)
+{
+    struct vf_stage *s = ctx;
+    struct vf_pipeline *pipe = s->pipe;
+    if (!s->next) {
+        pipeline_wakeup_chain(pipe);
+        return;
+    }
+    pthread_mutex_lock(&pipe->lock);
+    if (!pipe->paused)
+        mp_dec_thread_kick(s->next->thread);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+static void pipeline_free_queues(struct vf_pipeline *pipe)
+{
+    for (int n = 0; n < pipe->num_in; n++)
+        talloc_free(pipe->in[n]);
+    pipe->num_in = 0;
+    pipe->in_eof = false;
+    for (int n = 0; n < pipe->num_out; n++)
+        talloc_free(pipe->out[n]);
+    pipe->num_out = 0;
+    pipe->out_eof = false;
+}
+
+static void pipeline_dtor(void *ptr)
+{
+    struct vf_pipeline *pipe = ptr;
+    // Joins the threads.
+    for (int n = 0; n < pipe->num_stages; n++)
+        talloc_free(pipe->stages[n]->thread);
+    pipeline_free_queues(pipe);
+    pthread_mutex_destroy(&pipe->lock);
+}
+
+static void pipeline_create(struct vf_chain *c)
+{
+    assert(!c->pipeline);
+
+    int max_frames = c->opts->video_filter_queue;
+    if (max_frames < 1 || c->first->next == c->last)
+        return;
+
+    struct vf_pipeline *pipe = talloc_zero(NULL, struct vf_pipeline);
+    pipe->chain = c;
+    pipe->max_frames = max_frames;
+    pipe->paused = true;
+    pthread_mutex_init(&pipe->lock, NULL);
+    talloc_set_destructor(pipe, pipeline_dtor);
+
+    struct vf_stage *prev = NULL;
+    for (struct vf_instance *vf = c->first->next; vf != c->last; vf = vf->next) {
+        struct vf_stage *s = talloc_zero(pipe, struct vf_stage);
+        *s = (struct vf_stage){ .pipe = pipe, .vf = vf, .prev = prev };
+        s->thread = mp_dec_thread_create(NULL, vf->info->name, &stage_fns, s,
+                                         max_frames, stage_wakeup, s);
+        if (!s->thread) {
+            MP_ERR(c, "Could not create video filter thread.\n");
+            talloc_free(pipe);
+            return;
+        }
+        if (prev)
+            prev->next = s;
+        MP_TARRAY_APPEND(pipe, pipe->stages, pipe->num_stages, s);
+        prev = s;
+    }
+
+    c->pipeline = pipe;
+}
+
+static void pipeline_destroy(struct vf_chain *c)
+{
+    TA_FREEP(&c->pipeline);
+}
+
+// Make sure all filter threads are idle, and stay idle until pipeline_resume().
+static void pipeline_pause(struct vf_chain *c)
+{
+    struct vf_pipeline *pipe = c->pipeline;
+    if (!pipe)
+        return;
+    pthread_mutex_lock(&pipe->lock);
+    pipe->paused = true;
+    pthread_mutex_unlock(&pipe->lock);
+    for (int n = 0; n < pipe->num_stages; n++)
+        mp_dec_thread_pause(pipe->stages[n]->thread);
+}
+
+// Like pipeline_pause(), but also drop all frames in flight.
+static void pipeline_reset(struct vf_chain *c)
+{
+    struct vf_pipeline *pipe = c->pipeline;
+    if (!pipe)
+        return;
+    pipeline_pause(c);
+    for (int n = 0; n < pipe->num_stages; n++)
+        mp_dec_thread_stop(pipe->stages[n]->thread);
+    pthread_mutex_lock(&pipe->lock);
+    pipeline_free_queues(pipe);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+// Restart the filter threads. If they weren't paused, only the first stage is
+// kicked (the others are kicked by the stage before them).
+static void locked_resume(struct vf_pipeline *pipe)
+{
+    if (pipe->paused) {
+        pipe->paused = false;
+        for (int n = 0; n < pipe->num_stages; n++)
+            mp_dec_thread_kick(pipe->stages[n]->thread);
+    } else {
+        mp_dec_thread_kick(pipe->stages[0]->thread);
+    }
+}
+
+static void pipeline_resume(struct vf_chain *c)
+{
+    struct vf_pipeline *pipe = c->pipeline;
+    if (!pipe)
+        return;
+    pthread_mutex_lock(&pipe->lock);
+    locked_resume(pipe);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+static void pipeline_write(struct vf_pipeline *pipe, struct mp_image *img)
+{
+    pthread_mutex_lock(&pipe->lock);
+    if (img) {
+        MP_TARRAY_APPEND(pipe, pipe->in, pipe->num_in, img);
+    } else {
+        pipe->in_eof = true;
+    }
+    locked_resume(pipe);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+static int pipeline_output(struct vf_pipeline *pipe, bool eof)
+{
+    if (!pipe->num_out) {
+        pthread_mutex_lock(&pipe->lock);
+        if (eof)
+            pipe->in_eof = true;
+        if (pipe->paused || eof)
+            locked_resume(pipe);
+        pthread_mutex_unlock(&pipe->lock);
+
+        struct vf_stage *last = pipe->stages[pipe->num_stages - 1];
+        struct mp_image *img;
+        int r = mp_dec_thread_get(last->thread, (void **)&img);
+        if (r == DATA_OK)
+            MP_TARRAY_APPEND(pipe, pipe->out, pipe->num_out, img);
+        pipe->out_eof = r == DATA_EOF;
+    }
+    return pipe->num_out > 0;
+}
+
+static bool pipeline_input_full(struct vf_pipeline *pipe)
+{
+    pthread_mutex_lock(&pipe->lock);
+    bool full = pipe->num_in >= pipe->max_frames || pipe->in_eof;
+    pthread_mutex_unlock(&pipe->lock);
+    return full;
+}
+
+// Whether the caller needs to wait for wakeup_callback before the chain can
+// make progress. This is only the case with --vf-queue-frames, if no output is
+// available, and either new input can't be queued (eof==false), or frames
+// are still being filtered after EOF (eof==true).
+bool vf_is_busy(struct vf_chain *c, bool eof)
+{
+    struct vf_pipeline *pipe = c->pipeline;
+    if (!pipe || pipe->num_out)
+        return false;
+    return eof ? !pipe->out_eof : pipeline_input_full(pipe);
 }
 
 // Input a frame into the filter chain. Ownership of img is transferred.
@@ -428,6 +746,10 @@ int vf_filter_frame(struct vf_chain *c, struct mp_image *img)
         return -1;
     }
     assert(mp_image_params_equal(&img->params, &c->input_params));
+    if (c->pipeline) {
+        pipeline_write(c->pipeline, img);
+        return 0;
+    }
     return vf_do_filter(c->first, img);
 }
 
@@ -472,11 +794,22 @@ static int vf_output_frame_until(struct vf_chain *c, struct vf_instance *until,
 //  returns: -1: error, 0: no output, 1: output available
 int vf_output_frame(struct vf_chain *c, bool eof)
 {
+    if (c->pipeline)
+        return pipeline_output(c->pipeline, eof);
     return vf_output_frame_until(c, c->last, eof);
 }
 
 struct mp_image *vf_read_output_frame(struct vf_chain *c)
 {
+    struct vf_pipeline *pipe = c->pipeline;
+    if (pipe) {
+        struct mp_image *img = NULL;
+        if (pipeline_output(pipe, false)) {
+            img = pipe->out[0];
+            MP_TARRAY_REMOVE_AT(pipe->out, pipe->num_out, 0);
+        }
+        return img;
+    }
     if (!c->last->num_out_queued)
         vf_output_frame(c, false);
     return vf_dequeue_output_frame(c->last);
@@ -485,6 +818,11 @@ struct mp_image *vf_read_output_frame(struct vf_chain *c)
 // Undo the previous vf_read_output_frame().
 void vf_unread_output_frame(struct vf_chain *c, struct mp_image *img)
 {
+    struct vf_pipeline *pipe = c->pipeline;
+    if (pipe) {
+        MP_TARRAY_INSERT_AT(pipe, pipe->out, pipe->num_out, 0, img);
+        return;
+    }
     struct vf_instance *vf = c->last;
     MP_TARRAY_INSERT_AT(vf, vf->out_queued, vf->num_out_queued, 0, img);
 }
@@ -500,6 +838,9 @@ void vf_unread_output_frame(struct vf_chain *c, struct mp_image *img)
 // returns -1: error, 0: nothing needed, 1: add new frame with vf_filter_frame()
 int vf_needs_input(struct vf_chain *c)
 {
+    // Keep the input queue filled, so that all filters have work to do.
+    if (c->pipeline)
+        return !pipeline_input_full(c->pipeline);
     struct vf_instance *prev = c->first;
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         while (cur->needs_input && cur->needs_input(cur)) {
@@ -530,8 +871,11 @@ static void vf_chain_forget_frames(struct vf_chain *c)
         vf_forget_frames(cur);
 }
 
+// With --vf-queue-frames, this leaves the filter threads stopped until the next
+// input or output call.
 void vf_seek_reset(struct vf_chain *c)
 {
+    pipeline_reset(c);
     vf_control_all(c, VFCTRL_SEEK_RESET, NULL);
     vf_chain_forget_frames(c);
 }
@@ -694,6 +1038,7 @@ static int vf_reconfig_wrapper(struct vf_instance *vf,
 int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params)
 {
     int r = 0;
+    pipeline_destroy(c);
     vf_seek_reset(c);
     for (struct vf_instance *vf = c->first; vf; ) {
         struct vf_instance *next = vf->next;
@@ -733,6 +1078,8 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params)
     vf_print_filter_chain(c, loglevel, failing);
     if (r < 0)
         c->output_params = (struct mp_image_params){0};
+    if (r >= 0)
+        pipeline_create(c);
     return r;
 }
 
@@ -813,6 +1160,7 @@ void vf_destroy(struct vf_chain *c)
 {
     if (!c)
         return;
+    pipeline_destroy(c);
     av_buffer_unref(&c->in_hwframes_ref);
     while (c->first) {
         vf_instance_t *vf = c->first;
@@ -102,6 +102,8 @@ typedef struct vf_instance {
     struct mp_image **out_queued;
     int num_out_queued;
 
+    struct mp_perf_stat *perf;
+
     // Caches valid output formats.
     uint8_t last_outfmts[IMGFMT_END - IMGFMT_START];
 
@@ -135,6 +137,8 @@ struct vf_chain {
     // since they are supposed to call it from foreign threads.
     void (*wakeup_callback)(void *ctx);
     void *wakeup_callback_ctx;
+
+    struct vf_pipeline *pipeline; // --vf-queue-frames threads, or NULL
 };
 
 enum vf_ctrl {
@@ -158,11 +162,14 @@ int vf_needs_input(struct vf_chain *c);
 struct mp_image *vf_read_output_frame(struct vf_chain *c);
 void vf_unread_output_frame(struct vf_chain *c, struct mp_image *img);
 void vf_seek_reset(struct vf_chain *c);
+bool vf_is_busy(struct vf_chain *c, bool eof);
 struct vf_instance *vf_append_filter(struct vf_chain *c, const char *name,
                                      char **args);
 void vf_remove_filter(struct vf_chain *c, struct vf_instance *vf);
 int vf_append_filter_list(struct vf_chain *c, struct m_obj_settings *list);
 struct vf_instance *vf_find_by_label(struct vf_chain *c, const char *label);
+struct mpv_node;
+void vf_get_perf_node(struct vf_chain *c, struct mpv_node *dst);
 void vf_print_filter_chain(struct vf_chain *c, int msglevel,
                            struct vf_instance *vf);
 
@@ -0,0 +1,99 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libavutil/frame.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixfmt.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "vf.h"
+
+// Maps hardware surfaces to another hardware format with av_hwframe_map(),
+// without copying the image data through system memory. Currently this is
+// only VAAPI -> DRM PRIME (e.g. VAAPI decoding or vf_vavpp, and a VO which
+// takes DRM PRIME frames). Usually inserted automatically by vf.c as
+// conversion filter.
+
+static bool test_conversion(int in, int out)
+{
+    return in == IMGFMT_VAAPI && out == IMGFMT_DRMPRIME;
+}
+
+static struct mp_image *filter(struct vf_instance *vf, struct mp_image *mpi)
+{
+    struct mp_image *res = NULL;
+    AVFrame *src = mp_image_to_av_frame(mpi);
+    AVFrame *dst = av_frame_alloc();
+    if (!src || !dst)
+        goto done;
+
+    dst->format = AV_PIX_FMT_DRM_PRIME;
+    if (av_hwframe_map(dst, src, AV_HWFRAME_MAP_READ) < 0) {
+        MP_ERR(vf, "Mapping the surface failed.\n");
+        goto done;
+    }
+    if (av_frame_copy_props(dst, src) < 0)
+        goto done;
+
+    res = mp_image_from_av_frame(dst);
+    if (res) {
+        mp_image_copy_attributes(res, mpi);
+        res->params = vf->fmt_out;
+    }
+
+done:
+    av_frame_free(&src);
+    av_frame_free(&dst);
+    talloc_free(mpi);
+    return res;
+}
+
+static int reconfig(struct vf_instance *vf, struct mp_image_params *in,
+                    struct mp_image_params *out)
+{
+    if (!test_conversion(in->imgfmt, IMGFMT_DRMPRIME))
+        return -1;
+    *out = *in;
+    out->imgfmt = IMGFMT_DRMPRIME;
+    return 0;
+}
+
+static int query_format(struct vf_instance *vf, unsigned int fmt)
+{
+    if (test_conversion(fmt, IMGFMT_DRMPRIME))
+        return vf_next_query_format(vf, IMGFMT_DRMPRIME);
+    return 0;
+}
+
+static int vf_open(vf_instance_t *vf)
+{
+    vf->reconfig = reconfig;
+    vf->filter = filter;
+    vf->query_format = query_format;
+    return 1;
+}
+
+const vf_info_t vf_info_hwmap = {
+    .description = "map hardware surfaces between APIs",
+    .name = "hwmap",
+    .open = vf_open,
+    .test_conversion = test_conversion,
+};
@@ -32,8 +32,10 @@
 #include "config.h"
 
 #include "common/msg.h"
+#include "common/tags.h"
 #include "options/m_option.h"
 #include "options/path.h"
+#include "osdep/timer.h"
 
 #include "video/img_format.h"
 #include "video/mp_image.h"
@@ -70,7 +72,11 @@ struct vf_priv_s {
     double out_pts;             // pts corresponding to first requested/ready frame
     struct mp_image **requested;// frame callback results (can point to dummy_img)
                                 // requested[0] is the frame to return first
+    int64_t *request_time;      // mp_time_us() of the request for requested[n]
     int max_requests;           // upper bound for requested[] array
+    int max_prefetch;           // upper bound for filtered frames in vf queue
+    double latency_last;        // script latency of the last frame (seconds)
+    double latency_avg;         // running average of the above
     bool failed;                // frame callback returned with an error
     bool shutdown;              // ask node to return
     bool eof;                   // drain remaining data
@@ -82,6 +88,9 @@ struct vf_priv_s {
     char *cfg_file;
     int cfg_maxbuffer;
     int cfg_maxrequests;
+    int cfg_maxprefetch;
+
+    struct mp_tags *metadata;   // for VFCTRL_GET_METADATA
 };
 
 // priv->requested[n] points to this if a request for frame n is in-progress
@@ -263,6 +272,11 @@ static void VS_CC vs_frame_done(void *userData, const VSFrameRef *f, int n,
     MP_DBG(vf, "filtered frame %d (%d)\n", n, index);
     assert(p->requested[index] == &dummy_img);
 
+    double latency = (mp_time_us() - p->request_time[index]) / 1e6;
+    p->latency_last = latency;
+    p->latency_avg = p->latency_avg > 0 ? p->latency_avg * 0.9 + latency * 0.1
+                                        : latency;
+
     struct mp_image *res = NULL;
     if (f) {
         struct mp_image img = map_vs_frame(p, f, false);
@@ -310,8 +324,10 @@ static bool locked_read_output(struct vf_instance *vf)
             p->out_pts += duration;
         }
         vf_add_output_frame(vf, out);
-        for (int n = 0; n < p->max_requests - 1; n++)
+        for (int n = 0; n < p->max_requests - 1; n++) {
             p->requested[n] = p->requested[n + 1];
+            p->request_time[n] = p->request_time[n + 1];
+        }
         p->requested[p->max_requests - 1] = NULL;
         p->out_frameno++;
         r = true;
@@ -327,6 +343,7 @@ static bool locked_read_output(struct vf_instance *vf)
             // Note: this assumes getFrameAsync() will never call
             //       infiltGetFrame (if it does, we would deadlock)
             p->requested[n] = (struct mp_image *)&dummy_img;
+            p->request_time[n] = mp_time_us();
             p->failed = false;
             MP_DBG(vf, "requesting frame %d (%d)\n", p->out_frameno + n, n);
             p->vsapi->getFrameAsync(p->out_frameno + n, p->out_node,
@@ -421,7 +438,7 @@ static bool needs_input(struct vf_instance *vf)
     bool r = false;
     pthread_mutex_lock(&p->lock);
     locked_read_output(vf);
-    r = vf->num_out_queued < p->max_requests && locked_need_input(vf);
+    r = vf->num_out_queued < p->max_prefetch && locked_need_input(vf);
     pthread_mutex_unlock(&p->lock);
     return r;
 }
@@ -718,6 +735,25 @@ static int control(vf_instance_t *vf, int request, void *data)
         if (p->out_node && reinit_vs(vf) < 0)
             return CONTROL_ERROR;
         return CONTROL_OK;
+    case VFCTRL_GET_METADATA: {
+        pthread_mutex_lock(&p->lock);
+        double last = p->latency_last, avg = p->latency_avg;
+        int pending = num_requested(p);
+        pthread_mutex_unlock(&p->lock);
+        talloc_free(p->metadata);
+        p->metadata = talloc_zero(NULL, struct mp_tags);
+        char buf[40];
+        snprintf(buf, sizeof(buf), "%.3f", last * 1000);
+        mp_tags_set_str(p->metadata, "latency-ms", buf);
+        snprintf(buf, sizeof(buf), "%.3f", avg * 1000);
+        mp_tags_set_str(p->metadata, "latency-avg-ms", buf);
+        snprintf(buf, sizeof(buf), "%d", pending);
+        mp_tags_set_str(p->metadata, "pending-requests", buf);
+        snprintf(buf, sizeof(buf), "%d", vf->num_out_queued);
+        mp_tags_set_str(p->metadata, "prefetched-frames", buf);
+        *(struct mp_tags *)data = *p->metadata;
+        return CONTROL_OK;
+    }
     }
     return CONTROL_UNKNOWN;
 }
@@ -728,6 +764,7 @@ static void uninit(struct vf_instance *vf)
 
     destroy_vs(vf);
     p->drv->uninit(vf);
+    talloc_free(p->metadata);
 
     pthread_cond_destroy(&p->wakeup);
     pthread_mutex_destroy(&p->lock);
@@ -756,10 +793,15 @@ static int vf_open(vf_instance_t *vf)
     p->max_requests = p->cfg_maxrequests;
     if (p->max_requests < 0)
         p->max_requests = av_cpu_count();
-    MP_VERBOSE(vf, "using %d concurrent requests.\n", p->max_requests);
+    p->max_prefetch = p->cfg_maxprefetch;
+    if (p->max_prefetch < 0)
+        p->max_prefetch = p->max_requests;
+    MP_VERBOSE(vf, "using %d concurrent requests, prefetching %d frames.\n",
+               p->max_requests, p->max_prefetch);
     int maxbuffer = p->cfg_maxbuffer * p->max_requests;
     p->buffered = talloc_array(vf, struct mp_image *, maxbuffer);
     p->requested = talloc_zero_array(vf, struct mp_image *, p->max_requests);
+    p->request_time = talloc_zero_array(vf, int64_t, p->max_requests);
     return 1;
 }
 
@@ -769,6 +811,8 @@ static const m_option_t vf_opts_fields[] = {
     OPT_INTRANGE("buffered-frames", cfg_maxbuffer, 0, 1, 9999, OPTDEF_INT(4)),
     OPT_CHOICE_OR_INT("concurrent-frames", cfg_maxrequests, 0, 1, 99,
                       ({"auto", -1}), OPTDEF_INT(-1)),
+    OPT_CHOICE_OR_INT("prefetch-frames", cfg_maxprefetch, 0, 1, 9999,
+                      ({"auto", -1}), OPTDEF_INT(-1)),
     {0}
 };
 
@@ -0,0 +1,88 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "common/common.h"
+
+#include "gpu_memcpy.h"
+
+#if HAVE_SSE4_INTRINSICS
+
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#include <smmintrin.h>
+
+// Reads from uncached speculative write combining (USWC) memory, such as
+// mapped hardware decoder surfaces, are very slow with normal loads. The
+// SSE4.1 streaming loads fetch a full cache line at once.
+static void *memcpy_sse4(void *restrict d, const void *restrict s, size_t size)
+{
+    uint8_t *dst = d;
+    const uint8_t *src = s;
+
+    // Streaming loads require aligned source addresses.
+    size_t head = MPMIN((16 - ((uintptr_t)src & 15)) & 15, size);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+
+    _mm_mfence();
+
+    bool dst_aligned = !((uintptr_t)dst & 15);
+    for (; size >= 64; size -= 64) {
+        __m128i x0 = _mm_stream_load_si128((__m128i *)src + 0);
+        __m128i x1 = _mm_stream_load_si128((__m128i *)src + 1);
+        __m128i x2 = _mm_stream_load_si128((__m128i *)src + 2);
+        __m128i x3 = _mm_stream_load_si128((__m128i *)src + 3);
+        if (dst_aligned) {
+            _mm_store_si128((__m128i *)dst + 0, x0);
+            _mm_store_si128((__m128i *)dst + 1, x1);
+            _mm_store_si128((__m128i *)dst + 2, x2);
+            _mm_store_si128((__m128i *)dst + 3, x3);
+        } else {
+            _mm_storeu_si128((__m128i *)dst + 0, x0);
+            _mm_storeu_si128((__m128i *)dst + 1, x1);
+            _mm_storeu_si128((__m128i *)dst + 2, x2);
+            _mm_storeu_si128((__m128i *)dst + 3, x3);
+        }
+        src += 64;
+        dst += 64;
+    }
+
+    memcpy(dst, src, size);
+    return d;
+}
+
+#pragma GCC pop_options
+
+#endif
+
+// Like memcpy(), but faster if s points to memory which is mapped from the GPU.
+// Works with any memory, but is not necessarily faster for normal memory.
+void *gpu_memcpy(void *restrict d, const void *restrict s, size_t size)
+{
+#if HAVE_SSE4_INTRINSICS
+    if (__builtin_cpu_supports("sse4.1"))
+        return memcpy_sse4(d, s, size);
+#endif
+    return memcpy(d, s, size);
+}
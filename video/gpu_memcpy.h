@@ -0,0 +1,8 @@
+#ifndef MP_GPU_MEMCPY_H
+#define MP_GPU_MEMCPY_H
+
+#include <stddef.h>
+
+void *gpu_memcpy(void *restrict d, const void *restrict s, size_t size);
+
+#endif
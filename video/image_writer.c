@@ -55,6 +55,7 @@ const struct m_opt_choice_alternatives mp_image_writer_formats[] = {
     {"jpg",  AV_CODEC_ID_MJPEG},
     {"jpeg", AV_CODEC_ID_MJPEG},
     {"png",  AV_CODEC_ID_PNG},
+    {"ppm",  AV_CODEC_ID_PPM},
     {0}
 };
 
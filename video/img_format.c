@@ -17,6 +17,7 @@
 
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/pixfmt.h>
@@ -121,7 +122,7 @@ static struct mp_imgfmt_desc mp_only_imgfmt_desc(int mpfmt)
     return (struct mp_imgfmt_desc) {0};
 }
 
-struct mp_imgfmt_desc mp_imgfmt_get_desc(int mpfmt)
+static struct mp_imgfmt_desc compute_imgfmt_desc(int mpfmt)
 {
     enum AVPixelFormat fmt = imgfmt2pixfmt(mpfmt);
     const AVPixFmtDescriptor *pd = av_pix_fmt_desc_get(fmt);
@@ -363,7 +364,7 @@ static bool is_native_endian(const AVPixFmtDescriptor *pixdesc)
     return pixdesc && (is_le != !!(pixdesc->flags & AV_PIX_FMT_FLAG_BE));
 }
 
-bool mp_get_regular_imgfmt(struct mp_regular_imgfmt *dst, int imgfmt)
+static bool compute_regular_imgfmt(struct mp_regular_imgfmt *dst, int imgfmt)
 {
     struct mp_regular_imgfmt res = {0};
 
@@ -453,6 +454,52 @@ bool mp_get_regular_imgfmt(struct mp_regular_imgfmt *dst, int imgfmt)
     return true;
 }
 
+// Descriptors never change at runtime, but are queried per frame in many
+// places, so compute them once for all formats.
+#define NUM_IMGFMTS (IMGFMT_END - IMGFMT_START)
+
+static struct {
+    struct mp_imgfmt_desc desc;
+    struct mp_regular_imgfmt regular;
+    bool is_regular;
+} imgfmt_cache[NUM_IMGFMTS];
+
+static pthread_once_t imgfmt_cache_once = PTHREAD_ONCE_INIT;
+
+static void init_imgfmt_cache(void)
+{
+    for (int n = 0; n < NUM_IMGFMTS; n++) {
+        int imgfmt = IMGFMT_START + n;
+        imgfmt_cache[n].desc = compute_imgfmt_desc(imgfmt);
+        imgfmt_cache[n].is_regular =
+            compute_regular_imgfmt(&imgfmt_cache[n].regular, imgfmt);
+    }
+}
+
+static bool imgfmt_is_cached(int imgfmt)
+{
+    if (imgfmt < IMGFMT_START || imgfmt >= IMGFMT_END)
+        return false;
+    pthread_once(&imgfmt_cache_once, init_imgfmt_cache);
+    return true;
+}
+
+struct mp_imgfmt_desc mp_imgfmt_get_desc(int mpfmt)
+{
+    if (!imgfmt_is_cached(mpfmt))
+        return compute_imgfmt_desc(mpfmt);
+    return imgfmt_cache[mpfmt - IMGFMT_START].desc;
+}
+
+bool mp_get_regular_imgfmt(struct mp_regular_imgfmt *dst, int imgfmt)
+{
+    if (!imgfmt_is_cached(imgfmt))
+        return compute_regular_imgfmt(dst, imgfmt);
+    if (!imgfmt_cache[imgfmt - IMGFMT_START].is_regular)
+        return false;
+    *dst = imgfmt_cache[imgfmt - IMGFMT_START].regular;
+    return true;
+}
 
 // Find a format that has the given flags set with the following configuration.
 int mp_imgfmt_find(int xs, int ys, int planes, int component_bits, int flags)
@@ -35,6 +35,7 @@
 #include "config.h"
 #include "common/av_common.h"
 #include "common/common.h"
+#include "gpu_memcpy.h"
 #include "hwdec.h"
 #include "mp_image.h"
 #include "sws_utils.h"
@@ -480,6 +481,13 @@ void mp_image_copy(struct mp_image *dst, struct mp_image *src)
     mp_image_copy_cb(dst, src, memcpy);
 }
 
+// Like mp_image_copy(), but faster if src is mapped GPU memory (see
+// gpu_memcpy()).
+void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src)
+{
+    mp_image_copy_cb(dst, src, gpu_memcpy);
+}
+
 static enum mp_csp mp_image_params_get_forced_csp(struct mp_image_params *params)
 {
     int imgfmt = params->hw_subfmt ? params->hw_subfmt : params->imgfmt;
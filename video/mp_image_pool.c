@@ -29,6 +29,7 @@
 #include "mpv_talloc.h"
 
 #include "common/common.h"
+#include "osdep/atomic.h"
 
 #include "fmt-conversion.h"
 #include "mp_image.h"
@@ -38,15 +39,27 @@ static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
 #define pool_lock() pthread_mutex_lock(&pool_mutex)
 #define pool_unlock() pthread_mutex_unlock(&pool_mutex)
 
+// Sum of the data sizes of all images allocated by any pool and not yet freed.
+static atomic_llong pool_total_bytes;
+
+// Software images allocated by the pool itself are rounded up to these, so
+// that images with slightly different sizes (e.g. after a crop filter changed
+// its parameters) can be reused. The returned image is cropped to the
+// requested size.
+#define SIZE_CLASS_W 64
+#define SIZE_CLASS_H 16
+
 // Thread-safety: the pool itself is not thread-safe, but pool-allocated images
 // can be referenced and unreferenced from other threads. (As long as the image
 // destructors are thread-safe.)
 
 struct mp_image_pool {
     int max_count;
+    int64_t max_bytes;
 
     struct mp_image **images;
     int num_images;
+    int64_t num_bytes;          // sum of image_flags.size of all images
 
     mp_image_allocator allocator;
     void *allocator_ctx;
@@ -62,8 +75,15 @@ struct image_flags {
     bool referenced;            // outside mp_image reference exists
     bool pool_alive;            // the mp_image_pool references this
     unsigned int order;         // for LRU allocation (basically a timestamp)
+    int64_t size;               // data size included in pool_total_bytes
 };
 
+static void image_flags_destructor(void *ptr)
+{
+    struct image_flags *it = ptr;
+    atomic_fetch_add(&pool_total_bytes, -it->size);
+}
+
 static void image_pool_destructor(void *ptr)
 {
     struct mp_image_pool *pool = ptr;
@@ -76,10 +96,25 @@ struct mp_image_pool *mp_image_pool_new(int max_count)
     talloc_set_destructor(pool, image_pool_destructor);
     *pool = (struct mp_image_pool) {
         .max_count = max_count,
+        .max_bytes = INT64_MAX,
     };
     return pool;
 }
 
+// Limit the sum of the data sizes of the images the pool keeps around. If the
+// limit is exceeded, the least recently used unreferenced images are freed.
+// This is a soft limit: images still referenced by someone are never freed.
+void mp_image_pool_set_max_bytes(struct mp_image_pool *pool, int64_t max_bytes)
+{
+    pool->max_bytes = max_bytes;
+}
+
+// Return the total size of the image data allocated by all image pools.
+int64_t mp_image_pool_get_total_bytes(void)
+{
+    return atomic_load(&pool_total_bytes);
+}
+
 void mp_image_pool_clear(struct mp_image_pool *pool)
 {
     for (int n = 0; n < pool->num_images; n++) {
@@ -95,6 +130,55 @@ void mp_image_pool_clear(struct mp_image_pool *pool)
             talloc_free(img);
     }
     pool->num_images = 0;
+    pool->num_bytes = 0;
+}
+
+// Free unreferenced images, least recently used first, until there is room for
+// a new image of the given size. Returns false if that's not possible.
+static bool evict_images(struct mp_image_pool *pool, int64_t new_size)
+{
+    while (pool->num_images >= pool->max_count ||
+           pool->num_bytes + new_size > pool->max_bytes)
+    {
+        int idx = -1;
+        pool_lock();
+        for (int n = 0; n < pool->num_images; n++) {
+            struct image_flags *it = pool->images[n]->priv;
+            struct image_flags *old_it =
+                idx >= 0 ? pool->images[idx]->priv : NULL;
+            if (!it->referenced && (!old_it || it->order < old_it->order))
+                idx = n;
+        }
+        // Unreferenced images can't become referenced from other threads.
+        if (idx >= 0)
+            ((struct image_flags *)pool->images[idx]->priv)->pool_alive = false;
+        pool_unlock();
+        if (idx < 0)
+            return false;
+        struct mp_image *img = pool->images[idx];
+        pool->num_bytes -= ((struct image_flags *)img->priv)->size;
+        MP_TARRAY_REMOVE_AT(pool->images, pool->num_images, idx);
+        talloc_free(img);
+    }
+    return true;
+}
+
+static int64_t get_image_size(struct mp_image *img)
+{
+    if (img->fmt.flags & MP_IMGFLAG_HWACCEL)
+        return 0;
+    int64_t size = 0;
+    for (int p = 0; p < MP_MAX_PLANES; p++) {
+        if (img->bufs[p])
+            size += img->bufs[p]->size;
+    }
+    return size;
+}
+
+static bool use_size_classes(struct mp_image_pool *pool, int fmt)
+{
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(fmt);
+    return !pool->allocator && !(desc.flags & MP_IMGFLAG_HWACCEL);
 }
 
 // This is the only function that is allowed to run in a different thread.
@@ -119,13 +203,20 @@ struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h)
 {
     struct mp_image *new = NULL;
+    int class_w = w, class_h = h;
+    if (use_size_classes(pool, fmt)) {
+        class_w = MP_ALIGN_UP(w, SIZE_CLASS_W);
+        class_h = MP_ALIGN_UP(h, SIZE_CLASS_H);
+    }
     pool_lock();
     for (int n = 0; n < pool->num_images; n++) {
         struct mp_image *img = pool->images[n];
         struct image_flags *img_it = img->priv;
         assert(img_it->pool_alive);
-        if (!img_it->referenced) {
-            if (img->imgfmt == fmt && img->w == w && img->h == h) {
+        if (!img_it->referenced && img->imgfmt == fmt) {
+            if ((img->w == w && img->h == h) ||
+                (img->w == class_w && img->h == class_h))
+            {
                 if (pool->use_lru) {
                     struct image_flags *new_it = new ? new->priv : NULL;
                     if (!new_it || new_it->order > img_it->order)
@@ -148,6 +239,7 @@ struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
         assert(!!new->bufs[p] == !p); // only 1 AVBufferRef
 
     struct mp_image *ref = mp_image_new_dummy_ref(new);
+    mp_image_set_size(ref, w, h);
 
     // This assumes the buffer is at this point exclusively owned by us: we
     // can't track whether the buffer is unique otherwise.
@@ -170,9 +262,16 @@ struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
 void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new)
 {
     struct image_flags *it = talloc_ptrtype(new, it);
-    *it = (struct image_flags) { .pool_alive = true };
+    *it = (struct image_flags) {
+        .pool_alive = true,
+        .order = pool->lru_counter,
+        .size = get_image_size(new),
+    };
     new->priv = it;
+    atomic_fetch_add(&pool_total_bytes, it->size);
+    talloc_set_destructor(it, image_flags_destructor);
     MP_TARRAY_APPEND(pool, pool->images, pool->num_images, new);
+    pool->num_bytes += it->size;
 }
 
 // Return a new image of given format/size. The only difference to
@@ -188,12 +287,22 @@ struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
         return mp_image_alloc(fmt, w, h);
     struct mp_image *new = mp_image_pool_get_no_alloc(pool, fmt, w, h);
     if (!new) {
-        if (pool->num_images >= pool->max_count)
+        int64_t size = 0;
+        int alloc_w = w, alloc_h = h;
+        if (use_size_classes(pool, fmt)) {
+            alloc_w = MP_ALIGN_UP(w, SIZE_CLASS_W);
+            alloc_h = MP_ALIGN_UP(h, SIZE_CLASS_H);
+            size = mp_image_get_alloc_size(fmt, alloc_w, alloc_h, 1);
+        }
+        // If everything is still referenced, start over (existing references
+        // stay valid, and the images are freed when they are unreferenced).
+        if (!evict_images(pool, MPMAX(size, 0)) &&
+            pool->num_images >= pool->max_count)
             mp_image_pool_clear(pool);
         if (pool->allocator) {
             new = pool->allocator(pool->allocator_ctx, fmt, w, h);
         } else {
-            new = mp_image_alloc(fmt, w, h);
+            new = mp_image_alloc(fmt, alloc_w, alloc_h);
         }
         if (!new)
             return NULL;
@@ -251,6 +360,43 @@ void mp_image_pool_set_lru(struct mp_image_pool *pool)
     pool->use_lru = true;
 }
 
+// Map the hw surface and read it back with gpu_memcpy(). The mapped memory is
+// usually uncached, which makes the plain memcpy() libavutil uses for
+// av_hwframe_transfer_data() very slow. dst must have the same size as src.
+static bool hw_download_mapped(struct mp_image *dst, struct mp_image *src)
+{
+    AVHWFramesContext *fctx = (void *)src->hwctx->data;
+    enum AVHWDeviceType type = fctx->device_ctx->type;
+    if (type != AV_HWDEVICE_TYPE_VAAPI && type != AV_HWDEVICE_TYPE_DXVA2 &&
+        type != AV_HWDEVICE_TYPE_D3D11VA)
+        return false;
+
+    bool ok = false;
+    struct mp_image *map = NULL;
+    AVFrame *srcav = mp_image_to_av_frame(src);
+    AVFrame *mapav = av_frame_alloc();
+    if (!srcav || !mapav)
+        goto done;
+
+    mapav->format = imgfmt2pixfmt(dst->imgfmt);
+    if (av_hwframe_map(mapav, srcav, AV_HWFRAME_MAP_READ) < 0)
+        goto done;
+
+    map = mp_image_from_av_frame(mapav);
+    if (map && map->imgfmt == dst->imgfmt && map->w >= dst->w &&
+        map->h >= dst->h)
+    {
+        mp_image_set_size(map, dst->w, dst->h);
+        mp_image_copy_gpu(dst, map);
+        ok = true;
+    }
+
+done:
+    talloc_free(map);
+    av_frame_free(&mapav);
+    av_frame_free(&srcav);
+    return ok;
+}
 
 // Copies the contents of the HW surface img to system memory and retuns it.
 // If swpool is not NULL, it's used to allocate the target image.
@@ -285,6 +431,13 @@ struct mp_image *mp_image_hw_download(struct mp_image *src,
     if (!dst)
         return NULL;
 
+    mp_image_set_size(dst, src->w, src->h);
+    if (hw_download_mapped(dst, src)) {
+        mp_image_copy_attributes(dst, src);
+        return dst;
+    }
+    mp_image_set_size(dst, fctx->width, fctx->height);
+
     // Target image must be writable, so unref it.
     AVFrame *dstav = mp_image_to_av_frame_and_unref(dst);
     if (!dstav)
@@ -2,6 +2,7 @@
 #define MPV_MP_IMAGE_POOL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct mp_image_pool;
 
@@ -13,6 +14,9 @@ void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new);
 void mp_image_pool_clear(struct mp_image_pool *pool);
 
 void mp_image_pool_set_lru(struct mp_image_pool *pool);
+void mp_image_pool_set_max_bytes(struct mp_image_pool *pool, int64_t max_bytes);
+
+int64_t mp_image_pool_get_total_bytes(void);
 
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h);
@@ -23,6 +23,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <limits.h>
+#include <string.h>
 
 #include <libavutil/common.h>
 
@@ -48,82 +49,110 @@ void packer_get_bb(struct bitmap_packer *packer, struct pos out_bb[2])
     out_bb[1] = (struct pos) {packer->used_width, packer->used_height};
 }
 
-#define HEIGHT_SORT_BITS 4
-static int size_index(int s)
+// Segment of the skyline: the top edge of the already packed area.
+struct skyline_node {
+    int x, y, w;
+};
+
+// Size of a rectangle to pack, and its index in the input.
+struct packer_rect {
+    int w, h, index;
+};
+
+// Sort by decreasing height, then by decreasing width.
+static int cmp_rects(const void *pa, const void *pb)
 {
-    int n = av_log2_16bit(s);
-    return (n << HEIGHT_SORT_BITS)
-       + ((- 1 - (s << HEIGHT_SORT_BITS >> n)) & ((1 << HEIGHT_SORT_BITS) - 1));
+    const struct packer_rect *a = pa, *b = pb;
+    if (a->h != b->h)
+        return a->h > b->h ? -1 : 1;
+    if (a->w != b->w)
+        return a->w > b->w ? -1 : 1;
+    return a->index - b->index;
 }
 
 /* Pack the given rectangles into an area of size w * h.
  * The size of each rectangle is read from in[i].x / in[i].y.
- * The height of each rectangle must be less than 65536.
- * 'scratch' must point to work memory for num_rects+16 ints.
+ * 'rects' must point to work memory for num_rects entries, and 'nodes' to
+ * num_rects + 1 entries.
  * The packed position for rectangle number i is set in out[i].
- * Return 0 on success, -1 if the rectangles did not fit in w*h.
+ * Return the used height on success, -1 if the rectangles did not fit in w*h.
  *
- * The rectangles are placed in rows in order approximately sorted by
- * height (the approximate sorting is simpler than a full one would be,
- * and allows the algorithm to work in linear time). Additionally, to
- * reduce wasted space when there are a few tall rectangles, empty
- * lower-right parts of rows are filled recursively when the size of
- * rectangles in the row drops past a power-of-two threshold. So if a
- * row starts with rectangles of size 3x50, 10x40 and 5x20 then the
- * free rectangle with corners (13, 20)-(w, 50) is filled recursively.
+ * This uses the skyline algorithm: the top edge of the packed area is kept as
+ * a list of horizontal segments. The rectangles are placed tallest first,
+ * each at the position where its top edge ends up lowest (preferring the
+ * leftmost position on ties), which fills the gaps next to taller rectangles
+ * much better than packing them in rows.
  */
 static int pack_rectangles(struct pos *in, struct pos *out, int num_rects,
-                           int w, int h, int *scratch, int *used_width)
+                           int w, int h, struct packer_rect *rects,
+                           struct skyline_node *nodes, int *used_width)
 {
-    int bins[16 << HEIGHT_SORT_BITS];
-    int sizes[16 << HEIGHT_SORT_BITS] = { 0 };
     for (int i = 0; i < num_rects; i++)
-        sizes[size_index(in[i].y)]++;
-    int idx = 0;
-    for (int i = 0; i < 16 << HEIGHT_SORT_BITS; i += 1 << HEIGHT_SORT_BITS) {
-        for (int j = 0; j < 1 << HEIGHT_SORT_BITS; j++) {
-            bins[i + j] = idx;
-            idx += sizes[i + j];
+        rects[i] = (struct packer_rect){in[i].x, in[i].y, i};
+    qsort(rects, num_rects, sizeof(rects[0]), cmp_rects);
+
+    int num_nodes = 1;
+    nodes[0] = (struct skyline_node){0, 0, w};
+    int used_height = 0;
+
+    for (int i = 0; i < num_rects; i++) {
+        int obj = rects[i].index;
+        int rw = rects[i].w, rh = rects[i].h;
+        out[obj] = (struct pos){0, 0};
+        if (rw <= 0 || rh <= 0)
+            continue;
+
+        int best = -1, best_y = 0, best_top = INT_MAX;
+        for (int n = 0; n < num_nodes; n++) {
+            int x = nodes[n].x;
+            if (x + rw > w)
+                break;
+            // The rectangle rests on the highest segment below it.
+            int y = 0;
+            for (int k = n, left = rw; left > 0; k++) {
+                y = MPMAX(y, nodes[k].y);
+                left -= nodes[k].w;
+            }
+            if (y + rh <= h && y + rh < best_top) {
+                best = n;
+                best_y = y;
+                best_top = y + rh;
+            }
         }
-        scratch[idx++] = -1;
-    }
-    for (int i = 0; i < num_rects; i++)
-        scratch[bins[size_index(in[i].y)]++] = i;
-    for (int i = 0; i < 16; i++)
-        bins[i] = bins[i << HEIGHT_SORT_BITS] - sizes[i << HEIGHT_SORT_BITS];
-    struct {
-        int size, x, bottom;
-    } stack[16] = {{15, 0, h}}, s = {};
-    int stackpos = 1;
-    int y;
-    while (stackpos) {
-        y = s.bottom;
-        s = stack[--stackpos];
-        s.size++;
-        while (s.size--) {
-            int maxy = -1;
-            int obj;
-            while ((obj = scratch[bins[s.size]]) >= 0) {
-                int bottom = y + in[obj].y;
-                if (bottom > s.bottom)
-                    break;
-                int right = s.x + in[obj].x;
-                if (right > w)
-                    break;
-                bins[s.size]++;
-                out[obj] = (struct pos){s.x, y};
-                num_rects--;
-                if (maxy < 0)
-                    stack[stackpos++] = s;
-                s.x = right;
-                maxy = FFMAX(maxy, bottom);
+        if (best < 0)
+            return -1;
+
+        int x = nodes[best].x, end = x + rw;
+        out[obj] = (struct pos){x, best_y};
+        *used_width = MPMAX(*used_width, end);
+        used_height = MPMAX(used_height, best_top);
+
+        // Replace the covered segments with the new one.
+        int k = best;
+        while (k < num_nodes && nodes[k].x + nodes[k].w <= end)
+            k++;
+        if (k < num_nodes && nodes[k].x < end) {
+            nodes[k].w -= end - nodes[k].x;
+            nodes[k].x = end;
+        }
+        memmove(&nodes[best + 1], &nodes[k], (num_nodes - k) * sizeof(nodes[0]));
+        num_nodes -= k - best - 1;
+        nodes[best] = (struct skyline_node){x, best_top, rw};
+
+        // Merge neighbouring segments of the same height.
+        for (int n = MPMAX(best - 1, 0); n + 1 < num_nodes && n <= best;) {
+            if (nodes[n].y == nodes[n + 1].y) {
+                nodes[n].w += nodes[n + 1].w;
+                memmove(&nodes[n + 1], &nodes[n + 2],
+                        (num_nodes - n - 2) * sizeof(nodes[0]));
+                num_nodes--;
+                best--;
+            } else {
+                n++;
             }
-            *used_width = FFMAX(*used_width, s.x);
-            if (maxy > 0)
-                s.bottom = maxy;
         }
     }
-    return num_rects ? -1 : y;
+    return used_height;
 }
 
 int packer_pack(struct bitmap_packer *packer)
@@ -132,6 +161,17 @@ int packer_pack(struct bitmap_packer *packer)
         return 0;
     int w_orig = packer->w, h_orig = packer->h;
     struct pos *in = packer->in;
+
+    // Often the bitmaps have the same sizes as in the previous call (e.g. only
+    // the colors changed, or a different part of the OSD). Keep the layout
+    // in this case; users can then update only the changed bitmaps.
+    if (packer->count == packer->prev_count && w_orig == packer->prev_w &&
+        h_orig == packer->prev_h &&
+        memcmp(in, packer->prev_in, packer->count * sizeof(in[0])) == 0)
+        return 0;
+    memcpy(packer->prev_in, in, packer->count * sizeof(in[0]));
+    packer->prev_count = -1;
+
     int xmax = 0, ymax = 0;
     for (int i = 0; i < packer->count; i++) {
         if (in[i].x <= 0 || in[i].y <= 0) {
@@ -155,7 +195,7 @@ int packer_pack(struct bitmap_packer *packer)
         int used_width = 0;
         int y = pack_rectangles(in, packer->result, packer->count,
                                 packer->w, packer->h,
-                                packer->scratch, &used_width);
+                                packer->rects, packer->nodes, &used_width);
         if (y >= 0) {
             packer->used_width = FFMIN(used_width, packer->w);
             packer->used_height = FFMIN(y, packer->h);
@@ -167,6 +207,9 @@ int packer_pack(struct bitmap_packer *packer)
                     packer->result[i].y += packer->padding;
                 }
             }
+            packer->prev_count = packer->count;
+            packer->prev_w = packer->w;
+            packer->prev_h = packer->h;
             return packer->w != w_orig || packer->h != h_orig;
         }
         int w_max = packer->w_max > 0 ? packer->w_max : INT_MAX;
@@ -190,10 +233,17 @@ void packer_set_size(struct bitmap_packer *packer, int size)
         return;
     packer->asize = FFMAX(packer->asize * 2, size);
     talloc_free(packer->result);
-    talloc_free(packer->scratch);
+    talloc_free(packer->rects);
+    talloc_free(packer->nodes);
+    talloc_free(packer->prev_in);
     packer->in = talloc_realloc(packer, packer->in, struct pos, packer->asize);
     packer->result = talloc_array_ptrtype(packer, packer->result,
                                           packer->asize);
-    packer->scratch = talloc_array_ptrtype(packer, packer->scratch,
-                                           packer->asize + 16);
+    packer->rects = talloc_array_ptrtype(packer, packer->rects,
+                                         packer->asize);
+    packer->nodes = talloc_array_ptrtype(packer, packer->nodes,
+                                         packer->asize + 1);
+    packer->prev_in = talloc_array_ptrtype(packer, packer->prev_in,
+                                           packer->asize);
+    packer->prev_count = 0;
 }
@@ -19,7 +19,10 @@ struct bitmap_packer {
     int used_height;
 
     // internal
-    int *scratch;
+    struct packer_rect *rects;
+    struct skyline_node *nodes;
+    struct pos *prev_in;
+    int prev_count, prev_w, prev_h;
     int asize;
 };
 
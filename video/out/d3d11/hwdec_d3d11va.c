@@ -36,11 +36,12 @@ struct d3d11va_opts {
 #define OPT_BASE_STRUCT struct d3d11va_opts
 const struct m_sub_options d3d11va_conf = {
     .opts = (const struct m_option[]) {
-        OPT_FLAG("d3d11va-zero-copy", zero_copy, 0),
+        OPT_CHOICE("d3d11va-zero-copy", zero_copy, 0,
+                   ({"no", 0}, {"yes", 1}, {"auto", -1})),
         {0}
     },
     .defaults = &(const struct d3d11va_opts) {
-        .zero_copy = 0,
+        .zero_copy = -1,
     },
     .size = sizeof(struct d3d11va_opts)
 };
@@ -63,6 +64,8 @@ struct priv {
     const struct ra_format *fmt[4];
 };
 
+static int init_copy(struct ra_hwdec_mapper *mapper);
+
 static void uninit(struct ra_hwdec *hw)
 {
     struct priv_owner *p = hw->priv;
@@ -128,7 +131,6 @@ static int mapper_init(struct ra_hwdec_mapper *mapper)
 {
     struct priv_owner *o = mapper->owner->priv;
     struct priv *p = mapper->priv;
-    HRESULT hr;
 
     mapper->dst_params = mapper->src_params;
     mapper->dst_params.imgfmt = mapper->src_params.hw_subfmt;
@@ -139,62 +141,84 @@ static int mapper_init(struct ra_hwdec_mapper *mapper)
     if (!ra_get_imgfmt_desc(mapper->ra, mapper->dst_params.imgfmt, &desc))
         return -1;
 
-    if (o->opts->zero_copy) {
-        // In the zero-copy path, we create the ra_tex objects in the map
-        // operation, so we just need to store the format of each plane
-        p->num_planes = desc.num_planes;
-        for (int i = 0; i < desc.num_planes; i++)
-            p->fmt[i] = desc.planes[i];
-    } else {
-        struct mp_image layout = {0};
-        mp_image_set_params(&layout, &mapper->dst_params);
-
-        DXGI_FORMAT copy_fmt;
-        switch (mapper->dst_params.imgfmt) {
-        case IMGFMT_NV12: copy_fmt = DXGI_FORMAT_NV12; break;
-        case IMGFMT_P010: copy_fmt = DXGI_FORMAT_P010; break;
-        default: return -1;
-        }
+    // In the zero-copy path, we create the ra_tex objects in the map
+    // operation, so we just need to store the format of each plane
+    p->num_planes = desc.num_planes;
+    for (int i = 0; i < desc.num_planes; i++)
+        p->fmt[i] = desc.planes[i];
 
-        D3D11_TEXTURE2D_DESC copy_desc = {
-            .Width = mapper->dst_params.w,
-            .Height = mapper->dst_params.h,
-            .MipLevels = 1,
-            .ArraySize = 1,
-            .SampleDesc.Count = 1,
-            .Format = copy_fmt,
-            .BindFlags = D3D11_BIND_SHADER_RESOURCE,
-        };
-        hr = ID3D11Device_CreateTexture2D(o->device, &copy_desc, NULL,
-                                          &p->copy_tex);
-        if (FAILED(hr)) {
-            MP_FATAL(mapper, "Could not create shader resource texture\n");
-            return -1;
-        }
+    // With "auto", the copy path is only set up once a frame turns out to be
+    // not bindable as shader resource.
+    if (!o->opts->zero_copy)
+        return init_copy(mapper);
 
-        for (int i = 0; i < desc.num_planes; i++) {
-            mapper->tex[i] = ra_d3d11_wrap_tex_video(mapper->ra, p->copy_tex,
-                mp_image_plane_w(&layout, i), mp_image_plane_h(&layout, i), 0,
-                desc.planes[i]);
-            if (!mapper->tex[i]) {
-                MP_FATAL(mapper, "Could not create RA texture view\n");
-                return -1;
-            }
-        }
+    return 0;
+}
+
+static int init_copy(struct ra_hwdec_mapper *mapper)
+{
+    struct priv_owner *o = mapper->owner->priv;
+    struct priv *p = mapper->priv;
+    HRESULT hr;
+
+    struct mp_image layout = {0};
+    mp_image_set_params(&layout, &mapper->dst_params);
 
-        // A ref to the immediate context is needed for CopySubresourceRegion
-        ID3D11Device1_GetImmediateContext1(o->device1, &p->ctx);
+    DXGI_FORMAT copy_fmt;
+    switch (mapper->dst_params.imgfmt) {
+    case IMGFMT_NV12: copy_fmt = DXGI_FORMAT_NV12; break;
+    case IMGFMT_P010: copy_fmt = DXGI_FORMAT_P010; break;
+    default: return -1;
     }
 
+    D3D11_TEXTURE2D_DESC copy_desc = {
+        .Width = mapper->dst_params.w,
+        .Height = mapper->dst_params.h,
+        .MipLevels = 1,
+        .ArraySize = 1,
+        .SampleDesc.Count = 1,
+        .Format = copy_fmt,
+        .BindFlags = D3D11_BIND_SHADER_RESOURCE,
+    };
+    hr = ID3D11Device_CreateTexture2D(o->device, &copy_desc, NULL,
+                                      &p->copy_tex);
+    if (FAILED(hr)) {
+        MP_FATAL(mapper, "Could not create shader resource texture\n");
+        return -1;
+    }
+
+    for (int i = 0; i < p->num_planes; i++) {
+        mapper->tex[i] = ra_d3d11_wrap_tex_video(mapper->ra, p->copy_tex,
+            mp_image_plane_w(&layout, i), mp_image_plane_h(&layout, i), 0,
+            p->fmt[i]);
+        if (!mapper->tex[i]) {
+            MP_FATAL(mapper, "Could not create RA texture view\n");
+            return -1;
+        }
+    }
+
+    // A ref to the immediate context is needed for CopySubresourceRegion
+    ID3D11Device1_GetImmediateContext1(o->device1, &p->ctx);
     return 0;
 }
 
 static int mapper_map(struct ra_hwdec_mapper *mapper)
 {
+    struct priv_owner *o = mapper->owner->priv;
     struct priv *p = mapper->priv;
     ID3D11Texture2D *tex = (void *)mapper->src->planes[0];
     int subresource = (intptr_t)mapper->src->planes[1];
 
+    if (!p->copy_tex && o->opts->zero_copy < 0) {
+        D3D11_TEXTURE2D_DESC desc2d;
+        ID3D11Texture2D_GetDesc(tex, &desc2d);
+        if (!(desc2d.BindFlags & D3D11_BIND_SHADER_RESOURCE)) {
+            MP_VERBOSE(mapper, "Decoder surface not bindable, copying.\n");
+            if (init_copy(mapper) < 0)
+                return -1;
+        }
+    }
+
     if (p->copy_tex) {
         ID3D11DeviceContext1_CopySubresourceRegion1(p->ctx,
             (ID3D11Resource *)p->copy_tex, 0, 0, 0, 0,
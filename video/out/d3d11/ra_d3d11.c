@@ -2076,6 +2076,12 @@ static void destroy(struct ra *ra)
     talloc_free(ra);
 }
 
+static void flush(struct ra *ra)
+{
+    struct ra_d3d11 *p = ra->priv;
+    ID3D11DeviceContext_Flush(p->ctx);
+}
+
 static struct ra_fns ra_fns_d3d11 = {
     .destroy            = destroy,
     .tex_create         = tex_create,
@@ -2096,6 +2102,7 @@ static struct ra_fns ra_fns_d3d11 = {
     .timer_start        = timer_start,
     .timer_stop         = timer_stop,
     .debug_marker       = debug_marker,
+    .flush              = flush,
 };
 
 void ra_d3d11_flush(struct ra *ra)
@@ -27,6 +27,7 @@
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <libavutil/lfg.h>
 
@@ -164,6 +165,55 @@ void mp_make_fruit_dither_matrix(float *out_matrix, int size)
     talloc_free(k);
 }
 
+// The matrix only depends on the size, so it's computed once per process.
+static pthread_mutex_t fruit_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static float *fruit_cache[MAX_SIZEB + 1];
+
+static bool load_matrix(const char *cache_file, float *m, size_t size)
+{
+    FILE *f = fopen(cache_file, "rb");
+    if (!f)
+        return false;
+    bool ok = fread(m, size, 1, f) == 1 && fgetc(f) == EOF;
+    fclose(f);
+    return ok;
+}
+
+static void save_matrix(const char *cache_file, const float *m, size_t size)
+{
+    FILE *f = fopen(cache_file, "wb");
+    if (!f)
+        return;
+    bool ok = fwrite(m, size, 1, f) == 1;
+    if (fclose(f) || !ok)
+        remove(cache_file);
+}
+
+// Like mp_make_fruit_dither_matrix(), but return a shared matrix, which is
+// computed only once per process. If cache_file is not NULL, the matrix is
+// also loaded from or written to that file. The returned pointer is valid
+// forever, and must not be modified.
+const float *mp_get_fruit_dither_matrix(int size, const char *cache_file)
+{
+    assert(size >= 1 && size <= MAX_SIZEB);
+
+    pthread_mutex_lock(&fruit_cache_lock);
+    float *m = fruit_cache[size];
+    if (!m) {
+        int tsize = 1 << size;
+        size_t bytes = sizeof(float) * tsize * tsize;
+        m = talloc_size(NULL, bytes);
+        if (!cache_file || !load_matrix(cache_file, m, bytes)) {
+            mp_make_fruit_dither_matrix(m, size);
+            if (cache_file)
+                save_matrix(cache_file, m, bytes);
+        }
+        fruit_cache[size] = m;
+    }
+    pthread_mutex_unlock(&fruit_cache_lock);
+    return m;
+}
+
 void mp_make_ordered_dither_matrix(unsigned char *m, int size)
 {
     m[0] = 0;
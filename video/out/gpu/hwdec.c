@@ -27,6 +27,7 @@
 
 extern const struct ra_hwdec_driver ra_hwdec_vaegl;
 extern const struct ra_hwdec_driver ra_hwdec_vaglx;
+extern const struct ra_hwdec_driver ra_hwdec_vaapi_vk;
 extern const struct ra_hwdec_driver ra_hwdec_videotoolbox;
 extern const struct ra_hwdec_driver ra_hwdec_vdpau;
 extern const struct ra_hwdec_driver ra_hwdec_dxva2egl;
@@ -37,6 +38,7 @@ extern const struct ra_hwdec_driver ra_hwdec_dxva2;
 extern const struct ra_hwdec_driver ra_hwdec_d3d11va;
 extern const struct ra_hwdec_driver ra_hwdec_cuda;
 extern const struct ra_hwdec_driver ra_hwdec_cuda_nvdec;
+extern const struct ra_hwdec_driver ra_hwdec_cuda_vk;
 extern const struct ra_hwdec_driver ra_hwdec_rpi_overlay;
 extern const struct ra_hwdec_driver ra_hwdec_drmprime_drm;
 
@@ -47,6 +49,9 @@ static const struct ra_hwdec_driver *const mpgl_hwdec_drivers[] = {
 #if HAVE_VAAPI_GLX
     &ra_hwdec_vaglx,
 #endif
+#if HAVE_VAAPI_VULKAN
+    &ra_hwdec_vaapi_vk,
+#endif
 #if HAVE_VDPAU_GL_X11
     &ra_hwdec_vdpau,
 #endif
@@ -69,6 +74,9 @@ static const struct ra_hwdec_driver *const mpgl_hwdec_drivers[] = {
 #if HAVE_CUDA_HWACCEL
     &ra_hwdec_cuda,
 #endif
+#if HAVE_CUDA_VULKAN
+    &ra_hwdec_cuda_vk,
+#endif
 #if HAVE_RPI
     &ra_hwdec_rpi_overlay,
 #endif
@@ -192,8 +200,9 @@ void ra_hwdec_uninit(struct ra_hwdec *hwdec)
 
 bool ra_hwdec_test_format(struct ra_hwdec *hwdec, int imgfmt)
 {
-    for (int n = 0; hwdec->driver->imgfmts[n]; n++) {
-        if (hwdec->driver->imgfmts[n] == imgfmt)
+    const int *imgfmts = hwdec->imgfmts ? hwdec->imgfmts : hwdec->driver->imgfmts;
+    for (int n = 0; imgfmts[n]; n++) {
+        if (imgfmts[n] == imgfmt)
             return true;
     }
     return false;
@@ -19,6 +19,9 @@ struct ra_hwdec {
     bool probing;
     // Used in overlay mode only.
     float overlay_colorkey[4];
+    // Optionally set by init() if the supported formats depend on the
+    // runtime environment. 0-terminated; replaces driver->imgfmts.
+    const int *imgfmts;
 };
 
 struct ra_hwdec_mapper {
@@ -17,6 +17,7 @@
 
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "mpv_talloc.h"
 
@@ -341,6 +342,50 @@ static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
     return vid_profile;
 }
 
+// Recently generated LUTs, shared by all VO instances in the process, so that
+// switching between files (or recreating the VO) doesn't regenerate them.
+#define LUT3D_CACHE_ENTRIES 4
+
+struct lut3d_cache_entry {
+    uint8_t hash[32];
+    uint16_t *data;     // talloc allocation
+};
+
+static pthread_mutex_t lut3d_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct lut3d_cache_entry lut3d_cache[LUT3D_CACHE_ENTRIES];
+
+static bool lut3d_cache_get(const uint8_t hash[32], uint16_t *out, size_t size)
+{
+    bool found = false;
+    pthread_mutex_lock(&lut3d_cache_lock);
+    for (int n = 0; n < LUT3D_CACHE_ENTRIES; n++) {
+        struct lut3d_cache_entry *e = &lut3d_cache[n];
+        if (e->data && memcmp(e->hash, hash, 32) == 0 &&
+            talloc_get_size(e->data) == size)
+        {
+            memcpy(out, e->data, size);
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lut3d_cache_lock);
+    return found;
+}
+
+static void lut3d_cache_put(const uint8_t hash[32], const uint16_t *data,
+                            size_t size)
+{
+    pthread_mutex_lock(&lut3d_cache_lock);
+    // Drop the oldest entry.
+    talloc_free(lut3d_cache[LUT3D_CACHE_ENTRIES - 1].data);
+    memmove(&lut3d_cache[1], &lut3d_cache[0],
+            sizeof(lut3d_cache[0]) * (LUT3D_CACHE_ENTRIES - 1));
+    struct lut3d_cache_entry *e = &lut3d_cache[0];
+    memcpy(e->hash, hash, 32);
+    e->data = talloc_memdup(NULL, data, size);
+    pthread_mutex_unlock(&lut3d_cache_lock);
+}
+
 bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
                        enum mp_csp_prim prim, enum mp_csp_trc trc,
                        struct AVBufferRef *vid_profile)
@@ -374,28 +419,33 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
     struct lut3d *lut = NULL;
     cmsContext cms = NULL;
 
+    // Gamma is included in the header to help uniquely identify it,
+    // because we may change the parameter in the future or make it
+    // customizable, same for the primaries.
+    char *cache_info = talloc_asprintf(tmp,
+            "ver=1.4, intent=%d, size=%dx%dx%d, prim=%d, trc=%d, "
+            "contrast=%d\n",
+            p->opts->intent, s_r, s_g, s_b, prim, trc, p->opts->contrast);
+
+    uint8_t hash[32];
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha)
+        abort();
+    av_sha_init(sha, 256);
+    av_sha_update(sha, cache_info, strlen(cache_info));
+    if (vid_profile)
+        av_sha_update(sha, vid_profile->data, vid_profile->size);
+    av_sha_update(sha, p->icc_data, p->icc_size);
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    if (lut3d_cache_get(hash, output, talloc_get_size(output))) {
+        MP_VERBOSE(p, "Reusing previously generated 3D LUT.\n");
+        goto done;
+    }
+
     char *cache_file = NULL;
     if (p->opts->cache_dir && p->opts->cache_dir[0]) {
-        // Gamma is included in the header to help uniquely identify it,
-        // because we may change the parameter in the future or make it
-        // customizable, same for the primaries.
-        char *cache_info = talloc_asprintf(tmp,
-                "ver=1.4, intent=%d, size=%dx%dx%d, prim=%d, trc=%d, "
-                "contrast=%d\n",
-                p->opts->intent, s_r, s_g, s_b, prim, trc, p->opts->contrast);
-
-        uint8_t hash[32];
-        struct AVSHA *sha = av_sha_alloc();
-        if (!sha)
-            abort();
-        av_sha_init(sha, 256);
-        av_sha_update(sha, cache_info, strlen(cache_info));
-        if (vid_profile)
-            av_sha_update(sha, vid_profile->data, vid_profile->size);
-        av_sha_update(sha, p->icc_data, p->icc_size);
-        av_sha_final(sha, hash);
-        av_free(sha);
-
         char *cache_dir = mp_get_user_path(tmp, p->global, p->opts->cache_dir);
         cache_file = talloc_strdup(tmp, "");
         for (int i = 0; i < sizeof(hash); i++)
@@ -412,6 +462,7 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
                                                  1000000000); // 1 GB
         if (cachedata.len == talloc_get_size(output)) {
             memcpy(output, cachedata.start, cachedata.len);
+            lut3d_cache_put(hash, output, talloc_get_size(output));
             goto done;
         } else {
             MP_WARN(p, "3D LUT cache invalid!\n");
@@ -461,6 +512,8 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
 
     cmsDeleteTransform(trafo);
 
+    lut3d_cache_put(hash, output, talloc_get_size(output));
+
     if (cache_file) {
         FILE *out = fopen(cache_file, "wb");
         if (out) {
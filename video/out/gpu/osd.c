@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
 
 #include <libavutil/common.h>
 
@@ -53,6 +54,8 @@ struct mpgl_osd_part {
     enum sub_bitmap_format format;
     int change_id;
     struct ra_tex *texture;
+    struct mp_image *shadow; // copy of the texture contents
+    struct mp_rect shadow_rc; // area where shadow is known to match texture
     int w, h;
     int num_subparts;
     int prev_num_subparts;
@@ -107,6 +110,7 @@ void mpgl_osd_destroy(struct mpgl_osd *ctx)
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
         struct mpgl_osd_part *p = ctx->parts[n];
         ra_tex_free(ctx->ra, &p->texture);
+        talloc_free(p->shadow);
     }
     talloc_free(ctx);
 }
@@ -120,11 +124,25 @@ static int next_pow2(int v)
     return INT_MAX;
 }
 
+// Whether the w*h area at (x, y) is the same in both images.
+static bool image_area_equal(struct mp_image *a, struct mp_image *b,
+                             int x, int y, int w, int h)
+{
+    int bpp = a->fmt.bytes[0];
+    for (int n = y; n < y + h; n++) {
+        if (memcmp(a->planes[0] + n * a->stride[0] + x * bpp,
+                   b->planes[0] + n * b->stride[0] + x * bpp, w * bpp))
+            return false;
+    }
+    return true;
+}
+
 static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
                        struct sub_bitmaps *imgs)
 {
     struct ra *ra = ctx->ra;
     bool ok = false;
+    bool reallocated = false;
 
     assert(imgs->packed);
 
@@ -138,6 +156,8 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
         osd->format != imgs->format)
     {
         ra_tex_free(ra, &osd->texture);
+        TA_FREEP(&osd->shadow);
+        reallocated = true;
 
         osd->format = imgs->format;
         osd->w = FFMAX(32, req_w);
@@ -167,16 +187,73 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
             goto done;
     }
 
+    struct mp_image *src = imgs->packed;
+    struct mp_rect rc = {0, 0, imgs->packed_w, imgs->packed_h};
+
+    // Upload only the area covering the bitmaps that differ from what is
+    // already in the texture. This helps if only some bitmaps change, because
+    // the packer keeps the layout if the bitmap sizes stay the same.
+    if (!reallocated && osd->shadow) {
+        struct mp_rect dirty_rc = {0};
+        bool dirty = false, full = false;
+        for (int n = 0; n < imgs->num_parts; n++) {
+            struct sub_bitmap *b = &imgs->parts[n];
+            struct mp_rect b_rc = {b->src_x, b->src_y,
+                                   b->src_x + b->w, b->src_y + b->h};
+            struct mp_rect *v = &osd->shadow_rc;
+            if (b_rc.x0 < v->x0 || b_rc.y0 < v->y0 ||
+                b_rc.x1 > v->x1 || b_rc.y1 > v->y1)
+            {
+                full = true;
+                break;
+            }
+            if (image_area_equal(osd->shadow, src, b->src_x, b->src_y,
+                                 b->w, b->h))
+                continue;
+            if (dirty) {
+                mp_rect_union(&dirty_rc, &b_rc);
+            } else {
+                dirty_rc = b_rc;
+            }
+            dirty = true;
+        }
+        if (!full) {
+            if (!dirty) {
+                ok = true;
+                goto done;
+            }
+            rc = dirty_rc;
+        }
+    }
+    bool full_upload = rc.x0 == 0 && rc.y0 == 0 && rc.x1 == imgs->packed_w &&
+                       rc.y1 == imgs->packed_h;
+
+    int bpp = src->fmt.bytes[0];
     struct ra_tex_upload_params params = {
         .tex = osd->texture,
-        .src = imgs->packed->planes[0],
-        .invalidate = true,
-        .rc = &(struct mp_rect){0, 0, imgs->packed_w, imgs->packed_h},
-        .stride = imgs->packed->stride[0],
+        .src = src->planes[0] + rc.y0 * src->stride[0] + rc.x0 * bpp,
+        .invalidate = reallocated,
+        .rc = &rc,
+        .stride = src->stride[0],
     };
 
     ok = ra->fns->tex_upload(ra, &params);
 
+    if (ok && !osd->shadow && full_upload) {
+        osd->shadow = mp_image_alloc(src->imgfmt, osd->w, osd->h);
+        talloc_steal(osd, osd->shadow);
+    }
+    if (ok && osd->shadow) {
+        // (A partial upload is always within shadow_rc.)
+        memcpy_pic(osd->shadow->planes[0] + rc.y0 * osd->shadow->stride[0] +
+                   rc.x0 * bpp, params.src, mp_rect_w(rc) * bpp, mp_rect_h(rc),
+                   osd->shadow->stride[0], src->stride[0]);
+        if (full_upload)
+            osd->shadow_rc = rc;
+    } else if (!ok) {
+        TA_FREEP(&osd->shadow);
+    }
+
 done:
     return ok;
 }
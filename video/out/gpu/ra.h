@@ -3,6 +3,8 @@
 #include "common/common.h"
 #include "misc/bstr.h"
 
+struct mp_gpu_mem_stats;
+
 // Handle for a rendering API backend.
 struct ra {
     struct ra_fns *fns;
@@ -53,6 +55,7 @@ enum {
     RA_CAP_GLOBAL_UNIFORM = 1 << 8, // supports using "naked" uniforms (not UBO)
     RA_CAP_GATHER         = 1 << 9, // supports textureGather in GLSL
     RA_CAP_FRAGCOORD      = 1 << 10, // supports reading from gl_FragCoord
+    RA_CAP_PARALLEL_COMPILE = 1 << 11, // renderpass_create is thread-safe
 };
 
 enum ra_ctype {
@@ -428,6 +431,9 @@ struct ra_fns {
     // Compile a shader and create a pipeline. This is a rare operation.
     // The params pointer and anything it points to must stay valid until
     // renderpass_destroy.
+    // If RA_CAP_PARALLEL_COMPILE is set, this may be called from another
+    // thread, concurrently with all other functions except renderpass_destroy
+    // of the returned pass.
     struct ra_renderpass *(*renderpass_create)(struct ra *ra,
                                     const struct ra_renderpass_params *params);
 
@@ -459,6 +465,13 @@ struct ra_fns {
     // Associates a marker with any past error messages, for debugging
     // purposes. Optional.
     void (*debug_marker)(struct ra *ra, const char *msg);
+
+    // Report memory usage statistics. Optional.
+    void (*mem_stats)(struct ra *ra, struct mp_gpu_mem_stats *out);
+
+    // Submit all pending commands to the GPU, without waiting for them to
+    // complete. Optional.
+    void (*flush)(struct ra *ra);
 };
 
 struct ra_tex *ra_tex_create(struct ra *ra, const struct ra_tex_params *params);
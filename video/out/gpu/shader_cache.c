@@ -4,6 +4,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/sha.h>
 #include <libavutil/mem.h>
@@ -11,12 +12,17 @@
 #include "osdep/io.h"
 
 #include "common/common.h"
+#include "misc/thread_pool.h"
 #include "options/path.h"
+#include "osdep/timer.h"
 #include "stream/stream.h"
 #include "shader_cache.h"
 #include "utils.h"
 
-// Force cache flush if more than this number of shaders is created.
+static const char sc_cache_header[] = "mpv shader cache v1\n";
+
+// If more than this number of shaders is created, the least recently used one
+// is removed.
 #define SC_MAX_ENTRIES 48
 
 union uniform_val {
@@ -49,11 +55,30 @@ struct sc_cached_uniform {
     bool set; // whether the uniform has ever been set
 };
 
+// A renderpass being created on the compile thread.
+struct sc_compile_job {
+    struct ra *ra;
+    struct ra_renderpass_params *params;
+    char *cache_dir, *cache_filename;
+    void (*done_cb)(void *ctx);
+    void *done_ctx;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    bool done;
+    struct ra_renderpass *pass;
+    int64_t compile_time_us;
+};
+
 struct sc_entry {
     struct ra_renderpass *pass;
+    struct sc_compile_job *job; // if non-NULL, pass is still being created
     struct sc_cached_uniform *cached_uniforms;
     int num_cached_uniforms;
     bstr total;
+    uint64_t hash; // of total
+    uint64_t last_use; // value of gl_shader_cache.use_counter
     struct timer_pool *timer;
     struct ra_buf *ubo;
     int ubo_index; // for ra_renderpass_input_val.index
@@ -82,6 +107,9 @@ struct gl_shader_cache {
 
     struct sc_entry **entries;
     int num_entries;
+    uint64_t use_counter;
+
+    struct mp_shader_cache_perf perf;
 
     struct sc_entry *current_shader; // set by gl_sc_generate()
 
@@ -99,6 +127,13 @@ struct gl_shader_cache {
     bool needs_reset;
 
     bool error_state; // true if an error occurred
+    bool compile_pending; // true if a pass was skipped due to async_compile
+
+    // For creating renderpasses asynchronously.
+    bool async_compile;
+    struct mp_thread_pool *compile_pool;
+    void (*compile_cb)(void *ctx);
+    void *compile_cb_ctx;
 
     // temporary buffers (avoids frequent reallocations)
     bstr tmp[6];
@@ -142,21 +177,53 @@ void gl_sc_reset(struct gl_shader_cache *sc)
     sc->needs_reset = false;
 }
 
+static bool sc_finish_job(struct gl_shader_cache *sc, struct sc_entry *entry,
+                          bool wait);
+
+static void sc_destroy_entry(struct gl_shader_cache *sc, struct sc_entry *e)
+{
+    if (e->job)
+        sc_finish_job(sc, e, true);
+    ra_buf_free(sc->ra, &e->ubo);
+    if (e->pass)
+        sc->ra->fns->renderpass_destroy(sc->ra, e->pass);
+    timer_pool_destroy(e->timer);
+    talloc_free(e);
+}
+
 static void sc_flush_cache(struct gl_shader_cache *sc)
 {
     MP_VERBOSE(sc, "flushing shader cache\n");
 
-    for (int n = 0; n < sc->num_entries; n++) {
-        struct sc_entry *e = sc->entries[n];
-        ra_buf_free(sc->ra, &e->ubo);
-        if (e->pass)
-            sc->ra->fns->renderpass_destroy(sc->ra, e->pass);
-        timer_pool_destroy(e->timer);
-        talloc_free(e);
-    }
+    for (int n = 0; n < sc->num_entries; n++)
+        sc_destroy_entry(sc, sc->entries[n]);
     sc->num_entries = 0;
 }
 
+static void sc_evict_lru(struct gl_shader_cache *sc)
+{
+    int lru = 0;
+    for (int n = 1; n < sc->num_entries; n++) {
+        if (sc->entries[n]->last_use < sc->entries[lru]->last_use)
+            lru = n;
+    }
+
+    sc_destroy_entry(sc, sc->entries[lru]);
+    MP_TARRAY_REMOVE_AT(sc->entries, sc->num_entries, lru);
+    sc->perf.evictions++;
+}
+
+// FNV-1a
+static uint64_t sc_hash(bstr s)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t n = 0; n < s.len; n++) {
+        h ^= (unsigned char)s.start[n];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
 void gl_sc_destroy(struct gl_shader_cache *sc)
 {
     if (!sc)
@@ -176,6 +243,22 @@ void gl_sc_reset_error(struct gl_shader_cache *sc)
     sc->error_state = false;
 }
 
+// Return whether a gl_sc_dispatch_* call was skipped since the last call to
+// this function, because its renderpass was still being created.
+bool gl_sc_check_pending(struct gl_shader_cache *sc)
+{
+    bool res = sc->compile_pending;
+    sc->compile_pending = false;
+    return res;
+}
+
+void gl_sc_perfdata(struct gl_shader_cache *sc, struct mp_shader_cache_perf *out)
+{
+    *out = sc->perf;
+    out->entries = sc->num_entries;
+    out->max_entries = SC_MAX_ENTRIES;
+}
+
 void gl_sc_enable_extension(struct gl_shader_cache *sc, char *name)
 {
     for (int n = 0; n < sc->num_exts; n++) {
@@ -543,6 +626,100 @@ void gl_sc_set_cache_dir(struct gl_shader_cache *sc, const char *dir)
     sc->cache_dir = talloc_strdup(sc, dir);
 }
 
+// Create new renderpasses on a separate thread. While this is enabled, dispatch
+// calls for shaders that are not ready yet do nothing (see
+// gl_sc_check_pending()). Once a renderpass is done, cb(cb_ctx) is called from
+// the compile thread. This does nothing if the RA doesn't support it.
+void gl_sc_set_async_compile(struct gl_shader_cache *sc, bool enable,
+                             void (*cb)(void *ctx), void *cb_ctx)
+{
+    if (!(sc->ra->caps & RA_CAP_PARALLEL_COMPILE))
+        enable = false;
+
+    if (enable && !sc->compile_pool) {
+        sc->compile_pool = mp_thread_pool_create(sc, 1);
+        if (!sc->compile_pool)
+            enable = false;
+    }
+
+    sc->async_compile = enable;
+    sc->compile_cb = cb;
+    sc->compile_cb_ctx = cb_ctx;
+}
+
+static void write_cache_file(struct gl_shader_cache *sc,
+                             struct ra_renderpass *pass, bstr old_program,
+                             const char *cache_dir, const char *cache_filename)
+{
+    bstr nc = pass->params.cached_program;
+    if (!nc.len || bstr_equals(old_program, nc))
+        return;
+
+    mp_mkdirp(cache_dir);
+
+    MP_VERBOSE(sc, "Writing shader cache file: %s\n", cache_filename);
+    FILE *out = fopen(cache_filename, "wb");
+    if (out) {
+        fwrite(sc_cache_header, strlen(sc_cache_header), 1, out);
+        fwrite(nc.start, nc.len, 1, out);
+        fclose(out);
+    }
+}
+
+static void compile_job_fn(void *ptr)
+{
+    struct sc_compile_job *job = ptr;
+    void (*cb)(void *ctx) = job->done_cb;
+    void *cb_ctx = job->done_ctx;
+
+    int64_t start = mp_time_us();
+    struct ra_renderpass *pass =
+        job->ra->fns->renderpass_create(job->ra, job->params);
+    int64_t compile_time = mp_time_us() - start;
+
+    pthread_mutex_lock(&job->lock);
+    job->pass = pass;
+    job->compile_time_us = compile_time;
+    job->done = true;
+    pthread_cond_broadcast(&job->wakeup);
+    pthread_mutex_unlock(&job->lock);
+
+    // (job may be freed at this point)
+    if (cb)
+        cb(cb_ctx);
+}
+
+// Pick up the result of entry->job. If wait is false and the job is not done
+// yet, return false.
+static bool sc_finish_job(struct gl_shader_cache *sc, struct sc_entry *entry,
+                          bool wait)
+{
+    struct sc_compile_job *job = entry->job;
+
+    pthread_mutex_lock(&job->lock);
+    while (wait && !job->done)
+        pthread_cond_wait(&job->wakeup, &job->lock);
+    bool done = job->done;
+    pthread_mutex_unlock(&job->lock);
+
+    if (!done)
+        return false;
+
+    entry->pass = job->pass;
+    sc->perf.compile_time += job->compile_time_us * 1000;
+    if (!entry->pass) {
+        sc->error_state = true;
+    } else if (job->cache_filename) {
+        write_cache_file(sc, entry->pass, job->params->cached_program,
+                         job->cache_dir, job->cache_filename);
+    }
+
+    pthread_cond_destroy(&job->wakeup);
+    pthread_mutex_destroy(&job->lock);
+    TA_FREEP(&entry->job);
+    return true;
+}
+
 static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
 {
     bool ret = false;
@@ -559,7 +736,6 @@ static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
     if (sc->text.len)
         mp_log_source(sc->log, MSGL_V, sc->text.start);
 
-    const char *cache_header = "mpv shader cache v1\n";
     char *cache_filename = NULL;
     char *cache_dir = NULL;
 
@@ -586,7 +762,7 @@ static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
             MP_VERBOSE(sc, "Trying to load shader from disk...\n");
             struct bstr cachedata =
                 stream_read_file(cache_filename, tmp, sc->global, 1000000000);
-            if (bstr_eatstart0(&cachedata, cache_header))
+            if (bstr_eatstart0(&cachedata, sc_cache_header))
                 params.cached_program = cachedata;
         }
     }
@@ -624,23 +800,33 @@ static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
         }
     }
 
+    if (sc->async_compile) {
+        struct sc_compile_job *job = talloc_ptrtype(entry, job);
+        *job = (struct sc_compile_job){
+            .ra = sc->ra,
+            .cache_dir = talloc_strdup(job, cache_dir),
+            .cache_filename = talloc_strdup(job, cache_filename),
+            .done_cb = sc->compile_cb,
+            .done_ctx = sc->compile_cb_ctx,
+        };
+        job->params = ra_renderpass_params_copy(job, &params);
+        pthread_mutex_init(&job->lock, NULL);
+        pthread_cond_init(&job->wakeup, NULL);
+        entry->job = job;
+        mp_thread_pool_queue(sc->compile_pool, compile_job_fn, job);
+        ret = true;
+        goto error;
+    }
+
+    int64_t start = mp_time_us();
     entry->pass = sc->ra->fns->renderpass_create(sc->ra, &params);
+    sc->perf.compile_time += (mp_time_us() - start) * 1000;
     if (!entry->pass)
         goto error;
 
-    if (entry->pass && cache_filename) {
-        bstr nc = entry->pass->params.cached_program;
-        if (nc.len && !bstr_equals(params.cached_program, nc)) {
-            mp_mkdirp(cache_dir);
-
-            MP_VERBOSE(sc, "Writing shader cache file: %s\n", cache_filename);
-            FILE *out = fopen(cache_filename, "wb");
-            if (out) {
-                fwrite(cache_header, strlen(cache_header), 1, out);
-                fwrite(nc.start, nc.len, 1, out);
-                fclose(out);
-            }
-        }
+    if (cache_filename) {
+        write_cache_file(sc, entry->pass, params.cached_program, cache_dir,
+                         cache_filename);
     }
 
     ret = true;
@@ -905,20 +1091,25 @@ static void gl_sc_generate(struct gl_shader_cache *sc,
     if (sc->params.target_format)
         ADD(hash_total, "format %s\n", sc->params.target_format->name);
 
+    uint64_t hash = sc_hash(*hash_total);
     struct sc_entry *entry = NULL;
     for (int n = 0; n < sc->num_entries; n++) {
         struct sc_entry *cur = sc->entries[n];
-        if (bstr_equals(cur->total, *hash_total)) {
+        if (cur->hash == hash && bstr_equals(cur->total, *hash_total)) {
             entry = cur;
             break;
         }
     }
-    if (!entry) {
+    if (entry) {
+        sc->perf.hits++;
+    } else {
+        sc->perf.misses++;
         if (sc->num_entries == SC_MAX_ENTRIES)
-            sc_flush_cache(sc);
+            sc_evict_lru(sc);
         entry = talloc_ptrtype(NULL, entry);
         *entry = (struct sc_entry){
             .total = bstrdup(entry, *hash_total),
+            .hash = hash,
             .timer = timer_pool_create(sc->ra),
         };
 
@@ -950,6 +1141,16 @@ static void gl_sc_generate(struct gl_shader_cache *sc,
         MP_TARRAY_APPEND(sc, sc->entries, sc->num_entries, entry);
     }
 
+    entry->last_use = ++sc->use_counter;
+
+    // If the renderpass is still being created, skip it, unless async
+    // creation was disabled in the meantime.
+    if (entry->job && !sc_finish_job(sc, entry, !sc->async_compile)) {
+        sc->compile_pending = true;
+        sc->current_shader = NULL;
+        return;
+    }
+
     if (!entry->pass) {
         sc->current_shader = NULL;
         return;
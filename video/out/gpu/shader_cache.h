@@ -60,3 +60,7 @@ struct mp_pass_perf gl_sc_dispatch_compute(struct gl_shader_cache *sc,
 // is normally done implicitly by gl_sc_dispatch_*
 void gl_sc_reset(struct gl_shader_cache *sc);
 void gl_sc_set_cache_dir(struct gl_shader_cache *sc, const char *dir);
+void gl_sc_set_async_compile(struct gl_shader_cache *sc, bool enable,
+                             void (*cb)(void *ctx), void *cb_ctx);
+bool gl_sc_check_pending(struct gl_shader_cache *sc);
+void gl_sc_perfdata(struct gl_shader_cache *sc, struct mp_shader_cache_perf *out);
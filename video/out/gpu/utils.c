@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "common/msg.h"
 #include "video/out/vo.h"
 #include "utils.h"
@@ -116,11 +118,30 @@ bool ra_tex_upload_pbo(struct ra *ra, struct ra_buf_pool *pbo,
         .host_mutable = true,
     };
 
-    struct ra_buf *buf = ra_buf_pool_get(ra, pbo, &bufparams);
+    // Persistently mapped buffers let us write the data directly into the
+    // buffer, while the GPU may still be reading from the other buffers in
+    // the pool. Each buffer is protected by its own fence (see buf_poll).
+    struct ra_buf *buf = NULL;
+    if (pbo->try_mapped) {
+        bufparams.host_mapped = true;
+        buf = ra_buf_pool_get(ra, pbo, &bufparams);
+        if (!buf) {
+            MP_VERBOSE(ra, "Mapped upload buffers not available.\n");
+            ra_buf_pool_uninit(ra, pbo);
+            bufparams.host_mapped = false;
+        }
+    }
+
+    if (!buf)
+        buf = ra_buf_pool_get(ra, pbo, &bufparams);
     if (!buf)
         return false;
 
-    ra->fns->buf_update(ra, buf, 0, params->src, bufparams.size);
+    if (buf->data) {
+        memcpy(buf->data, params->src, bufparams.size);
+    } else {
+        ra->fns->buf_update(ra, buf, 0, params->src, bufparams.size);
+    }
 
     struct ra_tex_upload_params newparams = *params;
     newparams.buf = buf;
@@ -71,6 +71,9 @@ struct ra_buf_pool {
     struct ra_buf **buffers;
     int num_buffers;
     int index;
+    // If set, ra_tex_upload_pbo() uses host_mapped buffers if possible. This
+    // is reset if the RA doesn't support them.
+    bool try_mapped;
 };
 
 void ra_buf_pool_uninit(struct ra *ra, struct ra_buf_pool *pool);
@@ -16,9 +16,11 @@
  */
 
 #include <assert.h>
+#include <inttypes.h>
 #include <math.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 
@@ -31,6 +33,7 @@
 #include "options/m_config.h"
 #include "common/global.h"
 #include "options/options.h"
+#include "options/path.h"
 #include "utils.h"
 #include "hwdec.h"
 #include "osd.h"
@@ -131,10 +134,22 @@ struct surface {
     struct ra_tex *tex;
     uint64_t id;
     double pts;
+    // Frame ID the contents of tex were rendered from, or 0. Unlike id, this
+    // survives resetting the interpolation queue.
+    uint64_t cached_id;
 };
 
 #define SURFACES_MAX 10
 
+// Computed scaler weights, kept across scaler re-inits.
+struct lut_cache_entry {
+    struct filter_kernel kernel; // state after mp_compute_lut()
+    int count, stride;
+    float *weights;
+};
+
+#define LUT_CACHE_MAX 16
+
 struct cached_file {
     char *path;
     struct bstr body;
@@ -143,6 +158,10 @@ struct cached_file {
 struct pass_info {
     struct bstr desc;
     struct mp_pass_perf perf;
+    // Histogram of all samples, as long as the pass had the same description
+    // (hist_desc).
+    struct bstr hist_desc;
+    struct mp_pass_hist hist;
 };
 
 struct dr_buffer {
@@ -212,17 +231,20 @@ struct gl_video {
     struct ra_tex *blend_subs_tex;
     struct ra_tex *screen_tex;
     struct ra_tex *output_tex;
+    struct ra_tex *output_tex_ahead;
     struct ra_tex *vdpau_deinterleave_tex[2];
     struct ra_tex **hook_textures;
     int num_hook_textures;
     int idx_hook_textures;
 
     struct ra_buf *hdr_peak_ssbo;
+    int hdr_peak_frames; // --hdr-peak-frames value hdr_peak_ssbo was set up for
     struct surface surfaces[SURFACES_MAX];
 
     // user pass descriptions and textures
     struct tex_hook *tex_hooks;
     int num_tex_hooks;
+    int num_user_hooks;         // subset of tex_hooks from user shaders
     struct gl_user_shader_tex *user_textures;
     int num_user_textures;
 
@@ -231,9 +253,14 @@ struct gl_video {
     int frames_drawn;
     bool is_interpolated;
     bool output_tex_valid;
+    uint64_t output_tex_id;     // frame contained in output_tex
+    uint64_t output_tex_ahead_id; // frame contained in output_tex_ahead, or 0
+    uint64_t geometry_id;       // changes if anything affecting sizes changes
 
     // state for configured scalers
     struct scaler scaler[SCALER_COUNT];
+    struct lut_cache_entry *lut_cache;
+    int num_lut_cache;
 
     struct mp_csp_equalizer_state *video_eq;
 
@@ -261,6 +288,7 @@ struct gl_video {
     struct pass_info pass_fresh[VO_PASS_PERF_MAX];
     struct pass_info pass_redraw[VO_PASS_PERF_MAX];
     struct pass_info *pass;
+    struct mp_pass_hist hist_fresh, hist_redraw; // per frame totals
     int pass_idx;
     struct timer_pool *upload_timer;
     struct timer_pool *blit_timer;
@@ -268,11 +296,16 @@ struct gl_video {
 
     int frames_uploaded;
     int frames_rendered;
+    uint64_t last_frame_time; // sum of the last measured pass times (ns)
+
+    // For --gpu-dynamic-quality.
+    int quality_level;      // number of QUALITY_* steps currently applied
+    int quality_over;       // consecutive frames over budget
+    int quality_under;      // consecutive frames well under budget
+    int min_quality_level;  // see gl_video_set_fast_rendering()
     AVLFG lfg;
 
     // Cached because computing it can take relatively long
-    int last_dither_matrix_size;
-    float *last_dither_matrix;
 
     struct cached_file *files;
     int num_files;
@@ -283,6 +316,11 @@ struct gl_video {
 
     bool dsi_warned;
     bool broken_frame; // temporary error state
+    bool compute_output; // final pass is a compute shader writing to screen
+
+    // For --gpu-async-compile.
+    void (*compile_cb)(void *ctx);
+    void *compile_cb_ctx;
 };
 
 static const struct gl_video_opts gl_video_opts_def = {
@@ -312,7 +350,10 @@ static const struct gl_video_opts gl_video_opts_def = {
     .tone_mapping = TONE_MAPPING_MOBIUS,
     .tone_mapping_param = NAN,
     .tone_mapping_desat = 1.0,
+    .hdr_peak_frames = PEAK_DETECT_FRAMES,
+    .hdr_peak_subsample = 2,
     .early_flush = -1,
+    .dynamic_quality_budget = 0.8,
 };
 
 static int validate_scaler_opt(struct mp_log *log, const m_option_t *opt,
@@ -354,6 +395,8 @@ const struct m_sub_options gl_video_conf = {
                     {"gamma",    TONE_MAPPING_GAMMA},
                     {"linear",   TONE_MAPPING_LINEAR})),
         OPT_FLAG("hdr-compute-peak", compute_hdr_peak, 0),
+        OPT_INTRANGE("hdr-peak-frames", hdr_peak_frames, 0, 1, PEAK_DETECT_FRAMES),
+        OPT_INTRANGE("hdr-peak-subsample", hdr_peak_subsample, 0, 1, 8),
         OPT_FLOAT("tone-mapping-param", tone_mapping_param, 0),
         OPT_FLOAT("tone-mapping-desaturate", tone_mapping_desat, 0),
         OPT_FLAG("gamut-warning", gamut_warning, 0),
@@ -401,6 +444,11 @@ const struct m_sub_options gl_video_conf = {
         OPT_INTRANGE("gpu-tex-pad-y", tex_pad_y, 0, 0, 4096),
         OPT_SUBSTRUCT("", icc_opts, mp_icc_conf, 0),
         OPT_STRING("gpu-shader-cache-dir", shader_cache_dir, 0),
+        OPT_FLAG("gpu-async-compile", async_compile, 0),
+        OPT_STRING("gpu-perf-dump", perf_dump, 0),
+        OPT_FLAG("gpu-dynamic-quality", dynamic_quality, 0),
+        OPT_FLOATRANGE("gpu-dynamic-quality-budget", dynamic_quality_budget, 0,
+                       0.1, 1.0),
         OPT_REPLACED("hdr-tone-mapping", "tone-mapping"),
         OPT_REPLACED("opengl-shaders", "glsl-shaders"),
         OPT_REPLACED("opengl-shader", "glsl-shader"),
@@ -458,7 +506,10 @@ static void debug_check_gl(struct gl_video *p, const char *msg)
         p->ra->fns->debug_marker(p->ra, msg);
 }
 
-static void gl_video_reset_surfaces(struct gl_video *p)
+// Empty the interpolation queue, but keep the rendered surfaces around, so
+// that they can be picked up again by update_surface() if the same frames
+// are queued again (e.g. when unpausing).
+static void gl_video_reset_queue(struct gl_video *p)
 {
     for (int i = 0; i < SURFACES_MAX; i++) {
         p->surfaces[i].id = 0;
@@ -468,6 +519,17 @@ static void gl_video_reset_surfaces(struct gl_video *p)
     p->surface_now = 0;
     p->frames_drawn = 0;
     p->output_tex_valid = false;
+    p->output_tex_ahead_id = 0;
+}
+
+// Like gl_video_reset_queue(), but also invalidate the surface contents. Must
+// be called if anything changes that affects how frames are rendered.
+static void gl_video_reset_surfaces(struct gl_video *p)
+{
+    p->geometry_id++;
+    for (int i = 0; i < SURFACES_MAX; i++)
+        p->surfaces[i].cached_id = 0;
+    gl_video_reset_queue(p);
 }
 
 static void gl_video_reset_hooks(struct gl_video *p)
@@ -479,6 +541,7 @@ static void gl_video_reset_hooks(struct gl_video *p)
         ra_tex_free(p->ra, &p->user_textures[i].tex);
 
     p->num_tex_hooks = 0;
+    p->num_user_hooks = 0;
     p->num_user_textures = 0;
 }
 
@@ -513,6 +576,7 @@ static void uninit_rendering(struct gl_video *p)
     ra_tex_free(p->ra, &p->blend_subs_tex);
     ra_tex_free(p->ra, &p->screen_tex);
     ra_tex_free(p->ra, &p->output_tex);
+    ra_tex_free(p->ra, &p->output_tex_ahead);
 
     for (int n = 0; n < SURFACES_MAX; n++)
         ra_tex_free(p->ra, &p->surfaces[n].tex);
@@ -995,6 +1059,15 @@ static void pass_record(struct gl_video *p, struct mp_pass_perf perf)
     if (pass->desc.len == 0)
         bstr_xappend(p, &pass->desc, bstr0("(unknown)"));
 
+    if (perf.count) {
+        if (!bstr_equals(pass->desc, pass->hist_desc)) {
+            pass->hist = (struct mp_pass_hist){0};
+            pass->hist_desc.len = 0;
+            bstr_xappend(p, &pass->hist_desc, pass->desc);
+        }
+        mp_pass_hist_add(&pass->hist, perf.last);
+    }
+
     p->pass_idx++;
 }
 
@@ -1031,6 +1104,8 @@ static void pass_report_performance(struct gl_video *p)
     if (!p->pass)
         return;
 
+    uint64_t total = 0;
+    bool measured = false;
     for (int i = 0; i < VO_PASS_PERF_MAX; i++) {
         struct pass_info *pass = &p->pass[i];
         if (pass->desc.len) {
@@ -1039,8 +1114,17 @@ static void pass_report_performance(struct gl_video *p)
                    (int)pass->perf.last/1000,
                    (int)pass->perf.avg/1000,
                    (int)pass->perf.peak/1000);
+            total += pass->perf.last;
+            measured |= pass->perf.count > 0;
         }
     }
+
+    p->last_frame_time = measured && p->pass == p->pass_fresh ? total : 0;
+
+    if (measured) {
+        bool fresh = p->pass == p->pass_fresh;
+        mp_pass_hist_add(fresh ? &p->hist_fresh : &p->hist_redraw, total);
+    }
 }
 
 static void pass_prepare_src_tex(struct gl_video *p)
@@ -1558,6 +1642,66 @@ static bool scaler_conf_eq(struct scaler_config a, struct scaler_config b)
            a.clamp == b.clamp;
 }
 
+static bool filter_window_eq(const struct filter_window *a,
+                             const struct filter_window *b)
+{
+    return a->weight == b->weight &&
+           a->radius == b->radius &&
+           a->params[0] == b->params[0] &&
+           a->params[1] == b->params[1] &&
+           a->blur == b->blur &&
+           a->taper == b->taper;
+}
+
+// Whether two (initialized) kernels produce the same LUT
+static bool filter_kernel_eq(const struct filter_kernel *a,
+                             const struct filter_kernel *b)
+{
+    return filter_window_eq(&a->f, &b->f) &&
+           filter_window_eq(&a->w, &b->w) &&
+           a->clamp == b->clamp &&
+           a->value_cutoff == b->value_cutoff &&
+           a->polar == b->polar &&
+           a->size == b->size &&
+           a->filter_scale == b->filter_scale;
+}
+
+// Like mp_compute_lut(), but return a previously computed result if possible.
+// The returned array is owned by the cache and stays valid until the next call.
+static float *compute_lut_cached(struct gl_video *p,
+                                 struct filter_kernel *kernel,
+                                 int count, int stride)
+{
+    for (int n = 0; n < p->num_lut_cache; n++) {
+        struct lut_cache_entry e = p->lut_cache[n];
+        if (e.count == count && e.stride == stride &&
+            filter_kernel_eq(&e.kernel, kernel))
+        {
+            // (mp_compute_lut() also sets this)
+            kernel->radius_cutoff = e.kernel.radius_cutoff;
+            // Move to the end, so that the oldest entries are evicted first
+            MP_TARRAY_REMOVE_AT(p->lut_cache, p->num_lut_cache, n);
+            MP_TARRAY_APPEND(p, p->lut_cache, p->num_lut_cache, e);
+            return e.weights;
+        }
+    }
+
+    if (p->num_lut_cache >= LUT_CACHE_MAX) {
+        talloc_free(p->lut_cache[0].weights);
+        MP_TARRAY_REMOVE_AT(p->lut_cache, p->num_lut_cache, 0);
+    }
+
+    struct lut_cache_entry e = {
+        .count = count,
+        .stride = stride,
+        .weights = talloc_array(p, float, count * stride),
+    };
+    mp_compute_lut(kernel, count, stride, e.weights);
+    e.kernel = *kernel;
+    MP_TARRAY_APPEND(p, p->lut_cache, p->num_lut_cache, e);
+    return e.weights;
+}
+
 static void reinit_scaler(struct gl_video *p, struct scaler *scaler,
                           const struct scaler_config *conf,
                           double scale_factor,
@@ -1628,8 +1772,8 @@ static void reinit_scaler(struct gl_video *p, struct scaler *scaler,
 
     scaler->lut_size = 1 << p->opts.scaler_lut_size;
 
-    float *weights = talloc_array(NULL, float, scaler->lut_size * stride);
-    mp_compute_lut(scaler->kernel, scaler->lut_size, stride, weights);
+    float *weights = compute_lut_cached(p, scaler->kernel,
+                                        scaler->lut_size, stride);
 
     bool use_1d = scaler->kernel->polar && (p->ra->caps & RA_CAP_TEX_1D);
 
@@ -1645,8 +1789,6 @@ static void reinit_scaler(struct gl_video *p, struct scaler *scaler,
     };
     scaler->lut = ra_tex_create(p->ra, &lut_params);
 
-    talloc_free(weights);
-
     debug_check_gl(p, "after initializing scaler");
 }
 
@@ -1850,22 +1992,74 @@ static bool szexp_lookup(void *priv, struct bstr var, float size[2])
     return false;
 }
 
-static bool user_hook_cond(struct gl_video *p, struct image img, void *priv)
+// The size and condition expressions of a user shader only depend on the
+// video and window geometry (which determine the sizes of all textures), so
+// their results are reused until it changes. A hook can be applied to
+// several textures, so keep a few entries.
+#define USER_HOOK_CACHE 4
+
+struct user_hook_cache {
+    uint64_t geometry_id;       // 0 if unused
+    enum plane_type type;       // hooked texture
+    int w, h;
+    float cond;
+    float out_w, out_h;
+};
+
+struct user_hook {
+    struct gl_user_shader_hook shader;
+    struct user_hook_cache cache[USER_HOOK_CACHE];
+    int cache_next;
+};
+
+static struct user_hook_cache *user_hook_eval(struct gl_video *p,
+                                              struct image img,
+                                              struct user_hook *hook)
 {
-    struct gl_user_shader_hook *shader = priv;
-    assert(shader);
+    for (int n = 0; n < USER_HOOK_CACHE; n++) {
+        struct user_hook_cache *c = &hook->cache[n];
+        if (c->geometry_id && c->geometry_id == p->geometry_id &&
+            c->type == img.type &&
+            c->w == img.w && c->h == img.h)
+            return c;
+    }
+
+    struct user_hook_cache *c = &hook->cache[hook->cache_next];
+    hook->cache_next = (hook->cache_next + 1) % USER_HOOK_CACHE;
+
+    // Make sure we at least create a legal FBO on failure, since it's better
+    // to do this and display an error message than just crash OpenGL
+    *c = (struct user_hook_cache){
+        .geometry_id = p->geometry_id,
+        .type = img.type,
+        .w = img.w,
+        .h = img.h,
+        .cond = false,
+        .out_w = 1.0,
+        .out_h = 1.0,
+    };
 
-    float res = false;
+    struct gl_user_shader_hook *shader = &hook->shader;
     struct szexp_ctx ctx = {p, img};
-    eval_szexpr(p->log, &ctx, szexp_lookup, shader->cond, &res);
-    return res;
+    eval_szexpr(p->log, &ctx, szexp_lookup, shader->cond, &c->cond);
+    eval_szexpr(p->log, &ctx, szexp_lookup, shader->width, &c->out_w);
+    eval_szexpr(p->log, &ctx, szexp_lookup, shader->height, &c->out_h);
+    return c;
+}
+
+static bool user_hook_cond(struct gl_video *p, struct image img, void *priv)
+{
+    struct user_hook *hook = priv;
+    assert(hook);
+    return user_hook_eval(p, img, hook)->cond;
 }
 
 static void user_hook(struct gl_video *p, struct image img,
                       struct gl_transform *trans, void *priv)
 {
-    struct gl_user_shader_hook *shader = priv;
-    assert(shader);
+    struct user_hook *hook = priv;
+    assert(hook);
+    struct gl_user_shader_hook *shader = &hook->shader;
     load_shader(p, shader->pass_body);
 
     pass_describe(p, "user shader: %.*s (%s)", BSTR_P(shader->pass_desc),
@@ -1878,12 +2072,8 @@ static void user_hook(struct gl_video *p, struct image img,
         GLSLF("color = hook();\n");
     }
 
-    // Make sure we at least create a legal FBO on failure, since it's better
-    // to do this and display an error message than just crash OpenGL
-    float w = 1.0, h = 1.0;
-
-    eval_szexpr(p->log, &(struct szexp_ctx){p, img}, szexp_lookup, shader->width, &w);
-    eval_szexpr(p->log, &(struct szexp_ctx){p, img}, szexp_lookup, shader->height, &h);
+    struct user_hook_cache *c = user_hook_eval(p, img, hook);
+    float w = c->out_w, h = c->out_h;
 
     *trans = (struct gl_transform){{{w / img.w, 0}, {0, h / img.h}}};
     gl_transform_trans(shader->offset, trans);
@@ -1892,8 +2082,9 @@ static void user_hook(struct gl_video *p, struct image img,
 static bool add_user_hook(void *priv, struct gl_user_shader_hook hook)
 {
     struct gl_video *p = priv;
-    struct gl_user_shader_hook *copy = talloc_ptrtype(p, copy);
-    *copy = hook;
+    struct user_hook *copy = talloc_zero(p, struct user_hook);
+    p->num_user_hooks++;
+    copy->shader = hook;
 
     struct tex_hook texhook = {
         .save_tex = bstrdup0(copy, hook.save_tex),
@@ -2426,7 +2617,20 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
             dst.gamma = MP_CSP_TRC_GAMMA22;
     }
 
+    // If the source already is in the target space (the common SDR case with
+    // --target-prim/--target-trc set to what the video uses anyway), skip
+    // everything, including the uniforms and the HDR peak detection compute
+    // pass, which only feeds the tone mapping.
+    if (!p->use_lut_3d && !p->opts.gamut_warning && color_map_is_noop(src, dst)) {
+        if (p->use_linear && !osd)
+            pass_delinearize(p->sc, dst.gamma);
+        return;
+    }
+
     bool detect_peak = p->opts.compute_hdr_peak && mp_trc_is_hdr(src.gamma);
+    int peak_frames = p->opts.hdr_peak_frames;
+    if (detect_peak && p->hdr_peak_ssbo && p->hdr_peak_frames != peak_frames)
+        ra_buf_free(ra, &p->hdr_peak_ssbo); // restart averaging
     if (detect_peak && !p->hdr_peak_ssbo) {
         struct {
             unsigned int sig_peak_raw;
@@ -2436,9 +2640,10 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
 
         // Prefill with safe values
         int safe = MP_REF_WHITE * mp_trc_nom_peak(p->image_params.color.gamma);
-        peak_ssbo.sig_peak_raw = PEAK_DETECT_FRAMES * safe;
+        peak_ssbo.sig_peak_raw = peak_frames * safe;
         for (int i = 0; i < PEAK_DETECT_FRAMES+1; i++)
             peak_ssbo.frame_max[i] = safe;
+        p->hdr_peak_frames = peak_frames;
 
         struct ra_buf_params params = {
             .type = RA_BUF_TYPE_SHADER_STORAGE,
@@ -2466,7 +2671,8 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
     // Adapt from src to dst as necessary
     pass_color_map(p->sc, src, dst, p->opts.tone_mapping,
                    p->opts.tone_mapping_param, p->opts.tone_mapping_desat,
-                   detect_peak, p->opts.gamut_warning, p->use_linear && !osd);
+                   detect_peak, peak_frames, p->opts.hdr_peak_subsample,
+                   p->opts.gamut_warning, p->use_linear && !osd);
 
     if (p->use_lut_3d) {
         gl_sc_uniform_texture(p->sc, "lut_3d", p->lut_3d_texture);
@@ -2482,6 +2688,12 @@ void gl_video_set_fb_depth(struct gl_video *p, int fb_depth)
     p->fb_depth = fb_depth;
 }
 
+// Position of the current output pixel (for patterns like dithering).
+static const char *frag_coord(struct gl_video *p)
+{
+    return p->compute_output ? "frag_coord" : "gl_FragCoord.xy";
+}
+
 static void pass_dither(struct gl_video *p)
 {
     // Assume 8 bits per component if unknown.
@@ -2504,12 +2716,19 @@ static void pass_dither(struct gl_video *p)
             int sizeb = p->opts.dither_size;
             int size = 1 << sizeb;
 
-            if (p->last_dither_matrix_size != size) {
-                p->last_dither_matrix = talloc_realloc(p, p->last_dither_matrix,
-                                                       float, size * size);
-                mp_make_fruit_dither_matrix(p->last_dither_matrix, sizeb);
-                p->last_dither_matrix_size = size;
+            char *cache_file = NULL;
+            if (p->opts.shader_cache_dir && p->opts.shader_cache_dir[0]) {
+                char *dir = mp_get_user_path(NULL, p->global,
+                                             p->opts.shader_cache_dir);
+                mp_mkdirp(dir);
+                char name[40];
+                snprintf(name, sizeof(name), "dither-fruit-v1-%d-%dbit.bin",
+                         sizeb, (int)(sizeof(float) * 8));
+                cache_file = mp_path_join(NULL, dir, name);
+                talloc_free(dir);
             }
+            const float *matrix = mp_get_fruit_dither_matrix(sizeb, cache_file);
+            talloc_free(cache_file);
 
             // Prefer R16 texture since they provide higher precision.
             fmt = ra_find_unorm_format(p->ra, 2, 1);
@@ -2517,11 +2736,11 @@ static void pass_dither(struct gl_video *p)
                 fmt = ra_find_float16_format(p->ra, 1);
             if (fmt) {
                 tex_size = size;
-                tex_data = p->last_dither_matrix;
+                tex_data = (void *)matrix;
                 if (fmt->ctype == RA_CTYPE_UNORM) {
                     uint16_t *t = temp = talloc_array(NULL, uint16_t, size * size);
                     for (int n = 0; n < size * size; n++)
-                        t[n] = p->last_dither_matrix[n] * UINT16_MAX;
+                        t[n] = matrix[n] * UINT16_MAX;
                     tex_data = t;
                 }
             } else {
@@ -2567,7 +2786,7 @@ static void pass_dither(struct gl_video *p)
 
     gl_sc_uniform_texture(p->sc, "dither", p->dither_texture);
 
-    GLSLF("vec2 dither_pos = gl_FragCoord.xy * 1.0/%d.0;\n", dither_size);
+    GLSLF("vec2 dither_pos = %s * 1.0/%d.0;\n", frag_coord(p), dither_size);
 
     if (p->opts.temporal_dither) {
         int phase = (p->frames_rendered / p->opts.temporal_dither_period) % 8u;
@@ -2755,12 +2974,29 @@ static void pass_draw_to_screen(struct gl_video *p, struct ra_fbo fbo)
 
     pass_colormanage(p, p->image_params.color, false);
 
+    int o_w = p->dst_rect.x1 - p->dst_rect.x0,
+        o_h = p->dst_rect.y1 - p->dst_rect.y0;
+
+    // If the compute shader can write to the target directly, keep using it
+    // for the rest of the output pipeline, which saves a round trip through
+    // p->screen_tex. This requires that the whole video rect is inside the
+    // target, because writes outside of it are not clipped.
+    struct mp_rect *rc = &p->dst_rect;
+    p->compute_output = p->pass_compute.active &&
+                        !p->pass_compute.directly_writes &&
+                        fbo.tex->params.storage_dst && !fbo.flip &&
+                        rc->x0 >= 0 && rc->y0 >= 0 &&
+                        rc->x1 <= fbo.tex->params.w &&
+                        rc->y1 <= fbo.tex->params.h;
+    if (p->compute_output) {
+        PRELUDE("#define frag_coord (vec2(gl_GlobalInvocationID) + "
+                "vec2(%d.5, %d.5))\n", p->dst_rect.x0, p->dst_rect.y0);
+    }
+
     // Since finish_pass_fbo doesn't work with compute shaders, and neither
     // does the checkerboard/dither code, we may need an indirection via
     // p->screen_tex here.
-    if (p->pass_compute.active) {
-        int o_w = p->dst_rect.x1 - p->dst_rect.x0,
-            o_h = p->dst_rect.y1 - p->dst_rect.y0;
+    if (p->pass_compute.active && !p->compute_output) {
         finish_pass_tex(p, &p->screen_tex, o_w, o_h);
         struct image tmp = image_wrap(p->screen_tex, PLANE_RGB, p->components);
         copy_image(p, &(int){0}, tmp);
@@ -2770,7 +3006,8 @@ static void pass_draw_to_screen(struct gl_video *p, struct ra_fbo fbo)
         if (p->opts.alpha_mode == ALPHA_BLEND_TILES) {
             // Draw checkerboard pattern to indicate transparency
             GLSLF("// transparency checkerboard\n");
-            GLSL(bvec2 tile = lessThan(fract(gl_FragCoord.xy * 1.0/32.0), vec2(0.5));)
+            GLSLF("bvec2 tile = lessThan(fract(%s * 1.0/32.0), vec2(0.5));\n",
+                  frag_coord(p));
             GLSL(vec3 background = vec3(tile.x == tile.y ? 0.93 : 0.87);)
             GLSL(color.rgb += background.rgb * (1.0 - color.a);)
             GLSL(color.a = 1.0;)
@@ -2788,7 +3025,22 @@ static void pass_draw_to_screen(struct gl_video *p, struct ra_fbo fbo)
 
     pass_dither(p);
     pass_describe(p, "output to screen");
-    finish_pass_fbo(p, fbo, &p->dst_rect);
+
+    // (A user shader on OUTPUT may have ended the compute pass.)
+    if (p->pass_compute.active) {
+        assert(p->compute_output);
+        gl_sc_uniform_image2D_wo(p->sc, "out_image", fbo.tex);
+        GLSLF("if (all(lessThan(gl_GlobalInvocationID.xy, uvec2(%d, %d))))\n",
+              o_w, o_h);
+        GLSLF("    imageStore(out_image, ivec2(gl_GlobalInvocationID) + "
+              "ivec2(%d, %d), color);\n", p->dst_rect.x0, p->dst_rect.y0);
+        dispatch_compute(p, o_w, o_h, p->pass_compute);
+        p->pass_compute = (struct compute_info){0};
+        debug_check_gl(p, "after dispatching compute shader");
+    } else {
+        finish_pass_fbo(p, fbo, &p->dst_rect);
+    }
+    p->compute_output = false;
 }
 
 static bool update_surface(struct gl_video *p, struct mp_image *mpi,
@@ -2797,6 +3049,23 @@ static bool update_surface(struct gl_video *p, struct mp_image *mpi,
     int vp_w = p->dst_rect.x1 - p->dst_rect.x0,
         vp_h = p->dst_rect.y1 - p->dst_rect.y0;
 
+    // Reuse the result of a previous rendering of this frame, if it's in a
+    // surface that is not part of the queue anymore.
+    for (int i = 0; i < SURFACES_MAX; i++) {
+        struct surface *s = &p->surfaces[i];
+        if (s->cached_id != id || !s->tex || (s != surf && s->id))
+            continue;
+        if (s != surf) {
+            MPSWAP(struct ra_tex *, s->tex, surf->tex);
+            s->cached_id = surf->cached_id;
+        }
+        surf->cached_id = id;
+        surf->id  = id;
+        surf->pts = mpi->pts;
+        return true;
+    }
+
+    surf->cached_id = 0;
     pass_info_reset(p, false);
     if (!pass_render_frame(p, mpi, id))
         return false;
@@ -2810,6 +3079,7 @@ static bool update_surface(struct gl_video *p, struct mp_image *mpi,
     }
 
     finish_pass_tex(p, &surf->tex, vp_w, vp_h);
+    surf->cached_id = id;
     surf->id  = id;
     surf->pts = mpi->pts;
     return true;
@@ -2825,7 +3095,7 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
     // interpolation artifacts from surrounding frames when unpausing or
     // framestepping
     if (t->still)
-        gl_video_reset_surfaces(p);
+        gl_video_reset_queue(p);
 
     // First of all, figure out if we have a frame available at all, and draw
     // it manually + reset the queue if not
@@ -2988,6 +3258,117 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
     p->frames_drawn += 1;
 }
 
+// Render the current frame with the minimal code path, and with shaders
+// created synchronously. Used if the real shaders are still being compiled.
+static void render_frame_fallback(struct gl_video *p, struct vo_frame *frame,
+                                  struct ra_fbo fbo)
+{
+    MP_DBG(p, "Shaders not ready yet, using dumb mode for this frame.\n");
+
+    // Whatever was rendered so far is incomplete.
+    gl_video_reset_surfaces(p);
+
+    struct m_color c = p->clear_color;
+    float color[4] = {c.r / 255.0, c.g / 255.0, c.b / 255.0, c.a / 255.0};
+    p->ra->fns->clear(p->ra, fbo.tex, color, &p->dst_rect);
+
+    gl_sc_set_async_compile(p->sc, false, NULL, NULL);
+    bool dumb_mode = p->dumb_mode;
+    p->dumb_mode = true;
+
+    pass_info_reset(p, false);
+    if (pass_render_frame(p, frame->current, frame->frame_id))
+        pass_draw_to_screen(p, fbo);
+
+    p->dumb_mode = dumb_mode;
+    gl_sc_set_async_compile(p->sc, p->opts.async_compile && p->compile_cb,
+                            p->compile_cb, p->compile_cb_ctx);
+}
+
+// Each level of --gpu-dynamic-quality disables one more expensive feature, in
+// order of how little it is expected to be noticed. See apply_quality_level().
+enum {
+    QUALITY_NO_DEBAND = 1,
+    QUALITY_NO_INTERPOLATION,
+    QUALITY_FAST_SCALERS,
+    QUALITY_MAX = QUALITY_FAST_SCALERS,
+};
+
+// Number of consecutive freshly rendered frames over budget before stepping
+// down, and well under budget before stepping up again. Recovering is much
+// slower, so that a level which barely fits doesn't flip back and forth.
+#define QUALITY_DOWN_FRAMES 10
+#define QUALITY_UP_FRAMES 300
+
+// Called from reinit_from_options(), after p->opts was copied from the options.
+static void apply_quality_level(struct gl_video *p)
+{
+    int level = MPMAX(p->quality_level, p->min_quality_level);
+    if (level >= QUALITY_NO_DEBAND)
+        p->opts.deband = 0;
+    if (level >= QUALITY_NO_INTERPOLATION)
+        p->opts.interpolation = 0;
+    if (level >= QUALITY_FAST_SCALERS) {
+        for (int n = 0; n < SCALER_COUNT; n++) {
+            if (n != SCALER_TSCALE && p->opts.scaler[n].kernel.name)
+                p->opts.scaler[n].kernel.name = "bilinear";
+        }
+        p->opts.sigmoid_upscaling = 0;
+        p->opts.correct_downscaling = 0;
+    }
+}
+
+static void set_quality_level(struct gl_video *p, int level)
+{
+    MP_VERBOSE(p, "Dynamic quality level %d -> %d.\n", p->quality_level, level);
+    p->quality_level = level;
+    p->quality_over = p->quality_under = 0;
+    reinit_from_options(p);
+}
+
+// Always render with the lowest quality level, regardless of the options and
+// of --gpu-dynamic-quality. Meant for small secondary views of the video.
+void gl_video_set_fast_rendering(struct gl_video *p, bool fast)
+{
+    int level = fast ? QUALITY_MAX : 0;
+    if (p->min_quality_level == level)
+        return;
+    p->min_quality_level = level;
+    reinit_from_options(p);
+}
+
+// Compare the GPU time of the last freshly rendered frame against the vsync
+// interval, and step the quality level up or down accordingly. This relies on
+// timer queries, so it does nothing if the RA doesn't support them.
+static void update_dynamic_quality(struct gl_video *p, struct vo_frame *frame)
+{
+    // Not p->opts, since dumb mode resets most fields of it.
+    struct gl_video_opts *opts = p->opts_cache->opts;
+
+    if (!opts->dynamic_quality) {
+        if (p->quality_level)
+            set_quality_level(p, 0);
+        return;
+    }
+
+    if (!p->last_frame_time || frame->vsync_interval <= 0)
+        return;
+
+    double budget = frame->vsync_interval * 1e9 * opts->dynamic_quality_budget;
+    if (p->last_frame_time > budget) {
+        p->quality_under = 0;
+        if (++p->quality_over >= QUALITY_DOWN_FRAMES &&
+            p->quality_level < QUALITY_MAX)
+            set_quality_level(p, p->quality_level + 1);
+    } else if (p->last_frame_time < budget / 2) {
+        p->quality_over = 0;
+        if (++p->quality_under >= QUALITY_UP_FRAMES && p->quality_level > 0)
+            set_quality_level(p, p->quality_level - 1);
+    } else {
+        p->quality_over = p->quality_under = 0;
+    }
+}
+
 void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
                            struct ra_fbo fbo)
 {
@@ -2996,6 +3377,7 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
     struct mp_rect target_rc = {0, 0, fbo.tex->params.w, fbo.tex->params.h};
 
     p->broken_frame = false;
+    gl_sc_check_pending(p->sc);
 
     bool has_frame = !!frame->current;
 
@@ -3034,12 +3416,28 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
         if (interpolate) {
             gl_video_interpolate_frame(p, frame, fbo);
         } else {
-            bool is_new = frame->frame_id != p->image.id;
+            uint64_t cur_id = p->output_tex_valid ? p->output_tex_id
+                                                  : p->image.id;
+            bool is_new = frame->frame_id != cur_id;
 
             // Redrawing a frame might update subtitles.
             if (frame->still && p->opts.blend_subs)
                 is_new = true;
 
+            // Pick up the frame if it was rendered ahead of time.
+            if (is_new) {
+                if (p->output_tex_ahead_id == frame->frame_id &&
+                    p->output_tex_ahead->params.w == fbo.tex->params.w &&
+                    p->output_tex_ahead->params.h == fbo.tex->params.h)
+                {
+                    MPSWAP(struct ra_tex *, p->output_tex, p->output_tex_ahead);
+                    p->output_tex_valid = true;
+                    p->output_tex_id = frame->frame_id;
+                    is_new = false;
+                }
+                p->output_tex_ahead_id = 0;
+            }
+
             if (is_new || !p->output_tex_valid) {
                 p->output_tex_valid = false;
 
@@ -3048,10 +3446,16 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
                     goto done;
 
                 // For the non-interpolation case, we draw to a single "cache"
-                // texture to speed up subsequent re-draws (if any exist)
+                // texture to speed up subsequent re-draws (if any exist).
+                // Still frames are cached too: while paused, OSD changes
+                // trigger redraws that only need to re-composite the OSD.
+                // The same goes for frames that are already being redrawn,
+                // and for all frames if user shaders make rendering costly.
                 struct ra_fbo dest_fbo = fbo;
-                if (frame->num_vsyncs > 1 && frame->display_synced &&
-                    !p->dumb_mode && (p->ra->caps & RA_CAP_BLIT))
+                bool want_cache = (frame->num_vsyncs > 1 && frame->display_synced)
+                                  || frame->still || frame->redraw ||
+                                  p->num_user_hooks > 0;
+                if (want_cache && !p->dumb_mode && (p->ra->caps & RA_CAP_BLIT))
                 {
                     bool r = ra_tex_resize(p->ra, p->log, &p->output_tex,
                                            fbo.tex->params.w, fbo.tex->params.h,
@@ -3059,6 +3463,7 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
                     if (r) {
                         dest_fbo = (struct ra_fbo) { p->output_tex };
                         p->output_tex_valid = true;
+                        p->output_tex_id = frame->frame_id;
                     }
                 }
                 pass_draw_to_screen(p, dest_fbo);
@@ -3080,6 +3485,9 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
                 pass_record(p, timer_pool_measure(p->blit_timer));
             }
         }
+
+        if (gl_sc_check_pending(p->sc))
+            render_frame_fallback(p, frame, fbo);
     }
 
 done:
@@ -3107,6 +3515,51 @@ done:
 
     p->frames_rendered++;
     pass_report_performance(p);
+    update_dynamic_quality(p, frame);
+}
+
+// Render a display-synced frame into a spare output texture while the previous
+// frame is still being displayed. If the next gl_video_render_frame() call is
+// for this frame, it only needs to blit the texture (plus OSD). Does nothing
+// if this is not possible, e.g. with interpolation.
+void gl_video_prerender_frame(struct gl_video *p, struct vo_frame *frame,
+                              int w, int h)
+{
+    gl_video_update_options(p);
+
+    if (!frame->current || !frame->display_synced || frame->still ||
+        p->opts.interpolation || p->dumb_mode ||
+        !(p->ra->caps & RA_CAP_BLIT) ||
+        (p->hwdec_active && p->hwdec->driver->overlay_frame))
+        return;
+
+    gl_sc_check_pending(p->sc);
+
+    if (!ra_tex_resize(p->ra, p->log, &p->output_tex_ahead, w, h,
+                       p->fbo_format))
+        return;
+
+    // Uploading the frame resets the OSD timestamp, but the OSD of the
+    // currently displayed frame might still be redrawn.
+    double osd_pts = p->osd_pts;
+
+    p->broken_frame = false;
+    pass_info_reset(p, false);
+    bool ok = pass_render_frame(p, frame->current, frame->frame_id);
+    if (ok) {
+        pass_draw_to_screen(p, (struct ra_fbo) { p->output_tex_ahead });
+        ok = !gl_sc_error_state(p->sc) && !p->broken_frame &&
+             !gl_sc_check_pending(p->sc);
+    }
+    p->osd_pts = osd_pts;
+
+    if (ok) {
+        p->output_tex_ahead_id = frame->frame_id;
+        pass_report_performance(p);
+    }
+
+    if (p->ra->fns->flush)
+        p->ra->fns->flush(p->ra);
 }
 
 // Use this color instead of the global option.
@@ -3146,22 +3599,28 @@ void gl_video_resize(struct gl_video *p,
         mpgl_osd_resize(p->osd, p->osd_rect, p->image_params.stereo_out);
 }
 
-static void frame_perf_data(struct pass_info pass[], struct mp_frame_perf *out)
+static void frame_perf_data(struct pass_info pass[], struct mp_pass_hist *total,
+                            struct mp_frame_perf *out)
 {
     for (int i = 0; i < VO_PASS_PERF_MAX; i++) {
         if (!pass[i].desc.len)
             break;
         out->perf[out->count] = pass[i].perf;
+        out->hist[out->count] = pass[i].hist;
         out->desc[out->count] = pass[i].desc.start;
         out->count++;
     }
+    out->total = *total;
 }
 
 void gl_video_perfdata(struct gl_video *p, struct voctrl_performance_data *out)
 {
     *out = (struct voctrl_performance_data){0};
-    frame_perf_data(p->pass_fresh,  &out->fresh);
-    frame_perf_data(p->pass_redraw, &out->redraw);
+    frame_perf_data(p->pass_fresh,  &p->hist_fresh,  &out->fresh);
+    frame_perf_data(p->pass_redraw, &p->hist_redraw, &out->redraw);
+    gl_sc_perfdata(p->sc, &out->shader_cache);
+    if (p->ra->fns->mem_stats)
+        p->ra->fns->mem_stats(p->ra, &out->gpu_mem);
 }
 
 // This assumes nv12, with textures set to GL_NEAREST filtering.
@@ -3495,6 +3954,58 @@ static void init_gl(struct gl_video *p)
     ra_dump_img_formats(p->ra, MSGL_DEBUG);
 }
 
+static void dump_hist(FILE *f, const char *type, const char *desc,
+                      const struct mp_pass_hist *hist)
+{
+    if (!hist->count)
+        return;
+
+    fprintf(f, "%s\t%s\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\n",
+            type, desc, hist->count,
+            mp_pass_hist_percentile(hist, 0.5),
+            mp_pass_hist_percentile(hist, 0.9),
+            mp_pass_hist_percentile(hist, 0.99),
+            mp_pass_hist_percentile(hist, 0.999));
+    for (int n = 0; n < VO_PERF_HIST_BUCKETS; n++) {
+        if (hist->buckets[n])
+            fprintf(f, "\t%"PRIu64"\t%u\n", mp_pass_hist_bucket_max(n),
+                    (unsigned)hist->buckets[n]);
+    }
+}
+
+// Write the pass histograms for --gpu-perf-dump.
+static void dump_perf(struct gl_video *p)
+{
+    if (!p->opts.perf_dump || !p->opts.perf_dump[0])
+        return;
+
+    void *tmp = talloc_new(NULL);
+    char *path = mp_get_user_path(tmp, p->global, p->opts.perf_dump);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        MP_ERR(p, "Could not open '%s' for writing.\n", path);
+        talloc_free(tmp);
+        return;
+    }
+
+    fprintf(f, "# type\tpass\tcount\tp50\tp90\tp99\tp99.9 (ns)\n");
+    fprintf(f, "#\tbucket upper bound (ns)\tcount\n");
+    dump_hist(f, "fresh", "(total)", &p->hist_fresh);
+    dump_hist(f, "redraw", "(total)", &p->hist_redraw);
+    for (int i = 0; i < VO_PASS_PERF_MAX; i++) {
+        struct pass_info *fresh = &p->pass_fresh[i];
+        struct pass_info *redraw = &p->pass_redraw[i];
+        if (fresh->hist_desc.len)
+            dump_hist(f, "fresh", fresh->hist_desc.start, &fresh->hist);
+        if (redraw->hist_desc.len)
+            dump_hist(f, "redraw", redraw->hist_desc.start, &redraw->hist);
+    }
+
+    fclose(f);
+    MP_VERBOSE(p, "Wrote pass statistics to '%s'.\n", path);
+    talloc_free(tmp);
+}
+
 void gl_video_uninit(struct gl_video *p)
 {
     if (!p)
@@ -3511,9 +4022,13 @@ void gl_video_uninit(struct gl_video *p)
     timer_pool_destroy(p->blit_timer);
     timer_pool_destroy(p->osd_timer);
 
+    dump_perf(p);
+
     for (int i = 0; i < VO_PASS_PERF_MAX; i++) {
         talloc_free(p->pass_fresh[i].desc.start);
         talloc_free(p->pass_redraw[i].desc.start);
+        talloc_free(p->pass_fresh[i].hist_desc.start);
+        talloc_free(p->pass_redraw[i].hist_desc.start);
     }
 
     mpgl_osd_destroy(p->osd);
@@ -3530,7 +4045,7 @@ void gl_video_uninit(struct gl_video *p)
 
 void gl_video_reset(struct gl_video *p)
 {
-    gl_video_reset_surfaces(p);
+    gl_video_reset_queue(p);
 }
 
 bool gl_video_showing_interpolated_frame(struct gl_video *p)
@@ -3639,12 +4154,20 @@ static const char *handle_scaler_opt(const char *name, bool tscale)
 static void gl_video_update_options(struct gl_video *p)
 {
     if (m_config_cache_update(p->opts_cache)) {
-        gl_lcms_update_options(p->cms);
+        // Avoid marking the ICC profile as changed (and regenerating the 3D
+        // LUT) for unrelated option changes.
+        struct gl_video_opts *opts = p->opts_cache->opts;
+        if (m_config_cache_is_changed(p->opts_cache, opts->icc_opts))
+            gl_lcms_update_options(p->cms);
         reinit_from_options(p);
     }
 
-    if (mp_csp_equalizer_state_changed(p->video_eq))
+    if (mp_csp_equalizer_state_changed(p->video_eq)) {
         p->output_tex_valid = false;
+        p->output_tex_ahead_id = 0;
+        for (int i = 0; i < SURFACES_MAX; i++)
+            p->surfaces[i].cached_id = 0;
+    }
 }
 
 static void reinit_from_options(struct gl_video *p)
@@ -3659,9 +4182,12 @@ static void reinit_from_options(struct gl_video *p)
     if (!p->force_clear_color)
         p->clear_color = p->opts.background;
 
+    apply_quality_level(p);
     check_gl_features(p);
     uninit_rendering(p);
     gl_sc_set_cache_dir(p->sc, p->opts.shader_cache_dir);
+    gl_sc_set_async_compile(p->sc, p->opts.async_compile && p->compile_cb,
+                            p->compile_cb, p->compile_cb_ctx);
     p->ra->use_pbo = p->opts.pbo;
     gl_video_setup_hooks(p);
     reinit_osd(p);
@@ -3673,6 +4199,18 @@ static void reinit_from_options(struct gl_video *p)
     }
 }
 
+// Enable --gpu-async-compile (if the option is set). cb(ctx) is called from a
+// foreign thread when a shader has finished compiling; the user should redraw
+// the current frame then.
+void gl_video_set_compile_cb(struct gl_video *p, void (*cb)(void *ctx),
+                             void *ctx)
+{
+    p->compile_cb = cb;
+    p->compile_cb_ctx = ctx;
+    gl_sc_set_async_compile(p->sc, p->opts.async_compile && p->compile_cb,
+                            p->compile_cb, p->compile_cb_ctx);
+}
+
 void gl_video_configure_queue(struct gl_video *p, struct vo *vo)
 {
     gl_video_update_options(p);
@@ -3819,24 +4357,61 @@ static void gl_video_dr_free_buffer(void *opaque, uint8_t *data)
     assert(0);
 }
 
+// Return whether the strides of an image with the given width are multiples of
+// the texel size of each plane, which texture uploads from buffers require.
+static bool dr_strides_ok(struct ra_imgfmt_desc *desc, int imgfmt, int w,
+                          int align)
+{
+    struct mp_imgfmt_desc fmt = mp_imgfmt_get_desc(imgfmt);
+    for (int n = 0; n < desc->num_planes; n++) {
+        int line_bytes = (mp_chroma_div_up(w, fmt.xs[n]) * fmt.bpp[n] + 7) / 8;
+        if (MP_ALIGN_UP(line_bytes, align) % desc->planes[n]->pixel_size)
+            return false;
+    }
+    return true;
+}
+
 struct mp_image *gl_video_get_image(struct gl_video *p, int imgfmt, int w, int h,
                                     int stride_align)
 {
-    int size = mp_image_get_alloc_size(imgfmt, w, h, stride_align);
+    struct ra_imgfmt_desc desc;
+    if (!ra_get_imgfmt_desc(p->ra, imgfmt, &desc))
+        return NULL;
+
+    // Raise the alignment to the texel sizes (and 4, which Vulkan requires for
+    // buffer offsets), so that the planes can be uploaded without a copy. If a
+    // texel size is not a power of 2 (e.g. rgb24), pad the width instead.
+    int align = MPMAX(stride_align, 4);
+    for (int n = 0; n < desc.num_planes; n++) {
+        int texel = desc.planes[n]->pixel_size;
+        if (texel > 0 && !(texel & (texel - 1)))
+            align = MPMAX(align, texel);
+    }
+    int alloc_w = w;
+    while (!dr_strides_ok(&desc, imgfmt, alloc_w, align)) {
+        if (alloc_w - w > 64 * align)
+            return NULL;
+        alloc_w++;
+    }
+
+    int size = mp_image_get_alloc_size(imgfmt, alloc_w, h, align);
     if (size < 0)
         return NULL;
 
-    int alloc_size = size + stride_align;
+    int alloc_size = size + align;
     void *ptr = gl_video_dr_alloc_buffer(p, alloc_size);
     if (!ptr)
         return NULL;
 
     // (we expect vo.c to proxy the free callback, so it happens in the same
     // thread it was allocated in, removing the need for synchronization)
-    struct mp_image *res = mp_image_from_buffer(imgfmt, w, h, stride_align,
+    struct mp_image *res = mp_image_from_buffer(imgfmt, alloc_w, h, align,
                                                 ptr, alloc_size, p,
                                                 gl_video_dr_free_buffer);
-    if (!res)
+    if (!res) {
         gl_video_dr_free_buffer(p, ptr);
+        return NULL;
+    }
+    mp_image_set_size(res, w, h);
     return res;
 }
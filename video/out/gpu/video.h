@@ -95,7 +95,7 @@ enum tone_mapping {
     TONE_MAPPING_LINEAR,
 };
 
-// How many frames to average over for HDR peak detection
+// Maximum number of frames to average over for HDR peak detection
 #define PEAK_DETECT_FRAMES 100
 
 struct gl_video_opts {
@@ -109,6 +109,8 @@ struct gl_video_opts {
     int target_brightness;
     int tone_mapping;
     int compute_hdr_peak;
+    int hdr_peak_frames;
+    int hdr_peak_subsample;
     float tone_mapping_param;
     float tone_mapping_desat;
     int gamut_warning;
@@ -139,6 +141,10 @@ struct gl_video_opts {
     struct mp_icc_opts *icc_opts;
     int early_flush;
     char *shader_cache_dir;
+    int async_compile;
+    char *perf_dump;
+    int dynamic_quality;
+    float dynamic_quality_budget;
 };
 
 extern const struct m_sub_options gl_video_conf;
@@ -155,6 +161,8 @@ void gl_video_config(struct gl_video *p, struct mp_image_params *params);
 void gl_video_set_output_depth(struct gl_video *p, int r, int g, int b);
 void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
                            struct ra_fbo fbo);
+void gl_video_prerender_frame(struct gl_video *p, struct vo_frame *frame,
+                              int w, int h);
 void gl_video_resize(struct gl_video *p,
                      struct mp_rect *src, struct mp_rect *dst,
                      struct mp_osd_res *osd);
@@ -175,12 +183,15 @@ struct mp_colorspace gl_video_get_output_colorspace(struct gl_video *p);
 
 void gl_video_reset(struct gl_video *p);
 bool gl_video_showing_interpolated_frame(struct gl_video *p);
+void gl_video_set_fast_rendering(struct gl_video *p, bool fast);
 
 struct ra_hwdec;
 void gl_video_set_hwdec(struct gl_video *p, struct ra_hwdec *hwdec);
 
 struct vo;
 void gl_video_configure_queue(struct gl_video *p, struct vo *vo);
+void gl_video_set_compile_cb(struct gl_video *p, void (*cb)(void *ctx),
+                             void *ctx);
 
 struct mp_image *gl_video_get_image(struct gl_video *p, int imgfmt, int w, int h,
                                     int stride_align);
@@ -558,8 +558,10 @@ void pass_inverse_ootf(struct gl_shader_cache *sc, enum mp_csp_light light, floa
 }
 
 // Tone map from a known peak brightness to the range [0,1]. If ref_peak
-// is 0, we will use peak detection instead
+// is 0, we will use peak detection instead, averaged over peak_frames frames,
+// and sampling only every peak_subsample-th pixel in each direction.
 static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
+                          int peak_frames, int peak_subsample,
                           enum tone_mapping algo, float param, float desat)
 {
     GLSLF("// HDR tone mapping\n");
@@ -582,23 +584,31 @@ static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
         // For performance, we want to do as few atomic operations on global
         // memory as possible, so use an atomic in shmem for the work group.
         // We also want slightly more stable values, so use the group average
-        // instead of the group max
+        // instead of the group max. Subsampling reduces the number of
+        // (serialized) shmem atomics, which dominate the cost of this.
         GLSLHF("shared uint group_sum = 0;\n");
+        if (peak_subsample > 1) {
+            GLSLF("if (gl_LocalInvocationID.x %% %du == 0u && "
+                  "gl_LocalInvocationID.y %% %du == 0u)\n",
+                  peak_subsample, peak_subsample);
+        }
         GLSLF("atomicAdd(group_sum, uint(sig * %f));\n", MP_REF_WHITE);
 
         // Have one thread in each work group update the frame maximum
         GLSL(memoryBarrierBuffer();)
         GLSL(barrier();)
+        GLSLF("uvec2 peak_samples = (gl_WorkGroupSize.xy + uvec2(%du)) / "
+              "uvec2(%du);\n", peak_subsample - 1, peak_subsample);
         GLSL(if (gl_LocalInvocationIndex == 0))
             GLSL(atomicMax(frame_max[index], group_sum /
-                 (gl_WorkGroupSize.x * gl_WorkGroupSize.y));)
+                 (peak_samples.x * peak_samples.y));)
 
         // Finally, have one thread per invocation update the total maximum
         // and advance the index
         GLSL(memoryBarrierBuffer();)
         GLSL(barrier();)
         GLSL(if (gl_GlobalInvocationID == ivec3(0)) {) // do this once per invocation
-            GLSLF("uint next = (index + 1) %% %d;\n", PEAK_DETECT_FRAMES+1);
+            GLSLF("uint next = (index + 1) %% %d;\n", peak_frames + 1);
             GLSLF("sig_peak_raw = sig_peak_raw + frame_max[index] - frame_max[next];\n");
             GLSLF("frame_max[next] = %d;\n", (int)MP_REF_WHITE);
             GLSL(index = next;)
@@ -607,7 +617,7 @@ static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
         GLSL(memoryBarrierBuffer();)
         GLSL(barrier();)
         GLSLF("float sig_peak = 1.0/%f * float(sig_peak_raw);\n",
-              MP_REF_WHITE * PEAK_DETECT_FRAMES);
+              MP_REF_WHITE * peak_frames);
     } else {
         GLSLHF("const float sig_peak = %f;\n", ref_peak);
     }
@@ -678,10 +688,23 @@ static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
 // detect the peak instead of relying on metadata. Note that this requires
 // the caller to have already bound the appropriate SSBO and set up the
 // compute shader metadata
+// Whether pass_color_map() has nothing to do for src -> dst, i.e. the signal
+// doesn't need to be linearized for any of its operations.
+bool color_map_is_noop(struct mp_colorspace src, struct mp_colorspace dst)
+{
+    float dst_range = mp_trc_nom_peak(dst.gamma);
+    return src.gamma == dst.gamma &&
+           src.primaries == dst.primaries &&
+           mp_trc_nom_peak(src.gamma) == dst_range &&
+           src.sig_peak <= dst_range &&
+           src.light == dst.light;
+}
+
 void pass_color_map(struct gl_shader_cache *sc,
                     struct mp_colorspace src, struct mp_colorspace dst,
                     enum tone_mapping algo, float tone_mapping_param,
                     float tone_mapping_desat, bool detect_peak,
+                    int peak_frames, int peak_subsample,
                     bool gamut_warning, bool is_linear)
 {
     GLSLF("// color mapping\n");
@@ -702,11 +725,7 @@ void pass_color_map(struct gl_shader_cache *sc,
     // All operations from here on require linear light as a starting point,
     // so we linearize even if src.gamma == dst.gamma when one of the other
     // operations needs it
-    bool need_gamma = src.gamma != dst.gamma ||
-                      src.primaries != dst.primaries ||
-                      src_range != dst_range ||
-                      src.sig_peak > dst_range ||
-                      src.light != dst.light;
+    bool need_gamma = !color_map_is_noop(src, dst);
 
     if (need_gamma && !is_linear) {
         pass_linearize(sc, src.gamma);
@@ -740,7 +759,8 @@ void pass_color_map(struct gl_shader_cache *sc,
     // Tone map to prevent clipping when the source signal peak exceeds the
     // encodable range or we've reduced the gamut
     if (ref_peak > 1) {
-        pass_tone_map(sc, detect_peak ? 0 : ref_peak, algo,
+        pass_tone_map(sc, detect_peak ? 0 : ref_peak, peak_frames,
+                      peak_subsample, algo,
                       tone_mapping_param, tone_mapping_desat);
     }
 
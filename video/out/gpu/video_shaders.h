@@ -42,10 +42,12 @@ void pass_delinearize(struct gl_shader_cache *sc, enum mp_csp_trc trc);
 void pass_ootf(struct gl_shader_cache *sc, enum mp_csp_light light, float peak);
 void pass_inverse_ootf(struct gl_shader_cache *sc, enum mp_csp_light light, float peak);
 
+bool color_map_is_noop(struct mp_colorspace src, struct mp_colorspace dst);
 void pass_color_map(struct gl_shader_cache *sc,
                     struct mp_colorspace src, struct mp_colorspace dst,
                     enum tone_mapping algo, float tone_mapping_param,
                     float tone_mapping_desat, bool use_detected_peak,
+                    int peak_frames, int peak_subsample,
                     bool gamut_warning, bool is_linear);
 
 void pass_sample_deband(struct gl_shader_cache *sc, struct deband_opts *opts,
@@ -31,6 +31,7 @@
 #include "libmpv/opengl_cb.h"
 #include "video/out/drm_common.h"
 #include "common/common.h"
+#include "osdep/timer.h"
 
 #include "egl_helpers.h"
 #include "common.h"
@@ -252,6 +253,14 @@ static const struct ra_swapchain_fns drm_atomic_swapchain = {
     .start_frame   = drm_atomic_egl_start_frame,
 };
 
+static void page_flipped(int fd, unsigned int frame, unsigned int sec,
+                         unsigned int usec, void *data)
+{
+    struct ra_ctx *ctx = data;
+    int64_t t = mp_time_us_from_monotonic(sec * INT64_C(1000000) + usec);
+    vo_report_presentation(ctx->vo, t, frame);
+}
+
 static void drm_egl_swap_buffers(struct ra_ctx *ctx)
 {
     struct priv *p = ctx->priv;
@@ -269,12 +278,12 @@ static void drm_egl_swap_buffers(struct ra_ctx *ctx)
         drm_object_set_property(atomic_ctx->request, atomic_ctx->primary_plane, "ZPOS", 1);
 
         ret = drmModeAtomicCommit(p->kms->fd, atomic_ctx->request,
-                                  DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, NULL);
+                                  DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, ctx);
         if (ret)
             MP_WARN(ctx->vo, "Failed to commit atomic request (%d)\n", ret);
     } else {
         ret = drmModePageFlip(p->kms->fd, p->kms->crtc_id, p->fb->id,
-                                  DRM_MODE_PAGE_FLIP_EVENT, p);
+                                  DRM_MODE_PAGE_FLIP_EVENT, ctx);
         if (ret) {
             MP_WARN(ctx->vo, "Failed to queue page flip: %s\n", mp_strerror(errno));
         }
@@ -337,6 +346,7 @@ static bool drm_egl_init(struct ra_ctx *ctx)
 
     struct priv *p = ctx->priv = talloc_zero(ctx, struct priv);
     p->ev.version = DRM_EVENT_CONTEXT_VERSION;
+    p->ev.page_flip_handler = page_flipped;
 
     p->vt_switcher_active = vt_switcher_init(&p->vt_switcher, ctx->vo->log);
     if (p->vt_switcher_active) {
@@ -37,6 +37,7 @@
 #define CUDA_DECL(NAME, TYPE) \
     TYPE *mpv_ ## NAME;
 CUDA_FNS(CUDA_DECL)
+CUDA_OPT_FNS(CUDA_DECL)
 
 static bool cuda_loaded = false;
 static pthread_once_t cuda_load_once = PTHREAD_ONCE_INIT;
@@ -53,6 +54,11 @@ static void cuda_do_load(void)
 
     CUDA_FNS(CUDA_LOAD_SYMBOL)
 
+#define CUDA_LOAD_OPT_SYMBOL(NAME, TYPE) \
+    mpv_ ## NAME = dlsym(lib, #NAME);
+
+    CUDA_OPT_FNS(CUDA_LOAD_OPT_SYMBOL)
+
     cuda_loaded = true;
 }
 
@@ -61,3 +67,11 @@ bool cuda_load(void)
     pthread_once(&cuda_load_once, cuda_do_load);
     return cuda_loaded;
 }
+
+bool cuda_has_external_memory(void)
+{
+    return cuda_load() && mpv_cuDeviceGetCount && mpv_cuDeviceGetUuid &&
+           mpv_cuCtxSynchronize && mpv_cuMemFree_v2 &&
+           mpv_cuImportExternalMemory && mpv_cuExternalMemoryGetMappedBuffer &&
+           mpv_cuDestroyExternalMemory;
+}
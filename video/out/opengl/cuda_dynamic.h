@@ -89,6 +89,39 @@ typedef enum CUGLDeviceList_enum {
 
 #define CU_GRAPHICS_REGISTER_FLAGS_WRITE_DISCARD 2
 
+// External memory interop (CUDA 10.0)
+
+typedef struct CUextMemory_st *CUexternalMemory;
+
+typedef struct CUuuid_st {
+    char bytes[16];
+} CUuuid;
+
+typedef enum CUexternalMemoryHandleType_enum {
+    CU_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD = 1,
+} CUexternalMemoryHandleType;
+
+typedef struct CUDA_EXTERNAL_MEMORY_HANDLE_DESC_st {
+    CUexternalMemoryHandleType type;
+    union {
+        int fd;
+        struct {
+            void *handle;
+            const void *name;
+        } win32;
+    } handle;
+    unsigned long long size;
+    unsigned int flags;
+    unsigned int reserved[16];
+} CUDA_EXTERNAL_MEMORY_HANDLE_DESC;
+
+typedef struct CUDA_EXTERNAL_MEMORY_BUFFER_DESC_st {
+    unsigned long long offset;
+    unsigned long long size;
+    unsigned int flags;
+    unsigned int reserved[16];
+} CUDA_EXTERNAL_MEMORY_BUFFER_DESC;
+
 typedef CUresult CUDAAPI tcuInit(unsigned int Flags);
 typedef CUresult CUDAAPI tcuCtxCreate_v2(CUcontext *pctx, unsigned int flags, CUdevice dev);
 typedef CUresult CUDAAPI tcuCtxPushCurrent_v2(CUcontext *pctx);
@@ -104,6 +137,13 @@ typedef CUresult CUDAAPI tcuGraphicsUnregisterResource(CUgraphicsResource resour
 typedef CUresult CUDAAPI tcuGraphicsMapResources(unsigned int count, CUgraphicsResource* resources, CUstream hStream);
 typedef CUresult CUDAAPI tcuGraphicsUnmapResources(unsigned int count, CUgraphicsResource* resources, CUstream hStream);
 typedef CUresult CUDAAPI tcuGraphicsSubResourceGetMappedArray(CUarray* pArray, CUgraphicsResource resource, unsigned int arrayIndex, unsigned int mipLevel);
+typedef CUresult CUDAAPI tcuDeviceGetCount(int *count);
+typedef CUresult CUDAAPI tcuDeviceGetUuid(CUuuid *uuid, CUdevice dev);
+typedef CUresult CUDAAPI tcuCtxSynchronize(void);
+typedef CUresult CUDAAPI tcuMemFree_v2(CUdeviceptr dptr);
+typedef CUresult CUDAAPI tcuImportExternalMemory(CUexternalMemory *extMem_out, const CUDA_EXTERNAL_MEMORY_HANDLE_DESC *memHandleDesc);
+typedef CUresult CUDAAPI tcuExternalMemoryGetMappedBuffer(CUdeviceptr *devPtr, CUexternalMemory extMem, const CUDA_EXTERNAL_MEMORY_BUFFER_DESC *bufferDesc);
+typedef CUresult CUDAAPI tcuDestroyExternalMemory(CUexternalMemory extMem);
 
 #define CUDA_FNS(FN) \
     FN(cuInit, tcuInit) \
@@ -122,10 +162,21 @@ typedef CUresult CUDAAPI tcuGraphicsSubResourceGetMappedArray(CUarray* pArray, C
     FN(cuGraphicsUnmapResources, tcuGraphicsUnmapResources) \
     FN(cuGraphicsSubResourceGetMappedArray, tcuGraphicsSubResourceGetMappedArray) \
 
+// Optional functions, which are NULL if the driver is too old.
+#define CUDA_OPT_FNS(FN) \
+    FN(cuDeviceGetCount, tcuDeviceGetCount) \
+    FN(cuDeviceGetUuid, tcuDeviceGetUuid) \
+    FN(cuCtxSynchronize, tcuCtxSynchronize) \
+    FN(cuMemFree_v2, tcuMemFree_v2) \
+    FN(cuImportExternalMemory, tcuImportExternalMemory) \
+    FN(cuExternalMemoryGetMappedBuffer, tcuExternalMemoryGetMappedBuffer) \
+    FN(cuDestroyExternalMemory, tcuDestroyExternalMemory) \
+
 #define CUDA_EXT_DECL(NAME, TYPE) \
     extern TYPE *mpv_ ## NAME;
 
 CUDA_FNS(CUDA_EXT_DECL)
+CUDA_OPT_FNS(CUDA_EXT_DECL)
 
 #define cuInit mpv_cuInit
 #define cuCtxCreate mpv_cuCtxCreate_v2
@@ -142,7 +193,17 @@ CUDA_FNS(CUDA_EXT_DECL)
 #define cuGraphicsMapResources mpv_cuGraphicsMapResources
 #define cuGraphicsUnmapResources mpv_cuGraphicsUnmapResources
 #define cuGraphicsSubResourceGetMappedArray mpv_cuGraphicsSubResourceGetMappedArray
+#define cuDeviceGetCount mpv_cuDeviceGetCount
+#define cuDeviceGetUuid mpv_cuDeviceGetUuid
+#define cuCtxSynchronize mpv_cuCtxSynchronize
+#define cuMemFree mpv_cuMemFree_v2
+#define cuImportExternalMemory mpv_cuImportExternalMemory
+#define cuExternalMemoryGetMappedBuffer mpv_cuExternalMemoryGetMappedBuffer
+#define cuDestroyExternalMemory mpv_cuDestroyExternalMemory
 
 bool cuda_load(void);
 
+// Whether the optional external memory functions were loaded.
+bool cuda_has_external_memory(void);
+
 #endif // MPV_CUDA_DYNAMIC_H
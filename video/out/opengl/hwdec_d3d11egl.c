@@ -29,6 +29,7 @@
 #include "osdep/windows_utils.h"
 #include "video/out/gpu/hwdec.h"
 #include "ra_gl.h"
+#include "utils.h"
 #include "video/hwdec.h"
 #include "video/decode/d3d.h"
 
@@ -64,11 +65,20 @@ struct priv_owner {
     EGLBoolean (EGLAPIENTRY *StreamPostD3DTextureNV12ANGLE)
             (EGLDisplay dpy, EGLStreamKHR stream, void *texture,
              const EGLAttrib *attrib_list);
+
+    // EGL_ANGLE_stream_producer_d3d_texture (optional, supersedes the NV12
+    // variant and also handles P010)
+    EGLBoolean (EGLAPIENTRY *CreateStreamProducerD3DTextureANGLE)
+            (EGLDisplay dpy, EGLStreamKHR stream, const EGLAttrib *attrib_list);
+    EGLBoolean (EGLAPIENTRY *StreamPostD3DTextureANGLE)
+            (EGLDisplay dpy, EGLStreamKHR stream, void *texture,
+             const EGLAttrib *attrib_list);
 };
 
 struct priv {
     EGLStreamKHR egl_stream;
     GLuint gl_textures[2];
+    int component_bytes; // 1 for NV12, 2 for P010
 };
 
 static void uninit(struct ra_hwdec *hw)
@@ -125,6 +135,25 @@ static int init(struct ra_hwdec *hw)
     p->StreamPostD3DTextureNV12ANGLE =
         (void *)eglGetProcAddress("eglStreamPostD3DTextureNV12ANGLE");
 
+    if (gl_check_extension(exts, "EGL_ANGLE_stream_producer_d3d_texture")) {
+        p->CreateStreamProducerD3DTextureANGLE =
+            (void *)eglGetProcAddress("eglCreateStreamProducerD3DTextureANGLE");
+        p->StreamPostD3DTextureANGLE =
+            (void *)eglGetProcAddress("eglStreamPostD3DTextureANGLE");
+        if (!p->CreateStreamProducerD3DTextureANGLE ||
+            !p->StreamPostD3DTextureANGLE)
+        {
+            p->CreateStreamProducerD3DTextureANGLE = NULL;
+            p->StreamPostD3DTextureANGLE = NULL;
+        }
+    }
+
+    // Without the generic producer, only NV12 surfaces can be posted.
+    if (!p->CreateStreamProducerD3DTextureANGLE) {
+        static const int nv12_only[] = {IMGFMT_D3D11NV12, 0};
+        hw->imgfmts = nv12_only;
+    }
+
     if (!p->CreateStreamKHR || !p->DestroyStreamKHR ||
         !p->StreamConsumerAcquireKHR || !p->StreamConsumerReleaseKHR ||
         !p->StreamConsumerGLTextureExternalAttribsNV ||
@@ -211,7 +240,18 @@ static int mapper_init(struct ra_hwdec_mapper *mapper)
     struct priv *p = mapper->priv;
     GL *gl = ra_gl_get(mapper->ra);
 
-    if (mapper->src_params.hw_subfmt != IMGFMT_NV12) {
+    switch (mapper->src_params.hw_subfmt) {
+    case IMGFMT_NV12:
+        p->component_bytes = 1;
+        break;
+    case IMGFMT_P010:
+        // Only the generic producer can post P010 textures.
+        if (o->CreateStreamProducerD3DTextureANGLE) {
+            p->component_bytes = 2;
+            break;
+        }
+        // fall through
+    default:
         MP_FATAL(mapper, "Format not supported.\n");
         return -1;
     }
@@ -252,9 +292,17 @@ static int mapper_init(struct ra_hwdec_mapper *mapper)
                                                      attrs))
         goto fail;
 
-    if (!o->CreateStreamProducerD3DTextureNV12ANGLE(o->egl_display, p->egl_stream,
+    if (o->CreateStreamProducerD3DTextureANGLE) {
+        if (!o->CreateStreamProducerD3DTextureANGLE(o->egl_display,
+                                                    p->egl_stream,
                                                     (EGLAttrib[]){EGL_NONE}))
-        goto fail;
+            goto fail;
+    } else {
+        if (!o->CreateStreamProducerD3DTextureNV12ANGLE(o->egl_display,
+                                                        p->egl_stream,
+                                                        (EGLAttrib[]){EGL_NONE}))
+            goto fail;
+    }
 
     for (int n = 0; n < num_planes; n++) {
         gl->ActiveTexture(GL_TEXTURE0 + texunits + n);
@@ -278,17 +326,20 @@ static int mapper_map(struct ra_hwdec_mapper *mapper)
     if (!d3d_tex)
         return -1;
 
+    // The decoder texture is an array texture; the subresource selects the
+    // slice, so no copy into a separate texture is needed.
     EGLAttrib attrs[] = {
         EGL_D3D_TEXTURE_SUBRESOURCE_ID_ANGLE, d3d_subindex,
         EGL_NONE,
     };
-    if (!o->StreamPostD3DTextureNV12ANGLE(o->egl_display, p->egl_stream,
-                                          (void *)d3d_tex, attrs))
-    {
+    EGLBoolean (EGLAPIENTRY *post)(EGLDisplay, EGLStreamKHR, void *,
+                                   const EGLAttrib *) =
+        o->StreamPostD3DTextureANGLE ? o->StreamPostD3DTextureANGLE
+                                     : o->StreamPostD3DTextureNV12ANGLE;
+    if (!post(o->egl_display, p->egl_stream, (void *)d3d_tex, attrs)) {
         // ANGLE changed the enum ID of this without warning at one point.
         attrs[0] = attrs[0] == 0x33AB ? 0x3AAB : 0x33AB;
-        if (!o->StreamPostD3DTextureNV12ANGLE(o->egl_display, p->egl_stream,
-                                              (void *)d3d_tex, attrs))
+        if (!post(o->egl_display, p->egl_stream, (void *)d3d_tex, attrs))
             return -1;
     }
 
@@ -304,7 +355,8 @@ static int mapper_map(struct ra_hwdec_mapper *mapper)
             .w = texdesc.Width / (n ? 2 : 1),
             .h = texdesc.Height / (n ? 2 : 1),
             .d = 1,
-            .format = ra_find_unorm_format(mapper->ra, 1, n ? 2 : 1),
+            .format = ra_find_unorm_format(mapper->ra, p->component_bytes,
+                                           n ? 2 : 1),
             .render_src = true,
             .src_linear = true,
             .external_oes = true,
@@ -336,7 +388,7 @@ const struct ra_hwdec_driver ra_hwdec_d3d11egl = {
     .name = "d3d11-egl",
     .priv_size = sizeof(struct priv_owner),
     .api = HWDEC_D3D11VA,
-    .imgfmts = {IMGFMT_D3D11NV12, 0},
+    .imgfmts = {IMGFMT_D3D11NV12, IMGFMT_D3D11VA, 0},
     .init = init,
     .uninit = uninit,
     .mapper = &(const struct ra_hwdec_mapper_driver){
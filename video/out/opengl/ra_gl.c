@@ -256,6 +256,7 @@ static struct ra_tex *gl_tex_create_blank(struct ra *ra,
     tex->params = *params;
     tex->params.initial_data = NULL;
     struct ra_tex_gl *tex_gl = tex->priv = talloc_zero(NULL, struct ra_tex_gl);
+    tex_gl->pbo.try_mapped = ra_gl_get(ra)->version >= 440;
 
     const struct gl_format *fmt = params->format->priv;
     tex_gl->internal_format = fmt->internal_format;
@@ -1121,6 +1122,12 @@ static void gl_debug_marker(struct ra *ra, const char *msg)
         gl_check_error(p->gl, ra->log, msg);
 }
 
+static void gl_flush(struct ra *ra)
+{
+    struct ra_gl *p = ra->priv;
+    p->gl->Flush();
+}
+
 static struct ra_fns ra_fns_gl = {
     .destroy                = gl_destroy,
     .tex_create             = gl_tex_create,
@@ -1142,4 +1149,5 @@ static struct ra_fns ra_fns_gl = {
     .timer_start            = gl_timer_start,
     .timer_stop             = gl_timer_stop,
     .debug_marker           = gl_debug_marker,
+    .flush                  = gl_flush,
 };
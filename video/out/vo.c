@@ -41,6 +41,7 @@
 #include "options/m_config.h"
 #include "common/msg.h"
 #include "common/global.h"
+#include "common/perf.h"
 #include "video/hwdec.h"
 #include "video/mp_image.h"
 #include "sub/osd.h"
@@ -63,6 +64,8 @@ extern const struct vo_driver video_out_sdl;
 extern const struct vo_driver video_out_vaapi;
 extern const struct vo_driver video_out_rpi;
 extern const struct vo_driver video_out_tct;
+extern const struct vo_driver video_out_shm;
+extern const struct vo_driver video_out_tee;
 
 const struct vo_driver *const video_out_drivers[] =
 {
@@ -95,6 +98,10 @@ const struct vo_driver *const video_out_drivers[] =
     // should not be auto-selected
     &video_out_image,
     &video_out_tct,
+    &video_out_tee,
+#if HAVE_POSIX
+    &video_out_shm,
+#endif
 #if HAVE_CACA
     &video_out_caca,
 #endif
@@ -146,6 +153,19 @@ struct vo_internal {
     bool expecting_vsync;
     int64_t num_successive_vsyncs;
 
+    // Presentation feedback (vo_report_presentation()).
+    bool have_presentation;         // VO reports actual presentation times
+    int64_t present_time;           // time of the last reported presentation
+    int64_t present_msc;            // vsync counter of the last presentation
+    int64_t num_swaps;              // swaps since the last timing reset
+    int64_t num_presented;          // presentations since the last reset
+
+    // External vsync source (vo_report_vsync()).
+    pthread_cond_t vsync_wakeup;
+    int64_t ext_vsync_time;         // time of the last reported vsync
+    uint64_t ext_vsync_count;       // number of reported vsyncs
+    uint64_t ext_vsync_waited;      // ext_vsync_count seen by vo_wait_vsync()
+
     int64_t flip_queue_offset; // queue flip events at most this much in advance
 
     int64_t delayed_count;
@@ -158,11 +178,22 @@ struct vo_internal {
 
     bool rendering;                 // true if an image is being rendered
     struct vo_frame *frame_queued;  // should be drawn next
+    bool frame_prerendered;         // frame_queued was passed to prerender
     int req_frames;                 // VO's requested value of num_frames
     uint64_t current_frame_id;
 
     double display_fps;
     int opt_framedrop;
+
+    // Result of VOCTRL_GET_WIN_STATE, refreshed by the VO thread on
+    // VO_EVENT_WIN_STATE, so readers don't need to wait for the VO thread.
+    bool win_state_valid;
+    int win_state;
+
+    // Frame timing log (--frame-timing-log). Ring buffer, the oldest entry is
+    // at frame_timings[timings_start].
+    struct vo_frame_timing *frame_timings;
+    int timings_start, num_timings, timings_alloc;
 };
 
 extern const struct m_sub_options gl_video_conf;
@@ -247,11 +278,14 @@ static void dealloc_vo(struct vo *vo)
 
     pthread_mutex_destroy(&vo->in->lock);
     pthread_cond_destroy(&vo->in->wakeup);
+    pthread_cond_destroy(&vo->in->vsync_wakeup);
     talloc_free(vo);
 }
 
-static struct vo *vo_create(bool probing, struct mpv_global *global,
-                            struct vo_extra *ex, char *name)
+// Create a VO using the driver with the given name. Normally, this is done by
+// init_best_video_out(); vo_tee uses it to create its outputs.
+struct vo *vo_create(bool probing, struct mpv_global *global,
+                     struct vo_extra *ex, char *name)
 {
     assert(ex->wakeup_cb);
 
@@ -284,6 +318,7 @@ static struct vo *vo_create(bool probing, struct mpv_global *global,
     mp_dispatch_set_wakeup_fn(vo->in->dispatch, dispatch_wakeup_cb, vo);
     pthread_mutex_init(&vo->in->lock, NULL);
     pthread_cond_init(&vo->in->wakeup, NULL);
+    pthread_cond_init(&vo->in->vsync_wakeup, NULL);
 
     vo->opts_cache = m_config_cache_alloc(NULL, global, &vo_sub_opts);
     vo->opts = vo->opts_cache->opts;
@@ -380,6 +415,9 @@ static void reset_vsync_timings(struct vo *vo)
     in->base_vsync = 0;
     in->expecting_vsync = false;
     in->num_successive_vsyncs = 0;
+    in->present_time = 0;
+    in->num_swaps = 0;
+    in->num_presented = 0;
 }
 
 static double vsync_stddef(struct vo *vo, int64_t ref_vsync)
@@ -462,6 +500,32 @@ static void vsync_skip_detection(struct vo *vo)
         in->base_vsync += desync / 10;  // smooth out drift
 }
 
+// Add a measured vsync duration, and update the estimates derived from it.
+// Always called locked.
+static void add_vsync_sample(struct vo *vo, int64_t sample)
+{
+    struct vo_internal *in = vo->in;
+
+    if (in->num_vsync_samples >= MAX_VSYNC_SAMPLES)
+        in->num_vsync_samples -= 1;
+    MP_TARRAY_INSERT_AT(in, in->vsync_samples, in->num_vsync_samples, 0,
+                        sample);
+    in->drop_point = MPMIN(in->drop_point + 1, in->num_vsync_samples);
+    in->num_total_vsync_samples += 1;
+
+    double avg = 0;
+    for (int n = 0; n < in->num_vsync_samples; n++)
+        avg += in->vsync_samples[n];
+    in->estimated_vsync_interval = avg / in->num_vsync_samples;
+    in->estimated_vsync_jitter =
+        vsync_stddef(vo, in->vsync_interval) / in->vsync_interval;
+
+    check_estimated_display_fps(vo);
+
+    MP_STATS(vo, "value %f jitter", in->estimated_vsync_jitter);
+    MP_STATS(vo, "value %f vsync-diff", in->vsync_samples[0] / 1e6);
+}
+
 // Always called locked.
 static void update_vsync_timing_after_swap(struct vo *vo)
 {
@@ -481,30 +545,99 @@ static void update_vsync_timing_after_swap(struct vo *vo)
     if (in->num_successive_vsyncs <= 2)
         return;
 
-    if (in->num_vsync_samples >= MAX_VSYNC_SAMPLES)
-        in->num_vsync_samples -= 1;
-    MP_TARRAY_INSERT_AT(in, in->vsync_samples, in->num_vsync_samples, 0,
-                        now - prev_vsync);
-    in->drop_point = MPMIN(in->drop_point + 1, in->num_vsync_samples);
-    in->num_total_vsync_samples += 1;
     if (in->base_vsync) {
         in->base_vsync += in->vsync_interval;
     } else {
         in->base_vsync = now;
     }
 
-    double avg = 0;
-    for (int n = 0; n < in->num_vsync_samples; n++)
-        avg += in->vsync_samples[n];
-    in->estimated_vsync_interval = avg / in->num_vsync_samples;
-    in->estimated_vsync_jitter =
-        vsync_stddef(vo, in->vsync_interval) / in->vsync_interval;
+    // With presentation feedback, the samples and drift correction come from
+    // vo_report_presentation() instead of the (much noisier) swap return time.
+    if (in->have_presentation) {
+        in->num_swaps++;
+        return;
+    }
 
-    check_estimated_display_fps(vo);
+    add_vsync_sample(vo, now - prev_vsync);
     vsync_skip_detection(vo);
+}
 
-    MP_STATS(vo, "value %f jitter", in->estimated_vsync_jitter);
-    MP_STATS(vo, "value %f vsync-diff", in->vsync_samples[0] / 1e6);
+// Report that a frame was actually shown on screen at time_us (in mp_time_us()
+// time). msc is the display's vsync counter at that point, which must increase
+// with each vsync, or 0 if unknown. Can be called from any thread, but must be
+// called once for each presented swap, in order. Once this was called, the VO
+// is assumed to report all further presentations.
+void vo_report_presentation(struct vo *vo, int64_t time_us, int64_t msc)
+{
+    struct vo_internal *in = vo->in;
+    pthread_mutex_lock(&in->lock);
+    in->have_presentation = true;
+    int64_t vsyncs = 0;
+    if (in->present_time && time_us > in->present_time) {
+        if (msc > 0 && in->present_msc > 0) {
+            vsyncs = msc - in->present_msc;
+        } else if (in->vsync_interval > 1) {
+            vsyncs = llrint((time_us - in->present_time) /
+                            (double)in->vsync_interval);
+        }
+    }
+    if (in->num_presented < in->num_swaps)
+        in->num_presented++;
+    if (in->expecting_vsync && in->base_vsync && vsyncs > 0) {
+        add_vsync_sample(vo, (time_us - in->present_time) / vsyncs);
+
+        // Frames swapped after the one just presented will show up one vsync
+        // after each other, so base_vsync (the expected display time of the
+        // last swapped frame) can be checked against the real time.
+        int64_t pending = MPMAX(in->num_swaps - in->num_presented, 0);
+        int64_t expected = in->base_vsync - pending * in->vsync_interval;
+        int64_t desync = time_us - expected;
+        if (vsyncs > 1 || llabs(desync) >= in->vsync_interval * 3 / 4) {
+            // A vsync was missed, or the estimate was off by a whole frame.
+            in->base_vsync += desync;
+            in->delayed_count += 1;
+            MP_STATS(vo, "vo-delayed");
+        } else {
+            in->base_vsync += desync / 10;  // smooth out drift
+        }
+    }
+    in->present_time = time_us;
+    in->present_msc = msc;
+    pthread_mutex_unlock(&in->lock);
+}
+
+// Report a vsync event from an external source (such as a display callback),
+// which happened at time_us (in mp_time_us() time). Can be called from any
+// thread. This only wakes up vo_wait_vsync().
+void vo_report_vsync(struct vo *vo, int64_t time_us)
+{
+    struct vo_internal *in = vo->in;
+    pthread_mutex_lock(&in->lock);
+    in->ext_vsync_time = time_us;
+    in->ext_vsync_count++;
+    pthread_cond_broadcast(&in->vsync_wakeup);
+    pthread_mutex_unlock(&in->lock);
+}
+
+// Wait for the next vsync reported with vo_report_vsync(), for VOs whose
+// flip_page doesn't block on vsync by itself. Returns the time of the vsync,
+// or 0 on timeout. If vsyncs were reported since the last call, returns the
+// latest one immediately.
+int64_t vo_wait_vsync(struct vo *vo, int64_t timeout_us)
+{
+    struct vo_internal *in = vo->in;
+    struct timespec ts = mp_rel_time_to_timespec(timeout_us / 1e6);
+    int64_t res = 0;
+    pthread_mutex_lock(&in->lock);
+    while (in->ext_vsync_count == in->ext_vsync_waited) {
+        if (pthread_cond_timedwait(&in->vsync_wakeup, &in->lock, &ts))
+            break;
+    }
+    if (in->ext_vsync_count != in->ext_vsync_waited)
+        res = in->ext_vsync_time;
+    in->ext_vsync_waited = in->ext_vsync_count;
+    pthread_mutex_unlock(&in->lock);
+    return res;
 }
 
 // to be called from VO thread only
@@ -527,8 +660,21 @@ static void update_display_fps(struct vo *vo)
         if (display_fps <= 0)
             vo->driver->control(vo, VOCTRL_GET_DISPLAY_FPS, &display_fps);
 
+        int win_state = 0;
+        bool win_state_valid =
+            vo->driver->control(vo, VOCTRL_GET_WIN_STATE, &win_state) >= 1;
+
         pthread_mutex_lock(&in->lock);
 
+        if (in->win_state_valid != win_state_valid ||
+            in->win_state != win_state)
+        {
+            in->win_state_valid = win_state_valid;
+            in->win_state = win_state;
+            in->queued_events |= VO_EVENT_WIN_STATE;
+            wakeup_core(vo);
+        }
+
         if (in->display_fps != display_fps) {
             in->display_fps = display_fps;
             MP_VERBOSE(vo, "Assuming %f FPS for display sync.\n", display_fps);
@@ -595,7 +741,9 @@ int vo_reconfig(struct vo *vo, struct mp_image_params *params)
 {
     int ret;
     void *p[] = {vo, params, &ret};
+    MP_STATS(vo, "start vo reconfig");
     mp_dispatch_run(vo->in->dispatch, run_reconfig, p);
+    MP_STATS(vo, "end vo reconfig");
     return ret;
 }
 
@@ -717,12 +865,25 @@ void vo_wakeup(struct vo *vo)
 // callback once the time is right.
 // If next_pts is negative, disable any timing and draw the frame as fast as
 // possible.
+// With display-sync, the next frame can be queued while the current one is
+// still shown for one more vsync, so the VO can render it ahead of time. This
+// moves the GPU work of a new frame away from the vsync it's presented on.
+// must be called locked
+static bool can_render_ahead(struct vo *vo)
+{
+    struct vo_internal *in = vo->in;
+    return vo->driver->prerender_frame && !in->paused && in->current_frame &&
+           in->current_frame->display_synced &&
+           in->current_frame->num_vsyncs == 1;
+}
+
 bool vo_is_ready_for_frame(struct vo *vo, int64_t next_pts)
 {
     struct vo_internal *in = vo->in;
     pthread_mutex_lock(&in->lock);
     bool r = vo->config_ok && !in->frame_queued &&
-             (!in->current_frame || in->current_frame->num_vsyncs < 1);
+             (!in->current_frame || in->current_frame->num_vsyncs < 1 ||
+              can_render_ahead(vo));
     if (r && next_pts >= 0) {
         // Don't show the frame too early - it would basically freeze the
         // display by disallowing OSD redrawing or VO interaction.
@@ -751,10 +912,13 @@ void vo_queue_frame(struct vo *vo, struct vo_frame *frame)
     struct vo_internal *in = vo->in;
     pthread_mutex_lock(&in->lock);
     assert(vo->config_ok && !in->frame_queued &&
-           (!in->current_frame || in->current_frame->num_vsyncs < 1));
+           (!in->current_frame || in->current_frame->num_vsyncs < 1 ||
+            can_render_ahead(vo)));
     in->hasframe = true;
     frame->frame_id = ++(in->current_frame_id);
+    frame->queued_time = mp_time_us();
     in->frame_queued = frame;
+    in->frame_prerendered = false;
     in->wakeup_pts = frame->display_synced
                    ? 0 : frame->pts + MPMAX(frame->duration, 0);
     wakeup_locked(vo);
@@ -788,6 +952,46 @@ static void wait_until(struct vo *vo, int64_t target)
     pthread_mutex_unlock(&in->lock);
 }
 
+// Append t to the frame timing log, and drop entries that are older than
+// --frame-timing-log seconds. Called with lock held.
+static void log_frame_timing(struct vo *vo, struct vo_frame_timing *t)
+{
+    struct vo_internal *in = vo->in;
+
+    double keep = vo->opts->frame_timing_log;
+    if (keep <= 0) {
+        TA_FREEP(&in->frame_timings);
+        in->timings_start = in->num_timings = in->timings_alloc = 0;
+        return;
+    }
+
+    int64_t min_time = mp_time_us() - (int64_t)(keep * 1e6);
+    while (in->num_timings &&
+           in->frame_timings[in->timings_start].queued < min_time)
+    {
+        in->timings_start = (in->timings_start + 1) % in->timings_alloc;
+        in->num_timings--;
+    }
+
+    if (in->num_timings == in->timings_alloc) {
+        int alloc = MPMAX(in->timings_alloc * 2, 64);
+        struct vo_frame_timing *new =
+            talloc_array(in, struct vo_frame_timing, alloc);
+        for (int n = 0; n < in->num_timings; n++) {
+            new[n] = in->frame_timings[(in->timings_start + n) %
+                                       in->timings_alloc];
+        }
+        talloc_free(in->frame_timings);
+        in->frame_timings = new;
+        in->timings_alloc = alloc;
+        in->timings_start = 0;
+    }
+
+    int pos = (in->timings_start + in->num_timings) % in->timings_alloc;
+    in->frame_timings[pos] = *t;
+    in->num_timings++;
+}
+
 static bool render_frame(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
@@ -798,7 +1002,13 @@ static bool render_frame(struct vo *vo)
 
     pthread_mutex_lock(&in->lock);
 
-    if (in->frame_queued) {
+    // A frame queued early (see can_render_ahead()) waits until the current
+    // frame has been shown for its last vsync.
+    bool hold = in->frame_queued && in->current_frame && !in->paused &&
+                in->current_frame->display_synced &&
+                in->current_frame->num_vsyncs > 0;
+
+    if (in->frame_queued && !hold) {
         talloc_free(in->current_frame);
         in->current_frame = in->frame_queued;
         in->frame_queued = NULL;
@@ -851,16 +1061,29 @@ static bool render_frame(struct vo *vo)
         in->prev_vsync = now;
     in->expecting_vsync = use_vsync;
 
+    struct vo_frame_timing timing = {
+        .frame_id = frame->frame_id,
+        .video_pts = frame->current ? frame->current->pts : MP_NOPTS_VALUE,
+        .audio_pts = frame->audio_pts,
+        .decoded = frame->decoded_time,
+        .queued = frame->queued_time,
+        .target = target,
+    };
+
     if (in->dropped_frame) {
         in->drop_count += 1;
+        mp_perf_add(vo->global, MP_PERF_VO_DROPPED, 1);
     } else {
         in->rendering = true;
         in->hasframe_rendered = true;
         int64_t prev_drop_count = vo->in->drop_count;
+        int64_t prev_delayed_count = in->delayed_count;
         pthread_mutex_unlock(&in->lock);
         wakeup_core(vo); // core can queue new video now
 
         MP_STATS(vo, "start video-draw");
+        int64_t t0 = mp_time_us();
+        timing.render_start = t0;
 
         if (vo->driver->draw_frame) {
             vo->driver->draw_frame(vo, frame);
@@ -868,14 +1091,20 @@ static bool render_frame(struct vo *vo)
             vo->driver->draw_image(vo, mp_image_new_ref(frame->current));
         }
 
+        timing.render_end = mp_time_us();
+        mp_perf_time(vo->global, MP_PERF_VO_RENDER, timing.render_end - t0);
         MP_STATS(vo, "end video-draw");
 
         wait_until(vo, target);
 
         MP_STATS(vo, "start video-flip");
+        t0 = mp_time_us();
+        timing.swap_start = t0;
 
         vo->driver->flip_page(vo);
 
+        timing.swap_end = mp_time_us();
+        mp_perf_time(vo->global, MP_PERF_VO_PRESENT, timing.swap_end - t0);
         MP_STATS(vo, "end video-flip");
 
         pthread_mutex_lock(&in->lock);
@@ -883,6 +1112,29 @@ static bool render_frame(struct vo *vo)
         in->rendering = false;
 
         update_vsync_timing_after_swap(vo);
+
+        timing.vsync = in->prev_vsync;
+        timing.delayed = in->delayed_count > prev_delayed_count;
+
+        // Render the next frame while the current one is still on screen.
+        if (in->frame_queued && !in->frame_prerendered &&
+            vo->driver->prerender_frame)
+        {
+            struct vo_frame *next = vo_frame_ref(in->frame_queued);
+            in->frame_prerendered = true;
+            in->rendering = true;
+            pthread_mutex_unlock(&in->lock);
+
+            MP_STATS(vo, "start video-prerender");
+            t0 = mp_time_us();
+            vo->driver->prerender_frame(vo, next);
+            mp_perf_time(vo->global, MP_PERF_VO_RENDER, mp_time_us() - t0);
+            MP_STATS(vo, "end video-prerender");
+            talloc_free(next);
+
+            pthread_mutex_lock(&in->lock);
+            in->rendering = false;
+        }
     }
 
     if (vo->driver->caps & VO_CAP_NOREDRAW) {
@@ -896,6 +1148,9 @@ static bool render_frame(struct vo *vo)
         in->request_redraw = false;
     }
 
+    timing.dropped = in->dropped_frame;
+    log_frame_timing(vo, &timing);
+
     pthread_cond_broadcast(&in->wakeup); // for vo_wait_frame()
     wakeup_core(vo);
 
@@ -1227,6 +1482,23 @@ int64_t vo_get_delayed_count(struct vo *vo)
     return res;
 }
 
+// Return a copy of the frame timing log, oldest entry first. The array is
+// allocated under ta_parent; returns the number of entries.
+int vo_get_frame_timings(struct vo *vo, void *ta_parent,
+                         struct vo_frame_timing **out)
+{
+    struct vo_internal *in = vo->in;
+    pthread_mutex_lock(&in->lock);
+    int num = in->num_timings;
+    *out = talloc_array(ta_parent, struct vo_frame_timing, num);
+    for (int n = 0; n < num; n++) {
+        (*out)[n] = in->frame_timings[(in->timings_start + n) %
+                                      in->timings_alloc];
+    }
+    pthread_mutex_unlock(&in->lock);
+    return num;
+}
+
 double vo_get_display_fps(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
@@ -1236,6 +1508,18 @@ double vo_get_display_fps(struct vo *vo)
     return res;
 }
 
+// Return the last known VOCTRL_GET_WIN_STATE result. Unlike vo_control(),
+// this doesn't block on the VO thread. Returns false if unsupported.
+bool vo_get_win_state(struct vo *vo, int *state)
+{
+    struct vo_internal *in = vo->in;
+    pthread_mutex_lock(&in->lock);
+    bool valid = in->win_state_valid;
+    *state = in->win_state;
+    pthread_mutex_unlock(&in->lock);
+    return valid;
+}
+
 // Set specific event flags, and wakeup the playback core if needed.
 // vo_query_and_reset_events() can retrieve the events again.
 void vo_event(struct vo *vo, int event)
@@ -1398,3 +1682,44 @@ struct mp_image *vo_get_image(struct vo *vo, int imgfmt, int w, int h,
     mp_dispatch_run(vo->in->dispatch, sync_get_image, &cmd);
     return cmd.res;
 }
+
+static int hist_bucket(uint64_t ns)
+{
+    if (ns < (1ULL << VO_PERF_HIST_MIN_LOG2))
+        return 0;
+    int e = 0;
+    while (ns >> (e + 1))
+        e++;
+    int sub = (ns >> (e - 3)) & (VO_PERF_HIST_SUB - 1);
+    int bucket = (e - VO_PERF_HIST_MIN_LOG2) * VO_PERF_HIST_SUB + sub;
+    return MPMIN(bucket, VO_PERF_HIST_BUCKETS - 1);
+}
+
+void mp_pass_hist_add(struct mp_pass_hist *hist, uint64_t ns)
+{
+    hist->buckets[hist_bucket(ns)] += 1;
+    hist->count += 1;
+}
+
+// Return the (exclusive) upper bound of the given bucket, in nanoseconds.
+uint64_t mp_pass_hist_bucket_max(int bucket)
+{
+    int e = bucket / VO_PERF_HIST_SUB + VO_PERF_HIST_MIN_LOG2;
+    uint64_t sub = bucket % VO_PERF_HIST_SUB;
+    return (VO_PERF_HIST_SUB + sub + 1) << (e - 3);
+}
+
+// Return an upper bound for the p-th quantile (0 <= p <= 1), or 0 if empty.
+uint64_t mp_pass_hist_percentile(const struct mp_pass_hist *hist, double p)
+{
+    if (!hist->count)
+        return 0;
+    uint64_t target = ceil(hist->count * MPCLAMP(p, 0.0, 1.0));
+    uint64_t sum = 0;
+    for (int n = 0; n < VO_PERF_HIST_BUCKETS; n++) {
+        sum += hist->buckets[n];
+        if (sum >= MPMAX(target, 1))
+            return mp_pass_hist_bucket_max(n);
+    }
+    return mp_pass_hist_bucket_max(VO_PERF_HIST_BUCKETS - 1);
+}
@@ -154,17 +154,63 @@ struct mp_pass_perf {
 
 #define VO_PASS_PERF_MAX 64
 
+// Histogram of execution times over the whole lifetime of a pass. The buckets
+// are logarithmic: each power of 2 (starting at 2^VO_PERF_HIST_MIN_LOG2 ns) is
+// split into VO_PERF_HIST_SUB buckets, so the relative error is at most 1/8.
+#define VO_PERF_HIST_SUB 8
+#define VO_PERF_HIST_MIN_LOG2 10
+#define VO_PERF_HIST_BUCKETS (24 * VO_PERF_HIST_SUB)
+
+struct mp_pass_hist {
+    uint64_t count;
+    uint32_t buckets[VO_PERF_HIST_BUCKETS];
+};
+
+void mp_pass_hist_add(struct mp_pass_hist *hist, uint64_t ns);
+uint64_t mp_pass_hist_bucket_max(int bucket);
+uint64_t mp_pass_hist_percentile(const struct mp_pass_hist *hist, double p);
+
 struct mp_frame_perf {
     int count;
     struct mp_pass_perf perf[VO_PASS_PERF_MAX];
+    struct mp_pass_hist hist[VO_PASS_PERF_MAX];
+    // Sum of all passes per frame.
+    struct mp_pass_hist total;
     // The owner of this struct does not have ownership over the names, and
     // they may change at any time - so this struct should not be stored
     // anywhere or the results reused
     char *desc[VO_PASS_PERF_MAX];
 };
 
+struct mp_shader_cache_perf {
+    uint64_t hits, misses, evictions;
+    uint64_t compile_time; // total time spent creating shaders, in nanoseconds
+    int entries, max_entries;
+};
+
+#define VO_GPU_MEM_HEAPS_MAX 32
+
+// Memory allocated by the GPU API backend (currently only vulkan). A heap is
+// a set of allocations with the same usage/memory flags, which are the API's
+// native flag values.
+struct mp_gpu_mem_heap {
+    uint32_t usage, flags;
+    int num_slabs;
+    int num_regions;    // number of free regions (measures fragmentation)
+    uint64_t size;      // total allocated size in bytes
+    uint64_t used;      // size actually in use
+};
+
+struct mp_gpu_mem_stats {
+    int num_heaps;
+    struct mp_gpu_mem_heap heaps[VO_GPU_MEM_HEAPS_MAX];
+    uint64_t released;  // total size of slabs released as unused
+};
+
 struct voctrl_performance_data {
     struct mp_frame_perf fresh, redraw;
+    struct mp_shader_cache_perf shader_cache;
+    struct mp_gpu_mem_stats gpu_mem;
 };
 
 enum {
@@ -239,6 +285,31 @@ struct vo_frame {
     // drops or reconfigs will keep the guarantee.
     // The ID is never 0 (unless num_frames==0). IDs are strictly monotonous.
     uint64_t frame_id;
+    // For the frame timing log only: realtime (mp_time_us()) at which the
+    // player got the frame from the decoder or filters (0 if unknown), and the
+    // audio playback position when it was queued (MP_NOPTS_VALUE if unknown).
+    int64_t decoded_time;
+    double audio_pts;
+    // Set by vo_queue_frame().
+    int64_t queued_time;
+};
+
+// Timestamps of a single rendered or dropped frame, as recorded with
+// --frame-timing-log. Times are in mp_time_us() units, or 0 if not applicable.
+struct vo_frame_timing {
+    uint64_t frame_id;
+    double video_pts;       // media timestamp of the frame
+    double audio_pts;       // audio position when the frame was queued
+    int64_t decoded;        // frame returned by decoder/filters
+    int64_t queued;         // vo_queue_frame() was called
+    int64_t target;         // scheduled display time (0: display-synced)
+    int64_t render_start;   // draw_frame() start
+    int64_t render_end;
+    int64_t swap_start;     // flip_page() start
+    int64_t swap_end;
+    int64_t vsync;          // vsync (or reported presentation) after the swap
+    bool dropped;
+    bool delayed;           // vsync skip detected after the swap
 };
 
 struct vo_driver {
@@ -324,6 +395,12 @@ struct vo_driver {
      */
     void (*draw_frame)(struct vo *vo, struct vo_frame *frame);
 
+    /* Optional. Render the given frame ahead of time, so that the following
+     * draw_frame() call with it is cheap. Called with display-sync while the
+     * previous frame is still being shown, right after flip_page().
+     */
+    void (*prerender_frame)(struct vo *vo, struct vo_frame *frame);
+
     /*
      * Blit/Flip buffer to the screen. Must be called after each frame!
      */
@@ -412,6 +489,8 @@ struct vo {
 
 struct mpv_global;
 struct vo *init_best_video_out(struct mpv_global *global, struct vo_extra *ex);
+struct vo *vo_create(bool probing, struct mpv_global *global,
+                     struct vo_extra *ex, char *name);
 int vo_reconfig(struct vo *vo, struct mp_image_params *p);
 
 int vo_control(struct vo *vo, int request, void *data);
@@ -429,6 +508,11 @@ void vo_set_paused(struct vo *vo, bool paused);
 int64_t vo_get_drop_count(struct vo *vo);
 void vo_increment_drop_count(struct vo *vo, int64_t n);
 int64_t vo_get_delayed_count(struct vo *vo);
+int vo_get_frame_timings(struct vo *vo, void *ta_parent,
+                         struct vo_frame_timing **out);
+void vo_report_presentation(struct vo *vo, int64_t time_us, int64_t msc);
+void vo_report_vsync(struct vo *vo, int64_t time_us);
+int64_t vo_wait_vsync(struct vo *vo, int64_t timeout_us);
 void vo_query_formats(struct vo *vo, uint8_t *list);
 void vo_event(struct vo *vo, int event);
 int vo_query_and_reset_events(struct vo *vo, int events);
@@ -439,6 +523,7 @@ int64_t vo_get_vsync_interval(struct vo *vo);
 double vo_get_estimated_vsync_interval(struct vo *vo);
 double vo_get_estimated_vsync_jitter(struct vo *vo);
 double vo_get_display_fps(struct vo *vo);
+bool vo_get_win_state(struct vo *vo, int *state);
 double vo_get_delay(struct vo *vo);
 void vo_discard_timing_info(struct vo *vo);
 struct mp_image *vo_get_image(struct vo *vo, int imgfmt, int w, int h,
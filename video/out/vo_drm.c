@@ -25,7 +25,12 @@
 
 #include <libswscale/swscale.h>
 
+#include "config.h"
+
 #include "drm_common.h"
+#if HAVE_DRMPRIME
+#include "drm_prime.h"
+#endif
 
 #include "common/msg.h"
 #include "osdep/timer.h"
@@ -39,11 +44,12 @@
 #define BYTES_PER_PIXEL 4
 #define BITS_PER_PIXEL 32
 #define USE_MASTER 0
-#define BUF_COUNT 2
+#define BUF_COUNT 3
 
 struct framebuffer {
     uint32_t width;
     uint32_t height;
+    uint32_t depth;
     uint32_t stride;
     uint32_t size;
     uint32_t handle;
@@ -51,6 +57,13 @@ struct framebuffer {
     uint32_t fb;
 };
 
+#if HAVE_DRMPRIME
+struct prime_frame {
+    struct drm_prime_framebuffer fb;
+    struct mp_image *image;
+};
+#endif
+
 struct priv {
     char *connector_spec;
     int mode_id;
@@ -62,19 +75,31 @@ struct priv {
     bool vt_switcher_active;
     struct vt_switcher vt_switcher;
 
+    // Frames are rendered into a free buffer while another one is queued for
+    // the next page flip, and a third one is being scanned out.
     struct framebuffer bufs[BUF_COUNT];
-    int front_buf;
+    int front_buf;      // currently scanned out
+    int queued_buf;     // pending page flip to this buffer, or -1
+    int back_buf;       // last buffer drawn by draw_image()
     bool active;
     bool pflip_happening;
 
     int32_t screen_w;
     int32_t screen_h;
     struct mp_image *last_input;
-    struct mp_image *cur_frame;
+    struct mp_image *cur_frame;     // OSD staging image (PRIME mode only)
     struct mp_rect src;
     struct mp_rect dst;
     struct mp_osd_res osd;
     struct mp_sws_context *sws;
+
+    // With DRM PRIME input, the frames are scanned out directly from an
+    // overlay plane, and the dumb buffers on the primary plane only contain
+    // the OSD (with alpha). Each frame is presented with one atomic commit.
+    bool prime_mode;
+#if HAVE_DRMPRIME
+    struct prime_frame prime_next, prime_cur, prime_old;
+#endif
 };
 
 static void fb_destroy(int fd, struct framebuffer *buf)
@@ -112,8 +137,8 @@ static bool fb_setup_single(struct vo *vo, int fd, struct framebuffer *buf)
     buf->handle = creq.handle;
 
     // create framebuffer object for the dumb-buffer
-    if (drmModeAddFB(fd, buf->width, buf->height, 24, creq.bpp, buf->stride,
-                     buf->handle, &buf->fb)) {
+    if (drmModeAddFB(fd, buf->width, buf->height, buf->depth, creq.bpp,
+                     buf->stride, buf->handle, &buf->fb)) {
         MP_ERR(vo, "Cannot create framebuffer: %s\n", mp_strerror(errno));
         goto err;
     }
@@ -143,14 +168,20 @@ err:
     return false;
 }
 
-static bool fb_setup_double_buffering(struct vo *vo)
+// depth is 24 for XRGB, or 32 for ARGB
+static bool fb_setup_buffers(struct vo *vo, int depth)
 {
     struct priv *p = vo->priv;
 
     p->front_buf = 0;
-    for (unsigned int i = 0; i < 2; i++) {
-        p->bufs[i].width = p->kms->mode.hdisplay;
-        p->bufs[i].height = p->kms->mode.vdisplay;
+    p->queued_buf = -1;
+    p->back_buf = 0;
+    for (unsigned int i = 0; i < BUF_COUNT; i++) {
+        p->bufs[i] = (struct framebuffer){
+            .width = p->kms->mode.hdisplay,
+            .height = p->kms->mode.vdisplay,
+            .depth = depth,
+        };
     }
 
     for (unsigned int i = 0; i < BUF_COUNT; i++) {
@@ -169,8 +200,68 @@ static bool fb_setup_double_buffering(struct vo *vo)
 static void page_flipped(int fd, unsigned int frame, unsigned int sec,
                          unsigned int usec, void *data)
 {
-    struct priv *p = data;
+    struct vo *vo = data;
+    struct priv *p = vo->priv;
+    if (p->queued_buf >= 0)
+        p->front_buf = p->queued_buf;
+    p->queued_buf = -1;
     p->pflip_happening = false;
+    int64_t t = mp_time_us_from_monotonic(sec * INT64_C(1000000) + usec);
+    vo_report_presentation(vo, t, frame);
+}
+
+// Block until the pending page flip (if any) has completed. Only one flip can
+// be queued on a CRTC at a time.
+static void wait_pending_flip(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    const int timeout_ms = 3000;
+    while (p->pflip_happening) {
+        struct pollfd fds[1] = {
+            { .events = POLLIN, .fd = p->kms->fd },
+        };
+        if (poll(fds, 1, timeout_ms) <= 0 || !(fds[0].revents & POLLIN)) {
+            MP_WARN(vo, "Timeout waiting for page flip.\n");
+            break;
+        }
+        int ret = drmHandleEvent(p->kms->fd, &p->ev);
+        if (ret) {
+            MP_ERR(vo, "drmHandleEvent failed: %i\n", ret);
+            break;
+        }
+    }
+    // Don't get stuck if the event never arrives.
+    if (p->pflip_happening) {
+        p->queued_buf = -1;
+        p->pflip_happening = false;
+    }
+}
+
+// Return a buffer which is neither scanned out nor queued for scanout.
+static int get_free_buf(struct priv *p)
+{
+    for (int n = 0; n < BUF_COUNT; n++) {
+        if (n != p->front_buf && n != p->queued_buf)
+            return n;
+    }
+    assert(0);
+    return 0;
+}
+
+// Wrap the video area of the buffer as image, so that it can be rendered into
+// directly (sws_dst parameters, centered on the screen).
+static void fb_get_video_image(struct vo *vo, struct framebuffer *buf,
+                               struct mp_image *img)
+{
+    struct priv *p = vo->priv;
+    int w = p->dst.x1 - p->dst.x0;
+    int h = p->dst.y1 - p->dst.y0;
+    int x = (p->screen_w - w) >> 1;
+    int y = (p->screen_h - h) >> 1;
+    *img = (struct mp_image){0};
+    mp_image_set_params(img, &p->sws->dst);
+    img->planes[0] = buf->map + y * buf->stride + x * BYTES_PER_PIXEL;
+    img->stride[0] = buf->stride;
 }
 
 static bool crtc_setup(struct vo *vo)
@@ -180,7 +271,7 @@ static bool crtc_setup(struct vo *vo)
         return true;
     p->old_crtc = drmModeGetCrtc(p->kms->fd, p->kms->crtc_id);
     int ret = drmModeSetCrtc(p->kms->fd, p->kms->crtc_id,
-                             p->bufs[p->front_buf + BUF_COUNT - 1].fb,
+                             p->bufs[p->front_buf].fb,
                              0, 0, &p->kms->connector->connector_id, 1,
                              &p->kms->mode);
     p->active = true;
@@ -195,14 +286,7 @@ static void crtc_release(struct vo *vo)
         return;
     p->active = false;
 
-    // wait for current page flip
-    while (p->pflip_happening) {
-        int ret = drmHandleEvent(p->kms->fd, &p->ev);
-        if (ret) {
-            MP_ERR(vo, "drmHandleEvent failed: %i\n", ret);
-            break;
-        }
-    }
+    wait_pending_flip(vo);
 
     if (p->old_crtc) {
         drmModeSetCrtc(p->kms->fd, p->old_crtc->crtc_id,
@@ -262,6 +346,164 @@ static void wakeup(struct vo *vo)
         vt_switcher_interrupt_poll(&p->vt_switcher);
 }
 
+#if HAVE_DRMPRIME
+static void prime_frame_release(struct vo *vo, struct prime_frame *frame)
+{
+    struct priv *p = vo->priv;
+    drm_prime_destroy_framebuffer(vo->log, p->kms->fd, &frame->fb);
+    mp_image_unrefp(&frame->image);
+}
+
+static void prime_release_all(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    prime_frame_release(vo, &p->prime_next);
+    prime_frame_release(vo, &p->prime_cur);
+    prime_frame_release(vo, &p->prime_old);
+}
+
+// Show the frame in p->prime_next on the overlay plane, and the OSD buffer
+// p->bufs[p->back_buf] on the primary plane above it, with a single atomic
+// commit (completion is signaled with a page flip event).
+static bool prime_commit(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    struct drm_atomic_context *ctx = p->kms->atomic_context;
+    struct drm_object *ov = ctx->overlay_plane;
+    struct drm_object *pr = ctx->primary_plane;
+    struct prime_frame *frame = p->prime_next.image ? &p->prime_next
+                                                    : &p->prime_cur;
+
+    drmModeAtomicReq *request = drmModeAtomicAlloc();
+    if (!request)
+        return false;
+
+    int srcw = p->src.x1 - p->src.x0;
+    int srch = p->src.y1 - p->src.y0;
+    uint32_t fb_id = frame->fb.fb_id;
+    drm_object_set_property(request, ov, "FB_ID",   fb_id);
+    drm_object_set_property(request, ov, "CRTC_ID", fb_id ? ctx->crtc->id : 0);
+    drm_object_set_property(request, ov, "SRC_X",   p->src.x0 << 16);
+    drm_object_set_property(request, ov, "SRC_Y",   p->src.y0 << 16);
+    drm_object_set_property(request, ov, "SRC_W",   srcw << 16);
+    drm_object_set_property(request, ov, "SRC_H",   srch << 16);
+    drm_object_set_property(request, ov, "CRTC_X",  MP_ALIGN_DOWN(p->dst.x0, 2));
+    drm_object_set_property(request, ov, "CRTC_Y",  MP_ALIGN_DOWN(p->dst.y0, 2));
+    drm_object_set_property(request, ov, "CRTC_W",
+                            MP_ALIGN_UP(p->dst.x1 - p->dst.x0, 2));
+    drm_object_set_property(request, ov, "CRTC_H",
+                            MP_ALIGN_UP(p->dst.y1 - p->dst.y0, 2));
+    drm_object_set_property(request, ov, "ZPOS",    0);
+    drm_object_set_property(request, pr, "FB_ID",   p->bufs[p->back_buf].fb);
+    drm_object_set_property(request, pr, "ZPOS",    1);
+
+    int ret = drmModeAtomicCommit(p->kms->fd, request,
+                                  DRM_MODE_ATOMIC_NONBLOCK |
+                                  DRM_MODE_PAGE_FLIP_EVENT, vo);
+    drmModeAtomicFree(request);
+    if (ret) {
+        MP_WARN(vo, "Atomic commit failed: %s\n", mp_strerror(errno));
+        return false;
+    }
+
+    // prime_old is not displayed anymore after the previous commit completed.
+    if (frame == &p->prime_next) {
+        prime_frame_release(vo, &p->prime_old);
+        p->prime_old = p->prime_cur;
+        p->prime_cur = p->prime_next;
+        p->prime_next = (struct prime_frame){0};
+    }
+    return true;
+}
+
+static void draw_prime(struct vo *vo, struct mp_image *mpi)
+{
+    struct priv *p = vo->priv;
+
+    if (mpi) {
+        AVDRMFrameDescriptor *desc = (AVDRMFrameDescriptor *)mpi->planes[0];
+        prime_frame_release(vo, &p->prime_next);
+        if (desc && drm_prime_create_framebuffer(vo->log, p->kms->fd, desc,
+                                                 mpi->w, mpi->h,
+                                                 &p->prime_next.fb) == 0)
+        {
+            p->prime_next.image = mp_image_new_ref(mpi);
+        } else {
+            MP_ERR(vo, "Could not create DRM PRIME framebuffer.\n");
+        }
+    }
+
+    // The OSD is drawn onto a transparent screen-sized image.
+    struct mp_image *osd = p->cur_frame;
+    memset_pic(osd->planes[0], 0, osd->w * BYTES_PER_PIXEL, osd->h,
+               osd->stride[0]);
+    osd_draw_on_image(vo->osd, p->osd, mpi ? mpi->pts : 0, 0, osd);
+
+    // Copy it in one go; the dumb buffers are slow to read back from.
+    p->back_buf = get_free_buf(p);
+    struct framebuffer *buf = &p->bufs[p->back_buf];
+    memcpy_pic(buf->map, osd->planes[0], osd->w * BYTES_PER_PIXEL,
+               osd->h, buf->stride, osd->stride[0]);
+}
+#endif
+
+// Queue a page flip to p->bufs[p->back_buf] on the primary plane. This doesn't
+// wait for it; completion is signaled with a page flip event.
+static bool queue_flip(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    struct drm_atomic_context *ctx = p->kms->atomic_context;
+    uint32_t fb_id = p->bufs[p->back_buf].fb;
+
+    int ret;
+    if (ctx) {
+        drmModeAtomicReq *request = drmModeAtomicAlloc();
+        if (!request)
+            return false;
+        drm_object_set_property(request, ctx->primary_plane, "FB_ID", fb_id);
+        drm_object_set_property(request, ctx->primary_plane, "CRTC_ID",
+                                ctx->crtc->id);
+        ret = drmModeAtomicCommit(p->kms->fd, request,
+                                  DRM_MODE_ATOMIC_NONBLOCK |
+                                  DRM_MODE_PAGE_FLIP_EVENT, vo);
+        drmModeAtomicFree(request);
+    } else {
+        ret = drmModePageFlip(p->kms->fd, p->kms->crtc_id, fb_id,
+                              DRM_MODE_PAGE_FLIP_EVENT, vo);
+    }
+    if (ret)
+        MP_WARN(vo, "Cannot flip page for connector: %s\n", mp_strerror(errno));
+    return ret == 0;
+}
+
+// Recreate the dumb buffers if the pixel depth needs to change. The CRTC is
+// switched to a new buffer before the old ones are destroyed, because
+// removing a framebuffer that is being scanned out disables the CRTC.
+static bool fb_set_depth(struct vo *vo, int depth)
+{
+    struct priv *p = vo->priv;
+    if (p->bufs[0].depth == depth)
+        return true;
+
+    wait_pending_flip(vo);
+
+    struct framebuffer old[BUF_COUNT];
+    memcpy(old, p->bufs, sizeof(old));
+    int old_front = p->front_buf;
+    if (!fb_setup_buffers(vo, depth)) {
+        memcpy(p->bufs, old, sizeof(old));
+        p->front_buf = p->back_buf = old_front;
+        return false;
+    }
+    if (p->active) {
+        drmModeSetCrtc(p->kms->fd, p->kms->crtc_id, p->bufs[0].fb, 0, 0,
+                       &p->kms->connector->connector_id, 1, &p->kms->mode);
+    }
+    for (unsigned int i = 0; i < BUF_COUNT; i++)
+        fb_destroy(p->kms->fd, &old[i]);
+    return true;
+}
+
 static int reconfig(struct vo *vo, struct mp_image_params *params)
 {
     struct priv *p = vo->priv;
@@ -270,6 +512,30 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     vo->dheight = p->screen_h;
     vo_get_src_dst_rects(vo, &p->src, &p->dst, &p->osd);
 
+    p->prime_mode = params->imgfmt == IMGFMT_DRMPRIME;
+#if HAVE_DRMPRIME
+    if (!p->prime_mode) {
+        // Setting the primary plane with the legacy API disables all other
+        // planes, so the overlay frames are not needed anymore.
+        prime_release_all(vo);
+    }
+#endif
+    if (!fb_set_depth(vo, p->prime_mode ? 32 : 24)) {
+        MP_ERR(vo, "Cannot create framebuffer\n");
+        return -1;
+    }
+
+    if (p->prime_mode) {
+        // The hardware scales the video on the overlay plane, and OSD is
+        // rendered in screen coordinates.
+        talloc_free(p->cur_frame);
+        p->cur_frame = mp_image_alloc(IMGFMT_BGRA, p->screen_w, p->screen_h);
+        if (!p->cur_frame)
+            return -1;
+        vo->want_redraw = true;
+        return 0;
+    }
+
     int w = p->dst.x1 - p->dst.x0;
     int h = p->dst.y1 - p->dst.y0;
 
@@ -293,11 +559,12 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
         .p_h = 1,
     };
 
-    talloc_free(p->cur_frame);
-    p->cur_frame = mp_image_alloc(IMGFMT, p->screen_w, p->screen_h);
     mp_image_params_guess_csp(&p->sws->dst);
-    mp_image_set_params(p->cur_frame, &p->sws->dst);
 
+    // Video is rendered directly into the buffers, so the black borders
+    // around it stay as they are.
+    talloc_free(p->cur_frame);
+    p->cur_frame = NULL;
     struct framebuffer *buf = p->bufs;
     for (unsigned int i = 0; i < BUF_COUNT; i++)
         memset(buf[i].map, 0, buf[i].size);
@@ -313,29 +580,27 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *p = vo->priv;
 
-    if (p->active) {
+    if (p->active && p->prime_mode) {
+#if HAVE_DRMPRIME
+        draw_prime(vo, mpi);
+#endif
+    } else if (p->active) {
+        // swscale writes straight into the buffer that is flipped next.
+        p->back_buf = get_free_buf(p);
+        struct mp_image dst;
+        fb_get_video_image(vo, &p->bufs[p->back_buf], &dst);
         if (mpi) {
             struct mp_image src = *mpi;
             struct mp_rect src_rc = p->src;
             src_rc.x0 = MP_ALIGN_DOWN(src_rc.x0, mpi->fmt.align_x);
             src_rc.y0 = MP_ALIGN_DOWN(src_rc.y0, mpi->fmt.align_y);
             mp_image_crop_rc(&src, src_rc);
-            mp_sws_scale(p->sws, p->cur_frame, &src);
-            osd_draw_on_image(vo->osd, p->osd, src.pts, 0, p->cur_frame);
+            mp_sws_scale(p->sws, &dst, &src);
+            osd_draw_on_image(vo->osd, p->osd, src.pts, 0, &dst);
         } else {
-            mp_image_clear(p->cur_frame, 0, 0, p->cur_frame->w, p->cur_frame->h);
-            osd_draw_on_image(vo->osd, p->osd, 0, 0, p->cur_frame);
+            mp_image_clear(&dst, 0, 0, dst.w, dst.h);
+            osd_draw_on_image(vo->osd, p->osd, 0, 0, &dst);
         }
-
-        struct framebuffer *front_buf = &p->bufs[p->front_buf];
-        int w = p->dst.x1 - p->dst.x0;
-        int h = p->dst.y1 - p->dst.y0;
-        int x = (p->screen_w - w) >> 1;
-        int y = (p->screen_h - h) >> 1;
-        int shift = y * front_buf->stride + x * BYTES_PER_PIXEL;
-        memcpy_pic(front_buf->map + shift, p->cur_frame->planes[0],
-                   w * BYTES_PER_PIXEL, h, front_buf->stride,
-                   p->cur_frame->stride[0]);
     }
 
     if (mpi != p->last_input) {
@@ -347,32 +612,26 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (!p->active || p->pflip_happening)
+    if (!p->active)
         return;
 
-    int ret = drmModePageFlip(p->kms->fd, p->kms->crtc_id,
-                              p->bufs[p->front_buf].fb,
-                              DRM_MODE_PAGE_FLIP_EVENT, p);
-    if (ret) {
-        MP_WARN(vo, "Cannot flip page for connector\n");
+    // This blocks only until the previous frame is on screen; the new one was
+    // rendered into a third buffer in the meantime.
+    wait_pending_flip(vo);
+    if (p->back_buf == p->front_buf)
+        return; // nothing new was drawn
+
+    bool ok = false;
+    if (p->prime_mode) {
+#if HAVE_DRMPRIME
+        ok = prime_commit(vo);
+#endif
     } else {
-        p->front_buf++;
-        p->front_buf %= BUF_COUNT;
-        p->pflip_happening = true;
+        ok = queue_flip(vo);
     }
-
-    // poll page flip finish event
-    const int timeout_ms = 3000;
-    struct pollfd fds[1] = {
-        { .events = POLLIN, .fd = p->kms->fd },
-    };
-    poll(fds, 1, timeout_ms);
-    if (fds[0].revents & POLLIN) {
-        ret = drmHandleEvent(p->kms->fd, &p->ev);
-        if (ret != 0) {
-            MP_ERR(vo, "drmHandleEvent failed: %i\n", ret);
-            return;
-        }
+    if (ok) {
+        p->queued_buf = p->back_buf;
+        p->pflip_happening = true;
     }
 }
 
@@ -383,6 +642,9 @@ static void uninit(struct vo *vo)
     crtc_release(vo);
 
     if (p->kms) {
+#if HAVE_DRMPRIME
+        prime_release_all(vo);
+#endif
         for (unsigned int i = 0; i < BUF_COUNT; i++)
             fb_destroy(p->kms->fd, &p->bufs[i]);
         kms_destroy(p->kms);
@@ -420,8 +682,8 @@ static int preinit(struct vo *vo)
         goto err;
     }
 
-    if (!fb_setup_double_buffering(vo)) {
-        MP_ERR(vo, "Failed to set up double buffering.\n");
+    if (!fb_setup_buffers(vo, 24)) {
+        MP_ERR(vo, "Failed to set up framebuffers.\n");
         goto err;
     }
 
@@ -449,6 +711,9 @@ err:
 
 static int query_format(struct vo *vo, int format)
 {
+    struct priv *p = vo->priv;
+    if (format == IMGFMT_DRMPRIME)
+        return HAVE_DRMPRIME && p->kms->atomic_context;
     return sws_isSupportedInput(imgfmt2pixfmt(format));
 }
 
@@ -457,8 +722,14 @@ static int control(struct vo *vo, uint32_t request, void *arg)
     struct priv *p = vo->priv;
     switch (request) {
     case VOCTRL_SCREENSHOT_WIN:
-        *(struct mp_image**)arg = mp_image_new_copy(p->cur_frame);
+    {
+        if (p->prime_mode || !vo->config_ok)
+            break; // the buffer contains the OSD only
+        struct mp_image img;
+        fb_get_video_image(vo, &p->bufs[p->back_buf], &img);
+        *(struct mp_image**)arg = mp_image_new_copy(&img);
         return VO_TRUE;
+    }
     case VOCTRL_REDRAW_FRAME:
         draw_image(vo, p->last_input);
         return VO_TRUE;
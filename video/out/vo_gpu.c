@@ -92,6 +92,12 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
     }
 }
 
+static void prerender_frame(struct vo *vo, struct vo_frame *frame)
+{
+    struct gpu_priv *p = vo->priv;
+    gl_video_prerender_frame(p->renderer, frame, vo->dwidth, vo->dheight);
+}
+
 static void flip_page(struct vo *vo)
 {
     struct gpu_priv *p = vo->priv;
@@ -261,6 +267,12 @@ static struct mp_image *get_image(struct vo *vo, int imgfmt, int w, int h,
     return gl_video_get_image(p->renderer, imgfmt, w, h, stride_align);
 }
 
+static void compile_done_cb(void *ctx)
+{
+    struct vo *vo = ctx;
+    vo_redraw(vo);
+}
+
 static void uninit(struct vo *vo)
 {
     struct gpu_priv *p = vo->priv;
@@ -293,6 +305,7 @@ static int preinit(struct vo *vo)
 
     p->renderer = gl_video_init(p->ctx->ra, vo->log, vo->global);
     gl_video_set_osd_source(p->renderer, vo->osd);
+    gl_video_set_compile_cb(p->renderer, compile_done_cb, vo);
     gl_video_configure_queue(p->renderer, vo);
 
     get_and_update_icc_profile(p);
@@ -336,6 +349,7 @@ const struct vo_driver video_out_gpu = {
     .control = control,
     .get_image = get_image,
     .draw_frame = draw_frame,
+    .prerender_frame = prerender_frame,
     .flip_page = flip_page,
     .wait_events = wait_events,
     .wakeup = wakeup,
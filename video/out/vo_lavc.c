@@ -157,6 +157,11 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     encode_lavc_set_csp(vo->encode_lavc_ctx, vc->codec, params->color.space);
     encode_lavc_set_csp_levels(vo->encode_lavc_ctx, vc->codec, params->color.levels);
 
+    // Hardware encoders need the frames context of the input surfaces, which
+    // is known only with the first frame. The encoder is opened there.
+    if (IMGFMT_IS_HWACCEL(params->imgfmt))
+        goto done;
+
     if (encode_lavc_open_codec(vo->encode_lavc_ctx, vc->codec) < 0)
         goto error;
 
@@ -286,7 +291,7 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
 
     double pts = mpi ? mpi->pts : MP_NOPTS_VALUE;
 
-    if (mpi) {
+    if (mpi && !IMGFMT_IS_HWACCEL(mpi->imgfmt)) {
         assert(vo->params);
 
         struct mp_osd_res dim = osd_res_from_image_params(vo->params);
@@ -296,6 +301,21 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
 
     if (!vc || vc->shutdown)
         goto done;
+    if (mpi && !avcodec_is_open(vc->codec)) {
+        // Hardware surfaces are passed to the encoder as they are.
+        if (!mpi->hwctx) {
+            MP_ERR(vo, "hardware frame without frames context\n");
+            vc->shutdown = true;
+            goto done;
+        }
+        vc->codec->hw_frames_ctx = av_buffer_ref(mpi->hwctx);
+        if (!vc->codec->hw_frames_ctx ||
+            encode_lavc_open_codec(ectx, vc->codec) < 0)
+        {
+            vc->shutdown = true;
+            goto done;
+        }
+    }
     if (!encode_lavc_start(ectx)) {
         MP_WARN(vo, "NOTE: skipped initial video frame (probably because audio is not there yet)\n");
         goto done;
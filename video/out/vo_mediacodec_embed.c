@@ -15,29 +15,200 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <time.h>
+#include <pthread.h>
+
 #include <libavcodec/mediacodec.h>
 
+#include "config.h"
+
+#if HAVE_ANDROID_CHOREOGRAPHER
+#include <android/choreographer.h>
+#include <android/looper.h>
+#endif
+
 #include "common/common.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 #include "vo.h"
 #include "video/mp_image.h"
 
 struct priv {
     struct mp_image *next_image;
+    bool display_synced;
+
+#if HAVE_ANDROID_CHOREOGRAPHER
+    // Choreographer thread, which reports vsyncs to vo.c
+    pthread_t vsync_thread;
+    bool vsync_thread_running;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    ALooper *looper;            // set once the thread is initialized
+    bool looper_init_done;
+    bool terminate;
+    int64_t last_frame_ns;
+    double vsync_interval_ns;   // averaged distance between callbacks
+#endif
 };
 
+#if HAVE_ANDROID_CHOREOGRAPHER
+static int64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void frame_cb(long frame_time_ns, void *data)
+{
+    struct vo *vo = data;
+    struct priv *p = vo->priv;
+    int64_t frame_ns = (int64_t)frame_time_ns;
+
+    pthread_mutex_lock(&p->lock);
+    bool terminate = p->terminate;
+    if (p->last_frame_ns) {
+        double interval = frame_ns - p->last_frame_ns;
+        // Ignore missed callbacks (the thread could have been descheduled).
+        if (!p->vsync_interval_ns) {
+            p->vsync_interval_ns = interval;
+        } else if (interval < p->vsync_interval_ns * 1.5) {
+            p->vsync_interval_ns += (interval - p->vsync_interval_ns) * 0.05;
+        }
+    }
+    p->last_frame_ns = frame_ns;
+    pthread_mutex_unlock(&p->lock);
+
+    // The frame time uses System.nanoTime(), i.e. CLOCK_MONOTONIC.
+    vo_report_vsync(vo, mp_time_us() - (monotonic_ns() - frame_ns) / 1000);
+
+    if (!terminate)
+        AChoreographer_postFrameCallback(AChoreographer_getInstance(),
+                                         frame_cb, vo);
+}
+
+// AChoreographer only works on a thread with a looper, so run our own.
+static void *vsync_thread(void *arg)
+{
+    struct vo *vo = arg;
+    struct priv *p = vo->priv;
+    mpthread_set_name("vo-vsync");
+
+    ALooper *looper = ALooper_prepare(0);
+    ALooper_acquire(looper);
+    AChoreographer *ch = AChoreographer_getInstance();
+    if (ch)
+        AChoreographer_postFrameCallback(ch, frame_cb, vo);
+
+    pthread_mutex_lock(&p->lock);
+    p->looper = ch ? looper : NULL;
+    p->looper_init_done = true;
+    pthread_cond_broadcast(&p->wakeup);
+    while (ch && !p->terminate) {
+        pthread_mutex_unlock(&p->lock);
+        ALooper_pollOnce(-1, NULL, NULL, NULL);
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    ALooper_release(looper);
+    return NULL;
+}
+
+static void start_vsync_thread(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    if (pthread_create(&p->vsync_thread, NULL, vsync_thread, vo)) {
+        pthread_cond_destroy(&p->wakeup);
+        pthread_mutex_destroy(&p->lock);
+        return;
+    }
+    p->vsync_thread_running = true;
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->looper_init_done)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    bool ok = !!p->looper;
+    pthread_mutex_unlock(&p->lock);
+    if (!ok)
+        MP_WARN(vo, "Choreographer not available, no vsync timing.\n");
+}
+
+static void stop_vsync_thread(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    if (!p->vsync_thread_running)
+        return;
+    pthread_mutex_lock(&p->lock);
+    p->terminate = true;
+    if (p->looper)
+        ALooper_wake(p->looper);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->vsync_thread, NULL);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+    p->vsync_thread_running = false;
+}
+
+static bool have_vsync(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    if (!p->vsync_thread_running)
+        return false;
+    pthread_mutex_lock(&p->lock);
+    bool r = !!p->looper;
+    pthread_mutex_unlock(&p->lock);
+    return r;
+}
+#endif
+
 static int preinit(struct vo *vo)
 {
+#if HAVE_ANDROID_CHOREOGRAPHER
+    start_vsync_thread(vo);
+#endif
     return 0;
 }
 
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (!p->next_image)
-        return;
+    AVMediaCodecBuffer *buffer = NULL;
+    if (p->next_image)
+        buffer = (AVMediaCodecBuffer *)p->next_image->planes[3];
 
-    AVMediaCodecBuffer *buffer = (AVMediaCodecBuffer *)p->next_image->planes[3];
-    av_mediacodec_release_buffer(buffer, 1);
+#if HAVE_ANDROID_CHOREOGRAPHER
+    // Releasing a buffer doesn't block, so pace the swaps on the vsyncs
+    // reported by Choreographer, which is what display-sync needs. Otherwise,
+    // vo.c already waited until the frame's display time.
+    if (have_vsync(vo) && !p->display_synced) {
+        vo_report_presentation(vo, mp_time_us(), 0);
+    } else if (have_vsync(vo)) {
+        int64_t vsync = vo_wait_vsync(vo, 100 * 1000);
+        if (!vsync)
+            vsync = mp_time_us();
+        int64_t interval = vo_get_vsync_interval(vo);
+        if (interval <= 1)
+            interval = 16667;
+        // Queue the frame 2 vsyncs ahead, as recommended for
+        // releaseOutputBuffer() with a timestamp, so the compositor has
+        // enough time to latch it for exactly that vsync.
+        int64_t target = vsync + 2 * interval;
+#if HAVE_MEDIACODEC_RENDER_AT_TIME
+        if (buffer) {
+            int64_t target_ns = monotonic_ns() + (target - mp_time_us()) * 1000;
+            av_mediacodec_render_buffer_at_time(buffer, target_ns);
+            buffer = NULL;
+        }
+#endif
+        vo_report_presentation(vo, target, 0);
+    }
+#endif
+
+    if (buffer)
+        av_mediacodec_release_buffer(buffer, 1);
     mp_image_unrefp(&p->next_image);
 }
 
@@ -51,6 +222,7 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
 
     talloc_free(p->next_image);
     p->next_image = mpi;
+    p->display_synced = frame->display_synced;
 }
 
 static int query_format(struct vo *vo, int format)
@@ -60,6 +232,22 @@ static int query_format(struct vo *vo, int format)
 
 static int control(struct vo *vo, uint32_t request, void *data)
 {
+#if HAVE_ANDROID_CHOREOGRAPHER
+    struct priv *p = vo->priv;
+    switch (request) {
+    case VOCTRL_GET_DISPLAY_FPS: {
+        if (!have_vsync(vo))
+            break;
+        pthread_mutex_lock(&p->lock);
+        double interval = p->vsync_interval_ns;
+        pthread_mutex_unlock(&p->lock);
+        if (interval <= 0)
+            break;
+        *(double *)data = 1e9 / interval;
+        return VO_TRUE;
+    }
+    }
+#endif
     return VO_NOTIMPL;
 }
 
@@ -71,6 +259,9 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
 static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
+#if HAVE_ANDROID_CHOREOGRAPHER
+    stop_vsync_thread(vo);
+#endif
     mp_image_unrefp(&p->next_image);
 }
 
@@ -32,6 +32,9 @@
 
 #include "libmpv/opengl_cb.h"
 
+// Maximum for mpv_opengl_cb_set_render_ahead().
+#define MAX_RENDER_AHEAD 8
+
 /*
  * mpv_opengl_cb_context is created by the host application - the host application
  * can access it any time, even if the VO is destroyed (or not created yet).
@@ -46,6 +49,12 @@
  * - to make video timing work like it should, the VO thread waits on the
  *   openglcb API user anyway, and the (unlikely) deadlock is avoided with
  *   a timeout
+ *
+ * Additional contexts for the same player can be created with
+ * mpv_opengl_cb_create_view(). Such a view has its own renderer (and OpenGL
+ * context), but gets the frames from the primary context, which is the only
+ * one the VO talks to. The VO never waits on views. All mutable state of a
+ * view is protected by the lock of the primary context.
  */
 
 struct vo_priv {
@@ -78,6 +87,16 @@ struct mpv_opengl_cb_context {
     bool imgfmt_supported[IMGFMT_END - IMGFMT_START];
     bool update_new_opts;
     struct vo *active;
+    int render_ahead;               // see mpv_opengl_cb_set_render_ahead()
+    int64_t *targets;               // target times of frames not flipped yet
+    int num_targets;
+    bool fast_rendering;            // see mpv_opengl_cb_set_fast_rendering()
+    struct mpv_opengl_cb_context **views; // (primary context only)
+    int num_views;
+    bool new_frame;                 // (views only) cur_frame not rendered yet
+
+    // --- Immutable
+    struct mpv_opengl_cb_context *primary; // set for views, NULL otherwise
 
     // --- This is only mutable while initialized=false, during which nothing
     //     except the OpenGL context manager is allowed to access it.
@@ -96,6 +115,12 @@ struct mpv_opengl_cb_context {
 
 static void update(struct vo_priv *p);
 
+// Return the context whose lock protects ctx.
+static struct mpv_opengl_cb_context *lock_owner(struct mpv_opengl_cb_context *ctx)
+{
+    return ctx->primary ? ctx->primary : ctx;
+}
+
 static void forget_frames(struct mpv_opengl_cb_context *ctx, bool all)
 {
     pthread_cond_broadcast(&ctx->wakeup);
@@ -139,10 +164,63 @@ void mpv_opengl_cb_set_update_callback(struct mpv_opengl_cb_context *ctx,
                                       mpv_opengl_cb_update_fn callback,
                                       void *callback_ctx)
 {
-    pthread_mutex_lock(&ctx->lock);
+    struct mpv_opengl_cb_context *owner = lock_owner(ctx);
+    pthread_mutex_lock(&owner->lock);
     ctx->update_cb = callback;
     ctx->update_cb_ctx = callback_ctx;
+    pthread_mutex_unlock(&owner->lock);
+}
+
+mpv_opengl_cb_context *mpv_opengl_cb_create_view(mpv_opengl_cb_context *ctx)
+{
+    if (!ctx || ctx->primary)
+        return NULL;
+
+    mpv_opengl_cb_context *view = mp_opengl_create(ctx->global, ctx->client_api);
+    view->primary = ctx;
+
+    pthread_mutex_lock(&ctx->lock);
+    // Freed with the primary context at the latest.
+    talloc_steal(ctx, view);
+    MP_TARRAY_APPEND(ctx, ctx->views, ctx->num_views, view);
+    view->img_params = ctx->img_params;
+    view->reconfigured = true;
+    view->update_new_opts = true;
+    view->cur_frame = vo_frame_ref(ctx->cur_frame);
+    view->new_frame = !!view->cur_frame;
     pthread_mutex_unlock(&ctx->lock);
+
+    return view;
+}
+
+void mpv_opengl_cb_destroy_view(mpv_opengl_cb_context *view)
+{
+    if (!view || !view->primary)
+        return;
+
+    mpv_opengl_cb_uninit_gl(view);
+
+    struct mpv_opengl_cb_context *ctx = view->primary;
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_views; n++) {
+        if (ctx->views[n] == view) {
+            MP_TARRAY_REMOVE_AT(ctx->views, ctx->num_views, n);
+            break;
+        }
+    }
+    talloc_free(view);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+int mpv_opengl_cb_set_fast_rendering(mpv_opengl_cb_context *ctx, int fast)
+{
+    struct mpv_opengl_cb_context *owner = lock_owner(ctx);
+    pthread_mutex_lock(&owner->lock);
+    ctx->fast_rendering = fast;
+    if (ctx->update_cb)
+        ctx->update_cb(ctx->update_cb_ctx);
+    pthread_mutex_unlock(&owner->lock);
+    return 0;
 }
 
 // Reset some GL attributes the user might clobber. For mid-term compatibility
@@ -200,18 +278,25 @@ int mpv_opengl_cb_init_gl(struct mpv_opengl_cb_context *ctx, const char *exts,
 
     m_config_cache_update(ctx->vo_opts_cache);
 
-    ctx->hwdec_devs = hwdec_devices_create();
-    ctx->hwdec = ra_hwdec_load(ctx->log, ctx->ra_ctx->ra, ctx->global,
-                               ctx->hwdec_devs, ctx->vo_opts->gl_hwdec_interop);
-    gl_video_set_hwdec(ctx->renderer, ctx->hwdec);
+    // The decoder uses the hwdec device of the primary context, whose
+    // surfaces can't be mapped into an unrelated OpenGL context. So views
+    // render software (or copied back) frames only.
+    if (!ctx->primary) {
+        ctx->hwdec_devs = hwdec_devices_create();
+        ctx->hwdec = ra_hwdec_load(ctx->log, ctx->ra_ctx->ra, ctx->global,
+                                   ctx->hwdec_devs,
+                                   ctx->vo_opts->gl_hwdec_interop);
+        gl_video_set_hwdec(ctx->renderer, ctx->hwdec);
+    }
 
-    pthread_mutex_lock(&ctx->lock);
+    struct mpv_opengl_cb_context *owner = lock_owner(ctx);
+    pthread_mutex_lock(&owner->lock);
     for (int n = IMGFMT_START; n < IMGFMT_END; n++) {
         ctx->imgfmt_supported[n - IMGFMT_START] =
             gl_video_check_format(ctx->renderer, n);
     }
     ctx->initialized = true;
-    pthread_mutex_unlock(&ctx->lock);
+    pthread_mutex_unlock(&owner->lock);
 
     reset_gl_state(ctx->gl);
     return 0;
@@ -225,16 +310,20 @@ int mpv_opengl_cb_uninit_gl(struct mpv_opengl_cb_context *ctx)
     // Bring down the decoder etc., which still might be using the hwdec
     // context. Setting initialized=false guarantees it can't come back.
 
-    pthread_mutex_lock(&ctx->lock);
+    struct mpv_opengl_cb_context *owner = lock_owner(ctx);
+    pthread_mutex_lock(&owner->lock);
     forget_frames(ctx, true);
     ctx->initialized = false;
-    pthread_mutex_unlock(&ctx->lock);
+    pthread_mutex_unlock(&owner->lock);
 
-    kill_video(ctx->client_api);
+    // Views don't own any state of the player.
+    if (!ctx->primary) {
+        kill_video(ctx->client_api);
 
-    pthread_mutex_lock(&ctx->lock);
-    assert(!ctx->active);
-    pthread_mutex_unlock(&ctx->lock);
+        pthread_mutex_lock(&ctx->lock);
+        assert(!ctx->active);
+        pthread_mutex_unlock(&ctx->lock);
+    }
 
     gl_video_uninit(ctx->renderer);
     ctx->renderer = NULL;
@@ -250,21 +339,42 @@ int mpv_opengl_cb_uninit_gl(struct mpv_opengl_cb_context *ctx)
     return 0;
 }
 
-int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
+int mpv_opengl_cb_set_render_ahead(mpv_opengl_cb_context *ctx, int frames)
 {
-    assert(ctx->renderer);
-
-    if (fbo && !(ctx->gl->mpgl_caps & MPGL_CAP_FB)) {
-        MP_FATAL(ctx, "Rendering to FBO requested, but no FBO extension found!\n");
-        return MPV_ERROR_UNSUPPORTED;
-    }
+    if (frames < 0 || frames > MAX_RENDER_AHEAD)
+        return MPV_ERROR_INVALID_PARAMETER;
 
-    reset_gl_state(ctx->gl);
+    // The video timing is determined by the primary context only.
+    if (ctx->primary)
+        return 0;
 
     pthread_mutex_lock(&ctx->lock);
+    ctx->render_ahead = frames;
+    pthread_cond_signal(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+    return 0;
+}
 
-    struct vo *vo = ctx->active;
+static void render_frame(mpv_opengl_cb_context *ctx, struct vo_frame *frame,
+                         int fbo, int vp_w, int vp_h)
+{
+    struct ra_swapchain *sw = ctx->ra_ctx->swapchain;
+    struct ra_fbo target;
+    ra_gl_ctx_resize(sw, vp_w, abs(vp_h), fbo);
+    ra_gl_ctx_start_frame(sw, &target);
+    target.flip = vp_h < 0;
+    gl_video_render_frame(ctx->renderer, frame, target);
+    ra_gl_ctx_submit_frame(sw, frame);
 
+    reset_gl_state(ctx->gl);
+}
+
+// The following functions are called locked (by the lock of the owner), and
+// are common to the primary context and views.
+
+static void resize_renderer(mpv_opengl_cb_context *ctx, struct vo *vo,
+                            int vp_w, int vp_h)
+{
     ctx->force_update |= ctx->reconfigured;
 
     if (ctx->vp_w != vp_w || ctx->vp_h != vp_h)
@@ -285,14 +395,11 @@ int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
 
         gl_video_resize(ctx->renderer, &src, &dst, &osd);
     }
+}
 
-    if (ctx->reconfigured) {
-        gl_video_set_osd_source(ctx->renderer, vo ? vo->osd : NULL);
-        gl_video_config(ctx->renderer, &ctx->img_params);
-    }
+static void update_renderer(mpv_opengl_cb_context *ctx)
+{
     if (ctx->update_new_opts) {
-        if (vo)
-            gl_video_configure_queue(ctx->renderer, vo);
         int debug;
         mp_read_option_raw(ctx->global, "gpu-debug", &m_option_type_flag,
                            &debug);
@@ -301,8 +408,8 @@ int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
         if (gl_video_icc_auto_enabled(ctx->renderer))
             MP_ERR(ctx, "icc-profile-auto is not available with opengl-cb\n");
     }
-    ctx->reconfigured = false;
-    ctx->update_new_opts = false;
+
+    gl_video_set_fast_rendering(ctx->renderer, ctx->fast_rendering);
 
     if (ctx->reset) {
         gl_video_reset(ctx->renderer);
@@ -310,12 +417,87 @@ int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
         if (ctx->cur_frame)
             ctx->cur_frame->still = true;
     }
+}
+
+// Views render the most recent frame handed to the primary context, without
+// any waiting. They don't render the OSD, which can't be shared between
+// renderers.
+static int draw_view(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
+{
+    struct mpv_opengl_cb_context *primary = ctx->primary;
+
+    pthread_mutex_lock(&primary->lock);
+
+    resize_renderer(ctx, primary->active, vp_w, vp_h);
+
+    int imgfmt = ctx->img_params.imgfmt;
+    bool supported = imgfmt >= IMGFMT_START && imgfmt < IMGFMT_END &&
+                     ctx->imgfmt_supported[imgfmt - IMGFMT_START];
+    if (ctx->reconfigured) {
+        struct mp_image_params params = {0};
+        if (supported) {
+            params = ctx->img_params;
+        } else if (imgfmt) {
+            MP_WARN(ctx, "Video format not supported by view; a hwdec copy "
+                    "mode is required.\n");
+        }
+        gl_video_config(ctx->renderer, &params);
+    }
+    update_renderer(ctx);
+    ctx->reconfigured = false;
+    ctx->update_new_opts = false;
+
+    struct vo_frame *frame = supported ? vo_frame_ref(ctx->cur_frame) : NULL;
+    if (frame && !ctx->new_frame)
+        frame->redraw = true;
+    ctx->new_frame = false;
+
+    pthread_mutex_unlock(&primary->lock);
+
+    struct vo_frame dummy = {0};
+    MP_STATS(ctx, "glcb-render");
+    render_frame(ctx, frame ? frame : &dummy, fbo, vp_w, vp_h);
+
+    talloc_free(frame);
+    return 0;
+}
+
+static int draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h,
+                int64_t target_time, bool ahead)
+{
+    assert(ctx->renderer);
+
+    if (fbo && !(ctx->gl->mpgl_caps & MPGL_CAP_FB)) {
+        MP_FATAL(ctx, "Rendering to FBO requested, but no FBO extension found!\n");
+        return MPV_ERROR_UNSUPPORTED;
+    }
+
+    reset_gl_state(ctx->gl);
+
+    if (ctx->primary)
+        return draw_view(ctx, fbo, vp_w, vp_h);
+
+    pthread_mutex_lock(&ctx->lock);
+
+    struct vo *vo = ctx->active;
+
+    resize_renderer(ctx, vo, vp_w, vp_h);
+
+    if (ctx->reconfigured) {
+        gl_video_set_osd_source(ctx->renderer, vo ? vo->osd : NULL);
+        gl_video_config(ctx->renderer, &ctx->img_params);
+    }
+    if (ctx->update_new_opts && vo)
+        gl_video_configure_queue(ctx->renderer, vo);
+    update_renderer(ctx);
+    ctx->reconfigured = false;
+    ctx->update_new_opts = false;
 
     struct vo_frame *frame = ctx->next_frame;
     int64_t wait_present_count = ctx->present_count;
     if (frame) {
         ctx->next_frame = NULL;
-        if (!(frame->redraw || !frame->current))
+        if (!(frame->redraw || !frame->current) && !ahead)
             wait_present_count += 1;
         pthread_cond_signal(&ctx->wakeup);
         talloc_free(ctx->cur_frame);
@@ -330,18 +512,17 @@ int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
     if (!frame)
         frame = &dummy;
 
+    // Remember when the host wants to show this, for the matching report_flip.
+    if (target_time) {
+        if (ctx->num_targets >= MAX_RENDER_AHEAD + 1)
+            MP_TARRAY_REMOVE_AT(ctx->targets, ctx->num_targets, 0);
+        MP_TARRAY_APPEND(ctx, ctx->targets, ctx->num_targets, target_time);
+    }
+
     pthread_mutex_unlock(&ctx->lock);
 
     MP_STATS(ctx, "glcb-render");
-    struct ra_swapchain *sw = ctx->ra_ctx->swapchain;
-    struct ra_fbo target;
-    ra_gl_ctx_resize(sw, vp_w, abs(vp_h), fbo);
-    ra_gl_ctx_start_frame(sw, &target);
-    target.flip = vp_h < 0;
-    gl_video_render_frame(ctx->renderer, frame, target);
-    ra_gl_ctx_submit_frame(sw, frame);
-
-    reset_gl_state(ctx->gl);
+    render_frame(ctx, frame, fbo, vp_w, vp_h);
 
     if (frame != &dummy)
         talloc_free(frame);
@@ -354,12 +535,35 @@ int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
     return 0;
 }
 
+int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
+{
+    return draw(ctx, fbo, vp_w, vp_h, 0, false);
+}
+
+int mpv_opengl_cb_draw_ahead(mpv_opengl_cb_context *ctx, int fbo, int w, int h,
+                             int64_t target_time)
+{
+    return draw(ctx, fbo, w, h, target_time, true);
+}
+
 int mpv_opengl_cb_report_flip(mpv_opengl_cb_context *ctx, int64_t time)
 {
+    if (ctx->primary)
+        return 0;
+
     MP_STATS(ctx, "glcb-reportflip");
 
     pthread_mutex_lock(&ctx->lock);
     ctx->flip_count += 1;
+    int64_t target = 0;
+    if (ctx->num_targets) {
+        target = ctx->targets[0];
+        MP_TARRAY_REMOVE_AT(ctx->targets, ctx->num_targets, 0);
+    }
+    // Without an actual time, the host's target time is the best guess.
+    int64_t t = time ? time : target;
+    if (t && ctx->active)
+        vo_report_presentation(ctx->active, t, 0);
     pthread_cond_signal(&ctx->wakeup);
     pthread_mutex_unlock(&ctx->lock);
 
@@ -371,6 +575,26 @@ static void update(struct vo_priv *p)
 {
     if (p->ctx->update_cb)
         p->ctx->update_cb(p->ctx->update_cb_ctx);
+    for (int n = 0; n < p->ctx->num_views; n++) {
+        struct mpv_opengl_cb_context *view = p->ctx->views[n];
+        if (view->update_cb)
+            view->update_cb(view->update_cb_ctx);
+    }
+}
+
+// Called locked. Give all views a reference to the new frame. The image data
+// is shared, so this doesn't copy anything. Redraw requests keep the previous
+// frame.
+static void update_views_frame(struct vo_priv *p, struct vo_frame *frame)
+{
+    if (frame->redraw || !frame->current)
+        return;
+    for (int n = 0; n < p->ctx->num_views; n++) {
+        struct mpv_opengl_cb_context *view = p->ctx->views[n];
+        talloc_free(view->cur_frame);
+        view->cur_frame = vo_frame_ref(frame);
+        view->new_frame = true;
+    }
 }
 
 static void draw_frame(struct vo *vo, struct vo_frame *frame)
@@ -380,8 +604,13 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
     pthread_mutex_lock(&p->ctx->lock);
     assert(!p->ctx->next_frame);
     p->ctx->next_frame = vo_frame_ref(frame);
-    p->ctx->expected_flip_count = p->ctx->flip_count + 1;
+    // With render-ahead, up to render_ahead earlier frames are still waiting
+    // to be flipped.
+    int64_t in_flight = MPCLAMP(p->ctx->expected_flip_count - p->ctx->flip_count,
+                                0, p->ctx->render_ahead);
+    p->ctx->expected_flip_count = p->ctx->flip_count + in_flight + 1;
     p->ctx->redrawing = frame->redraw || !frame->current;
+    update_views_frame(p, frame);
     update(p);
     pthread_mutex_unlock(&p->ctx->lock);
 }
@@ -391,6 +620,15 @@ static void flip_page(struct vo *vo)
     struct vo_priv *p = vo->priv;
     struct timespec ts = mp_rel_time_to_timespec(0.2);
 
+    // Hand out frames early enough so that the host can render ahead.
+    // (Not needed with display-sync, where the flip wait below paces us.)
+    pthread_mutex_lock(&p->ctx->lock);
+    int render_ahead = p->ctx->render_ahead;
+    pthread_mutex_unlock(&p->ctx->lock);
+    int64_t vsync = vo_get_vsync_interval(vo);
+    int64_t offset = render_ahead * (vsync > 0 ? vsync : 1000000 / 60);
+    vo_set_queue_params(vo, offset, vo_get_num_req_frames(vo));
+
     pthread_mutex_lock(&p->ctx->lock);
 
     // Wait until frame was rendered
@@ -410,8 +648,11 @@ static void flip_page(struct vo *vo)
     if (p->ctx->redrawing)
         goto done; // do not block for redrawing
 
-    // Wait until frame was presented
-    while (p->ctx->expected_flip_count > p->ctx->flip_count) {
+    // Wait until frame was presented (or, with render-ahead, until no more
+    // than render_ahead frames are waiting for presentation)
+    while (p->ctx->expected_flip_count - p->ctx->render_ahead >
+           p->ctx->flip_count)
+    {
         // mpv_opengl_cb_report_flip() is declared as optional API.
         // Assume the user calls it consistently _if_ it's called at all.
         if (!p->ctx->flip_count)
@@ -457,6 +698,12 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     forget_frames(p->ctx, true);
     p->ctx->img_params = *params;
     p->ctx->reconfigured = true;
+    for (int n = 0; n < p->ctx->num_views; n++) {
+        struct mpv_opengl_cb_context *view = p->ctx->views[n];
+        forget_frames(view, true);
+        view->img_params = *params;
+        view->reconfigured = true;
+    }
     pthread_mutex_unlock(&p->ctx->lock);
 
     return 0;
@@ -471,6 +718,8 @@ static int control(struct vo *vo, uint32_t request, void *data)
         pthread_mutex_lock(&p->ctx->lock);
         forget_frames(p->ctx, false);
         p->ctx->reset = true;
+        for (int n = 0; n < p->ctx->num_views; n++)
+            p->ctx->views[n]->reset = true;
         pthread_mutex_unlock(&p->ctx->lock);
         return VO_TRUE;
     case VOCTRL_PAUSE:
@@ -482,12 +731,16 @@ static int control(struct vo *vo, uint32_t request, void *data)
     case VOCTRL_SET_PANSCAN:
         pthread_mutex_lock(&p->ctx->lock);
         p->ctx->force_update = true;
+        for (int n = 0; n < p->ctx->num_views; n++)
+            p->ctx->views[n]->force_update = true;
         update(p);
         pthread_mutex_unlock(&p->ctx->lock);
         return VO_TRUE;
     case VOCTRL_UPDATE_RENDER_OPTS:
         pthread_mutex_lock(&p->ctx->lock);
         p->ctx->update_new_opts = true;
+        for (int n = 0; n < p->ctx->num_views; n++)
+            p->ctx->views[n]->update_new_opts = true;
         update(p);
         pthread_mutex_unlock(&p->ctx->lock);
         return VO_TRUE;
@@ -504,6 +757,12 @@ static void uninit(struct vo *vo)
     forget_frames(p->ctx, true);
     p->ctx->img_params = (struct mp_image_params){0};
     p->ctx->reconfigured = true;
+    for (int n = 0; n < p->ctx->num_views; n++) {
+        struct mpv_opengl_cb_context *view = p->ctx->views[n];
+        forget_frames(view, true);
+        view->img_params = (struct mp_image_params){0};
+        view->reconfigured = true;
+    }
     p->ctx->active = NULL;
     update(p);
     pthread_mutex_unlock(&p->ctx->lock);
@@ -527,6 +786,10 @@ static int preinit(struct vo *vo)
     p->ctx->active = vo;
     p->ctx->reconfigured = true;
     p->ctx->update_new_opts = true;
+    for (int n = 0; n < p->ctx->num_views; n++) {
+        p->ctx->views[n]->reconfigured = true;
+        p->ctx->views[n]->update_new_opts = true;
+    }
     pthread_mutex_unlock(&p->ctx->lock);
 
     vo->hwdec_devs = p->ctx->hwdec_devs;
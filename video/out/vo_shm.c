@@ -0,0 +1,255 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <libavutil/pixfmt.h>
+
+#include "config.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "libmpv/frame_shm.h"
+#include "options/m_option.h"
+#include "osdep/atomic.h"
+#include "osdep/io.h"
+#include "video/fmt-conversion.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "vo.h"
+
+#define SHM_ALIGN 64
+
+// The mapping is shared with other processes, so the lock-based emulation of
+// stdatomic.h can't be used for this.
+#if HAVE_STDATOMIC
+#define shm_barrier() atomic_thread_fence(memory_order_seq_cst)
+#else
+#define shm_barrier() __sync_synchronize()
+#endif
+
+struct priv {
+    char *name;
+    int num_slots;
+
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    struct mpv_frame_shm_header *hdr;
+    struct mpv_frame_shm_slot *slots;
+    uint64_t frame_count;
+};
+
+static void destroy_shm(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    if (p->hdr) {
+        p->hdr->generation = UINT32_MAX;
+        shm_barrier();
+        munmap(p->map, p->map_size);
+        shm_unlink(p->name);
+    }
+    if (p->fd >= 0)
+        close(p->fd);
+
+    p->fd = -1;
+    p->map = NULL;
+    p->hdr = NULL;
+    p->slots = NULL;
+}
+
+static int reconfig(struct vo *vo, struct mp_image_params *params)
+{
+    struct priv *p = vo->priv;
+
+    destroy_shm(vo);
+
+    int slot_size = mp_image_get_alloc_size(params->imgfmt, params->w,
+                                            params->h, SHM_ALIGN);
+    if (slot_size < 0)
+        return -1;
+    slot_size = MP_ALIGN_UP(slot_size, SHM_ALIGN);
+
+    size_t data_offset = sizeof(struct mpv_frame_shm_header) +
+                         p->num_slots * sizeof(struct mpv_frame_shm_slot);
+    data_offset = MP_ALIGN_UP(data_offset, SHM_ALIGN);
+    p->map_size = data_offset + (size_t)slot_size * p->num_slots;
+
+    // Make sure a consumer never sees the old layout in the new object.
+    shm_unlink(p->name);
+    p->fd = shm_open(p->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (p->fd < 0) {
+        MP_ERR(vo, "Could not create shared memory object '%s': %s\n",
+               p->name, mp_strerror(errno));
+        return -1;
+    }
+
+    if (ftruncate(p->fd, p->map_size) < 0) {
+        MP_ERR(vo, "Could not resize shared memory: %s\n", mp_strerror(errno));
+        goto error;
+    }
+
+    p->map = mmap(NULL, p->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  p->fd, 0);
+    if (p->map == MAP_FAILED) {
+        p->map = NULL;
+        MP_ERR(vo, "Could not map shared memory: %s\n", mp_strerror(errno));
+        goto error;
+    }
+
+    int d_w, d_h;
+    mp_image_params_get_dsize(params, &d_w, &d_h);
+
+    p->hdr = (void *)p->map;
+    p->slots = (void *)(p->map + sizeof(struct mpv_frame_shm_header));
+    *p->hdr = (struct mpv_frame_shm_header){
+        .version = MPV_FRAME_SHM_VERSION,
+        .num_slots = p->num_slots,
+        .data_offset = data_offset,
+        .slot_size = slot_size,
+        .pixfmt = imgfmt2pixfmt(params->imgfmt),
+        .width = params->w,
+        .height = params->h,
+        .d_w = d_w,
+        .d_h = d_h,
+    };
+    // (ftruncate() zero-fills the slots.)
+    shm_barrier();
+    p->hdr->magic = MPV_FRAME_SHM_MAGIC;
+
+    MP_VERBOSE(vo, "Exporting %dx%d %s frames to '%s' (%d slots).\n",
+               params->w, params->h, mp_imgfmt_to_name(params->imgfmt),
+               p->name, p->num_slots);
+    return 0;
+
+error:
+    close(p->fd);
+    p->fd = -1;
+    shm_unlink(p->name);
+    return -1;
+}
+
+static void free_nothing(void *opaque, uint8_t *data)
+{
+}
+
+static void draw_image(struct vo *vo, struct mp_image *mpi)
+{
+    struct priv *p = vo->priv;
+
+    if (!p->hdr)
+        goto done;
+
+    int n = p->frame_count % p->num_slots;
+    struct mpv_frame_shm_slot *slot = &p->slots[n];
+    uint8_t *data = p->map + p->hdr->data_offset + n * p->hdr->slot_size;
+
+    struct mp_image *dst =
+        mp_image_from_buffer(mpi->imgfmt, mpi->w, mpi->h, SHM_ALIGN,
+                             data, p->hdr->slot_size, NULL, free_nothing);
+    if (!dst)
+        goto done;
+
+    slot->seq++;
+    shm_barrier();
+
+    mp_image_copy(dst, mpi);
+
+    slot->frame_num = p->frame_count;
+    slot->pts = mpi->pts;
+    slot->num_planes = dst->num_planes;
+    for (int i = 0; i < MPV_FRAME_SHM_MAX_PLANES; i++) {
+        bool valid = i < dst->num_planes;
+        slot->plane_offset[i] = valid ? dst->planes[i] - data : 0;
+        slot->plane_stride[i] = valid ? dst->stride[i] : 0;
+    }
+
+    shm_barrier();
+    slot->seq++;
+    shm_barrier();
+
+    p->hdr->frame_count = ++p->frame_count;
+
+    talloc_free(dst);
+done:
+    talloc_free(mpi);
+}
+
+static void flip_page(struct vo *vo)
+{
+}
+
+static int query_format(struct vo *vo, int format)
+{
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(format);
+    return !(desc.flags & MP_IMGFLAG_HWACCEL) &&
+           desc.num_planes <= MPV_FRAME_SHM_MAX_PLANES &&
+           imgfmt2pixfmt(format) != AV_PIX_FMT_NONE;
+}
+
+static void uninit(struct vo *vo)
+{
+    destroy_shm(vo);
+}
+
+static int preinit(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    p->fd = -1;
+
+    if (!p->name || p->name[0] != '/') {
+        MP_FATAL(vo, "--vo-shm-name must start with '/'.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int control(struct vo *vo, uint32_t request, void *data)
+{
+    return VO_NOTIMPL;
+}
+
+#define OPT_BASE_STRUCT struct priv
+const struct vo_driver video_out_shm = {
+    .description = "Export frames to shared memory",
+    .name = "shm",
+    .preinit = preinit,
+    .query_format = query_format,
+    .reconfig = reconfig,
+    .control = control,
+    .draw_image = draw_image,
+    .flip_page = flip_page,
+    .uninit = uninit,
+    .priv_size = sizeof(struct priv),
+    .priv_defaults = &(const struct priv) {
+        .name = "/mpv-frames",
+        .num_slots = 4,
+    },
+    .options = (const struct m_option[]) {
+        OPT_STRING("name", name, 0),
+        OPT_INTRANGE("slots", num_slots, 0, 1, 64),
+        {0},
+    },
+    .options_prefix = "vo-shm",
+};
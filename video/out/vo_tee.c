@@ -0,0 +1,296 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "options/m_option.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "vo.h"
+
+// Sends the same frames to several VOs. Each output runs its own VO thread,
+// and gets new references to the decoded images (optionally cropped, which
+// only adjusts the plane pointers). The outputs are run in lockstep: a frame
+// is considered presented once all outputs have flipped it, so the timing
+// feedback to the player follows the slowest output.
+
+#define MAX_OUTPUTS 16
+
+struct output {
+    char *driver;
+    bool crop;          // crop the video to rc
+    int w, h, x, y;     // requested crop
+    struct mp_rect rc;  // actual crop, for the current video params
+    struct vo *vo;
+};
+
+struct priv {
+    char **outputs;
+
+    struct output out[MAX_OUTPUTS];
+    int num_out;
+    uint8_t formats[IMGFMT_END - IMGFMT_START];
+    uint64_t last_frame_id;
+};
+
+static void output_wakeup(void *ctx)
+{
+    struct vo *vo = ctx;
+    // Makes us forward the output's events with VOCTRL_CHECK_EVENTS.
+    vo_wakeup(vo);
+}
+
+// Parse "driver" or "driver@WxH+X+Y".
+static bool parse_output(struct vo *vo, struct output *o, char *s)
+{
+    char *geo = strchr(s, '@');
+    o->driver = talloc_strndup(vo, s, geo ? geo - s : strlen(s));
+    if (geo) {
+        int len = 0;
+        if (sscanf(geo + 1, "%dx%d+%d+%d%n", &o->w, &o->h, &o->x, &o->y,
+                   &len) != 4 || geo[1 + len] || o->w < 1 || o->h < 1 ||
+            o->x < 0 || o->y < 0)
+        {
+            MP_ERR(vo, "Invalid crop '%s' (expected WxH+X+Y).\n", geo + 1);
+            return false;
+        }
+        o->crop = true;
+    }
+    if (!o->driver[0] || strcmp(o->driver, "tee") == 0) {
+        MP_ERR(vo, "Invalid output driver '%s'.\n", o->driver);
+        return false;
+    }
+    return true;
+}
+
+static void uninit(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    for (int n = 0; n < p->num_out; n++) {
+        if (p->out[n].vo)
+            vo_destroy(p->out[n].vo);
+        p->out[n].vo = NULL;
+    }
+}
+
+static int preinit(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    for (int n = 0; p->outputs && p->outputs[n]; n++) {
+        if (p->num_out >= MAX_OUTPUTS) {
+            MP_ERR(vo, "Too many outputs (maximum is %d).\n", MAX_OUTPUTS);
+            goto error;
+        }
+        struct output *o = &p->out[p->num_out++];
+        if (!parse_output(vo, o, p->outputs[n]))
+            goto error;
+    }
+    if (!p->num_out) {
+        MP_ERR(vo, "No outputs set with --vo-tee-outputs.\n");
+        goto error;
+    }
+
+    struct vo_extra ex = vo->extra;
+    ex.wakeup_cb = output_wakeup;
+    ex.wakeup_ctx = vo;
+
+    memset(p->formats, 1, sizeof(p->formats));
+    for (int n = 0; n < p->num_out; n++) {
+        struct output *o = &p->out[n];
+        o->vo = vo_create(false, vo->global, &ex, o->driver);
+        if (!o->vo) {
+            MP_ERR(vo, "Could not create output %d (%s).\n", n, o->driver);
+            goto error;
+        }
+
+        uint8_t formats[IMGFMT_END - IMGFMT_START];
+        vo_query_formats(o->vo, formats);
+        for (int i = 0; i < MP_ARRAY_SIZE(formats); i++) {
+            p->formats[i] &= !!formats[i];
+            // Hardware surfaces can't be cropped.
+            if (o->crop && IMGFMT_IS_HWACCEL(IMGFMT_START + i))
+                p->formats[i] = 0;
+        }
+    }
+
+    return 0;
+
+error:
+    uninit(vo);
+    return -1;
+}
+
+static int query_format(struct vo *vo, int format)
+{
+    struct priv *p = vo->priv;
+    return p->formats[format - IMGFMT_START];
+}
+
+static int reconfig(struct vo *vo, struct mp_image_params *params)
+{
+    struct priv *p = vo->priv;
+
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(params->imgfmt);
+    int align_x = MPMAX(desc.align_x, 1), align_y = MPMAX(desc.align_y, 1);
+
+    for (int n = 0; n < p->num_out; n++) {
+        struct output *o = &p->out[n];
+        struct mp_image_params op = *params;
+        if (o->crop) {
+            // The start must be aligned to the chroma subsampling.
+            int x0 = MPMIN(o->x / align_x * align_x, params->w);
+            int y0 = MPMIN(o->y / align_y * align_y, params->h);
+            o->rc = (struct mp_rect){x0, y0, MPMIN(x0 + o->w, params->w),
+                                             MPMIN(y0 + o->h, params->h)};
+            if (o->rc.x1 <= o->rc.x0 || o->rc.y1 <= o->rc.y0) {
+                MP_ERR(vo, "Output %d: crop is outside of the video.\n", n);
+                return -1;
+            }
+            op.w = o->rc.x1 - o->rc.x0;
+            op.h = o->rc.y1 - o->rc.y0;
+        }
+        if (vo_reconfig(o->vo, &op) < 0) {
+            MP_ERR(vo, "Output %d (%s) failed to configure.\n", n, o->driver);
+            return -1;
+        }
+    }
+
+    p->last_frame_id = 0;
+    return 0;
+}
+
+static struct vo_frame *output_frame(struct output *o, struct vo_frame *frame)
+{
+    struct vo_frame *nframe = vo_frame_ref(frame);
+    if (o->crop) {
+        for (int n = 0; n < nframe->num_frames; n++)
+            mp_image_crop_rc(nframe->frames[n], o->rc);
+    }
+    // Our own VO thread does the timing (the output gets pts=0 in display-sync
+    // mode, or the target time otherwise). The output must display each frame
+    // exactly once; repeats are triggered by us.
+    nframe->display_synced = false;
+    nframe->num_vsyncs = 1;
+    return nframe;
+}
+
+static void draw_frame(struct vo *vo, struct vo_frame *frame)
+{
+    struct priv *p = vo->priv;
+
+    bool is_new = frame->frame_id != p->last_frame_id;
+    p->last_frame_id = frame->frame_id;
+
+    for (int n = 0; n < p->num_out; n++) {
+        struct output *o = &p->out[n];
+        if (!is_new) {
+            if (frame->redraw || frame->still)
+                vo_redraw(o->vo);
+            continue;
+        }
+        vo_wait_frame(o->vo);
+        if (!vo_is_ready_for_frame(o->vo, -1)) {
+            MP_VERBOSE(vo, "Output %d not ready, skipping frame.\n", n);
+            vo_increment_drop_count(vo, 1);
+            continue;
+        }
+        vo_queue_frame(o->vo, output_frame(o, frame));
+    }
+
+    // Keep the outputs in sync: return only once all of them are done.
+    for (int n = 0; n < p->num_out; n++)
+        vo_wait_frame(p->out[n].vo);
+}
+
+static void flip_page(struct vo *vo)
+{
+}
+
+static int control(struct vo *vo, uint32_t request, void *data)
+{
+    struct priv *p = vo->priv;
+
+    switch (request) {
+    case VOCTRL_CHECK_EVENTS:
+        for (int n = 0; n < p->num_out; n++) {
+            int events = vo_query_and_reset_events(p->out[n].vo, VO_EVENTS_USER);
+            if (events)
+                vo_event(vo, events);
+        }
+        return VO_TRUE;
+    case VOCTRL_RESET:
+        for (int n = 0; n < p->num_out; n++)
+            vo_seek_reset(p->out[n].vo);
+        p->last_frame_id = 0;
+        return VO_TRUE;
+    case VOCTRL_PAUSE:
+    case VOCTRL_RESUME:
+        for (int n = 0; n < p->num_out; n++)
+            vo_set_paused(p->out[n].vo, request == VOCTRL_PAUSE);
+        return VO_TRUE;
+    // Option changes are picked up by the outputs themselves.
+    case VOCTRL_SET_PANSCAN:
+    case VOCTRL_SET_EQUALIZER:
+    case VOCTRL_UPDATE_RENDER_OPTS:
+        return VO_TRUE;
+    // Window state changes apply to all outputs.
+    case VOCTRL_FULLSCREEN:
+    case VOCTRL_ONTOP:
+    case VOCTRL_BORDER:
+    case VOCTRL_ALL_WORKSPACES:
+    case VOCTRL_UPDATE_WINDOW_TITLE:
+    case VOCTRL_UPDATE_PLAYBACK_STATE:
+    case VOCTRL_SET_CURSOR_VISIBILITY:
+    case VOCTRL_KILL_SCREENSAVER:
+    case VOCTRL_RESTORE_SCREENSAVER: {
+        int r = VO_NOTIMPL;
+        for (int n = 0; n < p->num_out; n++) {
+            int nr = vo_control(p->out[n].vo, request, data);
+            if (n == 0)
+                r = nr;
+        }
+        return r;
+    }
+    }
+
+    // Queries are answered by the first output.
+    return vo_control(p->out[0].vo, request, data);
+}
+
+#define OPT_BASE_STRUCT struct priv
+const struct vo_driver video_out_tee = {
+    .description = "Send video to multiple outputs",
+    .name = "tee",
+    .preinit = preinit,
+    .query_format = query_format,
+    .reconfig = reconfig,
+    .control = control,
+    .draw_frame = draw_frame,
+    .flip_page = flip_page,
+    .uninit = uninit,
+    .priv_size = sizeof(struct priv),
+    .options = (const struct m_option[]) {
+        OPT_STRINGLIST("outputs", outputs, 0),
+        {0},
+    },
+    .options_prefix = "vo-tee",
+};
@@ -17,6 +17,7 @@
  * with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -50,6 +51,7 @@
 #include "video/fmt-conversion.h"
 
 #include "common/msg.h"
+#include "mpv_talloc.h"
 #include "input/input.h"
 #include "options/options.h"
 #include "osdep/timer.h"
@@ -83,9 +85,24 @@ struct priv {
     int Shmem_Flag;
     XShmSegmentInfo Shminfo[2];
     int Shm_Warned_Slow;
+
+    // Direct rendering: decoded frames in the X server's format are allocated
+    // in their own shm segments, and can be put on the window without copy.
+    struct dr_buffer **dr_buffers;
+    int num_dr_buffers;
+    struct mp_image *dr_image[2];   // frame being shown from each slot
+    XImage *dr_ximage[2];           // wraps dr_image[n], NULL if not used
 #endif
+    int x_imgfmt;                   // X server image format, 0 if unknown
 };
 
+#if HAVE_SHM
+struct dr_buffer {
+    XShmSegmentInfo shminfo;
+    size_t size;
+};
+#endif
+
 static bool resize(struct vo *vo);
 
 static bool getMyXImage(struct priv *p, int foo)
@@ -170,6 +187,143 @@ static void freeMyXImage(struct priv *p, int foo)
     p->myximage[foo] = NULL;
 }
 
+#if HAVE_SHM
+static void release_dr_slot(struct priv *p, int n)
+{
+    if (p->dr_ximage[n]) {
+        p->dr_ximage[n]->data = NULL; // owned by dr_image[n]
+        XDestroyImage(p->dr_ximage[n]);
+        p->dr_ximage[n] = NULL;
+    }
+    mp_image_unrefp(&p->dr_image[n]);
+}
+
+static struct dr_buffer *find_dr_buffer(struct priv *p, uint8_t *ptr)
+{
+    for (int n = 0; n < p->num_dr_buffers; n++) {
+        struct dr_buffer *buf = p->dr_buffers[n];
+        uint8_t *start = (uint8_t *)buf->shminfo.shmaddr;
+        if (ptr >= start && ptr < start + buf->size)
+            return buf;
+    }
+    return NULL;
+}
+
+// (vo.c proxies the free callback to the VO thread, so Xlib calls are fine.)
+static void dr_free_buffer(void *opaque, uint8_t *data)
+{
+    struct priv *p = opaque;
+    Display *display = p->vo->x11->display;
+
+    for (int n = 0; n < p->num_dr_buffers; n++) {
+        struct dr_buffer *buf = p->dr_buffers[n];
+        if ((uint8_t *)buf->shminfo.shmaddr == data) {
+            XShmDetach(display, &buf->shminfo);
+            XSync(display, False);
+            shmdt(buf->shminfo.shmaddr);
+            talloc_free(buf);
+            MP_TARRAY_REMOVE_AT(p->dr_buffers, p->num_dr_buffers, n);
+            return;
+        }
+    }
+    // not found - must not happen
+    assert(0);
+}
+
+static struct mp_image *get_image(struct vo *vo, int imgfmt, int w, int h,
+                                  int stride_align)
+{
+    struct priv *p = vo->priv;
+    Display *display = vo->x11->display;
+
+    if (!p->Shmem_Flag || !p->x_imgfmt || imgfmt != p->x_imgfmt)
+        return NULL;
+
+    int size = mp_image_get_alloc_size(imgfmt, w, h, stride_align);
+    if (size < 0)
+        return NULL;
+
+    struct dr_buffer *buf = talloc_zero(NULL, struct dr_buffer);
+    buf->size = size + stride_align;
+    buf->shminfo.shmid = shmget(IPC_PRIVATE, buf->size, IPC_CREAT | 0777);
+    if (buf->shminfo.shmid < 0)
+        goto error;
+    buf->shminfo.shmaddr = shmat(buf->shminfo.shmid, 0, 0);
+    if (buf->shminfo.shmaddr == (char *)-1) {
+        shmctl(buf->shminfo.shmid, IPC_RMID, 0);
+        goto error;
+    }
+    buf->shminfo.readOnly = True;
+    if (!XShmAttach(display, &buf->shminfo)) {
+        shmdt(buf->shminfo.shmaddr);
+        shmctl(buf->shminfo.shmid, IPC_RMID, 0);
+        goto error;
+    }
+    XSync(display, False);
+    shmctl(buf->shminfo.shmid, IPC_RMID, 0);
+
+    MP_TARRAY_APPEND(vo, p->dr_buffers, p->num_dr_buffers, buf);
+
+    uint8_t *ptr = (uint8_t *)buf->shminfo.shmaddr;
+    struct mp_image *res = mp_image_from_buffer(imgfmt, w, h, stride_align,
+                                                ptr, buf->size, p,
+                                                dr_free_buffer);
+    if (!res)
+        dr_free_buffer(p, ptr);
+    return res;
+
+error:
+    MP_VERBOSE(vo, "Could not allocate shm segment for direct rendering.\n");
+    talloc_free(buf);
+    return NULL;
+}
+
+// Show mpi directly from its shm segment, if it's a DR image that needs no
+// scaling or conversion. Returns false if the normal path must be used.
+static bool draw_direct(struct vo *vo, struct mp_image *mpi)
+{
+    struct priv *p = vo->priv;
+
+    if (!p->Shmem_Flag || !mpi || mpi->imgfmt != p->sws->dst.imgfmt)
+        return false;
+    if (p->src.x0 || p->src.y0 || p->src_w != mpi->w || p->src_h != mpi->h ||
+        p->dst_w != mpi->w || p->dst_h != mpi->h)
+        return false;
+    if (!find_dr_buffer(p, mpi->planes[0]))
+        return false;
+
+    struct mp_image *img = mp_image_new_ref(mpi);
+    if (!img)
+        return false;
+
+    // If the decoder still references the frame, this draws on a copy; then
+    // there's no point in the direct path anymore.
+    osd_draw_on_image(vo->osd, p->osd, img->pts, 0, img);
+
+    struct dr_buffer *buf = find_dr_buffer(p, img->planes[0]);
+    int bpp = img->fmt.bytes[0];
+    XImage *ximg = NULL;
+    if (buf && bpp > 0 && img->stride[0] % bpp == 0) {
+        ximg = XShmCreateImage(vo->x11->display, p->vinfo.visual, p->depth,
+                               ZPixmap, (char *)img->planes[0], &buf->shminfo,
+                               img->stride[0] / bpp, img->h);
+    }
+    if (ximg && ximg->bytes_per_line != img->stride[0]) {
+        ximg->data = NULL;
+        XDestroyImage(ximg);
+        ximg = NULL;
+    }
+    if (!ximg) {
+        talloc_free(img);
+        return false;
+    }
+
+    p->dr_image[p->current_buf] = img;
+    p->dr_ximage[p->current_buf] = ximg;
+    return true;
+}
+#endif
+
 const struct fmt_entry {
     uint32_t mpfmt;
     int depth;
@@ -210,8 +364,12 @@ static bool resize(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
-    for (int i = 0; i < 2; i++)
+    for (int i = 0; i < 2; i++) {
         freeMyXImage(p, i);
+#if HAVE_SHM
+        release_dr_slot(p, i);
+#endif
+    }
 
     vo_get_src_dst_rects(vo, &p->src, &p->dst, &p->osd);
 
@@ -254,6 +412,7 @@ static bool resize(struct vo *vo)
         MP_ERR(vo, "X server image format not supported, use another VO.\n");
         return -1;
     }
+    p->x_imgfmt = fmte->mpfmt;
 
     mp_sws_set_from_cmdline(p->sws, vo->opts->sws_opts);
     p->sws->dst = (struct mp_image_params) {
@@ -278,6 +437,10 @@ static void Display_Image(struct priv *p, XImage *myximage)
     struct vo *vo = p->vo;
 
     XImage *x_image = p->myximage[p->current_buf];
+#if HAVE_SHM
+    if (p->dr_ximage[p->current_buf])
+        x_image = p->dr_ximage[p->current_buf];
+#endif
 
     if (p->reset_view) {
         XFillRectangle(vo->x11->display, vo->x11->window, p->gc, 0, 0, vo->dwidth, vo->dheight);
@@ -343,6 +506,13 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 
     wait_for_completion(vo, 1);
 
+#if HAVE_SHM
+    // The X server is done with the frame previously shown from this slot.
+    release_dr_slot(p, p->current_buf);
+    if (draw_direct(vo, mpi))
+        goto done;
+#endif
+
     struct mp_image img = get_x_buffer(p, p->current_buf);
 
     if (mpi) {
@@ -359,6 +529,9 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 
     osd_draw_on_image(vo->osd, p->osd, mpi ? mpi->pts : 0, 0, &img);
 
+#if HAVE_SHM
+done:
+#endif
     if (mpi != p->original_image) {
         talloc_free(p->original_image);
         p->original_image = mpi;
@@ -375,6 +548,10 @@ static int query_format(struct vo *vo, int format)
 static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
+#if HAVE_SHM
+    release_dr_slot(p, 0);
+    release_dr_slot(p, 1);
+#endif
     if (p->myximage[0])
         freeMyXImage(p, 0);
     if (p->myximage[1])
@@ -450,6 +627,9 @@ const struct vo_driver video_out_x11 = {
     .reconfig = reconfig,
     .control = control,
     .draw_image = draw_image,
+#if HAVE_SHM
+    .get_image = get_image,
+#endif
     .flip_page = flip_page,
     .wakeup = vo_x11_wakeup,
     .wait_events = vo_x11_wait_events,
@@ -50,9 +50,14 @@ struct mpvk_ctx {
 
     struct vk_malloc *alloc; // memory allocator for this device
     struct vk_cmdpool *pool; // primary command pool for this device
+    struct vk_cmdpool *pool_transfer; // optional pool for async uploads
+    uint32_t pool_qfs[2];    // queue families of `pool` and `pool_transfer`
     struct vk_cmd *last_cmd; // most recently submitted command
     struct spirv_compiler *spirv; // GLSL -> SPIR-V compiler
 
     // Cached capabilities
     VkPhysicalDeviceLimits limits;
+    bool has_ext_memory_fd;    // can export/import memory as opaque fds
+    bool has_ext_dmabuf;       // can import DMABUFs as VkDeviceMemory
+    bool has_ext_drm_modifier; // can import DMABUFs with explicit tiling
 };
@@ -104,9 +104,16 @@ const struct m_sub_options vulkan_conf = {
                    {"immediate",    SWAP_IMMEDIATE})),
         OPT_INTRANGE("vulkan-queue-count", dev_opts.queue_count, 0, 1,
                      MPVK_MAX_QUEUES, OPTDEF_INT(1)),
+        OPT_FLAG("vulkan-async-transfer", dev_opts.async_transfer, 0),
         {0}
     },
-    .size = sizeof(struct vulkan_opts)
+    .size = sizeof(struct vulkan_opts),
+    .defaults = &(const struct vulkan_opts) {
+        .dev_opts = {
+            .queue_count = 1,
+            .async_transfer = 1,
+        },
+    },
 };
 
 struct priv {
@@ -244,7 +251,7 @@ void ra_vk_ctx_uninit(struct ra_ctx *ctx)
         struct priv *p = ctx->swapchain->priv;
         struct mpvk_ctx *vk = p->vk;
 
-        mpvk_pool_wait_idle(vk, vk->pool);
+        mpvk_dev_wait_idle(vk);
 
         for (int i = 0; i < p->num_images; i++)
             ra_tex_free(ctx->ra, &p->images[i]);
@@ -505,8 +512,10 @@ static void swap_buffers(struct ra_swapchain *sw)
 {
     struct priv *p = sw->priv;
 
+    // Block until the oldest frame has finished rendering. Frames are
+    // submitted in order, so there's no need to wake up repeatedly to poll.
     while (p->frames_in_flight >= sw->ctx->opts.swapchain_depth)
-        mpvk_dev_poll_cmds(p->vk, 100000); // 100μs
+        mpvk_dev_poll_cmds(p->vk, UINT32_MAX);
 }
 
 static const struct ra_swapchain_fns vulkan_swapchain = {
@@ -0,0 +1,400 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This hwdec implements CUDA->Vulkan interop for frames stored in CUDA device
+ * memory (i.e. from the nvdec/cuvid decoders). Vulkan buffers are allocated
+ * with exportable memory, which is imported into CUDA as external memory.
+ * Each frame is copied into such a buffer with a device-to-device copy, and
+ * then into the plane textures with a GPU-side upload. The frame data never
+ * passes through system RAM.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "video/out/opengl/cuda_dynamic.h"
+
+#include <libavutil/hwcontext.h>
+#include <libavutil/hwcontext_cuda.h>
+
+#include "video/out/gpu/hwdec.h"
+#include "ra_vk.h"
+
+// Upper bound on the number of frames in flight per mapper.
+#define MAX_BUFS MPVK_MAX_STREAMING_DEPTH
+
+struct priv_owner {
+    struct mp_hwdec_ctx hwctx;
+    CUcontext display_ctx;
+};
+
+struct ext_buf {
+    struct ra_buf *buf;
+    CUexternalMemory mem;
+    CUdeviceptr ptr;
+};
+
+struct priv {
+    struct mp_image layout;
+    size_t offset[4];   // plane offsets within a buffer
+    size_t stride[4];   // plane strides within a buffer
+    size_t size;        // total buffer size
+    struct ext_buf bufs[MAX_BUFS];
+    int num_bufs;
+
+    CUcontext display_ctx;
+};
+
+static int check_cu(struct ra_hwdec *hw, CUresult err, const char *func)
+{
+    const char *err_name;
+    const char *err_string;
+
+    MP_TRACE(hw, "Calling %s\n", func);
+
+    if (err == CUDA_SUCCESS)
+        return 0;
+
+    cuGetErrorName(err, &err_name);
+    cuGetErrorString(err, &err_string);
+
+    MP_ERR(hw, "%s failed", func);
+    if (err_name && err_string)
+        MP_ERR(hw, " -> %s: %s", err_name, err_string);
+    MP_ERR(hw, "\n");
+
+    return -1;
+}
+
+#define CHECK_CU(x) check_cu(hw, (x), #x)
+
+// Find the CUDA device that drives the Vulkan device.
+static int find_cuda_device(struct ra_hwdec *hw, CUdevice *out)
+{
+    struct mpvk_ctx *vk = ra_vk_get(hw->ra);
+
+    uint8_t vk_uuid[VK_UUID_SIZE];
+    if (!mpvk_get_device_uuid(vk, vk_uuid)) {
+        MP_VERBOSE(hw, "Can't determine the Vulkan device UUID\n");
+        return -1;
+    }
+
+    int count = 0;
+    if (CHECK_CU(cuDeviceGetCount(&count)) < 0)
+        return -1;
+
+    for (int n = 0; n < count; n++) {
+        CUdevice dev;
+        CUuuid uuid;
+        if (CHECK_CU(cuDeviceGet(&dev, n)) < 0 ||
+            CHECK_CU(cuDeviceGetUuid(&uuid, dev)) < 0)
+            return -1;
+        if (memcmp(uuid.bytes, vk_uuid, sizeof(uuid.bytes)) == 0) {
+            *out = dev;
+            return 0;
+        }
+    }
+
+    MP_VERBOSE(hw, "No CUDA device matches the Vulkan device\n");
+    return -1;
+}
+
+static int cuda_init(struct ra_hwdec *hw)
+{
+    CUdevice display_dev;
+    AVBufferRef *hw_device_ctx = NULL;
+    CUcontext dummy;
+    int ret = 0;
+    struct priv_owner *p = hw->priv;
+
+    struct mpvk_ctx *vk = ra_vk_get(hw->ra);
+    if (!vk || !vk->has_ext_memory_fd)
+        return -1;
+
+    if (!cuda_load()) {
+        MP_VERBOSE(hw, "Failed to load CUDA symbols\n");
+        return -1;
+    }
+
+    if (!cuda_has_external_memory()) {
+        MP_VERBOSE(hw, "CUDA driver does not support external memory\n");
+        return -1;
+    }
+
+    ret = CHECK_CU(cuInit(0));
+    if (ret < 0)
+        return -1;
+
+    if (find_cuda_device(hw, &display_dev) < 0)
+        return -1;
+
+    ret = CHECK_CU(cuCtxCreate(&p->display_ctx, CU_CTX_SCHED_BLOCKING_SYNC,
+                               display_dev));
+    if (ret < 0)
+        return -1;
+
+    hw_device_ctx = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_CUDA);
+    if (!hw_device_ctx)
+        goto error;
+
+    AVHWDeviceContext *device_ctx = (void *)hw_device_ctx->data;
+
+    AVCUDADeviceContext *device_hwctx = device_ctx->hwctx;
+    device_hwctx->cuda_ctx = p->display_ctx;
+
+    ret = av_hwdevice_ctx_init(hw_device_ctx);
+    if (ret < 0) {
+        MP_ERR(hw, "av_hwdevice_ctx_init failed\n");
+        goto error;
+    }
+
+    ret = CHECK_CU(cuCtxPopCurrent(&dummy));
+    if (ret < 0)
+        goto error;
+
+    p->hwctx = (struct mp_hwdec_ctx) {
+        .type = hw->driver->api,
+        .ctx = p->display_ctx,
+        .av_device_ref = hw_device_ctx,
+    };
+    p->hwctx.driver_name = hw->driver->name;
+    hwdec_devices_add(hw->devs, &p->hwctx);
+    return 0;
+
+ error:
+    av_buffer_unref(&hw_device_ctx);
+    CHECK_CU(cuCtxPopCurrent(&dummy));
+
+    return -1;
+}
+
+static void cuda_uninit(struct ra_hwdec *hw)
+{
+    struct priv_owner *p = hw->priv;
+
+    if (p->hwctx.ctx)
+        hwdec_devices_remove(hw->devs, &p->hwctx);
+    av_buffer_unref(&p->hwctx.av_device_ref);
+
+    if (p->display_ctx)
+        CHECK_CU(cuCtxDestroy(p->display_ctx));
+}
+
+#undef CHECK_CU
+#define CHECK_CU(x) check_cu((mapper)->owner, (x), #x)
+
+static int mapper_init(struct ra_hwdec_mapper *mapper)
+{
+    struct priv_owner *p_owner = mapper->owner->priv;
+    struct priv *p = mapper->priv;
+
+    p->display_ctx = p_owner->display_ctx;
+
+    int imgfmt = mapper->src_params.hw_subfmt;
+    mapper->dst_params = mapper->src_params;
+    mapper->dst_params.imgfmt = imgfmt;
+    mapper->dst_params.hw_subfmt = 0;
+
+    mp_image_set_params(&p->layout, &mapper->dst_params);
+
+    struct ra_imgfmt_desc desc;
+    if (!ra_get_imgfmt_desc(mapper->ra, imgfmt, &desc)) {
+        MP_ERR(mapper, "Unsupported format: %s\n", mp_imgfmt_to_name(imgfmt));
+        return -1;
+    }
+
+    for (int n = 0; n < desc.num_planes; n++) {
+        const struct ra_format *format = desc.planes[n];
+
+        struct ra_tex_params params = {
+            .dimensions = 2,
+            .w = mp_image_plane_w(&p->layout, n),
+            .h = mp_image_plane_h(&p->layout, n),
+            .d = 1,
+            .format = format,
+            .render_src = true,
+            .src_linear = format->linear_filter,
+            .host_mutable = true,
+        };
+
+        mapper->tex[n] = ra_tex_create(mapper->ra, &params);
+        if (!mapper->tex[n])
+            return -1;
+
+        // All planes of a frame are packed into one buffer.
+        p->offset[n] = MP_ALIGN_UP(p->size, 256);
+        p->stride[n] = params.w * format->pixel_size;
+        p->size = p->offset[n] + p->stride[n] * params.h;
+    }
+
+    return 0;
+}
+
+static void mapper_uninit(struct ra_hwdec_mapper *mapper)
+{
+    struct priv *p = mapper->priv;
+    CUcontext dummy;
+
+    // Don't bail if any CUDA calls fail. This is all best effort.
+    CHECK_CU(cuCtxPushCurrent(p->display_ctx));
+    for (int n = 0; n < p->num_bufs; n++) {
+        struct ext_buf *b = &p->bufs[n];
+        if (b->ptr)
+            CHECK_CU(cuMemFree(b->ptr));
+        if (b->mem)
+            CHECK_CU(cuDestroyExternalMemory(b->mem));
+        ra_buf_free(mapper->ra, &b->buf);
+    }
+    p->num_bufs = 0;
+    CHECK_CU(cuCtxPopCurrent(&dummy));
+
+    for (int n = 0; n < 4; n++)
+        ra_tex_free(mapper->ra, &mapper->tex[n]);
+}
+
+static void mapper_unmap(struct ra_hwdec_mapper *mapper)
+{
+}
+
+// Must be called with the display context pushed.
+static struct ext_buf *get_buf(struct ra_hwdec_mapper *mapper)
+{
+    struct priv *p = mapper->priv;
+    struct ra *ra = mapper->ra;
+
+    for (int n = 0; n < p->num_bufs; n++) {
+        struct ext_buf *b = &p->bufs[n];
+        if (!ra->fns->buf_poll || ra->fns->buf_poll(ra, b->buf))
+            return b;
+    }
+
+    if (p->num_bufs == MAX_BUFS) {
+        MP_ERR(mapper, "All interop buffers are in use.\n");
+        return NULL;
+    }
+
+    struct ext_buf *b = &p->bufs[p->num_bufs];
+    struct ra_vk_external_buf ext;
+    b->buf = ra_vk_create_external_buf(ra, p->size, &ext);
+    if (!b->buf) {
+        MP_ERR(mapper, "Failed to create exportable Vulkan buffer.\n");
+        return NULL;
+    }
+
+    CUDA_EXTERNAL_MEMORY_HANDLE_DESC mem_desc = {
+        .type = CU_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD,
+        .handle.fd = ext.fd,
+        .size = ext.mem_size,
+    };
+    if (CHECK_CU(cuImportExternalMemory(&b->mem, &mem_desc)) < 0) {
+        // The fd is only taken over on success.
+        close(ext.fd);
+        goto error;
+    }
+
+    CUDA_EXTERNAL_MEMORY_BUFFER_DESC buf_desc = {
+        .size = p->size,
+    };
+    if (CHECK_CU(cuExternalMemoryGetMappedBuffer(&b->ptr, b->mem, &buf_desc)) < 0)
+        goto error;
+
+    p->num_bufs++;
+    return b;
+
+error:
+    if (b->mem)
+        CHECK_CU(cuDestroyExternalMemory(b->mem));
+    ra_buf_free(ra, &b->buf);
+    *b = (struct ext_buf){0};
+    return NULL;
+}
+
+static int mapper_map(struct ra_hwdec_mapper *mapper)
+{
+    struct priv *p = mapper->priv;
+    CUcontext dummy;
+    int ret = 0, eret = 0;
+
+    ret = CHECK_CU(cuCtxPushCurrent(p->display_ctx));
+    if (ret < 0)
+        return ret;
+
+    struct ext_buf *b = get_buf(mapper);
+    if (!b) {
+        ret = -1;
+        goto error;
+    }
+
+    for (int n = 0; n < p->layout.num_planes; n++) {
+        CUDA_MEMCPY2D cpy = {
+            .srcMemoryType = CU_MEMORYTYPE_DEVICE,
+            .dstMemoryType = CU_MEMORYTYPE_DEVICE,
+            .srcDevice     = (CUdeviceptr)mapper->src->planes[n],
+            .srcPitch      = mapper->src->stride[n],
+            .dstDevice     = b->ptr + p->offset[n],
+            .dstPitch      = p->stride[n],
+            .WidthInBytes  = p->stride[n],
+            .Height        = mp_image_plane_h(&p->layout, n),
+        };
+        ret = CHECK_CU(cuMemcpy2D(&cpy));
+        if (ret < 0)
+            goto error;
+    }
+
+    // The copy must be complete before Vulkan reads the buffer.
+    ret = CHECK_CU(cuCtxSynchronize());
+    if (ret < 0)
+        goto error;
+
+    for (int n = 0; n < p->layout.num_planes; n++) {
+        struct ra_tex_upload_params params = {
+            .tex = mapper->tex[n],
+            .invalidate = true,
+            .buf = b->buf,
+            .buf_offset = p->offset[n],
+            .stride = p->stride[n],
+        };
+        if (!mapper->ra->fns->tex_upload(mapper->ra, &params)) {
+            ret = -1;
+            goto error;
+        }
+    }
+
+ error:
+   eret = CHECK_CU(cuCtxPopCurrent(&dummy));
+   if (eret < 0)
+       return eret;
+
+   return ret;
+}
+
+const struct ra_hwdec_driver ra_hwdec_cuda_vk = {
+    .name = "cuda-nvdec-vulkan",
+    .api = HWDEC_CUDA,
+    .imgfmts = {IMGFMT_CUDA, 0},
+    .priv_size = sizeof(struct priv_owner),
+    .init = cuda_init,
+    .uninit = cuda_uninit,
+    .mapper = &(const struct ra_hwdec_mapper_driver){
+        .priv_size = sizeof(struct priv),
+        .init = mapper_init,
+        .uninit = mapper_uninit,
+        .map = mapper_map,
+        .unmap = mapper_unmap,
+    },
+};
@@ -1,6 +1,7 @@
 #include "malloc.h"
 #include "utils.h"
 #include "osdep/timer.h"
+#include "video/out/vo.h"
 
 // Controls the multiplication factor for new slab allocations. The new slab
 // will always be allocated such that the size of the slab is this factor times
@@ -22,6 +23,11 @@
 // map with lots of small buffers during uninit. (Default: 1 KB)
 #define MPVK_HEAP_MINIMUM_REGION_SIZE (1 << 10)
 
+// Controls how long a slab must have been completely unused before it's
+// released by vk_malloc_garbage_collect(). This avoids freeing and
+// reallocating slabs all the time if usage fluctuates. (Default: 10 s)
+#define MPVK_HEAP_SLAB_IDLE_TIME (10 * 1000 * 1000)
+
 // Represents a region of available memory
 struct vk_region {
     size_t start; // first offset in region
@@ -41,6 +47,7 @@ struct vk_slab {
     size_t size;          // total size of `slab`
     size_t used;          // number of bytes actually in use (for GC accounting)
     bool dedicated;       // slab is allocated specifically for one object
+    int64_t idle_since;   // time at which `used` dropped to 0 (mp_time_us)
     // free space map: a sorted list of memory regions that are available
     struct vk_region *regions;
     int num_regions;
@@ -67,6 +74,7 @@ struct vk_malloc {
     VkPhysicalDeviceMemoryProperties props;
     struct vk_heap *heaps;
     int num_heaps;
+    uint64_t released; // total size of slabs freed by garbage collection
 };
 
 static void slab_free(struct mpvk_ctx *vk, struct vk_slab *slab)
@@ -140,6 +148,14 @@ static struct vk_slab *slab_alloc(struct mpvk_ctx *vk, struct vk_heap *heap,
             .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
         };
 
+        // Buffers may be used for uploads on the transfer queue
+        int num_qfs = mpvk_num_pool_qfs(vk);
+        if (num_qfs > 1) {
+            binfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            binfo.queueFamilyIndexCount = num_qfs;
+            binfo.pQueueFamilyIndices = vk->pool_qfs;
+        }
+
         VK(vkCreateBuffer(vk->dev, &binfo, MPVK_ALLOCATOR, &slab->buffer));
 
         VkMemoryRequirements reqs;
@@ -269,6 +285,13 @@ void vk_free_memslice(struct mpvk_ctx *vk, struct vk_memslice slice)
         // If the slab was purpose-allocated for this memslice, we can just
         // free it here
         slab_free(vk, slab);
+    } else if (slab->used == 0) {
+        // Reset the free space map. This also recovers regions that were too
+        // small to be tracked.
+        slab->num_regions = 0;
+        MP_TARRAY_APPEND(slab, slab->regions, slab->num_regions,
+                         (struct vk_region) { 0, slab->size });
+        slab->idle_since = mp_time_us();
     } else {
         // Return the allocation to the free space map
         insert_region(slab, (struct vk_region) {
@@ -278,6 +301,47 @@ void vk_free_memslice(struct mpvk_ctx *vk, struct vk_memslice slice)
     }
 }
 
+void vk_malloc_garbage_collect(struct mpvk_ctx *vk)
+{
+    struct vk_malloc *ma = vk->alloc;
+    int64_t now = mp_time_us();
+
+    for (int i = 0; i < ma->num_heaps; i++) {
+        struct vk_heap *heap = &ma->heaps[i];
+        for (int n = heap->num_slabs - 1; n >= 0; n--) {
+            struct vk_slab *slab = heap->slabs[n];
+            if (slab->used || now - slab->idle_since < MPVK_HEAP_SLAB_IDLE_TIME)
+                continue;
+
+            MP_VERBOSE(vk, "Releasing unused slab of size %zu.\n", slab->size);
+            ma->released += slab->size;
+            MP_TARRAY_REMOVE_AT(heap->slabs, heap->num_slabs, n);
+            slab_free(vk, slab);
+        }
+    }
+}
+
+void vk_malloc_stats(struct mpvk_ctx *vk, struct mp_gpu_mem_stats *out)
+{
+    struct vk_malloc *ma = vk->alloc;
+    *out = (struct mp_gpu_mem_stats){ .released = ma->released };
+
+    for (int i = 0; i < ma->num_heaps && i < VO_GPU_MEM_HEAPS_MAX; i++) {
+        struct vk_heap *heap = &ma->heaps[i];
+        struct mp_gpu_mem_heap *h = &out->heaps[out->num_heaps++];
+        *h = (struct mp_gpu_mem_heap) {
+            .usage = heap->usage,
+            .flags = heap->flags,
+            .num_slabs = heap->num_slabs,
+        };
+        for (int n = 0; n < heap->num_slabs; n++) {
+            h->size += heap->slabs[n]->size;
+            h->used += heap->slabs[n]->used;
+            h->num_regions += heap->slabs[n]->num_regions;
+        }
+    }
+}
+
 // reqs: can be NULL
 static struct vk_heap *find_heap(struct mpvk_ctx *vk, VkBufferUsageFlags usage,
                                  VkMemoryPropertyFlags flags,
@@ -324,6 +388,8 @@ static bool heap_get_region(struct mpvk_ctx *vk, struct vk_heap *heap,
     // with the heap
     if (size > MPVK_HEAP_MAXIMUM_SLAB_SIZE) {
         slab = slab_alloc(vk, heap, size);
+        if (slab)
+            slab->dedicated = true;
         *out_slab = slab;
         *out_index = 0;
         return !!slab;
@@ -5,6 +5,13 @@
 void vk_malloc_init(struct mpvk_ctx *vk);
 void vk_malloc_uninit(struct mpvk_ctx *vk);
 
+// Release slabs that have been unused for a while. Should be called
+// periodically, e.g. once per frame.
+void vk_malloc_garbage_collect(struct mpvk_ctx *vk);
+
+struct mp_gpu_mem_stats;
+void vk_malloc_stats(struct mpvk_ctx *vk, struct mp_gpu_mem_stats *out);
+
 // Represents a single "slice" of generic (non-buffer) memory, plus some
 // metadata for accounting. This struct is essentially read-only.
 struct vk_memslice {
@@ -1,3 +1,7 @@
+#include <fcntl.h>
+#include <inttypes.h>
+#include <unistd.h>
+
 #include "video/out/gpu/utils.h"
 #include "video/out/gpu/spirv.h"
 
@@ -11,6 +15,11 @@ struct ra_vk {
     struct mpvk_ctx *vk;
     struct ra_tex *clear_tex; // stupid hack for clear()
     struct vk_cmd *cmd;       // currently recording cmd
+    // For async transfers: signalled by the last graphics command, so that
+    // the next transfer command can wait on it (see vk_flush)
+    VkSemaphore gfx_sems[2];
+    int gfx_sem_idx;
+    bool gfx_sem_pending;
 };
 
 struct mpvk_ctx *ra_vk_get(struct ra *ra)
@@ -22,18 +31,6 @@ struct mpvk_ctx *ra_vk_get(struct ra *ra)
     return p->vk;
 }
 
-// Returns a command buffer, or NULL on error
-static struct vk_cmd *vk_require_cmd(struct ra *ra)
-{
-    struct ra_vk *p = ra->priv;
-    struct mpvk_ctx *vk = ra_vk_get(ra);
-
-    if (!p->cmd)
-        p->cmd = vk_cmd_begin(vk, vk->pool);
-
-    return p->cmd;
-}
-
 // Note: This technically follows the flush() API, but we don't need
 // to expose that (and in fact, it's a bad idea) since we control flushing
 // behavior with ra_vk_present_frame already.
@@ -43,6 +40,20 @@ static bool vk_flush(struct ra *ra, VkSemaphore *done)
     struct mpvk_ctx *vk = ra_vk_get(ra);
 
     if (p->cmd) {
+        if (p->cmd->pool == vk->pool && vk->pool_transfer) {
+            // Uploads must not overwrite textures that are still being used
+            // by previous graphics commands. The semaphore chain also ensures
+            // that a transfer command completes after all graphics commands
+            // submitted before it, which the lazy destructors rely on.
+            if (p->gfx_sem_pending) {
+                vk_cmd_dep(p->cmd, p->gfx_sems[p->gfx_sem_idx],
+                           VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+            }
+            p->gfx_sem_idx = !p->gfx_sem_idx;
+            vk_cmd_sig(p->cmd, p->gfx_sems[p->gfx_sem_idx]);
+            p->gfx_sem_pending = true;
+        }
+
         if (!vk_cmd_submit(vk, p->cmd, done))
             return false;
         p->cmd = NULL;
@@ -51,6 +62,45 @@ static bool vk_flush(struct ra *ra, VkSemaphore *done)
     return true;
 }
 
+// Returns a command buffer for the given pool, or NULL on error. If the
+// currently recording command belongs to a different pool, it's submitted,
+// and the new command waits for it.
+static struct vk_cmd *vk_require_cmd_pool(struct ra *ra,
+                                          struct vk_cmdpool *pool)
+{
+    struct ra_vk *p = ra->priv;
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+
+    VkSemaphore done = NULL;
+    if (p->cmd && p->cmd->pool != pool) {
+        // (Waiting for graphics commands is handled by vk_flush.)
+        bool from_gfx = p->cmd->pool == vk->pool;
+        if (!vk_flush(ra, from_gfx ? NULL : &done))
+            return NULL;
+    }
+
+    if (!p->cmd) {
+        p->cmd = vk_cmd_begin(vk, pool);
+        if (!p->cmd)
+            return NULL;
+        if (done)
+            vk_cmd_dep(p->cmd, done, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+        if (pool == vk->pool_transfer && p->gfx_sem_pending) {
+            vk_cmd_dep(p->cmd, p->gfx_sems[p->gfx_sem_idx],
+                       VK_PIPELINE_STAGE_TRANSFER_BIT);
+            p->gfx_sem_pending = false;
+        }
+    }
+
+    return p->cmd;
+}
+
+// Returns a graphics command buffer, or NULL on error
+static struct vk_cmd *vk_require_cmd(struct ra *ra)
+{
+    return vk_require_cmd_pool(ra, ra_vk_get(ra)->pool);
+}
+
 // The callback's *priv will always be set to `ra`
 static void vk_callback(struct ra *ra, vk_cb callback, void *arg)
 {
@@ -77,6 +127,8 @@ static void vk_destroy_ra(struct ra *ra)
     vk_flush(ra, NULL);
     mpvk_dev_wait_idle(vk);
     ra_tex_free(ra, &p->clear_tex);
+    for (int i = 0; i < 2; i++)
+        vkDestroySemaphore(vk->dev, p->gfx_sems[i], MPVK_ALLOCATOR);
 
     talloc_free(ra);
 }
@@ -198,12 +250,26 @@ struct ra *ra_create_vk(struct mpvk_ctx *vk, struct mp_log *log)
     if (vk->pool->props.queueFlags & VK_QUEUE_COMPUTE_BIT)
         ra->caps |= RA_CAP_COMPUTE;
 
+    if (vk->pool_transfer) {
+        static const VkSemaphoreCreateInfo seminfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        };
+        for (int i = 0; i < 2; i++) {
+            VK(vkCreateSemaphore(vk->dev, &seminfo, MPVK_ALLOCATOR,
+                                 &p->gfx_sems[i]));
+        }
+    }
+
     if (!vk_setup_formats(ra))
         goto error;
 
     // UBO support is required
     ra->caps |= RA_CAP_BUF_RO | RA_CAP_FRAGCOORD;
 
+    // vk_renderpass_create only creates device objects (which requires no
+    // external synchronization) and calls the thread-safe SPIR-V compiler
+    ra->caps |= RA_CAP_PARALLEL_COMPILE;
+
     // textureGather is only supported in GLSL 400+
     if (ra->glsl_version >= 400)
         ra->caps |= RA_CAP_GATHER;
@@ -286,6 +352,9 @@ struct ra_tex_vk {
     VkImageType type;
     VkImage img;
     struct vk_memslice mem;
+    // for imported DMABUFs (owned by the texture)
+    VkDeviceMemory ext_mem;
+    bool ext_acquire; // ownership must still be acquired from the external QF
     // for sampling
     VkImageView view;
     VkSampler sampler;
@@ -323,7 +392,16 @@ static void tex_barrier(struct vk_cmd *cmd, struct ra_tex_vk *tex_vk,
         imgBarrier.srcAccessMask = 0;
     }
 
-    if (imgBarrier.oldLayout != imgBarrier.newLayout ||
+    // Imported images were last written by a foreign user (e.g. a hardware
+    // decoder), so the first use needs to acquire them from there.
+    bool acquire = tex_vk->ext_acquire;
+    if (acquire) {
+        imgBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_EXTERNAL_KHR;
+        imgBarrier.dstQueueFamilyIndex = cmd->pool->qf;
+        tex_vk->ext_acquire = false;
+    }
+
+    if (acquire || imgBarrier.oldLayout != imgBarrier.newLayout ||
         imgBarrier.srcAccessMask != imgBarrier.dstAccessMask)
     {
         vkCmdPipelineBarrier(cmd->buf, tex_vk->current_stage, newStage, 0,
@@ -351,6 +429,7 @@ static void vk_tex_destroy(struct ra *ra, struct ra_tex *tex)
     if (!tex_vk->external_img) {
         vkDestroyImage(vk->dev, tex_vk->img, MPVK_ALLOCATOR);
         vk_free_memslice(vk, tex_vk->mem);
+        vkFreeMemory(vk->dev, tex_vk->ext_mem, MPVK_ALLOCATOR);
     }
 
     talloc_free(tex);
@@ -514,6 +593,13 @@ static struct ra_tex *vk_tex_create(struct ra *ra,
         .pQueueFamilyIndices = &vk->pool->qf,
     };
 
+    // Uploads may happen on the transfer queue
+    if (params->host_mutable && mpvk_num_pool_qfs(vk) > 1) {
+        iinfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        iinfo.queueFamilyIndexCount = mpvk_num_pool_qfs(vk);
+        iinfo.pQueueFamilyIndices = vk->pool_qfs;
+    }
+
     VK(vkCreateImage(vk->dev, &iinfo, MPVK_ALLOCATOR, &tex_vk->img));
 
     VkMemoryPropertyFlags memFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
@@ -597,9 +683,187 @@ error:
     return NULL;
 }
 
+struct ra_tex *ra_vk_wrap_dmabuf(struct ra *ra,
+                                 const struct ra_tex_params *params,
+                                 const struct ra_vk_dmabuf *buf)
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    struct ra_tex *tex = NULL;
+    int fd = -1;
+
+    if (!vk->has_ext_dmabuf || params->dimensions != 2 ||
+        params->render_dst || params->storage_dst || params->host_mutable ||
+        params->blit_dst)
+        return NULL;
+
+    bool explicit_modifier = false;
+#ifdef VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME
+    explicit_modifier = vk->has_ext_drm_modifier;
+#endif
+    // Without the modifier extension, only linear buffers can be described.
+    if (!explicit_modifier && buf->modifier != 0) {
+        MP_VERBOSE(ra, "Can't import DMABUF with modifier 0x%"PRIx64"\n",
+                   buf->modifier);
+        return NULL;
+    }
+
+    tex = talloc_zero(NULL, struct ra_tex);
+    tex->params = *params;
+    tex->params.initial_data = NULL;
+
+    struct ra_tex_vk *tex_vk = tex->priv = talloc_zero(tex, struct ra_tex_vk);
+    tex_vk->type = VK_IMAGE_TYPE_2D;
+
+    const struct vk_format *fmt = params->format->priv;
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (params->blit_src)
+        usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+    VkExternalMemoryImageCreateInfoKHR ext_info = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO_KHR,
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+    };
+
+    VkImageCreateInfo iinfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = &ext_info,
+        .imageType = tex_vk->type,
+        .format = fmt->iformat,
+        .extent = (VkExtent3D) { params->w, params->h, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_LINEAR,
+        .usage = usage,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &vk->pool->qf,
+    };
+
+    // With an explicit modifier, the plane offset is part of the layout and
+    // the memory is bound at 0. Otherwise, the image is bound at the offset.
+    VkDeviceSize bind_offset = buf->offset;
+#ifdef VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME
+    VkSubresourceLayout plane_layout = {
+        .offset = buf->offset,
+        .rowPitch = buf->pitch,
+    };
+    VkImageDrmFormatModifierExplicitCreateInfoEXT mod_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_EXPLICIT_CREATE_INFO_EXT,
+        .drmFormatModifier = buf->modifier,
+        .drmFormatModifierPlaneCount = 1,
+        .pPlaneLayouts = &plane_layout,
+    };
+    if (explicit_modifier) {
+        ext_info.pNext = &mod_info;
+        iinfo.tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT;
+        bind_offset = 0;
+    }
+#endif
+
+    if (!explicit_modifier) {
+        VkFormatProperties prop;
+        vkGetPhysicalDeviceFormatProperties(vk->physd, fmt->iformat, &prop);
+        VkFormatFeatureFlags flags = prop.linearTilingFeatures;
+        if (!(flags & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) ||
+            (params->src_linear &&
+             !(flags & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) ||
+            (params->blit_src && !(flags & VK_FORMAT_FEATURE_BLIT_SRC_BIT)))
+            goto error;
+    }
+
+    VK(vkCreateImage(vk->dev, &iinfo, MPVK_ALLOCATOR, &tex_vk->img));
+
+    if (!explicit_modifier) {
+        // The driver picks the layout of linear images, so it must match
+        // the one of the imported buffer.
+        VkImageSubresource sub = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT };
+        VkSubresourceLayout layout;
+        vkGetImageSubresourceLayout(vk->dev, tex_vk->img, &sub, &layout);
+        if (layout.offset != 0 || layout.rowPitch != buf->pitch) {
+            MP_VERBOSE(ra, "DMABUF pitch %zu does not match linear image "
+                       "pitch %zu\n", (size_t)buf->pitch,
+                       (size_t)layout.rowPitch);
+            goto error;
+        }
+    }
+
+    VkMemoryRequirements reqs;
+    vkGetImageMemoryRequirements(vk->dev, tex_vk->img, &reqs);
+    if (bind_offset % reqs.alignment || bind_offset + reqs.size > buf->size) {
+        MP_VERBOSE(ra, "DMABUF plane does not satisfy memory requirements\n");
+        goto error;
+    }
+
+    PFN_vkGetMemoryFdPropertiesKHR pfn_vkGetMemoryFdPropertiesKHR =
+        (PFN_vkGetMemoryFdPropertiesKHR)
+            vkGetDeviceProcAddr(vk->dev, "vkGetMemoryFdPropertiesKHR");
+    if (!pfn_vkGetMemoryFdPropertiesKHR)
+        goto error;
+
+    VkMemoryFdPropertiesKHR fd_props = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_FD_PROPERTIES_KHR,
+    };
+    VK(pfn_vkGetMemoryFdPropertiesKHR(vk->dev,
+            VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT, buf->fd, &fd_props));
+
+    uint32_t types = reqs.memoryTypeBits & fd_props.memoryTypeBits;
+    int mem_type = -1;
+    for (int i = 0; i < 32; i++) {
+        if (types & (1u << i)) {
+            mem_type = i;
+            break;
+        }
+    }
+    if (mem_type < 0) {
+        MP_VERBOSE(ra, "No compatible memory type for DMABUF import\n");
+        goto error;
+    }
+
+    // A successful import takes over the fd, so import a duplicate.
+    fd = fcntl(buf->fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0)
+        goto error;
+
+    VkImportMemoryFdInfoKHR import_info = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR,
+        .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+        .fd = fd,
+    };
+    VkMemoryAllocateInfo ainfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &import_info,
+        .allocationSize = buf->size,
+        .memoryTypeIndex = mem_type,
+    };
+    VK(vkAllocateMemory(vk->dev, &ainfo, MPVK_ALLOCATOR, &tex_vk->ext_mem));
+    fd = -1;
+
+    VK(vkBindImageMemory(vk->dev, tex_vk->img, tex_vk->ext_mem, bind_offset));
+
+    if (!vk_init_image(ra, tex))
+        goto error;
+
+    // Preserve the imported contents. Sampling it before the producer is
+    // done writing is prevented by the DMABUF's implicit fences.
+    tex_vk->current_layout = VK_IMAGE_LAYOUT_GENERAL;
+    tex_vk->ext_acquire = true;
+
+    return tex;
+
+error:
+    if (fd >= 0)
+        close(fd);
+    vk_tex_destroy(ra, tex);
+    return NULL;
+}
+
 // For ra_buf.priv
 struct ra_buf_vk {
     struct vk_bufslice slice;
+    VkDeviceMemory ext_mem; // dedicated exported memory (owns slice.buf)
     int refcount; // 1 = object allocated but not in use, > 1 = in use
     bool needsflush;
     // "current" metadata, can change during course of execution
@@ -616,7 +880,12 @@ static void vk_buf_deref(struct ra *ra, struct ra_buf *buf)
     struct ra_buf_vk *buf_vk = buf->priv;
 
     if (--buf_vk->refcount == 0) {
-        vk_free_memslice(vk, buf_vk->slice.mem);
+        if (buf_vk->ext_mem) {
+            vkDestroyBuffer(vk->dev, buf_vk->slice.buf, MPVK_ALLOCATOR);
+            vkFreeMemory(vk->dev, buf_vk->ext_mem, MPVK_ALLOCATOR);
+        } else {
+            vk_free_memslice(vk, buf_vk->slice.mem);
+        }
         talloc_free(buf);
     }
 }
@@ -755,6 +1024,107 @@ error:
     return NULL;
 }
 
+struct ra_buf *ra_vk_create_external_buf(struct ra *ra, size_t size,
+                                         struct ra_vk_external_buf *out)
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    int fd = -1;
+
+    if (!vk->has_ext_memory_fd)
+        return NULL;
+
+    PFN_vkGetMemoryFdKHR pfn_vkGetMemoryFdKHR = (PFN_vkGetMemoryFdKHR)
+        vkGetDeviceProcAddr(vk->dev, "vkGetMemoryFdKHR");
+    if (!pfn_vkGetMemoryFdKHR)
+        return NULL;
+
+    struct ra_buf *buf = talloc_zero(NULL, struct ra_buf);
+    buf->params = (struct ra_buf_params) {
+        .type = RA_BUF_TYPE_TEX_UPLOAD,
+        .size = size,
+    };
+
+    struct ra_buf_vk *buf_vk = buf->priv = talloc_zero(buf, struct ra_buf_vk);
+    buf_vk->current_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    buf_vk->current_access = 0;
+    buf_vk->refcount = 1;
+
+    VkExternalMemoryBufferCreateInfoKHR ext_info = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO_KHR,
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT_KHR,
+    };
+    VkBufferCreateInfo binfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = &ext_info,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+
+    // Buffers may be used for uploads on the transfer queue
+    int num_qfs = mpvk_num_pool_qfs(vk);
+    if (num_qfs > 1) {
+        binfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        binfo.queueFamilyIndexCount = num_qfs;
+        binfo.pQueueFamilyIndices = vk->pool_qfs;
+    }
+
+    VK(vkCreateBuffer(vk->dev, &binfo, MPVK_ALLOCATOR, &buf_vk->slice.buf));
+
+    VkMemoryRequirements reqs;
+    vkGetBufferMemoryRequirements(vk->dev, buf_vk->slice.buf, &reqs);
+
+    VkPhysicalDeviceMemoryProperties props;
+    vkGetPhysicalDeviceMemoryProperties(vk->physd, &props);
+    int mem_type = -1;
+    for (int i = 0; i < props.memoryTypeCount; i++) {
+        if ((reqs.memoryTypeBits & (1u << i)) &&
+            (props.memoryTypes[i].propertyFlags &
+             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+        {
+            mem_type = i;
+            break;
+        }
+    }
+    if (mem_type < 0)
+        goto error;
+
+    VkExportMemoryAllocateInfoKHR export_info = {
+        .sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO_KHR,
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT_KHR,
+    };
+    VkMemoryAllocateInfo ainfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &export_info,
+        .allocationSize = reqs.size,
+        .memoryTypeIndex = mem_type,
+    };
+    VK(vkAllocateMemory(vk->dev, &ainfo, MPVK_ALLOCATOR, &buf_vk->ext_mem));
+    VK(vkBindBufferMemory(vk->dev, buf_vk->slice.buf, buf_vk->ext_mem, 0));
+
+    VkMemoryGetFdInfoKHR fd_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR,
+        .memory = buf_vk->ext_mem,
+        .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT_KHR,
+    };
+    VK(pfn_vkGetMemoryFdKHR(vk->dev, &fd_info, &fd));
+
+    buf_vk->slice.mem = (struct vk_memslice) {
+        .vkmem = buf_vk->ext_mem,
+        .size = reqs.size,
+    };
+
+    *out = (struct ra_vk_external_buf) {
+        .fd = fd,
+        .mem_size = reqs.size,
+    };
+    return buf;
+
+error:
+    vk_buf_deref(ra, buf);
+    return NULL;
+}
+
 static bool vk_buf_poll(struct ra *ra, struct ra_buf *buf)
 {
     struct ra_buf_vk *buf_vk = buf->priv;
@@ -802,7 +1172,20 @@ static bool vk_tex_upload(struct ra *ra,
     uint64_t size = region.bufferRowLength * region.bufferImageHeight *
                     region.imageExtent.depth;
 
-    struct vk_cmd *cmd = vk_require_cmd(ra);
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    struct vk_cmdpool *pool = vk->pool;
+    if (vk->pool_transfer && tex->params.host_mutable) {
+        pool = vk->pool_transfer;
+        // Synchronization with previous uses on the graphics queue is done by
+        // semaphores, and the graphics pipeline stages in the current state
+        // are not valid on a transfer queue. So only transition the layout.
+        tex_vk->current_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        tex_vk->current_access = 0;
+        buf_vk->current_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        buf_vk->current_access = 0;
+    }
+
+    struct vk_cmd *cmd = vk_require_cmd_pool(ra, pool);
     if (!cmd)
         goto error;
 
@@ -1007,7 +1390,7 @@ static struct ra_renderpass *vk_renderpass_create(struct ra *ra,
     VkShaderModule frag_shader = NULL;
     VkShaderModule comp_shader = NULL;
 
-    static int dsCount[RA_VARTYPE_COUNT] = {0};
+    int dsCount[RA_VARTYPE_COUNT] = {0};
     VkDescriptorSetLayoutBinding *bindings = NULL;
     int num_bindings = 0;
 
@@ -1686,6 +2069,16 @@ static uint64_t vk_timer_stop(struct ra *ra, ra_timer *ratimer)
     return timer->result;
 }
 
+static void vk_mem_stats(struct ra *ra, struct mp_gpu_mem_stats *out)
+{
+    vk_malloc_stats(ra_vk_get(ra), out);
+}
+
+static void vk_flush_ra(struct ra *ra)
+{
+    vk_flush(ra, NULL);
+}
+
 static struct ra_fns ra_fns_vk = {
     .destroy                = vk_destroy_ra,
     .tex_create             = vk_tex_create,
@@ -1707,6 +2100,8 @@ static struct ra_fns ra_fns_vk = {
     .timer_destroy          = vk_timer_destroy_lazy,
     .timer_start            = vk_timer_start,
     .timer_stop             = vk_timer_stop,
+    .mem_stats              = vk_mem_stats,
+    .flush                  = vk_flush_ra,
 };
 
 static void present_cb(void *priv, int *inflight)
@@ -1740,7 +2135,9 @@ bool ra_vk_submit(struct ra *ra, struct ra_tex *tex, VkSemaphore acquired,
                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
                VK_PIPELINE_STAGE_TRANSFER_BIT);
 
-    return vk_flush(ra, done);
+    bool ok = vk_flush(ra, done);
+    vk_malloc_garbage_collect(ra_vk_get(ra));
+    return ok;
 
 error:
     return false;
@@ -16,6 +16,38 @@ VkDevice ra_vk_get_dev(struct ra *ra);
 struct ra_tex *ra_vk_wrap_swapchain_img(struct ra *ra, VkImage vkimg,
                                         VkSwapchainCreateInfoKHR info);
 
+// Describes a single plane of a DMABUF to import with ra_vk_wrap_dmabuf.
+struct ra_vk_dmabuf {
+    int fd;             // not taken over (a duplicate is imported)
+    size_t size;        // total size of the DMABUF object
+    size_t offset;      // start of the plane within the object
+    size_t pitch;       // bytes per row of the plane
+    uint64_t modifier;  // DRM format modifier (0 is linear)
+};
+
+// Allocates a ra_tex that samples from an imported DMABUF, without copying.
+// Only 2D textures usable as render_src/blit_src are supported. The first use
+// acquires the image from the external producer; synchronization with it
+// relies on the implicit fences of the DMABUF. Returns NULL if the buffer
+// can't be imported by this device.
+struct ra_tex *ra_vk_wrap_dmabuf(struct ra *ra,
+                                 const struct ra_tex_params *params,
+                                 const struct ra_vk_dmabuf *buf);
+
+// Memory of a buffer created with ra_vk_create_external_buf.
+struct ra_vk_external_buf {
+    int fd;             // opaque fd of the memory, owned by the caller
+    size_t mem_size;    // size of the memory object (can exceed the buffer)
+};
+
+// Creates a device-local RA_BUF_TYPE_TEX_UPLOAD buffer whose memory is
+// exported as an opaque fd, so another API (e.g. CUDA) can write into it.
+// The buffer can then be used with tex_upload to copy it into a texture on
+// the GPU. The writer must have finished before the upload is submitted, and
+// must not touch the buffer again until ra_buf_poll() returns true.
+struct ra_buf *ra_vk_create_external_buf(struct ra *ra, size_t size,
+                                         struct ra_vk_external_buf *out);
+
 // This function flushes the command buffers, transitions `tex` (which must be
 // a wrapped swapchain image) into a format suitable for presentation, and
 // submits the current rendering commands. The indicated semaphore must fire
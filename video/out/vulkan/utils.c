@@ -150,6 +150,7 @@ void mpvk_uninit(struct mpvk_ctx *vk)
 
     if (vk->dev) {
         vk_cmdpool_uninit(vk, vk->pool);
+        vk_cmdpool_uninit(vk, vk->pool_transfer);
         vk_malloc_uninit(vk);
         vkDestroyDevice(vk->dev, MPVK_ALLOCATOR);
     }
@@ -190,29 +191,50 @@ bool mpvk_instance_init(struct mpvk_ctx *vk, struct mp_log *log,
     }
 
     // Enable whatever extensions were compiled in.
-    const char *extensions[] = {
-        VK_KHR_SURFACE_EXTENSION_NAME,
-        surf_ext_name,
-
-        // Extra extensions only used for debugging. These are toggled by
-        // decreasing the enabledExtensionCount, so the number needs to be
-        // synchronized with the code below.
-        VK_EXT_DEBUG_REPORT_EXTENSION_NAME,
+    void *tmp = talloc_new(NULL);
+    const char **extensions = NULL;
+    int num_extensions = 0;
+    MP_TARRAY_APPEND(tmp, extensions, num_extensions,
+                     VK_KHR_SURFACE_EXTENSION_NAME);
+    MP_TARRAY_APPEND(tmp, extensions, num_extensions, surf_ext_name);
+
+    // Extra extensions only used for debugging
+    if (debug) {
+        MP_TARRAY_APPEND(tmp, extensions, num_extensions,
+                         VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+    }
+
+    // Optional extensions, needed for importing external memory (hwdec
+    // interop). Only enabled if the loader supports them.
+    static const char *const opt_extensions[] = {
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+        VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME,
     };
 
-    const int debugExtensionCount = 1;
+    uint32_t num_props = 0;
+    vkEnumerateInstanceExtensionProperties(NULL, &num_props, NULL);
+    VkExtensionProperties *props =
+        talloc_array(tmp, VkExtensionProperties, num_props);
+    vkEnumerateInstanceExtensionProperties(NULL, &num_props, props);
+    for (int i = 0; i < MP_ARRAY_SIZE(opt_extensions); i++) {
+        for (int n = 0; n < num_props; n++) {
+            if (strcmp(props[n].extensionName, opt_extensions[i]) == 0) {
+                MP_TARRAY_APPEND(tmp, extensions, num_extensions,
+                                 opt_extensions[i]);
+                break;
+            }
+        }
+    }
 
     info.ppEnabledExtensionNames = extensions;
-    info.enabledExtensionCount = MP_ARRAY_SIZE(extensions);
-
-    if (!debug)
-        info.enabledExtensionCount -= debugExtensionCount;
+    info.enabledExtensionCount = num_extensions;
 
     MP_VERBOSE(vk, "Creating instance with extensions:\n");
     for (int i = 0; i < info.enabledExtensionCount; i++)
         MP_VERBOSE(vk, "    %s\n", info.ppEnabledExtensionNames[i]);
 
     VkResult res = vkCreateInstance(&info, MPVK_ALLOCATOR, &vk->inst);
+    talloc_free(tmp);
     if (res != VK_SUCCESS) {
         MP_VERBOSE(vk, "Failed creating instance: %s\n", vk_err(res));
         return false;
@@ -442,6 +464,34 @@ error:
     return false;
 }
 
+bool mpvk_get_device_uuid(struct mpvk_ctx *vk, uint8_t uuid[VK_UUID_SIZE])
+{
+    VK_LOAD_PFN(vkGetPhysicalDeviceProperties2KHR)
+    if (!pfn_vkGetPhysicalDeviceProperties2KHR)
+        return false;
+
+    VkPhysicalDeviceIDPropertiesKHR id_props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES_KHR,
+    };
+    VkPhysicalDeviceProperties2KHR props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR,
+        .pNext = &id_props,
+    };
+    pfn_vkGetPhysicalDeviceProperties2KHR(vk->physd, &props);
+    memcpy(uuid, id_props.deviceUUID, VK_UUID_SIZE);
+    return true;
+}
+
+static bool device_has_ext(VkExtensionProperties *props, int num_props,
+                           const char *name)
+{
+    for (int n = 0; n < num_props; n++) {
+        if (strcmp(props[n].extensionName, name) == 0)
+            return true;
+    }
+    return false;
+}
+
 bool mpvk_device_init(struct mpvk_ctx *vk, struct mpvk_device_opts opts)
 {
     assert(vk->physd);
@@ -483,6 +533,26 @@ bool mpvk_device_init(struct mpvk_ctx *vk, struct mpvk_device_opts opts)
     // is horribly wrong.
     assert(idx >= 0);
 
+    // Optionally use a dedicated transfer queue family for uploads. This is
+    // typically a DMA engine on discrete GPUs, which can run in parallel with
+    // rendering. Families with a coarse image transfer granularity can't be
+    // used for arbitrary sub-rectangle uploads, so skip them.
+    int tidx = -1;
+    for (int i = 0; opts.async_transfer && i < qfnum; i++) {
+        VkQueueFlags flags = qfs[i].queueFlags;
+        VkExtent3D gran = qfs[i].minImageTransferGranularity;
+        if (!(flags & VK_QUEUE_TRANSFER_BIT) ||
+            (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+            continue;
+        if (gran.width != 1 || gran.height != 1 || gran.depth != 1)
+            continue;
+        tidx = i;
+        break;
+    }
+
+    if (tidx >= 0)
+        MP_VERBOSE(vk, "Using QF %d for async transfers.\n", tidx);
+
     // Ensure we can actually present to the surface using this queue
     VkBool32 sup;
     VK(vkGetPhysicalDeviceSurfaceSupportKHR(vk->physd, idx, vk->surf, &sup));
@@ -495,12 +565,17 @@ bool mpvk_device_init(struct mpvk_ctx *vk, struct mpvk_device_opts opts)
     // device
     assert(opts.queue_count <= MPVK_MAX_QUEUES);
     static const float priorities[MPVK_MAX_QUEUES] = {0};
-    VkDeviceQueueCreateInfo qinfo = {
+    VkDeviceQueueCreateInfo qinfos[2] = {{
         .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
         .queueFamilyIndex = idx,
         .queueCount = MPMIN(qfs[idx].queueCount, opts.queue_count),
         .pQueuePriorities = priorities,
-    };
+    }, {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = tidx,
+        .queueCount = 1,
+        .pQueuePriorities = priorities,
+    }};
 
     const char **exts = NULL;
     int num_exts = 0;
@@ -508,10 +583,59 @@ bool mpvk_device_init(struct mpvk_ctx *vk, struct mpvk_device_opts opts)
     if (vk->spirv->required_ext)
         MP_TARRAY_APPEND(tmp, exts, num_exts, vk->spirv->required_ext);
 
+    // Importing DMABUFs (e.g. VAAPI surfaces) is optional
+    uint32_t num_props = 0;
+    vkEnumerateDeviceExtensionProperties(vk->physd, NULL, &num_props, NULL);
+    VkExtensionProperties *props =
+        talloc_array(tmp, VkExtensionProperties, num_props);
+    vkEnumerateDeviceExtensionProperties(vk->physd, NULL, &num_props, props);
+
+    // Sharing memory with other APIs (e.g. CUDA) is optional as well
+    static const char *const memfd_exts[] = {
+        VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME,
+        VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
+    };
+    vk->has_ext_memory_fd = true;
+    for (int i = 0; i < MP_ARRAY_SIZE(memfd_exts); i++)
+        vk->has_ext_memory_fd &= device_has_ext(props, num_props, memfd_exts[i]);
+    if (vk->has_ext_memory_fd) {
+        for (int i = 0; i < MP_ARRAY_SIZE(memfd_exts); i++)
+            MP_TARRAY_APPEND(tmp, exts, num_exts, memfd_exts[i]);
+    }
+
+    vk->has_ext_dmabuf = vk->has_ext_memory_fd &&
+        device_has_ext(props, num_props,
+                       VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME);
+    if (vk->has_ext_dmabuf) {
+        MP_TARRAY_APPEND(tmp, exts, num_exts,
+                         VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME);
+    }
+
+#ifdef VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME
+    // Needed to import tiled DMABUFs
+    static const char *const modifier_exts[] = {
+        VK_KHR_BIND_MEMORY_2_EXTENSION_NAME,
+        VK_KHR_IMAGE_FORMAT_LIST_EXTENSION_NAME,
+        VK_KHR_MAINTENANCE1_EXTENSION_NAME,
+        VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME,
+        VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME,
+        VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME,
+    };
+    vk->has_ext_drm_modifier = vk->has_ext_dmabuf;
+    for (int i = 0; i < MP_ARRAY_SIZE(modifier_exts); i++) {
+        vk->has_ext_drm_modifier &=
+            device_has_ext(props, num_props, modifier_exts[i]);
+    }
+    if (vk->has_ext_drm_modifier) {
+        for (int i = 0; i < MP_ARRAY_SIZE(modifier_exts); i++)
+            MP_TARRAY_APPEND(tmp, exts, num_exts, modifier_exts[i]);
+    }
+#endif
+
     VkDeviceCreateInfo dinfo = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .queueCreateInfoCount = 1,
-        .pQueueCreateInfos = &qinfo,
+        .queueCreateInfoCount = tidx >= 0 ? 2 : 1,
+        .pQueueCreateInfos = qinfos,
         .ppEnabledExtensionNames = exts,
         .enabledExtensionCount = num_exts,
     };
@@ -525,8 +649,15 @@ bool mpvk_device_init(struct mpvk_ctx *vk, struct mpvk_device_opts opts)
     vk_malloc_init(vk);
 
     // Create the vk_cmdpools and all required queues / synchronization objects
-    if (!vk_cmdpool_init(vk, qinfo, qfs[idx], &vk->pool))
+    if (!vk_cmdpool_init(vk, qinfos[0], qfs[idx], &vk->pool))
         goto error;
+    vk->pool_qfs[0] = idx;
+
+    if (tidx >= 0) {
+        if (!vk_cmdpool_init(vk, qinfos[1], qfs[tidx], &vk->pool_transfer))
+            goto error;
+        vk->pool_qfs[1] = tidx;
+    }
 
     talloc_free(tmp);
     return true;
@@ -585,6 +716,12 @@ void mpvk_pool_wait_idle(struct mpvk_ctx *vk, struct vk_cmdpool *pool)
 void mpvk_dev_wait_idle(struct mpvk_ctx *vk)
 {
     mpvk_pool_wait_idle(vk, vk->pool);
+    mpvk_pool_wait_idle(vk, vk->pool_transfer);
+}
+
+int mpvk_num_pool_qfs(struct mpvk_ctx *vk)
+{
+    return vk->pool_transfer ? 2 : 1;
 }
 
 void mpvk_pool_poll_cmds(struct mpvk_ctx *vk, struct vk_cmdpool *pool,
@@ -613,6 +750,7 @@ void mpvk_pool_poll_cmds(struct mpvk_ctx *vk, struct vk_cmdpool *pool,
 
 void mpvk_dev_poll_cmds(struct mpvk_ctx *vk, uint32_t timeout)
 {
+    mpvk_pool_poll_cmds(vk, vk->pool_transfer, 0);
     mpvk_pool_poll_cmds(vk, vk->pool, timeout);
 }
 
@@ -644,6 +782,12 @@ void vk_cmd_dep(struct vk_cmd *cmd, VkSemaphore dep,
     cmd->depstages[cmd->num_deps++] = depstage;
 }
 
+void vk_cmd_sig(struct vk_cmd *cmd, VkSemaphore sig)
+{
+    assert(cmd->num_sigs < MPVK_MAX_CMD_DEPS);
+    cmd->sigs[cmd->num_sigs++] = sig;
+}
+
 struct vk_cmd *vk_cmd_begin(struct mpvk_ctx *vk, struct vk_cmdpool *pool)
 {
     // Garbage collect the cmdpool first
@@ -689,12 +833,17 @@ bool vk_cmd_submit(struct mpvk_ctx *vk, struct vk_cmd *cmd, VkSemaphore *done)
         .pWaitDstStageMask = cmd->depstages,
     };
 
+    VkSemaphore sigs[MPVK_MAX_CMD_DEPS + 1];
+    for (int i = 0; i < cmd->num_sigs; i++)
+        sigs[sinfo.signalSemaphoreCount++] = cmd->sigs[i];
+
     if (done) {
-        sinfo.signalSemaphoreCount = 1;
-        sinfo.pSignalSemaphores = &cmd->done;
+        sigs[sinfo.signalSemaphoreCount++] = cmd->done;
         *done = cmd->done;
     }
 
+    sinfo.pSignalSemaphores = sigs;
+
     VK(vkResetFences(vk->dev, 1, &cmd->fence));
     VK(vkQueueSubmit(queue, 1, &sinfo, cmd->fence));
     MP_TRACE(vk, "Submitted command on queue %p (QF %d)\n", (void *)queue,
@@ -703,6 +852,7 @@ bool vk_cmd_submit(struct mpvk_ctx *vk, struct vk_cmd *cmd, VkSemaphore *done)
     for (int i = 0; i < cmd->num_deps; i++)
         cmd->deps[i] = NULL;
     cmd->num_deps = 0;
+    cmd->num_sigs = 0;
 
     vk->last_cmd = cmd;
     return true;
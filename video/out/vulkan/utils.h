@@ -55,15 +55,25 @@ bool mpvk_pick_surface_format(struct mpvk_ctx *vk);
 
 struct mpvk_device_opts {
     int queue_count;    // number of queues to use
+    int async_transfer; // use a dedicated transfer queue if available
 };
 
 // Create a logical device and initialize the vk_cmdpools
 bool mpvk_device_init(struct mpvk_ctx *vk, struct mpvk_device_opts opts);
 
+// Retrieve the UUID of the physical device, which identifies it across APIs.
+// Returns false if the instance does not support querying it.
+bool mpvk_get_device_uuid(struct mpvk_ctx *vk, uint8_t uuid[VK_UUID_SIZE]);
+
 // Wait until all commands submitted to all queues have completed
 void mpvk_pool_wait_idle(struct mpvk_ctx *vk, struct vk_cmdpool *pool);
 void mpvk_dev_wait_idle(struct mpvk_ctx *vk);
 
+// Number of queue families a resource needs to be shared with if it may be
+// accessed by all command pools. If this is larger than 1, such resources
+// must be created with VK_SHARING_MODE_CONCURRENT and vk->pool_qfs.
+int mpvk_num_pool_qfs(struct mpvk_ctx *vk);
+
 // Wait until at least one command submitted to any queue has completed, and
 // process the callbacks. Good for event loops that need to delay until a
 // command completes. Will block at most `timeout` nanoseconds. If used with
@@ -102,6 +112,10 @@ struct vk_cmd {
     VkSemaphore deps[MPVK_MAX_CMD_DEPS];
     VkPipelineStageFlags depstages[MPVK_MAX_CMD_DEPS];
     int num_deps;
+    // Additional semaphores to signal on completion. Same as above, these
+    // are not owned by the vk_cmd.
+    VkSemaphore sigs[MPVK_MAX_CMD_DEPS];
+    int num_sigs;
     // Since VkFences are useless, we have to manually track "callbacks"
     // to fire once the VkFence completes. These are used for multiple purposes,
     // ranging from garbage collection (resource deallocation) to fencing.
@@ -118,6 +132,9 @@ void vk_cmd_callback(struct vk_cmd *cmd, vk_cb callback, void *p, void *arg);
 void vk_cmd_dep(struct vk_cmd *cmd, VkSemaphore dep,
                 VkPipelineStageFlags depstage);
 
+// Signal an additional semaphore once the command completes.
+void vk_cmd_sig(struct vk_cmd *cmd, VkSemaphore sig);
+
 #define MPVK_MAX_QUEUES 8
 #define MPVK_MAX_CMDS 64
 
@@ -16,6 +16,7 @@
  */
 
 #include <poll.h>
+#include <time.h>
 #include <unistd.h>
 #include <linux/input.h>
 #include "common/msg.h"
@@ -35,6 +36,9 @@
 // Generated from server-decoration.xml
 #include "video/out/wayland/srv-decor.h"
 
+// Generated from presentation-time.xml
+#include "video/out/wayland/presentation-time.h"
+
 static void xdg_shell_ping(void *data, struct zxdg_shell_v6 *shell, uint32_t serial)
 {
     zxdg_shell_v6_pong(shell, serial);
@@ -756,6 +760,67 @@ static const struct wl_surface_listener surface_listener = {
     surface_handle_leave,
 };
 
+static void remove_feedback(struct vo_wayland_state *wl,
+                            struct wp_presentation_feedback *fback)
+{
+    for (int n = 0; n < wl->num_feedbacks; n++) {
+        if (wl->feedbacks[n] == fback) {
+            MP_TARRAY_REMOVE_AT(wl->feedbacks, wl->num_feedbacks, n);
+            break;
+        }
+    }
+    wp_presentation_feedback_destroy(fback);
+}
+
+static void feedback_sync_output(void *data, struct wp_presentation_feedback *fback,
+                                 struct wl_output *output)
+{
+}
+
+static void feedback_presented(void *data, struct wp_presentation_feedback *fback,
+                               uint32_t tv_sec_hi, uint32_t tv_sec_lo,
+                               uint32_t tv_nsec, uint32_t refresh,
+                               uint32_t seq_hi, uint32_t seq_lo,
+                               uint32_t flags)
+{
+    struct vo_wayland_state *wl = data;
+
+    // Only the monotonic clock can be mapped to mp_time_us().
+    if (wl->presentation_clock_ok) {
+        int64_t sec = ((uint64_t)tv_sec_hi << 32) | tv_sec_lo;
+        int64_t t = mp_time_us_from_monotonic(sec * 1000000 + tv_nsec / 1000);
+        int64_t msc = ((uint64_t)seq_hi << 32) | seq_lo;
+        vo_report_presentation(wl->vo, t, msc);
+    }
+
+    remove_feedback(wl, fback);
+}
+
+static void feedback_discarded(void *data, struct wp_presentation_feedback *fback)
+{
+    remove_feedback(data, fback);
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+    feedback_sync_output,
+    feedback_presented,
+    feedback_discarded,
+};
+
+static void presentation_handle_clock_id(void *data, struct wp_presentation *pres,
+                                         uint32_t clk_id)
+{
+    struct vo_wayland_state *wl = data;
+    wl->presentation_clock = clk_id;
+    wl->presentation_clock_ok = clk_id == CLOCK_MONOTONIC;
+    if (!wl->presentation_clock_ok)
+        MP_VERBOSE(wl, "Presentation clock is not monotonic, ignoring it.\n");
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+    presentation_handle_clock_id,
+};
+
 static const struct wl_callback_listener frame_listener;
 
 static void frame_callback(void *data, struct wl_callback *callback, uint32_t time)
@@ -767,6 +832,15 @@ static void frame_callback(void *data, struct wl_callback *callback, uint32_t ti
 
     wl->frame_callback = wl_surface_frame(wl->surface);
     wl_callback_add_listener(wl->frame_callback, &frame_listener, wl);
+
+    // Like the frame callback, this applies to the next surface commit (i.e.
+    // the next buffer swap), so each presented frame reports its actual time.
+    if (wl->presentation && wl->presentation_clock_ok) {
+        struct wp_presentation_feedback *fback =
+            wp_presentation_feedback(wl->presentation, wl->surface);
+        wp_presentation_feedback_add_listener(fback, &feedback_listener, wl);
+        MP_TARRAY_APPEND(wl, wl->feedbacks, wl->num_feedbacks, fback);
+    }
 }
 
 static const struct wl_callback_listener frame_listener = {
@@ -827,6 +901,11 @@ static void registry_handle_add(void *data, struct wl_registry *reg, uint32_t id
         wl->idle_inhibit_manager = wl_registry_bind(reg, id, &zwp_idle_inhibit_manager_v1_interface, 1);
     }
 
+    if (!strcmp(interface, wp_presentation_interface.name) && found++) {
+        wl->presentation = wl_registry_bind(reg, id, &wp_presentation_interface, 1);
+        wp_presentation_add_listener(wl->presentation, &presentation_listener, wl);
+    }
+
     if (found > 1)
         MP_VERBOSE(wl, "Registered for protocol %s\n", interface);
 }
@@ -1069,6 +1148,13 @@ void vo_wayland_uninit(struct vo *vo)
     if (wl->idle_inhibit_manager)
         zwp_idle_inhibit_manager_v1_destroy(wl->idle_inhibit_manager);
 
+    for (int n = 0; n < wl->num_feedbacks; n++)
+        wp_presentation_feedback_destroy(wl->feedbacks[n]);
+    wl->num_feedbacks = 0;
+
+    if (wl->presentation)
+        wp_presentation_destroy(wl->presentation);
+
     if (wl->shell)
         zxdg_shell_v6_destroy(wl->shell);
 
@@ -77,6 +77,13 @@ struct vo_wayland_state {
     struct zwp_idle_inhibit_manager_v1 *idle_inhibit_manager;
     struct zwp_idle_inhibitor_v1 *idle_inhibitor;
 
+    /* Presentation feedback */
+    struct wp_presentation *presentation;
+    uint32_t presentation_clock;
+    bool presentation_clock_ok;
+    struct wp_presentation_feedback **feedbacks;
+    int num_feedbacks;
+
     /* Input */
     struct wl_seat     *seat;
     struct wl_pointer  *pointer;
@@ -16,10 +16,12 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
 #include <libavutil/opt.h>
 
 #include "config.h"
@@ -33,6 +35,7 @@
 #include "fmt-conversion.h"
 #include "csputils.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
 #include "video/filter/vf.h"
 #include "osdep/endian.h"
 
@@ -45,6 +48,7 @@ struct sws_opts {
     int chr_hshift;
     float chr_sharpen;
     float lum_sharpen;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct sws_opts
@@ -68,6 +72,8 @@ const struct m_sub_options sws_conf = {
         OPT_INT("chs", chr_hshift, 0),
         OPT_FLOATRANGE("ls", lum_sharpen, 0, -100.0, 100.0),
         OPT_FLOATRANGE("cs", chr_sharpen, 0, -100.0, 100.0),
+        OPT_CHOICE_OR_INT("threads", threads, 0, 1, MP_SWS_MAX_THREADS,
+                          ({"auto", 0})),
         {0}
     },
     .size = sizeof(struct sws_opts),
@@ -95,6 +101,8 @@ void mp_sws_set_from_cmdline(struct mp_sws_context *ctx, struct sws_opts *opts)
 
     ctx->flags = SWS_PRINT_INFO;
     ctx->flags |= opts->scaler;
+
+    ctx->threads = opts->threads;
 }
 
 bool mp_sws_supported_format(int imgfmt)
@@ -125,9 +133,54 @@ static bool cache_valid(struct mp_sws_context *ctx)
            ctx->saturation == old->saturation;
 }
 
+// Slice threading: if the source and destination have the same height (format
+// conversion and horizontal scaling), the image is split into horizontal bands,
+// each converted by its own SwsContext. Each band also converts SLICE_ALIGN
+// rows above and below it into a temporary image, and only the inner part is
+// copied to the destination, so vertical chroma filtering works the same as
+// when converting the whole image at once.
+#define SLICE_ALIGN 16
+// Roughly the output size at which another thread is worth it.
+#define SLICE_PIXELS (256 * 1024)
+
+struct sws_slice {
+    struct mp_sws_slices *owner;
+    struct SwsContext *sws;
+    int y0, y1;                 // destination rows of this band
+    int m0, m1;                 // rows converted (y0/y1 plus margins)
+    struct mp_image *tmp;       // m1-m0 rows
+};
+
+struct mp_sws_slices {
+    struct mp_thread_pool *pool;
+    struct sws_slice *slices;
+    int num_slices;
+
+    // Set for the duration of a mp_sws_scale() call.
+    struct mp_image *src, *dst;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int pending;                // protected by lock
+};
+
+static void free_slices(void *p)
+{
+    struct mp_sws_slices *sl = p;
+    // Joins the threads.
+    talloc_free(sl->pool);
+    for (int n = 0; n < sl->num_slices; n++) {
+        sws_freeContext(sl->slices[n].sws);
+        talloc_free(sl->slices[n].tmp);
+    }
+    pthread_cond_destroy(&sl->wakeup);
+    pthread_mutex_destroy(&sl->lock);
+}
+
 static void free_mp_sws(void *p)
 {
     struct mp_sws_context *ctx = p;
+    TA_FREEP(&ctx->slices);
     sws_freeContext(ctx->sws);
     sws_freeFilter(ctx->src_filter);
     sws_freeFilter(ctx->dst_filter);
@@ -145,53 +198,44 @@ struct mp_sws_context *mp_sws_alloc(void *talloc_ctx)
         .saturation = 1 << 16,
         .force_reload = true,
         .params = {SWS_PARAM_DEFAULT, SWS_PARAM_DEFAULT},
+        .threads = 1,
         .cached = talloc_zero(ctx, struct mp_sws_context),
     };
     talloc_set_destructor(ctx, free_mp_sws);
     return ctx;
 }
 
-// Reinitialize (if needed) - return error code.
-// Optional, but possibly useful to avoid having to handle mp_sws_scale errors.
-int mp_sws_reinit(struct mp_sws_context *ctx)
+// Create a SwsContext for ctx->src/ctx->dst, but with the given heights (for
+// slice threading, which converts bands of the image).
+static struct SwsContext *create_sws(struct mp_sws_context *ctx, int src_h,
+                                     int dst_h)
 {
     struct mp_image_params *src = &ctx->src;
     struct mp_image_params *dst = &ctx->dst;
 
-    // Neutralize unsupported or ignored parameters.
-    src->p_w = dst->p_w = 0;
-    src->p_h = dst->p_h = 0;
-
-    if (cache_valid(ctx))
-        return 0;
-
-    sws_freeContext(ctx->sws);
-    ctx->sws = sws_alloc_context();
-    if (!ctx->sws)
-        return -1;
-
-    mp_image_params_guess_csp(src); // sanitize colorspace/colorlevels
-    mp_image_params_guess_csp(dst);
-
     struct mp_imgfmt_desc src_fmt = mp_imgfmt_get_desc(src->imgfmt);
     struct mp_imgfmt_desc dst_fmt = mp_imgfmt_get_desc(dst->imgfmt);
     if (!src_fmt.id || !dst_fmt.id)
-        return -1;
+        return NULL;
 
     enum AVPixelFormat s_fmt = imgfmt2pixfmt(src->imgfmt);
     if (s_fmt == AV_PIX_FMT_NONE || sws_isSupportedInput(s_fmt) < 1) {
         MP_ERR(ctx, "Input image format %s not supported by libswscale.\n",
                mp_imgfmt_to_name(src->imgfmt));
-        return -1;
+        return NULL;
     }
 
     enum AVPixelFormat d_fmt = imgfmt2pixfmt(dst->imgfmt);
     if (d_fmt == AV_PIX_FMT_NONE || sws_isSupportedOutput(d_fmt) < 1) {
         MP_ERR(ctx, "Output image format %s not supported by libswscale.\n",
                mp_imgfmt_to_name(dst->imgfmt));
-        return -1;
+        return NULL;
     }
 
+    struct SwsContext *sws = sws_alloc_context();
+    if (!sws)
+        return NULL;
+
     int s_csp = mp_csp_to_sws_colorspace(src->color.space);
     int s_range = src->color.levels == MP_CSP_LEVELS_PC;
 
@@ -204,42 +248,70 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     s_range = s_range && (src_fmt.flags & MP_IMGFLAG_YUV);
     d_range = d_range && (dst_fmt.flags & MP_IMGFLAG_YUV);
 
-    av_opt_set_int(ctx->sws, "sws_flags", ctx->flags, 0);
+    av_opt_set_int(sws, "sws_flags", ctx->flags, 0);
 
-    av_opt_set_int(ctx->sws, "srcw", src->w, 0);
-    av_opt_set_int(ctx->sws, "srch", src->h, 0);
-    av_opt_set_int(ctx->sws, "src_format", s_fmt, 0);
+    av_opt_set_int(sws, "srcw", src->w, 0);
+    av_opt_set_int(sws, "srch", src_h, 0);
+    av_opt_set_int(sws, "src_format", s_fmt, 0);
 
-    av_opt_set_int(ctx->sws, "dstw", dst->w, 0);
-    av_opt_set_int(ctx->sws, "dsth", dst->h, 0);
-    av_opt_set_int(ctx->sws, "dst_format", d_fmt, 0);
+    av_opt_set_int(sws, "dstw", dst->w, 0);
+    av_opt_set_int(sws, "dsth", dst_h, 0);
+    av_opt_set_int(sws, "dst_format", d_fmt, 0);
 
-    av_opt_set_double(ctx->sws, "param0", ctx->params[0], 0);
-    av_opt_set_double(ctx->sws, "param1", ctx->params[1], 0);
+    av_opt_set_double(sws, "param0", ctx->params[0], 0);
+    av_opt_set_double(sws, "param1", ctx->params[1], 0);
 
 #if LIBAVCODEC_VERSION_MICRO >= 100
     int cr_src = mp_chroma_location_to_av(src->chroma_location);
     int cr_dst = mp_chroma_location_to_av(dst->chroma_location);
     int cr_xpos, cr_ypos;
     if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_src) >= 0) {
-        av_opt_set_int(ctx->sws, "src_h_chr_pos", cr_xpos, 0);
-        av_opt_set_int(ctx->sws, "src_v_chr_pos", cr_ypos, 0);
+        av_opt_set_int(sws, "src_h_chr_pos", cr_xpos, 0);
+        av_opt_set_int(sws, "src_v_chr_pos", cr_ypos, 0);
     }
     if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_dst) >= 0) {
-        av_opt_set_int(ctx->sws, "dst_h_chr_pos", cr_xpos, 0);
-        av_opt_set_int(ctx->sws, "dst_v_chr_pos", cr_ypos, 0);
+        av_opt_set_int(sws, "dst_h_chr_pos", cr_xpos, 0);
+        av_opt_set_int(sws, "dst_v_chr_pos", cr_ypos, 0);
     }
 #endif
 
     // This can fail even with normal operation, e.g. if a conversion path
     // simply does not support these settings.
     int r =
-        sws_setColorspaceDetails(ctx->sws, sws_getCoefficients(s_csp), s_range,
+        sws_setColorspaceDetails(sws, sws_getCoefficients(s_csp), s_range,
                                  sws_getCoefficients(d_csp), d_range,
                                  ctx->brightness, ctx->contrast, ctx->saturation);
     ctx->supports_csp = r >= 0;
 
-    if (sws_init_context(ctx->sws, ctx->src_filter, ctx->dst_filter) < 0)
+    if (sws_init_context(sws, ctx->src_filter, ctx->dst_filter) < 0) {
+        sws_freeContext(sws);
+        return NULL;
+    }
+    return sws;
+}
+
+// Reinitialize (if needed) - return error code.
+// Optional, but possibly useful to avoid having to handle mp_sws_scale errors.
+int mp_sws_reinit(struct mp_sws_context *ctx)
+{
+    struct mp_image_params *src = &ctx->src;
+    struct mp_image_params *dst = &ctx->dst;
+
+    // Neutralize unsupported or ignored parameters.
+    src->p_w = dst->p_w = 0;
+    src->p_h = dst->p_h = 0;
+
+    if (cache_valid(ctx))
+        return 0;
+
+    TA_FREEP(&ctx->slices);
+    sws_freeContext(ctx->sws);
+
+    mp_image_params_guess_csp(src); // sanitize colorspace/colorlevels
+    mp_image_params_guess_csp(dst);
+
+    ctx->sws = create_sws(ctx, src->h, dst->h);
+    if (!ctx->sws)
         return -1;
 
     ctx->force_reload = false;
@@ -247,6 +319,115 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     return 1;
 }
 
+static int get_num_slices(struct mp_sws_context *ctx)
+{
+    struct mp_image_params *src = &ctx->src;
+    struct mp_image_params *dst = &ctx->dst;
+
+    if (ctx->threads == 1 || src->h != dst->h)
+        return 1;
+    // Filters with a large (or user-defined) support would need more margin;
+    // error diffusion depends on the previous rows.
+    if (ctx->src_filter || ctx->dst_filter ||
+        (ctx->flags & (SWS_X | SWS_GAUSS | SWS_SINC | SWS_ERROR_DIFFUSE)))
+        return 1;
+    struct mp_imgfmt_desc src_fmt = mp_imgfmt_get_desc(src->imgfmt);
+    struct mp_imgfmt_desc dst_fmt = mp_imgfmt_get_desc(dst->imgfmt);
+    if (!(src_fmt.flags & dst_fmt.flags & MP_IMGFLAG_BYTE_ALIGNED))
+        return 1;
+
+    int max = ctx->threads > 0 ? ctx->threads : av_cpu_count();
+    int num = MPMIN((int64_t)dst->w * dst->h / SLICE_PIXELS,
+                    MPMIN(max, MP_SWS_MAX_THREADS));
+    // Every band should be some multiple of the margin.
+    num = MPMIN(num, dst->h / (SLICE_ALIGN * 4));
+    return MPMAX(num, 1);
+}
+
+static bool init_slices(struct mp_sws_context *ctx, int num)
+{
+    if (ctx->slices && ctx->slices->num_slices == num)
+        return true;
+    TA_FREEP(&ctx->slices);
+
+    struct mp_sws_slices *sl = talloc_zero(NULL, struct mp_sws_slices);
+    pthread_mutex_init(&sl->lock, NULL);
+    pthread_cond_init(&sl->wakeup, NULL);
+    talloc_set_destructor(sl, free_slices);
+    ctx->slices = sl;
+
+    // The calling thread converts the first band.
+    sl->pool = mp_thread_pool_create(NULL, num - 1);
+    if (!sl->pool)
+        goto error;
+
+    int h = ctx->dst.h;
+    int band = MP_ALIGN_UP(h / num, SLICE_ALIGN);
+    sl->slices = talloc_zero_array(sl, struct sws_slice, num);
+    for (int n = 0; n < num; n++) {
+        struct sws_slice *s = &sl->slices[n];
+        s->owner = sl;
+        s->y0 = MPMIN(n * band, h);
+        s->y1 = n == num - 1 ? h : MPMIN((n + 1) * band, h);
+        s->m0 = MPMAX(s->y0 - SLICE_ALIGN, 0);
+        s->m1 = MPMIN(s->y1 + SLICE_ALIGN, h);
+        sl->num_slices++;
+        if (s->y0 >= s->y1)
+            continue;
+        s->sws = create_sws(ctx, s->m1 - s->m0, s->m1 - s->m0);
+        s->tmp = mp_image_alloc(ctx->dst.imgfmt, ctx->dst.w, s->m1 - s->m0);
+        if (!s->sws || !s->tmp)
+            goto error;
+    }
+    return true;
+
+error:
+    MP_VERBOSE(ctx, "Could not set up slice threading.\n");
+    TA_FREEP(&ctx->slices);
+    return false;
+}
+
+static void scale_slice(void *ptr)
+{
+    struct sws_slice *s = ptr;
+    struct mp_sws_slices *sl = s->owner;
+
+    if (s->sws) {
+        struct mp_image src = *sl->src;
+        mp_image_crop(&src, 0, s->m0, src.w, s->m1);
+        sws_scale(s->sws, (const uint8_t *const *) src.planes, src.stride,
+                  0, src.h, s->tmp->planes, s->tmp->stride);
+
+        struct mp_image tmp = *s->tmp;
+        mp_image_crop(&tmp, 0, s->y0 - s->m0, tmp.w, s->y1 - s->m0);
+        struct mp_image dst = *sl->dst;
+        mp_image_crop(&dst, 0, s->y0, dst.w, s->y1);
+        mp_image_copy(&dst, &tmp);
+    }
+
+    pthread_mutex_lock(&sl->lock);
+    sl->pending -= 1;
+    pthread_cond_signal(&sl->wakeup);
+    pthread_mutex_unlock(&sl->lock);
+}
+
+static void scale_slices(struct mp_sws_slices *sl, struct mp_image *dst,
+                         struct mp_image *src)
+{
+    sl->src = src;
+    sl->dst = dst;
+    sl->pending = sl->num_slices;
+    for (int n = 1; n < sl->num_slices; n++)
+        mp_thread_pool_queue(sl->pool, scale_slice, &sl->slices[n]);
+    scale_slice(&sl->slices[0]);
+
+    pthread_mutex_lock(&sl->lock);
+    while (sl->pending)
+        pthread_cond_wait(&sl->wakeup, &sl->lock);
+    pthread_mutex_unlock(&sl->lock);
+    sl->src = sl->dst = NULL;
+}
+
 // Scale from src to dst - if src/dst have different parameters from previous
 // calls, the context is reinitialized. Return error code. (It can fail if
 // reinitialization was necessary, and swscale returned an error.)
@@ -262,6 +443,12 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
         return r;
     }
 
+    int num = get_num_slices(ctx);
+    if (num > 1 && init_slices(ctx, num)) {
+        scale_slices(ctx->slices, dst, src);
+        return 0;
+    }
+
     sws_scale(ctx->sws, (const uint8_t *const *) src->planes, src->stride,
               0, src->h, dst->planes, dst->stride);
     return 0;
@@ -272,6 +459,7 @@ int mp_image_swscale(struct mp_image *dst, struct mp_image *src,
 {
     struct mp_sws_context *ctx = mp_sws_alloc(NULL);
     ctx->flags = my_sws_flags;
+    ctx->threads = 0;
     int res = mp_sws_scale(ctx, dst, src);
     talloc_free(ctx);
     return res;
@@ -13,6 +13,9 @@ struct sws_opts;
 // Guaranteed to be a power of 2 and > 1.
 #define SWS_MIN_BYTE_ALIGN 16
 
+// Upper limit for mp_sws_context.threads.
+#define MP_SWS_MAX_THREADS 16
+
 extern const int mp_sws_hq_flags;
 extern const int mp_sws_fast_flags;
 
@@ -32,6 +35,9 @@ struct mp_sws_context {
     int flags;
     int brightness, contrast, saturation;
     bool force_reload;
+    // Maximum number of threads for slice threading (0: pick a number from the
+    // output size, 1: disable). mp_sws_alloc() sets it to 1.
+    int threads;
     // These are also implicitly set by mp_sws_scale(), and thus optional.
     // Setting them before that call makes sense when using mp_sws_reinit().
     struct mp_image_params src, dst;
@@ -48,6 +54,9 @@ struct mp_sws_context {
 
     // Contains parameters for which sws is valid
     struct mp_sws_context *cached;
+
+    // Per-band contexts and thread pool, if slice threading is used.
+    struct mp_sws_slices *slices;
 };
 
 struct mp_sws_context *mp_sws_alloc(void *talloc_ctx);
@@ -129,6 +129,12 @@ def build(ctx):
         ctx.wayland_protocol_header(proto_dir = ctx.env.WL_PROTO_DIR,
             protocol  = "unstable/idle-inhibit/idle-inhibit-unstable-v1",
             target    = "video/out/wayland/idle-inhibit-v1.h")
+        ctx.wayland_protocol_code(proto_dir = ctx.env.WL_PROTO_DIR,
+            protocol  = "stable/presentation-time/presentation-time",
+            target    = "video/out/wayland/presentation-time.c")
+        ctx.wayland_protocol_header(proto_dir = ctx.env.WL_PROTO_DIR,
+            protocol  = "stable/presentation-time/presentation-time",
+            target    = "video/out/wayland/presentation-time.h")
         ctx.wayland_protocol_code(proto_dir = "../video/out/wayland",
             protocol = "server-decoration",
             target   = "video/out/wayland/srv-decor.c")
@@ -229,8 +235,10 @@ def build(ctx):
         ( "common/codecs.c" ),
         ( "common/encode_lavc.c",                "encoding" ),
         ( "common/common.c" ),
+        ( "common/mem_budget.c" ),
         ( "common/tags.c" ),
         ( "common/msg.c" ),
+        ( "common/perf.c" ),
         ( "common/playlist.c" ),
         ( "common/recorder.c" ),
         ( "common/version.c" ),
@@ -270,8 +278,11 @@ def build(ctx):
         ## Misc
         ( "misc/bstr.c" ),
         ( "misc/charset_conv.c" ),
+        ( "misc/dec_thread.c" ),
         ( "misc/dispatch.c" ),
         ( "misc/json.c" ),
+        ( "misc/kv_store.c" ),
+        ( "misc/msgpack.c" ),
         ( "misc/node.c" ),
         ( "misc/ring.c" ),
         ( "misc/rendezvous.c" ),
@@ -300,6 +311,7 @@ def build(ctx):
         ( "player/javascript.c",                 "javascript" ),
         ( "player/osd.c" ),
         ( "player/playloop.c" ),
+        ( "player/preview.c" ),
         ( "player/screenshot.c" ),
         ( "player/scripting.c" ),
         ( "player/sub.c" ),
@@ -313,6 +325,7 @@ def build(ctx):
         ( "stream/cache.c" ),
         ( "stream/cache_file.c" ),
         ( "stream/cookies.c" ),
+        ( "stream/disc_cache.c" ),
         ( "stream/dvb_tune.c",                   "dvbin" ),
         ( "stream/frequencies.c",                "tv" ),
         ( "stream/rar.c" ),
@@ -355,6 +368,7 @@ def build(ctx):
         ## Video
         ( "video/csputils.c" ),
         ( "video/fmt-conversion.c" ),
+        ( "video/gpu_memcpy.c" ),
         ( "video/image_loader.c" ),
         ( "video/image_writer.c" ),
         ( "video/img_format.c" ),
@@ -381,6 +395,7 @@ def build(ctx):
         ( "video/filter/vf_flip.c",              "gpl" ),
         ( "video/filter/vf_format.c",            "gpl" ),
         ( "video/filter/vf_gradfun.c",           "gpl" ),
+        ( "video/filter/vf_hwmap.c",             "vaapi && drmprime" ),
         ( "video/filter/vf_lavfi.c" ),
         ( "video/filter/vf_mirror.c",            "gpl" ),
         ( "video/filter/vf_noformat.c",          "gpl" ),
@@ -461,7 +476,9 @@ def build(ctx):
         ( "video/out/vo_gpu.c" ),
         ( "video/out/vo_opengl_cb.c",            "gl" ),
         ( "video/out/vo_sdl.c",                  "sdl2" ),
+        ( "video/out/vo_shm.c",                  "posix" ),
         ( "video/out/vo_tct.c" ),
+        ( "video/out/vo_tee.c" ),
         ( "video/out/vo_vaapi.c",                "vaapi-x11 && gpl" ),
         ( "video/out/vo_vdpau.c",                "vdpau" ),
         ( "video/out/vo_x11.c" ,                 "x11" ),
@@ -478,10 +495,13 @@ def build(ctx):
         ( "video/out/vulkan/context_wayland.c",  "vulkan && wayland" ),
         ( "video/out/vulkan/context_win.c",      "vulkan && win32-desktop" ),
         ( "video/out/vulkan/spirv_nvidia.c",     "vulkan" ),
+        ( "video/out/vulkan/hwdec_vaapi_vk.c",   "vaapi-vulkan" ),
+        ( "video/out/vulkan/hwdec_cuda_vk.c",    "cuda-vulkan" ),
         ( "video/out/win32/exclusive_hack.c",    "gl-win32" ),
         ( "video/out/wayland_common.c",          "wayland" ),
         ( "video/out/wayland/xdg-shell-v6.c",    "wayland" ),
         ( "video/out/wayland/idle-inhibit-v1.c", "wayland" ),
+        ( "video/out/wayland/presentation-time.c", "wayland" ),
         ( "video/out/wayland/srv-decor.c",       "wayland" ),
         ( "video/out/win_state.c"),
         ( "video/out/x11_common.c",              "x11" ),
@@ -669,7 +689,8 @@ def build(ctx):
             PRIV_LIBS    = get_deps(),
         )
 
-        headers = ["client.h", "qthelper.hpp", "opengl_cb.h", "stream_cb.h"]
+        headers = ["client.h", "qthelper.hpp", "opengl_cb.h", "stream_cb.h",
+                   "frame_shm.h"]
         for f in headers:
             ctx.install_as(ctx.env.INCDIR + '/mpv/' + f, 'libmpv/' + f)
 